@@ -71,5 +71,6 @@
 #include <ipfixcol/api.h>
 #include <ipfixcol/ipfix_message.h>
 #include <ipfixcol/ipfix_element.h>
+#include <ipfixcol/statistics.h>
 
 #endif /* IPFIXCOL_H_ */
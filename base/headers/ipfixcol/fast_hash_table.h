@@ -48,6 +48,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "api.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -65,11 +67,11 @@ extern "C" {
 /**
  * Lookup tables.
  */
-extern uint8_t lt_free_flag[];
-extern uint8_t lt_pow_of_two[];
-extern uint8_t lt_replacement_vector[][4];
-extern uint8_t lt_replacement_vector_remove[][4];
-extern uint8_t lt_replacement_index[];
+extern API uint8_t lt_free_flag[];
+extern API uint8_t lt_pow_of_two[];
+extern API uint8_t lt_replacement_vector[][4];
+extern API uint8_t lt_replacement_vector_remove[][4];
+extern API uint8_t lt_replacement_index[];
 
 /**
  * Constants used for table functions.
@@ -172,7 +174,7 @@ typedef struct
  * @return Pointer to the structure of the hash table, NULL if the memory couldn't be allocated
  *         or parameters do not meet requirements.
  */
-fht_table_t * fht_init(uint32_t table_rows, uint32_t key_size, uint32_t data_size, uint32_t stash_size);
+API fht_table_t * fht_init(uint32_t table_rows, uint32_t key_size, uint32_t data_size, uint32_t stash_size);
 
 /**
  * \brief Function for inserting the item into the table without using stash.
@@ -197,7 +199,7 @@ fht_table_t * fht_init(uint32_t table_rows, uint32_t key_size, uint32_t data_siz
  *                      FHT_INSERT_LOST if the inserted item pulled out the oldest item in the row of the table.
  *                      FHT_INSERT_FAILED if there already is an item with such key in the table.
  */
-int fht_insert(fht_table_t *table, const void *key, const void *data, void *key_lost, void *data_lost);
+API int fht_insert(fht_table_t *table, const void *key, const void *data, void *key_lost, void *data_lost);
 
 /**
  * \brief Function for inserting the item into the table without using stash
@@ -211,7 +213,7 @@ int fht_insert(fht_table_t *table, const void *key, const void *data, void *key_
  *                      FHT_INSERT_FAILED if there already is an item with such key in the table.
  *                      FHT_INSERT_FULL if the row where the item should be placed is full.
  */
-int fht_insert_wr(fht_table_t *table, const void *key, const void *data);
+API int fht_insert_wr(fht_table_t *table, const void *key, const void *data);
 
 /**
  * \brief Function for inserting the item into the table using stash.
@@ -241,7 +243,7 @@ int fht_insert_wr(fht_table_t *table, const void *key, const void *data);
  *                      FHT_INSERT_STASH_LOST if item inserted in stash replaced an item in stash.
  *                      FHT_INSERT_FAILED if there already is an item with such key in the table.
  */
-int fht_insert_with_stash(fht_table_t *table, const void *key, const void *data, void *key_lost, void *data_lost);
+API int fht_insert_with_stash(fht_table_t *table, const void *key, const void *data, void *key_lost, void *data_lost);
 
 /**
  * \brief Function for inserting the item into the table using stash
@@ -257,7 +259,7 @@ int fht_insert_with_stash(fht_table_t *table, const void *key, const void *data,
  *                      FHT_INSERT_FAILED if there already is an item with such key in the table.
  *                      FHT_INSERT_FULL if the row where the item should be placed is full.
  */
-int fht_insert_with_stash_wr(fht_table_t *table, const void *key, const void *data);
+API int fht_insert_with_stash_wr(fht_table_t *table, const void *key, const void *data);
 
 /**
  * \brief Function for getting data from the table without looking for in stash, looks for by key.
@@ -341,7 +343,7 @@ static inline void * fht_get_data(fht_table_t *table, const void *key)
  * @return          Pointer to data if found.
  *                  NULL if not found.
  */
-inline void * fht_get_data_locked(fht_table_t *table, const void *key, int8_t **lock)
+static inline void * fht_get_data_locked(fht_table_t *table, const void *key, int8_t **lock)
 {
    unsigned long long table_row = (table->table_rows - 1) & (table->hash_function)(key, table->key_size);
    unsigned long long table_col_row = table_row * FHT_TABLE_COLS;
@@ -403,7 +405,7 @@ inline void * fht_get_data_locked(fht_table_t *table, const void *key, int8_t **
  * @return          Pointer to data if found.
  *                  NULL if not found.
  */
-inline void * fht_get_data_with_stash(fht_table_t *table, const void *key)
+static inline void * fht_get_data_with_stash(fht_table_t *table, const void *key)
 {
    unsigned long long table_row = (table->table_rows - 1) & (table->hash_function)(key, table->key_size);
    unsigned long long table_col_row = table_row * FHT_TABLE_COLS;
@@ -491,7 +493,7 @@ inline void * fht_get_data_with_stash(fht_table_t *table, const void *key)
  * @return          Pointer to data if found.
  *                  NULL if not found.
  */
-inline void * fht_get_data_with_stash_locked(fht_table_t *table, const void *key, int8_t **lock)
+static inline void * fht_get_data_with_stash_locked(fht_table_t *table, const void *key, int8_t **lock)
 {
    unsigned long long table_row = (table->table_rows - 1) & (table->hash_function)(key, table->key_size);
    unsigned long long table_col_row = table_row * FHT_TABLE_COLS;
@@ -568,7 +570,7 @@ inline void * fht_get_data_with_stash_locked(fht_table_t *table, const void *key
  * @return              0 if item is found and removed.
  *                      1 if item is not found and not removed.
  */
-int fht_remove(fht_table_t *table, const void *key);
+API int fht_remove(fht_table_t *table, const void *key);
 
 /**
  * \brief Function for removing item from the table without looking for in stash.
@@ -582,7 +584,7 @@ int fht_remove(fht_table_t *table, const void *key);
  * @return              0 if item is found. Item is removed and ROW IS UNLOCKED!!
  *                      1 if item is not found and not removed. ROW REMAINS LOCKED!!
  */
-int fht_remove_locked(fht_table_t *table, const void *key, int8_t *lock_ptr);
+API int fht_remove_locked(fht_table_t *table, const void *key, int8_t *lock_ptr);
 
 /**
  * \brief Function for removing item from the table with looking for in stash.
@@ -597,7 +599,7 @@ int fht_remove_locked(fht_table_t *table, const void *key, int8_t *lock_ptr);
  * @return              0 if item is found and removed.
  *                      1 if item is not found and not removed.
  */
-int fht_remove_with_stash(fht_table_t *table, const void *key);
+API int fht_remove_with_stash(fht_table_t *table, const void *key);
 
 /**
  * \brief Function for removing item from the table with looking for in stash.
@@ -611,7 +613,7 @@ int fht_remove_with_stash(fht_table_t *table, const void *key);
  * @return              0 if item is found. Item is removed and ROW/STASH IS UNLOCKED!!
  *                      1 if item is not found and not removed. ROW/STASH REMAINS LOCKED!!
  */
-int fht_remove_with_stash_locked(fht_table_t *table, const void *key, int8_t *lock_ptr);
+API int fht_remove_with_stash_locked(fht_table_t *table, const void *key, int8_t *lock_ptr);
 
 /**
  * \brief Function for removing actual item from the table when using iterator.
@@ -621,7 +623,7 @@ int fht_remove_with_stash_locked(fht_table_t *table, const void *key, int8_t *lo
  * @return              0 if item is removed.
  *                      1 if item is not removed.
  */
-int fht_remove_iter(fht_iter_t *iter);
+API int fht_remove_iter(fht_iter_t *iter);
 
 /**
  * \brief Function for clearing the table.
@@ -631,7 +633,7 @@ int fht_remove_iter(fht_iter_t *iter);
  *
  * @param table     Pointer to the hash table structure.
  */
-void fht_clear(fht_table_t *table);
+API void fht_clear(fht_table_t *table);
 
 /**
  * \brief Function for destroying the table and freeing memory.
@@ -640,14 +642,14 @@ void fht_clear(fht_table_t *table);
  *
  * @param table     Pointer to the hash table structure.
  */
-void fht_destroy(fht_table_t *table);
+API void fht_destroy(fht_table_t *table);
 
 /**
  * \brief Function for unlocking table row/stash.
  *
  * @param lock      Pointer to lock variable.
  */
-inline void fht_unlock_data(int8_t *lock)
+static inline void fht_unlock_data(int8_t *lock)
 {
    __sync_lock_release(lock);
 }
@@ -660,14 +662,14 @@ inline void fht_unlock_data(int8_t *lock)
  * @return          Pointer to the iterator structure.
  *                  NULL if could not allocate memory.
  */
-fht_iter_t * fht_init_iter(fht_table_t *table);
+API fht_iter_t * fht_init_iter(fht_table_t *table);
 
 /**
  * \brief Function for reinitializing iterator for the table.
  *
  * @param iter      Pointer to the existing iterator.
  */
-void fht_reinit_iter(fht_iter_t *iter);
+API void fht_reinit_iter(fht_iter_t *iter);
 
 /**
  * \brief Function for getting next item in the table.
@@ -678,7 +680,7 @@ void fht_reinit_iter(fht_iter_t *iter);
  *                  FHT_ITER_RET_END if iterator is in the end of the table and does not
  *                  contain any other item.
  */
-int32_t fht_get_next_iter(fht_iter_t *iter);
+API int32_t fht_get_next_iter(fht_iter_t *iter);
 
 /**
  * \brief Function for destroying iterator and freeing memory.
@@ -688,7 +690,7 @@ int32_t fht_get_next_iter(fht_iter_t *iter);
  *
  * @param iter      Pointer to the iterator structure.
  */
-void fht_destroy_iter(fht_iter_t *iter);
+API void fht_destroy_iter(fht_iter_t *iter);
 
 #ifdef __cplusplus
 }
@@ -55,6 +55,19 @@
 
 #include "api.h"
 
+/**
+ * \brief Declare that the plugin can be replicated
+ *
+ * Plugins with this declaration can run in more instances (replicas, see
+ * \<replicas\> element of plugin's configuration) taking alternate messages
+ * from one input queue. Each replica gets its own configuration from
+ * intermediate_init(). The plugin must not depend on previous messages and
+ * must call "pass_message" and "drop_message" only from
+ * intermediate_process_message(). Passed messages are restored to the order
+ * of the input queue.
+ */
+#define IPFIXCOL_INTERMEDIATE_REPLICABLE unsigned int intermediate_replicable API __attribute__((used)) = 1;
+
 /**
  * \brief Initialize intermediate plugin
  * 
@@ -95,6 +108,26 @@ API int intermediate_close(void *config);
  */
 API int intermediate_process_message(void *config, void *message);
 
+/** Maximal number of messages passed to intermediate_process_batch() */
+#define INTERMEDIATE_BATCH_MAX 64
+
+/**
+ * \brief Process a batch of IPFIX messages (optional)
+ *
+ * When the plugin provides this function, it is called instead of
+ * intermediate_process_message() with up to INTERMEDIATE_BATCH_MAX
+ * consecutive messages of the input queue. Each message must be passed or
+ * dropped ("pass_messages" and "drop_messages" handle more of them at once).
+ * Passed messages are written into the output queue together when the
+ * function returns.
+ *
+ * \param[in] config
+ * \param[in] messages Array of IPFIX messages
+ * \param[in] count Number of messages
+ * \return 0 on success, nonzero else.
+ */
+API int intermediate_process_batch(void *config, void **messages, int count);
+
 /**
 * \brief Pass processed IPFIX message to the output queue.
 *
@@ -115,6 +148,41 @@ API int pass_message(void *config, struct ipfix_message *message);
 */
 API int drop_message(void *config, struct ipfix_message *message);
 
+/**
+* \brief Pass more processed IPFIX messages to the output queue.
+*
+* \param[in] config configuration structure
+* \param[in] messages IPFIX messages
+* \param[in] count Number of messages
+* \return 0 on success, negative value otherwise
+*/
+API int pass_messages(void *config, struct ipfix_message **messages, int count);
+
+/**
+* \brief Drop more IPFIX messages.
+*
+* Intended for intermediate_process_batch(), intermediate_process_message()
+* can drop only its own message.
+*
+* \param[in] config configuration structure
+* \param[in] messages IPFIX messages
+* \param[in] count Number of messages
+* \return 0 on success, negative value otherwise
+*/
+API int drop_messages(void *config, struct ipfix_message **messages, int count);
+
+/**
+ * \brief Get occupancy of queues after the plugin
+ *
+ * Maximum of the output queue of the plugin, the input queue of the Output
+ * Manager and the queues of storage plugins. Queues fill up from the slowest
+ * consumer, so the value shows whether the rest of the pipeline keeps up.
+ *
+ * \param[in] config configuration structure
+ * \return Occupancy in per mille (0 - 1000)
+ */
+API unsigned int pipeline_load(void *config);
+
 #endif /* IPFIXCOL_INTERMEDIATE_H_ */
 
 /**@}*/
@@ -48,6 +48,8 @@
 #ifndef IPFIX_MESSAGE_H_
 #define IPFIX_MESSAGE_H_
 
+#include <string.h>
+
 #include "api.h"
 #include "input.h"
 #include "templates.h"
@@ -60,6 +62,22 @@ struct __attribute__((__packed__)) ipfix_template_row {
 	uint16_t id, length;
 };
 
+/**
+ * \brief Flow key of a data record (addresses, ports and protocol)
+ *
+ * ODID is not a part of the key, the same flow from more exporters has
+ * the same key. IPv4 addresses use the first 4 bytes of address arrays.
+ */
+struct ipfix_flow_key {
+	uint8_t src_addr[16];
+	uint8_t dst_addr[16];
+	uint16_t src_port;
+	uint16_t dst_port;
+	uint8_t protocol;
+	uint8_t ipv6;
+	uint8_t padding[2];
+};
+
 /**
  * \brief Create ipfix_message structure from data in memory
  *
@@ -299,6 +317,149 @@ API void message_free_metadata(struct ipfix_message *msg);
  */
 API struct metadata *message_copy_metadata(struct ipfix_message *src);
 
+/**
+ * \brief Register an enrichment field
+ *
+ * Intermediate plugins register their virtual fields once (during
+ * initialization) and then store values of the fields into messages using
+ * enrich_value_set(). Registration of an already registered field returns
+ * the same column. Values are visible only to storage plugins declaring
+ * IPFIXCOL_STORAGE_ENRICHMENT, others are refused while any field is
+ * registered.
+ *
+ * \param[in] enterprise Enterprise number
+ * \param[in] id Field ID
+ * \param[in] length Length of each value
+ * \return Column of the field on success, negative value otherwise (no free
+ * column or the field is already registered with a different length)
+ */
+API int enrich_field_register(uint32_t enterprise, uint16_t id, uint16_t length);
+
+/**
+ * \brief Get number of registered enrichment fields
+ *
+ * \return Number of fields (columns are numbered from 0)
+ */
+API int enrich_field_count();
+
+/**
+ * \brief Get description of an enrichment field
+ *
+ * \param[in] column Column of the field
+ * \return Field description or NULL if the column is not registered
+ */
+API const struct enrich_field *enrich_field_get(int column);
+
+/**
+ * \brief Store value of an enrichment field of a record
+ *
+ * The side buffer of the message is allocated when the first value of
+ * the column is stored.
+ *
+ * \param[in,out] msg IPFIX message
+ * \param[in] column Column of the field
+ * \param[in] record Index of the record (in metadata)
+ * \param[in] value Value (length of the field)
+ * \return 0 on success, negative value otherwise
+ */
+API int enrich_value_set(struct ipfix_message *msg, int column, uint16_t record, const void *value);
+
+/**
+ * \brief Get value of an enrichment field of a record
+ *
+ * \param[in] msg IPFIX message
+ * \param[in] column Column of the field
+ * \param[in] record Index of the record (in metadata)
+ * \return Pointer to the value or NULL if not set
+ */
+API uint8_t *enrich_value_get(const struct ipfix_message *msg, int column, uint16_t record);
+
+/**
+ * \brief Copy all enrichment values of a record to another message
+ *
+ * \param[in,out] dst Destination message
+ * \param[in] dst_record Index of the record in the destination message
+ * \param[in] src Source message
+ * \param[in] src_record Index of the record in the source message
+ * \return 0 on success, negative value otherwise
+ */
+API int enrich_record_copy(struct ipfix_message *dst, uint16_t dst_record, const struct ipfix_message *src, uint16_t src_record);
+
+/**
+ * \brief Free values of enrichment fields of a message
+ *
+ * \param[in] msg IPFIX message
+ */
+API void message_free_enrich(struct ipfix_message *msg);
+
+/**
+ * \brief Get data of a record's field including enrichment fields
+ *
+ * The field is searched in the record first (see data_record_get_field()),
+ * then in the enrichment fields of the message.
+ *
+ * \param[in] msg IPFIX message
+ * \param[in] record Index of the record (in metadata)
+ * \param[in] enterprise Enterprise number
+ * \param[in] id Field id
+ * \param[out] data_length Length of returned data
+ * \return Pointer to field or NULL
+ */
+API uint8_t *message_record_get_field(const struct ipfix_message *msg, uint16_t record, uint32_t enterprise, uint16_t id, int *data_length);
+
+/**
+ * \brief Create a copy of a message without some data records
+ *
+ * Template sets and kept data records are copied into a new packet, data sets
+ * without kept records are left out. Metadata (including channels) of the
+ * kept records are moved to the new message and values of their enrichment
+ * fields are copied. The original message is not modified otherwise and must
+ * be dropped by the caller.
+ *
+ * \param[in] msg IPFIX message
+ * \param[in] remove Flags of data records to remove (indexed as metadata)
+ * \return New message or NULL (nothing left or memory allocation error)
+ */
+API struct ipfix_message *message_remove_records(struct ipfix_message *msg, const uint8_t *remove);
+
+/**
+ * \brief Fill flow key of a data record
+ *
+ * Fields are found by the template offset cache (see data_record_get_field()).
+ * Missing ports and protocol are zero.
+ *
+ * \param[in] record Data record
+ * \param[in] templ Data record's template
+ * \param[out] key Flow key
+ * \return 0 on success, 1 when the record has no addresses
+ */
+API int data_record_flow_key(uint8_t *record, struct ipfix_template *templ, struct ipfix_flow_key *key);
+
+/**
+ * \brief Compute hash of a flow key
+ *
+ * All bits of the hash are mixed, both lower bits (table index) and upper
+ * bits (fingerprints, sampling) can be used.
+ *
+ * \param[in] key Flow key
+ * \return 64-bit hash
+ */
+static inline uint64_t flow_key_hash(const struct ipfix_flow_key *key)
+{
+	const uint8_t *p = (const uint8_t *) key;
+	uint64_t hash = 0, word;
+	size_t i;
+
+	for (i = 0; i < sizeof(*key); i += sizeof(word)) {
+		memcpy(&word, p + i, sizeof(word));
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 29;
+	}
+
+	hash *= 0xBF58476D1CE4E5B9ULL;
+	return hash ^ (hash >> 32);
+}
+
 #endif /* IPFIX_MESSAGE_H_ */
 
 /**@}*/
@@ -0,0 +1,78 @@
+/**
+ * \file statistics.h
+ * \brief Statistics of plugins printed by the collector's statistics thread
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef IPFIXCOL_STATISTICS_H_
+#define IPFIXCOL_STATISTICS_H_
+
+#include <stdio.h>
+
+#include "api.h"
+
+/**
+ * \brief Callback printing statistics of a plugin
+ *
+ * Called periodically from the statistics thread (see -S option). Values
+ * are printed to console with MSG_ALWAYS(" |     ...") lines when \p file
+ * is NULL, otherwise as KEY=value lines into the statistics file.
+ *
+ * \param[in] arg Argument given to statistics_register()
+ * \param[in] file Statistics file or NULL
+ */
+typedef void (*statistics_print_cb)(void *arg, FILE *file);
+
+/**
+ * \brief Register statistics of a plugin
+ *
+ * \param[in] name Name printed before the statistics on console
+ * \param[in] print Callback printing the statistics
+ * \param[in] arg Callback argument, identifies the registration
+ * \return 0 on success
+ */
+API int statistics_register(const char *name, statistics_print_cb print, void *arg);
+
+/**
+ * \brief Unregister statistics of a plugin
+ *
+ * When the function returns, the callback is not running and will not be
+ * called anymore.
+ *
+ * \param[in] arg Argument given to statistics_register()
+ */
+API void statistics_unregister(void *arg);
+
+#endif /* IPFIXCOL_STATISTICS_H_ */
@@ -105,6 +105,35 @@ struct __attribute__((packed)) metadata {
 	char dstName[32];
 };
 
+/** Maximal number of enrichment fields (columns) */
+#define MSG_MAX_ENRICH_COLUMNS 32
+
+/**
+ * \struct enrich_field
+ * \brief Virtual field registered by an intermediate plugin
+ *
+ * Values of the field are not part of data records, they are stored in
+ * a columnar side buffer of the message (see ::enrich_columns).
+ */
+struct enrich_field {
+	uint32_t enterprise;            /**< Enterprise number */
+	uint16_t id;                    /**< Field ID */
+	uint16_t length;                /**< Length of each value */
+};
+
+/**
+ * \struct enrich_columns
+ * \brief Values of enrichment fields of all records in a message
+ *
+ * Columns are indexed by the column returned by enrich_field_register(),
+ * values in a column by the index of the record in the metadata array.
+ */
+struct enrich_columns {
+	uint16_t records;                                   /**< Number of records */
+	uint8_t *values[MSG_MAX_ENRICH_COLUMNS];            /**< Values (NULL = unused column) */
+	uint8_t *present[MSG_MAX_ENRICH_COLUMNS];           /**< Non-zero if the value is set */
+};
+
 /**
  * \struct ipfix_message
  * \brief Structure covering main parts of the IPFIX packet by pointers into it.
@@ -134,8 +163,29 @@ struct __attribute__((__packed__)) ipfix_message {
 	void *live_profile;
 	/** List of metadata structures */
 	struct metadata *metadata;
+	/** Original ODID of a message joined in place by the joinflows plugin */
+	uint32_t                          original_odid;
+	/** Non-zero if original_odid is set */
+	uint8_t                           joined;
+	/** Values of enrichment fields (NULL if there are none) */
+	struct enrich_columns             *enrich;
+	/** Time of receipt (ns, latency tracing, 0 if unknown) */
+	uint64_t                          trace_received;
+	/** Time when the message left the previous stage (ns, latency tracing) */
+	uint64_t                          trace_stage;
 };
 
+/**
+ * \brief Declare that the plugin reads enrichment fields
+ *
+ * Values of enrichment fields (see enrich_field_register()) are not part of
+ * data records, they are only available through message_record_get_field()
+ * and enrich_value_get(). Storage plugins without this declaration are
+ * refused while any enrichment field is registered, since they would silently
+ * lose the values.
+ */
+#define IPFIXCOL_STORAGE_ENRICHMENT unsigned int storage_enrichment API __attribute__((used)) = 1;
+
 /**
  * \brief Storage plugin initialization function.
  *
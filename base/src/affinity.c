@@ -0,0 +1,183 @@
+/**
+ * \file affinity.c
+ * \brief CPU affinity and NUMA placement of collector threads
+ *
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <ipfixcol/verbose.h>
+
+#include "affinity.h"
+
+/** Identifier for MSG_* macros */
+static char *msg_module = "affinity";
+
+/** CPU affinity of the collector */
+static cpu_set_t affinity_default;
+static int affinity_default_set = 0;
+
+/**
+ * \brief Save CPU affinity of the collector
+ */
+void affinity_init()
+{
+	CPU_ZERO(&affinity_default);
+	affinity_default_set = (sched_getaffinity(0, sizeof(affinity_default), &affinity_default) == 0);
+}
+
+/**
+ * \brief Parse CPU list
+ *
+ * \param[in] list CPU list
+ * \param[out] set CPU set
+ * \return 0 on success
+ */
+static int affinity_parse(const char *list, cpu_set_t *set)
+{
+	const char *ptr = list;
+	char *end;
+	long first, last, cpu;
+
+	CPU_ZERO(set);
+
+	while (*ptr) {
+		first = strtol(ptr, &end, 10);
+		if (end == ptr || first < 0) {
+			return 1;
+		}
+
+		last = first;
+		if (*end == '-') {
+			ptr = end + 1;
+			last = strtol(ptr, &end, 10);
+			if (end == ptr || last < first) {
+				return 1;
+			}
+		}
+
+		if (last >= CPU_SETSIZE) {
+			return 1;
+		}
+
+		for (cpu = first; cpu <= last; ++cpu) {
+			CPU_SET(cpu, set);
+		}
+
+		ptr = end;
+		while (*ptr == ' ') {
+			ptr++;
+		}
+
+		if (*ptr == ',') {
+			ptr++;
+		} else if (*ptr) {
+			return 1;
+		}
+	}
+
+	return CPU_COUNT(set) == 0;
+}
+
+/**
+ * \brief Check CPU list
+ */
+int affinity_check(const char *list)
+{
+	cpu_set_t set;
+
+	return affinity_parse(list, &set);
+}
+
+/**
+ * \brief Set CPU affinity of the calling thread
+ */
+int affinity_set(const char *list, const char *thread)
+{
+	cpu_set_t set;
+	int ret;
+
+	if (!list) {
+		if (!affinity_default_set) {
+			return 0;
+		}
+
+		return pthread_setaffinity_np(pthread_self(), sizeof(affinity_default), &affinity_default) != 0;
+	}
+
+	if (affinity_parse(list, &set)) {
+		MSG_WARNING(msg_module, "Invalid CPU list '%s' of %s", list, thread);
+		return 1;
+	}
+
+	ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (ret != 0) {
+		MSG_WARNING(msg_module, "Unable to set CPU affinity of %s to '%s': %s", thread, list, strerror(ret));
+		return 1;
+	}
+
+	MSG_INFO(msg_module, "Thread %s runs on CPUs %s", thread, list);
+	return 0;
+}
+
+/**
+ * \brief Move memory to NUMA node of the calling thread
+ */
+int affinity_bind_local(void *addr, size_t len)
+{
+	unsigned int cpu, node;
+	unsigned long nodemask;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= sizeof(nodemask) * 8) {
+		return 1;
+	}
+
+	nodemask = 1UL << node;
+	if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, MPOL_MF_MOVE) != 0) {
+		/* Not supported by the kernel (no NUMA), not an error */
+		MSG_DEBUG(msg_module, "Unable to move memory to NUMA node %u: %s", node, strerror(errno));
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * \file affinity.h
+ * \brief CPU affinity and NUMA placement of collector threads
+ *
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef AFFINITY_H_
+#define AFFINITY_H_
+
+#include <stddef.h>
+
+/**
+ * \brief Save CPU affinity of the collector
+ *
+ * Threads without configured affinity get this affinity (they must not
+ * inherit affinity of a pinned thread that created them). Must be called
+ * before any thread is pinned.
+ */
+void affinity_init();
+
+/**
+ * \brief Check CPU list
+ *
+ * \param[in] list CPU list (e.g. "0-3,8,10-11")
+ * \return 0 if the list is valid
+ */
+int affinity_check(const char *list);
+
+/**
+ * \brief Set CPU affinity of the calling thread
+ *
+ * \param[in] list CPU list, NULL for affinity of the collector
+ * \param[in] thread name of the thread (for messages)
+ * \return 0 on success
+ */
+int affinity_set(const char *list, const char *thread);
+
+/**
+ * \brief Move memory to NUMA node of the calling thread
+ *
+ * Pages are migrated (if they are already allocated) and new pages are
+ * preferably allocated on the node. The memory must be page aligned.
+ *
+ * \param[in] addr address of the memory
+ * \param[in] len length of the memory
+ * \return 0 on success
+ */
+int affinity_bind_local(void *addr, size_t len);
+
+#endif /* AFFINITY_H_ */
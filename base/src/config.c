@@ -47,6 +47,7 @@
 
 #include <ipfixcol.h>
 #include "config.h"
+#include "affinity.h"
 
 #define DEFAULT_STORAGE_PLUGIN "ipfix"
 
@@ -124,6 +125,47 @@ static inline xmlChar *get_children_content(xmlNodePtr node, xmlChar *children_n
 	return (NULL);
 }
 
+/**
+ * \brief Take CPU affinity from plugin's configuration
+ *
+ * CPU affinity is handled by the collector, the element is removed from the
+ * configuration passed to the plugin.
+ *
+ * @param[in,out] xmldata Plugin's configuration.
+ * @param[in] plugin Name of the plugin (for messages).
+ * @return CPU list (must be freed) or NULL if it is not set or invalid.
+ */
+static char *config_take_cpu_affinity(xmlDocPtr xmldata, const char *plugin)
+{
+	xmlNodePtr node;
+	xmlChar *content;
+	char *list = NULL;
+
+	for (node = xmlDocGetRootElement(xmldata)->children; node; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE && !xmlStrcmp(node->name, BAD_CAST "cpuAffinity")) {
+			break;
+		}
+	}
+
+	if (!node) {
+		return NULL;
+	}
+
+	content = xmlNodeGetContent(node);
+	if (content && affinity_check((char *) content) == 0) {
+		list = strdup((char *) content);
+	} else {
+		MSG_WARNING(msg_module, "Invalid CPU affinity '%s' of plugin '%s'; ignoring...",
+				content ? (char *) content : "", plugin);
+	}
+
+	xmlFree(content);
+	xmlUnlinkNode(node);
+	xmlFreeNode(node);
+
+	return list;
+}
+
 /**
  * \brief Initiate internal configuration file - open, get xmlDoc and prepare
  * XPathContext. Also register namespace "urn:cesnet:params:xml:ns:yang:ipfixcol-internals"
@@ -353,8 +395,10 @@ struct plugin_xml_conf_list* get_storage_plugins(xmlNodePtr collector_node, xmlD
 									}
 									aux_plugin->config.xmldata = xmlNewDoc (BAD_CAST "1.0");
 									xmlDocSetRootElement(aux_plugin->config.xmldata, xmlCopyNode(node_filewriter, 1));
+									aux_plugin->config.cpu_affinity = config_take_cpu_affinity(aux_plugin->config.xmldata, (char *) file_format);
 
 									aux_plugin->config.require_single_manager = single_mgr;
+									aux_plugin->config.replicas = 1;
 
 									/* link new plugin item into the return list */
 									aux_plugin->next = plugins;
@@ -453,6 +497,8 @@ struct plugin_xml_conf_list* get_input_plugins(xmlNodePtr collector_node, char *
 	retval->next = NULL;
 	retval->config.xmldata = NULL;
 	retval->config.file = NULL;
+	retval->config.cpu_affinity = NULL;
+	retval->config.replicas = 1;
 
 	/* initiate internal config - open xml file, get xmlDoc and prepare xpath context for it */
 	internal_ctxt = ic_init(BAD_CAST "cesnet-ipfixcol-int", internal_cfg);
@@ -493,6 +539,7 @@ struct plugin_xml_conf_list* get_input_plugins(xmlNodePtr collector_node, char *
 	/* remember node with input plugin parameters */
 	retval->config.xmldata = xmlNewDoc(BAD_CAST "1.0");
 	xmlDocSetRootElement(retval->config.xmldata, xmlCopyNode(auxNode, 1));
+	retval->config.cpu_affinity = config_take_cpu_affinity(retval->config.xmldata, (char *) auxNode->name);
 
 	/*
 	 * remember filename of input plugin implementation
@@ -583,6 +630,10 @@ struct plugin_xml_conf_list* get_intermediate_plugins(xmlDocPtr config, char *in
 	xmlNodePtr plugin_config_internal;
 	xmlChar *plugin_file = NULL, *thread_name = NULL;
 	xmlDocPtr xmldata = NULL;
+	xmlNodePtr replicas_node;
+	xmlChar *replicas_str;
+	unsigned long replicas;
+	char *endptr;
 	uint8_t hit = 0;
 
 	/* initiate internal config - open xml file, get xmlDoc and prepare xpath context for it */
@@ -678,6 +729,28 @@ struct plugin_xml_conf_list* get_intermediate_plugins(xmlDocPtr config, char *in
 			continue;
 		}
 
+		/* Number of replicas is handled by collector, remove it from plugin's configuration */
+		replicas = 1;
+		for (replicas_node = xmlDocGetRootElement(xmldata)->children; replicas_node; replicas_node = replicas_node->next) {
+			if (replicas_node->type == XML_ELEMENT_NODE && !xmlStrcmp(replicas_node->name, BAD_CAST "replicas")) {
+				break;
+			}
+		}
+
+		if (replicas_node) {
+			replicas_str = xmlNodeGetContent(replicas_node);
+			replicas = strtoul((char *) replicas_str, &endptr, 10);
+			if (*endptr != '\0' || replicas == 0) {
+				MSG_WARNING(msg_module, "Invalid number of replicas '%s' of intermediate plugin '%s'; using 1",
+						(char *) replicas_str, (char *) node->name);
+				replicas = 1;
+			}
+
+			xmlFree(replicas_str);
+			xmlUnlinkNode(replicas_node);
+			xmlFreeNode(replicas_node);
+		}
+
 		aux_plugin = (struct plugin_xml_conf_list *) malloc(sizeof(*aux_plugin));
 		if (!aux_plugin) {
 			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
@@ -695,6 +768,8 @@ struct plugin_xml_conf_list* get_intermediate_plugins(xmlDocPtr config, char *in
 		}
 
 		aux_plugin->config.xmldata = xmldata;
+		aux_plugin->config.replicas = replicas;
+		aux_plugin->config.cpu_affinity = config_take_cpu_affinity(xmldata, (char *) node->name);
 
 		if (plugins) {
 			last_plugin->next = aux_plugin;
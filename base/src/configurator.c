@@ -182,7 +182,7 @@ void config_free_plugin(struct plugin_config *plugin)
 				rbuffer_free(plugin->inter->in_queue);
 			}
 			if (plugin->inter->dll_handler) {
-				plugin->inter->intermediate_close(plugin->inter->plugin_config);
+				ip_close(plugin->inter);
 				dlclose(plugin->inter->dll_handler);
 			}
 			free(plugin->inter);
@@ -215,6 +215,8 @@ void config_free_plugin(struct plugin_config *plugin)
 	if (plugin->conf.xmldata) {
 		xmlFreeDoc(plugin->conf.xmldata);
 	}
+
+	free(plugin->conf.cpu_affinity);
 	
 	free(plugin);
 }
@@ -392,6 +394,23 @@ err:
 	return 1;
 }
 
+/**
+ * \brief Find storage plugin which doesn't read enrichment fields
+ *
+ * \param[in] config configurator
+ * \return Plugin configuration or NULL if all storage plugins read them
+ */
+static struct plugin_config *config_storage_without_enrichment(configurator *config)
+{
+	for (int i = 0; config->startup->storage[i]; ++i) {
+		if (!dlsym(config->startup->storage[i]->storage->dll_handler, "storage_enrichment")) {
+			return config->startup->storage[i];
+		}
+	}
+
+	return NULL;
+}
+
 /**
  * \brief Add intermediate plugin into running configuration
  * 
@@ -450,6 +469,17 @@ int config_add_inter(configurator *config, struct plugin_config *plugin, int ind
 		goto err;
 	}
 
+	/* Batch processing is optional */
+	im_plugin->intermediate_process_batch = dlsym(im_plugin->dll_handler, "intermediate_process_batch");
+
+	/* Only plugins declaring it can run in more replicas */
+	im_plugin->replicas = plugin->conf.replicas;
+	if (im_plugin->replicas > 1 && !dlsym(im_plugin->dll_handler, "intermediate_replicable")) {
+		MSG_WARNING(msg_module, "[%d] Intermediate plugin '%s' cannot be replicated; running single instance",
+				config->proc_id, plugin->conf.name);
+		im_plugin->replicas = 1;
+	}
+
 	/* Create new output buffer for plugin */
 	im_plugin->out_queue = rbuffer_init(ring_buffer_size);
 	
@@ -489,6 +519,25 @@ int config_add_inter(configurator *config, struct plugin_config *plugin, int ind
 		}
 		goto err;
 	}
+
+	/* Running storage plugins would lose values of enrichment fields */
+	struct plugin_config *storage = NULL;
+	if (enrich_field_count() > 0 && (storage = config_storage_without_enrichment(config))) {
+		MSG_ERROR(msg_module, "[%d] Intermediate plugin '%s' cannot run with storage plugin '%s' which doesn't read enrichment fields",
+				config->proc_id, plugin->conf.name, storage->conf.name);
+
+		/* Stop plugin and restore queues */
+		ip_stop(im_plugin);
+		rbuffer_wait_empty(im_plugin->out_queue);
+		if (config->startup->inter[index + 1]) {
+			ip_change_in_queue(config->startup->inter[index + 1]->inter, backup_queue);
+		} else {
+			output_manager_set_in_queue(backup_queue);
+		}
+		rbuffer_free(im_plugin->out_queue);
+		ip_close(im_plugin);
+		goto err;
+	}
 	
 	config->ip_id++;
 	
@@ -573,6 +622,13 @@ int config_add_storage(configurator *config, struct plugin_config *plugin, int i
 		MSG_ERROR(msg_module, "[%d] Unable to load storage xml_conf (%s)", config->proc_id, dlerror());
 		goto err;
 	}
+
+	/* Values of enrichment fields are not part of data records */
+	if (enrich_field_count() > 0 && !dlsym(st_plugin->dll_handler, "storage_enrichment")) {
+		MSG_ERROR(msg_module, "[%d] Storage plugin '%s' cannot read enrichment fields used by intermediate plugins",
+				config->proc_id, plugin->conf.name);
+		goto err;
+	}
 	
 	/* Set plugin id */
 	st_plugin->id = config->sp_id;
@@ -609,15 +665,27 @@ err:
  * 
  * \param[in] first first config
  * \param[in] second second config
+ * \param[in] type plugin type
  * \return 0 if configurations are the same
  */
-int config_compare_xml(struct plugin_xml_conf *first, struct plugin_xml_conf *second)
+int config_compare_xml(struct plugin_xml_conf *first, struct plugin_xml_conf *second, int type)
 {
 	/* Compare plugin name, file path and ODID */
 	if (   strcmp(first->file, second->file)
 		|| strcmp(first->name, second->name)) {
 		return 1;
 	}
+
+	/* Only intermediate plugins run in replicas */
+	if (type == PLUGIN_INTER && first->replicas != second->replicas) {
+		return 1;
+	}
+
+	/* Compare CPU affinity (threads are pinned when they start) */
+	if ((first->cpu_affinity == NULL) != (second->cpu_affinity == NULL)
+		|| (first->cpu_affinity && strcmp(first->cpu_affinity, second->cpu_affinity))) {
+		return 1;
+	}
 	
 	/* TODO: memory management!! */
 	
@@ -764,7 +832,7 @@ int config_process_changes(configurator *config, struct plugin_config *old_plugi
 			/* Find plugins with same names */
 			if (!strcmp(old_plugins[i]->conf.name, new_plugins[j]->conf.name)) {
 				/* Compare configurations */
-				if (config_compare_xml(&(old_plugins[i]->conf), &(new_plugins[j]->conf)) == 0) {
+				if (config_compare_xml(&(old_plugins[i]->conf), &(new_plugins[j]->conf), type) == 0) {
 					/* Same configurations - nothing changed, only position (needed only for intermediate plugins) */
 					if (type == PLUGIN_INTER && i != j) {
 						/* move */
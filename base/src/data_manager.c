@@ -47,6 +47,8 @@
 #include <ipfixcol/storage.h>
 #include "configurator.h"
 #include "data_manager.h"
+#include "latency.h"
+#include "affinity.h"
 
 /** Identifier to MSG_* macros */
 static char *msg_module = "data manager";
@@ -103,6 +105,11 @@ static void* storage_plugin_thread(void *cfg)
 	/* set the thread name to reflect the configuration */
 	prctl(PR_SET_NAME, config->thread_name, 0, 0, 0);
 
+	/* pin the thread and move the queue to its NUMA node */
+	if (affinity_set(config->xml_conf->cpu_affinity, config->thread_name) == 0 && config->xml_conf->cpu_affinity) {
+		rbuffer_bind_local(config->thread_config->queue);
+	}
+
     /* loop will break upon receiving NULL from buffer */
 	while (!stop) {
 		/* get next data */
@@ -134,6 +141,7 @@ static void* storage_plugin_thread(void *cfg)
 		default: /* DATA */
 			if (can_read) {
 				config->store(config->config, msg, config->thread_config->template_mgr);
+				latency_stamp_end(config->latency, config->latency_total, msg);
 				rbuffer_remove_reference(config->thread_config->queue, index, 1);
 			}
 			break;
@@ -158,6 +166,7 @@ int data_manager_add_plugin(struct data_manager_config *config, struct storage *
 {
 	int retval = 0, name_len;
 	xmlChar *plugin_params;
+	char stage_name[32];
 	
 	/* Check ODID */
 	if ((plugin->xml_conf->observation_domain_id != NULL && /* OID set and does not match */
@@ -206,6 +215,11 @@ int data_manager_add_plugin(struct data_manager_config *config, struct storage *
 	plugin->thread_config = plugin_cfg;
 	plugin->odid = config->observation_domain_id;
 	
+	/* Latency stages are shared by all ODIDs */
+	plugin->latency = latency_stage_get(plugin->thread_name);
+	snprintf(stage_name, sizeof(stage_name), "%s total", plugin->thread_name);
+	plugin->latency_total = latency_stage_get(stage_name);
+
 	/* Set thread name */
 	name_len = strlen(plugin->thread_name);
 	snprintf(plugin->thread_name + name_len, 16 - name_len, " %d", config->observation_domain_id);
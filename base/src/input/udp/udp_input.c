@@ -54,6 +54,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <libxml/parser.h>
@@ -72,6 +73,10 @@ IPFIXCOL_API_VERSION;
 /* default port for udp collector */
 #define DEFAULT_PORT "4739"
 
+/* busy polling: SO_BUSY_POLL time (us) and maximal time of spinning (ms) */
+#define BUSY_POLL_USEC 50
+#define BUSY_POLL_SPIN_MS 100
+
 /** Identifier to MSG_* macros */
 static char *msg_module = "UDP input";
 
@@ -97,6 +102,7 @@ struct plugin_conf {
 	int socket; /**< listening socket */
 	struct input_info_network info; /**< infromation structure passed to collector */
 	struct input_info_list *info_list; /**< list of infromation structures passed to collector */
+	int busy_poll; /**< spin on the socket instead of sleeping in recvfrom */
 };
 
 /**
@@ -205,6 +211,9 @@ int input_init(char *params, void **config)
 					free(conf->info.options_template_life_packet);
 				}
 				conf->info.options_template_life_packet = tmp_val;
+			} else if (xmlStrEqual(cur_node->name, BAD_CAST "busyPoll")) {
+				conf->busy_poll = !strcasecmp(tmp_val, "yes") || !strcasecmp(tmp_val, "true");
+				free(tmp_val);
 			} else { /* unknown parameter, ignore */
 				free(tmp_val);
 			}
@@ -253,6 +262,16 @@ int input_init(char *params, void **config)
 		MSG_WARNING(msg_module, "Cannot turn off socket option IPV6_V6ONLY; plugin may not accept IPv4 connections...");
 	}
 
+	/* let the kernel poll the device queue too (needs CAP_NET_ADMIN) */
+	if (conf->busy_poll) {
+		int busy_poll_usec = BUSY_POLL_USEC;
+		if (setsockopt(conf->socket, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_usec, sizeof(busy_poll_usec)) == -1) {
+			MSG_WARNING(msg_module, "Cannot set socket option SO_BUSY_POLL: %s", strerror(errno));
+		}
+
+		MSG_INFO(msg_module, "Busy polling enabled; input thread should be pinned to an isolated CPU");
+	}
+
 	/* bind socket to address */
 	if (bind(conf->socket, addrinfo->ai_addr, addrinfo->ai_addrlen) != 0) {
 		MSG_ERROR(msg_module, "Cannot bind socket: %s", strerror(errno));
@@ -340,6 +359,42 @@ out:
 	return retval;
 }
 
+/**
+ * \brief Receive packet without sleeping
+ *
+ * Spins on nonblocking socket. Returns -1 with errno EAGAIN after
+ * BUSY_POLL_SPIN_MS without data, so the collector can check its state.
+ *
+ * \param[in] sock socket
+ * \param[out] buf buffer
+ * \param[in] address source address
+ * \param[in,out] addr_len length of source address
+ * \return length of received packet, -1 on error
+ */
+static ssize_t recv_busy_poll(int sock, char *buf, struct sockaddr_in6 *address, socklen_t *addr_len)
+{
+	struct timespec start, now;
+	unsigned int spins = 0;
+	ssize_t len;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (1) {
+		len = recvfrom(sock, buf, BUFF_LEN, MSG_DONTWAIT, (struct sockaddr*) address, addr_len);
+		if (len != -1 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+			return len;
+		}
+
+		/* do not read the clock on every spin */
+		if ((++spins & 0x3ff) == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 >= BUSY_POLL_SPIN_MS) {
+				return -1;
+			}
+		}
+	}
+}
+
 /**
  * \brief Pass input data from the input plugin into the ipfixcol core.
  *
@@ -374,9 +429,14 @@ int get_packet(void *config, struct input_info **info, char **packet, int *sourc
 	}
 
 	/* receive packet */
-	len = recvfrom(sock, *packet, BUFF_LEN, 0, (struct sockaddr*) &address, &addr_len);
+	if (conf->busy_poll) {
+		len = recv_busy_poll(sock, *packet, &address, &addr_len);
+	} else {
+		len = recvfrom(sock, *packet, BUFF_LEN, 0, (struct sockaddr*) &address, &addr_len);
+	}
+
 	if (len == -1) {
-		if (errno == EINTR) {
+		if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
 			return INPUT_INTR;
 		}
 
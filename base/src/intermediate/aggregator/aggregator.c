@@ -0,0 +1,1042 @@
+/**
+ * \file aggregator.c
+ * \brief Intermediate plugin for time-windowed flow aggregation
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <ipfixcol.h>
+#include <ipfixcol/intermediate.h>
+#include <ipfixcol/fast_hash_table.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include <string.h>
+#include <time.h>
+
+/* API version constant */
+IPFIXCOL_API_VERSION;
+
+/* Identifier for verbose macros */
+static const char *msg_module = "aggregator";
+
+/** Default number of aggregated flows kept in the table */
+#define AGGR_DEFAULT_FLOWS 262144
+/** Default active timeout (seconds) */
+#define AGGR_DEFAULT_ACTIVE 300
+/** Default inactive timeout (seconds) */
+#define AGGR_DEFAULT_INACTIVE 30
+
+/** Template IDs of generated templates (IPv4 and IPv6 one) */
+#define AGGR_TEMPLATE_ID 65280
+/** Maximal number of data records in a generated message */
+#define AGGR_MSG_RECORDS 512
+/** Maximal number of fields of a generated template */
+#define AGGR_MAX_FIELDS 10
+#define TEMPL_MAX_LEN 100000
+
+/* Information Elements */
+#define IE_OCTETS      1
+#define IE_PACKETS     2
+#define IE_FLOWS       3
+#define IE_PROTOCOL    4
+#define IE_SRC_PORT    7
+#define IE_SRC_IPV4    8
+#define IE_DST_PORT   11
+#define IE_DST_IPV4   12
+#define IE_SRC_IPV6   27
+#define IE_DST_IPV6   28
+#define IE_START_SEC 150
+#define IE_END_SEC   151
+#define IE_START_MS  152
+#define IE_END_MS    153
+
+/* Fields of the aggregation key */
+#define AGGR_KEY_SRC_ADDR 0x01
+#define AGGR_KEY_DST_ADDR 0x02
+#define AGGR_KEY_SRC_PORT 0x04
+#define AGGR_KEY_DST_PORT 0x08
+#define AGGR_KEY_PROTOCOL 0x10
+#define AGGR_KEY_ADDR (AGGR_KEY_SRC_ADDR | AGGR_KEY_DST_ADDR)
+
+/**
+ * \brief Aggregation key
+ *
+ * Fields that are not part of the configured key stay zeroed. The size is
+ * a multiple of 8 bytes for the hash function of the table.
+ */
+struct aggr_key {
+	uint32_t odid;          /**< Observation Domain ID */
+	uint8_t src_addr[16];   /**< Source address (prefix) */
+	uint8_t dst_addr[16];   /**< Destination address (prefix) */
+	uint16_t src_port;      /**< Source port (network byte order) */
+	uint16_t dst_port;      /**< Destination port (network byte order) */
+	uint8_t protocol;       /**< Protocol */
+	uint8_t ipv6;           /**< Non-zero for IPv6 addresses */
+	uint8_t padding[6];
+};
+
+/**
+ * \brief Aggregated values
+ */
+struct aggr_data {
+	uint64_t octets;        /**< Sum of octets */
+	uint64_t packets;       /**< Sum of packets */
+	uint64_t flows;         /**< Number of aggregated flows */
+	uint64_t first;         /**< First flow start (milliseconds) */
+	uint64_t last;          /**< Last flow end (milliseconds) */
+	time_t created;         /**< Time of the first update (active timeout) */
+	time_t updated;         /**< Time of the last update (inactive timeout) */
+};
+
+/**
+ * \brief Generated message being filled
+ */
+struct aggr_output {
+	uint8_t *pkt;           /**< Packet (NULL if there are no records) */
+	uint16_t offset;        /**< Length of the packet */
+	uint16_t records;       /**< Number of data records */
+};
+
+/**
+ * \brief Source of aggregated flows (one per ODID)
+ *
+ * Sources are kept until the plugin is closed, generated messages refer to
+ * their input info and templates.
+ */
+struct aggr_source {
+	uint32_t odid;                      /**< Observation Domain ID */
+	struct input_info *input_info;      /**< Input info of generated messages */
+	struct ipfix_template *templ[2];    /**< Generated templates (IPv4, IPv6) */
+	struct aggr_output out[2];          /**< Messages being filled */
+	void *live_profile;                 /**< Live profile of the last message */
+	struct aggr_source *next;
+};
+
+/**
+ * \brief Plugin's configuration structure
+ */
+struct plugin_conf {
+	void *ip_config;                    /**< Intermediate process config */
+	uint8_t key;                        /**< Fields of the key (AGGR_KEY_*) */
+	int src_prefix;                     /**< Source IPv4 prefix length */
+	int dst_prefix;                     /**< Destination IPv4 prefix length */
+	int src_prefix6;                    /**< Source IPv6 prefix length */
+	int dst_prefix6;                    /**< Destination IPv6 prefix length */
+	time_t active;                      /**< Active timeout */
+	time_t inactive;                    /**< Inactive timeout */
+	uint32_t flows;                     /**< Size of the table */
+	int pass_original;                  /**< Pass original messages too */
+	fht_table_t *table;                 /**< Aggregated flows */
+	fht_iter_t *iter;                   /**< Iterator for expiration */
+	time_t next_scan;                   /**< Time of the next expiration scan */
+	uint16_t templ_rec[2][2 + 2 * AGGR_MAX_FIELDS]; /**< Template records */
+	uint16_t templ_len[2];              /**< Lengths of template records */
+	uint16_t rec_len[2];                /**< Lengths of data records */
+	struct aggr_source *sources;        /**< Sources */
+	struct aggr_source *last_source;    /**< Last used source */
+	uint64_t exported;                  /**< Number of exported records */
+};
+
+/**
+ * \brief Free configuration structure
+ *
+ * \param[in] conf plugin's configuration
+ */
+void aggregator_free_config(struct plugin_conf *conf)
+{
+	struct aggr_source *src;
+	int i;
+
+	if (!conf) {
+		return;
+	}
+
+	while (conf->sources) {
+		src = conf->sources;
+		conf->sources = src->next;
+
+		for (i = 0; i < 2; ++i) {
+			free(src->out[i].pkt);
+			free(src->templ[i]);
+		}
+		free(src->input_info);
+		free(src);
+	}
+
+	if (conf->iter) {
+		fht_destroy_iter(conf->iter);
+	}
+	if (conf->table) {
+		fht_destroy(conf->table);
+	}
+	free(conf);
+}
+
+/**
+ * \brief Parse prefix length attribute
+ *
+ * \param[in] node XML node
+ * \param[in] name attribute name
+ * \param[in] max full length of the address
+ * \return prefix length, -1 if it is invalid
+ */
+static int aggregator_parse_prefix(xmlNode *node, const char *name, int max)
+{
+	xmlChar *value = xmlGetProp(node, (const xmlChar *) name);
+	char *end;
+	long prefix;
+
+	if (!value) {
+		return max;
+	}
+
+	prefix = strtol((char *) value, &end, 10);
+	if (*end != '\0' || end == (char *) value || prefix < 0 || prefix > max) {
+		MSG_ERROR(msg_module, "Invalid prefix length '%s'", (char *) value);
+		prefix = -1;
+	}
+
+	xmlFree(value);
+	return (int) prefix;
+}
+
+/**
+ * \brief Process aggregation key configuration
+ *
+ * \param[in] conf plugin configuration structure
+ * \param[in] key key element
+ * \return 0 on success
+ */
+int process_key_xml(struct plugin_conf *conf, xmlNode *key)
+{
+	xmlNode *node;
+
+	conf->key = 0;
+	for (node = key->children; node; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		if (!xmlStrcmp(node->name, (const xmlChar *) "srcAddr")) {
+			conf->key |= AGGR_KEY_SRC_ADDR;
+			conf->src_prefix = aggregator_parse_prefix(node, "prefix", 32);
+			conf->src_prefix6 = aggregator_parse_prefix(node, "prefix6", 128);
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "dstAddr")) {
+			conf->key |= AGGR_KEY_DST_ADDR;
+			conf->dst_prefix = aggregator_parse_prefix(node, "prefix", 32);
+			conf->dst_prefix6 = aggregator_parse_prefix(node, "prefix6", 128);
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "srcPort")) {
+			conf->key |= AGGR_KEY_SRC_PORT;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "dstPort")) {
+			conf->key |= AGGR_KEY_DST_PORT;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "protocol")) {
+			conf->key |= AGGR_KEY_PROTOCOL;
+		} else {
+			MSG_ERROR(msg_module, "Unknown key field '%s'", (char *) node->name);
+			return 1;
+		}
+	}
+
+	if (conf->src_prefix < 0 || conf->dst_prefix < 0 || conf->src_prefix6 < 0 || conf->dst_prefix6 < 0) {
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Process startup configuration
+ *
+ * \param[in] conf plugin configuration structure
+ * \param[in] params configuration xml data
+ * \return 0 on success
+ */
+int process_startup_xml(struct plugin_conf *conf, char *params)
+{
+	xmlNode *node;
+	xmlChar *value;
+	long number;
+	char *end;
+	int ret = 0;
+
+	/* Default configuration (5-tuple) */
+	conf->key = AGGR_KEY_ADDR | AGGR_KEY_SRC_PORT | AGGR_KEY_DST_PORT | AGGR_KEY_PROTOCOL;
+	conf->src_prefix = conf->dst_prefix = 32;
+	conf->src_prefix6 = conf->dst_prefix6 = 128;
+	conf->active = AGGR_DEFAULT_ACTIVE;
+	conf->inactive = AGGR_DEFAULT_INACTIVE;
+	conf->flows = AGGR_DEFAULT_FLOWS;
+
+	/* Load XML configuration */
+	xmlDoc *doc = xmlParseDoc(BAD_CAST params);
+	if (!doc) {
+		MSG_ERROR(msg_module, "Unable to parse startup configuration!");
+		return 1;
+	}
+
+	xmlNode *root = xmlDocGetRootElement(doc);
+	if (!root) {
+		MSG_ERROR(msg_module, "Cannot get document root element!");
+		xmlFreeDoc(doc);
+		return 1;
+	}
+
+	for (node = root->children; node && !ret; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		if (!xmlStrcmp(node->name, (const xmlChar *) "key")) {
+			ret = process_key_xml(conf, node);
+			continue;
+		}
+
+		value = xmlNodeGetContent(node);
+		if (!value) {
+			continue;
+		}
+
+		if (!xmlStrcmp(node->name, (const xmlChar *) "passOriginal")) {
+			conf->pass_original = !xmlStrcasecmp(value, (const xmlChar *) "yes")
+				|| !xmlStrcasecmp(value, (const xmlChar *) "true");
+			xmlFree(value);
+			continue;
+		}
+
+		number = strtol((char *) value, &end, 10);
+		if (*end != '\0' || end == (char *) value || number <= 0) {
+			MSG_ERROR(msg_module, "Invalid value '%s' of %s", (char *) value, (char *) node->name);
+			ret = 1;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "activeTimeout")) {
+			conf->active = number;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "inactiveTimeout")) {
+			conf->inactive = number;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "tableSize")) {
+			conf->flows = number;
+		} else {
+			MSG_WARNING(msg_module, "Unknown element '%s'", (char *) node->name);
+		}
+
+		xmlFree(value);
+	}
+
+	xmlFreeDoc(doc);
+	return ret;
+}
+
+/**
+ * \brief Add field to a template record
+ *
+ * \param[in,out] rec template record
+ * \param[in] id Information Element ID
+ * \param[in] length field length
+ * \return length of the field
+ */
+static uint16_t aggregator_template_add(uint16_t *rec, uint16_t id, uint16_t length)
+{
+	uint16_t count = ntohs(rec[1]);
+
+	rec[2 + 2 * count] = htons(id);
+	rec[3 + 2 * count] = htons(length);
+	rec[1] = htons(count + 1);
+
+	return length;
+}
+
+/**
+ * \brief Build template record for aggregated flows
+ *
+ * \param[in,out] conf plugin configuration
+ * \param[in] ipv6 non-zero for IPv6 addresses
+ */
+void aggregator_build_template(struct plugin_conf *conf, int ipv6)
+{
+	uint16_t *rec = conf->templ_rec[ipv6];
+	uint16_t addr_len = ipv6 ? 16 : 4;
+	uint16_t len = 0;
+
+	rec[0] = htons(AGGR_TEMPLATE_ID + ipv6);
+	rec[1] = 0;
+
+	if (conf->key & AGGR_KEY_SRC_ADDR) {
+		len += aggregator_template_add(rec, ipv6 ? IE_SRC_IPV6 : IE_SRC_IPV4, addr_len);
+	}
+	if (conf->key & AGGR_KEY_DST_ADDR) {
+		len += aggregator_template_add(rec, ipv6 ? IE_DST_IPV6 : IE_DST_IPV4, addr_len);
+	}
+	if (conf->key & AGGR_KEY_SRC_PORT) {
+		len += aggregator_template_add(rec, IE_SRC_PORT, 2);
+	}
+	if (conf->key & AGGR_KEY_DST_PORT) {
+		len += aggregator_template_add(rec, IE_DST_PORT, 2);
+	}
+	if (conf->key & AGGR_KEY_PROTOCOL) {
+		len += aggregator_template_add(rec, IE_PROTOCOL, 1);
+	}
+
+	len += aggregator_template_add(rec, IE_OCTETS, 8);
+	len += aggregator_template_add(rec, IE_PACKETS, 8);
+	len += aggregator_template_add(rec, IE_FLOWS, 8);
+	len += aggregator_template_add(rec, IE_START_MS, 8);
+	len += aggregator_template_add(rec, IE_END_MS, 8);
+
+	conf->templ_len[ipv6] = 4 + 4 * ntohs(rec[1]);
+	conf->rec_len[ipv6] = len;
+}
+
+/**
+ * \brief Plugin initialization
+ *
+ * \param[in] params xml configuration
+ * \param[in] ip_config	intermediate process config
+ * \param[in] ip_id	intermediate process ID for template manager
+ * \param[in] template_mgr template manager
+ * \param[out] config config storage
+ * \return 0 on success
+ */
+int intermediate_init(char* params, void* ip_config, uint32_t ip_id, struct ipfix_template_mgr* template_mgr, void** config)
+{
+	uint32_t rows = 1;
+
+	/* Suppress compiler warnings */
+	(void) ip_id; (void) template_mgr;
+
+	if (!params) {
+		MSG_ERROR(msg_module, "Missing plugin's configuration");
+		return 1;
+	}
+
+	/* Create configuration */
+	struct plugin_conf *conf = calloc(1, sizeof(struct plugin_conf));
+	if (!conf) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	/* Process configuration */
+	if (process_startup_xml(conf, params) != 0) {
+		aggregator_free_config(conf);
+		return 1;
+	}
+
+	/* Each row of the table holds FHT_TABLE_COLS flows, number of rows must be a power of two */
+	while (rows * FHT_TABLE_COLS < conf->flows && rows < (1U << 31)) {
+		rows <<= 1;
+	}
+
+	conf->table = fht_init(rows, sizeof(struct aggr_key), sizeof(struct aggr_data), 0);
+	if (!conf->table) {
+		MSG_ERROR(msg_module, "Unable to create table for %u flows", rows * FHT_TABLE_COLS);
+		aggregator_free_config(conf);
+		return 1;
+	}
+
+	conf->iter = fht_init_iter(conf->table);
+	if (!conf->iter) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		aggregator_free_config(conf);
+		return 1;
+	}
+
+	aggregator_build_template(conf, 0);
+	aggregator_build_template(conf, 1);
+
+	/* Save configuration */
+	conf->ip_config = ip_config;
+	*config = conf;
+
+	MSG_INFO(msg_module, "Aggregating up to %u flows, active timeout %lds, inactive timeout %lds",
+			rows * FHT_TABLE_COLS, (long) conf->active, (long) conf->inactive);
+	return 0;
+}
+
+/**
+ * \brief Find source by ODID
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] odid Observation Domain ID
+ * \return source or NULL
+ */
+static struct aggr_source *aggregator_find_source(struct plugin_conf *conf, uint32_t odid)
+{
+	struct aggr_source *src;
+
+	if (conf->last_source && conf->last_source->odid == odid) {
+		return conf->last_source;
+	}
+
+	for (src = conf->sources; src; src = src->next) {
+		if (src->odid == odid) {
+			conf->last_source = src;
+			return src;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief Get source of a message, create it when it does not exist
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] msg IPFIX message
+ * \return source or NULL on error
+ */
+struct aggr_source *aggregator_get_source(struct plugin_conf *conf, struct ipfix_message *msg)
+{
+	struct aggr_source *src;
+	size_t info_size;
+	int i;
+
+	src = aggregator_find_source(conf, msg->input_info->odid);
+	if (src) {
+		return src;
+	}
+
+	src = calloc(1, sizeof(struct aggr_source));
+	if (!src) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		return NULL;
+	}
+
+	/* Generated messages have their own sequence numbers */
+	info_size = (msg->input_info->type == SOURCE_TYPE_IPFIX_FILE)
+			? sizeof(struct input_info_file) : sizeof(struct input_info_network);
+	src->input_info = calloc(1, info_size);
+	if (!src->input_info) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		free(src);
+		return NULL;
+	}
+
+	memcpy(src->input_info, msg->input_info, info_size);
+	src->input_info->sequence_number = 0;
+	src->odid = msg->input_info->odid;
+
+	for (i = 0; i < 2; ++i) {
+		src->templ[i] = tm_create_template(conf->templ_rec[i], TEMPL_MAX_LEN, TM_TEMPLATE, src->odid);
+		if (!src->templ[i]) {
+			MSG_ERROR(msg_module, "[%u] Unable to create template", src->odid);
+			free(src->templ[0]);
+			free(src->input_info);
+			free(src);
+			return NULL;
+		}
+	}
+
+	src->next = conf->sources;
+	conf->sources = src;
+	conf->last_source = src;
+
+	MSG_DEBUG(msg_module, "[%u] New source", src->odid);
+	return src;
+}
+
+/**
+ * \brief Pass filled message of a source
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] src source
+ * \param[in] ipv6 non-zero for the message with IPv6 flows
+ */
+void aggregator_output_flush(struct plugin_conf *conf, struct aggr_source *src, int ipv6)
+{
+	struct aggr_output *out = &src->out[ipv6];
+	struct ipfix_message *msg;
+	struct ipfix_header *header;
+	struct metadata *metadata;
+	uint16_t data_offset = IPFIX_HEADER_LENGTH + 4 + conf->templ_len[ipv6];
+	uint16_t i;
+
+	if (!out->pkt) {
+		return;
+	}
+
+	msg = calloc(1, sizeof(struct ipfix_message));
+	metadata = calloc(out->records, sizeof(struct metadata));
+	if (!msg || !metadata) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		free(msg);
+		free(metadata);
+		free(out->pkt);
+		out->pkt = NULL;
+		return;
+	}
+
+	header = (struct ipfix_header *) out->pkt;
+	header->version = htons(IPFIX_VERSION);
+	header->length = htons(out->offset);
+	header->export_time = htonl(time(NULL));
+	header->sequence_number = htonl(src->input_info->sequence_number);
+	header->observation_domain_id = htonl(src->odid);
+	src->input_info->sequence_number += out->records;
+
+	msg->pkt_header = header;
+	msg->input_info = src->input_info;
+	msg->source_status = SOURCE_STATUS_OPENED;
+	msg->live_profile = src->live_profile;
+	msg->templ_set[0] = (struct ipfix_template_set *) (out->pkt + IPFIX_HEADER_LENGTH);
+	msg->templ_records_count = 1;
+	msg->data_couple[0].data_set = (struct ipfix_data_set *) (out->pkt + data_offset);
+	msg->data_couple[0].data_set->header.length = htons(out->offset - data_offset);
+	msg->data_couple[0].data_template = src->templ[ipv6];
+	msg->data_records_count = out->records;
+	msg->metadata = metadata;
+
+	for (i = 0; i < out->records; ++i) {
+		metadata[i].record.record = out->pkt + data_offset + 4 + i * conf->rec_len[ipv6];
+		metadata[i].record.length = conf->rec_len[ipv6];
+		metadata[i].record.templ = src->templ[ipv6];
+	}
+
+	tm_template_reference_inc(src->templ[ipv6]);
+	conf->exported += out->records;
+	out->pkt = NULL;
+
+	pass_message(conf->ip_config, msg);
+}
+
+/**
+ * \brief Pass filled messages of all sources
+ *
+ * \param[in] conf plugin configuration
+ */
+void aggregator_flush(struct plugin_conf *conf)
+{
+	struct aggr_source *src;
+
+	for (src = conf->sources; src; src = src->next) {
+		aggregator_output_flush(conf, src, 0);
+		aggregator_output_flush(conf, src, 1);
+	}
+}
+
+/**
+ * \brief Write 64-bit value in network byte order
+ *
+ * \param[out] p destination
+ * \param[in] value value
+ * \return pointer behind the value
+ */
+static inline uint8_t *aggregator_write_u64(uint8_t *p, uint64_t value)
+{
+	value = htobe64(value);
+	memcpy(p, &value, sizeof(value));
+	return p + sizeof(value);
+}
+
+/**
+ * \brief Export aggregated flow
+ *
+ * The flow is written into the message of its source, the message is passed
+ * when it is full.
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] key aggregation key
+ * \param[in] data aggregated values
+ */
+void aggregator_export(struct plugin_conf *conf, const struct aggr_key *key, const struct aggr_data *data)
+{
+	struct aggr_source *src;
+	struct aggr_output *out;
+	struct ipfix_set_header *set;
+	int ipv6 = key->ipv6 ? 1 : 0;
+	int addr_len = ipv6 ? 16 : 4;
+	uint8_t *p;
+
+	src = aggregator_find_source(conf, key->odid);
+	if (!src) {
+		return;
+	}
+
+	out = &src->out[ipv6];
+	if (!out->pkt) {
+		out->pkt = malloc(IPFIX_HEADER_LENGTH + 4 + conf->templ_len[ipv6] + 4 + AGGR_MSG_RECORDS * conf->rec_len[ipv6]);
+		if (!out->pkt) {
+			MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+			return;
+		}
+
+		/* Template set with the generated template */
+		set = (struct ipfix_set_header *) (out->pkt + IPFIX_HEADER_LENGTH);
+		set->flowset_id = htons(IPFIX_TEMPLATE_FLOWSET_ID);
+		set->length = htons(4 + conf->templ_len[ipv6]);
+		memcpy(out->pkt + IPFIX_HEADER_LENGTH + 4, conf->templ_rec[ipv6], conf->templ_len[ipv6]);
+
+		/* Data set header (length is set when the message is passed) */
+		set = (struct ipfix_set_header *) (out->pkt + IPFIX_HEADER_LENGTH + 4 + conf->templ_len[ipv6]);
+		set->flowset_id = htons(AGGR_TEMPLATE_ID + ipv6);
+		out->offset = IPFIX_HEADER_LENGTH + 4 + conf->templ_len[ipv6] + 4;
+		out->records = 0;
+	}
+
+	/* Fields in the order of the template */
+	p = out->pkt + out->offset;
+	if (conf->key & AGGR_KEY_SRC_ADDR) {
+		memcpy(p, key->src_addr, addr_len);
+		p += addr_len;
+	}
+	if (conf->key & AGGR_KEY_DST_ADDR) {
+		memcpy(p, key->dst_addr, addr_len);
+		p += addr_len;
+	}
+	if (conf->key & AGGR_KEY_SRC_PORT) {
+		memcpy(p, &key->src_port, 2);
+		p += 2;
+	}
+	if (conf->key & AGGR_KEY_DST_PORT) {
+		memcpy(p, &key->dst_port, 2);
+		p += 2;
+	}
+	if (conf->key & AGGR_KEY_PROTOCOL) {
+		*p++ = key->protocol;
+	}
+	p = aggregator_write_u64(p, data->octets);
+	p = aggregator_write_u64(p, data->packets);
+	p = aggregator_write_u64(p, data->flows);
+	p = aggregator_write_u64(p, data->first);
+	p = aggregator_write_u64(p, data->last);
+
+	out->offset = p - out->pkt;
+	out->records++;
+
+	if (out->records == AGGR_MSG_RECORDS) {
+		aggregator_output_flush(conf, src, ipv6);
+	}
+}
+
+/**
+ * \brief Export expired flows
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] now current time
+ * \param[in] src export all flows of this source regardless of timeouts (may be NULL)
+ */
+void aggregator_expire(struct plugin_conf *conf, time_t now, struct aggr_source *src)
+{
+	struct aggr_key *key;
+	struct aggr_data *data;
+
+	fht_reinit_iter(conf->iter);
+	while (fht_get_next_iter(conf->iter) == FHT_ITER_RET_OK) {
+		key = (struct aggr_key *) conf->iter->key_ptr;
+		data = (struct aggr_data *) conf->iter->data_ptr;
+
+		if (src) {
+			if (key->odid != src->odid) {
+				continue;
+			}
+		} else if (now - data->created < conf->active && now - data->updated < conf->inactive) {
+			continue;
+		}
+
+		aggregator_export(conf, key, data);
+		fht_remove_iter(conf->iter);
+	}
+}
+
+/**
+ * \brief Read unsigned field of a data record
+ *
+ * \param[in] rec data record
+ * \param[in] id Information Element ID
+ * \param[out] value field value
+ * \return 0 if the field was found
+ */
+static int aggregator_get_uint(struct ipfix_record *rec, uint16_t id, uint64_t *value)
+{
+	int len = 0, i;
+	uint8_t *field = data_record_get_field(rec->record, rec->templ, 0, id, &len);
+
+	if (!field || len < 1 || len > 8) {
+		return 1;
+	}
+
+	/* Reduced size encoding is allowed */
+	*value = 0;
+	for (i = 0; i < len; ++i) {
+		*value = (*value << 8) | field[i];
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Copy address prefix of a data record
+ *
+ * \param[in] rec data record
+ * \param[in] id Information Element ID
+ * \param[in] bytes address length
+ * \param[in] prefix prefix length
+ * \param[out] addr address prefix (host bits are cleared)
+ * \return 0 if the address was found
+ */
+static int aggregator_get_prefix(struct ipfix_record *rec, uint16_t id, int bytes, int prefix, uint8_t *addr)
+{
+	int len = 0, i;
+	uint8_t *field = data_record_get_field(rec->record, rec->templ, 0, id, &len);
+
+	if (!field || len != bytes) {
+		return 1;
+	}
+
+	memcpy(addr, field, bytes);
+	for (i = prefix / 8; i < bytes; ++i) {
+		addr[i] &= (i == prefix / 8) ? (uint8_t) (0xFF00 >> (prefix % 8)) : 0;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Fill aggregation key of a data record
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] odid Observation Domain ID
+ * \param[in] rec data record
+ * \param[out] key aggregation key
+ */
+static void aggregator_fill_key(struct plugin_conf *conf, uint32_t odid, struct ipfix_record *rec, struct aggr_key *key)
+{
+	uint64_t value;
+	int found = 0;
+
+	memset(key, 0, sizeof(*key));
+	key->odid = odid;
+
+	if (conf->key & AGGR_KEY_ADDR) {
+		if (conf->key & AGGR_KEY_SRC_ADDR) {
+			found |= !aggregator_get_prefix(rec, IE_SRC_IPV4, 4, conf->src_prefix, key->src_addr);
+		}
+		if (conf->key & AGGR_KEY_DST_ADDR) {
+			found |= !aggregator_get_prefix(rec, IE_DST_IPV4, 4, conf->dst_prefix, key->dst_addr);
+		}
+
+		/* No IPv4 address, try IPv6 */
+		if (!found) {
+			if (conf->key & AGGR_KEY_SRC_ADDR) {
+				found |= !aggregator_get_prefix(rec, IE_SRC_IPV6, 16, conf->src_prefix6, key->src_addr);
+			}
+			if (conf->key & AGGR_KEY_DST_ADDR) {
+				found |= !aggregator_get_prefix(rec, IE_DST_IPV6, 16, conf->dst_prefix6, key->dst_addr);
+			}
+			key->ipv6 = found;
+		}
+	}
+
+	if ((conf->key & AGGR_KEY_SRC_PORT) && !aggregator_get_uint(rec, IE_SRC_PORT, &value)) {
+		key->src_port = htons((uint16_t) value);
+	}
+	if ((conf->key & AGGR_KEY_DST_PORT) && !aggregator_get_uint(rec, IE_DST_PORT, &value)) {
+		key->dst_port = htons((uint16_t) value);
+	}
+	if ((conf->key & AGGR_KEY_PROTOCOL) && !aggregator_get_uint(rec, IE_PROTOCOL, &value)) {
+		key->protocol = (uint8_t) value;
+	}
+}
+
+/**
+ * \brief Get flow timestamp in milliseconds
+ *
+ * \param[in] rec data record
+ * \param[in] id_ms Information Element ID of the timestamp in milliseconds
+ * \param[in] id_sec Information Element ID of the timestamp in seconds
+ * \param[in] def default value
+ * \return timestamp
+ */
+static uint64_t aggregator_get_time(struct ipfix_record *rec, uint16_t id_ms, uint16_t id_sec, uint64_t def)
+{
+	uint64_t value;
+
+	if (!aggregator_get_uint(rec, id_ms, &value)) {
+		return value;
+	}
+	if (!aggregator_get_uint(rec, id_sec, &value)) {
+		return value * 1000;
+	}
+
+	return def;
+}
+
+/**
+ * \brief Aggregate flow record
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] src source of the record
+ * \param[in] rec data record
+ * \param[in] now current time
+ * \param[in] export_time export time of the message (milliseconds)
+ */
+void aggregator_process_record(struct plugin_conf *conf, struct aggr_source *src, struct ipfix_record *rec, time_t now, uint64_t export_time)
+{
+	struct aggr_key key, lost_key;
+	struct aggr_data new_data, lost_data, *data;
+	uint64_t octets = 0, packets = 0, flows = 1;
+	uint64_t first, last;
+
+	aggregator_fill_key(conf, src->odid, rec, &key);
+
+	aggregator_get_uint(rec, IE_OCTETS, &octets);
+	aggregator_get_uint(rec, IE_PACKETS, &packets);
+	aggregator_get_uint(rec, IE_FLOWS, &flows);
+	first = aggregator_get_time(rec, IE_START_MS, IE_START_SEC, export_time);
+	last = aggregator_get_time(rec, IE_END_MS, IE_END_SEC, export_time);
+
+	data = (struct aggr_data *) fht_get_data(conf->table, &key);
+	if (data) {
+		data->octets += octets;
+		data->packets += packets;
+		data->flows += flows;
+		if (first < data->first) {
+			data->first = first;
+		}
+		if (last > data->last) {
+			data->last = last;
+		}
+		data->updated = now;
+		return;
+	}
+
+	new_data.octets = octets;
+	new_data.packets = packets;
+	new_data.flows = flows;
+	new_data.first = first;
+	new_data.last = last;
+	new_data.created = now;
+	new_data.updated = now;
+
+	if (fht_insert(conf->table, &key, &new_data, &lost_key, &lost_data) == FHT_INSERT_LOST) {
+		/* The oldest flow of the row was replaced, export it now */
+		aggregator_export(conf, &lost_key, &lost_data);
+	}
+}
+
+/**
+ * \brief Process IPFIX message
+ *
+ * Flow records are aggregated and the message is dropped (unless passOriginal
+ * is set). Messages without flow records (e.g. with options data) and
+ * messages announcing new or closed sources are passed unchanged.
+ *
+ * \param[in] config plugin configuration
+ * \param[in] message IPFIX message
+ * \return 0 on success
+ */
+int intermediate_process_message(void* config, void* message)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) config;
+	struct ipfix_message *msg = (struct ipfix_message *) message;
+	struct aggr_source *src;
+	struct ipfix_record rec;
+	time_t now = time(NULL);
+	uint64_t export_time;
+	int aggregated = 0;
+	uint16_t i;
+
+	if (msg->source_status != SOURCE_STATUS_OPENED) {
+		src = aggregator_find_source(conf, msg->input_info->odid);
+		if (msg->source_status == SOURCE_STATUS_CLOSED && src) {
+			/* Export flows before the data manager of the ODID is closed */
+			aggregator_expire(conf, now, src);
+			aggregator_flush(conf);
+		}
+
+		pass_message(conf->ip_config, msg);
+		return 0;
+	}
+
+	src = aggregator_get_source(conf, msg);
+	if (!src || !msg->metadata) {
+		pass_message(conf->ip_config, msg);
+		return 0;
+	}
+
+	src->live_profile = msg->live_profile;
+	export_time = (uint64_t) ntohl(msg->pkt_header->export_time) * 1000;
+
+	for (i = 0; i < msg->data_records_count; ++i) {
+		/* Metadata are packed, copy the record */
+		rec = msg->metadata[i].record;
+		if (!rec.templ || rec.templ->template_type != TM_TEMPLATE) {
+			continue;
+		}
+
+		aggregator_process_record(conf, src, &rec, now, export_time);
+		aggregated++;
+	}
+
+	/* Look for expired flows once per second */
+	if (now >= conf->next_scan) {
+		aggregator_expire(conf, now, NULL);
+		conf->next_scan = now + 1;
+	}
+	aggregator_flush(conf);
+
+	if (aggregated && !conf->pass_original) {
+		drop_message(conf->ip_config, msg);
+	} else {
+		pass_message(conf->ip_config, msg);
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Close intermediate plugin
+ *
+ * \param[in] config plugin configuration
+ * \return 0 on success
+ */
+int intermediate_close(void *config)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) config;
+	uint64_t remaining = 0;
+
+	MSG_DEBUG(msg_module, "Closing");
+
+	/* Output queue is not available anymore */
+	fht_reinit_iter(conf->iter);
+	while (fht_get_next_iter(conf->iter) == FHT_ITER_RET_OK) {
+		remaining++;
+	}
+
+	MSG_INFO(msg_module, "Exported %lu aggregated flows, %lu flows not exported",
+			(unsigned long) conf->exported, (unsigned long) remaining);
+
+	/* Release configuration */
+	aggregator_free_config(conf);
+
+	return 0;
+}
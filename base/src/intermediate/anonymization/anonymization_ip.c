@@ -63,6 +63,9 @@
 /* API version constant */
 IPFIXCOL_API_VERSION;
 
+/* Messages are processed independently, plugin can be replicated */
+IPFIXCOL_INTERMEDIATE_REPLICABLE;
+
 static char *msg_module = "Anon IP";
 
 #define ANONYMIZATION_TYPE_TRUNCATION    1
@@ -0,0 +1,570 @@
+/**
+ * \file dedup.c
+ * \brief Intermediate plugin removing flows exported by more exporters
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <ipfixcol.h>
+#include <ipfixcol/intermediate.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* API version constant */
+IPFIXCOL_API_VERSION;
+
+/* Identifier for verbose macros */
+static const char *msg_module = "dedup";
+
+/** Default number of flows remembered in one generation */
+#define DEDUP_DEFAULT_FLOWS (1 << 20)
+/** Default length of the window (seconds) */
+#define DEDUP_DEFAULT_WINDOW 10
+/** Number of slots in one bucket (one cache line) */
+#define DEDUP_BUCKET_SLOTS 8
+
+/** Enrichment field with ODID of the first exporter of a duplicate flow */
+#define DEDUP_ENTERPRISE 8057
+#define DEDUP_FIELD 1002
+#define DEDUP_LENGTH 4
+
+/**
+ * \brief What to do with duplicate flows
+ */
+enum dedup_mode {
+	DEDUP_DROP,     /**< Remove duplicate records from messages */
+	DEDUP_MARK,     /**< Set enrichment field of duplicate records */
+};
+
+/**
+ * \brief One generation of remembered flows
+ *
+ * Each slot holds 32-bit fingerprint of the flow key (upper half) and ODID
+ * of the exporter that exported it first (lower half), 0 is an empty slot.
+ * Memory is bounded, when a bucket is full a slot is overwritten.
+ */
+struct dedup_generation {
+	uint64_t *slots;        /**< Buckets of slots */
+	uint64_t used;          /**< Number of used slots */
+	time_t epoch;           /**< Window number of the generation */
+};
+
+/**
+ * \brief Plugin's configuration structure
+ */
+struct plugin_conf {
+	void *ip_config;                /**< Intermediate process config */
+	enum dedup_mode mode;           /**< What to do with duplicates */
+	time_t window;                  /**< Length of one generation (seconds) */
+	uint32_t buckets;               /**< Number of buckets of a generation (power of two) */
+	int column;                     /**< Enrichment column (mark mode) */
+	struct dedup_generation gen[2]; /**< Current and previous generation */
+	int current;                    /**< Index of the current generation */
+
+	/* Statistics (read by the statistics thread) */
+	uint64_t lookups;               /**< Number of looked up flows */
+	uint64_t duplicates;            /**< Number of duplicate flows */
+	uint64_t evictions;             /**< Number of overwritten slots */
+	uint64_t compared;              /**< Number of compared fingerprints */
+};
+
+/**
+ * \brief Processing data of one message
+ */
+struct dedup_process {
+	struct plugin_conf *conf;       /**< Plugin configuration */
+	uint32_t odid;                  /**< ODID of the message */
+	uint32_t *first_odid;           /**< ODID of the first exporter of each record */
+	uint8_t *duplicate;             /**< Flags of duplicate records */
+	uint16_t records;               /**< Number of processed records */
+	uint16_t duplicates;            /**< Number of duplicate records */
+	uint64_t lookups;               /**< Local statistics */
+	uint64_t evictions;
+	uint64_t compared;
+};
+
+/**
+ * \brief Free configuration structure
+ *
+ * \param[in] conf plugin's configuration
+ */
+void dedup_free_config(struct plugin_conf *conf)
+{
+	if (conf) {
+		free(conf->gen[0].slots);
+		free(conf->gen[1].slots);
+		free(conf);
+	}
+}
+
+/**
+ * \brief Process startup configuration
+ *
+ * \param[in] conf plugin configuration structure
+ * \param[in] params configuration xml data
+ * \return 0 on success
+ */
+int process_startup_xml(struct plugin_conf *conf, char *params)
+{
+	xmlNode *node;
+	xmlChar *value;
+	uint64_t flows = DEDUP_DEFAULT_FLOWS;
+	long number;
+	char *end;
+	int ret = 0;
+
+	conf->mode = DEDUP_DROP;
+	conf->window = DEDUP_DEFAULT_WINDOW;
+
+	/* Load XML configuration */
+	xmlDoc *doc = xmlParseDoc(BAD_CAST params);
+	if (!doc) {
+		MSG_ERROR(msg_module, "Unable to parse startup configuration!");
+		return 1;
+	}
+
+	xmlNode *root = xmlDocGetRootElement(doc);
+	if (!root) {
+		MSG_ERROR(msg_module, "Cannot get document root element!");
+		xmlFreeDoc(doc);
+		return 1;
+	}
+
+	for (node = root->children; node && !ret; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		value = xmlNodeGetContent(node);
+		if (!value) {
+			continue;
+		}
+
+		if (!xmlStrcmp(node->name, (const xmlChar *) "mode")) {
+			if (!xmlStrcasecmp(value, (const xmlChar *) "drop")) {
+				conf->mode = DEDUP_DROP;
+			} else if (!xmlStrcasecmp(value, (const xmlChar *) "mark")) {
+				conf->mode = DEDUP_MARK;
+			} else {
+				MSG_ERROR(msg_module, "Unknown mode '%s'", (char *) value);
+				ret = 1;
+			}
+			xmlFree(value);
+			continue;
+		}
+
+		number = strtol((char *) value, &end, 10);
+		if (*end != '\0' || end == (char *) value || number <= 0) {
+			MSG_ERROR(msg_module, "Invalid value '%s' of %s", (char *) value, (char *) node->name);
+			ret = 1;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "window")) {
+			conf->window = number;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "flows")) {
+			flows = number;
+		} else {
+			MSG_WARNING(msg_module, "Unknown element '%s'", (char *) node->name);
+		}
+
+		xmlFree(value);
+	}
+
+	xmlFreeDoc(doc);
+
+	/* Number of buckets is a power of two */
+	conf->buckets = 1;
+	while ((uint64_t) conf->buckets * DEDUP_BUCKET_SLOTS < flows && conf->buckets < (1U << 28)) {
+		conf->buckets <<= 1;
+	}
+
+	return ret;
+}
+
+/**
+ * \brief Get memory used by remembered flows
+ *
+ * \param[in] conf plugin configuration
+ * \return size in bytes
+ */
+static uint64_t dedup_memory(struct plugin_conf *conf)
+{
+	return 2 * (uint64_t) conf->buckets * DEDUP_BUCKET_SLOTS * sizeof(uint64_t);
+}
+
+/**
+ * \brief Print statistics
+ *
+ * Expected false positive rate is the number of fingerprints compared with
+ * fingerprints of different flows divided by 2^32 (per lookup).
+ *
+ * \param[in] arg plugin configuration
+ * \param[in] file statistics file or NULL
+ */
+void dedup_print_stats(void *arg, FILE *file)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) arg;
+	uint64_t lookups = __sync_fetch_and_add(&conf->lookups, 0);
+	uint64_t duplicates = __sync_fetch_and_add(&conf->duplicates, 0);
+	uint64_t evictions = __sync_fetch_and_add(&conf->evictions, 0);
+	uint64_t compared = __sync_fetch_and_add(&conf->compared, 0);
+	uint64_t used = __sync_fetch_and_add(&conf->gen[0].used, 0) + __sync_fetch_and_add(&conf->gen[1].used, 0);
+	uint64_t slots = 2 * (uint64_t) conf->buckets * DEDUP_BUCKET_SLOTS;
+	double fp_rate = lookups ? (double) compared / 4294967296.0 / lookups : 0.0;
+
+	if (file) {
+		fprintf(file, "DEDUP_MEMORY=%" PRIu64 "\n", dedup_memory(conf));
+		fprintf(file, "DEDUP_USED_SLOTS=%" PRIu64 "\n", used);
+		fprintf(file, "DEDUP_LOOKUPS=%" PRIu64 "\n", lookups);
+		fprintf(file, "DEDUP_DUPLICATES=%" PRIu64 "\n", duplicates);
+		fprintf(file, "DEDUP_EVICTIONS=%" PRIu64 "\n", evictions);
+		fprintf(file, "DEDUP_FALSE_POSITIVE_RATE=%g\n", fp_rate);
+	} else {
+		MSG_ALWAYS(" |     memory: %" PRIu64 " B, used slots: %" PRIu64 " / %" PRIu64, dedup_memory(conf), used, slots);
+		MSG_ALWAYS(" |     flows: %" PRIu64 ", duplicates: %" PRIu64 ", evictions: %" PRIu64, lookups, duplicates, evictions);
+		MSG_ALWAYS(" |     expected false positive rate: %g", fp_rate);
+	}
+}
+
+/**
+ * \brief Plugin initialization
+ *
+ * \param[in] params xml configuration
+ * \param[in] ip_config	intermediate process config
+ * \param[in] ip_id	intermediate process ID for template manager
+ * \param[in] template_mgr template manager
+ * \param[out] config config storage
+ * \return 0 on success
+ */
+int intermediate_init(char* params, void* ip_config, uint32_t ip_id, struct ipfix_template_mgr* template_mgr, void** config)
+{
+	/* Suppress compiler warnings */
+	(void) ip_id; (void) template_mgr;
+
+	if (!params) {
+		MSG_ERROR(msg_module, "Missing plugin's configuration");
+		return 1;
+	}
+
+	/* Create configuration */
+	struct plugin_conf *conf = calloc(1, sizeof(struct plugin_conf));
+	if (!conf) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	/* Process configuration */
+	if (process_startup_xml(conf, params) != 0) {
+		dedup_free_config(conf);
+		return 1;
+	}
+
+	conf->gen[0].slots = calloc((size_t) conf->buckets * DEDUP_BUCKET_SLOTS, sizeof(uint64_t));
+	conf->gen[1].slots = calloc((size_t) conf->buckets * DEDUP_BUCKET_SLOTS, sizeof(uint64_t));
+	if (!conf->gen[0].slots || !conf->gen[1].slots) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		dedup_free_config(conf);
+		return 1;
+	}
+
+	if (conf->mode == DEDUP_MARK) {
+		conf->column = enrich_field_register(DEDUP_ENTERPRISE, DEDUP_FIELD, DEDUP_LENGTH);
+		if (conf->column < 0) {
+			MSG_ERROR(msg_module, "Unable to register enrichment field");
+			dedup_free_config(conf);
+			return 1;
+		}
+	}
+
+	/* Save configuration */
+	conf->ip_config = ip_config;
+	*config = conf;
+
+	statistics_register(msg_module, &dedup_print_stats, conf);
+
+	MSG_INFO(msg_module, "Remembering flows for %ld-%lds in %" PRIu64 " B (%s duplicates)",
+			(long) conf->window, (long) 2 * conf->window, dedup_memory(conf),
+			conf->mode == DEDUP_DROP ? "dropping" : "marking");
+	return 0;
+}
+
+/**
+ * \brief Move to the generation of the current window
+ *
+ * Slots of generations older than the previous window are cleared.
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] now current time
+ */
+static void dedup_rotate(struct plugin_conf *conf, time_t now)
+{
+	time_t epoch = now / conf->window;
+	struct dedup_generation *gen = &conf->gen[conf->current];
+
+	if (gen->epoch == epoch) {
+		return;
+	}
+
+	/* The other generation becomes current */
+	conf->current ^= 1;
+	gen = &conf->gen[conf->current];
+	memset(gen->slots, 0, (size_t) conf->buckets * DEDUP_BUCKET_SLOTS * sizeof(uint64_t));
+	__sync_lock_test_and_set(&gen->used, 0);
+	gen->epoch = epoch;
+
+	/* Previous generation is too old too */
+	gen = &conf->gen[conf->current ^ 1];
+	if (gen->epoch != epoch - 1 && gen->used) {
+		memset(gen->slots, 0, (size_t) conf->buckets * DEDUP_BUCKET_SLOTS * sizeof(uint64_t));
+		__sync_lock_test_and_set(&gen->used, 0);
+	}
+}
+
+/**
+ * \brief Look up a bucket for the fingerprint
+ *
+ * \param[in] bucket bucket
+ * \param[in] fp fingerprint
+ * \param[in,out] proc processing data (statistics)
+ * \return matching slot or NULL
+ */
+static inline uint64_t *dedup_bucket_find(uint64_t *bucket, uint32_t fp, struct dedup_process *proc)
+{
+	int i;
+
+	for (i = 0; i < DEDUP_BUCKET_SLOTS; ++i) {
+		if (!bucket[i]) {
+			break;
+		}
+
+		proc->compared++;
+		if ((uint32_t) (bucket[i] >> 32) == fp) {
+			proc->compared--;
+			return &bucket[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief Check whether a flow was exported by other exporter
+ *
+ * The flow is remembered when it is seen for the first time.
+ *
+ * \param[in,out] proc processing data
+ * \param[in] key flow key
+ * \param[out] first_odid ODID of the exporter that exported the flow first
+ * \return 1 if the flow is a duplicate, 0 otherwise
+ */
+static int dedup_check(struct dedup_process *proc, const struct ipfix_flow_key *key, uint32_t *first_odid)
+{
+	struct plugin_conf *conf = proc->conf;
+	struct dedup_generation *gen;
+	uint64_t hash = flow_key_hash(key), *bucket, *slot;
+	uint32_t fp = (uint32_t) (hash >> 32), odid;
+	size_t index = (hash & (conf->buckets - 1)) * DEDUP_BUCKET_SLOTS;
+	int i;
+
+	/* Zero fingerprint would look like an empty slot */
+	if (fp == 0) {
+		fp = 1;
+	}
+
+	proc->lookups++;
+
+	/* Current generation first, then the previous one */
+	for (i = 0; i < 2; ++i) {
+		gen = &conf->gen[conf->current ^ i];
+		slot = dedup_bucket_find(gen->slots + index, fp, proc);
+		if (slot) {
+			odid = (uint32_t) *slot;
+			if (odid == proc->odid) {
+				return 0;
+			}
+
+			*first_odid = odid;
+			return 1;
+		}
+	}
+
+	/* Remember the flow */
+	gen = &conf->gen[conf->current];
+	bucket = gen->slots + index;
+	for (i = 0; i < DEDUP_BUCKET_SLOTS && bucket[i]; ++i);
+
+	if (i == DEDUP_BUCKET_SLOTS) {
+		/* Bucket is full, overwrite a slot */
+		i = fp % DEDUP_BUCKET_SLOTS;
+		proc->evictions++;
+	} else {
+		__sync_fetch_and_add(&gen->used, 1);
+	}
+
+	bucket[i] = ((uint64_t) fp << 32) | proc->odid;
+	return 0;
+}
+
+/**
+ * \brief Check one data record
+ *
+ * \param[in] rec Data record
+ * \param[in] rec_len Data record's length
+ * \param[in] templ Data record's template
+ * \param[in] data Processing data
+ */
+void dedup_process_data_record(uint8_t *rec, int rec_len, struct ipfix_template *templ, void *data)
+{
+	struct dedup_process *proc = (struct dedup_process *) data;
+	struct ipfix_flow_key key;
+	uint32_t odid = 0;
+	int duplicate = 0;
+
+	(void) rec_len;
+
+	if (templ->template_type == TM_TEMPLATE && !data_record_flow_key(rec, templ, &key)) {
+		duplicate = dedup_check(proc, &key, &odid);
+	}
+
+	proc->first_odid[proc->records] = odid;
+	proc->duplicate[proc->records++] = duplicate;
+	if (duplicate) {
+		proc->duplicates++;
+	}
+}
+
+/**
+ * \brief Process IPFIX message
+ *
+ * \param[in] config plugin configuration
+ * \param[in] message IPFIX message
+ * \return 0 on success
+ */
+int intermediate_process_message(void* config, void* message)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) config;
+	struct ipfix_message *msg = (struct ipfix_message *) message, *new_msg;
+	struct dedup_process proc;
+	uint32_t odid;
+	int i;
+
+	if (msg->source_status == SOURCE_STATUS_CLOSED || msg->data_records_count == 0) {
+		pass_message(conf->ip_config, msg);
+		return 0;
+	}
+
+	memset(&proc, 0, sizeof(proc));
+	proc.conf = conf;
+	proc.odid = msg->input_info->odid;
+	proc.first_odid = malloc(msg->data_records_count * sizeof(uint32_t));
+	proc.duplicate = malloc(msg->data_records_count * sizeof(uint8_t));
+	if (!proc.first_odid || !proc.duplicate) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		free(proc.first_odid);
+		free(proc.duplicate);
+		pass_message(conf->ip_config, msg);
+		return 0;
+	}
+
+	dedup_rotate(conf, time(NULL));
+
+	/* Check all data records */
+	for (i = 0; i < MSG_MAX_DATA_COUPLES && msg->data_couple[i].data_set; ++i) {
+		if (!msg->data_couple[i].data_template) {
+			continue;
+		}
+
+		data_set_process_records(msg->data_couple[i].data_set, msg->data_couple[i].data_template,
+				&dedup_process_data_record, (void *) &proc);
+	}
+
+	/* Statistics are updated once per message */
+	__sync_fetch_and_add(&conf->lookups, proc.lookups);
+	__sync_fetch_and_add(&conf->duplicates, proc.duplicates);
+	__sync_fetch_and_add(&conf->evictions, proc.evictions);
+	__sync_fetch_and_add(&conf->compared, proc.compared);
+
+	if (!proc.duplicates) {
+		free(proc.first_odid);
+		free(proc.duplicate);
+		pass_message(conf->ip_config, msg);
+		return 0;
+	}
+
+	if (conf->mode == DEDUP_MARK) {
+		for (i = 0; i < proc.records; ++i) {
+			if (proc.duplicate[i]) {
+				odid = htonl(proc.first_odid[i]);
+				enrich_value_set(msg, conf->column, i, &odid);
+			}
+		}
+
+		free(proc.first_odid);
+		free(proc.duplicate);
+		pass_message(conf->ip_config, msg);
+		return 0;
+	}
+
+	new_msg = message_remove_records(msg, proc.duplicate);
+	free(proc.first_odid);
+	free(proc.duplicate);
+
+	drop_message(conf->ip_config, msg);
+	if (new_msg) {
+		pass_message(conf->ip_config, new_msg);
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Close intermediate plugin
+ *
+ * \param[in] config plugin configuration
+ * \return 0 on success
+ */
+int intermediate_close(void *config)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) config;
+
+	MSG_DEBUG(msg_module, "Closing");
+
+	statistics_unregister(conf);
+	dedup_free_config(conf);
+
+	return 0;
+}
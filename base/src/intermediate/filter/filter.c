@@ -70,6 +70,9 @@
 /* API version constant */
 IPFIXCOL_API_VERSION;
 
+/* Messages are processed independently, plugin can be replicated */
+IPFIXCOL_INTERMEDIATE_REPLICABLE;
+
 static const char *msg_module = "filter";
 
 /**
@@ -81,6 +84,8 @@ struct filter_process {
 	struct filter_profile *profile; /**< used filter profile */
 	int records;		/**< number of filtered records */
 	struct metadata *metadata;
+	int src_records;	/**< number of processed records */
+	uint16_t *src_index;	/**< original index of each filtered record (enrichment) */
 };
 
 /**
@@ -627,9 +632,15 @@ void filter_process_data_record(uint8_t *rec, int rec_len, struct ipfix_template
 			conf->metadata[conf->records].record.templ = templ;
 		}
 
+		if (conf->src_index) {
+			conf->src_index[conf->records] = conf->src_records;
+		}
+
 		*(conf->offset) += rec_len;
 		conf->records++;
 	}
+
+	conf->src_records++;
 }
 
 /**
@@ -684,6 +695,8 @@ void filter_copy_metainfo(struct ipfix_message *src, struct ipfix_message *dst)
 	dst->source_status = src->source_status;
 	dst->templ_records_count = src->templ_records_count;
 	dst->opt_templ_records_count = src->opt_templ_records_count;
+	dst->trace_received = src->trace_received;
+	dst->trace_stage = src->trace_stage;
 }
 
 /**
@@ -726,6 +739,11 @@ struct ipfix_message *filter_apply_profile(struct ipfix_message *msg, struct fil
 	conf.profile = profile;
 	conf.records = 0;
 	conf.metadata = message_copy_metadata(msg);
+	conf.src_records = 0;
+	conf.src_index = NULL;
+	if (msg->enrich) {
+		conf.src_index = calloc(msg->data_records_count, sizeof(uint16_t));
+	}
 
 	/* Copy header */
 	memcpy(ptr, msg->pkt_header, IPFIX_HEADER_LENGTH);
@@ -763,6 +781,7 @@ struct ipfix_message *filter_apply_profile(struct ipfix_message *msg, struct fil
 	if (offset == IPFIX_HEADER_LENGTH) {
 		/* empty message */
 		free(ptr);
+		free(conf.src_index);
 		return NULL;
 	}
 
@@ -791,6 +810,14 @@ struct ipfix_message *filter_apply_profile(struct ipfix_message *msg, struct fil
 	new_msg->metadata = conf.metadata;
 	new_msg->data_records_count = conf.records;
 
+	/* Copy values of enrichment fields of filtered records */
+	if (conf.src_index) {
+		for (i = 0; i < conf.records; ++i) {
+			enrich_record_copy(new_msg, i, msg, conf.src_index[i]);
+		}
+		free(conf.src_index);
+	}
+
 	filter_copy_metainfo(msg, new_msg);
 
 	return new_msg;
@@ -83,6 +83,7 @@ struct mapping {
 	struct mapped_template *new_templ;  /* mapped template */
 	struct ipfix_template_record *orig_rec; /* original template record */
 	struct mapping *next; /* next mapping */
+	struct mapping *hnext; /* next mapping in the same hash table bucket */
 };
 
 /* reuse released Template ID */
@@ -100,6 +101,10 @@ struct mapping_header {
 	struct input_info *input_info;
 	struct mapping_header *next; /* Next header */
 	struct ipfix_template *remove_later;
+	struct mapping **table; /* hash table of mappings (by ODID, TID and type) */
+	uint32_t table_size;    /* number of buckets (power of two) */
+	uint32_t count;         /* number of mappings */
+	bool add_orig_odid;     /* add field 405 to mapped templates */
 };
 
 /* structure for each mapped source ODID */
@@ -120,6 +125,7 @@ struct joinflows_ip_config {
 	struct source *default_source;  /* mapping for unmentioned ODIDs */
 	uint32_t ip_id; /* source ID for Template Manager */
 	struct ipfix_template_mgr *tm; /* Template Manager */
+	bool in_place; /* relabel messages without copying records */
 };
 
 /* struct for data and template processing */
@@ -135,11 +141,15 @@ struct joinflows_processor {
 	struct source *src;
 	struct metadata *metadata;
 	uint16_t metadata_index;
+	bool in_place;
 };
 
 /* TODO!!!!!!!!*/
 #define TEMPL_MAX_LEN 100000
 
+/* initial number of buckets of the mapping hash table */
+#define MAPPING_TABLE_SIZE 64
+
 /**
  * \brief Compate template records
  *
@@ -181,9 +191,10 @@ int records_compare(struct ipfix_template_record *first, int lenf, struct ipfix_
  * \param[in] type Template type
  * \param[in] new_tid Template ID of new template record
  * \param[in] odid ODID
+ * \param[in] add_orig_odid Add field 405 (if not present)
  * \return pointer to updated template
  */
-struct mapped_template *updated_templ(struct ipfix_template_record *orig_rec, int rec_len, int type, uint16_t new_tid, uint32_t odid)
+struct mapped_template *updated_templ(struct ipfix_template_record *orig_rec, int rec_len, int type, uint16_t new_tid, uint32_t odid, bool add_orig_odid)
 {
 	struct mapped_template *new_mapped;
 	struct ipfix_template_record *new_rec;
@@ -210,7 +221,7 @@ struct mapped_template *updated_templ(struct ipfix_template_record *orig_rec, in
 	/**
 	 * Check whether template record already contains 405. If not, add it.
 	 */
-	if (!template_record_get_field(orig_rec, 0, ORIGINAL_ODID_FIELD, NULL)) {
+	if (add_orig_odid && !template_record_get_field(orig_rec, 0, ORIGINAL_ODID_FIELD, NULL)) {
 		memcpy(((uint8_t *)new_rec) + rec_len, &field_num, 2);
 		memcpy(((uint8_t *)new_rec) + rec_len + 2, &field_len, 2);
 		new_rec->count = htons(ntohs(new_rec->count) + 1);
@@ -266,6 +277,53 @@ void mapping_reuse_tid(struct mapping_header *map, uint16_t tid)
 	map->reuse = reuse;
 }
 
+/**
+ * \brief Compute hash of a mapping key
+ *
+ * \param[in] orig_odid Original ODID
+ * \param[in] orig_tid Original Template ID
+ * \param[in] type Template type
+ * \return hash value
+ */
+static inline uint32_t mapping_hash(uint32_t orig_odid, uint16_t orig_tid, int type)
+{
+	uint32_t hash = orig_odid * 0x9E3779B1U;
+	hash ^= ((uint32_t) orig_tid << 1) | (type & 1);
+	hash *= 0x85EBCA6BU;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+/**
+ * \brief Resize hash table of mappings
+ *
+ * \param[in] map Mapping header
+ * \param[in] size New number of buckets (power of two)
+ * \return 0 on success
+ */
+int mapping_table_resize(struct mapping_header *map, uint32_t size)
+{
+	struct mapping **table, *aux_map;
+	uint32_t idx;
+
+	table = calloc(size, sizeof(struct mapping *));
+	if (!table) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	for (aux_map = map->first; aux_map; aux_map = aux_map->next) {
+		idx = mapping_hash(aux_map->orig_odid, aux_map->orig_tid, aux_map->type) & (size - 1);
+		aux_map->hnext = table[idx];
+		table[idx] = aux_map;
+	}
+
+	free(map->table);
+	map->table = table;
+	map->table_size = size;
+	return 0;
+}
+
 /**
  * \brief Find mapping for given ODID and TID
  *
@@ -277,16 +335,17 @@ void mapping_reuse_tid(struct mapping_header *map, uint16_t tid)
  */
 struct mapping *mapping_lookup(struct mapping_header *map, uint32_t orig_odid, uint16_t orig_tid, int type)
 {
-	if (map == NULL) {
+	if (map == NULL || map->table == NULL) {
 		return NULL;
 	}
 
-	struct mapping *aux_map = map->first;
+	uint32_t idx = mapping_hash(orig_odid, orig_tid, type) & (map->table_size - 1);
+	struct mapping *aux_map = map->table[idx];
 	while (aux_map) {
 		if (aux_map->orig_odid == orig_odid && aux_map->orig_tid == orig_tid && aux_map->type == type) {
 			return aux_map;
 		}
-		aux_map = aux_map->next;
+		aux_map = aux_map->hnext;
 	}
 
 	return NULL;
@@ -300,8 +359,30 @@ struct mapping *mapping_lookup(struct mapping_header *map, uint32_t orig_odid, u
  */
 void mapping_insert(struct mapping_header *map, struct mapping *new_map)
 {
+	uint32_t idx;
+
 	new_map->next = map->first;
 	map->first = new_map;
+	map->count++;
+
+	/* Keep at most one mapping per bucket on average */
+	if (map->table == NULL || map->count > map->table_size) {
+		uint32_t size = map->table ? 2 * map->table_size : MAPPING_TABLE_SIZE;
+		if (mapping_table_resize(map, size) == 0) {
+			/* The new mapping has been added during resize */
+			return;
+		}
+
+		if (map->table == NULL) {
+			/* Not in the table, lookups will fail */
+			new_map->hnext = NULL;
+			return;
+		}
+	}
+
+	idx = mapping_hash(new_map->orig_odid, new_map->orig_tid, new_map->type) & (map->table_size - 1);
+	new_map->hnext = map->table[idx];
+	map->table[idx] = new_map;
 }
 
 /**
@@ -339,7 +420,13 @@ struct mapping *mapping_create(struct mapping_header *map, uint32_t orig_odid, u
 
 
 	/* Create updated template */
-	new_map->new_templ = updated_templ(orig_rec, rec_len, type, new_map->new_tid, orig_odid);
+	new_map->new_templ = updated_templ(orig_rec, rec_len, type, new_map->new_tid, orig_odid, map->add_orig_odid);
+	if (!new_map->new_templ) {
+		mapping_reuse_tid(map, new_map->new_tid);
+		free(new_map->orig_rec);
+		free(new_map);
+		return NULL;
+	}
 
 	mapping_insert(map, new_map);
 
@@ -372,6 +459,7 @@ struct mapping *mapping_copy(struct mapping *orig_map, uint32_t orig_odid, uint1
 	new_map->orig_rec_len = orig_map->orig_rec_len;
 	new_map->new_odid = orig_map->new_odid;
 	new_map->new_tid = orig_map->new_tid;
+	new_map->type = orig_map->type;
 	new_map->new_templ = orig_map->new_templ;
 	new_map->new_templ->references++;
 
@@ -422,6 +510,9 @@ struct mapping *mapping_equal(struct mapping_header *map, uint32_t orig_odid, ui
 	equal_mapping = mapping_find_equal(map, orig_rec, rec_len, type);
 	if (equal_mapping != NULL) {
 		new_mapping = mapping_copy(equal_mapping, orig_odid, orig_tid);
+		if (!new_mapping) {
+			return NULL;
+		}
 		mapping_insert(map, new_mapping);
 		MSG_DEBUG(msg_module, "[%u -> %u] Equal mapping from %u to %u", orig_odid, new_mapping->new_odid, orig_tid, new_mapping->new_tid);
 	}
@@ -479,6 +570,20 @@ void mapping_destroy_old_templates(struct mapping_header *map)
 void mapping_remove(struct mapping_header *map, struct mapping *old_map)
 {
 	struct mapping *aux_map = map->first;
+	struct mapping **bucket;
+
+	/* Remove from hash table */
+	if (map->table) {
+		bucket = &map->table[mapping_hash(old_map->orig_odid, old_map->orig_tid, old_map->type) & (map->table_size - 1)];
+		while (*bucket) {
+			if (*bucket == old_map) {
+				*bucket = old_map->hnext;
+				break;
+			}
+			bucket = &(*bucket)->hnext;
+		}
+	}
+	map->count--;
 
 	if (map->first == old_map) {
 		map->first = old_map->next;
@@ -540,6 +645,7 @@ void mapping_destroy(struct mapping_header *map)
 
 	mapping_destroy_old_templates(map);
 	
+	free(map->table);
 	free(map->input_info);
 	free(map);
 }
@@ -596,6 +702,14 @@ int intermediate_init(char *params, void *ip_config, uint32_t ip_id, struct ipfi
 	struct source *src = NULL;
 
 	for (curr = root->children; curr != NULL; curr = curr->next) {
+		if (curr->type == XML_ELEMENT_NODE && !xmlStrcmp(curr->name, (const xmlChar *) "inPlace")) {
+			xmlChar *value = xmlNodeGetContent(curr);
+			conf->in_place = value && (!xmlStrcasecmp(value, (const xmlChar *) "yes")
+				|| !xmlStrcasecmp(value, (const xmlChar *) "true"));
+			xmlFree(value);
+			continue;
+		}
+
 		join = curr->children;
 		for (join = curr->children; join != NULL; join = join->next) {
 			to = (char *) xmlGetProp(curr, (const xmlChar *) "to");
@@ -647,12 +761,20 @@ int intermediate_init(char *params, void *ip_config, uint32_t ip_id, struct ipfi
 		}
 	}
 
+	/* Field 405 is added to templates only when records are copied */
+	for (new_map = conf->mappings; new_map; new_map = new_map->next) {
+		new_map->add_orig_odid = !conf->in_place;
+	}
+
 	conf->ip_id = ip_id;
 	conf->ip_config = ip_config;
 	conf->tm = template_mgr;
 
 	xmlFreeDoc(doc);
 	*config = conf;
+	if (conf->in_place) {
+		MSG_INFO(msg_module, "Messages will be relabeled in place (without field 405)");
+	}
 	MSG_INFO(msg_module, "Successfully initialized");
 	return 0;
 }
@@ -660,6 +782,9 @@ int intermediate_init(char *params, void *ip_config, uint32_t ip_id, struct ipfi
 /**
  * \brief Process new templates
  *
+ * New mapped templates are copied to the new message. In the in-place mode,
+ * the Template ID of each template record is replaced by the mapped one.
+ *
  * \param[in] rec Template record
  * \param[in] rec_len Record's length
  * \param[in] data Processor's data
@@ -677,7 +802,7 @@ void templates_processor(uint8_t *rec, int rec_len, void *data)
 		map = mapping_equal(proc->src->mapping, proc->orig_odid, orig_tid, record, rec_len, proc->type);
 		if (map == NULL) {
 			map = mapping_create(proc->src->mapping, proc->orig_odid, orig_tid, record, rec_len, proc->type);
-			mapped = map->new_templ;
+			mapped = map ? map->new_templ : NULL;
 		}
 	} else if (records_compare(record, rec_len, map->orig_rec, map->orig_rec_len, map->orig_odid)) {
 		/* UDPATED*/
@@ -685,8 +810,16 @@ void templates_processor(uint8_t *rec, int rec_len, void *data)
 		map = mapping_equal(proc->src->mapping, proc->orig_odid, orig_tid, record, rec_len, proc->type);
 		if (map == NULL) {
 			map = mapping_create(proc->src->mapping, proc->orig_odid, orig_tid, record, rec_len, proc->type);
-			mapped = map->new_templ;
+			mapped = map ? map->new_templ : NULL;
+		}
+	}
+
+	if (proc->in_place) {
+		/* Mapped template differs only in Template ID */
+		if (map) {
+			record->template_id = htons(map->new_tid);
 		}
+		return;
 	}
 
 	/* Add new mapped record to template set */
@@ -841,6 +974,89 @@ void joinflows_copy_template_info(struct ipfix_template *to, struct ipfix_templa
 	to->last_transmission = from->last_message;
 }
 
+/**
+ * \brief Relabel message to the new ODID without copying records
+ *
+ * Template IDs of template records and Set IDs of data sets are replaced
+ * in place by the mapped ones. Records are not extended by field 405,
+ * the original ODID is stored in the message (ipfix_message::original_odid).
+ *
+ * \param[in] conf Plugin configuration
+ * \param[in,out] msg IPFIX message
+ * \param[in] src Source structure
+ * \param[in] orig_odid Original ODID
+ * \param[in] newsn Sequence number of the relabeled message
+ * \return 0 on success
+ */
+int joinflows_relabel_message(struct joinflows_ip_config *conf, struct ipfix_message *msg, struct source *src, uint32_t orig_odid, uint32_t newsn)
+{
+	uint32_t i;
+	uint16_t metadata_index = 0;
+	struct joinflows_processor proc;
+	struct ipfix_template *templ, *new_templ;
+	struct mapping *map;
+
+	memset(&proc, 0, sizeof(proc));
+	proc.orig_odid = orig_odid;
+	proc.src = src;
+	proc.in_place = true;
+
+	/* Process templates */
+	proc.type = TM_TEMPLATE;
+	for (i = 0; i < MSG_MAX_TEMPL_SETS && msg->templ_set[i]; ++i) {
+		template_set_process_records(msg->templ_set[i], proc.type, &templates_processor, (void *) &proc);
+	}
+
+	/* Process option templates */
+	proc.type = TM_OPTIONS_TEMPLATE;
+	for (i = 0; i < MSG_MAX_OTEMPL_SETS && msg->opt_templ_set[i]; ++i) {
+		template_set_process_records((struct ipfix_template_set *) msg->opt_templ_set[i], proc.type, &templates_processor, (void *) &proc);
+	}
+
+	for (i = 0; i < MSG_MAX_DATA_COUPLES && msg->data_couple[i].data_set; ++i) {
+		templ = msg->data_couple[i].data_template;
+		if (!templ) {
+			continue;
+		}
+
+		map = mapping_lookup(src->mapping, orig_odid, templ->template_id, templ->template_type);
+		if (!map) {
+			MSG_WARNING(msg_module, "[%u] %d not found, something is wrong!", orig_odid, templ->template_id);
+			/* Keep the original template, skip its metadata */
+			while (msg->metadata && metadata_index < msg->data_records_count &&
+				   msg->metadata[metadata_index].record.templ == templ) {
+				metadata_index++;
+			}
+			continue;
+		}
+
+		new_templ = map->new_templ->templ;
+		msg->data_couple[i].data_set->header.flowset_id = htons(new_templ->template_id);
+		msg->data_couple[i].data_template = new_templ;
+
+		/* Copy template info and move the reference to the new template */
+		joinflows_copy_template_info(new_templ, templ);
+		tm_template_reference_inc(new_templ);
+		tm_template_reference_dec(templ);
+
+		/* Update templates in metadata */
+		while (msg->metadata && metadata_index < msg->data_records_count &&
+			   msg->metadata[metadata_index].record.templ == templ) {
+			msg->metadata[metadata_index].record.templ = new_templ;
+			metadata_index++;
+		}
+	}
+
+	msg->pkt_header->observation_domain_id = htonl(src->new_odid);
+	msg->pkt_header->sequence_number = htonl(newsn);
+	msg->input_info = src->mapping->input_info;
+	msg->original_odid = orig_odid;
+	msg->joined = 1;
+
+	pass_message(conf->ip_config, (void *) msg);
+	return 0;
+}
+
 int intermediate_process_message(void *config, void *message)
 {
 	uint32_t orig_odid, i, new_i = 0, prevoffset, tsets = 0, otsets = 0, trec, otrec;
@@ -873,6 +1089,10 @@ int intermediate_process_message(void *config, void *message)
 		return 0;
 	}
 
+	if (conf->in_place) {
+		return joinflows_relabel_message(conf, msg, src, orig_odid, newsn);
+	}
+
 	proc.msg = calloc(1, ntohs(msg->pkt_header->length) + 4 * (msg->data_records_count + msg->templ_records_count + msg->opt_templ_records_count));
 	if (!proc.msg) {
 		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
@@ -891,10 +1111,15 @@ int intermediate_process_message(void *config, void *message)
 	proc.orig_odid = orig_odid;
 	proc.src = src;
 	proc.trecords = 0;
+	proc.in_place = false;
 	new_msg->pkt_header = (struct ipfix_header *) proc.msg;
 	new_msg->live_profile = msg->live_profile;
+	new_msg->trace_received = msg->trace_received;
+	new_msg->trace_stage = msg->trace_stage;
 	new_msg->metadata = msg->metadata;
 	msg->metadata = NULL;
+	new_msg->enrich = msg->enrich;
+	msg->enrich = NULL;
 
 	/* Process templates */
 	proc.type = TM_TEMPLATE;
@@ -990,6 +1215,7 @@ int intermediate_process_message(void *config, void *message)
 	/* Dont send empty message */
 	if (proc.offset == IPFIX_HEADER_LENGTH) {
 		free(proc.msg);
+		message_free_enrich(new_msg);
 		free(new_msg);
 		drop_message(conf->ip_config, message);
 		return 0;
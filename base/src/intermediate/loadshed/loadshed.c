@@ -0,0 +1,436 @@
+/**
+ * \file loadshed.c
+ * \brief Intermediate plugin sampling flows when the collector is overloaded
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <ipfixcol.h>
+#include <ipfixcol/intermediate.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* API version constant */
+IPFIXCOL_API_VERSION;
+
+/* Plugin can be replicated (each replica has its own controller) */
+IPFIXCOL_INTERMEDIATE_REPLICABLE;
+
+/* Identifier for verbose macros */
+static const char *msg_module = "loadshed";
+
+/** Default load (per mille) that increases the sampling rate */
+#define LOADSHED_DEFAULT_HIGH 800
+/** Default load (per mille) that decreases the sampling rate */
+#define LOADSHED_DEFAULT_LOW 500
+/** Default interval between load checks (ms) */
+#define LOADSHED_DEFAULT_INTERVAL 100
+/** Default number of low load checks before the sampling rate is decreased */
+#define LOADSHED_DEFAULT_COOLDOWN 10
+/** Default maximal sampling rate */
+#define LOADSHED_DEFAULT_MAX_RATE 1024
+/** Maximal exponent of the sampling rate */
+#define LOADSHED_MAX_SHIFT 30
+
+/** Enrichment field with the sampling rate of a kept flow */
+#define LOADSHED_ENTERPRISE 8057
+#define LOADSHED_FIELD 1003
+#define LOADSHED_LENGTH 4
+
+/**
+ * \brief Plugin's configuration structure
+ */
+struct plugin_conf {
+	void *ip_config;                /**< Intermediate process config */
+	unsigned int high;              /**< Load that increases the rate (per mille) */
+	unsigned int low;               /**< Load that decreases the rate (per mille) */
+	uint64_t interval;              /**< Interval between load checks (ms) */
+	unsigned int cooldown;          /**< Number of low load checks before decrease */
+	unsigned int max_shift;         /**< Exponent of the maximal sampling rate */
+	int column;                     /**< Enrichment column */
+
+	/* Controller state */
+	unsigned int shift;             /**< Exponent of the sampling rate */
+	unsigned int low_checks;        /**< Number of consecutive low load checks */
+	uint64_t last_check;            /**< Time of the last load check (ms) */
+
+	/* Statistics (read by the statistics thread) */
+	unsigned int load;              /**< Last seen load (per mille) */
+	uint64_t flows;                 /**< Number of seen flows */
+	uint64_t shed;                  /**< Number of removed flows */
+	uint64_t changes;               /**< Number of changes of the sampling rate */
+};
+
+/**
+ * \brief Processing data of one message
+ */
+struct loadshed_process {
+	struct plugin_conf *conf;       /**< Plugin configuration */
+	struct ipfix_message *msg;      /**< Processed message */
+	unsigned int shift;             /**< Exponent of the sampling rate */
+	uint32_t rate;                  /**< Sampling rate (network byte order) */
+	uint8_t *remove;                /**< Remove flags of the records */
+	uint16_t records;               /**< Number of processed records */
+	uint16_t removed;               /**< Number of removed records */
+};
+
+/**
+ * \brief Process startup configuration
+ *
+ * \param[in] conf plugin configuration structure
+ * \param[in] params configuration xml data
+ * \return 0 on success
+ */
+int process_startup_xml(struct plugin_conf *conf, char *params)
+{
+	xmlNode *node;
+	xmlChar *value;
+	long number, max_rate = LOADSHED_DEFAULT_MAX_RATE;
+	char *end;
+	int ret = 0;
+
+	conf->high = LOADSHED_DEFAULT_HIGH;
+	conf->low = LOADSHED_DEFAULT_LOW;
+	conf->interval = LOADSHED_DEFAULT_INTERVAL;
+	conf->cooldown = LOADSHED_DEFAULT_COOLDOWN;
+
+	/* Load XML configuration */
+	xmlDoc *doc = xmlParseDoc(BAD_CAST params);
+	if (!doc) {
+		MSG_ERROR(msg_module, "Unable to parse startup configuration!");
+		return 1;
+	}
+
+	xmlNode *root = xmlDocGetRootElement(doc);
+	if (!root) {
+		MSG_ERROR(msg_module, "Cannot get document root element!");
+		xmlFreeDoc(doc);
+		return 1;
+	}
+
+	for (node = root->children; node && !ret; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		value = xmlNodeGetContent(node);
+		if (!value) {
+			continue;
+		}
+
+		number = strtol((char *) value, &end, 10);
+		if (*end != '\0' || end == (char *) value || number <= 0) {
+			MSG_ERROR(msg_module, "Invalid value '%s' of %s", (char *) value, (char *) node->name);
+			ret = 1;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "highWatermark")) {
+			conf->high = number * 10;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "lowWatermark")) {
+			conf->low = number * 10;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "checkInterval")) {
+			conf->interval = number;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "cooldown")) {
+			conf->cooldown = number;
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "maxRate")) {
+			max_rate = number;
+		} else {
+			MSG_WARNING(msg_module, "Unknown element '%s'", (char *) node->name);
+		}
+
+		xmlFree(value);
+	}
+
+	xmlFreeDoc(doc);
+
+	if (!ret && (conf->high > 1000 || conf->low >= conf->high)) {
+		MSG_ERROR(msg_module, "Watermarks must satisfy 0 < lowWatermark < highWatermark <= 100");
+		ret = 1;
+	}
+
+	/* Sampling rate is a power of two */
+	conf->max_shift = 0;
+	while (conf->max_shift < LOADSHED_MAX_SHIFT && (1L << (conf->max_shift + 1)) <= max_rate) {
+		conf->max_shift++;
+	}
+
+	return ret;
+}
+
+/**
+ * \brief Print statistics
+ *
+ * \param[in] arg plugin configuration
+ * \param[in] file statistics file or NULL
+ */
+void loadshed_print_stats(void *arg, FILE *file)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) arg;
+	unsigned int shift = __sync_fetch_and_add(&conf->shift, 0);
+	unsigned int load = __sync_fetch_and_add(&conf->load, 0);
+	uint64_t flows = __sync_fetch_and_add(&conf->flows, 0);
+	uint64_t shed = __sync_fetch_and_add(&conf->shed, 0);
+	uint64_t changes = __sync_fetch_and_add(&conf->changes, 0);
+
+	if (file) {
+		fprintf(file, "LOADSHED_SAMPLING_RATE=%lu\n", 1UL << shift);
+		fprintf(file, "LOADSHED_LOAD=%u\n", load / 10);
+		fprintf(file, "LOADSHED_FLOWS=%" PRIu64 "\n", flows);
+		fprintf(file, "LOADSHED_SHED=%" PRIu64 "\n", shed);
+		fprintf(file, "LOADSHED_RATE_CHANGES=%" PRIu64 "\n", changes);
+	} else {
+		MSG_ALWAYS(" |     sampling rate: 1:%lu, pipeline load: %u%%", 1UL << shift, load / 10);
+		MSG_ALWAYS(" |     flows: %" PRIu64 ", shed: %" PRIu64 ", rate changes: %" PRIu64, flows, shed, changes);
+	}
+}
+
+/**
+ * \brief Plugin initialization
+ *
+ * \param[in] params xml configuration
+ * \param[in] ip_config	intermediate process config
+ * \param[in] ip_id	intermediate process ID for template manager
+ * \param[in] template_mgr template manager
+ * \param[out] config config storage
+ * \return 0 on success
+ */
+int intermediate_init(char* params, void* ip_config, uint32_t ip_id, struct ipfix_template_mgr* template_mgr, void** config)
+{
+	/* Suppress compiler warnings */
+	(void) ip_id; (void) template_mgr;
+
+	/* Create configuration */
+	struct plugin_conf *conf = calloc(1, sizeof(struct plugin_conf));
+	if (!conf) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	/* Process configuration (all parameters are optional) */
+	if (process_startup_xml(conf, params ? params : "<loadshed/>") != 0) {
+		free(conf);
+		return 1;
+	}
+
+	conf->column = enrich_field_register(LOADSHED_ENTERPRISE, LOADSHED_FIELD, LOADSHED_LENGTH);
+	if (conf->column < 0) {
+		MSG_ERROR(msg_module, "Unable to register enrichment field");
+		free(conf);
+		return 1;
+	}
+
+	/* Save configuration */
+	conf->ip_config = ip_config;
+	*config = conf;
+
+	statistics_register(msg_module, &loadshed_print_stats, conf);
+
+	MSG_INFO(msg_module, "Shedding flows above %u%% load (up to 1:%lu)", conf->high / 10, 1UL << conf->max_shift);
+	return 0;
+}
+
+/**
+ * \brief Get monotonic time
+ *
+ * \return time in milliseconds
+ */
+static inline uint64_t loadshed_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * \brief Update the sampling rate according to the load of the pipeline
+ *
+ * The rate is doubled immediately when the load reaches the high watermark,
+ * it is halved only after the load stays below the low watermark for the
+ * cooldown number of checks, so the rate does not oscillate.
+ *
+ * \param[in,out] conf plugin configuration
+ */
+static void loadshed_control(struct plugin_conf *conf)
+{
+	uint64_t now = loadshed_now();
+	unsigned int load, shift = conf->shift;
+
+	if (now - conf->last_check < conf->interval) {
+		return;
+	}
+
+	conf->last_check = now;
+	load = pipeline_load(conf->ip_config);
+	__sync_lock_test_and_set(&conf->load, load);
+
+	if (load >= conf->high) {
+		conf->low_checks = 0;
+		if (shift < conf->max_shift) {
+			shift++;
+		}
+	} else if (load <= conf->low && shift > 0) {
+		if (++conf->low_checks >= conf->cooldown) {
+			conf->low_checks = 0;
+			shift--;
+		}
+	} else {
+		conf->low_checks = 0;
+	}
+
+	if (shift != conf->shift) {
+		MSG_INFO(msg_module, "Pipeline load %u%%, sampling rate 1:%lu", load / 10, 1UL << shift);
+		__sync_lock_test_and_set(&conf->shift, shift);
+		__sync_fetch_and_add(&conf->changes, 1);
+	}
+}
+
+/**
+ * \brief Decide whether to keep one data record
+ *
+ * A flow is kept when the upper bits of its hash are zero. Flows kept with
+ * a higher rate are kept with all lower rates too.
+ *
+ * \param[in] rec Data record
+ * \param[in] rec_len Data record's length
+ * \param[in] templ Data record's template
+ * \param[in] data Processing data
+ */
+void loadshed_process_data_record(uint8_t *rec, int rec_len, struct ipfix_template *templ, void *data)
+{
+	struct loadshed_process *proc = (struct loadshed_process *) data;
+	struct ipfix_flow_key key;
+	uint8_t remove = 0;
+
+	(void) rec_len;
+
+	/* Options and flows without addresses are always kept */
+	if (templ->template_type == TM_TEMPLATE && !data_record_flow_key(rec, templ, &key)) {
+		if (flow_key_hash(&key) >> (64 - proc->shift)) {
+			remove = 1;
+			proc->removed++;
+		} else {
+			/* Annotate the flow with the rate (copied with the record) */
+			enrich_value_set(proc->msg, proc->conf->column, proc->records, &proc->rate);
+		}
+	}
+
+	proc->remove[proc->records++] = remove;
+}
+
+/**
+ * \brief Process IPFIX message
+ *
+ * \param[in] config plugin configuration
+ * \param[in] message IPFIX message
+ * \return 0 on success
+ */
+int intermediate_process_message(void* config, void* message)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) config;
+	struct ipfix_message *msg = (struct ipfix_message *) message, *new_msg;
+	struct loadshed_process proc;
+	int i;
+
+	loadshed_control(conf);
+
+	if (conf->shift == 0 || msg->source_status == SOURCE_STATUS_CLOSED || msg->data_records_count == 0) {
+		__sync_fetch_and_add(&conf->flows, msg->data_records_count);
+		pass_message(conf->ip_config, msg);
+		return 0;
+	}
+
+	memset(&proc, 0, sizeof(proc));
+	proc.conf = conf;
+	proc.msg = msg;
+	proc.shift = conf->shift;
+	proc.rate = htonl(1U << proc.shift);
+	proc.remove = malloc(msg->data_records_count);
+	if (!proc.remove) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		pass_message(conf->ip_config, msg);
+		return 0;
+	}
+
+	/* Sample all data records */
+	for (i = 0; i < MSG_MAX_DATA_COUPLES && msg->data_couple[i].data_set; ++i) {
+		if (!msg->data_couple[i].data_template) {
+			continue;
+		}
+
+		data_set_process_records(msg->data_couple[i].data_set, msg->data_couple[i].data_template,
+				&loadshed_process_data_record, (void *) &proc);
+	}
+
+	/* Statistics are updated once per message */
+	__sync_fetch_and_add(&conf->flows, proc.records);
+	__sync_fetch_and_add(&conf->shed, proc.removed);
+
+	if (!proc.removed) {
+		free(proc.remove);
+		pass_message(conf->ip_config, msg);
+		return 0;
+	}
+
+	new_msg = message_remove_records(msg, proc.remove);
+	free(proc.remove);
+
+	drop_message(conf->ip_config, msg);
+	if (new_msg) {
+		pass_message(conf->ip_config, new_msg);
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Close intermediate plugin
+ *
+ * \param[in] config plugin configuration
+ * \return 0 on success
+ */
+int intermediate_close(void *config)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) config;
+
+	MSG_DEBUG(msg_module, "Closing");
+
+	statistics_unregister(conf);
+	free(conf);
+
+	return 0;
+}
@@ -44,6 +44,9 @@
  *
  * This plugin adds information about exporter's IP address into each 
  * data record (if it does not contain it yet). Supported are both IPv4 and IPv6.
+ * In the enrichment mode, the address is stored as an enrichment field of
+ * the message instead of rewriting templates and records. Only storage
+ * plugins declaring IPFIXCOL_STORAGE_ENRICHMENT can be used in this mode.
  *
  * @{
  */
@@ -54,6 +57,9 @@
 
 #include <ipfixcol.h>
 
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
 /* API version constant */
 IPFIXCOL_API_VERSION;
 
@@ -71,6 +77,9 @@ struct odip_ip_config {
 	void *ip_config;               /* internal process configuration */
 	uint32_t ip_id;                /* source ID for Template Manager */
 	struct ipfix_template_mgr *tm; /* Template Manager */
+	bool enrich;                   /* store address as enrichment field */
+	int column4;                   /* enrichment column of IPv4 address */
+	int column6;                   /* enrichment column of IPv6 address */
 };
 
 /* structure for processing message */
@@ -98,7 +107,6 @@ struct odip_processor {
  */
 int intermediate_init(char *params, void *ip_config, uint32_t ip_id, struct ipfix_template_mgr *template_mgr, void **config)
 {
-	(void) params;
 	struct odip_ip_config *conf;
 	conf = (struct odip_ip_config *) calloc(1, sizeof(*conf));
 	if (!conf) {
@@ -106,6 +114,35 @@ int intermediate_init(char *params, void *ip_config, uint32_t ip_id, struct ipfi
 		return -1;
 	}
 
+	/* parse configuration (optional) */
+	xmlDoc *doc = params ? xmlParseDoc(BAD_CAST params) : NULL;
+	xmlNode *root = doc ? xmlDocGetRootElement(doc) : NULL;
+	xmlNode *curr = NULL;
+
+	for (curr = root ? root->children : NULL; curr != NULL; curr = curr->next) {
+		if (curr->type == XML_ELEMENT_NODE && !xmlStrcmp(curr->name, (const xmlChar *) "enrichment")) {
+			xmlChar *value = xmlNodeGetContent(curr);
+			conf->enrich = value && (!xmlStrcasecmp(value, (const xmlChar *) "yes")
+				|| !xmlStrcasecmp(value, (const xmlChar *) "true"));
+			xmlFree(value);
+		}
+	}
+
+	if (doc) {
+		xmlFreeDoc(doc);
+	}
+
+	if (conf->enrich) {
+		conf->column4 = enrich_field_register(0, ODIP4_FIELD, ODIP4_LENGTH);
+		conf->column6 = enrich_field_register(0, ODIP6_FIELD, ODIP6_LENGTH);
+		if (conf->column4 < 0 || conf->column6 < 0) {
+			MSG_ERROR(msg_module, "Unable to register enrichment fields");
+			free(conf);
+			return -1;
+		}
+		MSG_INFO(msg_module, "Exporter's address will be stored as enrichment field");
+	}
+
 	conf->ip_id = ip_id;
 	conf->ip_config = ip_config;
 	conf->tm = template_mgr;
@@ -227,6 +264,32 @@ void odip_copy_template_info(struct ipfix_template *to, struct ipfix_template *f
 	to->last_transmission = from->last_transmission;
 }
 
+/**
+ * \brief Store exporter's address as enrichment field of each record
+ *
+ * Records of the message are not modified. Storage plugins get the address
+ * via message_record_get_field() (if the record doesn't contain it).
+ *
+ * @param conf plugin configuration
+ * @param msg IPFIX message
+ * @param info input information of the message
+ * @return 0 on success
+ */
+int odip_enrich_message(struct odip_ip_config *conf, struct ipfix_message *msg, struct input_info_network *info)
+{
+	int column = (info->l3_proto == 4) ? conf->column4 : conf->column6;
+	uint16_t i;
+
+	for (i = 0; i < msg->data_records_count; ++i) {
+		if (enrich_value_set(msg, column, i, &(info->src_addr)) != 0) {
+			break;
+		}
+	}
+
+	pass_message(conf->ip_config, (void *) msg);
+	return 0;
+}
+
 /**
  * \brief Process IPFIX message
  * 
@@ -249,6 +312,10 @@ int intermediate_process_message(void *config, void *message)
 		pass_message(conf->ip_config, (void *) msg);
 		return 0;
 	}
+
+	if (conf->enrich) {
+		return odip_enrich_message(conf, msg, info);
+	}
 	
 	/* allocate space for new message */
 	if (info->l3_proto == 4) {
@@ -274,6 +341,8 @@ int intermediate_process_message(void *config, void *message)
 	new_msg->pkt_header = (struct ipfix_header *) proc.msg;
 	new_msg->metadata = msg->metadata;
 	msg->metadata = NULL;
+	new_msg->enrich = msg->enrich;
+	msg->enrich = NULL;
 
 	proc.tm = conf->tm;
 	proc.key.crc = conf->ip_id;
@@ -383,6 +452,8 @@ int intermediate_process_message(void *config, void *message)
 	new_msg->live_profile = msg->live_profile;
 	new_msg->plugin_id = msg->plugin_id;
 	new_msg->plugin_status = msg->plugin_status;
+	new_msg->trace_received = msg->trace_received;
+	new_msg->trace_stage = msg->trace_stage;
 
 	drop_message(conf->ip_config, message);
 	pass_message(conf->ip_config, (void *) new_msg);
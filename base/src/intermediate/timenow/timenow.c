@@ -47,6 +47,9 @@
 /* API version constant */
 IPFIXCOL_API_VERSION;
 
+/* Messages are processed independently, plugin can be replicated */
+IPFIXCOL_INTERMEDIATE_REPLICABLE;
+
 /* Identifier for verbose macros */
 static const char *msg_module = "timenow";
 
@@ -170,26 +173,22 @@ void timenow_update_timestamps(struct ipfix_record *record, uint64_t time_diff)
 }
 
 /**
- * \brief Process IPFIX message
- * 
- * \param[in] config plugin configuration
- * \param[in] message IPFIX message
- * \return 0 on success
+ * \brief Update timestamps of all flow records of a message
+ *
+ * \param[in] msg IPFIX message
+ * \param[in] now current time
  */
-int intermediate_process_message(void* config, void* message)
+static void timenow_update_message(struct ipfix_message *msg, time_t now)
 {
-	struct plugin_conf *conf = (struct plugin_conf *) config;
-	struct ipfix_message *msg = (struct ipfix_message *) message;
 	int flow_count = msg->data_records_count;
 
 	/* Do nothing when there are no flow records */
 	if (flow_count < 1) {
-		pass_message(conf->ip_config, msg);
-		return 0;
+		return;
 	}
 
 	/* Compute number of milliseconds from packet export time */
-	uint64_t time_diff = time(NULL) - ntohl(msg->pkt_header->export_time);
+	uint64_t time_diff = now - ntohl(msg->pkt_header->export_time);
 	time_diff *= 1000;
 
 	/* Process each data record (except last) */
@@ -204,12 +203,51 @@ int intermediate_process_message(void* config, void* message)
 
 	/* Do the last record here (no more prefetch) */
 	timenow_update_timestamps(&(msg->metadata[flow_count - 1].record), time_diff);
+}
+
+/**
+ * \brief Process IPFIX message
+ * 
+ * \param[in] config plugin configuration
+ * \param[in] message IPFIX message
+ * \return 0 on success
+ */
+int intermediate_process_message(void* config, void* message)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) config;
+	struct ipfix_message *msg = (struct ipfix_message *) message;
+
+	timenow_update_message(msg, time(NULL));
 
 	/* Pass message to the next plugin/Output Manager */
 	pass_message(conf->ip_config, msg);
 	return 0;
 }
 
+/**
+ * \brief Process batch of IPFIX messages
+ *
+ * Current time is read once for the whole batch.
+ *
+ * \param[in] config plugin configuration
+ * \param[in] messages IPFIX messages
+ * \param[in] count number of messages
+ * \return 0 on success
+ */
+int intermediate_process_batch(void* config, void** messages, int count)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) config;
+	time_t now = time(NULL);
+
+	for (int i = 0; i < count; ++i) {
+		timenow_update_message((struct ipfix_message *) messages[i], now);
+	}
+
+	/* Pass messages to the next plugin/Output Manager */
+	pass_messages(conf->ip_config, (struct ipfix_message **) messages, count);
+	return 0;
+}
+
 /**
  * \brief Close intermediate plugin
  * 
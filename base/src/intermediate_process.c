@@ -47,25 +47,50 @@
 #include "queues.h"
 #include "intermediate_process.h"
 #include "config.h"
+#include "output_manager.h"
+#include "latency.h"
+#include "affinity.h"
 #include <ipfixcol/intermediate.h>
 
 static char *msg_module = "intermediate_process";
 
+/** Initial number of messages a replica can pass during one process call */
+#define IP_PASSED_INIT 4
+
+/**
+ * \brief Pin intermediate thread to configured CPUs
+ *
+ * Input queue is moved to NUMA node of the thread when the thread is pinned.
+ *
+ * \param[in] conf intermediate process configuration
+ * \param[in] in_queue input queue
+ */
+static void ip_set_affinity(struct intermediate *conf, struct ring_buffer *in_queue)
+{
+	char *cpus = conf->xml_conf->cpu_affinity;
+
+	if (affinity_set(cpus, conf->thread_name) == 0 && cpus) {
+		rbuffer_bind_local(in_queue);
+	}
+}
+
 /**
  * \brief Wait for data from input queue in loop.
  *
  * This function runs in separated thread.
  *
- * \param[in] config configuration structure
+ * \param[in] config replica structure
  * \return NULL
  */
 void *ip_loop(void *config)
 {
-	struct intermediate *conf = (struct intermediate *) config;
+	struct intermediate_replica *replica = (struct intermediate_replica *) config;
+	struct intermediate *conf = replica->inter;
 	struct ipfix_message *msg;
 	unsigned int index;
 
 	prctl(PR_SET_NAME, conf->thread_name, 0, 0, 0);
+	ip_set_affinity(conf, conf->in_queue);
 
 	/* wait for messages and process them */
 	while (1) {
@@ -78,9 +103,12 @@ void *ip_loop(void *config)
 			rbuffer_remove_reference(conf->in_queue, index, 1);
 			if (conf->new_in) {
 				/* Set new input queue */
+				pthread_mutex_lock(&conf->in_q_mutex);
 				conf->in_queue = conf->new_in;
 				conf->new_in = NULL;
 				pthread_cond_signal(&conf->in_q_cond);
+				pthread_mutex_unlock(&conf->in_q_mutex);
+				ip_set_affinity(conf, conf->in_queue);
 				continue;
 			}
 
@@ -88,13 +116,13 @@ void *ip_loop(void *config)
 			MSG_DEBUG(msg_module, "NULL message; terminating intermediate process %s...", conf->thread_name);
 			break;
 		}
-		conf->index = index;
-		conf->dropped = false;
+		replica->index = index;
+		replica->dropped = false;
 		
 		/* process message */
-		conf->intermediate_process_message(conf->plugin_config, msg);
+		conf->intermediate_process_message(replica->plugin_config, msg);
 
-		if (!conf->dropped) {
+		if (!replica->dropped) {
 			/* remove message from input queue, but do not free memory (it must be done later in output manager) */
 			rbuffer_remove_reference(conf->in_queue, index, 0);
 		}
@@ -103,6 +131,105 @@ void *ip_loop(void *config)
 	return NULL;
 }
 
+/**
+ * \brief Wait for batches of data from input queue in loop.
+ *
+ * Used for plugins processing batches of messages and for replicated plugins.
+ * Replicas take batches one by one in the order of the input queue and each
+ * batch gets a sequence number. Messages passed by a replica wait until all
+ * batches with lower sequence numbers are written into the output queue, so
+ * the output keeps the order of the input.
+ *
+ * This function runs in separated thread.
+ *
+ * \param[in] config replica structure
+ * \return NULL
+ */
+void *ip_loop_batch(void *config)
+{
+	struct intermediate_replica *replica = (struct intermediate_replica *) config;
+	struct intermediate *conf = replica->inter;
+	struct ipfix_message *msgs[INTERMEDIATE_BATCH_MAX];
+	unsigned int index, count, max;
+
+	prctl(PR_SET_NAME, conf->thread_name, 0, 0, 0);
+	ip_set_affinity(conf, conf->in_queue);
+
+	/* plugins without batch processing get messages one by one */
+	max = conf->intermediate_process_batch ? INTERMEDIATE_BATCH_MAX : 1;
+
+	/* wait for messages and process them */
+	while (1) {
+		/* take the next messages of input buffer */
+		pthread_mutex_lock(&conf->read_mutex);
+		replica->in_queue = conf->in_queue;
+		index = conf->next_index;
+
+		count = rbuffer_read_batch(replica->in_queue, &index, msgs, max);
+		if (count == 0) {
+			pthread_mutex_unlock(&conf->read_mutex);
+			MSG_ERROR(msg_module, "Unable to read input queue; terminating intermediate process %s...", conf->thread_name);
+			break;
+		}
+
+		conf->next_index = (index + count) % replica->in_queue->size;
+
+		if (!msgs[0]) {
+			/* messages of other replicas may be still in process, do not free them */
+			rbuffer_remove_reference(replica->in_queue, index, 0);
+			if (conf->new_in) {
+				/* Set new input queue */
+				pthread_mutex_lock(&conf->in_q_mutex);
+				conf->in_queue = conf->new_in;
+				conf->new_in = NULL;
+				conf->next_index = -1;
+				pthread_cond_signal(&conf->in_q_cond);
+				pthread_mutex_unlock(&conf->in_q_mutex);
+				ip_set_affinity(conf, conf->in_queue);
+				pthread_mutex_unlock(&conf->read_mutex);
+				continue;
+			}
+
+			/* terminating replica (each one gets its own NULL message) */
+			pthread_mutex_unlock(&conf->read_mutex);
+			MSG_DEBUG(msg_module, "NULL message; terminating intermediate process %s...", conf->thread_name);
+			break;
+		}
+
+		replica->seq = conf->next_seq++;
+		pthread_mutex_unlock(&conf->read_mutex);
+
+		replica->index = index;
+		replica->passed_cnt = 0;
+
+		/* process messages */
+		if (conf->intermediate_process_batch) {
+			conf->intermediate_process_batch(replica->plugin_config, (void **) msgs, count);
+		} else {
+			conf->intermediate_process_message(replica->plugin_config, msgs[0]);
+		}
+
+		/* wait for turn and write passed messages into output buffer */
+		pthread_mutex_lock(&conf->out_mutex);
+		while (conf->out_seq != replica->seq) {
+			pthread_cond_wait(&conf->out_cond, &conf->out_mutex);
+		}
+
+		if (replica->passed_cnt > 0) {
+			rbuffer_write_batch(conf->out_queue, replica->passed, replica->passed_cnt, 1);
+		}
+
+		conf->out_seq++;
+		pthread_cond_broadcast(&conf->out_cond);
+		pthread_mutex_unlock(&conf->out_mutex);
+
+		/* remove messages from input queue, dropped messages are already freed */
+		rbuffer_remove_references(replica->in_queue, index, count, 0);
+	}
+
+	return NULL;
+}
+
 /**
  * \brief Change process input queue
  */
@@ -122,32 +249,105 @@ int ip_change_in_queue(struct intermediate* conf, struct ring_buffer* in_queue)
 	return 0;
 }
 
+/**
+ * \brief Stop first \p count replicas
+ *
+ * \param[in] conf configuration structure
+ * \param[in] count number of running replicas
+ */
+static void ip_stop_replicas(struct intermediate *conf, unsigned int count)
+{
+	void *retval;
+	unsigned int i;
+
+	/* each replica terminates on its own NULL message */
+	for (i = 0; i < count; ++i) {
+		rbuffer_write(conf->in_queue, NULL, 1);
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (pthread_join(conf->replica[i].thread_id, &retval) != 0) {
+			MSG_DEBUG(msg_module, "pthread_join() error");
+		}
+	}
+}
+
 /**
  * \brief Initialize Intermediate Process.
  */
 int ip_init(struct intermediate *conf, uint32_t ip_id)
 {
+	unsigned int i, running;
 	int ret;
 
-	/* Initialize plugin */
+	if (conf->replicas == 0) {
+		conf->replicas = 1;
+	}
+
+	conf->deferred = (conf->replicas > 1 || conf->intermediate_process_batch);
+	conf->latency = latency_stage_get(conf->thread_name);
+	conf->next_index = -1;
+	conf->next_seq = 0;
+	conf->out_seq = 0;
+	pthread_mutex_init(&conf->read_mutex, NULL);
+	pthread_mutex_init(&conf->out_mutex, NULL);
+	pthread_cond_init(&conf->out_cond, NULL);
+
+	conf->replica = calloc(conf->replicas, sizeof(struct intermediate_replica));
+	if (!conf->replica) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		ip_close(conf);
+		return -1;
+	}
+
+	/* Initialize plugin (each replica gets its own instance) */
 	xmlChar *ip_params = NULL;
 	xmlDocDumpMemory(conf->xml_conf->xmldata, &ip_params, NULL);
 	
-	conf->intermediate_init((char *) ip_params, conf, ip_id, template_mgr, &(conf->plugin_config));
-	if (conf->plugin_config == NULL) {
-		MSG_ERROR(msg_module, "Unable to initialize intermediate process");
-		return -1;
+	for (i = 0; i < conf->replicas; ++i) {
+		conf->replica[i].inter = conf;
+		conf->intermediate_init((char *) ip_params, &(conf->replica[i]), ip_id, template_mgr, &(conf->replica[i].plugin_config));
+		if (conf->replica[i].plugin_config == NULL) {
+			MSG_ERROR(msg_module, "Unable to initialize intermediate process");
+			free(ip_params);
+			ip_close(conf);
+			return -1;
+		}
 	}
 
 	free(ip_params);
 	
-	/* start main thread */
-	ret = pthread_create(&(conf->thread_id), NULL, ip_loop, (void *)conf);
-	if (ret != 0) {
+	/* start main threads */
+	for (i = 0; i < conf->replicas; ++i) {
+		ret = pthread_create(&(conf->replica[i].thread_id), NULL,
+				conf->deferred ? ip_loop_batch : ip_loop, (void *) &(conf->replica[i]));
+		if (ret != 0) {
+			break;
+		}
+	}
+
+	if (i == 0) {
 		MSG_ERROR(msg_module, "Unable to create thread for intermediate process");
+		ip_close(conf);
 		return -1;
 	}
 
+	if (i < conf->replicas) {
+		/* Continue with replicas that are already running */
+		MSG_WARNING(msg_module, "Unable to create thread for intermediate process replica; %u of %u replicas are running",
+				i, conf->replicas);
+		running = i;
+		for (; i < conf->replicas; ++i) {
+			conf->intermediate_close(conf->replica[i].plugin_config);
+			conf->replica[i].plugin_config = NULL;
+		}
+		conf->replicas = running;
+	}
+
+	if (conf->replicas > 1) {
+		MSG_INFO(msg_module, "Intermediate process %s runs in %u replicas", conf->thread_name, conf->replicas);
+	}
+
 	return 0;
 }
 
@@ -156,18 +356,41 @@ int ip_init(struct intermediate *conf, uint32_t ip_id)
  */
 int pass_message(void *config, struct ipfix_message *msg)
 {
+	struct intermediate_replica *replica;
 	struct intermediate *conf;
+	struct ipfix_message **passed;
 	int ret;
 
-	conf = (struct intermediate *) config;
+	replica = (struct intermediate_replica *) config;
+	conf = replica->inter;
 
 	if (msg == NULL) {
 		MSG_WARNING(msg_module, "NULL message from intermediate plugin; skipping...");
 		return 0;
 	}
-	ret = rbuffer_write(conf->out_queue, msg, 1);
 
-	return ret;
+	latency_stamp(conf->latency, msg);
+
+	if (!conf->deferred) {
+		ret = rbuffer_write(conf->out_queue, msg, 1);
+		return ret;
+	}
+
+	/* Messages are written together after processing (and after messages of previous sequence numbers) */
+	if (replica->passed_cnt == replica->passed_max) {
+		passed = realloc(replica->passed, (replica->passed_max ? 2 * replica->passed_max : IP_PASSED_INIT) * sizeof(*passed));
+		if (!passed) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+			return -1;
+		}
+
+		replica->passed = passed;
+		replica->passed_max = replica->passed_max ? 2 * replica->passed_max : IP_PASSED_INIT;
+	}
+
+	replica->passed[replica->passed_cnt++] = msg;
+
+	return 0;
 }
 
 /**
@@ -175,15 +398,89 @@ int pass_message(void *config, struct ipfix_message *msg)
  */
 int drop_message(void *config, struct ipfix_message *msg)
 {
-	struct intermediate *conf = (struct intermediate *) config;
-	(void) msg;
+	struct intermediate_replica *replica = (struct intermediate_replica *) config;
+	struct intermediate *conf = replica->inter;
+
+	if (conf->deferred) {
+		/* Messages around may be still processed (or passed), free only this one */
+		rbuffer_free_message(msg);
+		return 0;
+	}
 
-	rbuffer_remove_reference(conf->in_queue, conf->index, 1);
-	conf->dropped = true;
+	rbuffer_remove_reference(conf->in_queue, replica->index, 1);
+	replica->dropped = true;
 	
 	return 0;
 }
 
+/**
+ * \brief Pass more processed IPFIX messages to the output queue.
+ */
+int pass_messages(void *config, struct ipfix_message **msgs, int count)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < count; ++i) {
+		if (pass_message(config, msgs[i]) != 0) {
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * \brief Drop more IPFIX messages.
+ */
+int drop_messages(void *config, struct ipfix_message **msgs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		drop_message(config, msgs[i]);
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Get occupancy of queues after the plugin
+ */
+unsigned int pipeline_load(void *config)
+{
+	struct intermediate_replica *replica = (struct intermediate_replica *) config;
+	unsigned int load, om_load;
+
+	load = rbuffer_load(replica->inter->out_queue);
+	om_load = output_manager_load();
+
+	return load > om_load ? load : om_load;
+}
+
+/**
+ * \brief Close all replicas of intermediate plugin
+ */
+void ip_close(struct intermediate *conf)
+{
+	unsigned int i;
+
+	if (conf->replica) {
+		for (i = 0; i < conf->replicas; ++i) {
+			if (conf->replica[i].plugin_config) {
+				conf->intermediate_close(conf->replica[i].plugin_config);
+			}
+			free(conf->replica[i].passed);
+		}
+
+		free(conf->replica);
+		conf->replica = NULL;
+	}
+
+	pthread_cond_destroy(&conf->out_cond);
+	pthread_mutex_destroy(&conf->out_mutex);
+	pthread_mutex_destroy(&conf->read_mutex);
+}
+
 /**
  * \brief Close Intermediate Process
  */
@@ -197,7 +494,7 @@ int ip_destroy(struct intermediate *conf)
 	rbuffer_free(conf->in_queue);
 
 	/* Close plugin */
-	conf->intermediate_close(conf->plugin_config);
+	ip_close(conf);
 
 	free(conf);
 
@@ -209,20 +506,12 @@ int ip_destroy(struct intermediate *conf)
  */
 int ip_stop(struct intermediate *conf)
 {
-	void *retval;
-	int ret;
-	
 	if (!conf) {
 		return -1;
 	}
 
-	/* wait for thread to terminate */
-	rbuffer_write(conf->in_queue, NULL, 1);
-	ret = pthread_join(conf->thread_id, &retval);
-
-	if (ret != 0) {
-		MSG_DEBUG(msg_module, "pthread_join() error");
-	}
+	/* wait for threads to terminate */
+	ip_stop_replicas(conf, conf->replicas);
 
 	return 0;
 }
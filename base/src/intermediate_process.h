@@ -43,7 +43,9 @@
  * \ingroup internalAPIs
  *
  * In ipfixmed, Intermediate Process is a thread that picks up data from its
- * input queue and calls function process_message() on it.
+ * input queue and calls function process_message() on it. Replicable plugins
+ * can run in several threads (replicas) taking messages from the same queue;
+ * their output is restored to the order of the input queue.
  *
  * @{
  */
@@ -77,6 +79,15 @@ int ip_change_in_queue(struct intermediate *conf, struct ring_buffer *in_queue);
  */
 int ip_destroy(struct intermediate *conf);
 
+/**
+ * \brief Close all replicas of intermediate plugin
+ *
+ * Threads of the replicas must be already stopped.
+ *
+ * \param[in] conf configuration structure
+ */
+void ip_close(struct intermediate *conf);
+
 /**
  * \brief Stop Intermediate Process
  *
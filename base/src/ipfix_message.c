@@ -41,6 +41,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
 #include <ipfixcol/ipfix_message.h>
 #include <ipfixcol/verbose.h>
 
@@ -68,6 +69,15 @@ static struct offset_field offsets[] = {
 	{ OF_DSTIPV6,	28,	16 }
 };
 
+/* Information Elements of the flow key */
+#define IE_PROTOCOL    4
+#define IE_SRC_PORT    7
+#define IE_SRC_IPV4    8
+#define IE_DST_PORT   11
+#define IE_DST_IPV4   12
+#define IE_SRC_IPV6   27
+#define IE_DST_IPV6   28
+
 /* some auxiliary functions for extracting data of exact length */
 #define read8(ptr) (*((uint8_t *) (ptr)))
 #define read16(ptr) (*((uint16_t *) (ptr)))
@@ -361,6 +371,7 @@ int message_free(struct ipfix_message *msg)
 	}
 
 	free(msg->pkt_header);
+	message_free_enrich(msg);
 	free(msg);
 
 	/* note we do not want to free input_info structure, it is input plugin's job */
@@ -583,12 +594,13 @@ int data_record_field_offset(uint8_t *data_record, struct ipfix_template *templ,
  */
 uint8_t *data_record_get_field(uint8_t *record, struct ipfix_template *templ, uint32_t enterprise, uint16_t id, int *data_length)
 {
-	int offset_id = OF_COUNT;
+	int i, offset_id = OF_COUNT;
 
 	if (enterprise == 0) {
-		/* Check whether we have offset field for this ID */
-		for (offset_id = 0; offset_id < OF_COUNT; ++offset_id) {
-			if (id == offsets[offset_id].id) {
+		/* Check whether we have offset field for this ID (cached by enum offset_fields) */
+		for (i = 0; i < OF_COUNT; ++i) {
+			if (id == offsets[i].id) {
+				offset_id = offsets[i].offset_index;
 				break;
 			}
 		}
@@ -859,3 +871,387 @@ struct metadata *message_copy_metadata(struct ipfix_message *src)
 
 	return metadata;
 }
+
+/** Registered enrichment fields */
+static struct enrich_field enrich_fields[MSG_MAX_ENRICH_COLUMNS];
+/** Number of registered enrichment fields */
+static int enrich_fields_cnt = 0;
+/** Lock for registration of enrichment fields */
+static pthread_mutex_t enrich_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int enrich_field_register(uint32_t enterprise, uint16_t id, uint16_t length)
+{
+	int column;
+
+	if (length == 0 || length == VAR_IE_LENGTH) {
+		MSG_ERROR(msg_module, "Enrichment field %u:%u must have a fixed length", enterprise, id);
+		return -1;
+	}
+
+	pthread_mutex_lock(&enrich_mutex);
+	for (column = 0; column < enrich_fields_cnt; ++column) {
+		if (enrich_fields[column].enterprise != enterprise || enrich_fields[column].id != id) {
+			continue;
+		}
+
+		pthread_mutex_unlock(&enrich_mutex);
+		if (enrich_fields[column].length != length) {
+			MSG_ERROR(msg_module, "Enrichment field %u:%u is already registered with length %u", enterprise, id, enrich_fields[column].length);
+			return -1;
+		}
+		return column;
+	}
+
+	if (enrich_fields_cnt == MSG_MAX_ENRICH_COLUMNS) {
+		pthread_mutex_unlock(&enrich_mutex);
+		MSG_ERROR(msg_module, "Unable to register enrichment field %u:%u, all %d columns are used", enterprise, id, MSG_MAX_ENRICH_COLUMNS);
+		return -1;
+	}
+
+	enrich_fields[column].enterprise = enterprise;
+	enrich_fields[column].id = id;
+	enrich_fields[column].length = length;
+
+	/* The field must be complete before readers see it */
+	__sync_synchronize();
+	enrich_fields_cnt++;
+	pthread_mutex_unlock(&enrich_mutex);
+
+	MSG_DEBUG(msg_module, "Enrichment field %u:%u registered as column %d", enterprise, id, column);
+	return column;
+}
+
+int enrich_field_count()
+{
+	return enrich_fields_cnt;
+}
+
+const struct enrich_field *enrich_field_get(int column)
+{
+	if (column < 0 || column >= enrich_fields_cnt) {
+		return NULL;
+	}
+
+	return &enrich_fields[column];
+}
+
+int enrich_value_set(struct ipfix_message *msg, int column, uint16_t record, const void *value)
+{
+	struct enrich_columns *enrich = msg->enrich;
+	uint16_t length;
+
+	if (column < 0 || column >= enrich_fields_cnt || record >= msg->data_records_count) {
+		return -1;
+	}
+
+	length = enrich_fields[column].length;
+
+	if (!enrich) {
+		enrich = calloc(1, sizeof(struct enrich_columns));
+		if (!enrich) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+			return -1;
+		}
+
+		enrich->records = msg->data_records_count;
+		msg->enrich = enrich;
+	}
+
+	if (record >= enrich->records) {
+		/* Number of records changed after the buffer was allocated */
+		return -1;
+	}
+
+	if (!enrich->values[column]) {
+		/* Values followed by presence flags */
+		enrich->values[column] = calloc(enrich->records, length + 1);
+		if (!enrich->values[column]) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+			return -1;
+		}
+
+		enrich->present[column] = enrich->values[column] + (size_t) enrich->records * length;
+	}
+
+	memcpy(enrich->values[column] + (size_t) record * length, value, length);
+	enrich->present[column][record] = 1;
+	return 0;
+}
+
+uint8_t *enrich_value_get(const struct ipfix_message *msg, int column, uint16_t record)
+{
+	const struct enrich_columns *enrich = msg->enrich;
+
+	if (!enrich || column < 0 || column >= enrich_fields_cnt || record >= enrich->records) {
+		return NULL;
+	}
+
+	if (!enrich->values[column] || !enrich->present[column][record]) {
+		return NULL;
+	}
+
+	return enrich->values[column] + (size_t) record * enrich_fields[column].length;
+}
+
+int enrich_record_copy(struct ipfix_message *dst, uint16_t dst_record, const struct ipfix_message *src, uint16_t src_record)
+{
+	int column;
+	uint8_t *value;
+
+	if (!src->enrich) {
+		return 0;
+	}
+
+	for (column = 0; column < enrich_fields_cnt; ++column) {
+		value = enrich_value_get(src, column, src_record);
+		if (value && enrich_value_set(dst, column, dst_record, value)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void message_free_enrich(struct ipfix_message *msg)
+{
+	int column;
+
+	if (!msg->enrich) {
+		return;
+	}
+
+	for (column = 0; column < MSG_MAX_ENRICH_COLUMNS; ++column) {
+		free(msg->enrich->values[column]);
+	}
+
+	free(msg->enrich);
+	msg->enrich = NULL;
+}
+
+uint8_t *message_record_get_field(const struct ipfix_message *msg, uint16_t record, uint32_t enterprise, uint16_t id, int *data_length)
+{
+	struct ipfix_record rec;
+	uint8_t *field;
+	int column;
+
+	if (!msg->metadata || record >= msg->data_records_count) {
+		return NULL;
+	}
+
+	/* Field of the record */
+	rec = msg->metadata[record].record;
+	field = data_record_get_field(rec.record, rec.templ, enterprise, id, data_length);
+	if (field || !msg->enrich) {
+		return field;
+	}
+
+	/* Enrichment field */
+	for (column = 0; column < enrich_fields_cnt; ++column) {
+		if (enrich_fields[column].enterprise != enterprise || enrich_fields[column].id != id) {
+			continue;
+		}
+
+		field = enrich_value_get(msg, column, record);
+		if (field && data_length) {
+			*data_length = enrich_fields[column].length;
+		}
+		return field;
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief Processing data for copying kept records
+ */
+struct remove_records_copy {
+	uint8_t *ptr;                   /**< New packet */
+	int offset;                     /**< Offset in the new packet */
+	const uint8_t *remove;          /**< Remove flags */
+	uint16_t src_records;           /**< Number of processed records */
+	uint16_t records;               /**< Number of copied records */
+	uint16_t *src_index;            /**< Original index of each copied record */
+	uint8_t **src_record;           /**< Original position of each copied record */
+};
+
+/**
+ * \brief Copy data record that is not removed
+ */
+static void message_remove_records_copy(uint8_t *rec, int rec_len, struct ipfix_template *templ, void *data)
+{
+	struct remove_records_copy *copy = (struct remove_records_copy *) data;
+
+	(void) templ;
+
+	if (!copy->remove[copy->src_records]) {
+		memcpy(copy->ptr + copy->offset, rec, rec_len);
+		copy->src_index[copy->records] = copy->src_records;
+		copy->src_record[copy->records] = copy->ptr + copy->offset;
+		copy->offset += rec_len;
+		copy->records++;
+	}
+
+	copy->src_records++;
+}
+
+struct ipfix_message *message_remove_records(struct ipfix_message *msg, const uint8_t *remove)
+{
+	struct ipfix_message *new_msg = NULL;
+	struct remove_records_copy copy;
+	int i, j, length, oldoffset;
+	uint16_t rec;
+
+	memset(&copy, 0, sizeof(copy));
+	copy.remove = remove;
+	copy.ptr = malloc(ntohs(msg->pkt_header->length));
+	copy.src_index = malloc(msg->data_records_count * sizeof(uint16_t));
+	copy.src_record = malloc(msg->data_records_count * sizeof(uint8_t *));
+	if (!copy.ptr || !copy.src_index || !copy.src_record) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		goto cleanup;
+	}
+
+	/* Copy header */
+	memcpy(copy.ptr, msg->pkt_header, IPFIX_HEADER_LENGTH);
+	copy.offset = IPFIX_HEADER_LENGTH;
+
+	/* Copy (options) template sets */
+	for (i = 0; i < MSG_MAX_TEMPL_SETS && msg->templ_set[i]; ++i) {
+		length = ntohs(msg->templ_set[i]->header.length);
+		memcpy(copy.ptr + copy.offset, msg->templ_set[i], length);
+		copy.offset += length;
+	}
+
+	for (i = 0; i < MSG_MAX_OTEMPL_SETS && msg->opt_templ_set[i]; ++i) {
+		length = ntohs(msg->opt_templ_set[i]->header.length);
+		memcpy(copy.ptr + copy.offset, msg->opt_templ_set[i], length);
+		copy.offset += length;
+	}
+
+	/* Copy data records that are kept */
+	for (i = 0; i < MSG_MAX_DATA_COUPLES && msg->data_couple[i].data_set; ++i) {
+		if (!msg->data_couple[i].data_template) {
+			/* Data set without template, skip it */
+			continue;
+		}
+
+		oldoffset = copy.offset;
+		memcpy(copy.ptr + copy.offset, &(msg->data_couple[i].data_set->header), sizeof(struct ipfix_set_header));
+		copy.offset += sizeof(struct ipfix_set_header);
+
+		data_set_process_records(msg->data_couple[i].data_set, msg->data_couple[i].data_template, &message_remove_records_copy, (void *) &copy);
+
+		if (copy.offset == oldoffset + 4) {
+			/* No data records were copied, rollback */
+			copy.offset = oldoffset;
+			continue;
+		}
+
+		/* Update data set length */
+		((struct ipfix_set_header *) (copy.ptr + oldoffset))->length = htons(copy.offset - oldoffset);
+	}
+
+	if (copy.offset == IPFIX_HEADER_LENGTH) {
+		/* Empty message */
+		goto cleanup;
+	}
+
+	((struct ipfix_header *) copy.ptr)->length = htons(copy.offset);
+
+	/* Create new IPFIX message (takes the packet) */
+	new_msg = message_create_from_mem(copy.ptr, copy.offset, msg->input_info, msg->source_status);
+	copy.ptr = NULL;
+	if (!new_msg) {
+		goto cleanup;
+	}
+
+	/* Match data couples and increment template references */
+	for (i = 0; i < MSG_MAX_DATA_COUPLES && new_msg->data_couple[i].data_set; ++i) {
+		for (j = 0; j < MSG_MAX_DATA_COUPLES && msg->data_couple[j].data_set; ++j) {
+			if (new_msg->data_couple[i].data_set->header.flowset_id == msg->data_couple[j].data_set->header.flowset_id) {
+				new_msg->data_couple[i].data_template = msg->data_couple[j].data_template;
+				break;
+			}
+		}
+		tm_template_reference_inc(new_msg->data_couple[i].data_template);
+	}
+
+	new_msg->data_records_count = copy.records;
+
+	/* Move metadata of copied records */
+	if (msg->metadata && copy.records) {
+		new_msg->metadata = calloc(copy.records, sizeof(struct metadata));
+		if (!new_msg->metadata) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		}
+
+		for (rec = 0; new_msg->metadata && rec < copy.records; ++rec) {
+			new_msg->metadata[rec] = msg->metadata[copy.src_index[rec]];
+			new_msg->metadata[rec].record.record = copy.src_record[rec];
+			msg->metadata[copy.src_index[rec]].channels = NULL;
+		}
+	}
+
+	/* Copy values of enrichment fields of copied records */
+	if (msg->enrich) {
+		for (rec = 0; rec < copy.records; ++rec) {
+			enrich_record_copy(new_msg, rec, msg, copy.src_index[rec]);
+		}
+	}
+
+	new_msg->live_profile = msg->live_profile;
+	new_msg->plugin_id = msg->plugin_id;
+	new_msg->plugin_status = msg->plugin_status;
+	new_msg->templ_records_count = msg->templ_records_count;
+	new_msg->opt_templ_records_count = msg->opt_templ_records_count;
+	new_msg->original_odid = msg->original_odid;
+	new_msg->joined = msg->joined;
+	new_msg->trace_received = msg->trace_received;
+	new_msg->trace_stage = msg->trace_stage;
+
+cleanup:
+	free(copy.ptr);
+	free(copy.src_index);
+	free(copy.src_record);
+	return new_msg;
+}
+
+/**
+ * \brief Fill flow key of a data record
+ */
+int data_record_flow_key(uint8_t *record, struct ipfix_template *templ, struct ipfix_flow_key *key)
+{
+	uint8_t *src, *dst, *field;
+	int src_len = 0, dst_len = 0, len = 0;
+
+	memset(key, 0, sizeof(*key));
+
+	src = data_record_get_field(record, templ, 0, IE_SRC_IPV4, &src_len);
+	dst = data_record_get_field(record, templ, 0, IE_DST_IPV4, &dst_len);
+	if (!src || !dst || src_len != 4 || dst_len != 4) {
+		src = data_record_get_field(record, templ, 0, IE_SRC_IPV6, &src_len);
+		dst = data_record_get_field(record, templ, 0, IE_DST_IPV6, &dst_len);
+		if (!src || !dst || src_len != 16 || dst_len != 16) {
+			return 1;
+		}
+		key->ipv6 = 1;
+	}
+
+	memcpy(key->src_addr, src, src_len);
+	memcpy(key->dst_addr, dst, dst_len);
+
+	field = data_record_get_field(record, templ, 0, IE_SRC_PORT, &len);
+	if (field && len == 2) {
+		memcpy(&key->src_port, field, 2);
+	}
+	field = data_record_get_field(record, templ, 0, IE_DST_PORT, &len);
+	if (field && len == 2) {
+		memcpy(&key->dst_port, field, 2);
+	}
+	field = data_record_get_field(record, templ, 0, IE_PROTOCOL, &len);
+	if (field && len == 1) {
+		key->protocol = *field;
+	}
+
+	return 0;
+}
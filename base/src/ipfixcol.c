@@ -70,6 +70,8 @@
 #include "preprocessor.h"
 #include "output_manager.h"
 #include "configurator.h"
+#include "latency.h"
+#include "affinity.h"
 
 /**
  * \defgroup internalAPIs ipfixcol's Internal APIs
@@ -390,6 +392,9 @@ int main (int argc, char* argv[])
 		goto cleanup_err;
 	}
 	
+	/* Save CPU affinity for threads without configured affinity */
+	affinity_init();
+
 	/* Create output queue for preprocessor */
 	preprocessor_set_output_queue(rbuffer_init(ring_buffer_size));
 	
@@ -419,6 +424,9 @@ int main (int argc, char* argv[])
 	/* Allow signals in the main thread only */
 	pthread_sigmask(SIG_UNBLOCK, &set, NULL);
 
+	/* Pin input (and preprocessor) to its CPUs */
+	affinity_set(config->input.xml_conf->cpu_affinity, "input");
+
 	/* main loop */
 	while (!terminating) {
 		/* get data to process */
@@ -454,6 +462,7 @@ int main (int argc, char* argv[])
 		if (reconf) {
 			MSG_INFO(msg_module, "[%d] Starting reconfiguration process", config->proc_id);
 			config_reconf(config);
+			affinity_set(config->input.xml_conf->cpu_affinity, "input");
 			reconf = 0;
 		}
 }
@@ -482,6 +491,9 @@ cleanup:
 		config_destroy(config);
 	}
 
+	/* Free latency histograms (no stage is running now) */
+	latency_destroy();
+
 	/* Unlink pidfile by parent process. */
 	if (pidfile_path && unlink(pidfile_path) != 0) {
 		MSG_ERROR(msg_module, "Cannot unlink pidfile \"%s\": %s", pidfile_path, strerror(errno));
@@ -0,0 +1,326 @@
+/**
+ * \file latency.c
+ * \brief Per-stage latency tracing of IPFIX messages
+ *
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ipfixcol/verbose.h>
+
+#include "latency.h"
+
+/** Identifier for MSG_* macros */
+static char *msg_module = "latency";
+
+int latency_enabled = 0;
+
+/** Registered stages (never removed until latency_destroy) */
+static struct latency_stage *latency_stages[LATENCY_MAX_STAGES];
+static unsigned int latency_stage_cnt = 0;
+static pthread_mutex_t latency_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Reported percentiles */
+static const double latency_percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+static const char *latency_percentile_names[] = { "P50", "P90", "P99", "P999" };
+static const char *latency_percentile_json[] = { "p50", "p90", "p99", "p999" };
+#define LATENCY_PERCENTILES (sizeof(latency_percentiles) / sizeof(latency_percentiles[0]))
+
+/**
+ * \brief Enable tracing
+ */
+void latency_enable()
+{
+	latency_enabled = 1;
+}
+
+/**
+ * \brief Get stage of the pipeline
+ */
+struct latency_stage *latency_stage_get(const char *name)
+{
+	struct latency_stage *stage = NULL;
+	unsigned int i;
+
+	pthread_mutex_lock(&latency_mutex);
+
+	for (i = 0; i < latency_stage_cnt; ++i) {
+		if (!strcmp(latency_stages[i]->name, name)) {
+			stage = latency_stages[i];
+			goto unlock;
+		}
+	}
+
+	if (latency_stage_cnt == LATENCY_MAX_STAGES) {
+		MSG_WARNING(msg_module, "Too many stages, latency of '%s' is not traced", name);
+		goto unlock;
+	}
+
+	stage = calloc(1, sizeof(struct latency_stage));
+	if (!stage) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		goto unlock;
+	}
+
+	snprintf(stage->name, sizeof(stage->name), "%s", name);
+	latency_stages[latency_stage_cnt] = stage;
+
+	/* Statistics thread reads the stages without locking */
+	__sync_synchronize();
+	latency_stage_cnt++;
+
+unlock:
+	pthread_mutex_unlock(&latency_mutex);
+	return stage;
+}
+
+/**
+ * \brief Get lower bound of a bucket
+ *
+ * \param[in] index index of the bucket
+ * \return latency in nanoseconds
+ */
+static uint64_t latency_bucket_lower(unsigned int index)
+{
+	unsigned int group = index / LATENCY_SUB, sub = index % LATENCY_SUB;
+
+	if (group == 0) {
+		return index;
+	}
+
+	return (uint64_t) (LATENCY_SUB + sub) << (group - 1);
+}
+
+/**
+ * \brief Get upper bound of a bucket
+ *
+ * \param[in] index index of the bucket
+ * \return latency in nanoseconds
+ */
+static uint64_t latency_bucket_upper(unsigned int index)
+{
+	return index + 1 < LATENCY_BUCKETS ? latency_bucket_lower(index + 1) : latency_bucket_lower(index) * 2;
+}
+
+/**
+ * \brief Create key of a stage for statistics file
+ *
+ * \param[in] stage stage
+ * \param[out] key key (upper case, other characters than alphanumeric are '_')
+ * \param[in] size size of the key buffer
+ */
+static void latency_stage_key(const struct latency_stage *stage, char *key, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i + 1 < size && stage->name[i]; ++i) {
+		key[i] = isalnum((unsigned char) stage->name[i]) ? toupper((unsigned char) stage->name[i]) : '_';
+	}
+
+	key[i] = '\0';
+}
+
+/**
+ * \brief Compute percentiles of a histogram
+ *
+ * Percentiles are upper bounds of buckets.
+ *
+ * \param[in] hist histogram
+ * \param[in] total number of values in the histogram
+ * \param[out] value percentiles (LATENCY_PERCENTILES items)
+ */
+static void latency_percentiles_get(const uint64_t *hist, uint64_t total, uint64_t *value)
+{
+	unsigned int b, p;
+
+	memset(value, 0, LATENCY_PERCENTILES * sizeof(uint64_t));
+	for (p = 0; p < LATENCY_PERCENTILES && total; ++p) {
+		uint64_t target = (uint64_t) (latency_percentiles[p] * total + 0.5), seen = 0;
+
+		if (target == 0) {
+			target = 1;
+		}
+
+		for (b = 0; b < LATENCY_BUCKETS; ++b) {
+			seen += hist[b];
+			if (seen >= target) {
+				value[p] = latency_bucket_upper(b);
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * \brief Print latencies of all stages since the previous report
+ */
+void latency_print(FILE *file, unsigned int interval)
+{
+	struct latency_stage *stage;
+	uint64_t delta[LATENCY_BUCKETS], total, sum, records, value[LATENCY_PERCENTILES], max;
+	unsigned int i, cnt = latency_stage_cnt, b, p;
+	char key[sizeof(stage->name)];
+
+	if (!latency_enabled || cnt == 0) {
+		return;
+	}
+
+	if (!file) {
+		MSG_ALWAYS(" | Latency of stages (since the previous report):", NULL);
+		MSG_ALWAYS(" |     %-20s %15s %12s %12s %12s %12s %12s", "stage", "data records/s",
+				"p50 [us]", "p90 [us]", "p99 [us]", "p99.9 [us]", "max [us]");
+	}
+
+	for (i = 0; i < cnt; ++i) {
+		stage = latency_stages[i];
+
+		/* Histogram of the interval */
+		total = 0;
+		max = 0;
+		for (b = 0; b < LATENCY_BUCKETS; ++b) {
+			uint64_t current = __sync_fetch_and_add(&stage->buckets[b], 0);
+			delta[b] = current - stage->last_buckets[b];
+			stage->last_buckets[b] = current;
+			total += delta[b];
+			if (delta[b]) {
+				max = latency_bucket_upper(b);
+			}
+		}
+
+		records = __sync_fetch_and_add(&stage->records, 0);
+		sum = records - stage->last_records;
+		stage->last_records = records;
+
+		latency_percentiles_get(delta, total, value);
+
+		if (file) {
+			latency_stage_key(stage, key, sizeof(key));
+			fprintf(file, "LATENCY_%s_DATA_REC_SEC=%" PRIu64 "\n", key, sum / interval);
+			for (p = 0; p < LATENCY_PERCENTILES; ++p) {
+				fprintf(file, "LATENCY_%s_%s_US=%.1f\n", key, latency_percentile_names[p], value[p] / 1000.0);
+			}
+			fprintf(file, "LATENCY_%s_MAX_US=%.1f\n", key, max / 1000.0);
+		} else {
+			MSG_ALWAYS(" |     %-20s %15" PRIu64 " %12.1f %12.1f %12.1f %12.1f %12.1f", stage->name, sum / interval,
+					value[0] / 1000.0, value[1] / 1000.0, value[2] / 1000.0, value[3] / 1000.0, max / 1000.0);
+		}
+	}
+}
+
+/**
+ * \brief Dump cumulative histograms of all stages
+ */
+void latency_dump(FILE *file)
+{
+	struct latency_stage *stage;
+	unsigned int i, cnt = latency_stage_cnt, b;
+	uint64_t count;
+	char key[sizeof(stage->name)];
+
+	for (i = 0; i < cnt; ++i) {
+		stage = latency_stages[i];
+		latency_stage_key(stage, key, sizeof(key));
+
+		fprintf(file, "LATENCY_%s_MESSAGES=%" PRIu64 "\n", key, __sync_fetch_and_add(&stage->messages, 0));
+		fprintf(file, "LATENCY_%s_DATA_REC=%" PRIu64 "\n", key, __sync_fetch_and_add(&stage->records, 0));
+
+		for (b = 0; b < LATENCY_BUCKETS; ++b) {
+			count = __sync_fetch_and_add(&stage->buckets[b], 0);
+			if (count) {
+				fprintf(file, "LATENCY_%s_%" PRIu64 "=%" PRIu64 "\n", key, latency_bucket_lower(b), count);
+			}
+		}
+	}
+}
+
+/**
+ * \brief Print cumulative latencies of all stages as JSON
+ */
+void latency_print_json(FILE *file, const char *indent)
+{
+	struct latency_stage *stage;
+	uint64_t hist[LATENCY_BUCKETS], total, value[LATENCY_PERCENTILES], max;
+	unsigned int i, cnt = latency_stage_cnt, b, p;
+
+	fprintf(file, "[");
+
+	for (i = 0; i < cnt; ++i) {
+		stage = latency_stages[i];
+
+		total = 0;
+		max = 0;
+		for (b = 0; b < LATENCY_BUCKETS; ++b) {
+			hist[b] = __sync_fetch_and_add(&stage->buckets[b], 0);
+			total += hist[b];
+			if (hist[b]) {
+				max = latency_bucket_upper(b);
+			}
+		}
+
+		latency_percentiles_get(hist, total, value);
+
+		fprintf(file, "%s\n%s\t{\"stage\": \"%s\", \"messages\": %" PRIu64 ", \"data_records\": %" PRIu64,
+				i ? "," : "", indent, stage->name, total, __sync_fetch_and_add(&stage->records, 0));
+		for (p = 0; p < LATENCY_PERCENTILES; ++p) {
+			fprintf(file, ", \"%s_us\": %.1f", latency_percentile_json[p], value[p] / 1000.0);
+		}
+		fprintf(file, ", \"max_us\": %.1f}", max / 1000.0);
+	}
+
+	fprintf(file, "%s%s]", cnt ? "\n" : "", cnt ? indent : "");
+}
+
+/**
+ * \brief Free all stages
+ */
+void latency_destroy()
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&latency_mutex);
+
+	latency_enabled = 0;
+	for (i = 0; i < latency_stage_cnt; ++i) {
+		free(latency_stages[i]);
+		latency_stages[i] = NULL;
+	}
+	latency_stage_cnt = 0;
+
+	pthread_mutex_unlock(&latency_mutex);
+}
@@ -0,0 +1,238 @@
+/**
+ * \file latency.h
+ * \brief Per-stage latency tracing of IPFIX messages
+ *
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <ipfixcol/storage.h>
+
+/** Number of linear sub-buckets of each power of two (2^LATENCY_SUB_BITS) */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB (1 << LATENCY_SUB_BITS)
+/** Exponent of the highest tracked latency (2^40 ns is about 18 minutes) */
+#define LATENCY_MAX_EXP 40
+/** Number of buckets of a histogram */
+#define LATENCY_BUCKETS ((LATENCY_MAX_EXP - LATENCY_SUB_BITS + 2) * LATENCY_SUB)
+/** Maximal number of stages */
+#define LATENCY_MAX_STAGES 64
+
+/**
+ * \brief Latency histogram of one stage of the pipeline
+ *
+ * Buckets are log-linear (like HDR histograms): each power of two is split
+ * into LATENCY_SUB buckets, so the relative error is below 1/LATENCY_SUB.
+ * Counters are updated atomically by the threads of the stage, the statistics
+ * thread reads them without locking.
+ */
+struct latency_stage {
+	char name[32];                          /**< Name of the stage */
+	uint64_t messages;                      /**< Number of traced messages */
+	uint64_t records;                       /**< Number of data records of the messages */
+	uint64_t buckets[LATENCY_BUCKETS];      /**< Histogram of latencies (ns) */
+
+	/* Values at the previous report (statistics thread only) */
+	uint64_t last_records;
+	uint64_t last_buckets[LATENCY_BUCKETS];
+};
+
+/** Non-zero if tracing is enabled */
+extern int latency_enabled;
+
+/**
+ * \brief Get current time for tracing
+ *
+ * CLOCK_MONOTONIC is read through vDSO (from TSC on x86), so the call does
+ * not enter the kernel.
+ *
+ * \return time in nanoseconds
+ */
+static inline uint64_t latency_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * \brief Get histogram bucket of a latency
+ *
+ * \param[in] ns latency in nanoseconds
+ * \return index of the bucket
+ */
+static inline unsigned int latency_bucket(uint64_t ns)
+{
+	unsigned int exp;
+
+	if (ns < LATENCY_SUB) {
+		return ns;
+	}
+
+	exp = 63 - __builtin_clzll(ns);
+	if (exp > LATENCY_MAX_EXP) {
+		return LATENCY_BUCKETS - 1;
+	}
+
+	return (exp - LATENCY_SUB_BITS + 1) * LATENCY_SUB + ((ns >> (exp - LATENCY_SUB_BITS)) & (LATENCY_SUB - 1));
+}
+
+/**
+ * \brief Add latency of a message to histogram of a stage
+ *
+ * \param[in] stage stage
+ * \param[in] ns latency in nanoseconds
+ * \param[in] records number of data records of the message
+ */
+static inline void latency_stage_add(struct latency_stage *stage, uint64_t ns, uint16_t records)
+{
+	__sync_fetch_and_add(&stage->buckets[latency_bucket(ns)], 1);
+	__sync_fetch_and_add(&stage->messages, 1);
+	__sync_fetch_and_add(&stage->records, records);
+}
+
+/**
+ * \brief Stamp a message leaving a stage
+ *
+ * Time since the previous stamp (time in the queue before the stage and
+ * processing in the stage) is added to the stage. Messages created by
+ * intermediate plugins have no stamp, they are only stamped.
+ *
+ * \param[in] stage stage (may be NULL)
+ * \param[in,out] msg IPFIX message
+ */
+static inline void latency_stamp(struct latency_stage *stage, struct ipfix_message *msg)
+{
+	uint64_t now;
+
+	if (!latency_enabled || !stage) {
+		return;
+	}
+
+	now = latency_now();
+	if (msg->trace_stage) {
+		latency_stage_add(stage, now - msg->trace_stage, msg->data_records_count);
+	}
+
+	msg->trace_stage = now;
+}
+
+/**
+ * \brief Add latency of a message at the end of the pipeline
+ *
+ * The message is shared by storage plugins, it is not stamped.
+ *
+ * \param[in] stage stage of the storage plugin (may be NULL)
+ * \param[in] total end-to-end stage of the storage plugin (may be NULL)
+ * \param[in] msg IPFIX message
+ */
+static inline void latency_stamp_end(struct latency_stage *stage, struct latency_stage *total, const struct ipfix_message *msg)
+{
+	uint64_t now;
+
+	if (!latency_enabled) {
+		return;
+	}
+
+	now = latency_now();
+	if (stage && msg->trace_stage) {
+		latency_stage_add(stage, now - msg->trace_stage, msg->data_records_count);
+	}
+	if (total && msg->trace_received) {
+		latency_stage_add(total, now - msg->trace_received, msg->data_records_count);
+	}
+}
+
+/**
+ * \brief Enable tracing
+ */
+void latency_enable();
+
+/**
+ * \brief Get stage of the pipeline
+ *
+ * Stages with the same name (e.g. one storage plugin for more ODIDs) share
+ * one histogram. Stages are never removed during runtime.
+ *
+ * \param[in] name name of the stage
+ * \return stage or NULL (too many stages or memory allocation error)
+ */
+struct latency_stage *latency_stage_get(const char *name);
+
+/**
+ * \brief Print latencies of all stages since the previous report
+ *
+ * Percentiles and records per second of each stage are printed to the
+ * statistics file or to the console (file is NULL).
+ *
+ * \param[in] file statistics file or NULL
+ * \param[in] interval length of the interval (seconds)
+ */
+void latency_print(FILE *file, unsigned int interval);
+
+/**
+ * \brief Dump cumulative histograms of all stages
+ *
+ * Only non-empty buckets are written, as LATENCY_<STAGE>_<ns>=<count> where
+ * <ns> is the lower bound of the bucket.
+ *
+ * \param[in] file output file
+ */
+void latency_dump(FILE *file);
+
+/**
+ * \brief Print cumulative latencies of all stages as JSON
+ *
+ * Writes an array with an object (name, number of messages and data records,
+ * percentiles in microseconds) for each stage.
+ *
+ * \param[in] file output file
+ * \param[in] indent indentation of the array items
+ */
+void latency_print_json(FILE *file, const char *indent);
+
+/**
+ * \brief Free all stages
+ */
+void latency_destroy();
+
+#endif /* LATENCY_H_ */
@@ -50,10 +50,15 @@
 #include <glob.h>
 #include <libgen.h>
 #include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "configurator.h"
 #include "data_manager.h"
 #include "output_manager.h"
+#include "latency.h"
+#include "affinity.h"
 
 /* MSG_ macros identifiers */
 static const char *msg_module = "output manager";
@@ -78,6 +83,20 @@ struct input_info_node {
 /* List of input_info_node structures */
 struct input_info_node *input_info_list = NULL; /* Pointer to first node in list */
 
+/* Statistics registered by plugins */
+struct plugin_stat_node {
+	char *name;
+	statistics_print_cb print;
+	void *arg;
+	struct plugin_stat_node *next;
+};
+
+static struct plugin_stat_node *plugin_stat_list = NULL;
+static pthread_mutex_t plugin_stat_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Latency of the Output Manager (queue before it and distribution to Data Managers) */
+static struct latency_stage *om_latency = NULL;
+
 /**
  * \brief Add input_info as a node to input_info_list
  *
@@ -232,6 +251,23 @@ inline struct ring_buffer *output_manager_get_in_queue()
 	return conf->in_queue;
 }
 
+/**
+ * \brief Get occupancy of Output Manager's queues
+ */
+unsigned int output_manager_load()
+{
+	unsigned int load, store_load;
+
+	if (!conf) {
+		return 0;
+	}
+
+	load = rbuffer_load(conf->in_queue);
+	store_load = conf->store_load;
+
+	return load > store_load ? load : store_load;
+}
+
 /**
  * \brief Set new input queue
  */
@@ -334,6 +370,59 @@ int output_manager_remove_plugin(int id)
 	return 0;
 }
 
+/**
+ * \brief Get maximal occupancy of storage queues
+ *
+ * \param[in] output_manager Output Manager structure
+ * \return Occupancy in per mille
+ */
+static unsigned int output_manager_store_load(struct output_manager_config *output_manager)
+{
+	struct data_manager_config *dm;
+	unsigned int load, max = 0;
+
+	for (dm = output_manager->data_managers; dm; dm = dm->next) {
+		load = rbuffer_load(dm->store_queue);
+		if (load > max) {
+			max = load;
+		}
+	}
+
+	return max;
+}
+
+/**
+ * \brief Pin Output Manager thread to CPUs from 'outputManagerCpuAffinity'
+ *
+ * Input queue is moved to NUMA node of the thread when the thread is pinned.
+ *
+ * @param[in] output_manager Output Manager configuration
+ */
+static void output_manager_set_affinity(struct output_manager_config *output_manager)
+{
+	xmlNode *node;
+	char *cpus = NULL;
+
+	for (node = output_manager->plugins_config->collector_node->children; node; node = node->next) {
+		if (!xmlStrcmp(node->name, (const xmlChar *) "outputManagerCpuAffinity")) {
+			cpus = (char *) xmlNodeGetContent(node);
+			break;
+		}
+	}
+
+	if (cpus && affinity_check(cpus) != 0) {
+		MSG_ERROR(msg_module, "Configuration error: invalid CPU list '%s' in 'outputManagerCpuAffinity'", cpus);
+		xmlFree(cpus);
+		cpus = NULL;
+	}
+
+	if (affinity_set(cpus, "Output Manager") == 0 && cpus) {
+		rbuffer_bind_local(output_manager->in_queue);
+	}
+
+	xmlFree(cpus);
+}
+
 /**
  * \brief Output Manager thread
  *
@@ -352,6 +441,7 @@ static void *output_manager_plugin_thread(void* config)
 
 	/* Set thread name to reflect the configuration */
 	prctl(PR_SET_NAME, "ipfixcol OM", 0, 0, 0);
+	output_manager_set_affinity(conf);
 
 	/* loop will break upon receiving NULL from buffer */
 	while (1) {
@@ -366,6 +456,7 @@ static void *output_manager_plugin_thread(void* config)
 				conf->in_queue = (struct ring_buffer *) conf->new_in;
 				conf->new_in = NULL;
 				pthread_cond_signal(&conf->in_q_cond);
+				output_manager_set_affinity(conf);
 				continue;
 			}
 
@@ -373,6 +464,8 @@ static void *output_manager_plugin_thread(void* config)
 			break;
 		}
 
+		latency_stamp(om_latency, msg);
+
 		odid = (conf->perman_odid_merge || conf->manager_mode == OM_SINGLE)
 				? 0 : msg->input_info->odid;
 
@@ -439,6 +532,9 @@ static void *output_manager_plugin_thread(void* config)
 
 		/* Remove data from queue (without memory deallocation) */
 		rbuffer_remove_reference(conf->in_queue, index, 0);
+
+		/* Update occupancy of storage queues (for load shedding) */
+		conf->store_load = output_manager_store_load(conf);
 	}
 
 	MSG_INFO(msg_module, "Closing Output Manager thread");
@@ -627,6 +723,159 @@ void statistics_print_buffers(struct output_manager_config *conf, FILE *stat_out
 	}
 }
 
+/**
+ * \brief Register statistics of a plugin
+ */
+int statistics_register(const char *name, statistics_print_cb print, void *arg)
+{
+	struct plugin_stat_node *node = calloc(1, sizeof(struct plugin_stat_node));
+	if (!node) {
+		MSG_ERROR(stat_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	node->name = strdup(name);
+	if (!node->name) {
+		MSG_ERROR(stat_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		free(node);
+		return 1;
+	}
+
+	node->print = print;
+	node->arg = arg;
+
+	pthread_mutex_lock(&plugin_stat_mutex);
+	node->next = plugin_stat_list;
+	plugin_stat_list = node;
+	pthread_mutex_unlock(&plugin_stat_mutex);
+
+	return 0;
+}
+
+/**
+ * \brief Unregister statistics of a plugin
+ */
+void statistics_unregister(void *arg)
+{
+	struct plugin_stat_node **node, *aux_node;
+
+	pthread_mutex_lock(&plugin_stat_mutex);
+	node = &plugin_stat_list;
+	while (*node) {
+		if ((*node)->arg == arg) {
+			aux_node = *node;
+			*node = aux_node->next;
+			free(aux_node->name);
+			free(aux_node);
+			continue;
+		}
+
+		node = &(*node)->next;
+	}
+	pthread_mutex_unlock(&plugin_stat_mutex);
+}
+
+/**
+ * \brief Print statistics registered by plugins
+ *
+ * @param stat_out_file Output file for statistics
+ */
+static void statistics_print_plugins(FILE *stat_out_file)
+{
+	struct plugin_stat_node *node;
+
+	pthread_mutex_lock(&plugin_stat_mutex);
+	for (node = plugin_stat_list; node; node = node->next) {
+		if (!stat_out_file) {
+			MSG_ALWAYS(" | %s:", node->name);
+		}
+
+		node->print(node->arg, stat_out_file);
+	}
+	pthread_mutex_unlock(&plugin_stat_mutex);
+}
+
+/**
+ * \brief Open statistics socket
+ *
+ * @param path Path of the socket (old socket is removed)
+ * @return Listening socket or -1 on error
+ */
+static int statistics_socket_open(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		MSG_ERROR(msg_module, "Statistics socket path '%s' is too long", path);
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		MSG_ERROR(msg_module, "Unable to create statistics socket: %s", strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy_safe(addr.sun_path, path, sizeof(addr.sun_path));
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(fd, 8) == -1) {
+		MSG_ERROR(msg_module, "Unable to listen on statistics socket '%s': %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	MSG_INFO(msg_module, "Latency histograms are available on statistics socket '%s'", path);
+	return fd;
+}
+
+/**
+ * \brief Send cumulative latency histograms to all waiting clients
+ *
+ * @param fd Listening socket
+ */
+static void statistics_socket_serve(int fd)
+{
+	FILE *client_file;
+	int client;
+
+	while ((client = accept(fd, NULL, NULL)) != -1) {
+		client_file = fdopen(client, "w");
+		if (!client_file) {
+			close(client);
+			continue;
+		}
+
+		fprintf(client_file, "%s=%lu\n", "TIME", time(NULL));
+		latency_dump(client_file);
+		fclose(client_file);
+	}
+}
+
+/**
+ * \brief Wait for the next statistics interval and serve statistics socket
+ *
+ * @param conf Output Manager configuration
+ * @param fd Listening socket
+ */
+static void statistics_socket_wait(struct output_manager_config *conf, int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	uint64_t now = latency_now(), end = now + (uint64_t) conf->stat_interval * 1000000000;
+
+	/* Reconfiguration (SIGUSR1) interrupts poll, the interval continues */
+	while (!conf->stats.done && now < end) {
+		if (poll(&pfd, 1, (end - now) / 1000000 + 1) > 0) {
+			statistics_socket_serve(fd);
+		}
+
+		now = latency_now();
+	}
+}
+
 /**
  * \brief Periodically prints statistics about proccessing speed
  *
@@ -650,6 +899,8 @@ static void *statistics_thread(void* config)
 
 	/* Process XML config */
 	char *full_stat_out_file_path = NULL;
+	char *stat_socket_path = NULL;
+	int stat_socket = -1;
 	xmlNode *node = conf->plugins_config->collector_node;
 	while (node != NULL) {
 		/* Skip processing this node in case it's a comment */
@@ -663,6 +914,24 @@ static void *statistics_thread(void* config)
 			node = node->xmlChildrenNode;
 		}
 
+		if (xmlStrcmp(node->name, (const xmlChar *) "statisticsSocket") == 0) {
+			char *socket_path = (char *) xmlNodeGetContent(node->xmlChildrenNode);
+			if (socket_path && strlen(socket_path) > 0) {
+				if (stat_socket == -1) {
+					stat_socket = statistics_socket_open(socket_path);
+				}
+				if (stat_socket != -1 && !stat_socket_path) {
+					stat_socket_path = strdup(socket_path);
+				}
+			} else {
+				MSG_ERROR(msg_module, "Configuration error: 'statisticsSocket' node has no value");
+			}
+
+			xmlFree(socket_path);
+			node = node->next;
+			continue;
+		}
+
 		if (xmlStrcmp(node->name, (const xmlChar *) "statisticsFile") == 0) {
 			/* Disable printing statistics to console when printing to file */
 			print_stat_to_console = 0;
@@ -731,9 +1000,6 @@ static void *statistics_thread(void* config)
 			}
 
 			xmlFree(stat_out_file_path);
-
-			/* No need to continue tree traversal, because 'statisticsFile' is only node to look for */
-			break;
 		}
 
 		node = node->next;
@@ -745,12 +1011,16 @@ static void *statistics_thread(void* config)
 	FILE *stat_out_file = NULL;
 	while (conf->stat_interval && !conf->stats.done) { /* stats.done can be set by Output Manager */
 		/* Sleep */
-		struct timespec tv;
-		tv.tv_sec = conf->stat_interval;
-		tv.tv_nsec = 0;
+		if (stat_socket != -1) {
+			statistics_socket_wait(conf, stat_socket);
+		} else {
+			struct timespec tv;
+			tv.tv_sec = conf->stat_interval;
+			tv.tv_nsec = 0;
 
-		/* Reconfiguration (SIGUSR1) cause sleep interruption */
-		while (nanosleep(&tv, &tv) == -1 && errno == EINTR && !conf->stats.done);
+			/* Reconfiguration (SIGUSR1) cause sleep interruption */
+			while (nanosleep(&tv, &tv) == -1 && errno == EINTR && !conf->stats.done);
+		}
 
 		/* Compute time */
 		time_now = time(NULL);
@@ -845,6 +1115,12 @@ static void *statistics_thread(void* config)
 		/* Print buffer usage */
 		statistics_print_buffers(conf, stat_out_file);
 
+		/* Print latency of stages */
+		latency_print(stat_out_file, conf->stat_interval);
+
+		/* Print statistics of plugins */
+		statistics_print_plugins(stat_out_file);
+
 		/* Flush input stream and close file */
 		if (print_stat_to_file) {
 			fflush(stat_out_file);
@@ -856,6 +1132,12 @@ static void *statistics_thread(void* config)
 		free(full_stat_out_file_path);
 	}
 
+	if (stat_socket != -1) {
+		close(stat_socket);
+		unlink(stat_socket_path);
+		free(stat_socket_path);
+	}
+
 	return NULL;
 }
 
@@ -881,6 +1163,12 @@ int output_manager_create(configurator *plugins_config, int stat_interval, bool
 	conf->plugins_config = plugins_config;
 	conf->perman_odid_merge = odid_merge;
 
+	/* Latency of stages is traced only when it is reported */
+	if (stat_interval > 0) {
+		latency_enable();
+	}
+	om_latency = latency_stage_get("output_manager");
+
 	if (conf->manager_mode == OM_SINGLE) {
 		MSG_INFO(msg_module, "Configuring Output Manager in single manager mode");
 	} else if (conf->manager_mode == OM_MULTIPLE) {
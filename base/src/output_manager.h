@@ -88,6 +88,7 @@ struct output_manager_config {
 	struct ring_buffer *in_queue;               /**< Input queue */
 	struct ring_buffer *new_in;                 /**< New input queue */
 	int running;                                /**< Status of manager */
+	volatile unsigned int store_load;           /**< Maximal occupancy of storage queues (per mille) */
 	bool perman_odid_merge;                     /**< Enable permanently single data manager */
 	enum om_mode manager_mode;                       /**< Manager mode */
 	pthread_t thread_id;                        /**< Manager's thread ID */
@@ -153,6 +154,14 @@ void output_manager_set_in_queue(struct ring_buffer *in_queue);
  */
 struct ring_buffer *output_manager_get_in_queue();
 
+/**
+ * \brief Get occupancy of Output Manager's queues
+ *
+ * \return Maximal occupancy of the input queue and queues of storage plugins
+ * in per mille (0 - 1000)
+ */
+unsigned int output_manager_load();
+
 /**
  * \brief Change mode of output manager
  *
@@ -46,6 +46,7 @@
 #include "preprocessor.h"
 #include "data_manager.h"
 #include "queues.h"
+#include "latency.h"
 #include <ipfixcol.h>
 #include <ipfixcol/ipfix_message.h>
 #include "crc.h"
@@ -54,6 +55,7 @@
 static char *msg_module = "preprocessor";
 
 static struct ring_buffer *preprocessor_out_queue = NULL;
+static struct latency_stage *preprocessor_latency = NULL;
 static configurator *global_config = NULL;
 
 /* Sequence number counter for each flow data source */
@@ -202,6 +204,10 @@ void data_source_info_destroy()
 void preprocessor_set_output_queue(struct ring_buffer *out_queue)
 {
 	preprocessor_out_queue = out_queue;
+
+	if (!preprocessor_latency) {
+		preprocessor_latency = latency_stage_get("preprocessor");
+	}
 }
 
 /**
@@ -538,6 +544,7 @@ void preprocessor_parse_msg(void* packet, int len, struct input_info* input_info
 	struct ipfix_message* msg;
 	uint32_t exporter_ip_addr;
 	uint32_t *seqn;
+	uint64_t received = latency_enabled ? latency_now() : 0;
 
 	/* Check input info */
 	if (input_info == NULL) {
@@ -627,6 +634,11 @@ void preprocessor_parse_msg(void* packet, int len, struct input_info* input_info
 		msg->input_info->data_records += msg->data_records_count;
 	}
 
+	/* Start latency tracing of the message */
+	msg->trace_received = received;
+	msg->trace_stage = received;
+	latency_stamp(preprocessor_latency, msg);
+
 	/* Send data to the first intermediate plugin */
 	if (rbuffer_write(preprocessor_out_queue, msg, 1) != 0) {
 		MSG_WARNING(msg_module, "[%u] Unable to write into Data Manager input queue; skipping data...",
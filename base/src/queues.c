@@ -40,12 +40,27 @@
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "queues.h"
+#include "affinity.h"
 
 /** Identifier to MSG_* macros */
 static char *msg_module = "queue";
 
+/**
+ * \brief Round size of memory up to whole pages
+ *
+ * @param[in] size Size of the memory.
+ * @return Size in bytes.
+ */
+static size_t rbuffer_pages(size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	return (size + page - 1) / page * page;
+}
+
 /**
  * \brief Initiate ring buffer structure with specified size.
  *
@@ -71,14 +86,20 @@ struct ring_buffer* rbuffer_init(uint16_t size)
 	retval->write_offset = 0;
 	retval->count = 0;
 	retval->size = size;
-	retval->data = (struct ipfix_message **) malloc(size * sizeof(struct ipfix_message*));
-	if (retval->data == NULL) {
+
+	/* Arrays are page aligned, so they can be moved to NUMA node of the consumer */
+	if (posix_memalign((void **) &retval->data, sysconf(_SC_PAGESIZE), rbuffer_pages(size * sizeof(struct ipfix_message*))) != 0) {
 		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
 		free(retval);
 		return NULL;
 	}
 
-	retval->data_references = (unsigned int *) calloc(size, sizeof(unsigned int));
+	if (posix_memalign((void **) &retval->data_references, sysconf(_SC_PAGESIZE), rbuffer_pages(size * sizeof(unsigned int))) != 0) {
+		retval->data_references = NULL;
+	} else {
+		memset(retval->data_references, 0, size * sizeof(unsigned int));
+	}
+
 	if (retval->data_references == NULL) {
 		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
 		free(retval->data);
@@ -223,32 +244,180 @@ struct ipfix_message* rbuffer_read(struct ring_buffer* rbuffer, unsigned int *in
 }
 
 /**
- * \brief Decrease reference counter on specified record in ring buffer.
+ * \brief Add more records into the ring buffer.
  *
- * Each thread can use this function only once (for each ring buffer run) when
- * it is done with data from index. Reference count is set to the number of
- * threads reading data from the ring buffer. The scheme of usage is usually as
- * follows:
+ * Records are added in the given order, the ring buffer is locked once for
+ * all records that fit into it.
  *
- * - rbuffer_read (); <br/>
- * - do some work with read data; <br/>
- * - rbuffer_remove_reference ();
+ * @param[in] rbuffer Ring buffer.
+ * @param[in] records IPFIX message structures to be added into the ring buffer.
+ * @param[in] count Number of records.
+ * @param[in] ref_count Initial refference count - number of reading threads.
+ * @return 0 on success, nonzero on error.
+ */
+int rbuffer_write_batch(struct ring_buffer* rbuffer, struct ipfix_message** records, unsigned int count, uint16_t ref_count)
+{
+	unsigned int written = 0;
+	int ret = EXIT_SUCCESS;
+
+	if (rbuffer == NULL || ref_count == 0) {
+		MSG_ERROR(msg_module, "Invalid ring buffer write parameters");
+		return EXIT_FAILURE;
+	}
+
+	if (pthread_mutex_lock(&(rbuffer->mutex)) != 0) {
+		MSG_ERROR(msg_module, "Mutex lock failed (%s:%d)", __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+
+	while (written < count) {
+		/* leave one position in buffer free (see rbuffer_write) */
+		while (rbuffer->count + 1 >= rbuffer->size) {
+			if (pthread_cond_wait(&(rbuffer->cond), &(rbuffer->mutex)) != 0) {
+				MSG_ERROR(msg_module, "Condition wait failed (%s:%d)", __FILE__, __LINE__);
+
+				if (pthread_mutex_unlock(&(rbuffer->mutex)) != 0) {
+					MSG_ERROR(msg_module, "Mutex unlock failed (%s:%d)", __FILE__, __LINE__);
+				}
+
+				return EXIT_FAILURE;
+			}
+		}
+
+		while (written < count && rbuffer->count + 1 < rbuffer->size) {
+			rbuffer->data[rbuffer->write_offset] = records[written++];
+			rbuffer->data_references[rbuffer->write_offset] = ref_count;
+			rbuffer->write_offset = (rbuffer->write_offset + 1) % rbuffer->size;
+			rbuffer->count++;
+		}
+
+		/* inform read threads, there can be more of them waiting for different records */
+		if (pthread_cond_broadcast(&(rbuffer->cond)) != 0) {
+			MSG_ERROR(msg_module, "Condition signal failed (%s:%d)", __FILE__, __LINE__);
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	if (pthread_mutex_unlock(&(rbuffer->mutex)) != 0) {
+		MSG_ERROR(msg_module, "Mutex unlock failed (%s:%d)", __FILE__, __LINE__);
+		return EXIT_FAILURE;
+	}
+
+	return ret;
+}
+
+/**
+ * \brief Get consecutive records from ring buffer.
+ *
+ * Waits for the first record like rbuffer_read() and returns all following
+ * records that are already in the ring buffer (at most \p max). NULL record
+ * ends the batch; it is returned alone when it is the first one.
  *
  * @param[in] rbuffer Ring buffer.
- * @param[in] index Index of the item in the ring buffer.
- * @param[in] do_free 1 to free data with 0 references, 0 to lose data by removing
- * the pointer, but do not free the data.
- * @return 0 on success, nonzero on error - no reference on item
+ * @param[in,out] index Index of the first record, (unsigned int)-1 for ring
+ * buffer's read offset.
+ * @param[out] records Read records.
+ * @param[in] max Maximal number of records.
+ * @return Number of read records, 0 on error.
  */
-int rbuffer_remove_reference(struct ring_buffer* rbuffer, unsigned int index, uint8_t do_free)
+unsigned int rbuffer_read_batch(struct ring_buffer* rbuffer, unsigned int *index, struct ipfix_message** records, unsigned int max)
+{
+	unsigned int count = 0, available;
+
+	if (pthread_mutex_lock(&(rbuffer->mutex)) != 0) {
+		MSG_ERROR(msg_module, "Mutex lock failed (%s:%d)", __FILE__, __LINE__);
+		return 0;
+	}
+
+	if (*index == (unsigned int) -1) {
+		*index = rbuffer->read_offset;
+	}
+
+	/* wait when trying to read from write_offset - no data here yet */
+	while (rbuffer->write_offset == *index) {
+		if (pthread_cond_wait(&(rbuffer->cond), &(rbuffer->mutex)) != 0) {
+			MSG_ERROR(msg_module, "Condition wait failed (%s:%d)", __FILE__, __LINE__);
+
+			if (pthread_mutex_unlock(&(rbuffer->mutex)) != 0) {
+				MSG_ERROR(msg_module, "Mutex unlock failed (%s:%d)", __FILE__, __LINE__);
+			}
+
+			return 0;
+		}
+	}
+
+	available = (rbuffer->write_offset + rbuffer->size - *index) % rbuffer->size;
+	while (count < available && count < max) {
+		records[count] = rbuffer->data[(*index + count) % rbuffer->size];
+		if (!records[count]) {
+			/* NULL record is returned alone */
+			if (count == 0) {
+				count++;
+			}
+			break;
+		}
+		count++;
+	}
+
+	if (pthread_mutex_unlock(&(rbuffer->mutex)) != 0) {
+		MSG_ERROR(msg_module, "Mutex unlock failed (%s:%d)", __FILE__, __LINE__);
+		return 0;
+	}
+
+	/* Wake up other threads waiting for read */
+	if (pthread_cond_signal(&(rbuffer->cond)) != 0) {
+		MSG_ERROR(msg_module, "Condition signal failed (%s:%d)", __FILE__, __LINE__);
+		return 0;
+	}
+
+	return count;
+}
+
+/**
+ * \brief Free IPFIX message read from ring buffer.
+ *
+ * References on templates of the message are decreased.
+ *
+ * @param[in] msg IPFIX message (may be NULL).
+ */
+void rbuffer_free_message(struct ipfix_message *msg)
 {
 	int i;
 
-	/* atomic rbuffer->data_references[index]--; and check <= 0 */
-	if (__sync_fetch_and_sub(&(rbuffer->data_references[index]), 1) <= 0) {
-		return EXIT_FAILURE;
+	if (!msg) {
+		return;
+	}
+
+	if (msg->pkt_header) {
+		free(msg->pkt_header);
 	}
 
+	/* Decrement reference on templates */
+	for (i = 0; i < MSG_MAX_DATA_COUPLES && msg->data_couple[i].data_set; ++i) {
+		if (msg->data_couple[i].data_template) {
+			tm_template_reference_dec(msg->data_couple[i].data_template);
+		}
+	}
+
+	if (msg->metadata) {
+		message_free_metadata(msg);
+	}
+
+	message_free_enrich(msg);
+
+	free(msg);
+}
+
+/**
+ * \brief Move read offset over the records without references.
+ *
+ * @param[in] rbuffer Ring buffer.
+ * @param[in] do_free 1 to free data with 0 references, 0 to lose data by removing
+ * the pointer, but do not free the data.
+ * @return 0 on success, nonzero on error
+ */
+static int rbuffer_release(struct ring_buffer* rbuffer, uint8_t do_free)
+{
 	if (pthread_mutex_lock(&(rbuffer->mutex)) != 0) {
 		MSG_ERROR(msg_module, "Mutex lock failed (%s:%d)", __FILE__, __LINE__);
 		return EXIT_FAILURE;
@@ -259,24 +428,7 @@ int rbuffer_remove_reference(struct ring_buffer* rbuffer, unsigned int index, ui
 		while ((rbuffer->data_references[rbuffer->read_offset] == 0) && (rbuffer->count > 0)) {
 			if (do_free) {
 				/* free the data */
-				if (rbuffer->data[rbuffer->read_offset]) {
-					if (rbuffer->data[rbuffer->read_offset]->pkt_header) {
-						free(rbuffer->data[rbuffer->read_offset]->pkt_header);
-					}
-
-					/* Decrement reference on templates */
-					for (i = 0; i < MSG_MAX_DATA_COUPLES && rbuffer->data[rbuffer->read_offset]->data_couple[i].data_set; ++i) {
-						if (rbuffer->data[rbuffer->read_offset]->data_couple[i].data_template) {
-							tm_template_reference_dec(rbuffer->data[rbuffer->read_offset]->data_couple[i].data_template);
-						}
-					}
-					
-					if (rbuffer->data[rbuffer->read_offset]->metadata) {
-						message_free_metadata(rbuffer->data[rbuffer->read_offset]);
-					}
-					
-					free(rbuffer->data[rbuffer->read_offset]);
-				}
+				rbuffer_free_message(rbuffer->data[rbuffer->read_offset]);
 			}
 
 			/* move offset pointer in ring buffer */
@@ -310,8 +462,9 @@ int rbuffer_remove_reference(struct ring_buffer* rbuffer, unsigned int index, ui
 		return EXIT_SUCCESS;
 	}
 
-	/* I did change of rbuffer->count so inform about it other threads (mainly write thread) */
-	if (pthread_cond_signal(&(rbuffer->cond)) != 0) {
+	/* I did change of rbuffer->count so inform about it other threads (mainly write thread),
+	 * a reader waiting for new data can share the condition with it */
+	if (pthread_cond_broadcast(&(rbuffer->cond)) != 0) {
 		MSG_ERROR(msg_module, "Condition signal failed (%s:%d)", __FILE__, __LINE__);
 		return EXIT_FAILURE;
 	}
@@ -319,6 +472,93 @@ int rbuffer_remove_reference(struct ring_buffer* rbuffer, unsigned int index, ui
 	return EXIT_SUCCESS;
 }
 
+/**
+ * \brief Decrease reference counter on specified record in ring buffer.
+ *
+ * Each thread can use this function only once (for each ring buffer run) when
+ * it is done with data from index. Reference count is set to the number of
+ * threads reading data from the ring buffer. The scheme of usage is usually as
+ * follows:
+ *
+ * - rbuffer_read (); <br/>
+ * - do some work with read data; <br/>
+ * - rbuffer_remove_reference ();
+ *
+ * @param[in] rbuffer Ring buffer.
+ * @param[in] index Index of the item in the ring buffer.
+ * @param[in] do_free 1 to free data with 0 references, 0 to lose data by removing
+ * the pointer, but do not free the data.
+ * @return 0 on success, nonzero on error - no reference on item
+ */
+int rbuffer_remove_reference(struct ring_buffer* rbuffer, unsigned int index, uint8_t do_free)
+{
+	/* atomic rbuffer->data_references[index]--; and check <= 0 */
+	if (__sync_fetch_and_sub(&(rbuffer->data_references[index]), 1) <= 0) {
+		return EXIT_FAILURE;
+	}
+
+	return rbuffer_release(rbuffer, do_free);
+}
+
+/**
+ * \brief Decrease reference counters on consecutive records in ring buffer.
+ *
+ * Batch version of rbuffer_remove_reference(), the read offset is moved
+ * (and the ring buffer locked) only once.
+ *
+ * @param[in] rbuffer Ring buffer.
+ * @param[in] index Index of the first item in the ring buffer.
+ * @param[in] count Number of items.
+ * @param[in] do_free 1 to free data with 0 references, 0 to lose data by removing
+ * the pointer, but do not free the data.
+ * @return 0 on success, nonzero on error - no reference on some item
+ */
+int rbuffer_remove_references(struct ring_buffer* rbuffer, unsigned int index, unsigned int count, uint8_t do_free)
+{
+	unsigned int i;
+	int ret = EXIT_SUCCESS;
+
+	for (i = 0; i < count; ++i) {
+		/* atomic rbuffer->data_references[index]--; and check <= 0 */
+		if (__sync_fetch_and_sub(&(rbuffer->data_references[(index + i) % rbuffer->size]), 1) <= 0) {
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	if (rbuffer_release(rbuffer, do_free) != EXIT_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	return ret;
+}
+
+/**
+ * \brief Get occupancy of ring buffer
+ *
+ * The counter is read without locking, the result is approximate.
+ *
+ * @param[in] rbuffer Ring buffer.
+ * @return Occupancy in per mille (0 - 1000).
+ */
+unsigned int rbuffer_load(struct ring_buffer* rbuffer)
+{
+	if (rbuffer == NULL || rbuffer->size == 0) {
+		return 0;
+	}
+
+	/* One slot always stays free */
+	return (unsigned int) rbuffer->count * 1000 / (rbuffer->size - 1);
+}
+
+/**
+ * \brief Move ring buffer to NUMA node of the calling thread
+ */
+void rbuffer_bind_local(struct ring_buffer* rbuffer)
+{
+	affinity_bind_local(rbuffer->data, rbuffer_pages(rbuffer->size * sizeof(struct ipfix_message*)));
+	affinity_bind_local(rbuffer->data_references, rbuffer_pages(rbuffer->size * sizeof(unsigned int)));
+}
+
 /**
  * \brief Wait for queue to became empty
  *
@@ -103,6 +103,45 @@ int rbuffer_write(struct ring_buffer* rbuffer, struct ipfix_message* record, uin
  */
 struct ipfix_message* rbuffer_read(struct ring_buffer* rbuffer, unsigned int *index);
 
+/**
+ * \brief Add more records into the ring buffer.
+ *
+ * Records are added in the given order, the ring buffer is locked once for
+ * all records that fit into it.
+ *
+ * @param[in] rbuffer Ring buffer.
+ * @param[in] records IPFIX message structures to be added into the ring buffer.
+ * @param[in] count Number of records.
+ * @param[in] ref_count Initial refference count - number of reading threads.
+ * @return 0 on success, nonzero on error.
+ */
+int rbuffer_write_batch(struct ring_buffer* rbuffer, struct ipfix_message** records, unsigned int count, uint16_t ref_count);
+
+/**
+ * \brief Get consecutive records from ring buffer.
+ *
+ * Waits for the first record like rbuffer_read() and returns all following
+ * records that are already in the ring buffer (at most \p max). NULL record
+ * ends the batch; it is returned alone when it is the first one.
+ *
+ * @param[in] rbuffer Ring buffer.
+ * @param[in,out] index Index of the first record, (unsigned int)-1 for ring
+ * buffer's read offset.
+ * @param[out] records Read records.
+ * @param[in] max Maximal number of records.
+ * @return Number of read records, 0 on error.
+ */
+unsigned int rbuffer_read_batch(struct ring_buffer* rbuffer, unsigned int *index, struct ipfix_message** records, unsigned int max);
+
+/**
+ * \brief Free IPFIX message read from ring buffer.
+ *
+ * References on templates of the message are decreased.
+ *
+ * @param[in] msg IPFIX message (may be NULL).
+ */
+void rbuffer_free_message(struct ipfix_message *msg);
+
 /**
  * \brief Decrease reference counter on specified record in ring buffer.
  *
@@ -123,6 +162,40 @@ struct ipfix_message* rbuffer_read(struct ring_buffer* rbuffer, unsigned int *in
  */
 int rbuffer_remove_reference(struct ring_buffer* rbuffer, unsigned int index, uint8_t do_free);
 
+/**
+ * \brief Decrease reference counters on consecutive records in ring buffer.
+ *
+ * Batch version of rbuffer_remove_reference(), the read offset is moved
+ * (and the ring buffer locked) only once.
+ *
+ * @param[in] rbuffer Ring buffer.
+ * @param[in] index Index of the first item in the ring buffer.
+ * @param[in] count Number of items.
+ * @param[in] do_free 1 to free data with 0 references, 0 to lose data by removing
+ * the pointer, but do not free the data.
+ * @return 0 on success, nonzero on error - no reference on some item
+ */
+int rbuffer_remove_references(struct ring_buffer* rbuffer, unsigned int index, unsigned int count, uint8_t do_free);
+
+/**
+ * \brief Get occupancy of ring buffer
+ *
+ * The counter is read without locking, the result is approximate.
+ *
+ * @param[in] rbuffer Ring buffer.
+ * @return Occupancy in per mille (0 - 1000).
+ */
+unsigned int rbuffer_load(struct ring_buffer* rbuffer);
+
+/**
+ * \brief Move ring buffer to NUMA node of the calling thread
+ *
+ * Called by the consumer of the ring buffer after it is pinned to CPUs.
+ *
+ * @param[in] rbuffer Ring buffer.
+ */
+void rbuffer_bind_local(struct ring_buffer* rbuffer);
+
 /**
  * \brief Wait for queue to became empty
  *
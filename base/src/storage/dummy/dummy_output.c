@@ -140,7 +140,10 @@ int store_packet(void *config, const struct ipfix_message *ipfix_msg,
 
 	MSG_DEBUG(msg_module, "[%u] Received IPFIX message", ipfix_msg->input_info->odid);
 
-	usleep(conf->delay);
+	/* without delay the plugin is a null storage (benchmarks) */
+	if (conf->delay > 0) {
+		usleep(conf->delay);
+	}
 	return 0;
 }
 
@@ -57,6 +57,8 @@
 #define DEF_PACKET_SIZE (4096)
 /** Default template refresh timeout         */
 #define DEF_TEMPLATE_REFRESH (300U)
+/** Default flow key of hash distribution    */
+#define DEF_HASH_KEY HASH_KEY_HOSTS
 
 static const char *msg_module = "forwarding(config)";
 
@@ -133,11 +135,37 @@ static enum DIST_MODE config_parse_distr(const char *str)
 		return DIST_ALL;
 	} else if (!strcasecmp(str, "roundrobin")) {
 		return DIST_ROUND_ROBIN;
+	} else if (!strcasecmp(str, "hash")) {
+		return DIST_HASH;
 	} else {
 		return DIST_INVALID;
 	}
 }
 
+/**
+ * \brief Parse flow key of hash distribution
+ * \param[in] str String
+ * \return Type of flow key
+ */
+static enum HASH_KEY config_parse_hash_key(const char *str)
+{
+	if (!str) {
+		return HASH_KEY_INVALID;
+	}
+
+	if (!strcasecmp(str, "srcIP")) {
+		return HASH_KEY_SRC_IP;
+	} else if (!strcasecmp(str, "dstIP")) {
+		return HASH_KEY_DST_IP;
+	} else if (!strcasecmp(str, "hosts")) {
+		return HASH_KEY_HOSTS;
+	} else if (!strcasecmp(str, "flow")) {
+		return HASH_KEY_FLOW;
+	} else {
+		return HASH_KEY_INVALID;
+	}
+}
+
 /**
  * \brief Convert string to transport protocol
  * \param[in] str String
@@ -285,6 +313,36 @@ static fwd_sender_t *config_parse_destination(struct parser_context *ctx)
 	return new_sender;
 }
 
+/**
+ * \brief Prepare a hash ring and packet builders for each destination
+ * \param[in,out] cfg Plugin configuration
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int config_prepare_hash(struct plugin_config *cfg)
+{
+	if (dest_hash_init(cfg->dest_mgr)) {
+		return 1;
+	}
+
+	size_t cnt = dest_hash_slots(cfg->dest_mgr);
+	cfg->builder_hash = calloc(cnt, sizeof(*cfg->builder_hash));
+	if (!cfg->builder_hash) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__,
+			__LINE__);
+		return 1;
+	}
+
+	cfg->builder_hash_cnt = cnt;
+	for (size_t i = 0; i < cnt; ++i) {
+		cfg->builder_hash[i] = bldr_create();
+		if (!cfg->builder_hash[i]) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 /**
  * \brief Parse XML configuration
  * \param[in,out] ctx Parser context
@@ -316,6 +374,15 @@ static int config_parse_xml(struct parser_context *ctx)
 			// Distribution type
 			aux_str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
 			ctx->cfg->mode = config_parse_distr((char *) aux_str);
+		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "hashKey")) {
+			// Flow key of hash distribution
+			aux_str = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+			ctx->cfg->hash_key = config_parse_hash_key((char *) aux_str);
+			if (ctx->cfg->hash_key == HASH_KEY_INVALID) {
+				MSG_ERROR(msg_module, "Invalid flow key '%s' of hash "
+					"distribution.", (aux_str) ? (char *) aux_str : "");
+				failed = true;
+			}
 		} else if (!xmlStrcasecmp(cur->name, (const xmlChar *) "packetSize")) {
 			// Maximal packet size
 			int result;
@@ -409,6 +476,11 @@ static int config_parse_xml(struct parser_context *ctx)
 		return 1;
 	}
 
+	if (ctx->cfg->mode == DIST_HASH && config_prepare_hash(ctx->cfg)) {
+		MSG_ERROR(msg_module, "Failed to prepare hash distribution.");
+		return 1;
+	}
+
 	return 0;
 }
 
@@ -439,6 +511,7 @@ struct plugin_config *config_parse(const char *cfg_string)
 
 	// Set default values
 	config->mode = DIST_ALL;
+	config->hash_key = DEF_HASH_KEY;
 	config->packet_size = DEF_PACKET_SIZE;
 	config->reconn_period = DEF_RECONN_PERIOD; // milliseconds
 	config->udp_refresh_timeout = DEF_TEMPLATE_REFRESH; // seconds
@@ -481,6 +554,10 @@ void config_destroy(struct plugin_config *cfg)
 	tmapper_destroy(cfg->tmplt_mgr);
 	bldr_destroy(cfg->builder_all);
 	bldr_destroy(cfg->builder_tmplt);
+	for (size_t i = 0; i < cfg->builder_hash_cnt; ++i) {
+		bldr_destroy(cfg->builder_hash[i]);
+	}
+	free(cfg->builder_hash);
 
 	free(cfg);
 }
@@ -53,6 +53,18 @@
 #include "packet.h"
 #include <ipfixcol.h>
 
+/**
+ * \brief Flow key for the hash distribution model
+ */
+enum HASH_KEY {
+	HASH_KEY_INVALID,       /**< Invalid type                            */
+	HASH_KEY_SRC_IP,        /**< Source IP address                       */
+	HASH_KEY_DST_IP,        /**< Destination IP address                  */
+	HASH_KEY_HOSTS,         /**< Pair of IP addresses (both directions)  */
+	HASH_KEY_FLOW           /**< IP addresses, ports and protocol
+	                          *  (both directions)                       */
+};
+
 /**
  * \brief Configuration of the plugin
  */
@@ -60,6 +72,7 @@ struct plugin_config {
 	char *def_port;             /**< Default port                            */
 	int def_proto;              /**< Default protocol                        */
 	enum DIST_MODE mode;        /**< Distribution mode                       */
+	enum HASH_KEY hash_key;     /**< Flow key (for hash distribution)        */
 	uint16_t packet_size;       /**< Maximal size per generated packet       */
 	int reconn_period;          /**< Reconnection period (in milliseconds)   */
 	unsigned int udp_refresh_timeout; /**< UDP template refresh timeout
@@ -69,6 +82,9 @@ struct plugin_config {
 
 	fwd_bldr_t *builder_all;    /**< Packet builder (for data and templates) */
 	fwd_bldr_t *builder_tmplt;  /**< Packet builder (for templates only)     */
+	fwd_bldr_t **builder_hash;  /**< Packet builders per destination
+	                              *  (only for hash distribution)         */
+	size_t builder_hash_cnt;    /**< Number of builders per destination    */
 
 	tmapper_t  *tmplt_mgr;      /**< Template manager                        */
 };
@@ -39,6 +39,7 @@
 
 #include <ipfixcol.h>
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
@@ -56,6 +57,8 @@ static const char *msg_module = "forwarding(dst)";
 #define DEF_GRP_SIZE (8)
 /** Default size of an array for sequence numbers of ODIDs                   */
 #define DEF_SEQ_ARRAY_SIZE (8)
+/** Number of points on the hash ring per destination                       */
+#define DEF_HASH_VNODES (128)
 
 /** \brief Auxiliary array for sequence number per ODID                      */
 struct seq_per_odid {
@@ -82,6 +85,22 @@ struct group {
 	size_t max;                /**< Max size of the array                    */
 };
 
+/** \brief Auxiliary buffers for sending a batch of packets                  */
+struct send_batch {
+	struct sender_pkt *pkts;     /**< Packets                                */
+	struct ipfix_header *hdrs;   /**< IPFIX headers of the packets           */
+	size_t pkt_max;              /**< Max number of packets                  */
+
+	struct iovec *io;            /**< Parts of all packets                   */
+	size_t io_max;               /**< Max number of parts                    */
+};
+
+/** \brief Point of the consistent hash ring                                 */
+struct hash_point {
+	uint32_t value;              /**< Position on the ring                   */
+	uint32_t slot;               /**< Index of a destination                 */
+};
+
 /** \brief Main structure for destination manager                            */
 struct _fwd_dest {
 	/** Index of next destination (for RoundRobin)                           */
@@ -115,6 +134,20 @@ struct _fwd_dest {
 
 	/** Template manager                                                     */
 	tmapper_t *tmplt_mgr;
+
+	/** Buffers for sending packets (used only by the main thread)           */
+	struct send_batch batch;
+
+	/** All destinations in the order of configuration (hash slots)          */
+	fwd_sender_t **slots;
+	size_t slots_cnt;            /**< Destinations in the array              */
+	size_t slots_max;            /**< Max size of the array                  */
+	/** Connected slots (updated by dest_hash_refresh())                     */
+	bool *slots_active;
+
+	/** Consistent hash ring (sorted by position)                            */
+	struct hash_point *ring;
+	size_t ring_cnt;             /**< Number of points on the ring           */
 };
 
 /**
@@ -132,6 +165,8 @@ struct tmplts_for_reconnected {
 	struct tmplts_per_odid *templates;
 	/** A size of the array                                                  */
 	uint32_t cnt;
+	/** Buffers for sending packets                                          */
+	struct send_batch *batch;
 };
 
 /**
@@ -153,7 +188,7 @@ typedef bool (*group_cb_t) (struct dst_client *dst, void *data);
 
 // Prototypes
 static enum SEND_STATUS dest_packet_sender(struct dst_client *dst,
-	fwd_bldr_t *bldr, bool req_flg);
+	struct send_batch *batch, fwd_bldr_t *bldr, bool req_flg);
 
 /**
  * \brief Get an sequence number for defined Observation Domain ID (ODID)
@@ -484,7 +519,8 @@ static bool aux_reconn_tmplt(struct dst_client *client, void *data)
 		// Send templates of defined ODID
 		fwd_bldr_t *packet_builder = tmplts->templates[i].odid_packet;
 
-		ret_val = dest_packet_sender(client, packet_builder, true);
+		ret_val = dest_packet_sender(client, tmplts->batch, packet_builder,
+			true);
 		if (ret_val == STATUS_OK) {
 			continue;
 		}
@@ -681,6 +717,13 @@ void dest_destroy(fwd_dest_t *dst_mgr)
 	group_destroy(dst_mgr->disconn);
 	group_destroy(dst_mgr->ready);
 	pthread_mutex_destroy(&dst_mgr->group_mtx);
+
+	free(dst_mgr->batch.pkts);
+	free(dst_mgr->batch.hdrs);
+	free(dst_mgr->batch.io);
+	free(dst_mgr->slots);
+	free(dst_mgr->slots_active);
+	free(dst_mgr->ring);
 	free(dst_mgr);
 }
 
@@ -691,11 +734,34 @@ int dest_add(fwd_dest_t *dst_mgr, fwd_sender_t *sndr)
 		return 1;
 	}
 
+	if (dst_mgr->slots_cnt == dst_mgr->slots_max) {
+		// The array is full -> realloc
+		size_t new_max = (dst_mgr->slots_max == 0)
+			? DEF_GRP_SIZE
+			: 2 * dst_mgr->slots_max;
+		fwd_sender_t **new_arr;
+
+		new_arr = realloc(dst_mgr->slots, new_max * sizeof(*new_arr));
+		if (!new_arr) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+				__FILE__, __LINE__);
+			return 1;
+		}
+
+		dst_mgr->slots = new_arr;
+		dst_mgr->slots_max = new_max;
+	}
+
 	pthread_mutex_lock(&dst_mgr->group_mtx);
 	int res = group_append(dst_mgr->disconn, sndr);
 	pthread_mutex_unlock(&dst_mgr->group_mtx);
 
-	return (res == 0) ? 0 : 1;
+	if (res != 0) {
+		return 1;
+	}
+
+	dst_mgr->slots[dst_mgr->slots_cnt++] = sndr;
+	return 0;
 }
 
 
@@ -894,7 +960,8 @@ void dest_check_reconnected(fwd_dest_t *dst_mgr)
 	}
 
 	free(odid_ids); // We don't need it anymore!
-	struct tmplts_for_reconnected data = {templates, odid_cnt};
+	struct tmplts_for_reconnected data = {templates, odid_cnt,
+		&dst_mgr->batch};
 
 	// Send all templates...
 	pthread_mutex_lock(&dst_mgr->group_mtx);
@@ -912,22 +979,138 @@ void dest_check_reconnected(fwd_dest_t *dst_mgr)
 	dest_templates_free(templates, odid_cnt);
 }
 
+/**
+ * \brief Make sure that the batch buffers can hold a given number of packets
+ *   and parts
+ * \param[in,out] batch Batch buffers
+ * \param[in]     pkts  Number of packets
+ * \param[in]     parts Number of parts
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int dest_batch_reserve(struct send_batch *batch, size_t pkts,
+	size_t parts)
+{
+	if (batch->pkt_max < pkts) {
+		struct sender_pkt *new_pkts;
+		struct ipfix_header *new_hdrs;
+
+		new_pkts = realloc(batch->pkts, pkts * sizeof(*new_pkts));
+		if (!new_pkts) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+				__FILE__, __LINE__);
+			return 1;
+		}
+		batch->pkts = new_pkts;
+
+		new_hdrs = realloc(batch->hdrs, pkts * sizeof(*new_hdrs));
+		if (!new_hdrs) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+				__FILE__, __LINE__);
+			return 1;
+		}
+		batch->hdrs = new_hdrs;
+		batch->pkt_max = pkts;
+	}
+
+	if (batch->io_max < parts) {
+		size_t new_max = (batch->io_max == 0) ? 64 : batch->io_max;
+		while (new_max < parts) {
+			new_max *= 2;
+		}
+
+		struct iovec *new_io = realloc(batch->io, new_max * sizeof(*new_io));
+		if (!new_io) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+				__FILE__, __LINE__);
+			return 1;
+		}
+
+		batch->io = new_io;
+		batch->io_max = new_max;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Prepare all packets of a builder for sending in one batch
+ *
+ * Each packet gets its own IPFIX header (with a correct sequence number) and
+ * parts of all packets are stored consecutively (see sender_send_batch()).
+ * \param[in,out] batch   Batch buffers
+ * \param[in,out] bldr    Packet builder
+ * \param[in]     seq_num Sequence number of the first packet
+ * \param[out]    rec_cnt Number of data records in all packets
+ * \return On success returns number of packets. Otherwise returns -1.
+ */
+static int dest_batch_prepare(struct send_batch *batch, fwd_bldr_t *bldr,
+	uint32_t seq_num, size_t *rec_cnt)
+{
+	int pkt_cnt = bldr_pkts_cnt(bldr);
+	if (pkt_cnt <= 0) {
+		*rec_cnt = 0;
+		return (pkt_cnt == 0) ? 0 : -1;
+	}
+
+	if (dest_batch_reserve(batch, pkt_cnt, 0)) {
+		return -1;
+	}
+
+	// Get parts of all packets (they are valid until the builder is reused)
+	size_t parts_total = 0;
+	size_t rec_total = 0;
+
+	for (int i = 0; i < pkt_cnt; ++i) {
+		struct sender_pkt *pkt = &batch->pkts[i];
+		size_t pkt_recs;
+
+		if (bldr_pkts_parts(bldr, seq_num, i, &batch->hdrs[i], &pkt->io,
+				&pkt->parts, &pkt_recs)) {
+			// Internal Error
+			return -1;
+		}
+
+		parts_total += pkt->parts + 1; // + IPFIX header
+		rec_total += pkt_recs;
+		seq_num += pkt_recs;
+	}
+
+	if (dest_batch_reserve(batch, pkt_cnt, parts_total)) {
+		return -1;
+	}
+
+	// Put the headers and parts together
+	struct iovec *pos = batch->io;
+	for (int i = 0; i < pkt_cnt; ++i) {
+		struct sender_pkt *pkt = &batch->pkts[i];
+
+		pos[0].iov_base = &batch->hdrs[i];
+		pos[0].iov_len = IPFIX_HEADER_LENGTH;
+		memcpy(&pos[1], pkt->io, pkt->parts * sizeof(*pos));
+
+		pkt->io = pos;
+		pkt->parts += 1;
+		pos += pkt->parts;
+	}
+
+	*rec_cnt = rec_total;
+	return pkt_cnt;
+}
+
 /**
  * \brief Send all packets to a destination (auxiliary function)
- * \param[in,out] dst  Destination
- * \param[in,out] bldr Packet builder
- * \param[in] req_flg  Required delivery (usually for packets with templates)
+ * \param[in,out] dst   Destination
+ * \param[in,out] batch Batch buffers
+ * \param[in,out] bldr  Packet builder
+ * \param[in] req_flg   Required delivery (usually for packets with templates)
  * \return Status code. When all packets were sent, returns STATUS_OK.
  */
 static enum SEND_STATUS dest_packet_sender(struct dst_client *dst,
-	fwd_bldr_t *bldr, bool req_flg)
+	struct send_batch *batch, fwd_bldr_t *bldr, bool req_flg)
 {
-	int pkt_cnt = bldr_pkts_cnt(bldr);
 	enum SEND_STATUS stat;
-
-	struct iovec *pkt_parts;
-	size_t size;
 	size_t rec_cnt;
+	int pkt_cnt;
 
 	// Get a sequence number
 	uint32_t odid = bldr_pkts_get_odid(bldr);
@@ -936,27 +1119,20 @@ static enum SEND_STATUS dest_packet_sender(struct dst_client *dst,
 		return STATUS_INVALID;
 	}
 
-	// Send packets
-	for (int i = 0; i < pkt_cnt; ++i) {
-		// Prepare the packet
-		if (bldr_pkts_iovec(bldr, *seq_num, i, &pkt_parts, &size,
-			&rec_cnt)) {
-			// Internal Error
-			return STATUS_INVALID;
-		}
-
-		// Send the packet
-		stat = sender_send_parts(dst->sender, pkt_parts, size,
-			MODE_NON_BLOCKING, req_flg);
-
-		if (stat != STATUS_OK) {
-			return stat;
-		}
+	// Prepare packets
+	pkt_cnt = dest_batch_prepare(batch, bldr, *seq_num, &rec_cnt);
+	if (pkt_cnt < 0) {
+		return STATUS_INVALID;
+	}
 
-		*seq_num += rec_cnt;
-		req_flg = true; // Remaining packets are always required
+	// Send packets
+	stat = sender_send_batch(dst->sender, batch->pkts, pkt_cnt,
+		MODE_NON_BLOCKING, req_flg);
+	if (stat != STATUS_OK) {
+		return stat;
 	}
 
+	*seq_num += rec_cnt;
 	return STATUS_OK;
 }
 
@@ -989,18 +1165,38 @@ int dest_move_to_dc(fwd_dest_t *dst_mgr, fwd_sender_t *sndr)
 	return 0;
 }
 
+/**
+ * \brief Get a slot index of a destination (see dest_hash_slots())
+ * \param[in] dst_mgr Destination manager
+ * \param[in] sndr    Sender of the destination
+ * \return Index or -1 (unknown sender)
+ */
+static int dest_hash_slot(const fwd_dest_t *dst_mgr, const fwd_sender_t *sndr)
+{
+	for (size_t i = 0; i < dst_mgr->slots_cnt; ++i) {
+		if (dst_mgr->slots[i] == sndr) {
+			return (int) i;
+		}
+	}
+
+	return -1;
+}
+
 /**
  * \brief Send to all destinations except one
  *
  * To send the messages to all destinations just use negative index (e.g. -1)
- * of \p except_idx
+ * of \p except_idx. If \p slots is not NULL, the packet builder for each
+ * destination is selected by its slot index (see dest_hash_slots()) and \p bldr
+ * is ignored.
  * \param[in,out] dst_mgr Destination manager
  * \param[in,out] bldr Packet builder
+ * \param[in,out] slots Packet builders per destination (can be NULL)
  * \param[in] except_idx Exception index (of the destination)
  * \param[in] req_flg Required delivery
  */
 static void dest_send_except_one(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr,
-	int except_idx, bool req_flg)
+	fwd_bldr_t **slots, int except_idx, bool req_flg)
 {
 	enum SEND_STATUS stat;
 	unsigned int idx = 0;
@@ -1014,7 +1210,17 @@ static void dest_send_except_one(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr,
 
 		// Send data to the destination
 		struct dst_client *client = &dst_mgr->conn->arr[idx];
-		stat = dest_packet_sender(client, bldr, req_flg);
+		if (slots != NULL) {
+			int slot = dest_hash_slot(dst_mgr, client->sender);
+			if (slot < 0) {
+				++idx;
+				continue;
+			}
+
+			bldr = slots[slot];
+		}
+
+		stat = dest_packet_sender(client, &dst_mgr->batch, bldr, req_flg);
 
 		switch (stat) {
 		case STATUS_BUSY:
@@ -1077,7 +1283,7 @@ static int dest_send_next(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr, bool req_flg)
 
 		// Send data to one selected destination
 		struct dst_client *client = &dst_mgr->conn->arr[idx];
-		stat = dest_packet_sender(client, bldr, req_flg);
+		stat = dest_packet_sender(client, &dst_mgr->batch, bldr, req_flg);
 
 		switch (stat) {
 		case STATUS_BUSY:
@@ -1152,7 +1358,7 @@ static void dest_send_rr(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr_all,
 		}
 
 		// Send template(s) to remaining destination
-		dest_send_except_one(dst_mgr, bldr_tmplts, index, true);
+		dest_send_except_one(dst_mgr, bldr_tmplts, NULL, index, true);
 	} else {
 		// No templates -> send to the next destination in the order
 		dest_send_next(dst_mgr, bldr_all, false);
@@ -1169,15 +1375,171 @@ void dest_send(fwd_dest_t *dst_mgr, fwd_bldr_t *bldr_all,
 	switch (mode) {
 	case DIST_ALL:
 		res = (bldr_pkts_cnt(bldr_tmplts) > 0);
-		dest_send_except_one(dst_mgr, bldr_all, -1, res);
+		dest_send_except_one(dst_mgr, bldr_all, NULL, -1, res);
 		break;
 
 	case DIST_ROUND_ROBIN:
 		dest_send_rr(dst_mgr, bldr_all, bldr_tmplts);
 		break;
 
+	case DIST_HASH:
+		MSG_ERROR(msg_module, "Hash distribution requires packets prepared "
+			"for each destination (use dest_send_hash()).");
+		break;
+
 	default:
 		MSG_ERROR(msg_module, "Unknown distribution model.");
 		break;
 	}
 }
+
+/* Calculate a hash value of a flow key */
+uint32_t dest_hash_data(const void *data, size_t len)
+{
+	// FNV-1a
+	const uint8_t *ptr = (const uint8_t *) data;
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= ptr[i];
+		hash *= 16777619U;
+	}
+
+	// Final mix (MurmurHash3) to spread similar keys over the whole ring
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+/**
+ * \brief Compare two points of the hash ring (for qsort)
+ * \param[in] a First point
+ * \param[in] b Second point
+ * \return Same as strcmp()
+ */
+static int dest_hash_point_cmp(const void *a, const void *b)
+{
+	const struct hash_point *pa = (const struct hash_point *) a;
+	const struct hash_point *pb = (const struct hash_point *) b;
+
+	if (pa->value != pb->value) {
+		return (pa->value < pb->value) ? -1 : 1;
+	}
+
+	// Collision -> keep the order deterministic
+	if (pa->slot != pb->slot) {
+		return (pa->slot < pb->slot) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/* Prepare a consistent hash ring of all destinations */
+int dest_hash_init(fwd_dest_t *dst_mgr)
+{
+	const size_t cnt = dst_mgr->slots_cnt;
+	if (cnt == 0) {
+		return 1;
+	}
+
+	free(dst_mgr->ring);
+	free(dst_mgr->slots_active);
+	dst_mgr->ring_cnt = 0;
+
+	dst_mgr->ring = calloc(cnt * DEF_HASH_VNODES, sizeof(*dst_mgr->ring));
+	dst_mgr->slots_active = calloc(cnt, sizeof(*dst_mgr->slots_active));
+	if (!dst_mgr->ring || !dst_mgr->slots_active) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+			__FILE__, __LINE__);
+		return 1;
+	}
+
+	char key[512];
+	for (size_t i = 0; i < cnt; ++i) {
+		const fwd_sender_t *sndr = dst_mgr->slots[i];
+
+		for (unsigned int v = 0; v < DEF_HASH_VNODES; ++v) {
+			int len = snprintf(key, sizeof(key), "%s:%s/%u",
+				sender_get_address(sndr), sender_get_port(sndr), v);
+			if (len < 0 || (size_t) len >= sizeof(key)) {
+				len = sizeof(key) - 1;
+			}
+
+			struct hash_point *point = &dst_mgr->ring[dst_mgr->ring_cnt++];
+			point->value = dest_hash_data(key, len);
+			point->slot = i;
+		}
+	}
+
+	qsort(dst_mgr->ring, dst_mgr->ring_cnt, sizeof(*dst_mgr->ring),
+		&dest_hash_point_cmp);
+	return 0;
+}
+
+/* Get a number of all destinations (connected or not) */
+size_t dest_hash_slots(const fwd_dest_t *dst_mgr)
+{
+	return dst_mgr->slots_cnt;
+}
+
+/* Update a list of connected destinations */
+void dest_hash_refresh(fwd_dest_t *dst_mgr)
+{
+	if (!dst_mgr->slots_active) {
+		return;
+	}
+
+	memset(dst_mgr->slots_active, 0,
+		dst_mgr->slots_cnt * sizeof(*dst_mgr->slots_active));
+
+	// Only the main thread modifies the group of connected destinations
+	for (size_t i = 0; i < dst_mgr->conn->cnt; ++i) {
+		int slot = dest_hash_slot(dst_mgr, dst_mgr->conn->arr[i].sender);
+		if (slot >= 0) {
+			dst_mgr->slots_active[slot] = true;
+		}
+	}
+}
+
+/* Find a connected destination for a hash value of a flow */
+int dest_hash_lookup(const fwd_dest_t *dst_mgr, uint32_t hash)
+{
+	const size_t cnt = dst_mgr->ring_cnt;
+	if (cnt == 0) {
+		return -1;
+	}
+
+	// Find the first point with a value greater or equal to the hash
+	size_t low = 0;
+	size_t high = cnt;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (dst_mgr->ring[mid].value < hash) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	// Walk clockwise to the first connected destination
+	for (size_t i = 0; i < cnt; ++i) {
+		const struct hash_point *point = &dst_mgr->ring[(low + i) % cnt];
+		if (dst_mgr->slots_active[point->slot]) {
+			return (int) point->slot;
+		}
+	}
+
+	return -1;
+}
+
+/* Send packet(s) prepared separately for each destination */
+void dest_send_hash(fwd_dest_t *dst_mgr, fwd_bldr_t **bldrs,
+	fwd_bldr_t *bldr_tmplts)
+{
+	// Are there any templates i.e. required delivery?
+	bool req_flg = (bldr_pkts_cnt(bldr_tmplts) > 0);
+	dest_send_except_one(dst_mgr, NULL, bldrs, -1, req_flg);
+}
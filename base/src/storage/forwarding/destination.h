@@ -59,7 +59,8 @@
 enum DIST_MODE {
 	DIST_INVALID,           /**< Invalid type                            */
 	DIST_ALL,               /**< Distribute flows to all destinations    */
-	DIST_ROUND_ROBIN        /**< Distribute using Round Robin            */
+	DIST_ROUND_ROBIN,       /**< Distribute using Round Robin            */
+	DIST_HASH               /**< Distribute records by a flow key hash   */
 };
 
 // Structure prototype
@@ -129,6 +130,63 @@ void dest_check_expired_udp(fwd_dest_t *dst_mgr, unsigned int timeout);
  */
 void dest_check_reconnected(fwd_dest_t *dst_mgr);
 
+/**
+ * \brief Prepare a consistent hash ring of all destinations
+ *
+ * Each destination is mapped to multiple points of the ring based on its
+ * address and port. Therefore, the mapping of flows is the same after restart
+ * and only flows of a missing destination are moved to other destinations.
+ * \warning Call this function after all destinations are added.
+ * \param[in,out] dst_mgr Destination manager
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int dest_hash_init(fwd_dest_t *dst_mgr);
+
+/**
+ * \brief Get a number of all destinations (connected or not)
+ * \param[in] dst_mgr Destination manager
+ * \return Count
+ */
+size_t dest_hash_slots(const fwd_dest_t *dst_mgr);
+
+/**
+ * \brief Update a list of connected destinations used by dest_hash_lookup()
+ * \warning This functions must be called only by the thread that use
+ *   dest_send()!
+ * \param[in,out] dst_mgr Destination manager
+ */
+void dest_hash_refresh(fwd_dest_t *dst_mgr);
+
+/**
+ * \brief Find a connected destination for a hash value of a flow
+ * \param[in] dst_mgr Destination manager
+ * \param[in] hash    Hash value (see dest_hash_data())
+ * \return On success returns an index of the destination (i.e. slot index
+ *   smaller than dest_hash_slots()). If no destination is connected, returns
+ *   -1.
+ */
+int dest_hash_lookup(const fwd_dest_t *dst_mgr, uint32_t hash);
+
+/**
+ * \brief Calculate a hash value of a flow key
+ * \param[in] data Flow key
+ * \param[in] len  Length of the key
+ * \return Hash value
+ */
+uint32_t dest_hash_data(const void *data, size_t len);
+
+/**
+ * \brief Send packet(s) prepared separately for each destination
+ *
+ * Used by the DIST_HASH distribution model. Packets of the destination
+ * with a slot index \p i are prepared by the builder \p bldrs[i].
+ * \param[in,out] dst_mgr     Destination manager
+ * \param[in,out] bldrs       Array of prepared packets (Packet builders)
+ * \param[in,out] bldr_tmplts Prepared packets - only templates (Packet builder)
+ */
+void dest_send_hash(fwd_dest_t *dst_mgr, fwd_bldr_t **bldrs,
+	fwd_bldr_t *bldr_tmplts);
+
 /**
  * \brief Send prepared packet(s)
  * \param[in,out] dst_mgr     Destination manager
@@ -56,6 +56,7 @@
 #include <stdbool.h>
 #include <time.h>
 #include <inttypes.h>
+#include <string.h>
 
 #include "configuration.h"
 
@@ -65,36 +66,70 @@ IPFIXCOL_API_VERSION
 // Module identification
 static const char* msg_module= "forwarding";
 
+/** Maximal length of a flow key (2x IPv6 address + 2x port + protocol)     */
+#define HASH_KEY_MAX_LEN (2 * 16 + 2 * 2 + 1)
+
 /**
- * \brief Get a number of data records in a Data Set
+ * \brief Get a template of a Data Set
  * \param[in] msg IPFIX message
  * \param[in] header Pointer to Data set header
- * \return On error returns -1. Otherwise returns number of data records.
+ * \return On error returns NULL. Otherwise returns the template.
  */
-static int fwd_rec_cnt(const struct ipfix_message *msg,
+static struct ipfix_template *fwd_data_template(const struct ipfix_message *msg,
 	const struct ipfix_set_header *header)
 {
-	// Find template
-	int i;
-	struct ipfix_template *tmplt = NULL;
-
-	for (i = 0; i < MSG_MAX_DATA_COUPLES && msg->data_couple[i].data_set; ++i) {
+	for (int i = 0; i < MSG_MAX_DATA_COUPLES && msg->data_couple[i].data_set;
+			++i) {
 		if (&msg->data_couple[i].data_set->header != header) {
 			continue;
 		}
 
 		// Couple found
-		tmplt = msg->data_couple[i].data_template;
-		break;
+		return msg->data_couple[i].data_template;
 	}
 
+	// Unknown template
+	return NULL;
+}
+
+/**
+ * \brief Get a number of data records in a Data Set
+ * \param[in] msg IPFIX message
+ * \param[in] header Pointer to Data set header
+ * \return On error returns -1. Otherwise returns number of data records.
+ */
+static int fwd_rec_cnt(const struct ipfix_message *msg,
+	const struct ipfix_set_header *header)
+{
+	struct ipfix_template *tmplt = fwd_data_template(msg, header);
 	if (!tmplt) {
 		// Unknown template
 		return -1;
 	}
 
 	// Get number of records
-	return data_set_records_count(msg->data_couple[i].data_set, tmplt);
+	// WARNING: const -> non const (ugly)
+	return data_set_records_count((struct ipfix_data_set *) header, tmplt);
+}
+
+/**
+ * \brief Get packet builders for templates and data
+ *
+ * The hash distribution model prepares packets for each destination
+ * separately. Other models use only one builder.
+ * \param[in]  cfg Plugin configuration
+ * \param[out] cnt Number of builders
+ * \return Array of builders
+ */
+static fwd_bldr_t **fwd_builders(struct plugin_config *cfg, size_t *cnt)
+{
+	if (cfg->mode == DIST_HASH) {
+		*cnt = cfg->builder_hash_cnt;
+		return cfg->builder_hash;
+	}
+
+	*cnt = 1;
+	return &cfg->builder_all;
 }
 
 /**
@@ -152,9 +187,14 @@ static void fwd_process_template_func(uint8_t *rec, int rec_len, void *data)
 	}
 
 	// Only "TMAPPER_ACT_PASS" can get here
-	int ret_all, ret_tmplt;
-	ret_all = bldr_add_template(ctx->cfg->builder_all, rec, rec_len, new_id,
-		ctx->type);
+	int ret_all = 0, ret_tmplt;
+	size_t bldr_cnt;
+	fwd_bldr_t **bldrs = fwd_builders(ctx->cfg, &bldr_cnt);
+
+	for (size_t i = 0; i < bldr_cnt; ++i) {
+		ret_all |= bldr_add_template(bldrs[i], rec, rec_len, new_id,
+			ctx->type);
+	}
 	ret_tmplt = bldr_add_template(ctx->cfg->builder_tmplt, rec, rec_len, new_id,
 		ctx->type);
 
@@ -203,6 +243,229 @@ static int fwd_process_template_set(struct plugin_config *cfg,
 	return (ctx.fail) ? 1 : 0;
 }
 
+/**
+ * \brief Auxiliary structure for splitting of a Data Set by flow keys
+ */
+struct split_ctx {
+	/** A configuration of the plugin (builders, destinations, etc.)     */
+	struct plugin_config *cfg;
+	/** New Flowset ID of the records                                    */
+	uint16_t new_id;
+	/** Status flag                                                      */
+	bool fail;
+};
+
+/**
+ * \brief Get IP addresses of a data record
+ * \param[in]  rec     Data record
+ * \param[in]  tmplt   Template of the record
+ * \param[out] src     Source address (or NULL)
+ * \param[out] src_len Length of the source address
+ * \param[out] dst     Destination address (or NULL)
+ * \param[out] dst_len Length of the destination address
+ */
+static void fwd_hash_addrs(uint8_t *rec, struct ipfix_template *tmplt,
+	uint8_t **src, int *src_len, uint8_t **dst, int *dst_len)
+{
+	// sourceIPv4Address, sourceIPv6Address
+	*src = data_record_get_field(rec, tmplt, 0, 8, src_len);
+	if (!*src) {
+		*src = data_record_get_field(rec, tmplt, 0, 27, src_len);
+	}
+
+	// destinationIPv4Address, destinationIPv6Address
+	*dst = data_record_get_field(rec, tmplt, 0, 12, dst_len);
+	if (!*dst) {
+		*dst = data_record_get_field(rec, tmplt, 0, 28, dst_len);
+	}
+
+	if (!*src || *src_len > 16) {
+		*src = NULL;
+		*src_len = 0;
+	}
+
+	if (!*dst || *dst_len > 16) {
+		*dst = NULL;
+		*dst_len = 0;
+	}
+}
+
+/**
+ * \brief Compare two endpoints of a flow
+ * \return Same as memcmp()
+ */
+static int fwd_hash_endpoint_cmp(const uint8_t *a_addr, int a_len,
+	const uint8_t *a_port, const uint8_t *b_addr, int b_len,
+	const uint8_t *b_port)
+{
+	if (a_len != b_len) {
+		return (a_len < b_len) ? -1 : 1;
+	}
+
+	int ret = (a_len > 0) ? memcmp(a_addr, b_addr, a_len) : 0;
+	if (ret != 0 || !a_port || !b_port) {
+		return ret;
+	}
+
+	return memcmp(a_port, b_port, 2);
+}
+
+/**
+ * \brief Calculate a hash value of a flow key of a data record
+ *
+ * Keys of both directions of a conversation (i.e. "hosts" and "flow") are
+ * the same, because endpoints are always stored in the same order.
+ * \param[in] type  Flow key
+ * \param[in] rec   Data record
+ * \param[in] tmplt Template of the record
+ * \return Hash value
+ */
+static uint32_t fwd_hash_record(enum HASH_KEY type, uint8_t *rec,
+	struct ipfix_template *tmplt)
+{
+	uint8_t key[HASH_KEY_MAX_LEN];
+	size_t key_len = 0;
+
+	uint8_t *src, *dst;
+	int src_len, dst_len;
+	fwd_hash_addrs(rec, tmplt, &src, &src_len, &dst, &dst_len);
+
+	switch (type) {
+	case HASH_KEY_SRC_IP:
+		if (src) {
+			memcpy(key, src, src_len);
+			key_len = src_len;
+		}
+		break;
+	case HASH_KEY_DST_IP:
+		if (dst) {
+			memcpy(key, dst, dst_len);
+			key_len = dst_len;
+		}
+		break;
+	case HASH_KEY_HOSTS:
+	case HASH_KEY_FLOW: {
+		uint8_t *src_port = NULL, *dst_port = NULL, *proto = NULL;
+		int len;
+
+		if (type == HASH_KEY_FLOW) {
+			// sourceTransportPort, destinationTransportPort, protocolIdentifier
+			src_port = data_record_get_field(rec, tmplt, 0, 7, &len);
+			src_port = (src_port && len == 2) ? src_port : NULL;
+			dst_port = data_record_get_field(rec, tmplt, 0, 11, &len);
+			dst_port = (dst_port && len == 2) ? dst_port : NULL;
+			proto = data_record_get_field(rec, tmplt, 0, 4, &len);
+			proto = (proto && len == 1) ? proto : NULL;
+		}
+
+		// Store endpoints in the same order for both directions
+		if (fwd_hash_endpoint_cmp(src, src_len, src_port, dst, dst_len,
+				dst_port) > 0) {
+			uint8_t *tmp_ptr;
+			int tmp_len;
+
+			tmp_ptr = src; src = dst; dst = tmp_ptr;
+			tmp_ptr = src_port; src_port = dst_port; dst_port = tmp_ptr;
+			tmp_len = src_len; src_len = dst_len; dst_len = tmp_len;
+		}
+
+		if (src) {
+			memcpy(&key[key_len], src, src_len);
+			key_len += src_len;
+		}
+		if (src_port) {
+			memcpy(&key[key_len], src_port, 2);
+			key_len += 2;
+		}
+		if (dst) {
+			memcpy(&key[key_len], dst, dst_len);
+			key_len += dst_len;
+		}
+		if (dst_port) {
+			memcpy(&key[key_len], dst_port, 2);
+			key_len += 2;
+		}
+		if (proto) {
+			key[key_len++] = *proto;
+		}
+		}
+		break;
+	default:
+		break;
+	}
+
+	return dest_hash_data(key, key_len);
+}
+
+/**
+ * \brief Add a one data record to the packet builder of its destination
+ * \remark This is a function for a callback
+ * \param[in]     rec     Data record
+ * \param[in]     rec_len A length of the record
+ * \param[in]     tmplt   Template of the record
+ * \param[in,out] data    Splitting context
+ */
+static void fwd_split_record_func(uint8_t *rec, int rec_len,
+	struct ipfix_template *tmplt, void *data)
+{
+	struct split_ctx *ctx = (struct split_ctx *) data;
+	struct plugin_config *cfg = ctx->cfg;
+
+	if (ctx->fail) {
+		return;
+	}
+
+	if (tmplt->template_type == TM_OPTIONS_TEMPLATE) {
+		// Options records (statistics, etc.) are not flows -> everyone
+		for (size_t i = 0; i < cfg->builder_hash_cnt; ++i) {
+			if (bldr_add_data_record(cfg->builder_hash[i], rec, rec_len,
+					ctx->new_id)) {
+				ctx->fail = true;
+				return;
+			}
+		}
+
+		return;
+	}
+
+	uint32_t hash = fwd_hash_record(cfg->hash_key, rec, tmplt);
+	int slot = dest_hash_lookup(cfg->dest_mgr, hash);
+	if (slot < 0) {
+		// No connected destination
+		return;
+	}
+
+	if (bldr_add_data_record(cfg->builder_hash[slot], rec, rec_len,
+			ctx->new_id)) {
+		ctx->fail = true;
+	}
+}
+
+/**
+ * \brief Split a Data Set into packet builders of destinations by flow keys
+ * \param[in,out] cfg    Configuration of the plugin
+ * \param[in]     msg    IPFIX packet which belongs to the Data Set
+ * \param[in]     header Header of the Data Set
+ * \param[in]     new_id New Flowset ID of the Data Set
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+static int fwd_split_data_set(struct plugin_config *cfg,
+	const struct ipfix_message *msg, const struct ipfix_set_header *header,
+	uint16_t new_id)
+{
+	struct ipfix_template *tmplt = fwd_data_template(msg, header);
+	if (!tmplt) {
+		return 1;
+	}
+
+	// WARNING: const -> non const (ugly)
+	struct ipfix_data_set *set = (struct ipfix_data_set *) header;
+	struct split_ctx ctx = {cfg, new_id, false};
+
+	data_set_process_records(set, tmplt, fwd_split_record_func, &ctx);
+	return (ctx.fail) ? 1 : 0;
+}
+
 /**
  * \brief Process and add a Data Set to the Packet builder
  * \param[in,out] cfg    Configuration of the plugin
@@ -252,6 +515,11 @@ static int fwd_process_data_set(struct plugin_config *cfg,
 		return 0;
 	}
 
+	if (cfg->mode == DIST_HASH) {
+		// Each record to the destination of its flow
+		return fwd_split_data_set(cfg, msg, header, new_id);
+	}
+
 	const struct ipfix_data_set *data_set;
 	data_set = (const struct ipfix_data_set *) header;
 
@@ -278,6 +546,8 @@ static int fwd_process_withdrawals(struct plugin_config *cfg, uint32_t odid,
 	uint16_t  ids_cnt;
 	uint16_t *ids_data;
 	int ret_all, ret_tmplt;
+	size_t bldr_cnt;
+	fwd_bldr_t **bldrs = fwd_builders(cfg, &bldr_cnt);
 
 	ids_data = tmapper_withdraw_ids(cfg->tmplt_mgr, odid, type, &ids_cnt);
 	if (!ids_data) {
@@ -286,7 +556,10 @@ static int fwd_process_withdrawals(struct plugin_config *cfg, uint32_t odid,
 
 	for (unsigned int i = 0; i < ids_cnt; ++i) {
 		const uint16_t id = ids_data[i];
-		ret_all =   bldr_add_template_withdrawal(cfg->builder_all,   id, type);
+		ret_all = 0;
+		for (size_t j = 0; j < bldr_cnt; ++j) {
+			ret_all |= bldr_add_template_withdrawal(bldrs[j], id, type);
+		}
 		ret_tmplt = bldr_add_template_withdrawal(cfg->builder_tmplt, id, type);
 
 		if (ret_all != 0 || ret_tmplt != 0) {
@@ -371,10 +644,20 @@ static int fwd_parse_msg(struct plugin_config *cfg,
 	// Prepare internal structures of packet builder for a new packet(s)
 	uint32_t pkt_odid = ntohl(msg->pkt_header->observation_domain_id);
 	uint32_t pkt_exp_time = ntohl(msg->pkt_header->export_time);
-	bldr_start(cfg->builder_all, pkt_odid, pkt_exp_time);
+	size_t bldr_cnt;
+	fwd_bldr_t **bldrs = fwd_builders(cfg, &bldr_cnt);
+
+	for (size_t i = 0; i < bldr_cnt; ++i) {
+		bldr_start(bldrs[i], pkt_odid, pkt_exp_time);
+	}
 	bldr_start(cfg->builder_tmplt, pkt_odid, pkt_exp_time);
 	bool any_templates = false;
 
+	if (cfg->mode == DIST_HASH) {
+		// Records are mapped only to connected destinations
+		dest_hash_refresh(cfg->dest_mgr);
+	}
+
 	// Process IPFIX message
 	uint8_t *pos = ((uint8_t *) msg->pkt_header) + IPFIX_HEADER_LENGTH;
 	uint16_t pkt_len = ntohs(msg->pkt_header->length);
@@ -427,8 +710,10 @@ static int fwd_parse_msg(struct plugin_config *cfg,
 	}
 
 	// Generate packets
-	if (bldr_end(cfg->builder_all, cfg->packet_size)) {
-		return 1;
+	for (size_t i = 0; i < bldr_cnt; ++i) {
+		if (bldr_end(bldrs[i], cfg->packet_size)) {
+			return 1;
+		}
 	}
 
 	if (bldr_end(cfg->builder_tmplt, cfg->packet_size)) {
@@ -501,7 +786,12 @@ int store_packet (void *config, const struct ipfix_message *ipfix_msg,
 	}
 
 	// Send new message(s)
-	dest_send(cfg->dest_mgr, cfg->builder_all, cfg->builder_tmplt, cfg->mode);
+	if (cfg->mode == DIST_HASH) {
+		dest_send_hash(cfg->dest_mgr, cfg->builder_hash, cfg->builder_tmplt);
+	} else {
+		dest_send(cfg->dest_mgr, cfg->builder_all, cfg->builder_tmplt,
+			cfg->mode);
+	}
 	return 0;
 }
 
@@ -65,12 +65,19 @@ static const char *msg_module = "forwarding(packet)";
  */
 #define TMPLT_SET_MAX_LEN (512)
 
+/**
+ * Maximal size of a Data Set assembled from separate data records (in bytes).
+ * Smaller sets allow to split the records into packets more precisely.
+ */
+#define DATA_SET_MAX_LEN  (1024)
+
 /**
  * \brief Type of the last IPFIX set inserted to the Packet builder
  */
 enum FLOW_SET_TYPE {
 	FST_NONE,                /**< Nothing inserted yet                */
 	FST_DATA,                /**< Data Set                            */
+	FST_DATA_REC,            /**< Data Set (assembled from records)   */
 	FST_TMPLT,               /**< Template Set (new templates)        */
 	FST_TMPLT_WITHDRAW,      /**< Template Set (withdrawal)           */
 	FST_OPT_TMPLT,           /**< Options Template Set (new templates)*/
@@ -865,6 +872,47 @@ int bldr_pkts_iovec(fwd_bldr_t *pkt, uint32_t seq_num,
 	return 0;
 }
 
+/* Get a packet defined by index as a list of parts and a separate header */
+int bldr_pkts_parts(fwd_bldr_t *pkt, uint32_t seq_num, size_t idx,
+	struct ipfix_header *header, struct iovec **io, size_t *size,
+	size_t *rec_cnt)
+{
+	if (!pkt->is_complete) {
+		// Internal structure not prepared
+		return 1;
+	}
+
+	struct packet_parts *parts = pkt->part_all;
+	if (idx >= parts->pkt_size) {
+		// Out of range
+		return 1;
+	}
+
+	struct packet_range *range = parts->pkt_arr[idx];
+	// Recover the last value from a backup (just for sure)
+	range->start[range->size - 1] = range->backup;
+
+	// Get total length
+	size_t total_len = IPFIX_HEADER_LENGTH;
+	for (size_t i = 1; i < range->size; ++i) {
+		total_len += range->start[i].iov_len;
+	}
+
+	/*
+	 * The header is stored into the user's memory, therefore the reserved
+	 * first position of the range is not touched and the parts of other
+	 * packets stay valid.
+	 */
+	*header = pkt->packet_header;
+	header->length = htons(total_len);
+	header->sequence_number = htonl(seq_num);
+
+	*io = &range->start[1];
+	*size = range->size - 1;
+	*rec_cnt = range->rec_cnt;
+	return 0;
+}
+
 /* Add a Data set */
 int bldr_add_dataset(fwd_bldr_t *pkt, const struct ipfix_data_set *data,
 	uint16_t new_id, unsigned int rec)
@@ -906,6 +954,62 @@ int bldr_add_dataset(fwd_bldr_t *pkt, const struct ipfix_data_set *data,
 	return 0;
 }
 
+/* Add a Data record */
+int bldr_add_data_record(fwd_bldr_t *pkt, const void *rec, size_t len,
+	uint16_t new_id)
+{
+	struct packet_parts *parts = pkt->part_all;
+	if (parts->insert_lock) {
+		return 1;
+	}
+
+	if (len == 0 || len + HEADER_SIZE > UINT16_MAX) {
+		return 1;
+	}
+
+	/*
+	 * Add a new header of a Data Set or use a previous Set with the same
+	 * Template ID and just update its header.
+	 */
+	struct ipfix_set_header *header = parts->last_set_header;
+	bool new_set = true;
+	if (parts->last_set_type == FST_DATA_REC
+			&& ntohs(header->flowset_id) == new_id
+			&& ntohs(header->length) + len <= DATA_SET_MAX_LEN) {
+		new_set = false;
+	}
+
+	if (new_set) {
+		header = arr_new(pkt->headers);
+		if (!header) {
+			return 1;
+		}
+
+		header->flowset_id = htons(new_id);
+		header->length = htons(HEADER_SIZE);
+
+		if (parts_insert(parts, header, HEADER_SIZE, true, 0)) {
+			return 1;
+		}
+
+		parts->last_set_type = FST_DATA_REC;
+		parts->last_set_header = header;
+	}
+
+	// Consecutive records of the original Data Set share one part
+	struct iovec *last = &parts->rec_flds[parts->rec_size - 1];
+	if (!new_set && ((const uint8_t *) last->iov_base) + last->iov_len
+			== (const uint8_t *) rec) {
+		last->iov_len += len;
+		parts->rec_cnt[parts->rec_size - 1]++;
+	} else if (parts_insert(parts, rec, len, false, 1)) {
+		return 1;
+	}
+
+	header->length = htons(ntohs(header->length) + len);
+	return 0;
+}
+
 /**
  * \brief Create and add a header of a (Options) Template Set
  * \param[in,out] pkt Packet builder
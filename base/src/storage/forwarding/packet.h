@@ -75,6 +75,7 @@
  *   -# bldr_start()
  *   -# repeate N times:
  *      - bldr_add_dataset()
+ *      - bldr_add_data_record()
  *      - bldr_add_template()
  *      - bldr_add_template_withdrawal()
  *   -# bldr_end()
@@ -82,6 +83,7 @@
  *     - bldr_pkts_cnt()
  *     - bldr_pkts_raw()
  *     - bldr_pkts_iovec()
+ *     - bldr_pkts_parts()
  *     - bldr_pkts_get_odid()
  *   -# New message? Go to the 2. step
  *   -# bldr_destroy()
@@ -138,6 +140,23 @@ int bldr_end(fwd_bldr_t *pkt, uint16_t len);
 int bldr_add_dataset(fwd_bldr_t *pkt, const struct ipfix_data_set *data,
 	uint16_t new_id, unsigned int rec);
 
+/**
+ * \brief Add a Data record
+ *
+ * Records are grouped into Data Sets with the Flowset ID \p new_id. A new Data
+ * Set is started when the previous inserted part is not a Data record with
+ * the same ID or the Set would be too long. Records that directly follow each
+ * other in memory are merged into one part of the packet.
+ * \param[in,out] pkt Packet builder
+ * \param[in] rec    Pointer to the Data record
+ * \param[in] len    Size of the record
+ * \param[in] new_id Flowset ID of the Data Set (>= 256)
+ * \return On success returns 0. Otherwise returns non-zero value and the
+ *   content of the builder is undefined until calling function bldr_start().
+ */
+int bldr_add_data_record(fwd_bldr_t *pkt, const void *rec, size_t len,
+	uint16_t new_id);
+
 /**
  * \brief Add a template
  *
@@ -210,6 +229,28 @@ int bldr_pkts_raw(fwd_bldr_t *pkt, uint32_t seq_num, size_t idx, size_t offset,
 int bldr_pkts_iovec(fwd_bldr_t *pkt, uint32_t seq_num, size_t idx,
 	struct iovec **io, size_t *size, size_t *rec_cnt);
 
+/**
+ * \brief Get a packet defined by index with a header in user's memory
+ *
+ * Unlike bldr_pkts_iovec(), parts of the packet do not include the IPFIX
+ * header. The header is stored into \p header instead, therefore parts of
+ * more packets of the same builder can be used at the same time (e.g. for
+ * sending a batch of packets).
+ * \param[in,out] pkt  Packet builder
+ * \param[in]  seq_num Sequence number of the packet
+ * \param[in]  idx     Index of the packet i.e. idx < bldr_pkts_cnt()
+ * \param[out] header  IPFIX header of the packet
+ * \param[out] io      Array of packet parts (without the header)
+ * \param[out] size    Number of parts
+ * \param[out] rec_cnt Number of data records in the packet
+ * \return On success returns 0. Otherwise returns non-zero value.
+ * \warning Parts are valid only until bldr_pkts_iovec() or bldr_pkts_raw() is
+ *   called.
+ */
+int bldr_pkts_parts(fwd_bldr_t *pkt, uint32_t seq_num, size_t idx,
+	struct ipfix_header *header, struct iovec **io, size_t *size,
+	size_t *rec_cnt);
+
 #endif // PACKET_H
 
 /**@}*/
@@ -37,6 +37,7 @@
  *
  */
 
+#define _GNU_SOURCE // sendmmsg()
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
@@ -54,6 +55,8 @@
 #define SOCKET_INVALID (-1)
 /** Maximum size of internal buffer (2^19) */
 #define BUFFER_SIZE (524288)
+/** Maximum number of parts/messages per one system call (see UIO_MAXIOV) */
+#define BATCH_MAX (1024)
 
 /** Module description */
 static const char *msg_module = "forwarding(sender)";
@@ -70,6 +73,9 @@ struct _fwd_sender {
 
 	uint8_t *buffer_data; /**< Buffer for unsent parts of messsages */
 	size_t buffer_valid;  /**< Valid part of the buffer             */
+
+	struct mmsghdr *mmsg; /**< Message headers for sendmmsg()       */
+	size_t mmsg_max;      /**< Size of the array of headers         */
 };
 
 /**
@@ -174,6 +180,7 @@ void sender_destroy(fwd_sender_t *s)
 	free(s->dst_addr);
 	free(s->dst_port);
 	free(s->buffer_data);
+	free(s->mmsg);
 
 	// Socket
 	sender_socket_close(s);
@@ -616,3 +623,171 @@ before_sendmsg:
 
 	return STATUS_OK;
 }
+
+/**
+ * \brief Send a batch of TCP packets
+ *
+ * Parts of consecutive packets are passed to the socket at once, so the kernel
+ * can coalesce them into as few segments as possible.
+ * \param[in,out] s Sender structure
+ * \param[in] pkts Array of packets (parts stored consecutively)
+ * \param[in] cnt Number of packets
+ * \param[in] mode Mode of sending operation
+ * \param[in] required Required delivery of the first packet
+ * \return Status of the operation
+ */
+static enum SEND_STATUS sender_send_gather(fwd_sender_t *s,
+	struct sender_pkt *pkts, size_t cnt, enum SEND_MODE mode, bool required)
+{
+	enum SEND_STATUS stat;
+	size_t idx = 0;
+
+	while (idx < cnt) {
+		// Take as many packets as possible
+		struct iovec *io = pkts[idx].io;
+		size_t parts = 0;
+
+		while (idx < cnt && (parts == 0
+				|| parts + pkts[idx].parts <= BATCH_MAX)) {
+			parts += pkts[idx].parts;
+			++idx;
+		}
+
+		stat = sender_send_parts(s, io, parts, mode, required);
+		if (stat != STATUS_OK) {
+			return stat;
+		}
+
+		required = true; // Remaining packets are always required
+	}
+
+	return STATUS_OK;
+}
+
+/**
+ * \brief Send a batch of packets one by one
+ * \param[in,out] s Sender structure
+ * \param[in] pkts Array of packets
+ * \param[in] cnt Number of packets
+ * \param[in] mode Mode of sending operation
+ * \param[in] required Required delivery of the first packet
+ * \return Status of the operation
+ */
+static enum SEND_STATUS sender_send_each(fwd_sender_t *s,
+	struct sender_pkt *pkts, size_t cnt, enum SEND_MODE mode, bool required)
+{
+	enum SEND_STATUS stat;
+
+	for (size_t i = 0; i < cnt; ++i) {
+		stat = sender_send_parts(s, pkts[i].io, pkts[i].parts, mode, required);
+		if (stat != STATUS_OK) {
+			return stat;
+		}
+
+		required = true; // Remaining packets are always required
+	}
+
+	return STATUS_OK;
+}
+
+/**
+ * \brief Send a batch of UDP packets
+ *
+ * Each packet is one datagram. All datagrams are passed to the kernel by
+ * sendmmsg(). If the socket would block, remaining datagrams are processed in
+ * the same way as by sender_send_parts().
+ * \param[in,out] s Sender structure
+ * \param[in] pkts Array of packets
+ * \param[in] cnt Number of packets
+ * \param[in] mode Mode of sending operation
+ * \param[in] required Required delivery of the first packet
+ * \return Status of the operation
+ */
+static enum SEND_STATUS sender_send_mmsg(fwd_sender_t *s,
+	struct sender_pkt *pkts, size_t cnt, enum SEND_MODE mode, bool required)
+{
+	if (s->socket_fd == SOCKET_INVALID) {
+		return STATUS_CLOSED;
+	}
+
+	if (s->buffer_valid > 0 || cnt == 1) {
+		// The order of data in the buffer must be preserved
+		return sender_send_each(s, pkts, cnt, mode, required);
+	}
+
+	// Prepare message headers
+	if (s->mmsg_max < cnt) {
+		struct mmsghdr *new_arr;
+		new_arr = realloc(s->mmsg, cnt * sizeof(*new_arr));
+		if (!new_arr) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+				__FILE__, __LINE__);
+			return sender_send_each(s, pkts, cnt, mode, required);
+		}
+
+		s->mmsg = new_arr;
+		s->mmsg_max = cnt;
+	}
+
+	memset(s->mmsg, 0, cnt * sizeof(*s->mmsg));
+	for (size_t i = 0; i < cnt; ++i) {
+		s->mmsg[i].msg_hdr.msg_iov = pkts[i].io;
+		s->mmsg[i].msg_hdr.msg_iovlen = pkts[i].parts;
+	}
+
+	int flags = MSG_NOSIGNAL; // Never use signals
+	flags |= (mode == MODE_NON_BLOCKING) ? MSG_DONTWAIT : 0;
+
+	size_t done = 0;
+	while (done < cnt) {
+		size_t todo = cnt - done;
+		if (todo > BATCH_MAX) {
+			todo = BATCH_MAX;
+		}
+
+		int ret = sendmmsg(s->socket_fd, &s->mmsg[done], todo, flags);
+		if (ret > 0) {
+			done += (size_t) ret;
+			continue;
+		}
+
+		if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			// Unexpected type of error
+			MSG_WARNING(msg_module, "Connection to \"%s:%s\" closed (%s).",
+				s->dst_addr, s->dst_port, strerror(errno));
+			sender_socket_close(s);
+			return STATUS_CLOSED;
+		}
+
+		// Operation would block
+		if (mode == MODE_BLOCKING) {
+			continue;
+		}
+
+		// Only non-blocking mode can get here
+		if (done == 0 && !required) {
+			// Nothing sent & not required data -> skip
+			return STATUS_BUSY;
+		}
+
+		// Required data or partially sent -> the rest one by one
+		return sender_send_each(s, &pkts[done], cnt - done, mode, true);
+	}
+
+	return STATUS_OK;
+}
+
+/** Send a batch of packets to the destination */
+enum SEND_STATUS sender_send_batch(fwd_sender_t *s, struct sender_pkt *pkts,
+	size_t cnt, enum SEND_MODE mode, bool required)
+{
+	if (cnt == 0) {
+		return STATUS_OK;
+	}
+
+	if (s->proto == IPPROTO_UDP) {
+		return sender_send_mmsg(s, pkts, cnt, mode, required);
+	}
+
+	return sender_send_gather(s, pkts, cnt, mode, required);
+}
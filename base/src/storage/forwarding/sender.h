@@ -65,6 +65,12 @@ enum SEND_STATUS {
 	STATUS_CLOSED     /**< Socket is closed or broken. Use sender_connect(). */
 };
 
+/** \brief One packet of a batch (see sender_send_batch())                 */
+struct sender_pkt {
+	struct iovec *io;     /**< Parts of the packet                           */
+	size_t parts;         /**< Number of parts                               */
+};
+
 /* Prototypes */
 typedef struct _fwd_sender fwd_sender_t;
 
@@ -159,6 +165,29 @@ enum SEND_STATUS sender_send(fwd_sender_t *s, const void *buf, size_t len,
 enum SEND_STATUS sender_send_parts(fwd_sender_t *s, struct iovec *io,
 	size_t parts, enum SEND_MODE mode, bool required);
 
+/**
+ * \brief Send a batch of packets to the destination
+ *
+ * UDP packets are passed to the kernel by a single sendmmsg() call. Parts of
+ * TCP packets are coalesced and written by a single gathering call.
+ * Therefore parts of all packets MUST be stored consecutively in one array
+ * i.e. the parts of the packet \p pkts[i + 1] directly follow the parts of
+ * the packet \p pkts[i].
+ *
+ * The flag \p required has the same meaning as in sender_send_parts(), but
+ * it is related to the first packet only. When the first packet is (at least
+ * partially) sent, the remaining packets are always required. In other words,
+ * STATUS_BUSY means that nothing was sent.
+ * \param[in,out] s Sender structure
+ * \param[in] pkts Array of packets
+ * \param[in] cnt Number of packets
+ * \param[in] mode Mode of sending operation
+ * \param[in] required Required delivery
+ * \return Status of the operation
+ */
+enum SEND_STATUS sender_send_batch(fwd_sender_t *s, struct sender_pkt *pkts,
+	size_t cnt, enum SEND_MODE mode, bool required);
+
 #endif // SENDER_H
 
 /**@}*/
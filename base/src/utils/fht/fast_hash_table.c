@@ -42,7 +42,7 @@
  *
  */
 
-#include "fast_hash_table.h"
+#include <ipfixcol/fast_hash_table.h>
 #include "hashes.h"
 
 #include <stdlib.h>
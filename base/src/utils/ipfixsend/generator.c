@@ -0,0 +1,907 @@
+/**
+ * \file ipfixsend/generator.c
+ * \brief Multi-threaded high-rate traffic generator
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+
+#include <ipfixcol.h>
+
+#include "ipfixsend.h"
+#include "generator.h"
+
+/** Set ID of template and options template sets */
+#define GEN_TEMPLATE_SET_ID 2
+#define GEN_OPT_TEMPLATE_SET_ID 3
+/** Minimal ID of data set (and template) */
+#define GEN_MIN_DATA_SET_ID 256
+/** Number of usable Template IDs */
+#define GEN_TEMPLATE_IDS (65536 - GEN_MIN_DATA_SET_ID)
+/** Field length of variable-length fields */
+#define GEN_VAR_LENGTH 65535
+
+/** Send buffer size of exporter sockets */
+#define GEN_SNDBUF (4 * 1024 * 1024)
+/** Waits shorter than this are done by spinning (ns) */
+#define GEN_SPIN_NS 100000L
+/** Timeout for waiting until queued messages are sent (ns) */
+#define GEN_FLUSHER_TIME 100000000L
+
+// 1 second in nanoseconds
+#define NANO_SEC 1000000000L
+
+/** Template known from the input file (used to count data records) */
+struct gen_template {
+	uint32_t odid;           /**< Original Observation Domain ID */
+	uint16_t id;             /**< Template ID                    */
+	uint16_t field_cnt;      /**< Number of fields               */
+	uint16_t *lengths;       /**< Lengths of fields              */
+	uint32_t length;         /**< Length of fixed-length fields  */
+	bool variable;           /**< Has variable-length fields     */
+};
+
+/** Preprocessed packet of the input file */
+struct gen_packet {
+	const uint8_t *data;     /**< Original packet                    */
+	uint16_t length;         /**< Length of the packet               */
+	uint16_t odid_idx;       /**< Index of the original ODID         */
+	uint32_t records;        /**< Number of data records             */
+	size_t tid_first;        /**< First offset of Template ID        */
+	size_t tid_cnt;          /**< Number of Template IDs             */
+};
+
+/** Preprocessed input file shared by all sender threads */
+struct gen_file {
+	struct gen_packet *packets; /**< Packets                            */
+	size_t packet_cnt;          /**< Number of packets                  */
+	uint16_t *tid_offsets;      /**< Offsets of Template IDs in packets */
+	size_t tid_cnt;             /**< Number of offsets                  */
+	uint32_t *odids;            /**< Original ODIDs                     */
+	uint16_t odid_cnt;          /**< Number of original ODIDs           */
+	uint32_t odid_span;         /**< Max. ODID - min. ODID + 1          */
+	uint16_t tid_span;          /**< Max. Template ID - 255             */
+	uint16_t max_length;        /**< Length of the longest packet       */
+
+	struct gen_template *templates; /**< Templates (preprocessing only)  */
+	size_t template_cnt;            /**< Number of templates             */
+};
+
+/** Simulated exporter */
+struct gen_exporter {
+	int fd;                  /**< Socket (own source port)         */
+	unsigned int id;         /**< Index of the exporter            */
+	size_t next;             /**< Index of the next packet         */
+	int loop;                /**< Number of finished replays       */
+	bool done;               /**< All replays finished             */
+	uint32_t *seq;           /**< Sequence numbers (per orig. ODID) */
+};
+
+/** Sender thread */
+struct gen_thread {
+	pthread_t thread;               /**< Thread                          */
+	const struct generator_cfg *cfg;/**< Configuration                   */
+	const struct gen_file *file;    /**< Input file                      */
+	struct gen_exporter **exporters;/**< Exporters of the thread         */
+	unsigned int exporter_cnt;      /**< Number of exporters             */
+
+	struct mmsghdr *msgs;           /**< Messages of the batch           */
+	struct iovec *iovs;             /**< Packets of the batch            */
+	uint8_t *buffers;               /**< Memory for packets of the batch */
+
+	double pkt_ns;                  /**< Time per packet (0 = unlimited) */
+	double next_ns;                 /**< Time of next sending            */
+	double burst_ns;                /**< Maximal saved time (burst)      */
+
+	uint64_t packets;               /**< Sent packets                    */
+	uint64_t bytes;                 /**< Sent bytes                      */
+	int error;                      /**< Thread failed                   */
+};
+
+static volatile int stop_generator = 0;
+
+void generator_stop()
+{
+	stop_generator = 1;
+}
+
+/**
+ * \brief Get monotonic time
+ * \return Time in nanoseconds
+ */
+static uint64_t gen_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * NANO_SEC + ts.tv_nsec;
+}
+
+/**
+ * \brief Read 16bit value in network byte order
+ */
+static inline uint16_t gen_get16(const uint8_t *ptr)
+{
+	uint16_t value;
+	memcpy(&value, ptr, sizeof(value));
+	return ntohs(value);
+}
+
+/**
+ * \brief Write 16bit value in network byte order
+ */
+static inline void gen_put16(uint8_t *ptr, uint16_t value)
+{
+	value = htons(value);
+	memcpy(ptr, &value, sizeof(value));
+}
+
+/**
+ * \brief Find template of the input file
+ * \param[in] file Input file
+ * \param[in] odid Observation Domain ID
+ * \param[in] id   Template ID
+ * \return Template or NULL
+ */
+static struct gen_template *gen_template_find(struct gen_file *file,
+	uint32_t odid, uint16_t id)
+{
+	size_t i;
+
+	for (i = 0; i < file->template_cnt; ++i) {
+		if (file->templates[i].odid == odid && file->templates[i].id == id) {
+			return &file->templates[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief Parse template record and store the template
+ *
+ * \param[in] file   Input file
+ * \param[in] odid   Observation Domain ID
+ * \param[in] rec    Template record
+ * \param[in] end    End of the set
+ * \param[in] hdr_len Length of the record header (4 or 6 for options)
+ * \return Length of the record, 0 on malformed record, -1 on memory error
+ */
+static int gen_template_parse(struct gen_file *file, uint32_t odid,
+	const uint8_t *rec, const uint8_t *end, int hdr_len)
+{
+	struct gen_template *tmpl, *new_templates;
+	const uint8_t *field;
+	uint16_t id = gen_get16(rec);
+	uint16_t field_cnt = gen_get16(rec + 2);
+	uint16_t i;
+
+	tmpl = gen_template_find(file, odid, id);
+	if (field_cnt == 0) {
+		/* Template withdrawal */
+		if (tmpl) {
+			free(tmpl->lengths);
+			*tmpl = file->templates[--file->template_cnt];
+		}
+		return 4;
+	}
+
+	if (rec + hdr_len > end) {
+		return 0;
+	}
+
+	if (!tmpl) {
+		new_templates = realloc(file->templates,
+			(file->template_cnt + 1) * sizeof(*new_templates));
+		if (!new_templates) {
+			ERR_MEM;
+			return -1;
+		}
+
+		file->templates = new_templates;
+		tmpl = &file->templates[file->template_cnt++];
+		memset(tmpl, 0, sizeof(*tmpl));
+		tmpl->odid = odid;
+		tmpl->id = id;
+	}
+
+	free(tmpl->lengths);
+	tmpl->lengths = malloc(field_cnt * sizeof(*tmpl->lengths));
+	if (!tmpl->lengths) {
+		ERR_MEM;
+		*tmpl = file->templates[--file->template_cnt];
+		return -1;
+	}
+
+	tmpl->field_cnt = field_cnt;
+	tmpl->length = 0;
+	tmpl->variable = false;
+
+	field = rec + hdr_len;
+	for (i = 0; i < field_cnt; ++i) {
+		if (field + 4 > end) {
+			return 0;
+		}
+
+		tmpl->lengths[i] = gen_get16(field + 2);
+		if (tmpl->lengths[i] == GEN_VAR_LENGTH) {
+			tmpl->variable = true;
+		} else {
+			tmpl->length += tmpl->lengths[i];
+		}
+
+		/* Enterprise number */
+		field += (gen_get16(field) & 0x8000) ? 8 : 4;
+	}
+
+	if (field > end) {
+		return 0;
+	}
+
+	return field - rec;
+}
+
+/**
+ * \brief Count data records in a data set
+ *
+ * \param[in] tmpl Template of the set (NULL when unknown)
+ * \param[in] data Data records
+ * \param[in] end  End of the set
+ * \return Number of records
+ */
+static uint32_t gen_records_count(const struct gen_template *tmpl,
+	const uint8_t *data, const uint8_t *end)
+{
+	uint32_t records = 0;
+	uint16_t i, length;
+
+	if (!tmpl) {
+		return 0;
+	}
+
+	if (!tmpl->variable) {
+		return tmpl->length ? (end - data) / tmpl->length : 0;
+	}
+
+	while (data < end) {
+		for (i = 0; i < tmpl->field_cnt; ++i) {
+			length = tmpl->lengths[i];
+			if (length == GEN_VAR_LENGTH) {
+				if (data >= end) {
+					return records;
+				}
+
+				length = *data++;
+				if (length == 255) {
+					if (data + 2 > end) {
+						return records;
+					}
+
+					length = gen_get16(data);
+					data += 2;
+				}
+			}
+
+			data += length;
+		}
+
+		if (data > end) {
+			break;
+		}
+
+		records++;
+	}
+
+	return records;
+}
+
+/**
+ * \brief Add offset of Template ID to rewrite
+ * \return 0 on success, nonzero on memory error
+ */
+static int gen_tid_add(struct gen_file *file, size_t *max, uint16_t offset,
+	uint16_t id)
+{
+	uint16_t *new_offsets;
+
+	if (file->tid_cnt == *max) {
+		*max = *max ? 2 * *max : 1024;
+		new_offsets = realloc(file->tid_offsets, *max * sizeof(*new_offsets));
+		if (!new_offsets) {
+			ERR_MEM;
+			return 1;
+		}
+
+		file->tid_offsets = new_offsets;
+	}
+
+	file->tid_offsets[file->tid_cnt++] = offset;
+	if (id - GEN_MIN_DATA_SET_ID + 1 > file->tid_span) {
+		file->tid_span = id - GEN_MIN_DATA_SET_ID + 1;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Preprocess packet of the input file
+ *
+ * Counts data records and finds Template IDs of sets and template records.
+ *
+ * \param[in] file   Input file
+ * \param[in] packet Packet
+ * \param[in,out] tid_max Allocated offsets
+ * \return 0 on success, nonzero on memory error
+ */
+static int gen_packet_parse(struct gen_file *file, struct gen_packet *packet,
+	size_t *tid_max)
+{
+	const struct ipfix_header *header = (const struct ipfix_header *) packet->data;
+	const uint8_t *set = packet->data + IPFIX_HEADER_LENGTH;
+	const uint8_t *packet_end = packet->data + packet->length;
+	const uint8_t *set_end, *rec;
+	uint32_t odid = ntohl(header->observation_domain_id);
+	uint16_t set_id, set_len;
+	int hdr_len, rec_len;
+
+	packet->tid_first = file->tid_cnt;
+
+	while (set + 4 <= packet_end) {
+		set_id = gen_get16(set);
+		set_len = gen_get16(set + 2);
+		if (set_len < 4 || set + set_len > packet_end) {
+			fprintf(stderr, "Malformed set in a packet, the rest of the packet "
+				"is not rewritten.\n");
+			break;
+		}
+
+		set_end = set + set_len;
+		if (set_id == GEN_TEMPLATE_SET_ID || set_id == GEN_OPT_TEMPLATE_SET_ID) {
+			hdr_len = (set_id == GEN_OPT_TEMPLATE_SET_ID) ? 6 : 4;
+			rec = set + 4;
+
+			/* Padding is shorter than a record header */
+			while (rec + 4 <= set_end && gen_get16(rec) >= GEN_MIN_DATA_SET_ID) {
+				if (gen_tid_add(file, tid_max, rec - packet->data, gen_get16(rec))) {
+					return 1;
+				}
+
+				rec_len = gen_template_parse(file, odid, rec, set_end, hdr_len);
+				if (rec_len < 0) {
+					return 1;
+				} else if (rec_len == 0) {
+					fprintf(stderr, "Malformed template record in a packet.\n");
+					break;
+				}
+
+				rec += rec_len;
+			}
+		} else if (set_id >= GEN_MIN_DATA_SET_ID) {
+			if (gen_tid_add(file, tid_max, set - packet->data, set_id)) {
+				return 1;
+			}
+
+			packet->records += gen_records_count(gen_template_find(file, odid, set_id),
+				set + 4, set_end);
+		}
+
+		set = set_end;
+	}
+
+	packet->tid_cnt = file->tid_cnt - packet->tid_first;
+	return 0;
+}
+
+/**
+ * \brief Free preprocessed input file
+ */
+static void gen_file_free(struct gen_file *file)
+{
+	size_t i;
+
+	for (i = 0; i < file->template_cnt; ++i) {
+		free(file->templates[i].lengths);
+	}
+
+	free(file->templates);
+	free(file->packets);
+	free(file->tid_offsets);
+	free(file->odids);
+}
+
+/**
+ * \brief Preprocess the input file
+ *
+ * \param[out] file    Preprocessed file
+ * \param[in]  packets Preloaded packets
+ * \return 0 on success, nonzero on error
+ */
+static int gen_file_init(struct gen_file *file, struct ipfix_header **packets)
+{
+	size_t i, tid_max = 0;
+	uint16_t j;
+	uint32_t odid, odid_min = UINT32_MAX, odid_max = 0;
+	uint32_t *new_odids;
+
+	memset(file, 0, sizeof(*file));
+	while (packets[file->packet_cnt]) {
+		file->packet_cnt++;
+	}
+
+	if (file->packet_cnt == 0) {
+		fprintf(stderr, "Input file is empty.\n");
+		return 1;
+	}
+
+	file->packets = calloc(file->packet_cnt, sizeof(*file->packets));
+	if (!file->packets) {
+		ERR_MEM;
+		return 1;
+	}
+
+	for (i = 0; i < file->packet_cnt; ++i) {
+		struct gen_packet *packet = &file->packets[i];
+
+		packet->data = (const uint8_t *) packets[i];
+		packet->length = ntohs(packets[i]->length);
+		if (packet->length > file->max_length) {
+			file->max_length = packet->length;
+		}
+
+		/* Index of the original ODID */
+		odid = ntohl(packets[i]->observation_domain_id);
+		for (j = 0; j < file->odid_cnt && file->odids[j] != odid; ++j);
+
+		if (j == file->odid_cnt) {
+			if (file->odid_cnt == UINT16_MAX) {
+				fprintf(stderr, "Too many Observation Domain IDs in the input file.\n");
+				gen_file_free(file);
+				return 1;
+			}
+
+			new_odids = realloc(file->odids, (file->odid_cnt + 1) * sizeof(*new_odids));
+			if (!new_odids) {
+				ERR_MEM;
+				gen_file_free(file);
+				return 1;
+			}
+
+			file->odids = new_odids;
+			file->odids[file->odid_cnt++] = odid;
+			odid_min = (odid < odid_min) ? odid : odid_min;
+			odid_max = (odid > odid_max) ? odid : odid_max;
+		}
+
+		packet->odid_idx = j;
+		if (gen_packet_parse(file, packet, &tid_max)) {
+			gen_file_free(file);
+			return 1;
+		}
+	}
+
+	file->odid_span = odid_max - odid_min + 1;
+	return 0;
+}
+
+/**
+ * \brief Create socket of an exporter connected to the collector
+ *
+ * \param[in] addr Address of the collector
+ * \return Socket or -1 on error
+ */
+static int gen_socket_create(const struct addrinfo *addr)
+{
+	int fd, sndbuf = GEN_SNDBUF;
+
+	fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to create socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (connect(fd, addr->ai_addr, addr->ai_addrlen) != 0) {
+		fprintf(stderr, "Unable to connect socket: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	/* Larger buffer is not necessary, ignore failure */
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	return fd;
+}
+
+/**
+ * \brief Wait until all queued messages of the socket are sent and close it
+ */
+static void gen_socket_close(int fd)
+{
+	int not_sent = 0;
+	struct timespec sleep_time = {0, GEN_FLUSHER_TIME};
+
+	while (!stop_generator && ioctl(fd, SIOCOUTQ, &not_sent) != -1 && not_sent > 0) {
+		nanosleep(&sleep_time, NULL);
+	}
+
+	close(fd);
+}
+
+/**
+ * \brief Copy next packet of the exporter into the batch and rewrite it
+ *
+ * \param[in] thread   Sender thread
+ * \param[in] exporter Exporter
+ * \param[in] iov      Packet of the batch
+ * \return 0 on success, nonzero when the exporter is done
+ */
+static int gen_packet_prepare(struct gen_thread *thread,
+	struct gen_exporter *exporter, struct iovec *iov)
+{
+	const struct gen_file *file = thread->file;
+	const struct gen_packet *packet;
+	struct ipfix_header *header;
+	uint8_t *data = iov->iov_base;
+	uint32_t shift, tid;
+	size_t i;
+
+	if (exporter->next == file->packet_cnt) {
+		exporter->next = 0;
+		exporter->loop++;
+	}
+
+	if (stop_generator || (thread->cfg->loops >= 0 && exporter->loop >= thread->cfg->loops)) {
+		exporter->done = true;
+		return 1;
+	}
+
+	packet = &file->packets[exporter->next++];
+	memcpy(data, packet->data, packet->length);
+	iov->iov_len = packet->length;
+
+	/* Exporter 0 keeps the original values */
+	header = (struct ipfix_header *) data;
+	header->observation_domain_id = htonl(ntohl(header->observation_domain_id)
+		+ exporter->id * file->odid_span);
+	header->sequence_number = htonl(exporter->seq[packet->odid_idx]);
+	exporter->seq[packet->odid_idx] += packet->records;
+
+	if (!thread->cfg->unique_templates || exporter->id == 0) {
+		return 0;
+	}
+
+	shift = (exporter->id * file->tid_span) % GEN_TEMPLATE_IDS;
+	for (i = packet->tid_first; i < packet->tid_first + packet->tid_cnt; ++i) {
+		tid = gen_get16(data + file->tid_offsets[i]) - GEN_MIN_DATA_SET_ID;
+		tid = (tid + shift) % GEN_TEMPLATE_IDS + GEN_MIN_DATA_SET_ID;
+		gen_put16(data + file->tid_offsets[i], tid);
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Wait for tokens to send packets
+ *
+ * Token bucket with rate of the thread and capacity of one batch. Long waits
+ * sleep, the rest is done by spinning to keep precise rate.
+ *
+ * \param[in] thread Sender thread
+ * \param[in] count  Number of packets
+ */
+static void gen_pace(struct gen_thread *thread, unsigned int count)
+{
+	uint64_t now = gen_now();
+	struct timespec sleep_time;
+	uint64_t wake;
+
+	if (thread->pkt_ns == 0) {
+		return;
+	}
+
+	if (thread->next_ns > now) {
+		if (thread->next_ns - now > GEN_SPIN_NS) {
+			wake = (uint64_t) thread->next_ns - GEN_SPIN_NS / 2;
+			sleep_time.tv_sec = wake / NANO_SEC;
+			sleep_time.tv_nsec = wake % NANO_SEC;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sleep_time, NULL);
+		}
+
+		while (gen_now() < thread->next_ns && !stop_generator);
+	} else if (now - thread->next_ns > thread->burst_ns) {
+		/* Tokens of idle time are limited by the bucket size */
+		thread->next_ns = now - thread->burst_ns;
+	}
+
+	thread->next_ns += count * thread->pkt_ns;
+}
+
+/**
+ * \brief Send batch of packets
+ *
+ * \param[in] thread Sender thread
+ * \param[in] fd     Socket of the exporter
+ * \param[in] count  Number of packets
+ * \return 0 on success, nonzero on error
+ */
+static int gen_send(struct gen_thread *thread, int fd, unsigned int count)
+{
+	unsigned int sent = 0, i;
+	int ret;
+
+	while (sent < count) {
+		ret = sendmmsg(fd, thread->msgs + sent, count - sent, 0);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				if (stop_generator) {
+					break;
+				}
+				continue;
+			} else if (errno == ECONNREFUSED) {
+				/* Collector is not listening (yet), error is reported once */
+				continue;
+			}
+
+			fprintf(stderr, "Network error: %s\n", strerror(errno));
+			return 1;
+		}
+
+		for (i = sent; i < sent + ret; ++i) {
+			thread->bytes += thread->iovs[i].iov_len;
+		}
+
+		sent += ret;
+	}
+
+	thread->packets += sent;
+	return 0;
+}
+
+/**
+ * \brief Sender thread
+ *
+ * Exporters of the thread send batches in round robin.
+ */
+static void *gen_thread_run(void *arg)
+{
+	struct gen_thread *thread = (struct gen_thread *) arg;
+	struct gen_exporter *exporter;
+	unsigned int active = thread->exporter_cnt;
+	unsigned int i, count;
+
+	thread->next_ns = gen_now();
+
+	while (active > 0 && !stop_generator) {
+		for (i = 0; i < thread->exporter_cnt && !stop_generator; ++i) {
+			exporter = thread->exporters[i];
+			if (exporter->done) {
+				continue;
+			}
+
+			for (count = 0; count < thread->cfg->batch; ++count) {
+				if (gen_packet_prepare(thread, exporter, &thread->iovs[count])) {
+					active--;
+					break;
+				}
+			}
+
+			if (count == 0) {
+				continue;
+			}
+
+			gen_pace(thread, count);
+			if (gen_send(thread, exporter->fd, count)) {
+				thread->error = 1;
+				return NULL;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * \brief Prepare batch buffers of the thread
+ * \return 0 on success, nonzero on memory error
+ */
+static int gen_thread_init(struct gen_thread *thread, unsigned int batch,
+	uint16_t max_length)
+{
+	unsigned int i;
+
+	thread->msgs = calloc(batch, sizeof(*thread->msgs));
+	thread->iovs = calloc(batch, sizeof(*thread->iovs));
+	thread->buffers = malloc((size_t) batch * max_length);
+	if (!thread->msgs || !thread->iovs || !thread->buffers) {
+		ERR_MEM;
+		return 1;
+	}
+
+	for (i = 0; i < batch; ++i) {
+		thread->iovs[i].iov_base = thread->buffers + (size_t) i * max_length;
+		thread->msgs[i].msg_hdr.msg_iov = &thread->iovs[i];
+		thread->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	return 0;
+}
+
+// Send packets of a preloaded file from simulated exporters
+int generator_run(const struct generator_cfg *cfg, reader_t *reader)
+{
+	struct ipfix_header **packets = reader_get_packets(reader);
+	struct addrinfo hints, *addr = NULL;
+	struct gen_file file;
+	struct gen_exporter *exporters = NULL;
+	struct gen_thread *threads = NULL;
+	unsigned int i, started = 0;
+	uint64_t start, elapsed, packets_sent = 0, bytes_sent = 0;
+	int ret, retval = 1;
+
+	if (!packets) {
+		fprintf(stderr, "Generator requires preloaded input file.\n");
+		return 1;
+	}
+
+	if (gen_file_init(&file, packets)) {
+		return 1;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+
+	ret = getaddrinfo(cfg->ip, cfg->port, &hints, &addr);
+	if (ret != 0) {
+		fprintf(stderr, "Network error: %s\n", gai_strerror(ret));
+		gen_file_free(&file);
+		return 1;
+	}
+
+	/* Exporters */
+	exporters = calloc(cfg->exporters, sizeof(*exporters));
+	threads = calloc(cfg->threads, sizeof(*threads));
+	if (!exporters || !threads) {
+		ERR_MEM;
+		goto cleanup;
+	}
+
+	for (i = 0; i < cfg->exporters; ++i) {
+		exporters[i].fd = -1;
+	}
+
+	for (i = 0; i < cfg->exporters; ++i) {
+		exporters[i].id = i;
+		exporters[i].seq = calloc(file.odid_cnt, sizeof(*exporters[i].seq));
+		if (!exporters[i].seq) {
+			ERR_MEM;
+			goto cleanup;
+		}
+
+		exporters[i].fd = gen_socket_create(addr);
+		if (exporters[i].fd < 0) {
+			goto cleanup;
+		}
+	}
+
+	/* Threads (exporters are assigned in round robin) */
+	for (i = 0; i < cfg->threads; ++i) {
+		threads[i].cfg = cfg;
+		threads[i].file = &file;
+		threads[i].exporters = calloc(cfg->exporters / cfg->threads + 1,
+			sizeof(*threads[i].exporters));
+		if (!threads[i].exporters) {
+			ERR_MEM;
+			goto cleanup;
+		}
+
+		if (gen_thread_init(&threads[i], cfg->batch, file.max_length)) {
+			goto cleanup;
+		}
+
+		if (cfg->packets_s > 0) {
+			threads[i].pkt_ns = (double) NANO_SEC * cfg->threads / cfg->packets_s;
+			threads[i].burst_ns = threads[i].pkt_ns * cfg->batch;
+		}
+	}
+
+	for (i = 0; i < cfg->exporters; ++i) {
+		struct gen_thread *thread = &threads[i % cfg->threads];
+		thread->exporters[thread->exporter_cnt++] = &exporters[i];
+	}
+
+	start = gen_now();
+	for (started = 0; started < cfg->threads; ++started) {
+		if (pthread_create(&threads[started].thread, NULL, gen_thread_run,
+				&threads[started]) != 0) {
+			fprintf(stderr, "Unable to create sender thread.\n");
+			generator_stop();
+			break;
+		}
+	}
+
+	retval = (started == cfg->threads) ? 0 : 1;
+	for (i = 0; i < started; ++i) {
+		pthread_join(threads[i].thread, NULL);
+		retval |= threads[i].error;
+		packets_sent += threads[i].packets;
+		bytes_sent += threads[i].bytes;
+	}
+
+	elapsed = gen_now() - start;
+	printf("Sent %" PRIu64 " packets (%" PRIu64 " bytes) in %.3f s: %.0f packets/s, %.1f Mb/s\n",
+		packets_sent, bytes_sent, elapsed / 1e9,
+		elapsed ? packets_sent * 1e9 / elapsed : 0.0,
+		elapsed ? bytes_sent * 8e3 / elapsed : 0.0);
+
+cleanup:
+	if (threads) {
+		for (i = 0; i < cfg->threads; ++i) {
+			free(threads[i].exporters);
+			free(threads[i].msgs);
+			free(threads[i].iovs);
+			free(threads[i].buffers);
+		}
+	}
+
+	if (exporters) {
+		for (i = 0; i < cfg->exporters; ++i) {
+			if (exporters[i].fd >= 0) {
+				gen_socket_close(exporters[i].fd);
+			}
+			free(exporters[i].seq);
+		}
+	}
+
+	free(threads);
+	free(exporters);
+	freeaddrinfo(addr);
+	gen_file_free(&file);
+	return retval;
+}
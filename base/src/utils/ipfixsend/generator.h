@@ -0,0 +1,78 @@
+/**
+ * \file ipfixsend/generator.h
+ * \brief Multi-threaded high-rate traffic generator
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef GENERATOR_H
+#define	GENERATOR_H
+
+#include <stdbool.h>
+#include "reader.h"
+
+/**
+ * \brief Configuration of the generator
+ */
+struct generator_cfg {
+	const char *ip;          /**< Destination address                       */
+	const char *port;        /**< Destination port                          */
+	unsigned int threads;    /**< Number of sender threads                  */
+	unsigned int exporters;  /**< Number of simulated exporters             */
+	unsigned int batch;      /**< Maximal number of packets in one sendmmsg */
+	int packets_s;           /**< Total packets/s limit (0 = unlimited)     */
+	int loops;               /**< Replays of the file per exporter (-1 = infinity) */
+	bool unique_templates;   /**< Rewrite Template IDs per exporter          */
+};
+
+/**
+ * \brief Send packets of a preloaded file from simulated exporters
+ *
+ * Each exporter has its own UDP socket (source port), Observation Domain IDs
+ * and sequence numbers. Exporters are distributed among sender threads, each
+ * thread sends batches of packets by sendmmsg() and paces them by a token
+ * bucket.
+ *
+ * \param[in] cfg    Configuration
+ * \param[in] reader Preloaded input file
+ * \return On success returns 0. Otherwise returns nonzero value.
+ */
+int generator_run(const struct generator_cfg *cfg, reader_t *reader);
+
+/**
+ * \brief Stop sending data
+ */
+void generator_stop();
+
+#endif	/* GENERATOR_H */
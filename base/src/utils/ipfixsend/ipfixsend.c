@@ -42,6 +42,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ipfixcol.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -55,16 +56,18 @@
 #include "ipfixsend.h"
 #include "reader.h"
 #include "sender.h"
+#include "generator.h"
 
 #ifdef HAVE_SCTP
 #include <netinet/sctp.h>
 #endif
 
-#define OPTSTRING "hci:d:p:t:n:s:S:R:"
+#define OPTSTRING "hci:d:p:t:n:s:S:R:T:E:B:U"
 #define DEFAULT_IP "127.0.0.1"
 #define DEFAULT_PORT "4739"
 #define DEFAULT_TYPE "UDP"
 #define INFINITY_LOOPS (-1)
+#define DEFAULT_BATCH 32
 /*
  * Timeout for waiting until all queued messages have been sent before close()
  * (in nanoseconds)
@@ -101,12 +104,20 @@ void usage()
 	printf("  -R num     Real-time sending\n");
 	printf("             Allow speed-up sending 'num' times (realtime: 1.0)\n");
 	printf("\n");
+	printf("Generator mode (UDP only, input file is always precached):\n");
+	printf("  -T num     Number of sender threads (default: 1)\n");
+	printf("  -E num     Number of simulated exporters (default: number of threads)\n");
+	printf("             Each exporter has own source port, ODID and sequence numbers\n");
+	printf("  -B num     Packets sent by one sendmmsg call (default: %d)\n", DEFAULT_BATCH);
+	printf("  -U         Rewrite Template IDs to be unique for each exporter\n");
+	printf("\n");
 }
 
 void handler(int signal)
 {
 	(void) signal; // skip compiler warning
 	sender_stop();
+	generator_stop();
 	stop = 1;
 }
 
@@ -126,6 +137,13 @@ int main(int argc, char** argv)
 	double  realtime_s = 0.0;
 	bool    precache = false;
 
+	/* Generator mode */
+	struct generator_cfg gen_cfg = {0};
+	bool    generator = false;
+	int     threads = 0;
+	int     exporters = 0;
+	int     batch = DEFAULT_BATCH;
+
 	if (argc == 1) {
 		usage();
 		return 0;
@@ -165,6 +183,22 @@ int main(int argc, char** argv)
 		case 'R':
 			realtime_s = atof(optarg);
 			break;
+		case 'T':
+			threads = atoi(optarg);
+			generator = true;
+			break;
+		case 'E':
+			exporters = atoi(optarg);
+			generator = true;
+			break;
+		case 'B':
+			batch = atoi(optarg);
+			generator = true;
+			break;
+		case 'U':
+			gen_cfg.unique_templates = true;
+			generator = true;
+			break;
 		default:
 			fprintf(stderr, "Unknown option.\n");
 			return 1;
@@ -193,10 +227,51 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	if (generator) {
+		threads = (threads == 0) ? 1 : threads;
+		exporters = (exporters == 0) ? threads : exporters;
+
+		if (threads < 0 || exporters < 0 || batch <= 0) {
+			fprintf(stderr, "Invalid value of threads, exporters or batch size.\n");
+			return 1;
+		}
+
+		if (strcasecmp(type, "UDP") != 0) {
+			fprintf(stderr, "Generator mode supports only UDP.\n");
+			return 1;
+		}
+
+		if (speed != NULL || realtime_s > 0) {
+			fprintf(stderr, "Generator mode supports only speed limit in packets/s.\n");
+			return 1;
+		}
+
+		precache = true;
+	}
+
 	/* Check whether everything is set */
 	CHECK_SET(input, "Input file");
 	signal(SIGINT, handler);
 
+	if (generator) {
+		reader_t *reader = reader_create(input, precache);
+		if (!reader) {
+			return 1;
+		}
+
+		gen_cfg.ip = ip;
+		gen_cfg.port = port;
+		gen_cfg.threads = threads;
+		gen_cfg.exporters = exporters;
+		gen_cfg.batch = batch;
+		gen_cfg.packets_s = packets_s;
+		gen_cfg.loops = loops;
+
+		int ret = generator_run(&gen_cfg, reader);
+		reader_destroy(reader);
+		return ret;
+	}
+
 	/* Get collector's address */
 	sisoconf *sender = siso_create();
 	if (!sender) {
@@ -61,6 +61,7 @@ struct reader_internal {
 	bool is_preloaded;   /**< Is the whole file preloaded                    */
 
 	struct ipfix_header **packets_preload;   /**< Preloaded packets          */
+	uint8_t *preload_buffer;                 /**< Memory of preloaded packets */
 	uint8_t packet_single[MAX_PACKET_SIZE];  /**< Internal buffer            */
 
 	struct {
@@ -73,8 +74,6 @@ struct reader_internal {
 // Function prototypes
 static struct ipfix_header **
 reader_preload_packets(reader_t *reader);
-static void
-reader_free_preloaded_packets(struct ipfix_header **packets);
 
 
 // Create a new packet reader
@@ -122,7 +121,8 @@ reader_destroy(reader_t *reader)
 	}
 
 	if (reader->is_preloaded) {
-		reader_free_preloaded_packets(reader->packets_preload);
+		free(reader->packets_preload);
+		free(reader->preload_buffer);
 	}
 
 	if (reader->file) {
@@ -218,136 +218,112 @@ reader_load_packet_buffer(reader_t *reader, uint8_t *out_buffer,
 	return READER_OK;
 }
 
-/**
- * \brief Allocate a memory large enought and load the next packet from a file
- *   into it.
- *
- * User MUST manualy free the packet later.
- * \note You should check EOF before calling this function.
- * \param[in] reader        Pointer to the packet reader
- * \param[out] packet_data  Pointer to newly allocated packet
- * \param[out] packet_size  Size of the new packet (can be NULL)
- * \return On success returns #READER_OK and fills the \p packet_data and
- *   \p packet_size. When end-of-file occurs, returns #READER_EOF. Otherwise
- *   (i.e. malformed packet, memory allocation error) returns #READER_ERROR.
- */
-static enum READER_STATUS
-reader_load_packet_alloc(reader_t *reader, struct ipfix_header **packet_data,
-	uint16_t *packet_size)
-{
-	// Load the packet header
-	struct ipfix_header header;
-	uint8_t *result;
-
-	enum READER_STATUS status = reader_load_packet_header(reader, &header);
-	if (status != READER_OK) {
-		return status;
-	}
-
-	uint16_t new_size = ntohs(header.length);
-	result = (uint8_t *) malloc(new_size);
-	if (!result) {
-		ERR_MEM;
-		return READER_ERROR;
-	}
-
-	memcpy(result, (const uint8_t *) &header, IPFIX_HEADER_LENGTH);
-	uint8_t *body_ptr = result + IPFIX_HEADER_LENGTH;
-	uint16_t body_size = new_size - IPFIX_HEADER_LENGTH;
-
-	if (body_size > 0 && fread(body_ptr, body_size, 1, reader->file) != 1) {
-		fprintf(stderr, "Unable to read a packet!\n");
-		free(result);
-		return READER_ERROR;
-	}
-
-	if (packet_size) {
-		*packet_size = new_size;
-	}
-
-	*packet_data = (struct ipfix_header *) result;
-	return READER_OK;
-}
-
 /**
  * \brief Read packets from IPFIX file and store them into memory
  *
- * Result represents a NULL-terminated array of pointers to the packets.
+ * The rest of the file is loaded into one buffer (reader->preload_buffer) and
+ * the result represents a NULL-terminated array of pointers to the packets
+ * in the buffer.
  * \param[in] reader  Pointer to the packet reader
  * \return On success returns a pointer to the array. Otherwise returns NULL.
  */
 static struct ipfix_header **
 reader_preload_packets(reader_t *reader)
 {
-	enum READER_STATUS status;
+	struct stat file_stat;
+	long offset;
+	size_t size, pos;
 	size_t pkt_cnt = 0;
 	size_t pkt_max = 2048;
 
+	offset = ftell(reader->file);
+	if (offset < 0 || fstat(fileno(reader->file), &file_stat) != 0) {
+		fprintf(stderr, "Unable to get size of the input file: %s\n",
+			strerror(errno));
+		return NULL;
+	}
+
+	size = (file_stat.st_size > offset) ? (size_t) (file_stat.st_size - offset) : 0;
+	if (size > 0) {
+		reader->preload_buffer = malloc(size);
+		if (!reader->preload_buffer) {
+			ERR_MEM;
+			return NULL;
+		}
+
+		if (fread(reader->preload_buffer, size, 1, reader->file) != 1) {
+			fprintf(stderr, "Unable to read the input file!\n");
+			free(reader->preload_buffer);
+			reader->preload_buffer = NULL;
+			return NULL;
+		}
+	}
+
 	struct ipfix_header **packets = calloc(pkt_max, sizeof(*packets));
 	if (!packets) {
 		ERR_MEM;
+		free(reader->preload_buffer);
+		reader->preload_buffer = NULL;
 		return NULL;
 	}
 
-	while (1) {
-		// Read packet
-		status = reader_load_packet_alloc(reader, &packets[pkt_cnt], NULL);
-		if (status == READER_EOF) {
+	pos = 0;
+	while (pos < size) {
+		// Check the packet header
+		struct ipfix_header *header;
+		header = (struct ipfix_header *) (reader->preload_buffer + pos);
+
+		if (size - pos < IPFIX_HEADER_LENGTH) {
+			fprintf(stderr, "Unable to read a packet header (probably "
+				"malformed packet).\n");
 			break;
 		}
 
-		if (status != READER_OK) {
-			// Failed -> Delete all loaded packets
-			for (size_t i = 0; i < pkt_cnt; ++i) {
-				free(packets[i]);
-			}
+		if (ntohs(header->version) != IPFIX_VERSION) {
+			fprintf(stderr, "Invalid version of a packet header.\n");
+			break;
+		}
 
-			free(packets);
-			return NULL;
+		uint16_t new_size = ntohs(header->length);
+		if (new_size < IPFIX_HEADER_LENGTH) {
+			fprintf(stderr, "Invalid size a packet in the packet header.\n");
+			break;
 		}
 
-		// Move array index to next packet - resize array if needed
-		pkt_cnt++;
-		if (pkt_cnt < pkt_max) {
-			continue;
+		if (new_size > size - pos) {
+			fprintf(stderr, "Unable to read a packet!\n");
+			break;
 		}
 
-		size_t new_max = 2 * pkt_max;
-		struct ipfix_header** new_packets;
+		// Resize array if needed (one item is kept for NULL)
+		if (pkt_cnt + 1 == pkt_max) {
+			size_t new_max = 2 * pkt_max;
+			struct ipfix_header** new_packets;
 
-		new_packets = realloc(packets, new_max * sizeof(*packets));
-		if (!new_packets) {
-			ERR_MEM;
-			// Failed -> Delete all loaded packets
-			for (size_t i = 0; i < pkt_cnt; ++i) {
-				free(packets[i]);
+			new_packets = realloc(packets, new_max * sizeof(*packets));
+			if (!new_packets) {
+				ERR_MEM;
+				break;
 			}
 
-			free(packets);
-			return NULL;
+			packets = new_packets;
+			pkt_max = new_max;
 		}
 
-		packets = new_packets;
-		pkt_max = new_max;
+		packets[pkt_cnt++] = header;
+		pos += new_size;
 	}
 
-	packets[pkt_cnt] = NULL;
-	return packets;
-}
-
-/**
- * \brief Free allocated memory for packets
- * \param[in] packets Array of packets
- */
-static void
-reader_free_preloaded_packets(struct ipfix_header **packets)
-{
-
-	for (size_t i = 0; packets[i] != NULL; ++i) {
-		free(packets[i]);
+	if (pos < size) {
+		// Failed -> Delete all loaded packets
+		free(packets);
+		free(reader->preload_buffer);
+		reader->preload_buffer = NULL;
+		return NULL;
 	}
 
-	free(packets);
+	packets[pkt_cnt] = NULL;
+	return packets;
 }
 
 
@@ -443,6 +419,13 @@ reader_get_next_packet(reader_t *reader, struct ipfix_header **output,
 	return READER_OK;
 }
 
+// Get preloaded packets
+struct ipfix_header **
+reader_get_packets(reader_t *reader)
+{
+	return reader->is_preloaded ? reader->packets_preload : NULL;
+}
+
 // Get the pointer to header of a next packet
 enum READER_STATUS
 reader_get_next_header(reader_t *reader, struct ipfix_header **header)
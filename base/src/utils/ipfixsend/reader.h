@@ -136,5 +136,16 @@ reader_get_next_packet(reader_t *reader, struct ipfix_header **output,
 enum READER_STATUS
 reader_get_next_header(reader_t *reader, struct ipfix_header **header);
 
+/**
+ * \brief Get all preloaded packets
+ *
+ * Packets are stored in one buffer, the array is terminated by NULL. A user is
+ * not allowed to change the packets.
+ * \param[in] reader Pointer to the packet reader
+ * \return Array of packets or NULL when the reader is not preloaded.
+ */
+struct ipfix_header **
+reader_get_packets(reader_t *reader);
+
 #endif	/* READER_H */
 
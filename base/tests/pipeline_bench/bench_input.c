@@ -0,0 +1,561 @@
+/**
+ * \file bench_input.c
+ * \brief In-memory input plugin for the pipeline benchmark
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+/**
+ * Replays IPFIX messages from memory as fast as the collector reads them.
+ * Messages are either synthetic (one template, random flows) or loaded from
+ * an IPFIX file. Messages are spread over configured number of exporters.
+ * When all messages are passed, exporters are closed and the collector is
+ * terminated.
+ *
+ * Configuration:
+ *
+ * <benchInput>
+ *     <packets>1000000</packets>   number of synthetic messages
+ *     <records>30</records>        data records in a synthetic message
+ *     <exporters>1</exporters>     number of exporters (ODIDs 1, 2, ...)
+ *     <file>flows.ipfix</file>     replay messages of the file instead
+ *     <loops>1</loops>             how many times the file is replayed
+ * </benchInput>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <time.h>
+
+#include <ipfixcol.h>
+
+/* API version constant */
+IPFIXCOL_API_VERSION;
+
+/** Identifier to MSG_* macros */
+static char *msg_module = "bench input";
+
+/** Number of distinct synthetic messages */
+#define BENCH_POOL 256
+
+/** Template of synthetic data records */
+#define BENCH_TEMPLATE_ID 256
+#define BENCH_TEMPLATE_FIELDS 9
+#define BENCH_RECORD_LEN 45
+
+static const uint16_t bench_template[BENCH_TEMPLATE_FIELDS][2] = {
+	{8, 4},     /* sourceIPv4Address */
+	{12, 4},    /* destinationIPv4Address */
+	{7, 2},     /* sourceTransportPort */
+	{11, 2},    /* destinationTransportPort */
+	{4, 1},     /* protocolIdentifier */
+	{1, 8},     /* octetDeltaCount */
+	{2, 8},     /* packetDeltaCount */
+	{152, 8},   /* flowStartMilliseconds */
+	{153, 8},   /* flowEndMilliseconds */
+};
+
+/** Length of template set */
+#define BENCH_TEMPLATE_LEN (sizeof(struct ipfix_set_header) + 4 + BENCH_TEMPLATE_FIELDS * 4)
+
+/** Maximal number of data records in a synthetic message */
+#define BENCH_RECORDS_MAX ((UINT16_MAX - IPFIX_HEADER_LENGTH - BENCH_TEMPLATE_LEN \
+		- sizeof(struct ipfix_set_header)) / BENCH_RECORD_LEN)
+
+struct bench_exporter {
+	struct input_info_network info;     /**< information passed to collector */
+	uint32_t sequence_number;           /**< sequence number of synthetic messages */
+	int opened;                         /**< first message was passed */
+};
+
+struct bench_message {
+	uint8_t *data;                      /**< IPFIX message (without templates for synthetic ones) */
+	uint16_t length;                    /**< length of the message */
+	uint16_t records;                   /**< number of data records (synthetic only) */
+};
+
+struct plugin_conf {
+	struct bench_exporter *exporters;   /**< exporters */
+	unsigned int exporters_cnt;         /**< number of exporters */
+	struct bench_message *messages;     /**< messages to replay */
+	unsigned int messages_cnt;          /**< number of messages */
+	uint8_t template_set[BENCH_TEMPLATE_LEN]; /**< template set of synthetic messages */
+	int synthetic;                      /**< messages are synthetic */
+	uint8_t *file_data;                 /**< content of replayed file */
+	uint64_t packets;                   /**< number of messages to pass */
+	uint64_t sent;                      /**< number of passed messages */
+	unsigned int closed;                /**< number of closed exporters */
+};
+
+/**
+ * \brief Simple pseudorandom generator (xorshift)
+ *
+ * \param[in,out] state state of the generator
+ * \return next number
+ */
+static uint64_t bench_random(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+/**
+ * \brief Write values in network byte order (unaligned)
+ *
+ * \param[in] ptr destination
+ * \param[in] value value
+ * \return pointer behind the value
+ */
+static uint8_t *bench_put16(uint8_t *ptr, uint16_t value)
+{
+	value = htons(value);
+	memcpy(ptr, &value, sizeof(value));
+	return ptr + sizeof(value);
+}
+
+static uint8_t *bench_put32(uint8_t *ptr, uint32_t value)
+{
+	value = htonl(value);
+	memcpy(ptr, &value, sizeof(value));
+	return ptr + sizeof(value);
+}
+
+static uint8_t *bench_put64(uint8_t *ptr, uint64_t value)
+{
+	value = htobe64(value);
+	memcpy(ptr, &value, sizeof(value));
+	return ptr + sizeof(value);
+}
+
+/**
+ * \brief Prepare template set and pool of synthetic messages
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] records data records in a message
+ * \return 0 on success
+ */
+static int bench_synthetic_init(struct plugin_conf *conf, unsigned int records)
+{
+	struct ipfix_set_header *set;
+	uint64_t state = 0x9e3779b97f4a7c15ULL, now = (uint64_t) time(NULL) * 1000, value;
+	uint16_t *templ;
+	uint8_t *ptr;
+	unsigned int i, j;
+
+	/* template set */
+	set = (struct ipfix_set_header *) conf->template_set;
+	set->flowset_id = htons(IPFIX_TEMPLATE_FLOWSET_ID);
+	set->length = htons(BENCH_TEMPLATE_LEN);
+
+	templ = (uint16_t *) (set + 1);
+	*templ++ = htons(BENCH_TEMPLATE_ID);
+	*templ++ = htons(BENCH_TEMPLATE_FIELDS);
+	for (i = 0; i < BENCH_TEMPLATE_FIELDS; ++i) {
+		*templ++ = htons(bench_template[i][0]);
+		*templ++ = htons(bench_template[i][1]);
+	}
+
+	/* messages with data sets */
+	conf->messages = calloc(BENCH_POOL, sizeof(struct bench_message));
+	if (!conf->messages) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	for (i = 0; i < BENCH_POOL; ++i) {
+		struct bench_message *msg = &conf->messages[i];
+
+		msg->length = IPFIX_HEADER_LENGTH + sizeof(struct ipfix_set_header) + records * BENCH_RECORD_LEN;
+		msg->records = records;
+		msg->data = calloc(1, msg->length);
+		if (!msg->data) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+			return 1;
+		}
+		conf->messages_cnt++;
+
+		((struct ipfix_header *) msg->data)->version = htons(IPFIX_VERSION);
+		((struct ipfix_header *) msg->data)->export_time = htonl(now / 1000);
+
+		set = (struct ipfix_set_header *) (msg->data + IPFIX_HEADER_LENGTH);
+		set->flowset_id = htons(BENCH_TEMPLATE_ID);
+		set->length = htons(sizeof(struct ipfix_set_header) + records * BENCH_RECORD_LEN);
+
+		ptr = (uint8_t *) (set + 1);
+		for (j = 0; j < records; ++j) {
+			value = bench_random(&state);
+
+			/* addresses from 10.0.0.0/16 and 192.168.0.0/16, ports and protocol */
+			ptr = bench_put32(ptr, 0x0a000000 | (value & 0xffff));
+			ptr = bench_put32(ptr, 0xc0a80000 | ((value >> 16) & 0xffff));
+			ptr = bench_put16(ptr, 1024 + ((value >> 32) % 64000));
+			ptr = bench_put16(ptr, (value >> 48) & 1 ? 443 : 53);
+			*ptr++ = (value >> 49) & 1 ? 6 : 17;
+
+			/* counters and timestamps */
+			value = bench_random(&state);
+			ptr = bench_put64(ptr, 64 + (value % 100000));
+			ptr = bench_put64(ptr, 1 + ((value >> 20) % 100));
+			ptr = bench_put64(ptr, now - 60000 + ((value >> 40) % 30000));
+			ptr = bench_put64(ptr, now - ((value >> 40) % 30000));
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Load messages of IPFIX file
+ *
+ * \param[in] conf plugin configuration
+ * \param[in] path path to the file
+ * \return 0 on success
+ */
+static int bench_file_init(struct plugin_conf *conf, const char *path)
+{
+	struct ipfix_header *header;
+	FILE *file;
+	long size, offset;
+	uint16_t length;
+	unsigned int i;
+
+	file = fopen(path, "rb");
+	if (!file) {
+		MSG_ERROR(msg_module, "Unable to open file '%s': %s", path, strerror(errno));
+		return 1;
+	}
+
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET) != 0) {
+		MSG_ERROR(msg_module, "Unable to read file '%s'", path);
+		fclose(file);
+		return 1;
+	}
+
+	conf->file_data = malloc(size);
+	if (!conf->file_data) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		fclose(file);
+		return 1;
+	}
+
+	if (fread(conf->file_data, 1, size, file) != (size_t) size) {
+		MSG_ERROR(msg_module, "Unable to read file '%s'", path);
+		fclose(file);
+		return 1;
+	}
+	fclose(file);
+
+	/* count messages */
+	for (offset = 0; offset + IPFIX_HEADER_LENGTH <= size; offset += length) {
+		header = (struct ipfix_header *) (conf->file_data + offset);
+		length = ntohs(header->length);
+		if (ntohs(header->version) != IPFIX_VERSION || length < IPFIX_HEADER_LENGTH || offset + length > size) {
+			MSG_WARNING(msg_module, "Invalid message at offset %ld of file '%s'; ignoring the rest...", offset, path);
+			break;
+		}
+		conf->messages_cnt++;
+	}
+
+	if (conf->messages_cnt == 0) {
+		MSG_ERROR(msg_module, "No IPFIX message in file '%s'", path);
+		return 1;
+	}
+
+	conf->messages = calloc(conf->messages_cnt, sizeof(struct bench_message));
+	if (!conf->messages) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	offset = 0;
+	for (i = 0; i < conf->messages_cnt; ++i) {
+		conf->messages[i].data = conf->file_data + offset;
+		conf->messages[i].length = ntohs(((struct ipfix_header *) (conf->file_data + offset))->length);
+		offset += conf->messages[i].length;
+	}
+
+	MSG_INFO(msg_module, "Loaded %u messages from file '%s'", conf->messages_cnt, path);
+	return 0;
+}
+
+/**
+ * \brief Get numeric configuration value
+ *
+ * \param[in] node XML node
+ * \param[in] min minimal value
+ * \param[in] max maximal value
+ * \param[out] result value
+ * \return 0 on success
+ */
+static int bench_config_number(xmlNode *node, uint64_t min, uint64_t max, uint64_t *result)
+{
+	xmlChar *content = xmlNodeGetContent(node);
+	char *end = NULL;
+	unsigned long long value = 0;
+
+	if (content) {
+		value = strtoull((char *) content, &end, 10);
+	}
+
+	if (!content || *end != '\0' || end == (char *) content || value < min || value > max) {
+		MSG_ERROR(msg_module, "Invalid value of %s: '%s'", (char *) node->name, content ? (char *) content : "");
+		xmlFree(content);
+		return 1;
+	}
+
+	xmlFree(content);
+	*result = value;
+	return 0;
+}
+
+/**
+ * \brief Free plugin configuration
+ *
+ * \param[in] conf plugin configuration
+ */
+static void bench_free(struct plugin_conf *conf)
+{
+	unsigned int i;
+
+	if (conf->synthetic && conf->messages) {
+		for (i = 0; i < conf->messages_cnt; ++i) {
+			free(conf->messages[i].data);
+		}
+	}
+
+	free(conf->messages);
+	free(conf->file_data);
+	free(conf->exporters);
+	free(conf);
+}
+
+/**
+ * \brief Input plugin initializtion function
+ */
+int input_init(char *params, void **config)
+{
+	struct plugin_conf *conf;
+	xmlDoc *doc;
+	xmlNode *root, *node;
+	xmlChar *file = NULL;
+	uint64_t packets = 1000000, records = 30, exporters = 1, loops = 1;
+	unsigned int i;
+	int ret = 0;
+
+	conf = calloc(1, sizeof(struct plugin_conf));
+	if (!conf) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return 1;
+	}
+
+	doc = xmlParseDoc(BAD_CAST params);
+	if (!doc) {
+		MSG_ERROR(msg_module, "Cannot parse configuration");
+		free(conf);
+		return 1;
+	}
+
+	root = xmlDocGetRootElement(doc);
+	if (!root || !xmlStrEqual(root->name, BAD_CAST "benchInput")) {
+		MSG_ERROR(msg_module, "Expecting benchInput root element");
+		ret = 1;
+	}
+
+	for (node = root ? root->children : NULL; node && ret == 0; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		if (xmlStrEqual(node->name, BAD_CAST "packets")) {
+			ret = bench_config_number(node, 1, UINT64_MAX, &packets);
+		} else if (xmlStrEqual(node->name, BAD_CAST "records")) {
+			ret = bench_config_number(node, 1, BENCH_RECORDS_MAX, &records);
+		} else if (xmlStrEqual(node->name, BAD_CAST "exporters")) {
+			ret = bench_config_number(node, 1, 65535, &exporters);
+		} else if (xmlStrEqual(node->name, BAD_CAST "loops")) {
+			ret = bench_config_number(node, 1, UINT32_MAX, &loops);
+		} else if (xmlStrEqual(node->name, BAD_CAST "file")) {
+			xmlFree(file);
+			file = xmlNodeGetContent(node);
+		}
+	}
+
+	xmlFreeDoc(doc);
+
+	if (ret != 0) {
+		xmlFree(file);
+		free(conf);
+		return 1;
+	}
+
+	/* messages */
+	if (file) {
+		ret = bench_file_init(conf, (char *) file);
+		conf->packets = (uint64_t) conf->messages_cnt * loops;
+		xmlFree(file);
+	} else {
+		conf->synthetic = 1;
+		ret = bench_synthetic_init(conf, records);
+		conf->packets = packets;
+	}
+
+	if (ret != 0) {
+		bench_free(conf);
+		return 1;
+	}
+
+	/* exporters */
+	conf->exporters_cnt = exporters;
+	conf->exporters = calloc(exporters, sizeof(struct bench_exporter));
+	if (!conf->exporters) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		bench_free(conf);
+		return 1;
+	}
+
+	for (i = 0; i < exporters; ++i) {
+		struct input_info_network *info = &conf->exporters[i].info;
+
+		info->type = SOURCE_TYPE_UDP;
+		info->status = SOURCE_STATUS_NEW;
+		info->odid = i + 1;
+		info->l3_proto = 4;
+		info->src_addr.ipv4.s_addr = htonl(0x0a000001 + i);
+		info->dst_addr.ipv4.s_addr = htonl(0x7f000001);
+		info->src_port = 10000 + i;
+		info->dst_port = 4739;
+	}
+
+	MSG_INFO(msg_module, "Replaying %lu %s messages from %u exporter(s)", (unsigned long) conf->packets,
+			conf->synthetic ? "synthetic" : "recorded", conf->exporters_cnt);
+
+	*config = conf;
+	return 0;
+}
+
+/**
+ * \brief Pass next message into the ipfixcol core.
+ */
+int get_packet(void *config, struct input_info **info, char **packet, int *source_status)
+{
+	struct plugin_conf *conf = (struct plugin_conf *) config;
+	struct bench_exporter *exporter;
+	struct bench_message *msg;
+	struct ipfix_header *header;
+	uint16_t length, templ = 0;
+
+	if (conf->sent == conf->packets) {
+		/* close exporters one by one, then stop the collector */
+		while (conf->closed < conf->exporters_cnt && !conf->exporters[conf->closed].opened) {
+			conf->closed++;
+		}
+
+		if (conf->closed == conf->exporters_cnt) {
+			terminating = 1;
+			return INPUT_INTR;
+		}
+
+		exporter = &conf->exporters[conf->closed++];
+		exporter->info.status = SOURCE_STATUS_CLOSED;
+		*info = (struct input_info *) &exporter->info;
+		*source_status = SOURCE_STATUS_CLOSED;
+
+		if (conf->closed == conf->exporters_cnt) {
+			terminating = 1;
+		}
+		return INPUT_CLOSED;
+	}
+
+	exporter = &conf->exporters[conf->sent % conf->exporters_cnt];
+	msg = &conf->messages[(conf->sent / conf->exporters_cnt) % conf->messages_cnt];
+
+	/* synthetic exporters send the template in the first message */
+	if (conf->synthetic && !exporter->opened) {
+		templ = BENCH_TEMPLATE_LEN;
+	}
+	length = msg->length + templ;
+
+	/* memory is freed by the core */
+	if (*packet) {
+		free(*packet);
+	}
+	*packet = malloc(length);
+	if (!*packet) {
+		MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return INPUT_ERROR;
+	}
+
+	memcpy(*packet, msg->data, IPFIX_HEADER_LENGTH);
+	memcpy(*packet + IPFIX_HEADER_LENGTH, conf->template_set, templ);
+	memcpy(*packet + IPFIX_HEADER_LENGTH + templ, msg->data + IPFIX_HEADER_LENGTH, msg->length - IPFIX_HEADER_LENGTH);
+
+	header = (struct ipfix_header *) *packet;
+	if (conf->synthetic) {
+		header->length = htons(length);
+		header->sequence_number = htonl(exporter->sequence_number);
+		header->observation_domain_id = htonl(exporter->info.odid);
+		exporter->sequence_number += msg->records;
+	} else {
+		/* recorded messages keep their ODIDs */
+		exporter->info.odid = ntohl(header->observation_domain_id);
+	}
+
+	*source_status = exporter->opened ? SOURCE_STATUS_OPENED : SOURCE_STATUS_NEW;
+	exporter->info.status = *source_status;
+	exporter->opened = 1;
+	*info = (struct input_info *) &exporter->info;
+
+	conf->sent++;
+	return length;
+}
+
+/**
+ * \brief Input plugin "destructor".
+ */
+int input_close(void **config)
+{
+	bench_free((struct plugin_conf *) *config);
+	*config = NULL;
+
+	return 0;
+}
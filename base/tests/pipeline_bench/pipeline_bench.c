@@ -0,0 +1,645 @@
+/**
+ * \file pipeline_bench.c
+ * \brief Throughput benchmark of the collector pipeline
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+/**
+ * Runs the collector core (preprocessor, intermediate plugins, Output Manager
+ * and storage plugins) in one process like ipfixcol does. The input is the
+ * in-memory bench input plugin, which is added to the internal configuration,
+ * the plugin chain is taken from the startup configuration.
+ *
+ * When the input is replayed and the pipeline is idle, throughput, CPU time
+ * of threads and latency percentiles of stages are printed as JSON.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <libxml/xpath.h>
+
+#include <ipfixcol.h>
+#include "../../src/config.h"
+#include "../../src/configurator.h"
+#include "../../src/preprocessor.h"
+#include "../../src/output_manager.h"
+#include "../../src/latency.h"
+#include "../../src/affinity.h"
+
+/** Name and module of the bench input plugin */
+#define BENCH_COLLECTOR "benchInput"
+#define BENCH_PLUGIN "ipfixcol-bench-input.so"
+
+/** Maximal number of threads and exporters tracked by the benchmark */
+#define BENCH_MAX_THREADS 256
+#define BENCH_MAX_SOURCES 65536
+
+/** Pipeline is idle when its threads used less CPU time in a check interval */
+#define BENCH_IDLE_CHECK_US 10000
+#define BENCH_IDLE_CPU_NS 100000
+#define BENCH_IDLE_CHECKS 3
+
+/* Globals of the collector core (defined by ipfixcol.c in the collector) */
+const char *ipfix_elements = DEFAULT_IPFIX_ELEMENTS;
+struct ipfix_template_mgr *template_mgr = NULL;
+volatile int terminating = 0;
+int ring_buffer_size = 8192;
+
+/** Identifier to MSG_* macros */
+static char *msg_module = "pipeline bench";
+
+/** Sources (exporters) of the input */
+static struct input_info *sources[BENCH_MAX_SOURCES];
+
+/** CPU time of a thread */
+struct bench_thread {
+	pid_t tid;              /**< Thread ID */
+	char name[16];          /**< Thread name */
+	uint64_t start;         /**< CPU time at the start of the benchmark (ns) */
+	uint64_t last;          /**< CPU time at the last sample (ns) */
+};
+
+void help()
+{
+	printf("Usage: pipeline_bench -c file [-i file] [-e file] [-o file] [-r size] [-v level] [-M]\n");
+	printf("  -c file   Startup configuration with <%s> collector and the plugin chain\n", BENCH_COLLECTOR);
+	printf("  -i file   Internal configuration file (default: %s)\n", DEFAULT_INTERNAL_CONFIG);
+	printf("  -e file   IPFIX IE specification file (default: %s)\n", DEFAULT_IPFIX_ELEMENTS);
+	printf("  -o file   Write JSON report to the file (default: stdout)\n");
+	printf("  -r size   Ring buffer size (default: 8192)\n");
+	printf("  -v level  Logging verbosity (level: 0-3)\n");
+	printf("  -M        Enable single data manager\n");
+	printf("  -h        Print this help\n");
+}
+
+/**
+ * \brief Get current time
+ *
+ * \param[in] clock clock
+ * \return time in nanoseconds
+ */
+static uint64_t bench_time(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * \brief Create internal configuration with the bench input plugin
+ *
+ * \param[in] internal path to the internal configuration
+ * \param[in] plugin path to the bench input plugin
+ * \return path to the temporary configuration or NULL
+ */
+static char *bench_internal_config(const char *internal, const char *plugin)
+{
+	char path[] = "/tmp/ipfixcol-bench-XXXXXX";
+	xmlDocPtr doc;
+	xmlNodePtr root, node, input;
+	int fd;
+
+	doc = xmlReadFile(internal, NULL, XML_PARSE_NOBLANKS);
+	if (!doc || !(root = xmlDocGetRootElement(doc))) {
+		MSG_ERROR(msg_module, "Unable to parse internal configuration '%s'", internal);
+		xmlFreeDoc(doc);
+		return NULL;
+	}
+
+	for (node = root->children; node; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE && !xmlStrcmp(node->name, BAD_CAST "supportedCollectors")) {
+			xmlNewChild(node, node->ns, BAD_CAST "name", BAD_CAST BENCH_COLLECTOR);
+			break;
+		}
+	}
+
+	if (!node) {
+		MSG_ERROR(msg_module, "No supportedCollectors in internal configuration '%s'", internal);
+		xmlFreeDoc(doc);
+		return NULL;
+	}
+
+	input = xmlNewChild(root, root->ns, BAD_CAST "inputPlugin", NULL);
+	xmlNewChild(input, root->ns, BAD_CAST "name", BAD_CAST BENCH_COLLECTOR);
+	xmlNewChild(input, root->ns, BAD_CAST "file", BAD_CAST plugin);
+	xmlNewChild(input, root->ns, BAD_CAST "processName", BAD_CAST "bench");
+
+	fd = mkstemp(path);
+	if (fd == -1) {
+		MSG_ERROR(msg_module, "Unable to create temporary file: %s", strerror(errno));
+		xmlFreeDoc(doc);
+		return NULL;
+	}
+	close(fd);
+
+	if (xmlSaveFormatFile(path, doc, 1) == -1) {
+		MSG_ERROR(msg_module, "Unable to write temporary file '%s'", path);
+		unlink(path);
+		xmlFreeDoc(doc);
+		return NULL;
+	}
+
+	xmlFreeDoc(doc);
+	return strdup(path);
+}
+
+/**
+ * \brief Get CPU time of a thread of this process
+ *
+ * \param[in] tid thread ID
+ * \param[out] name thread name
+ * \param[out] ns CPU time in nanoseconds
+ * \return 0 on success
+ */
+static int bench_thread_cpu(pid_t tid, char *name, uint64_t *ns)
+{
+	char path[64];
+	unsigned long long value;
+	unsigned long utime, stime;
+	FILE *file;
+	int ret;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+	file = fopen(path, "r");
+	if (!file) {
+		return 1;
+	}
+	if (!fgets(name, 16, file)) {
+		name[0] = '\0';
+	}
+	name[strcspn(name, "\n")] = '\0';
+	fclose(file);
+
+	/* schedstat has nanoseconds, stat only clock ticks */
+	snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", tid);
+	file = fopen(path, "r");
+	if (file) {
+		ret = fscanf(file, "%llu", &value);
+		fclose(file);
+		if (ret == 1) {
+			*ns = value;
+			return 0;
+		}
+	}
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+	file = fopen(path, "r");
+	if (!file) {
+		return 1;
+	}
+
+	/* skip pid and name (may contain spaces) */
+	ret = fscanf(file, "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+	fclose(file);
+	if (ret != 2) {
+		return 1;
+	}
+
+	*ns = (uint64_t) (utime + stime) * (1000000000 / sysconf(_SC_CLK_TCK));
+	return 0;
+}
+
+/**
+ * \brief Sample CPU time of all threads
+ *
+ * New threads are added with zero start time.
+ *
+ * \param[in,out] threads sampled threads
+ * \param[in,out] cnt number of sampled threads
+ * \param[in] start 1 if this is the sample at the start of the benchmark
+ * \param[in] main_tid thread of the benchmark (not included in the total)
+ * \return total CPU time of the other threads (ns)
+ */
+static uint64_t bench_threads_sample(struct bench_thread *threads, unsigned int *cnt, int start, pid_t main_tid)
+{
+	struct dirent *entry;
+	char name[16];
+	uint64_t ns, total = 0;
+	unsigned int i;
+	pid_t tid;
+	DIR *dir;
+
+	dir = opendir("/proc/self/task");
+	if (!dir) {
+		return 0;
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		tid = atoi(entry->d_name);
+		if (tid <= 0 || bench_thread_cpu(tid, name, &ns) != 0) {
+			continue;
+		}
+
+		for (i = 0; i < *cnt && threads[i].tid != tid; ++i);
+		if (i == *cnt) {
+			if (*cnt == BENCH_MAX_THREADS) {
+				continue;
+			}
+			threads[i].tid = tid;
+			threads[i].start = start ? ns : 0;
+			(*cnt)++;
+		}
+
+		strncpy_safe(threads[i].name, name, sizeof(threads[i].name));
+		threads[i].last = ns;
+	}
+
+	closedir(dir);
+
+	for (i = 0; i < *cnt; ++i) {
+		if (threads[i].tid != main_tid) {
+			total += threads[i].last;
+		}
+	}
+
+	return total;
+}
+
+/**
+ * \brief Wait until all messages pass the pipeline
+ *
+ * Queues after the input must be empty and threads must not use CPU.
+ *
+ * \param[in,out] threads sampled threads
+ * \param[in,out] cnt number of sampled threads
+ * \param[in] main_tid thread of the benchmark
+ */
+static void bench_wait_idle(struct bench_thread *threads, unsigned int *cnt, pid_t main_tid)
+{
+	uint64_t last, now;
+	int idle = 0;
+
+	last = bench_threads_sample(threads, cnt, 0, main_tid);
+	while (idle < BENCH_IDLE_CHECKS) {
+		usleep(BENCH_IDLE_CHECK_US);
+		now = bench_threads_sample(threads, cnt, 0, main_tid);
+
+		/* Storage queues are not checked, idle storage threads have them empty */
+		if (now - last < BENCH_IDLE_CPU_NS && get_preprocessor_output_queue()->count == 0
+				&& output_manager_get_in_queue()->count == 0) {
+			idle++;
+		} else {
+			idle = 0;
+		}
+
+		last = now;
+	}
+}
+
+/**
+ * \brief Print string as JSON
+ *
+ * \param[in] file output file
+ * \param[in] str string
+ */
+static void bench_json_string(FILE *file, const char *str)
+{
+	fputc('"', file);
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\') {
+			fprintf(file, "\\%c", *str);
+		} else if ((unsigned char) *str < 0x20) {
+			fprintf(file, "\\u%04x", *str);
+		} else {
+			fputc(*str, file);
+		}
+	}
+	fputc('"', file);
+}
+
+/**
+ * \brief Print CPU time of threads grouped by name as JSON
+ *
+ * \param[in] file output file
+ * \param[in] threads sampled threads
+ * \param[in] cnt number of sampled threads
+ * \param[in] main_tid thread of the input (reported as "input")
+ * \param[in] input_ns CPU time of the input
+ * \param[in] elapsed duration of the benchmark (ns)
+ */
+static void bench_print_cpu(FILE *file, struct bench_thread *threads, unsigned int cnt,
+		pid_t main_tid, uint64_t input_ns, uint64_t elapsed)
+{
+	unsigned int i, j, count;
+	uint64_t ns;
+
+	fprintf(file, "[\n\t\t{\"thread\": \"input\", \"threads\": 1, \"seconds\": %.3f, \"load\": %.3f}",
+			input_ns / 1e9, (double) input_ns / elapsed);
+
+	for (i = 0; i < cnt; ++i) {
+		if (threads[i].tid == main_tid) {
+			continue;
+		}
+
+		/* the first thread of the name */
+		for (j = 0; j < i && (threads[j].tid == main_tid || strcmp(threads[j].name, threads[i].name)); ++j);
+		if (j < i) {
+			continue;
+		}
+
+		ns = 0;
+		count = 0;
+		for (j = i; j < cnt; ++j) {
+			if (threads[j].tid != main_tid && !strcmp(threads[j].name, threads[i].name)) {
+				ns += threads[j].last - threads[j].start;
+				count++;
+			}
+		}
+
+		fprintf(file, ",\n\t\t{\"thread\": ");
+		bench_json_string(file, threads[i].name);
+		fprintf(file, ", \"threads\": %u, \"seconds\": %.3f, \"load\": %.3f}", count, ns / 1e9, (double) ns / elapsed);
+	}
+
+	fprintf(file, "\n\t]");
+}
+
+int main(int argc, char *argv[])
+{
+	char *startup_config = NULL, *internal_config = DEFAULT_INTERNAL_CONFIG, *output = NULL;
+	char *bench_config = NULL, *packet = NULL, exe[PATH_MAX], plugin[PATH_MAX + sizeof(BENCH_PLUGIN)];
+	struct input_info *input_info;
+	struct bench_thread threads[BENCH_MAX_THREADS];
+	unsigned int threads_cnt = 0, sources_cnt = 0, i;
+	int c, get_retval, source_status = SOURCE_STATUS_OPENED, retval = EXIT_SUCCESS;
+	uint64_t start, input_end, end, input_cpu, packets = 0, records = 0;
+	void *output_manager_config = NULL;
+	xmlXPathObjectPtr collectors;
+	configurator *config = NULL;
+	bool odid_merge = false;
+	pid_t main_tid;
+	ssize_t len;
+	FILE *file = stdout;
+
+	while ((c = getopt(argc, argv, "c:i:e:o:r:v:Mh")) != -1) {
+		switch (c) {
+		case 'c':
+			startup_config = optarg;
+			break;
+		case 'i':
+			internal_config = optarg;
+			break;
+		case 'e':
+			ipfix_elements = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'r':
+			ring_buffer_size = atoi(optarg);
+			break;
+		case 'v':
+			verbose = atoi(optarg);
+			break;
+		case 'M':
+			odid_merge = true;
+			break;
+		case 'h':
+			help();
+			return EXIT_SUCCESS;
+		default:
+			help();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!startup_config || ring_buffer_size <= 0) {
+		help();
+		return EXIT_FAILURE;
+	}
+
+	LIBXML_TEST_VERSION
+	xmlIndentTreeOutput = 1;
+
+	/* recorded messages are replayed repeatedly */
+	skip_seq_err = 1;
+
+	/* bench input plugin is next to the benchmark */
+	len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (len <= 0) {
+		MSG_ERROR(msg_module, "Unable to get path of the benchmark: %s", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	exe[len] = '\0';
+	snprintf(plugin, sizeof(plugin), "%s/%s", dirname(exe), BENCH_PLUGIN);
+
+	bench_config = bench_internal_config(internal_config, plugin);
+	if (!bench_config) {
+		return EXIT_FAILURE;
+	}
+
+	/* Set up the collector like ipfixcol does (the first collecting process only) */
+	config = config_init(bench_config, startup_config);
+	if (!config) {
+		MSG_ERROR(msg_module, "Configurator initialization failed");
+		goto cleanup_err;
+	}
+
+	collectors = get_collectors(config->act_doc);
+	if (!collectors) {
+		MSG_ERROR(msg_module, "No collector process configured");
+		goto cleanup_err;
+	}
+	config->collector_node = collectors->nodesetval->nodeTab[0];
+	xmlXPathFreeObject(collectors);
+
+	template_mgr = tm_create();
+	if (!template_mgr) {
+		MSG_ERROR(msg_module, "Unable to create Template Manager");
+		goto cleanup_err;
+	}
+
+	affinity_init();
+	preprocessor_set_output_queue(rbuffer_init(ring_buffer_size));
+
+	/* Latency is traced without periodic statistics */
+	latency_enable();
+	if (output_manager_create(config, 0, odid_merge, &output_manager_config) != 0) {
+		MSG_ERROR(msg_module, "Unable to create Output Manager");
+		goto cleanup_err;
+	}
+
+	if (config_reconf(config) != 0) {
+		MSG_ERROR(msg_module, "Unable to parse plugin configuration");
+		goto cleanup_err;
+	}
+
+	if (strcmp(config->input.xml_conf->file, plugin)) {
+		MSG_ERROR(msg_module, "Collecting process must use <%s> collector", BENCH_COLLECTOR);
+		goto cleanup_err;
+	}
+
+	preprocessor_set_configurator(config);
+
+	if (output_manager_start() != 0) {
+		MSG_ERROR(msg_module, "Output Manager initialization failed");
+		output_manager_config = NULL;
+		goto cleanup_err;
+	}
+
+	affinity_set(config->input.xml_conf->cpu_affinity, "input");
+
+	/* Replay the input */
+	main_tid = syscall(SYS_gettid);
+	bench_threads_sample(threads, &threads_cnt, 1, main_tid);
+	start = bench_time(CLOCK_MONOTONIC);
+	input_cpu = bench_time(CLOCK_THREAD_CPUTIME_ID);
+
+	while (!terminating) {
+		get_retval = config->input.get(config->input.config, &input_info, &packet, &source_status);
+		if (get_retval < 0) {
+			if (packet) {
+				free(packet);
+				packet = NULL;
+			}
+
+			if (get_retval == INPUT_ERROR) {
+				MSG_ERROR(msg_module, "Input plugin failed");
+				break;
+			}
+			continue;
+		} else if (get_retval == INPUT_CLOSED) {
+			/* sources are closed after the measurement, closing stops their Data Managers */
+			if (packet) {
+				free(packet);
+				packet = NULL;
+			}
+			continue;
+		}
+
+		/* remember sources for counters of packets and data records */
+		if (source_status == SOURCE_STATUS_NEW && sources_cnt < BENCH_MAX_SOURCES) {
+			sources[sources_cnt++] = input_info;
+		}
+
+		preprocessor_parse_msg(packet, get_retval, input_info, source_status);
+		source_status = SOURCE_STATUS_OPENED;
+		packet = NULL;
+		input_info = NULL;
+	}
+
+	input_end = bench_time(CLOCK_MONOTONIC);
+	input_cpu = bench_time(CLOCK_THREAD_CPUTIME_ID) - input_cpu;
+
+	bench_wait_idle(threads, &threads_cnt, main_tid);
+	end = bench_time(CLOCK_MONOTONIC) - (uint64_t) BENCH_IDLE_CHECKS * BENCH_IDLE_CHECK_US * 1000;
+	if (end < input_end) {
+		end = input_end;
+	}
+
+	for (i = 0; i < sources_cnt; ++i) {
+		packets += sources[i]->packets;
+		records += sources[i]->data_records;
+	}
+
+	/* Report */
+	if (output) {
+		file = fopen(output, "w");
+		if (!file) {
+			MSG_ERROR(msg_module, "Unable to open '%s': %s", output, strerror(errno));
+			file = stdout;
+		}
+	}
+
+	fprintf(file, "{\n\t\"config\": ");
+	bench_json_string(file, startup_config);
+	fprintf(file, ",\n\t\"ring_buffer_size\": %d", ring_buffer_size);
+	fprintf(file, ",\n\t\"packets\": %" PRIu64 ",\n\t\"data_records\": %" PRIu64, packets, records);
+	fprintf(file, ",\n\t\"seconds\": %.3f,\n\t\"input_seconds\": %.3f", (end - start) / 1e9, (input_end - start) / 1e9);
+	fprintf(file, ",\n\t\"packets_per_sec\": %.0f", packets * 1e9 / (end - start));
+	fprintf(file, ",\n\t\"data_records_per_sec\": %.0f", records * 1e9 / (end - start));
+	fprintf(file, ",\n\t\"cpu\": ");
+	bench_print_cpu(file, threads, threads_cnt, main_tid, input_cpu, end - start);
+	fprintf(file, ",\n\t\"latency\": ");
+	latency_print_json(file, "\t");
+	fprintf(file, "\n}\n");
+
+	if (file != stdout) {
+		fclose(file);
+	}
+
+	goto cleanup;
+
+cleanup_err:
+	retval = EXIT_FAILURE;
+
+cleanup:
+	/* Tear down like ipfixcol does */
+	for (i = 0; i < sources_cnt; ++i) {
+		preprocessor_parse_msg(NULL, INPUT_CLOSED, sources[i], SOURCE_STATUS_CLOSED);
+	}
+
+	preprocessor_close();
+
+	if (config) {
+		config_stop_inter(config);
+	}
+
+	if (output_manager_config) {
+		output_manager_close(output_manager_config);
+	}
+
+	if (config) {
+		config_destroy(config);
+	}
+
+	latency_destroy();
+
+	if (template_mgr) {
+		tm_destroy(template_mgr);
+	}
+
+	unlink(bench_config);
+	free(bench_config);
+
+	xmlCleanupThreads();
+	xmlCleanupParser();
+
+	return retval;
+}
@@ -0,0 +1,139 @@
+/**
+ * \file rbuffer_bench.c
+ * \brief Benchmark of single and batched ring buffer operations
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include "../../src/queues.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define STAGES 4 // Number of intermediate stages between queues
+#define BUFFER_SIZE 8192 // Size of the ring buffers
+#define MSG_COUNT 2000000 // How many messages go through the chain
+#define BATCH 64 // Maximal batch size
+
+struct ring_buffer *queues[STAGES + 1];
+struct ipfix_message messages[BUFFER_SIZE];
+int batched;
+
+/* Move messages from one queue to the next one */
+void *stage_thread(void *arg)
+{
+	int num = *((int *) arg);
+	struct ring_buffer *in = queues[num], *out = num < STAGES ? queues[num + 1] : NULL;
+	struct ipfix_message *msgs[BATCH];
+	unsigned int index, count;
+	int done = 0;
+
+	while (done < MSG_COUNT) {
+		index = -1;
+		if (batched) {
+			count = rbuffer_read_batch(in, &index, msgs, BATCH);
+			if (out) {
+				rbuffer_write_batch(out, msgs, count, 1);
+			}
+			rbuffer_remove_references(in, index, count, 0);
+		} else {
+			count = 1;
+			msgs[0] = rbuffer_read(in, &index);
+			if (out) {
+				rbuffer_write(out, msgs[0], 1);
+			}
+			rbuffer_remove_reference(in, index, 0);
+		}
+		done += count;
+	}
+
+	return NULL;
+}
+
+/* Run the chain and return time per message in nanoseconds */
+double run_chain()
+{
+	pthread_t threads[STAGES + 1];
+	int idarray[STAGES + 1];
+	struct timespec start, end;
+	int i;
+
+	for (i = 0; i <= STAGES; i++) {
+		queues[i] = rbuffer_init(BUFFER_SIZE);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i <= STAGES; i++) {
+		idarray[i] = i;
+		pthread_create(&threads[i], NULL, stage_thread, &idarray[i]);
+	}
+
+	/* input is written in the same way as by preprocessor (one by one) */
+	for (i = 0; i < MSG_COUNT; i++) {
+		rbuffer_write(queues[0], &messages[i % BUFFER_SIZE], 1);
+	}
+
+	for (i = 0; i <= STAGES; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (i = 0; i <= STAGES; i++) {
+		rbuffer_free(queues[i]);
+	}
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / MSG_COUNT;
+}
+
+int main()
+{
+	double single, batch;
+
+	memset(messages, 0, sizeof(messages));
+
+	batched = 0;
+	single = run_chain();
+	batched = 1;
+	batch = run_chain();
+
+	printf("%d messages, %d stages\n", MSG_COUNT, STAGES);
+	printf("single:  %.1f ns per message\n", single);
+	printf("batched: %.1f ns per message (batch of up to %d)\n", batch, BATCH);
+
+	return 0;
+}
@@ -37,7 +37,7 @@
  *
  */
 
-#include "../../../src/queues.h" // We expect that ring buffer API does not change
+#include "../../src/queues.h" // We expect that ring buffer API does not change
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -41,13 +41,15 @@
 #include <ipfixcol/intermediate.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include <GeoIP.h>
 #include <geoip.h>
 #include "countrycode.h"
-
-#define IPv4 4
-#define IPv6 6
+#include "trie.h"
 
 #define FIELD_IPV4_SRC 8
 #define FIELD_IPV4_DST 12
@@ -55,12 +57,55 @@
 #define FIELD_IPV6_SRC 27
 #define FIELD_IPV6_DST 28
 
+/* Number of records resolved together */
+#define GEOIP_BATCH 64
+
+/* Key of the hot-prefix caches (/24 and /48) */
+#define GEOIP_CACHE4_BYTES 3
+#define GEOIP_CACHE6_BYTES 6
+
 /* API version constant */
 IPFIXCOL_API_VERSION;
 
+/* Messages are processed independently, plugin can be replicated */
+IPFIXCOL_INTERMEDIATE_REPLICABLE;
+
 /* Identifier for verbose macros */
 static const char *msg_module = "geoip";
 
+/**
+ * \brief Address fields of a data record
+ */
+enum geoip_addr {
+	GEOIP_SRC4,
+	GEOIP_DST4,
+	GEOIP_SRC6,
+	GEOIP_DST6,
+	GEOIP_ADDR_CNT
+};
+
+/** IPFIX fields of addresses */
+static const uint16_t geoip_addr_fields[GEOIP_ADDR_CNT] = {
+	FIELD_IPV4_SRC, FIELD_IPV4_DST, FIELD_IPV6_SRC, FIELD_IPV6_DST
+};
+
+/**
+ * \brief Lookup tables built from GeoIP databases
+ */
+struct geoip_tables {
+	struct trie *trie4;	/**< IPv4 address -> numeric country code */
+	struct trie *trie6;	/**< IPv6 address -> numeric country code */
+};
+
+/**
+ * \brief Offsets of address fields in records of one template
+ */
+struct geoip_offsets {
+	struct ipfix_template *templ;	/**< Template */
+	int fixed;						/**< Template without variable-length fields */
+	int offset[GEOIP_ADDR_CNT];		/**< Offsets of fields (-1 = missing) */
+};
+
 /**
  * \brief Plugin's configuration structure
  */
@@ -68,10 +113,36 @@ struct geoip_conf {
 	void *ip_config;	/**< intermediate process config */
 	char *path;			/**< path to database file */
 	char *path6;		/**< path to IPv6 database file */
-	GeoIP *country_db;	/**< MaxMind GeoIP DB */
-	GeoIP *country_db6;	/**< IPv6 version */
+	uint32_t reload;	/**< interval of database checks in seconds (0 = never) */
+	time_t mtime;		/**< modification time of loaded database */
+	time_t mtime6;		/**< modification time of loaded IPv6 database */
+	struct geoip_tables *tables;	/**< tables used for lookups */
+	struct geoip_tables *pending;	/**< reloaded tables waiting for swap */
+	struct trie_cache cache4;		/**< hot IPv4 prefixes */
+	struct trie_cache cache6;		/**< hot IPv6 prefixes */
+	pthread_t reloader;				/**< database reloading thread */
+	int reloader_running;			/**< reloader has been started */
+	int stop;						/**< stop request for reloader */
+	pthread_mutex_t mutex;			/**< mutex for stop request */
+	pthread_cond_t cond;			/**< stop request signal */
 };
 
+/**
+ * \brief Free lookup tables
+ *
+ * \param[in] tables lookup tables
+ */
+void geoip_tables_free(struct geoip_tables *tables)
+{
+	if (!tables) {
+		return;
+	}
+
+	trie_free(tables->trie4);
+	trie_free(tables->trie6);
+	free(tables);
+}
+
 /**
  * \brief Free configuration structure
  * 
@@ -80,14 +151,21 @@ struct geoip_conf {
 void geoip_free_config(struct geoip_conf *conf)
 {
 	if (conf) {
-		/* Close databases */
-		if (conf->country_db) {
-			GeoIP_delete(conf->country_db);
-		}
-		
-		if (conf->country_db6) {
-			GeoIP_delete(conf->country_db6);
+		/* Stop reloader */
+		if (conf->reloader_running) {
+			pthread_mutex_lock(&conf->mutex);
+			conf->stop = 1;
+			pthread_cond_signal(&conf->cond);
+			pthread_mutex_unlock(&conf->mutex);
+			pthread_join(conf->reloader, NULL);
 		}
+
+		pthread_cond_destroy(&conf->cond);
+		pthread_mutex_destroy(&conf->mutex);
+
+		/* Free lookup tables */
+		geoip_tables_free(conf->tables);
+		geoip_tables_free(conf->pending);
 		
 		/* Free paths */
 		if (conf->path) {
@@ -137,6 +215,10 @@ int process_startup_xml(struct geoip_conf *conf, char *params)
 			conf->path = (char *) xmlNodeListGetString(doc, node->children, 1);
 		} else if (!xmlStrcmp(node->name, (const xmlChar *) "path6")) {
 			conf->path6 = (char *) xmlNodeListGetString(doc, node->children, 1);
+		} else if (!xmlStrcmp(node->name, (const xmlChar *) "reload")) {
+			char *reload = (char *) xmlNodeListGetString(doc, node->children, 1);
+			conf->reload = reload ? strtoul(reload, NULL, 10) : 0;
+			xmlFree(reload);
 		} else {
 			MSG_WARNING(msg_module, "Unknown element %s", (char *) node->name);
 		}
@@ -146,6 +228,257 @@ int process_startup_xml(struct geoip_conf *conf, char *params)
 	return 0;
 }
 
+/**
+ * \brief Get modification time of a file
+ *
+ * \param[in] path path to the file (may be NULL)
+ * \return modification time or 0
+ */
+time_t geoip_file_mtime(const char *path)
+{
+	struct stat st;
+
+	if (!path || stat(path, &st) != 0) {
+		return 0;
+	}
+
+	return st.st_mtime;
+}
+
+/**
+ * \brief Convert GeoIP country ID to numeric country code
+ *
+ * \param[in] id GeoIP country ID
+ * \return numeric code (0 if unknown)
+ */
+static uint16_t geoip_country_code(int id)
+{
+	if (id < 0 || (size_t) id >= sizeof(iso3166_GeoIP_country_codes) / sizeof(iso3166_GeoIP_country_codes[0])) {
+		return 0;
+	}
+
+	return iso3166_GeoIP_country_codes[id].num_code;
+}
+
+/**
+ * \brief Build IPv4 trie from GeoIP database
+ *
+ * Networks of the database are enumerated in ascending order, each lookup
+ * returns the network's mask, so the next lookup starts right after it.
+ *
+ * \param[in] db GeoIP database
+ * \return new trie or NULL
+ */
+struct trie *geoip_trie_build(GeoIP *db)
+{
+	struct trie *t = trie_create(4);
+	uint64_t ip = 0;
+	uint8_t prefix[4];
+	int id, mask;
+
+	if (!t) {
+		return NULL;
+	}
+
+	while (ip <= UINT32_MAX) {
+		id = GeoIP_id_by_ipnum(db, (unsigned long) ip);
+		mask = GeoIP_last_netmask(db);
+		if (mask < 0 || mask > 32) {
+			MSG_ERROR(msg_module, "Invalid network mask %d in GeoIP database", mask);
+			trie_free(t);
+			return NULL;
+		}
+
+		prefix[0] = ip >> 24;
+		prefix[1] = ip >> 16;
+		prefix[2] = ip >> 8;
+		prefix[3] = ip;
+
+		if (trie_insert(t, prefix, mask, geoip_country_code(id)) != 0) {
+			MSG_ERROR(msg_module, "Unable to build IPv4 lookup table");
+			trie_free(t);
+			return NULL;
+		}
+
+		ip += 1ULL << (32 - mask);
+	}
+
+	return t;
+}
+
+/**
+ * \brief Build IPv6 trie from GeoIP database
+ *
+ * \param[in] db GeoIPv6 database
+ * \return new trie or NULL
+ */
+struct trie *geoip_trie_build6(GeoIP *db)
+{
+	struct trie *t = trie_create(16);
+	uint64_t hi = 0, lo = 0;
+	geoipv6_t ipnum;
+	int i, id, mask;
+
+	if (!t) {
+		return NULL;
+	}
+
+	for (;;) {
+		for (i = 0; i < 8; ++i) {
+			ipnum.s6_addr[i] = hi >> (56 - 8 * i);
+			ipnum.s6_addr[i + 8] = lo >> (56 - 8 * i);
+		}
+
+		id = GeoIP_id_by_ipnum_v6(db, ipnum);
+		mask = GeoIP_last_netmask(db);
+		if (mask < 0 || mask > 128) {
+			MSG_ERROR(msg_module, "Invalid network mask %d in GeoIPv6 database", mask);
+			trie_free(t);
+			return NULL;
+		}
+
+		if (trie_insert(t, ipnum.s6_addr, mask, geoip_country_code(id)) != 0) {
+			MSG_ERROR(msg_module, "Unable to build IPv6 lookup table");
+			trie_free(t);
+			return NULL;
+		}
+
+		/* Move to the next network, stop after the last one */
+		if (mask == 0) {
+			break;
+		} else if (mask <= 64) {
+			uint64_t step = 1ULL << (64 - mask);
+			lo = 0;
+			if (hi + step < hi) {
+				break;
+			}
+			hi += step;
+		} else {
+			lo += 1ULL << (128 - mask);
+			if (lo == 0 && ++hi == 0) {
+				break;
+			}
+		}
+	}
+
+	return t;
+}
+
+/**
+ * \brief Open GeoIP databases and build lookup tables
+ *
+ * The databases are closed afterwards, lookups use only the tables.
+ *
+ * \param[in] conf plugin configuration
+ * \return new tables or NULL
+ */
+struct geoip_tables *geoip_tables_load(struct geoip_conf *conf)
+{
+	struct geoip_tables *tables;
+	GeoIP *db;
+
+	tables = calloc(1, sizeof(struct geoip_tables));
+	if (!tables) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
+		return NULL;
+	}
+
+	/* IPv4 GeoIP database */
+	if (conf->path) {
+		db = GeoIP_open(conf->path, GEOIP_MEMORY_CACHE);
+	} else {
+		db = GeoIP_new(GEOIP_MEMORY_CACHE);
+	}
+
+	if (!db) {
+		MSG_ERROR(msg_module, "Error while opening GeoIP database");
+		geoip_tables_free(tables);
+		return NULL;
+	}
+
+	tables->trie4 = geoip_trie_build(db);
+	GeoIP_delete(db);
+
+	/* IPv6 GeoIP database */
+	if (conf->path6) {
+		db = GeoIP_open(conf->path6, GEOIP_MEMORY_CACHE);
+	} else {
+		db = GeoIP_open(GEOIPV6_DAT, GEOIP_MEMORY_CACHE);
+//		db = GeoIP_open_type(GEOIP_COUNTRY_EDITION_V6, GEOIP_MEMORY_CACHE);
+	}
+
+	if (!db) {
+		MSG_ERROR(msg_module, "Error while opening GeoIPv6 database");
+		geoip_tables_free(tables);
+		return NULL;
+	}
+
+	tables->trie6 = geoip_trie_build6(db);
+	GeoIP_delete(db);
+
+	if (!tables->trie4 || !tables->trie6) {
+		geoip_tables_free(tables);
+		return NULL;
+	}
+
+	/* Share identical subtrees, failure only wastes memory */
+	trie_compact(tables->trie4);
+	trie_compact(tables->trie6);
+
+	MSG_INFO(msg_module, "Lookup tables built (IPv4: %zu kB, IPv6: %zu kB)",
+		trie_size(tables->trie4) / 1024, trie_size(tables->trie6) / 1024);
+	return tables;
+}
+
+/**
+ * \brief Database reloading thread
+ *
+ * Checks modification times of configured database files and rebuilds
+ * the lookup tables when they change. New tables are swapped by the
+ * processing thread.
+ *
+ * \param[in] arg plugin configuration
+ * \return NULL
+ */
+void *geoip_reloader(void *arg)
+{
+	struct geoip_conf *conf = (struct geoip_conf *) arg;
+	struct geoip_tables *tables;
+	struct timespec ts;
+	time_t mtime, mtime6;
+
+	pthread_mutex_lock(&conf->mutex);
+	while (!conf->stop) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += conf->reload;
+		pthread_cond_timedwait(&conf->cond, &conf->mutex, &ts);
+		if (conf->stop) {
+			break;
+		}
+		pthread_mutex_unlock(&conf->mutex);
+
+		mtime = geoip_file_mtime(conf->path);
+		mtime6 = geoip_file_mtime(conf->path6 ? conf->path6 : GEOIPV6_DAT);
+
+		if (mtime != conf->mtime || mtime6 != conf->mtime6) {
+			MSG_INFO(msg_module, "GeoIP database changed, reloading");
+
+			tables = geoip_tables_load(conf);
+			if (tables) {
+				/* Replace tables that have not been picked up yet */
+				geoip_tables_free(__sync_lock_test_and_set(&conf->pending, tables));
+				conf->mtime = mtime;
+				conf->mtime6 = mtime6;
+			}
+		}
+
+		pthread_mutex_lock(&conf->mutex);
+	}
+	pthread_mutex_unlock(&conf->mutex);
+
+	return NULL;
+}
+
 /**
  * \brief Plugin initialization
  * 
@@ -172,6 +505,9 @@ int intermediate_init(char* params, void* ip_config, uint32_t ip_id, struct ipfi
 		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)", __FILE__, __LINE__);
 		return 1;
 	}
+
+	pthread_mutex_init(&conf->mutex, NULL);
+	pthread_cond_init(&conf->cond, NULL);
 	
 	/* Process configuration */
 	if (process_startup_xml(conf, params) != 0) {
@@ -179,31 +515,26 @@ int intermediate_init(char* params, void* ip_config, uint32_t ip_id, struct ipfi
 		return 1;
 	}
 	
-	/* Initialize IPv4 GeoIP database */
-	if (conf->path) {
-		conf->country_db = GeoIP_open(conf->path, GEOIP_MEMORY_CACHE);
-	} else {
-		conf->country_db = GeoIP_new(GEOIP_MEMORY_CACHE);
-	}
-	
-	if (!conf->country_db) {
-		MSG_ERROR(msg_module, "Error while opening GeoIP database");
+	/* Build lookup tables from GeoIP databases */
+	conf->mtime = geoip_file_mtime(conf->path);
+	conf->mtime6 = geoip_file_mtime(conf->path6 ? conf->path6 : GEOIPV6_DAT);
+	conf->tables = geoip_tables_load(conf);
+	if (!conf->tables) {
 		geoip_free_config(conf);
 		return 1;
 	}
-	
-	/* Initialize IPv6 GeoIP database */
-	if (conf->path6) {
-		conf->country_db6 = GeoIP_open(conf->path6, GEOIP_MEMORY_CACHE);
-	} else {
-		conf->country_db6 = GeoIP_open(GEOIPV6_DAT, GEOIP_MEMORY_CACHE);
-//		conf->country_db6 = GeoIP_open_type(GEOIP_COUNTRY_EDITION_V6, GEOIP_MEMORY_CACHE);
-	}
-	
-	if (!conf->country_db6) {
-		MSG_ERROR(msg_module, "Error while opening GeoIPv6 database");
-		geoip_free_config(conf);
-		return 1;
+
+	trie_cache_clear(&conf->cache4, GEOIP_CACHE4_BYTES);
+	trie_cache_clear(&conf->cache6, GEOIP_CACHE6_BYTES);
+
+	/* Start database reloader */
+	if (conf->reload > 0) {
+		if (pthread_create(&conf->reloader, NULL, geoip_reloader, conf) != 0) {
+			MSG_ERROR(msg_module, "Unable to start database reloading thread");
+			geoip_free_config(conf);
+			return 1;
+		}
+		conf->reloader_running = 1;
 	}
 	
 	/* Save configuration */
@@ -215,51 +546,105 @@ int intermediate_init(char* params, void* ip_config, uint32_t ip_id, struct ipfi
 }
 
 /**
- * \brief Get country code for given data record and given address (source or destination)
- * 
+ * \brief Find offsets of address fields of a template
+ *
+ * \param[out] off offsets
+ * \param[in] templ template
+ */
+static void geoip_offsets_update(struct geoip_offsets *off, struct ipfix_template *templ)
+{
+	int i, offset;
+
+	off->templ = templ;
+	off->fixed = !(templ->data_length & 0x80000000);
+
+	for (i = 0; i < GEOIP_ADDR_CNT; ++i) {
+		off->offset[i] = -1;
+		if (off->fixed && template_get_field(templ, 0, geoip_addr_fields[i], &offset)) {
+			off->offset[i] = offset;
+		}
+	}
+}
+
+/**
+ * \brief Get address field of a data record
+ *
+ * \param[in] off offsets of the record's template
+ * \param[in] rec data record
+ * \param[in] addr address field
+ * \return pointer to the address or NULL
+ */
+static inline uint8_t *geoip_addr_get(const struct geoip_offsets *off, const struct ipfix_record *rec, int addr)
+{
+	int size;
+
+	if (off->fixed) {
+		return (off->offset[addr] < 0) ? NULL : (uint8_t *) rec->record + off->offset[addr];
+	}
+
+	return data_record_get_field((uint8_t *) rec->record, rec->templ, 0, geoip_addr_fields[addr], &size);
+}
+
+/**
+ * \brief Fill country codes of a batch of data records
+ *
+ * Addresses of all records are collected first and then resolved together
+ * per address family.
+ *
  * \param[in] conf plugin's configuration
- * \param[in] mdata data record's metadata
- * \param[in] ipv4_field IPv4 field
- * \param[in] ipv6_field IPv6 alternative
- * \return country code
+ * \param[in,out] mdata metadata of the records
+ * \param[in] count number of records (max. GEOIP_BATCH)
+ * \param[in,out] off offsets of the last template
  */
-uint16_t geoip_get_country_code(struct geoip_conf *conf, struct metadata *mdata, int ipv4_field, int ipv6_field)
+static void geoip_process_batch(struct geoip_conf *conf, struct metadata *mdata, int count, struct geoip_offsets *off)
 {
-	void *data;
-	
-	/* Get address */
-	int ipv = IPv4;
-	data = data_record_get_field(mdata->record.record, mdata->record.templ, 0, ipv4_field, NULL);
-	if (!data) {
-		data = data_record_get_field(mdata->record.record, mdata->record.templ, 0, ipv6_field, NULL);
-		ipv = IPv6;
+	const uint8_t *addr4[2 * GEOIP_BATCH], *addr6[2 * GEOIP_BATCH];
+	uint16_t code4[2 * GEOIP_BATCH], code6[2 * GEOIP_BATCH];
+	uint16_t slot4[2 * GEOIP_BATCH], slot6[2 * GEOIP_BATCH];
+	int i, dir, n4 = 0, n6 = 0;
+	uint8_t *data;
+
+	/* Collect addresses, slot = record * 2 + direction (0 = source) */
+	for (i = 0; i < count; ++i) {
+		struct ipfix_record rec = mdata[i].record;
+		if (rec.templ != off->templ) {
+			geoip_offsets_update(off, rec.templ);
+		}
+
+		mdata[i].srcCountry = 0;
+		mdata[i].dstCountry = 0;
+
+		for (dir = 0; dir < 2; ++dir) {
+			if ((data = geoip_addr_get(off, &rec, GEOIP_SRC4 + dir)) != NULL) {
+				addr4[n4] = data;
+				slot4[n4++] = i * 2 + dir;
+			} else if ((data = geoip_addr_get(off, &rec, GEOIP_SRC6 + dir)) != NULL) {
+				addr6[n6] = data;
+				slot6[n6++] = i * 2 + dir;
+			}
+		}
 	}
-	
-	if (!data) {
-		return 0;
+
+	/* Resolve addresses */
+	trie_lookup_batch(conf->tables->trie4, &conf->cache4, addr4, code4, n4);
+	trie_lookup_batch(conf->tables->trie6, &conf->cache6, addr6, code6, n6);
+
+	/* Fill numeric codes */
+	for (i = 0; i < n4; ++i) {
+		if (slot4[i] & 1) {
+			mdata[slot4[i] >> 1].dstCountry = code4[i];
+		} else {
+			mdata[slot4[i] >> 1].srcCountry = code4[i];
+		}
 	}
-	
-	/* Country ID */
-	uint16_t id = 0;
-	
-	/* Get country ID */
-	if (ipv == IPv4) {
-		id = GeoIP_id_by_ipnum(conf->country_db, *((uint32_t *) data));
-	} else {
-		/* IPv6 address */
-		uint32_t *addr = (uint32_t *) data;
-		
-		geoipv6_t ipnum;
-		ipnum.s6_addr32[0] = htonl(addr[3]);
-		ipnum.s6_addr32[1] = htonl(addr[2]);
-		ipnum.s6_addr32[2] = htonl(addr[1]);
-		ipnum.s6_addr32[3] = htonl(addr[0]);
-		
-		id = GeoIP_id_by_ipnum_v6(conf->country_db6, ipnum);
+
+	for (i = 0; i < n6; ++i) {
+		if (slot6[i] & 1) {
+			mdata[slot6[i] >> 1].dstCountry = code6[i];
+		} else {
+			mdata[slot6[i] >> 1].srcCountry = code6[i];
+		}
 	}
-	
-	/* Return numeric code */
-	return iso3166_GeoIP_country_codes[id].num_code;
 }
 
 /**
@@ -273,16 +658,28 @@ int intermediate_process_message(void* config, void* message)
 {
 	struct geoip_conf *conf = (struct geoip_conf *) config;
 	struct ipfix_message *msg = (struct ipfix_message *) message;
+	struct geoip_offsets off = {NULL, 0, {-1, -1, -1, -1}};
+	struct geoip_tables *tables;
+	int i, count;
+
+	/* Swap reloaded tables */
+	tables = __sync_lock_test_and_set(&conf->pending, NULL);
+	if (tables) {
+		geoip_tables_free(conf->tables);
+		conf->tables = tables;
+		trie_cache_clear(&conf->cache4, GEOIP_CACHE4_BYTES);
+		trie_cache_clear(&conf->cache6, GEOIP_CACHE6_BYTES);
+		MSG_INFO(msg_module, "Using reloaded GeoIP database");
+	}
 	
-	struct metadata *mdata;
-	
-	/* Process each data record */
-	for (int i = 0; i < msg->data_records_count; ++i) {
-		mdata = &(msg->metadata[i]);
-		
-		/* Fill country codes */
-		mdata->srcCountry = geoip_get_country_code(conf, mdata, FIELD_IPV4_SRC, FIELD_IPV6_SRC);
-		mdata->dstCountry = geoip_get_country_code(conf, mdata, FIELD_IPV4_DST, FIELD_IPV6_DST);
+	/* Process data records in batches */
+	for (i = 0; msg->metadata && i < msg->data_records_count; i += count) {
+		count = msg->data_records_count - i;
+		if (count > GEOIP_BATCH) {
+			count = GEOIP_BATCH;
+		}
+
+		geoip_process_batch(conf, &(msg->metadata[i]), count, &off);
 	}
 	
 	/* Pass message to the next plugin/Output Manager */
@@ -300,9 +697,15 @@ int intermediate_close(void *config)
 {
 	MSG_DEBUG(msg_module, "Closing");
 	struct geoip_conf *conf = (struct geoip_conf *) config;
+
+	if (conf->cache4.lookups + conf->cache6.lookups > 0) {
+		MSG_DEBUG(msg_module, "Hot-prefix cache hits: %" PRIu64 "/%" PRIu64 " (IPv4), %" PRIu64 "/%" PRIu64 " (IPv6)",
+			conf->cache4.hits, conf->cache4.lookups, conf->cache6.hits, conf->cache6.lookups);
+	}
 	
 	/* Release configuration */
 	geoip_free_config(conf);
 	
 	return 0;
 }
+
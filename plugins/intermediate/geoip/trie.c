@@ -0,0 +1,414 @@
+/**
+ * \file trie.c
+ * \brief Multibit trie for IP prefix lookups
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "trie.h"
+
+/** Maximal number of chunks (index must fit into entry shifted by 8 bits) */
+#define TRIE_CHUNK_MAX (1U << 23)
+
+/**
+ * \brief Context of trie compaction
+ */
+struct trie_compact_ctx {
+	const uint32_t *src;    /**< Original chunks */
+	uint32_t *dst;          /**< Compacted chunks */
+	uint32_t cnt;           /**< Number of compacted chunks */
+	uint32_t *hash;         /**< Compacted chunk + 1 per hash slot (0 = empty) */
+	uint32_t hash_mask;     /**< Number of hash slots - 1 */
+};
+
+/**
+ * \brief Create an empty trie
+ */
+struct trie *trie_create(int bytes)
+{
+	struct trie *t;
+
+	if (bytes != 4 && bytes != 16) {
+		return NULL;
+	}
+
+	t = calloc(1, sizeof(struct trie));
+	if (!t) {
+		return NULL;
+	}
+
+	t->root = calloc(TRIE_ROOT_SIZE, sizeof(uint32_t));
+	if (!t->root) {
+		free(t);
+		return NULL;
+	}
+
+	t->bytes = bytes;
+	return t;
+}
+
+/**
+ * \brief Allocate a new chunk filled with a value
+ *
+ * \param[in,out] t Trie
+ * \param[in] value Value of all entries
+ * \return Index of the chunk or -1
+ */
+static int64_t trie_chunk_new(struct trie *t, uint32_t value)
+{
+	uint32_t *chunk;
+	int i;
+
+	if (t->chunk_cnt == t->chunk_max) {
+		uint32_t max = t->chunk_max ? t->chunk_max * 2 : 1024;
+		if (max > TRIE_CHUNK_MAX) {
+			return -1;
+		}
+
+		chunk = realloc(t->chunks, (size_t) max * TRIE_CHUNK_SIZE * sizeof(uint32_t));
+		if (!chunk) {
+			return -1;
+		}
+
+		t->chunks = chunk;
+		t->chunk_max = max;
+	}
+
+	chunk = t->chunks + ((size_t) t->chunk_cnt << 8);
+	for (i = 0; i < TRIE_CHUNK_SIZE; ++i) {
+		chunk[i] = value;
+	}
+
+	return t->chunk_cnt++;
+}
+
+/**
+ * \brief Insert a prefix
+ */
+int trie_insert(struct trie *t, const uint8_t *prefix, int len, uint16_t value)
+{
+	int64_t chunk = -1, new_chunk;
+	uint32_t *table = t->root;
+	uint32_t idx = (prefix[0] << 8) | prefix[1];
+	uint32_t entry, span, first, i;
+	int end = TRIE_ROOT_BITS, byte = 2;
+
+	if (len < 0 || len > t->bytes * 8) {
+		return 1;
+	}
+
+	/* Descend to the level containing the end of the prefix */
+	while (len > end) {
+		entry = table[idx];
+		if (!(entry & TRIE_CHUNK)) {
+			new_chunk = trie_chunk_new(t, entry);
+			if (new_chunk < 0) {
+				return 1;
+			}
+
+			/* Chunks might have been reallocated */
+			table = (chunk < 0) ? t->root : t->chunks + (chunk << 8);
+			entry = TRIE_CHUNK | (uint32_t) new_chunk;
+			table[idx] = entry;
+		}
+
+		chunk = entry & ~TRIE_CHUNK;
+		table = t->chunks + (chunk << 8);
+		idx = prefix[byte++];
+		end += 8;
+	}
+
+	/* Fill all entries covered by the prefix */
+	span = 1U << (end - len);
+	first = idx & ~(span - 1);
+	for (i = first; i < first + span; ++i) {
+		table[i] = value;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Hash of a chunk
+ */
+static uint32_t trie_chunk_hash(const uint32_t *chunk)
+{
+	uint32_t hash = 2166136261U;
+	int i;
+
+	for (i = 0; i < TRIE_CHUNK_SIZE; ++i) {
+		hash = (hash ^ chunk[i]) * 16777619U;
+	}
+
+	return hash;
+}
+
+/**
+ * \brief Compact a subtree of an entry
+ *
+ * Children are stored before their parent so that chunks of one subtree
+ * are next to each other.
+ *
+ * \param[in,out] ctx Compaction context
+ * \param[in] entry Original entry
+ * \return Compacted entry
+ */
+static uint32_t trie_compact_entry(struct trie_compact_ctx *ctx, uint32_t entry)
+{
+	uint32_t tmp[TRIE_CHUNK_SIZE];
+	const uint32_t *src;
+	uint32_t hash, slot;
+	int i, uniform = 1;
+
+	if (!(entry & TRIE_CHUNK)) {
+		return entry;
+	}
+
+	src = ctx->src + ((size_t) (entry & ~TRIE_CHUNK) << 8);
+	for (i = 0; i < TRIE_CHUNK_SIZE; ++i) {
+		tmp[i] = trie_compact_entry(ctx, src[i]);
+		if (tmp[i] != tmp[0]) {
+			uniform = 0;
+		}
+	}
+
+	/* The whole chunk maps to a single value */
+	if (uniform && !(tmp[0] & TRIE_CHUNK)) {
+		return tmp[0];
+	}
+
+	/* Share identical chunks */
+	hash = trie_chunk_hash(tmp) & ctx->hash_mask;
+	while ((slot = ctx->hash[hash]) != 0) {
+		if (!memcmp(ctx->dst + ((size_t) (slot - 1) << 8), tmp, sizeof(tmp))) {
+			return TRIE_CHUNK | (slot - 1);
+		}
+		hash = (hash + 1) & ctx->hash_mask;
+	}
+
+	memcpy(ctx->dst + ((size_t) ctx->cnt << 8), tmp, sizeof(tmp));
+	ctx->hash[hash] = ++ctx->cnt;
+	return TRIE_CHUNK | (ctx->cnt - 1);
+}
+
+/**
+ * \brief Compact a trie
+ */
+int trie_compact(struct trie *t)
+{
+	struct trie_compact_ctx ctx;
+	uint32_t hash_size = 1;
+	uint32_t *shrunk;
+	int i;
+
+	if (t->chunk_cnt == 0) {
+		return 0;
+	}
+
+	while (hash_size < t->chunk_cnt * 2) {
+		hash_size <<= 1;
+	}
+
+	ctx.src = t->chunks;
+	ctx.cnt = 0;
+	ctx.hash_mask = hash_size - 1;
+	ctx.dst = malloc((size_t) t->chunk_cnt * TRIE_CHUNK_SIZE * sizeof(uint32_t));
+	ctx.hash = calloc(hash_size, sizeof(uint32_t));
+	if (!ctx.dst || !ctx.hash) {
+		free(ctx.dst);
+		free(ctx.hash);
+		return 1;
+	}
+
+	/* Root entries are not read again, they can be rewritten in place */
+	for (i = 0; i < TRIE_ROOT_SIZE; ++i) {
+		t->root[i] = trie_compact_entry(&ctx, t->root[i]);
+	}
+
+	free(ctx.hash);
+	free(t->chunks);
+
+	t->chunks = ctx.dst;
+	t->chunk_cnt = ctx.cnt;
+	t->chunk_max = ctx.cnt;
+
+	/* Give back unused memory */
+	if (ctx.cnt == 0) {
+		free(t->chunks);
+		t->chunks = NULL;
+	} else {
+		shrunk = realloc(t->chunks, (size_t) ctx.cnt * TRIE_CHUNK_SIZE * sizeof(uint32_t));
+		if (shrunk) {
+			t->chunks = shrunk;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Get cache key of an address
+ */
+static inline uint64_t trie_cache_key(const uint8_t *addr, int key_bytes)
+{
+	uint64_t key = 0;
+	int i;
+
+	for (i = 0; i < key_bytes; ++i) {
+		key = (key << 8) | addr[i];
+	}
+
+	return key;
+}
+
+/**
+ * \brief Get cache slot of a key
+ */
+static inline uint32_t trie_cache_slot(uint64_t key)
+{
+	return (uint32_t) ((key * 0x9E3779B97F4A7C15ULL) >> (64 - TRIE_CACHE_BITS));
+}
+
+/**
+ * \brief Resolve a batch of addresses
+ */
+void trie_lookup_batch(const struct trie *t, struct trie_cache *cache,
+		const uint8_t **addr, uint16_t *value, int count)
+{
+	uint32_t entry[TRIE_BATCH];
+	uint64_t key[TRIE_BATCH];
+	uint8_t byte[TRIE_BATCH];
+	int pending[TRIE_BATCH];
+	int base, n, i, j, cnt, next;
+	uint32_t slot;
+	const uint8_t *a;
+
+	for (base = 0; base < count; base += TRIE_BATCH) {
+		n = (count - base < TRIE_BATCH) ? count - base : TRIE_BATCH;
+		cnt = 0;
+
+		/* Hot prefixes first, prefetch root entries of the rest */
+		for (i = 0; i < n; ++i) {
+			a = addr[base + i];
+			if (cache) {
+				key[i] = trie_cache_key(a, cache->key_bytes);
+				slot = trie_cache_slot(key[i]);
+				cache->lookups++;
+				if (cache->valid[slot] && cache->key[slot] == key[i]) {
+					value[base + i] = cache->value[slot];
+					cache->hits++;
+					continue;
+				}
+			}
+
+			__builtin_prefetch(&t->root[(a[0] << 8) | a[1]]);
+			pending[cnt++] = i;
+		}
+
+		for (j = 0; j < cnt; ++j) {
+			i = pending[j];
+			a = addr[base + i];
+			entry[i] = t->root[(a[0] << 8) | a[1]];
+			byte[i] = 2;
+			if (entry[i] & TRIE_CHUNK) {
+				__builtin_prefetch(&t->chunks[((entry[i] & ~TRIE_CHUNK) << 8) | a[2]]);
+			}
+		}
+
+		/* Resolve one level of all pending addresses at a time */
+		while (cnt > 0) {
+			for (j = 0, next = 0; j < cnt; ++j) {
+				i = pending[j];
+				a = addr[base + i];
+
+				if (entry[i] & TRIE_CHUNK) {
+					entry[i] = t->chunks[((entry[i] & ~TRIE_CHUNK) << 8) | a[byte[i]++]];
+					if (entry[i] & TRIE_CHUNK) {
+						__builtin_prefetch(&t->chunks[((entry[i] & ~TRIE_CHUNK) << 8) | a[byte[i]]]);
+					}
+					pending[next++] = i;
+					continue;
+				}
+
+				value[base + i] = (uint16_t) entry[i];
+
+				/* The value is valid for the whole cached prefix */
+				if (cache && byte[i] <= cache->key_bytes) {
+					slot = trie_cache_slot(key[i]);
+					cache->key[slot] = key[i];
+					cache->value[slot] = (uint16_t) entry[i];
+					cache->valid[slot] = 1;
+				}
+			}
+			cnt = next;
+		}
+	}
+}
+
+/**
+ * \brief Clear a hot-prefix cache
+ */
+void trie_cache_clear(struct trie_cache *cache, int key_bytes)
+{
+	memset(cache->valid, 0, sizeof(cache->valid));
+	cache->key_bytes = key_bytes;
+	cache->hits = 0;
+	cache->lookups = 0;
+}
+
+/**
+ * \brief Get memory used by a trie
+ */
+size_t trie_size(const struct trie *t)
+{
+	return TRIE_ROOT_SIZE * sizeof(uint32_t)
+		+ (size_t) t->chunk_max * TRIE_CHUNK_SIZE * sizeof(uint32_t);
+}
+
+/**
+ * \brief Free a trie
+ */
+void trie_free(struct trie *t)
+{
+	if (!t) {
+		return;
+	}
+
+	free(t->chunks);
+	free(t->root);
+	free(t);
+}
@@ -0,0 +1,177 @@
+/**
+ * \file trie.h
+ * \brief Multibit trie for IP prefix lookups
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef TRIE_H_
+#define TRIE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Addresses are looked up by the first 16 bits in the root table and then
+ * by one byte in each chunk (DIR-16-8-8 for IPv4). Entries are either values
+ * or references to chunks (TRIE_CHUNK flag). Identical chunks are shared
+ * after trie_compact().
+ */
+#define TRIE_ROOT_BITS 16
+#define TRIE_ROOT_SIZE (1 << TRIE_ROOT_BITS)
+#define TRIE_CHUNK_SIZE 256
+#define TRIE_CHUNK 0x80000000U
+
+/** Maximal number of addresses resolved together by trie_lookup_batch() */
+#define TRIE_BATCH 32
+
+/** Number of entries of the hot-prefix cache */
+#define TRIE_CACHE_BITS 12
+#define TRIE_CACHE_SIZE (1 << TRIE_CACHE_BITS)
+
+/**
+ * \brief Multibit trie
+ */
+struct trie {
+	int bytes;           /**< Address length (4 or 16) */
+	uint32_t *root;      /**< Root table (TRIE_ROOT_SIZE entries) */
+	uint32_t *chunks;    /**< Chunks (TRIE_CHUNK_SIZE entries each) */
+	uint32_t chunk_cnt;  /**< Number of used chunks */
+	uint32_t chunk_max;  /**< Number of allocated chunks */
+};
+
+/**
+ * \brief Cache of recently resolved prefixes
+ *
+ * Key is the first \a key_bytes of an address. A value is cached only if
+ * the whole prefix maps to it. The cache belongs to the looking up thread
+ * and must be cleared (trie_cache_clear) when the trie is replaced.
+ */
+struct trie_cache {
+	int key_bytes;                        /**< Prefix length in bytes (max 8) */
+	uint64_t key[TRIE_CACHE_SIZE];        /**< Cached prefixes */
+	uint16_t value[TRIE_CACHE_SIZE];      /**< Cached values */
+	uint8_t valid[TRIE_CACHE_SIZE];       /**< Non-zero if the entry is used */
+	uint64_t hits;                        /**< Number of cache hits */
+	uint64_t lookups;                     /**< Number of lookups */
+};
+
+/**
+ * \brief Create an empty trie (all addresses map to 0)
+ *
+ * \param[in] bytes Address length in bytes (4 or 16)
+ * \return New trie or NULL
+ */
+struct trie *trie_create(int bytes);
+
+/**
+ * \brief Insert a prefix
+ *
+ * Prefixes must not overlap, each one overwrites values of the covered
+ * addresses.
+ *
+ * \param[in,out] t Trie
+ * \param[in] prefix Prefix in network byte order
+ * \param[in] len Prefix length in bits
+ * \param[in] value Value (less than TRIE_CHUNK)
+ * \return 0 on success
+ */
+int trie_insert(struct trie *t, const uint8_t *prefix, int len, uint16_t value);
+
+/**
+ * \brief Merge uniform and identical chunks and order them depth-first
+ *
+ * \param[in,out] t Trie
+ * \return 0 on success (the trie is not modified on failure)
+ */
+int trie_compact(struct trie *t);
+
+/**
+ * \brief Resolve a batch of addresses
+ *
+ * Memory accesses of all addresses of one level are interleaved and
+ * prefetched before the next level is resolved.
+ *
+ * \param[in] t Trie
+ * \param[in,out] cache Hot-prefix cache (may be NULL)
+ * \param[in] addr Addresses in network byte order
+ * \param[out] value Values of the addresses
+ * \param[in] count Number of addresses
+ */
+void trie_lookup_batch(const struct trie *t, struct trie_cache *cache,
+		const uint8_t **addr, uint16_t *value, int count);
+
+/**
+ * \brief Clear a hot-prefix cache
+ *
+ * \param[out] cache Cache
+ * \param[in] key_bytes Prefix length in bytes (max 8)
+ */
+void trie_cache_clear(struct trie_cache *cache, int key_bytes);
+
+/**
+ * \brief Get memory used by a trie
+ *
+ * \param[in] t Trie
+ * \return Size in bytes
+ */
+size_t trie_size(const struct trie *t);
+
+/**
+ * \brief Free a trie
+ *
+ * \param[in] t Trie
+ */
+void trie_free(struct trie *t);
+
+/**
+ * \brief Resolve a single address
+ *
+ * \param[in] t Trie
+ * \param[in] addr Address in network byte order
+ * \return Value of the address
+ */
+static inline uint16_t trie_lookup(const struct trie *t, const uint8_t *addr)
+{
+	uint32_t entry = t->root[(addr[0] << 8) | addr[1]];
+	int byte = 2;
+
+	while (entry & TRIE_CHUNK) {
+		entry = t->chunks[((entry & ~TRIE_CHUNK) << 8) | addr[byte++]];
+	}
+
+	return (uint16_t) entry;
+}
+
+#endif /* TRIE_H_ */
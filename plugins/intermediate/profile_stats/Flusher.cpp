@@ -0,0 +1,266 @@
+/**
+ * \file Flusher.cpp
+ * \brief Counters of profiles/channels and RRD flusher thread (source file)
+ */
+/*
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is``, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdexcept>
+#include <cstring>
+#include <ctime>
+
+#include "Flusher.h"
+
+extern "C" {
+#include <ipfixcol.h>
+}
+
+// Identifier for verbose macros
+static const char *msg_module = "profilestats";
+
+/** Initial number of slots                */
+static constexpr size_t SLOTS_INIT = 64;
+
+RRD_flusher::RRD_flusher() : _current(0), _pending(false), _stop(false),
+	_job_epoch(0), _job_time(0)
+{
+	for (int epoch = 0; epoch < EPOCH_CNT; ++epoch) {
+		for (int cnt = 0; cnt < SC_CNT; ++cnt) {
+			_values[epoch][cnt].resize(SLOTS_INIT, 0);
+		}
+	}
+
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_job_cond, NULL);
+	pthread_cond_init(&_done_cond, NULL);
+
+	int ret = pthread_create(&_thread, NULL, &RRD_flusher::thread_main, this);
+	if (ret != 0) {
+		pthread_cond_destroy(&_done_cond);
+		pthread_cond_destroy(&_job_cond);
+		pthread_mutex_destroy(&_mutex);
+		throw std::runtime_error("Failed to start RRD flusher thread: "
+			+ std::string(strerror(ret)));
+	}
+}
+
+RRD_flusher::~RRD_flusher()
+{
+	pthread_mutex_lock(&_mutex);
+	_stop = true;
+	pthread_cond_signal(&_job_cond);
+	pthread_mutex_unlock(&_mutex);
+
+	// The thread finishes a pending job first
+	pthread_join(_thread, NULL);
+
+	pthread_cond_destroy(&_done_cond);
+	pthread_cond_destroy(&_job_cond);
+	pthread_mutex_destroy(&_mutex);
+
+	for (struct slot &item : _slots) {
+		delete item.rrd;
+	}
+}
+
+void
+RRD_flusher::slot_add(RRD_wrapper *rrd, const std::string &name)
+{
+	size_t idx;
+
+	if (!_free.empty()) {
+		idx = _free.back();
+		_free.pop_back();
+	} else {
+		idx = _slots.size();
+		_slots.push_back({nullptr, std::string(), false});
+	}
+
+	size_t capacity = _values[0][0].size();
+	if (idx >= capacity) {
+		// The flusher must not read counters during reallocation
+		wait();
+		for (int epoch = 0; epoch < EPOCH_CNT; ++epoch) {
+			for (int cnt = 0; cnt < SC_CNT; ++cnt) {
+				_values[epoch][cnt].resize(2 * capacity, 0);
+			}
+		}
+	}
+
+	_slots[idx].rrd = rrd;
+	_slots[idx].name = name;
+	_slots[idx].removed = false;
+	rrd->slot_set(idx);
+}
+
+void
+RRD_flusher::slot_remove(RRD_wrapper *rrd)
+{
+	_slots[rrd->slot_get()].removed = true;
+}
+
+void
+RRD_flusher::swap(uint64_t timestamp)
+{
+	pthread_mutex_lock(&_mutex);
+	if (_pending) {
+		MSG_WARNING(msg_module, "RRD files of the previous interval are still "
+			"being updated. Waiting...", NULL);
+		while (_pending) {
+			pthread_cond_wait(&_done_cond, &_mutex);
+		}
+	}
+	pthread_mutex_unlock(&_mutex);
+
+	// The flusher is idle, so the job can be prepared without locking
+	_job.clear();
+	for (size_t idx = 0; idx < _slots.size(); ++idx) {
+		struct slot &item = _slots[idx];
+		if (!item.rrd) {
+			continue;
+		}
+
+		_job.push_back({idx, item});
+		if (item.removed) {
+			// The wrapper will be destroyed by the flusher
+			item.rrd = nullptr;
+			item.name.clear();
+			_free.push_back(idx);
+		}
+	}
+
+	_job_epoch = _current;
+	_job_time = timestamp;
+	_current = (_current + 1) % EPOCH_CNT;
+
+	pthread_mutex_lock(&_mutex);
+	_pending = true;
+	pthread_cond_signal(&_job_cond);
+	pthread_mutex_unlock(&_mutex);
+}
+
+void
+RRD_flusher::wait()
+{
+	pthread_mutex_lock(&_mutex);
+	while (_pending) {
+		pthread_cond_wait(&_done_cond, &_mutex);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+/**
+ * \brief Store counters of the retired epoch to RRD files and reset them
+ */
+void
+RRD_flusher::job_process()
+{
+	std::vector<uint64_t> *values = _values[_job_epoch];
+	uint64_t record[SC_CNT];
+	size_t failed = 0;
+
+	if (_job.empty()) {
+		return;
+	}
+
+	struct timespec ts_start, ts_end;
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+
+	for (struct job_entry &entry : _job) {
+		const size_t idx = entry.idx;
+		for (int cnt = 0; cnt < SC_CNT; ++cnt) {
+			record[cnt] = values[cnt][idx];
+			values[cnt][idx] = 0;
+		}
+
+		const char *name = entry.info.name.c_str();
+		try {
+			entry.info.rrd->file_update(_job_time, record);
+			MSG_DEBUG(msg_module, "RRD of %s has been successfully updated.",
+				name);
+		} catch (std::exception &ex) {
+			MSG_WARNING(msg_module, "Failed to update RRD of %s: %s", name,
+				ex.what());
+			failed++;
+		} catch (...) {
+			MSG_WARNING(msg_module, "Failed to update RRD of %s: %s", name,
+				"Unknown error has occurred");
+			failed++;
+		}
+
+		if (entry.info.removed) {
+			delete entry.info.rrd;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	double duration = (ts_end.tv_sec - ts_start.tv_sec)
+		+ (ts_end.tv_nsec - ts_start.tv_nsec) / 1e9;
+	MSG_INFO(msg_module, "%zu RRD files updated (%zu failed) in %.3f seconds.",
+		_job.size() - failed, failed, duration);
+	_job.clear();
+}
+
+/**
+ * \brief Flusher thread
+ * \param[in] arg Instance of the flusher
+ */
+void *
+RRD_flusher::thread_main(void *arg)
+{
+	RRD_flusher *flusher = static_cast<RRD_flusher *>(arg);
+
+	pthread_mutex_lock(&flusher->_mutex);
+	while (true) {
+		while (!flusher->_pending && !flusher->_stop) {
+			pthread_cond_wait(&flusher->_job_cond, &flusher->_mutex);
+		}
+		if (!flusher->_pending) {
+			// Stop request and nothing to do
+			break;
+		}
+
+		// The job is owned by this thread until the pending flag is cleared
+		pthread_mutex_unlock(&flusher->_mutex);
+		flusher->job_process();
+		pthread_mutex_lock(&flusher->_mutex);
+
+		flusher->_pending = false;
+		pthread_cond_broadcast(&flusher->_done_cond);
+	}
+	pthread_mutex_unlock(&flusher->_mutex);
+
+	return NULL;
+}
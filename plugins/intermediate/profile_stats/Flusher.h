@@ -0,0 +1,194 @@
+/**
+ * \file Flusher.h
+ * \brief Counters of profiles/channels and RRD flusher thread (header file)
+ */
+/*
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is``, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef PROFILESTATS_FLUSHER_H
+#define PROFILESTATS_FLUSHER_H
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "profilestats.h"
+#include "RRD.h"
+
+/**
+ * \brief Counters of all profiles/channels and a thread that stores them
+ *
+ * Counters are kept as structure of arrays, i.e. one array per counter
+ * (::st_counter) indexed by a slot of a profile/channel, and there are two
+ * sets (epochs) of them. The pipeline thread adds flows only to the current
+ * epoch. At the end of an interval, the epochs are swapped and the flusher
+ * thread writes the retired one to RRD files and resets it, so the pipeline
+ * thread never waits for RRD tools.
+ *
+ * All functions except the thread itself MUST be called from the same
+ * (pipeline) thread.
+ */
+class RRD_flusher {
+private:
+	/** Number of epochs                   */
+	static constexpr int EPOCH_CNT = 2;
+
+	/** Profile/channel                    */
+	struct slot {
+		/** RRD wrapper (NULL = free slot)             */
+		RRD_wrapper *rrd;
+		/** Name of the profile/channel (for messages) */
+		std::string name;
+		/** Deleted, flush and free on next swap       */
+		bool removed;
+	};
+
+	/** Profile/channel to flush           */
+	struct job_entry {
+		/** Slot of the counters                       */
+		size_t idx;
+		/** Copy of the slot                           */
+		struct slot info;
+	};
+
+	/** Counters [epoch][counter][slot]    */
+	std::vector<uint64_t> _values[EPOCH_CNT][SC_CNT];
+	/** Epoch updated by the pipeline      */
+	int _current;
+	/** Profiles/channels                  */
+	std::vector<struct slot> _slots;
+	/** Indexes of free slots              */
+	std::vector<size_t> _free;
+
+	/** Flusher thread                     */
+	pthread_t _thread;
+	/** Mutex for the job and flags        */
+	pthread_mutex_t _mutex;
+	/** A new job or a stop request        */
+	pthread_cond_t _job_cond;
+	/** The job has been finished          */
+	pthread_cond_t _done_cond;
+	/** A job is waiting or in progress    */
+	bool _pending;
+	/** Stop flag                          */
+	bool _stop;
+	/** Epoch to flush                     */
+	int _job_epoch;
+	/** Update timestamp of the job        */
+	uint64_t _job_time;
+	/** Profiles/channels to flush         */
+	std::vector<struct job_entry> _job;
+
+	static void *
+	thread_main(void *arg);
+	void
+	job_process();
+
+public:
+	/**
+	 * \brief Create counters and start the flusher thread
+	 * \throws runtime_error if the thread cannot be started
+	 */
+	RRD_flusher();
+	/**
+	 * \brief Wait for the flusher and destroy all wrappers
+	 * \note Counters that haven't been swapped are lost. Call swap() before.
+	 */
+	~RRD_flusher();
+
+	// Disable copy constructors
+	RRD_flusher(const RRD_flusher &) = delete;
+	RRD_flusher &operator=(const RRD_flusher &) = delete;
+
+	/**
+	 * \brief Add a profile/channel
+	 *
+	 * The flusher takes ownership of the wrapper and assigns it a slot.
+	 * \param[in] rrd  RRD wrapper
+	 * \param[in] name Name of the profile/channel (for messages)
+	 */
+	void
+	slot_add(RRD_wrapper *rrd, const std::string &name);
+	/**
+	 * \brief Remove a profile/channel
+	 *
+	 * Counters of the current interval will be stored during the next swap
+	 * and then the wrapper will be destroyed.
+	 * \param[in] rrd RRD wrapper
+	 */
+	void
+	slot_remove(RRD_wrapper *rrd);
+
+	/**
+	 * \brief Add a flow to the current counters of a profile/channel
+	 * \param[in] slot Slot of the profile/channel
+	 * \param[in] stat Flow statistics
+	 */
+	void
+	flow_add(size_t slot, const struct flow_stat &stat)
+	{
+		std::vector<uint64_t> *values = _values[_current];
+
+		values[SC_FLOWS + ST_TOTAL][slot] += 1;
+		values[SC_FLOWS + stat.proto][slot] += 1;
+		values[SC_PACKETS + ST_TOTAL][slot] += stat.packets;
+		values[SC_PACKETS + stat.proto][slot] += stat.packets;
+		values[SC_BYTES + ST_TOTAL][slot] += stat.bytes;
+		values[SC_BYTES + stat.proto][slot] += stat.bytes;
+
+		if (values[SC_PACKETS_MAX][slot] < stat.packets) {
+			values[SC_PACKETS_MAX][slot] = stat.packets;
+		}
+		if (values[SC_BYTES_MAX][slot] < stat.bytes) {
+			values[SC_BYTES_MAX][slot] = stat.bytes;
+		}
+	}
+
+	/**
+	 * \brief Retire the current epoch and pass it to the flusher thread
+	 *
+	 * If the previous epoch hasn't been flushed yet, the function waits.
+	 * \param[in] timestamp Update timestamp of the retired counters
+	 */
+	void
+	swap(uint64_t timestamp);
+	/**
+	 * \brief Wait until the retired epoch is flushed
+	 */
+	void
+	wait();
+};
+
+#endif // PROFILESTATS_FLUSHER_H
@@ -55,9 +55,9 @@
 
 
 RRD_wrapper::RRD_wrapper(const std::string &base_dir, const std::string &path,
-	uint64_t interval) : _interval(interval), _base_dir(base_dir), _path(path)
+	uint64_t interval) : _interval(interval), _base_dir(base_dir), _path(path),
+	_slot(0)
 {
-	stats_reset();
 	directory_path_sanitize(_path);
 
 	// Check if the path is subdirectory of the base directory
@@ -112,7 +112,7 @@ RRD_wrapper::file_create(uint64_t since, bool overwrite)
 }
 
 void
-RRD_wrapper::file_update(uint64_t timestamp)
+RRD_wrapper::file_update(uint64_t timestamp, const uint64_t *values)
 {
 	// Make sure that the RRD file exists
 	file_create(timestamp, false);
@@ -123,10 +123,7 @@ RRD_wrapper::file_update(uint64_t timestamp)
 	argv.emplace_back(_path);
 	argv.emplace_back("--template");
 	argv.emplace_back(_rrd_tmplt);
-	argv.emplace_back(stats_to_string(timestamp));
-
-	// Reset statistics
-	stats_reset();
+	argv.emplace_back(stats_to_string(timestamp, values));
 
 	// Create C style array
 	std::unique_ptr<const char *[]> c_argv(new const char *[argv.size()]);
@@ -146,47 +143,6 @@ RRD_wrapper::file_update(uint64_t timestamp)
 	}
 }
 
-void
-RRD_wrapper::flow_add(const struct flow_stat &stat)
-{
-	// Get protocol
-	int proto;
-	switch (stat.proto) {
-	case IP_TCP:
-		proto = ST_TCP;
-		break;
-	case IP_UDP:
-		proto = ST_UDP;
-		break;
-	case IP_ICMP:
-	case IP_ICMPv6:
-		proto = ST_ICMP;
-		break;
-	default:
-		proto = ST_OTHER;
-		break;
-	}
-
-	// Update protocol specific statistics
-	_fields[PACKETS].sum[proto] += stat.packets;
-	_fields[BYTES].sum[proto] += stat.bytes;
-	_fields[FLOWS].sum[proto] += 1;
-
-	// Update total statistics
-	_fields[PACKETS].sum[ST_TOTAL] += stat.packets;
-	_fields[BYTES].sum[ST_TOTAL] += stat.bytes;
-	_fields[FLOWS].sum[ST_TOTAL] += 1;
-
-	if (_fields[PACKETS].max < stat.packets) {
-		_fields[PACKETS].max = stat.packets;
-	}
-
-	if (_fields[BYTES].max < stat.bytes) {
-		_fields[BYTES].max = stat.bytes;
-	}
-
-}
-
 /**
  * \brief Create arguments for new RRD database
  * \param[in]  ts_start Specifies the time in seconds since 1970-01-01 UTC when
@@ -276,49 +232,37 @@ RRD_wrapper::stats_get_create_args(uint64_t ts_start, uint64_t ts_step,
 /**
  * \brief Convert statistics to an update string required by RRD tools
  * \param[in] timestamp The date used for updating the RRD
+ * \param[in] values    Counters (::st_counter order)
  * \return The string
  */
 std::string
-RRD_wrapper::stats_to_string(uint64_t timestamp)
+RRD_wrapper::stats_to_string(uint64_t timestamp, const uint64_t *values)
 {
 	std::stringstream ss;
 
 	// Add update time
 	ss << timestamp;
 
-	// Compute averages
-	const uint64_t total_flows = _fields[FLOWS].sum[ST_TOTAL];
-	for (size_t group = 1; group < ST_GROUP_CNT; ++group) {
-		if (total_flows == 0) {
-			_fields[group].avg = 0;
-		} else {
-			_fields[group].avg = _fields[group].sum[ST_TOTAL] / total_flows;
-		}
+	// Add sum statistics
+	for (int cnt = SC_FLOWS; cnt < SC_PACKETS_MAX; ++cnt) {
+		ss << ":" << values[cnt];
 	}
 
-	// Add sum statistics
-	for (size_t group = 0; group < ST_GROUP_CNT; ++group) {
-		for (int proto = 0; proto < ST_PROTOCOL_CNT; ++proto) {
-			ss << ":" << _fields[group].sum[proto];
-		}
+	// Compute averages
+	const uint64_t total_flows = values[SC_FLOWS + ST_TOTAL];
+	uint64_t packets_avg = 0;
+	uint64_t bytes_avg = 0;
+	if (total_flows != 0) {
+		packets_avg = values[SC_PACKETS + ST_TOTAL] / total_flows;
+		bytes_avg = values[SC_BYTES + ST_TOTAL] / total_flows;
 	}
 
 	// Add rest
-	ss << ":" << _fields[PACKETS].max << ":" << _fields[PACKETS].avg;
-	ss << ":" << _fields[BYTES].max << ":" << _fields[BYTES].avg;
+	ss << ":" << values[SC_PACKETS_MAX] << ":" << packets_avg;
+	ss << ":" << values[SC_BYTES_MAX] << ":" << bytes_avg;
 	return ss.str();
 }
 
-/**
- * \brief Reset statistics
- * \note All counters will be set to zeros
- */
-void
-RRD_wrapper::stats_reset()
-{
-	memset(_fields, 0, sizeof(_fields));
-}
-
 /**
  * \brief Check directory configuration
  *
@@ -51,32 +51,6 @@ extern "C" {
 
 class RRD_wrapper {
 private:
-	/** Statistics groups                  */
-	enum st_group {
-		FLOWS = 0,   /**< This MUST be the first!              */
-		PACKETS,
-		BYTES,
-		ST_GROUP_CNT /**< This must be always the last element */
-	};
-
-	/** Statistics protocols               */
-	enum st_protocol {
-		ST_TOTAL = 0,   /**< This MUST be the first!              */
-		ST_TCP,
-		ST_UDP,
-		ST_ICMP,
-		ST_OTHER,
-		ST_PROTOCOL_CNT /**< This must be always the last element */
-	};
-
-	/** IPFIX protocol identifiers         */
-	enum ipfix_protocol {
-		IP_ICMP = 1,
-		IP_TCP = 6,
-		IP_UDP = 17,
-		IP_ICMPv6 = 58,
-	};
-
 	/** Type of RRD data source            */
 	enum rrd_data_source_type {
 		RRD_DST_GAUGE = 0,
@@ -99,16 +73,6 @@ private:
 	/** Names and types of RRD Data sources */
 	static const std::vector<rrd_field> _tmplt_fields;
 
-	/** Statistic fields                   */
-	struct stats_field {
-		/** Summary fields                 */
-		uint64_t sum[ST_PROTOCOL_CNT];
-		/** Max value                      */
-		uint64_t max;
-		/** Average value                  */
-		uint64_t avg;
-	};
-
 	/** Update interval                    */
 	uint64_t _interval;
 	/** Update template for RRD files      */
@@ -117,13 +81,11 @@ private:
 	std::string _base_dir;
 	/** Path to the RRD file               */
 	std::string _path;
-	/** Stats data (local counters)        */
-	struct stats_field _fields[ST_GROUP_CNT];
+	/** Index of counters in the flusher   */
+	size_t _slot;
 
-	void
-	stats_reset();
 	std::string
-	stats_to_string(uint64_t timestamp);
+	stats_to_string(uint64_t timestamp, const uint64_t *values);
 	void
 	stats_get_create_args(uint64_t ts_start, uint64_t ts_step,
 		std::vector<std::string> &args);
@@ -170,20 +132,27 @@ public:
 	void
 	file_create(uint64_t since, bool overwrite = false);
 	/**
-	 * \brief Flush local counters to the RRD file and reset the counters
+	 * \brief Store counters to the RRD file
 	 * \note If the RRD file doesn't exists, the function will try to create
 	 *   a new one.
 	 * \param[in] timestamp Update timestamp
+	 * \param[in] values    Counters of the interval (::st_counter order)
+	 * \throws runtime_error in case of failure
 	 */
 	void
-	file_update(uint64_t timestamp);
+	file_update(uint64_t timestamp, const uint64_t *values);
 
 	/**
-	 * \brief Add a new flow to local statistics
-	 * \param[in] stat Flow statistics
+	 * \brief Get an index of counters assigned by RRD_flusher
+	 */
+	size_t
+	slot_get() const {return _slot;};
+	/**
+	 * \brief Set an index of counters (RRD_flusher only)
+	 * \param[in] slot Index
 	 */
 	void
-	flow_add(const struct flow_stat &stat);
+	slot_set(size_t slot) {_slot = slot;};
 };
 
 
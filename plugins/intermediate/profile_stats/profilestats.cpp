@@ -40,6 +40,7 @@
  */
 
 #include <exception>
+#include <stdexcept>
 #include <algorithm>
 #include <vector>
 #include <memory>
@@ -47,6 +48,7 @@
 #include "configuration.h"
 #include "profilestats.h"
 #include "RRD.h"
+#include "Flusher.h"
 
 extern "C" {
 #include <ipfixcol.h>
@@ -73,6 +75,14 @@ constexpr uint16_t IPFIX_IE_PACKETS = 2;
 /** IPFIX Information Element of protocol    */
 constexpr uint16_t IPFIX_IE_PROTO   = 4;
 
+/** IPFIX protocol identifiers               */
+enum ipfix_protocol {
+	IP_ICMP = 1,
+	IP_TCP = 6,
+	IP_UDP = 17,
+	IP_ICMPv6 = 58,
+};
+
 /**
  * \brief Plugin instance
  */
@@ -84,6 +94,8 @@ struct plugin_data {
 	plugin_config *cfg;
 	/** Event manager of profiles        */
 	pevents_t *events;
+	/** Counters and RRD flusher thread  */
+	RRD_flusher *flusher;
 	/** Start of the current interval    */
 	time_t interval_start;
 
@@ -92,6 +104,7 @@ struct plugin_data {
         ip_config = nullptr;
         cfg = nullptr;
         events = nullptr;
+        flusher = nullptr;
         interval_start = 0;
     }
 
@@ -103,6 +116,9 @@ struct plugin_data {
 		if (events != nullptr) {
 			pevents_destroy(events);
 		}
+		if (flusher != nullptr) {
+			delete(flusher);
+		}
 	}
 
 	// Disable copy constructors
@@ -161,13 +177,15 @@ flow_stat_convert_field(const void *field, size_t size, uint64_t *value)
 
 /**
  * \brief Find an IANA IPFIX field in a record and convert it to uint64_t
+ *
+ * Offsets of common fields are cached in the template by the collector.
  * \param[in]  rec    IPFIX record
  * \param[in]  id     Identification of IPFIX Information Element
  * \param[out] result Converted value
  * \return On success returns 0 and \p result is filled.
  *   Otherwise (usually the field is not present) returns a non-zero value.
  */
-int
+static inline int
 flow_stat_get_value(struct ipfix_record *rec, uint16_t id, uint64_t &result)
 {
 	uint8_t *rec_data = static_cast<uint8_t *>(rec->record);
@@ -195,10 +213,11 @@ flow_stat_get_value(struct ipfix_record *rec, uint16_t id, uint64_t &result)
  * \return On success returns 0. Otherwise (at least one field not found),
  *   returns a non-zero value.
  */
-int
+static inline int
 flow_stat_prepare(struct ipfix_record *rec, struct flow_stat &stats)
 {
-	if (flow_stat_get_value(rec, IPFIX_IE_PROTO, stats.proto)) {
+	uint64_t proto;
+	if (flow_stat_get_value(rec, IPFIX_IE_PROTO, proto)) {
 		return 1;
 	}
 
@@ -210,6 +229,22 @@ flow_stat_prepare(struct ipfix_record *rec, struct flow_stat &stats)
 		return 1;
 	}
 
+	switch (proto) {
+	case IP_TCP:
+		stats.proto = ST_TCP;
+		break;
+	case IP_UDP:
+		stats.proto = ST_UDP;
+		break;
+	case IP_ICMP:
+	case IP_ICMPv6:
+		stats.proto = ST_ICMP;
+		break;
+	default:
+		stats.proto = ST_OTHER;
+		break;
+	}
+
 	return 0;
 }
 
@@ -217,7 +252,8 @@ flow_stat_prepare(struct ipfix_record *rec, struct flow_stat &stats)
  * \brief Create a new channel
  *
  * Generate a new file name of the channel based on profiling configuration
- * and try to create appropriate RRD database.
+ * and pass a new RRD wrapper to the flusher. The RRD database is created by
+ * the flusher thread before its first update.
  * \param[in] ctx Event context (local and global data)
  * \return Pointer to newly created RRD wrapper instance
  */
@@ -242,8 +278,8 @@ channel_create_cb(struct pevents_ctx *ctx)
 		file += ".rrd";
 
 		rrd = new RRD_wrapper(instance->cfg->base_dir, file, instance->cfg->interval);
-		// Note: If create operation fails, we will still have a wrapper
-		rrd->file_create(instance->interval_start, false);
+		instance->flusher->slot_add(rrd, std::string("channel '")
+			+ channel_path + channel_name + "'");
 
 	} catch (std::exception &ex) {
 		MSG_WARNING(msg_module, "Failed to create channel '%s%s': %s",
@@ -263,8 +299,9 @@ channel_create_cb(struct pevents_ctx *ctx)
 /**
  * \brief Destroy a channel
  *
- * First, flush remaining statistics to the RRD file and then delete RRD
- * wrapper instance. The RRD file will be preserved.
+ * The RRD wrapper is passed back to the flusher that stores remaining
+ * statistics at the end of the current interval and then deletes the
+ * wrapper. The RRD file will be preserved.
  * \param[in,out] ctx Event context (local and global data)
  */
 static void
@@ -283,19 +320,7 @@ channel_delete_cb(struct pevents_ctx *ctx)
 		return;
 	}
 
-	try {
-		// Flush up to now statistics and delete the channel
-		std::unique_ptr<RRD_wrapper> wrapper(rrd);
-		wrapper->file_update(instance->interval_start);
-	} catch (std::exception &ex) {
-		MSG_WARNING(msg_module, "Failed to properly delete channel '%s%s': %s",
-			channel_path, channel_name, ex.what());
-		return;
-	} catch (...) {
-		MSG_WARNING(msg_module, "Failed to properly delete channel '%s%s': %s",
-			channel_path, channel_name, "Unknown error has occurred");
-		return;
-	}
+	instance->flusher->slot_remove(rrd);
 
 	MSG_INFO(msg_module, "Channel '%s%s' has been successfully closed.",
 		channel_path, channel_name);
@@ -345,68 +370,31 @@ channel_update_cb(struct pevents_ctx *ctx, uint16_t flags)
 /**
  * \brief Add a flow
  *
- * Statistics will be stored into an RRD wrapper that aggregates them and later
- * will be flushed to the appropriate RRD file when channel_flush_cb() is
- * called. In other words, by calling this function the database is not
- * immediately updated, only statistics are cached.
+ * Statistics are added to the current counters of the channel. The counters
+ * are stored to the appropriate RRD file by the flusher thread at the end of
+ * the interval.
  * \param[in,out] ctx  Event context (local and global data)
  * \param[in]     data Pointer to parsed flow features
  */
 static void
 channel_data_cb(struct pevents_ctx *ctx, void *data)
-{
-	struct flow_stat *stat = static_cast<struct flow_stat *>(data);
-	RRD_wrapper *rrd = static_cast<RRD_wrapper *>(ctx->user.local);
-	if (!rrd) {
-		return;
-	}
-
-	rrd->flow_add(*stat);
-}
-
-/**
- * \brief Flush aggregated statistics to an RRD
- *
- * All statistics aggregated since last flush will be stored to the database
- * and the local statistics will be reset to zeros.
- * \param[in,out] ctx Event context (local and global data)
- */
-static void
-channel_flush_cb(struct pevents_ctx *ctx)
 {
 	plugin_data *instance = static_cast<plugin_data *>(ctx->user.global);
+	struct flow_stat *stat = static_cast<struct flow_stat *>(data);
 	RRD_wrapper *rrd = static_cast<RRD_wrapper *>(ctx->user.local);
 	if (!rrd) {
 		return;
 	}
 
-	void *channel_ptr = ctx->ptr.channel;
-	const char *channel_path = channel_get_path(channel_ptr);
-	const char *channel_name = channel_get_name(channel_ptr);
-	MSG_DEBUG(msg_module, "Updating RRD of channel '%s%s'...", channel_path,
-		channel_name);
-
-	try {
-		rrd->file_update(instance->interval_start);
-	} catch (std::exception &ex) {
-		MSG_WARNING(msg_module, "Failed to update RRD of channel '%s%s': %s",
-			channel_path, channel_name, ex.what());
-		return;
-	} catch (...) {
-		MSG_WARNING(msg_module, "Failed to update RRD of channel '%s%s': %s",
-			channel_path, channel_name, "Unknown error has occurred");
-		return;
-	}
-
-	MSG_INFO(msg_module, "RRD of channel '%s%s' has been successfully updated.",
-		channel_path, channel_name);
+	instance->flusher->flow_add(rrd->slot_get(), *stat);
 }
 
 /**
  * \brief Create a new profile
  *
  * Generate a new file name of the profile based on profiling configuration
- * and try to create appropriate RRD database.
+ * and pass a new RRD wrapper to the flusher. The RRD database is created by
+ * the flusher thread before its first update.
  * \param[in] ctx Event context (local and global data)
  * \return Pointer to newly created RRD wrapper instance
  */
@@ -429,8 +417,8 @@ profile_create_cb(struct pevents_ctx *ctx)
 		file += ".rrd";
 
 		rrd = new RRD_wrapper(instance->cfg->base_dir, file, instance->cfg->interval);
-		// Note: If create operation fails, we will still have a wrapper
-		rrd->file_create(instance->interval_start, false);
+		instance->flusher->slot_add(rrd, std::string("profile '")
+			+ profile_path + "'");
 
 	} catch (std::exception &ex) {
 		MSG_WARNING(msg_module, "Failed to create profile '%s': %s",
@@ -450,8 +438,9 @@ profile_create_cb(struct pevents_ctx *ctx)
 /**
  * \brief Destroy a profile
  *
- * First, flush remaining statistics to the RRD file and then delete RRD
- * wrapper instance. The RRD file will be preserved.
+ * The RRD wrapper is passed back to the flusher that stores remaining
+ * statistics at the end of the current interval and then deletes the
+ * wrapper. The RRD file will be preserved.
  * \param[in,out] ctx Event context (local and global data)
  */
 static void
@@ -469,19 +458,7 @@ profile_delete_cb(struct pevents_ctx *ctx)
 		return;
 	}
 
-	try {
-		// Flush up to now statistics and delete the channel
-		std::unique_ptr<RRD_wrapper> wrapper(rrd);
-		wrapper->file_update(instance->interval_start);
-	} catch (std::exception &ex) {
-		MSG_WARNING(msg_module, "Failed to properly delete profile '%s': %s",
-			profile_path, ex.what());
-		return;
-	} catch (...) {
-		MSG_WARNING(msg_module, "Failed to properly delete profile '%s': %s",
-			profile_path, "Unknown error has occurred");
-		return;
-	}
+	instance->flusher->slot_remove(rrd);
 
 	MSG_INFO(msg_module, "Profile '%s' has been successfully closed.",
 		profile_path);
@@ -530,60 +507,23 @@ profile_update_cb(struct pevents_ctx *ctx, uint16_t flags)
 /**
  * \brief Add a flow
  *
- * Statistics will be stored into an RRD wrapper that aggregates them and later
- * will be flushed to the appropriate RRD file when profile_flush_cb() is
- * called. In other words, by calling this function the database is not
- * immediately updated, only statistics are cached.
+ * Statistics are added to the current counters of the profile. The counters
+ * are stored to the appropriate RRD file by the flusher thread at the end of
+ * the interval.
  * \param[in,out] ctx  Event context (local and global data)
  * \param[in]     data Pointer to parsed flow features
  */
 static void
 profile_data_cb(struct pevents_ctx *ctx, void *data)
-{
-	struct flow_stat *stat = static_cast<struct flow_stat *>(data);
-	RRD_wrapper *rrd = static_cast<RRD_wrapper *>(ctx->user.local);
-	if (!rrd) {
-		return;
-	}
-
-	rrd->flow_add(*stat);
-}
-
-/**
- * \brief Flush aggregated statistics to an RRD
- *
- * All statistics aggregated since last flush will be stored to the database
- * and the local statistics will be reset to zeros.
- * \param[in,out] ctx Event context (local and global data)
- */
-static void
-profile_flush_cb(struct pevents_ctx *ctx)
 {
 	plugin_data *instance = static_cast<plugin_data *>(ctx->user.global);
+	struct flow_stat *stat = static_cast<struct flow_stat *>(data);
 	RRD_wrapper *rrd = static_cast<RRD_wrapper *>(ctx->user.local);
 	if (!rrd) {
 		return;
 	}
 
-	void *profile_ptr = ctx->ptr.profile;
-	const char *profile_path = profile_get_path(profile_ptr);
-	PROFILE_PATH_FIX(profile_path);
-	MSG_DEBUG(msg_module, "Updating RRD of profile '%s'...", profile_path);
-
-	try {
-		rrd->file_update(instance->interval_start);
-	} catch (std::exception &ex) {
-		MSG_WARNING(msg_module, "Failed to update RRD of profile '%s': %s",
-			profile_path, ex.what());
-		return;
-	} catch (...) {
-		MSG_WARNING(msg_module, "Failed to update RRD of profile '%s': %s",
-			profile_path, "Unknown error has occurred");
-		return;
-	}
-
-	MSG_INFO(msg_module, "RRD of profile '%s' has been successfully updated.",
-		profile_path);
+	instance->flusher->flow_add(rrd->slot_get(), *stat);
 }
 
 /**
@@ -613,6 +553,8 @@ intermediate_init(char* params, void* ip_config, uint32_t ip_id,
 		std::unique_ptr<struct plugin_data> data(new struct plugin_data());
 		// Parse parameters
 		data.get()->cfg = new plugin_config(params);
+		// Start the flusher of RRD files
+		data.get()->flusher = new RRD_flusher();
 
 		// Create a profile event manager
 		struct pevent_cb_set channel_cb;
@@ -684,8 +626,8 @@ intermediate_process_message(void* config, void* message)
 			new_time *= instance->cfg->interval;
 		}
 
-		// Use the old timestamp to store statistics
-		pevents_for_each(instance->events, profile_flush_cb, channel_flush_cb);
+		// Use the old timestamp to store statistics (in the flusher thread)
+		instance->flusher->swap(instance->interval_start);
 		instance->interval_start = new_time;
 	}
 
@@ -725,9 +667,10 @@ intermediate_close(void *config)
 	MSG_DEBUG(msg_module, "Closing...", NULL);
 	struct plugin_data *instance = static_cast<struct plugin_data *>(config);
 
-	// Flush and destroy all profiles and channels
+	// Destroy all profiles and channels and flush remaining statistics
 	pevents_destroy(instance->events);
 	instance->events = nullptr;
+	instance->flusher->swap(instance->interval_start);
 
 	delete(instance);
 	return 0;
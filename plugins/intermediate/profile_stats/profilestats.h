@@ -41,10 +41,36 @@
 #ifndef PROFILESTATS_H
 #define PROFILESTATS_H
 
+/** Statistics protocols               */
+enum st_protocol {
+	ST_TOTAL = 0,   /**< This MUST be the first!              */
+	ST_TCP,
+	ST_UDP,
+	ST_ICMP,
+	ST_OTHER,
+	ST_PROTOCOL_CNT /**< This must be always the last element */
+};
+
+/**
+ * \brief Counters of a channel/profile
+ *
+ * Order of counters corresponds to the order of sums in RRD Data Sources,
+ * i.e. each group (flows, packets, bytes) is followed by its protocol specific
+ * counters (indexed by ::st_protocol).
+ */
+enum st_counter {
+	SC_FLOWS       = 0,
+	SC_PACKETS     = SC_FLOWS   + ST_PROTOCOL_CNT,
+	SC_BYTES       = SC_PACKETS + ST_PROTOCOL_CNT,
+	SC_PACKETS_MAX = SC_BYTES   + ST_PROTOCOL_CNT,
+	SC_BYTES_MAX,
+	SC_CNT          /**< This must be always the last element */
+};
+
 /** Data fields from a flow required for update of statistics */
 struct flow_stat {
-	/** Protocol identifier of the flow */
-	uint64_t proto;
+	/** Protocol of the flow (::st_protocol, never ST_TOTAL) */
+	unsigned int proto;
 	/** Number of packet in the flow    */
 	uint64_t packets;
 	/** Number of bytes in the flow     */
@@ -0,0 +1,167 @@
+/**
+ * \file Publisher.cpp
+ * \brief Publisher of sketch snapshots (source file)
+ */
+/*
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is``, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "Publisher.h"
+
+extern "C" {
+#include <ipfixcol.h>
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+// Identifier for verbose macros
+static const char *msg_module = "sketches";
+
+Publisher::Publisher(const std::string &file, const std::string &socket)
+	: file(file), sd(-1)
+{
+	memset(&addr, 0, sizeof(addr));
+	if (socket.empty()) {
+		return;
+	}
+
+	if (socket.size() >= sizeof(addr.sun_path)) {
+		throw std::runtime_error("Path of the socket \"" + socket + "\" is too long");
+	}
+
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket.c_str(), sizeof(addr.sun_path) - 1);
+
+	sd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sd == -1) {
+		throw std::runtime_error("Failed to create a socket: "
+			+ std::string(strerror(errno)));
+	}
+}
+
+Publisher::~Publisher()
+{
+	if (sd != -1) {
+		close(sd);
+	}
+}
+
+/**
+ * \brief Write snapshots to the file
+ *
+ * Snapshots are written to a temporary file which then replaces the output
+ * file, so readers never see an incomplete interval.
+ * \param[in] snapshots Snapshots
+ */
+void
+Publisher::write_file(const std::vector<std::string> &snapshots)
+{
+	std::string tmp = file + ".tmp";
+	FILE *out = fopen(tmp.c_str(), "w");
+	if (!out) {
+		MSG_WARNING(msg_module, "Failed to open file '%s': %s", tmp.c_str(),
+			strerror(errno));
+		return;
+	}
+
+	bool failed = false;
+	for (const std::string &snapshot : snapshots) {
+		if (fputs(snapshot.c_str(), out) == EOF || fputc('\n', out) == EOF) {
+			failed = true;
+			break;
+		}
+	}
+
+	if (fclose(out) != 0 || failed) {
+		MSG_WARNING(msg_module, "Failed to write file '%s': %s", tmp.c_str(),
+			strerror(errno));
+		unlink(tmp.c_str());
+		return;
+	}
+
+	if (rename(tmp.c_str(), file.c_str()) != 0) {
+		MSG_WARNING(msg_module, "Failed to replace file '%s': %s", file.c_str(),
+			strerror(errno));
+		unlink(tmp.c_str());
+	}
+}
+
+/**
+ * \brief Send snapshots to the socket (one datagram per channel)
+ * \param[in] snapshots Snapshots
+ */
+void
+Publisher::send_socket(const std::vector<std::string> &snapshots)
+{
+	for (const std::string &snapshot : snapshots) {
+		ssize_t ret = sendto(sd, snapshot.data(), snapshot.size(), 0,
+			(const struct sockaddr *) &addr, sizeof(addr));
+		if (ret != -1) {
+			continue;
+		}
+
+		if (errno == ENOENT || errno == ECONNREFUSED) {
+			// Nobody is listening
+			MSG_DEBUG(msg_module, "No reader of socket '%s'", addr.sun_path);
+			return;
+		}
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			MSG_WARNING(msg_module, "Reader of socket '%s' is too slow, "
+				"snapshots dropped", addr.sun_path);
+			return;
+		}
+
+		MSG_WARNING(msg_module, "Failed to send a snapshot to socket '%s': %s",
+			addr.sun_path, strerror(errno));
+		return;
+	}
+}
+
+void
+Publisher::publish(const std::vector<std::string> &snapshots)
+{
+	if (!file.empty()) {
+		write_file(snapshots);
+	}
+
+	if (sd != -1) {
+		send_socket(snapshots);
+	}
+}
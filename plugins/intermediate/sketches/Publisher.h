@@ -0,0 +1,95 @@
+/**
+ * \file Publisher.h
+ * \brief Publisher of sketch snapshots (header file)
+ */
+/*
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is``, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <sys/socket.h>
+#include <sys/un.h>
+}
+
+/**
+ * \brief Publisher of snapshots
+ *
+ * Snapshots (one JSON object per channel) are written to a file that is
+ * atomically replaced at the end of each interval and/or sent as datagrams
+ * to a Unix socket. A missing reader of the socket is not an error.
+ */
+class Publisher {
+private:
+	/** Output file (empty if not used)   */
+	std::string file;
+	/** Socket descriptor (-1 if not used) */
+	int sd;
+	/** Address of the reader             */
+	struct sockaddr_un addr;
+
+	// Write snapshots to the file
+	void write_file(const std::vector<std::string> &snapshots);
+	// Send snapshots to the socket
+	void send_socket(const std::vector<std::string> &snapshots);
+public:
+	/**
+	 * \brief Constructor
+	 * \param[in] file   Output file (can be empty)
+	 * \param[in] socket Path of the Unix socket (can be empty)
+	 * \throws runtime_error if the socket cannot be created
+	 */
+	Publisher(const std::string &file, const std::string &socket);
+	/**
+	 * \brief Destructor
+	 */
+	~Publisher();
+
+	// Disable copy constructors
+	Publisher(const Publisher &) = delete;
+	Publisher &operator=(const Publisher &) = delete;
+
+	/**
+	 * \brief Publish snapshots of an interval
+	 * \param[in] snapshots Snapshots of all channels
+	 */
+	void publish(const std::vector<std::string> &snapshots);
+};
+
+#endif // PUBLISHER_H
@@ -0,0 +1,490 @@
+/**
+ * \file Sketch.cpp
+ * \brief Streaming sketches of flow data (source file)
+ */
+/*
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is``, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+extern "C" {
+#include <arpa/inet.h>
+}
+
+#include "Sketch.h"
+
+/**
+ * \brief Round a number up to a power of two
+ */
+static uint64_t
+round_pow2(uint64_t value)
+{
+	uint64_t result = 1;
+	while (result < value) {
+		result <<= 1;
+	}
+	return result;
+}
+
+/* ------------------------------------------------------------------------- */
+HyperLogLog::HyperLogLog(unsigned precision) : precision(precision)
+{
+	if (precision < 4 || precision > 18) {
+		throw std::invalid_argument("HyperLogLog precision out of range (4 - 18)");
+	}
+
+	regs.resize(size_t(1) << precision, 0);
+}
+
+void
+HyperLogLog::add(const uint64_t *hashes, size_t cnt)
+{
+	uint8_t *data = regs.data();
+	const unsigned shift = 64 - precision;
+	// Guard bit ensures that the rank is at most (64 - precision + 1)
+	const uint64_t guard = uint64_t(1) << (precision - 1);
+
+	for (size_t i = 0; i < cnt; ++i) {
+		uint64_t idx = hashes[i] >> shift;
+		uint8_t rank = __builtin_clzll((hashes[i] << precision) | guard) + 1;
+		if (data[idx] < rank) {
+			data[idx] = rank;
+		}
+	}
+}
+
+double
+HyperLogLog::estimate() const
+{
+	const double m = double(regs.size());
+	double sum = 0.0;
+	unsigned zeros = 0;
+
+	for (uint8_t reg : regs) {
+		sum += std::ldexp(1.0, -int(reg));
+		zeros += (reg == 0);
+	}
+
+	double alpha;
+	switch (regs.size()) {
+	case 16: alpha = 0.673; break;
+	case 32: alpha = 0.697; break;
+	case 64: alpha = 0.709; break;
+	default: alpha = 0.7213 / (1.0 + 1.079 / m); break;
+	}
+
+	double result = alpha * m * m / sum;
+	if (result <= 2.5 * m && zeros != 0) {
+		// Small range correction (linear counting)
+		result = m * std::log(m / zeros);
+	}
+
+	return result;
+}
+
+void
+HyperLogLog::reset()
+{
+	std::fill(regs.begin(), regs.end(), 0);
+}
+
+/* ------------------------------------------------------------------------- */
+CountMin::CountMin(uint32_t width, unsigned depth) : depth(depth)
+{
+	if (width == 0 || depth == 0) {
+		throw std::invalid_argument("Count-Min sketch cannot be empty");
+	}
+
+	width = round_pow2(width);
+	mask = width - 1;
+	counters.resize(size_t(width) * depth, 0);
+}
+
+void
+CountMin::add(const uint64_t *hashes, const uint64_t *values, size_t cnt)
+{
+	const size_t width = mask + 1;
+
+	// Row by row, the rows are independent
+	for (unsigned row = 0; row < depth; ++row) {
+		uint64_t *data = counters.data() + row * width;
+		for (size_t i = 0; i < cnt; ++i) {
+			uint64_t h1 = hashes[i] & 0xFFFFFFFFULL;
+			uint64_t h2 = hashes[i] >> 32;
+			data[(h1 + row * h2) & mask] += values[i];
+		}
+	}
+}
+
+uint64_t
+CountMin::estimate(uint64_t hash) const
+{
+	const size_t width = mask + 1;
+	uint64_t h1 = hash & 0xFFFFFFFFULL;
+	uint64_t h2 = hash >> 32;
+	uint64_t result = UINT64_MAX;
+
+	for (unsigned row = 0; row < depth; ++row) {
+		result = std::min(result, counters[row * width + ((h1 + row * h2) & mask)]);
+	}
+
+	return result;
+}
+
+void
+CountMin::reset()
+{
+	std::fill(counters.begin(), counters.end(), 0);
+}
+
+/* ------------------------------------------------------------------------- */
+SpaceSaving::SpaceSaving(uint32_t capacity) : capacity(capacity)
+{
+	if (capacity == 0) {
+		throw std::invalid_argument("Number of heavy hitters cannot be zero");
+	}
+
+	heap.reserve(capacity);
+	index.resize(round_pow2(uint64_t(capacity) * 2), 0);
+	mask = index.size() - 1;
+}
+
+/**
+ * \brief Find a slot of the index
+ * \param[in] key  Key
+ * \param[in] hash Hash of the key
+ * \return Slot of the item or an empty slot where the item belongs
+ */
+size_t
+SpaceSaving::slot_find(const sketch_key &key, uint64_t hash) const
+{
+	size_t slot = hash & mask;
+	while (index[slot] != 0) {
+		const item &it = heap[index[slot] - 1];
+		if (it.hash == hash && it.key == key) {
+			break;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+/**
+ * \brief Find a slot pointing to a position in the heap
+ * \param[in] pos Position in the heap
+ * \return Slot of the index
+ */
+size_t
+SpaceSaving::slot_of(size_t pos) const
+{
+	size_t slot = heap[pos].hash & mask;
+	while (index[slot] != pos + 1) {
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+/**
+ * \brief Remove a slot of the index (backward shift deletion)
+ * \param[in] slot Slot
+ */
+void
+SpaceSaving::slot_remove(size_t slot)
+{
+	size_t next = slot;
+	while (true) {
+		next = (next + 1) & mask;
+		if (index[next] == 0) {
+			break;
+		}
+
+		// Move the item back if its home slot is not within (slot, next]
+		size_t home = heap[index[next] - 1].hash & mask;
+		bool between = (slot <= next) ? (slot < home && home <= next)
+			: (slot < home || home <= next);
+		if (!between) {
+			index[slot] = index[next];
+			slot = next;
+		}
+	}
+
+	index[slot] = 0;
+}
+
+/**
+ * \brief Move an item down the heap (its count has been increased)
+ * \param[in] pos Position of the item
+ */
+void
+SpaceSaving::sift_down(size_t pos)
+{
+	const size_t size = heap.size();
+	size_t pos_slot = slot_of(pos);
+
+	while (true) {
+		size_t child = 2 * pos + 1;
+		if (child >= size) {
+			break;
+		}
+		if (child + 1 < size && heap[child + 1].count < heap[child].count) {
+			child++;
+		}
+		if (heap[pos].count <= heap[child].count) {
+			break;
+		}
+
+		size_t child_slot = slot_of(child);
+		std::swap(heap[pos], heap[child]);
+		index[pos_slot] = child + 1;
+		index[child_slot] = pos + 1;
+		pos = child;
+	}
+}
+
+/**
+ * \brief Move a new item up the heap
+ * \param[in] pos Position of the item
+ */
+void
+SpaceSaving::sift_up(size_t pos)
+{
+	size_t pos_slot = slot_of(pos);
+
+	while (pos > 0) {
+		size_t parent = (pos - 1) / 2;
+		if (heap[parent].count <= heap[pos].count) {
+			break;
+		}
+
+		size_t parent_slot = slot_of(parent);
+		std::swap(heap[pos], heap[parent]);
+		index[pos_slot] = parent + 1;
+		index[parent_slot] = pos + 1;
+		pos = parent;
+	}
+}
+
+void
+SpaceSaving::add(const sketch_key &key, uint64_t hash)
+{
+	size_t slot = slot_find(key, hash);
+	if (index[slot] != 0) {
+		// Monitored item
+		size_t pos = index[slot] - 1;
+		heap[pos].count++;
+		sift_down(pos);
+		return;
+	}
+
+	if (heap.size() < capacity) {
+		heap.push_back(item{key, hash, 1, 0});
+		index[slot] = heap.size();
+		sift_up(heap.size() - 1);
+		return;
+	}
+
+	// Replace the item with the minimal count
+	uint64_t min = heap[0].count;
+	slot_remove(slot_of(0));
+	heap[0] = item{key, hash, min + 1, min};
+	index[slot_find(key, hash)] = 1;
+	sift_down(0);
+}
+
+std::vector<SpaceSaving::item>
+SpaceSaving::top(size_t n) const
+{
+	std::vector<item> result(heap);
+	n = std::min(n, result.size());
+
+	std::partial_sort(result.begin(), result.begin() + n, result.end(),
+		[](const item &a, const item &b) { return a.count > b.count; });
+	result.resize(n);
+	return result;
+}
+
+void
+SpaceSaving::reset()
+{
+	heap.clear();
+	std::fill(index.begin(), index.end(), 0);
+}
+
+/* ------------------------------------------------------------------------- */
+ChannelSketch::ChannelSketch(const sketch_params &params, const std::string &name)
+	: params(params), total_flows(0), total_packets(0), total_bytes(0),
+	name(name)
+{
+	top.reserve(SD_CNT);
+	distinct.reserve(SD_CNT);
+	bytes.reserve(SD_CNT);
+
+	for (unsigned dim = 0; dim < SD_CNT; ++dim) {
+		top.emplace_back(params.top_capacity);
+		distinct.emplace_back(params.hll_precision);
+		bytes.emplace_back(params.cm_width, params.cm_depth);
+	}
+}
+
+void
+ChannelSketch::update(const std::vector<sketch_flow> &flows)
+{
+	const size_t cnt = pending.size();
+	if (cnt == 0) {
+		return;
+	}
+
+	buf_hash.resize(cnt);
+	buf_bytes.resize(cnt);
+
+	for (size_t i = 0; i < cnt; ++i) {
+		const sketch_flow &flow = flows[pending[i]];
+		buf_bytes[i] = flow.bytes;
+		total_bytes += flow.bytes;
+		total_packets += flow.packets;
+	}
+	total_flows += cnt;
+
+	// Update one dimension after another with all flows of the message
+	for (unsigned dim = 0; dim < SD_CNT; ++dim) {
+		for (size_t i = 0; i < cnt; ++i) {
+			buf_hash[i] = flows[pending[i]].hash[dim];
+		}
+
+		distinct[dim].add(buf_hash.data(), cnt);
+		bytes[dim].add(buf_hash.data(), buf_bytes.data(), cnt);
+
+		SpaceSaving &hitters = top[dim];
+		for (size_t i = 0; i < cnt; ++i) {
+			hitters.add(flows[pending[i]].key[dim], buf_hash[i]);
+		}
+	}
+
+	pending.clear();
+}
+
+/**
+ * \brief Convert a key to text
+ * \param[in] key Key
+ * \param[in] dim Dimension of the key
+ * \return Address or port
+ */
+static std::string
+key2str(const sketch_key &key, unsigned dim)
+{
+	if (dim == SD_SRC_PORT || dim == SD_DST_PORT) {
+		return std::to_string(key.lo);
+	}
+
+	uint8_t addr[16];
+	char buffer[INET6_ADDRSTRLEN];
+	static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+
+	memcpy(addr, &key.hi, 8);
+	memcpy(addr + 8, &key.lo, 8);
+
+	if (memcmp(addr, mapped, sizeof(mapped)) == 0) {
+		inet_ntop(AF_INET, addr + 12, buffer, sizeof(buffer));
+	} else {
+		inet_ntop(AF_INET6, addr, buffer, sizeof(buffer));
+	}
+
+	return buffer;
+}
+
+/**
+ * \brief Escape a string for JSON
+ */
+static std::string
+json_escape(const std::string &str)
+{
+	std::string result;
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			result += '\\';
+		}
+		result += c;
+	}
+	return result;
+}
+
+std::string
+ChannelSketch::snapshot(time_t start, time_t end) const
+{
+	std::ostringstream out;
+
+	out << "{\"channel\":\"" << json_escape(name) << "\""
+		<< ",\"start\":" << start << ",\"end\":" << end
+		<< ",\"flows\":" << total_flows << ",\"packets\":" << total_packets
+		<< ",\"bytes\":" << total_bytes;
+
+	for (unsigned dim = 0; dim < SD_CNT; ++dim) {
+		out << ",\"" << sketch_dim_names[dim] << "\":{\"distinct\":"
+			<< uint64_t(std::llround(distinct[dim].estimate())) << ",\"top\":[";
+
+		std::vector<SpaceSaving::item> items = top[dim].top(params.top_report);
+		for (size_t i = 0; i < items.size(); ++i) {
+			const SpaceSaving::item &it = items[i];
+			out << (i ? "," : "") << "{\"key\":\"" << key2str(it.key, dim)
+				<< "\",\"flows\":" << it.count << ",\"error\":" << it.error
+				<< ",\"bytes\":" << bytes[dim].estimate(it.hash) << "}";
+		}
+
+		out << "]}";
+	}
+
+	out << "}";
+	return out.str();
+}
+
+void
+ChannelSketch::reset()
+{
+	for (unsigned dim = 0; dim < SD_CNT; ++dim) {
+		top[dim].reset();
+		distinct[dim].reset();
+		bytes[dim].reset();
+	}
+
+	total_flows = 0;
+	total_packets = 0;
+	total_bytes = 0;
+}
@@ -0,0 +1,300 @@
+/**
+ * \file Sketch.h
+ * \brief Streaming sketches of flow data (header file)
+ */
+/*
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is``, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "sketches.h"
+
+/**
+ * \brief Key of a sketch
+ *
+ * Addresses are stored as IPv6 addresses (IPv4 addresses are mapped to
+ * ::ffff:0:0/96), ports are stored in the lower part.
+ */
+struct sketch_key {
+	uint64_t hi; /**< Upper 8 bytes of the address */
+	uint64_t lo; /**< Lower 8 bytes of the address or port */
+
+	bool operator==(const sketch_key &other) const {
+		return hi == other.hi && lo == other.lo;
+	}
+};
+
+/**
+ * \brief Hash a sketch key
+ * \param[in] key  Key
+ * \param[in] seed Seed (dimension)
+ * \return 64-bit hash
+ */
+static inline uint64_t
+sketch_hash(const sketch_key &key, uint64_t seed)
+{
+	uint64_t h = (key.hi ^ (seed * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+	h ^= key.lo + 0x94D049BB133111EBULL + (h << 6) + (h >> 2);
+	h ^= h >> 31;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= h >> 27;
+	h *= 0x94D049BB133111EBULL;
+	h ^= h >> 31;
+	return h;
+}
+
+/**
+ * \brief Parsed flow (sketch keys and hashes are prepared once per message)
+ */
+struct sketch_flow {
+	/** Keys of all dimensions */
+	sketch_key key[SD_CNT];
+	/** Hashes of the keys     */
+	uint64_t hash[SD_CNT];
+	/** Number of bytes        */
+	uint64_t bytes;
+	/** Number of packets      */
+	uint64_t packets;
+};
+
+/**
+ * \brief HyperLogLog distinct counter
+ */
+class HyperLogLog {
+private:
+	/** Number of index bits      */
+	unsigned precision;
+	/** Registers (2^precision)   */
+	std::vector<uint8_t> regs;
+
+public:
+	/**
+	 * \brief Constructor
+	 * \param[in] precision Number of index bits (4 - 18)
+	 */
+	explicit HyperLogLog(unsigned precision);
+
+	/**
+	 * \brief Add hashes of items
+	 * \param[in] hashes Hashes
+	 * \param[in] cnt    Number of hashes
+	 */
+	void add(const uint64_t *hashes, size_t cnt);
+
+	/** \brief Estimate number of distinct items */
+	double estimate() const;
+	/** \brief Remove all items */
+	void reset();
+};
+
+/**
+ * \brief Count-Min sketch
+ */
+class CountMin {
+private:
+	/** Mask of a column (width - 1) */
+	uint64_t mask;
+	/** Number of rows               */
+	unsigned depth;
+	/** Counters (row by row)        */
+	std::vector<uint64_t> counters;
+
+public:
+	/**
+	 * \brief Constructor
+	 * \param[in] width Number of counters in a row (power of two)
+	 * \param[in] depth Number of rows
+	 */
+	CountMin(uint32_t width, unsigned depth);
+
+	/**
+	 * \brief Add values of items
+	 * \param[in] hashes Hashes of the items
+	 * \param[in] values Values of the items
+	 * \param[in] cnt    Number of items
+	 */
+	void add(const uint64_t *hashes, const uint64_t *values, size_t cnt);
+
+	/**
+	 * \brief Estimate (upper bound of) the sum of values of an item
+	 * \param[in] hash Hash of the item
+	 */
+	uint64_t estimate(uint64_t hash) const;
+	/** \brief Remove all items */
+	void reset();
+};
+
+/**
+ * \brief Space-Saving heavy hitters
+ *
+ * Monitored items are kept in a min-heap ordered by their counts and indexed
+ * by an open addressing table. An unmonitored item replaces the item with the
+ * minimal count and inherits the count as its error.
+ */
+class SpaceSaving {
+public:
+	/** Monitored item */
+	struct item {
+		sketch_key key;  /**< Key                                      */
+		uint64_t hash;   /**< Hash of the key                          */
+		uint64_t count;  /**< Number of flows (upper bound)            */
+		uint64_t error;  /**< Maximal overestimation of the count      */
+	};
+
+private:
+	/** Maximal number of monitored items */
+	uint32_t capacity;
+	/** Min-heap of monitored items       */
+	std::vector<item> heap;
+	/** Index (position in the heap + 1, 0 is empty) */
+	std::vector<uint32_t> index;
+	/** Mask of the index                 */
+	uint64_t mask;
+
+	// Find a slot of the index
+	size_t slot_find(const sketch_key &key, uint64_t hash) const;
+	// Find a slot pointing to a position in the heap
+	size_t slot_of(size_t pos) const;
+	// Remove a slot of the index
+	void slot_remove(size_t slot);
+	// Move an item down the heap
+	void sift_down(size_t pos);
+	// Move an item up the heap
+	void sift_up(size_t pos);
+
+public:
+	/**
+	 * \brief Constructor
+	 * \param[in] capacity Maximal number of monitored items
+	 */
+	explicit SpaceSaving(uint32_t capacity);
+
+	/**
+	 * \brief Add an item
+	 * \param[in] key  Key of the item
+	 * \param[in] hash Hash of the key
+	 */
+	void add(const sketch_key &key, uint64_t hash);
+
+	/**
+	 * \brief Get items with the highest counts
+	 * \param[in] n Maximal number of items
+	 * \return Items ordered by their counts (descending)
+	 */
+	std::vector<item> top(size_t n) const;
+	/** \brief Remove all items */
+	void reset();
+};
+
+/** Parameters of sketches */
+struct sketch_params {
+	/** Number of monitored heavy hitters     */
+	uint32_t top_capacity;
+	/** Number of reported heavy hitters      */
+	uint32_t top_report;
+	/** Precision of HyperLogLog counters     */
+	unsigned hll_precision;
+	/** Width of Count-Min sketches           */
+	uint32_t cm_width;
+	/** Depth of Count-Min sketches           */
+	unsigned cm_depth;
+};
+
+/**
+ * \brief Sketches of one channel
+ *
+ * Each dimension (source/destination address/port) has its own heavy hitters,
+ * distinct counter and byte counters.
+ */
+class ChannelSketch {
+private:
+	/** Parameters                   */
+	const sketch_params &params;
+	/** Heavy hitters (by flows)     */
+	std::vector<SpaceSaving> top;
+	/** Distinct counters            */
+	std::vector<HyperLogLog> distinct;
+	/** Byte counters                */
+	std::vector<CountMin> bytes;
+
+	/** Total number of flows        */
+	uint64_t total_flows;
+	/** Total number of packets      */
+	uint64_t total_packets;
+	/** Total number of bytes        */
+	uint64_t total_bytes;
+
+	/** Buffer of hashes of a batch  */
+	std::vector<uint64_t> buf_hash;
+	/** Buffer of bytes of a batch   */
+	std::vector<uint64_t> buf_bytes;
+
+public:
+	/** Name of the channel (for snapshots) */
+	std::string name;
+	/** Flows of the current message that belong to the channel */
+	std::vector<uint16_t> pending;
+
+	/**
+	 * \brief Constructor
+	 * \param[in] params Parameters of sketches
+	 * \param[in] name   Name of the channel
+	 */
+	ChannelSketch(const sketch_params &params, const std::string &name);
+
+	/**
+	 * \brief Add pending flows of a message to the sketches
+	 * \param[in] flows Parsed flows of the message
+	 */
+	void update(const std::vector<sketch_flow> &flows);
+
+	/**
+	 * \brief Create a snapshot of the sketches (JSON object in one line)
+	 * \param[in] start Start of the interval
+	 * \param[in] end   End of the interval
+	 */
+	std::string snapshot(time_t start, time_t end) const;
+	/** \brief Remove all data (start a new interval) */
+	void reset();
+};
+
+#endif // SKETCH_H
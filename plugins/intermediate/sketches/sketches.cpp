@@ -0,0 +1,581 @@
+/**
+ * \file sketches.cpp
+ * \brief Intermediate plugin for streaming sketches (source file)
+ */
+/*
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is``, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include "configuration.h"
+#include "sketches.h"
+#include "Sketch.h"
+#include "Publisher.h"
+
+extern "C" {
+#include <ipfixcol.h>
+#include <ipfixcol/profiles.h>
+#include <ipfixcol/profile_events.h>
+
+// API version constant
+IPFIXCOL_API_VERSION
+}
+
+// Identifier for verbose macros
+static const char *msg_module = "sketches";
+
+/** IPFIX Information Element of bytes       */
+constexpr uint16_t IPFIX_IE_BYTES    = 1;
+/** IPFIX Information Element of packets     */
+constexpr uint16_t IPFIX_IE_PACKETS  = 2;
+/** IPFIX Information Element of src port    */
+constexpr uint16_t IPFIX_IE_SRC_PORT = 7;
+/** IPFIX Information Element of src IPv4    */
+constexpr uint16_t IPFIX_IE_SRC_IPV4 = 8;
+/** IPFIX Information Element of dst port    */
+constexpr uint16_t IPFIX_IE_DST_PORT = 11;
+/** IPFIX Information Element of dst IPv4    */
+constexpr uint16_t IPFIX_IE_DST_IPV4 = 12;
+/** IPFIX Information Element of src IPv6    */
+constexpr uint16_t IPFIX_IE_SRC_IPV6 = 27;
+/** IPFIX Information Element of dst IPv6    */
+constexpr uint16_t IPFIX_IE_DST_IPV6 = 28;
+
+/**
+ * \brief Plugin instance
+ */
+struct plugin_data {
+	/** Internal process configuration   */
+	void *ip_config;
+
+	/** Parsed parameters                */
+	plugin_config *cfg;
+	/** Event manager of profiles        */
+	pevents_t *events;
+	/** Publisher of snapshots           */
+	Publisher *publisher;
+	/** Start of the current interval    */
+	time_t interval_start;
+	/** End of the current snapshot      */
+	time_t interval_end;
+
+	/** Parsed flows of the current message           */
+	std::vector<sketch_flow> flows;
+	/** Number of flows with computed hashes          */
+	size_t hashed;
+	/** Channels with pending flows of the message    */
+	std::vector<ChannelSketch *> touched;
+	/** Snapshots waiting for publication             */
+	std::vector<std::string> snapshots;
+
+	// Constructor
+	plugin_data() {
+		ip_config = nullptr;
+		cfg = nullptr;
+		events = nullptr;
+		publisher = nullptr;
+		interval_start = 0;
+		interval_end = 0;
+		hashed = 0;
+	}
+
+	// Destructor
+	~plugin_data() {
+		if (events != nullptr) {
+			pevents_destroy(events);
+		}
+		if (publisher != nullptr) {
+			delete(publisher);
+		}
+		if (cfg != nullptr) {
+			delete(cfg);
+		}
+	}
+
+	// Disable copy constructors
+	plugin_data(const plugin_data &) = delete;
+	plugin_data &operator=(const plugin_data &) = delete;
+};
+
+/**
+ * \brief Get a value of an unsigned integer (stored in big endian order a.k.a.
+ *   network byte order)
+ *
+ * \param[in]  field  Pointer to the data field (in "network byte order")
+ * \param[in]  size   Size of the data field (min: 1 byte, max: 8 bytes)
+ * \return Converted value or 0 (invalid size of the field)
+ */
+static inline uint64_t
+flow_convert_field(const uint8_t *field, int size)
+{
+	if (size <= 0 || size > 8) {
+		return 0;
+	}
+
+	uint64_t value = 0;
+	memcpy(&(((uint8_t *) &value)[8 - size]), field, size);
+	return be64toh(value);
+}
+
+/**
+ * \brief Find an IANA IPFIX field in a record
+ *
+ * Offsets of common fields are cached in the template by the collector.
+ * \param[in]  rec   IPFIX record
+ * \param[in]  id    Identification of IPFIX Information Element
+ * \param[out] size  Size of the field
+ * \return Pointer to the field or NULL (the field is not present)
+ */
+static inline const uint8_t *
+flow_get_field(struct ipfix_record *rec, uint16_t id, int &size)
+{
+	uint8_t *rec_data = static_cast<uint8_t *>(rec->record);
+	return data_record_get_field(rec_data, rec->templ, 0, id, &size);
+}
+
+/**
+ * \brief Fill an address key (IPv4 addresses are mapped to IPv6)
+ * \param[in]  rec   IPFIX record
+ * \param[in]  id4   IPv4 Information Element
+ * \param[in]  id6   IPv6 Information Element
+ * \param[out] key   Key
+ * \return On success returns 0. Otherwise (no address) returns non-zero value.
+ */
+static inline int
+flow_addr_key(struct ipfix_record *rec, uint16_t id4, uint16_t id6,
+	sketch_key &key)
+{
+	uint8_t addr[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+	int size;
+
+	const uint8_t *field = flow_get_field(rec, id4, size);
+	if (field && size == 4) {
+		memcpy(addr + 12, field, 4);
+	} else {
+		field = flow_get_field(rec, id6, size);
+		if (!field || size != 16) {
+			return 1;
+		}
+		memcpy(addr, field, 16);
+	}
+
+	memcpy(&key.hi, addr, 8);
+	memcpy(&key.lo, addr + 8, 8);
+	return 0;
+}
+
+/**
+ * \brief Parse flow fields used by the sketches
+ * \param[in]  rec  IPFIX record
+ * \param[out] flow Parsed flow (without hashes)
+ * \return On success returns 0. Otherwise (addresses not found), returns
+ *   a non-zero value.
+ */
+static inline int
+flow_prepare(struct ipfix_record *rec, struct sketch_flow &flow)
+{
+	const uint8_t *field;
+	int size;
+
+	if (flow_addr_key(rec, IPFIX_IE_SRC_IPV4, IPFIX_IE_SRC_IPV6,
+			flow.key[SD_SRC_ADDR])
+		|| flow_addr_key(rec, IPFIX_IE_DST_IPV4, IPFIX_IE_DST_IPV6,
+			flow.key[SD_DST_ADDR])) {
+		return 1;
+	}
+
+	field = flow_get_field(rec, IPFIX_IE_SRC_PORT, size);
+	flow.key[SD_SRC_PORT].hi = 0;
+	flow.key[SD_SRC_PORT].lo = field ? flow_convert_field(field, size) : 0;
+
+	field = flow_get_field(rec, IPFIX_IE_DST_PORT, size);
+	flow.key[SD_DST_PORT].hi = 0;
+	flow.key[SD_DST_PORT].lo = field ? flow_convert_field(field, size) : 0;
+
+	field = flow_get_field(rec, IPFIX_IE_BYTES, size);
+	flow.bytes = field ? flow_convert_field(field, size) : 0;
+
+	field = flow_get_field(rec, IPFIX_IE_PACKETS, size);
+	flow.packets = field ? flow_convert_field(field, size) : 0;
+
+	return 0;
+}
+
+/**
+ * \brief Compute hashes of parsed flows that have not been hashed yet
+ *
+ * Hashes are computed for the whole message at once, dimension by dimension.
+ * \param[in,out] instance Plugin instance
+ */
+static void
+flows_hash(plugin_data *instance)
+{
+	std::vector<sketch_flow> &flows = instance->flows;
+	const size_t cnt = flows.size();
+
+	for (unsigned dim = 0; dim < SD_CNT; ++dim) {
+		for (size_t i = instance->hashed; i < cnt; ++i) {
+			flows[i].hash[dim] = sketch_hash(flows[i].key[dim], dim);
+		}
+	}
+
+	instance->hashed = cnt;
+}
+
+/**
+ * \brief Add pending flows of the message to the sketches of all channels
+ * \param[in,out] instance Plugin instance
+ */
+static void
+flows_flush(plugin_data *instance)
+{
+	flows_hash(instance);
+
+	for (ChannelSketch *sketch : instance->touched) {
+		sketch->update(instance->flows);
+	}
+
+	instance->touched.clear();
+	instance->flows.clear();
+	instance->hashed = 0;
+}
+
+/**
+ * \brief Create a new channel
+ * \param[in] ctx Event context (local and global data)
+ * \return Pointer to newly created sketches of the channel
+ */
+static void *
+channel_create_cb(struct pevents_ctx *ctx)
+{
+	plugin_data *instance = static_cast<plugin_data *>(ctx->user.global);
+	void *channel_ptr = ctx->ptr.channel;
+	const char *channel_path = channel_get_path(channel_ptr);
+	const char *channel_name = channel_get_name(channel_ptr);
+	MSG_DEBUG(msg_module, "Creating channel '%s%s'...", channel_path,
+		channel_name);
+
+	ChannelSketch *sketch = nullptr;
+
+	try {
+		sketch = new ChannelSketch(instance->cfg->sketch,
+			std::string(channel_path) + channel_name);
+	} catch (std::exception &ex) {
+		MSG_WARNING(msg_module, "Failed to create channel '%s%s': %s",
+			channel_path, channel_name, ex.what());
+		return nullptr;
+	}
+
+	MSG_INFO(msg_module, "Channel '%s%s' has been successfully created.",
+		channel_path, channel_name);
+	return sketch;
+}
+
+/**
+ * \brief Destroy a channel
+ *
+ * Pending flows are added to the sketches and the snapshot of the channel
+ * is published with the snapshots of the current interval.
+ * \param[in,out] ctx Event context (local and global data)
+ */
+static void
+channel_delete_cb(struct pevents_ctx *ctx)
+{
+	plugin_data *instance = static_cast<plugin_data *>(ctx->user.global);
+	ChannelSketch *sketch = static_cast<ChannelSketch *>(ctx->user.local);
+	if (!sketch) {
+		// Nothing to delete
+		return;
+	}
+
+	MSG_DEBUG(msg_module, "Deleting channel '%s'...", sketch->name.c_str());
+
+	if (!sketch->pending.empty()) {
+		flows_hash(instance);
+		sketch->update(instance->flows);
+		auto &touched = instance->touched;
+		touched.erase(std::remove(touched.begin(), touched.end(), sketch),
+			touched.end());
+	}
+
+	try {
+		instance->snapshots.push_back(sketch->snapshot(instance->interval_start,
+			time(NULL)));
+	} catch (std::exception &ex) {
+		MSG_WARNING(msg_module, "Failed to create a snapshot of channel '%s': "
+			"%s", sketch->name.c_str(), ex.what());
+	}
+
+	MSG_INFO(msg_module, "Channel '%s' has been successfully closed.",
+		sketch->name.c_str());
+	delete sketch;
+}
+
+/**
+ * \brief Add a flow
+ *
+ * The flow is only remembered, sketches are updated with all flows of
+ * the message at once.
+ * \param[in,out] ctx  Event context (local and global data)
+ * \param[in]     data Pointer to the index of the parsed flow
+ */
+static void
+channel_data_cb(struct pevents_ctx *ctx, void *data)
+{
+	plugin_data *instance = static_cast<plugin_data *>(ctx->user.global);
+	ChannelSketch *sketch = static_cast<ChannelSketch *>(ctx->user.local);
+	if (!sketch) {
+		return;
+	}
+
+	if (sketch->pending.empty()) {
+		instance->touched.push_back(sketch);
+	}
+
+	sketch->pending.push_back(*static_cast<uint16_t *>(data));
+}
+
+/**
+ * \brief Take a snapshot of a channel and start a new interval
+ * \param[in,out] ctx Event context (local and global data)
+ */
+static void
+channel_snapshot_fn(struct pevents_ctx *ctx)
+{
+	plugin_data *instance = static_cast<plugin_data *>(ctx->user.global);
+	ChannelSketch *sketch = static_cast<ChannelSketch *>(ctx->user.local);
+	if (!sketch) {
+		return;
+	}
+
+	try {
+		instance->snapshots.push_back(sketch->snapshot(instance->interval_start,
+			instance->interval_end));
+	} catch (std::exception &ex) {
+		MSG_WARNING(msg_module, "Failed to create a snapshot of channel '%s': "
+			"%s", sketch->name.c_str(), ex.what());
+	}
+
+	sketch->reset();
+}
+
+/**
+ * \brief Publish snapshots of all channels
+ * \param[in,out] instance Plugin instance
+ * \param[in]     end      End of the interval
+ */
+static void
+snapshots_publish(plugin_data *instance, time_t end)
+{
+	instance->interval_end = end;
+	pevents_for_each(instance->events, nullptr, channel_snapshot_fn);
+
+	if (!instance->snapshots.empty()) {
+		instance->publisher->publish(instance->snapshots);
+		instance->snapshots.clear();
+	}
+}
+
+/**
+ * \brief Plugin initialization
+ *
+ * \param[in] params xml   Configuration
+ * \param[in] ip_config    Intermediate process config
+ * \param[in] ip_id        Intermediate process ID for template manager
+ * \param[in] template_mgr Template manager
+ * \param[out] config      Config storage
+ * \return 0 on success
+ */
+int
+intermediate_init(char* params, void* ip_config, uint32_t ip_id,
+	ipfix_template_mgr* template_mgr, void** config)
+{
+	// Suppress compiler warnings
+	(void) ip_id;
+	(void) template_mgr;
+
+	if (!params) {
+		MSG_ERROR(msg_module, "Missing plugin configuration.", NULL);
+		return 1;
+	}
+
+	try {
+		std::unique_ptr<struct plugin_data> data(new struct plugin_data());
+		// Parse parameters
+		data.get()->cfg = new plugin_config(params);
+		// Prepare outputs
+		data.get()->publisher = new Publisher(data.get()->cfg->file,
+			data.get()->cfg->socket);
+		data.get()->flows.reserve(UINT16_MAX);
+
+		// Create a profile event manager (only channels are used)
+		struct pevent_cb_set channel_cb;
+		memset(&channel_cb, 0, sizeof(channel_cb));
+		channel_cb.on_create = channel_create_cb;
+		channel_cb.on_delete = channel_delete_cb;
+		channel_cb.on_data =   channel_data_cb;
+
+		struct pevent_cb_set profile_cb;
+		memset(&profile_cb, 0, sizeof(profile_cb));
+
+		data.get()->events = pevents_create(profile_cb, channel_cb);
+		if (!data.get()->events) {
+			throw std::runtime_error("Failed to initialize a manager of "
+				"profile events");
+		}
+		// Global data will be pointer to the plugin instance
+		pevents_global_set(data.get()->events, data.get());
+
+		// Save configuration
+		data.get()->ip_config = ip_config;
+		*config = data.release();
+
+	} catch (const std::exception &ex) {
+		// Standard exceptions
+		MSG_ERROR(msg_module, "%s", ex.what());
+		return 1;
+	} catch (...) {
+		// Non-standard exceptions
+		MSG_ERROR(msg_module, "Unknown exception has occurred.", NULL);
+		return 1;
+	}
+
+	MSG_DEBUG(msg_module, "Successfully initialized.", NULL);
+	return 0;
+}
+
+/**
+ * \brief Process IPFIX message
+ *
+ * Flows are parsed and assigned to their channels first, then hashes of all
+ * flows are computed and sketches of each affected channel are updated with
+ * all its flows at once.
+ * \param[in] config  Plugin configuration
+ * \param[in] message IPFIX message
+ * \return 0 on success
+ */
+int
+intermediate_process_message(void* config, void* message)
+{
+	struct plugin_data *instance = static_cast<struct plugin_data *>(config);
+	struct ipfix_message *msg = static_cast<struct ipfix_message *>(message);
+
+	// Catch closing message
+	if (msg->source_status == SOURCE_STATUS_CLOSED) {
+		pass_message(instance->ip_config, msg);
+		return 0;
+	}
+
+	// Are we still in the same interval or we should create a new one
+	time_t now = time(NULL);
+	if (difftime(now, instance->interval_start) >= instance->cfg->interval) {
+		time_t new_time = now;
+
+		if (instance->cfg->alignment) {
+			// We expect that time is integer value
+			new_time /= instance->cfg->interval;
+			new_time *= instance->cfg->interval;
+		}
+
+		if (instance->interval_start != 0) {
+			snapshots_publish(instance, new_time);
+		}
+		instance->interval_start = new_time;
+	}
+
+	// Parse all IPFIX records and assign them to channels
+	try {
+		for (uint16_t i = 0; i < msg->data_records_count; ++i) {
+			struct metadata *mdata = &msg->metadata[i];
+			if (!mdata->channels) {
+				// No channels -> skip
+				continue;
+			}
+
+			// Metadata are packed, use an aligned copy of the record
+			struct ipfix_record record = mdata->record;
+			instance->flows.emplace_back();
+			if (flow_prepare(&record, instance->flows.back()) != 0) {
+				instance->flows.pop_back();
+				continue;
+			}
+
+			uint16_t idx = instance->flows.size() - 1;
+			pevents_process(instance->events, (const void **) mdata->channels,
+				&idx);
+		}
+
+		flows_flush(instance);
+	} catch (std::exception &ex) {
+		MSG_WARNING(msg_module, "Failed to update sketches: %s", ex.what());
+		for (ChannelSketch *sketch : instance->touched) {
+			sketch->pending.clear();
+		}
+		instance->touched.clear();
+		instance->flows.clear();
+		instance->hashed = 0;
+	}
+
+	// Always pass a message
+	pass_message(instance->ip_config, msg);
+	return 0;
+}
+
+/**
+ * \brief Close intermediate plugin
+ *
+ * \param[in] config Plugin configuration
+ * \return 0 on success
+ */
+int
+intermediate_close(void *config)
+{
+	MSG_DEBUG(msg_module, "Closing...", NULL);
+	struct plugin_data *instance = static_cast<struct plugin_data *>(config);
+
+	// Destroy all channels (their snapshots are created) and publish them
+	pevents_destroy(instance->events);
+	instance->events = nullptr;
+	if (!instance->snapshots.empty()) {
+		instance->publisher->publish(instance->snapshots);
+	}
+
+	delete(instance);
+	return 0;
+}
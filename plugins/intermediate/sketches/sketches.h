@@ -0,0 +1,57 @@
+/**
+ * \file sketches.h
+ * \brief Intermediate plugin for streaming sketches (header file)
+ */
+/*
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is``, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef SKETCHES_H
+#define SKETCHES_H
+
+/** Dimensions of sketches */
+enum sketch_dim {
+	SD_SRC_ADDR = 0, /**< This MUST be the first!              */
+	SD_DST_ADDR,
+	SD_SRC_PORT,
+	SD_DST_PORT,
+	SD_CNT           /**< This must be always the last element */
+};
+
+/** Names of dimensions in snapshots (indexed by ::sketch_dim) */
+static const char * const sketch_dim_names[SD_CNT] = {
+	"srcAddr", "dstAddr", "srcPort", "dstPort"
+};
+
+#endif // SKETCHES_H
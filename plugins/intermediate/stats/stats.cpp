@@ -56,6 +56,7 @@ IPFIXCOL_API_VERSION;
 #include <sstream>
 #include <vector>
 #include <stdexcept>
+#include <cstring>
 
 /* Identifier for verbose macros */
 static const char *msg_module = "stats";
@@ -81,6 +82,8 @@ static const std::vector<const char*> fields{
 	"traffic",	"traffic_tcp",	"traffic_udp",	"traffic_icmp",	"traffic_other"
 };
 
+stats_updater *stats_updater_start(plugin_conf *conf);
+
 /**
  * \brief Process startup configuration
  *
@@ -170,6 +173,13 @@ int intermediate_init(char* params, void* ip_config, uint32_t ip_id, ipfix_templ
 			conf->templ += fields[i];
 		}
 
+		/* Start RRD updater */
+		conf->updater = stats_updater_start(conf);
+		if (!conf->updater) {
+			delete conf;
+			throw std::runtime_error("Failed to start RRD updater thread");
+		}
+
 		/* Save configuration */
 		conf->ip_config = ip_config;
 		*config = conf;
@@ -185,13 +195,12 @@ int intermediate_init(char* params, void* ip_config, uint32_t ip_id, ipfix_templ
 }
 
 /**
- * \brief Create new RRD database
+ * \brief Create new stats counters
  *
- * \param[in] conf plugin configuration
  * \param[in] file path to RRD file
  * \return stats_data structure
  */
-stats_data *stats_rrd_create(plugin_conf *conf, std::string file)
+stats_data *stats_data_create(std::string file)
 {
 	/* Create stats counters */
 	stats_data *stats = new stats_data;
@@ -204,13 +213,44 @@ stats_data *stats_rrd_create(plugin_conf *conf, std::string file)
 		}
 	}
 
+	return stats;
+}
+
+/**
+ * \brief Create directory of the RRD file
+ *
+ * \param[in] file path to RRD file
+ */
+void stats_create_dir(const std::string &file)
+{
+	size_t last_slash = file.find_last_of("/");
+	if (last_slash == std::string::npos) {
+		return;
+	}
+
+	std::string command = "mkdir -p \"" + file.substr(0, last_slash) + "\"";
+	system(command.c_str());
+}
+
+/**
+ * \brief Create new RRD database (if it does not exist)
+ *
+ * \param[in] updater RRD updater
+ * \param[in] file path to RRD file
+ * \param[in] start time of the first update
+ * \return 0 on success
+ */
+int stats_rrd_create(stats_updater *updater, const std::string &file, uint64_t start)
+{
 	/* Create file */
 	struct stat sts;
 	if (!(stat(file.c_str(), &sts) == -1 && errno == ENOENT)) {
 		/* File already exists */
-		return stats;
+		return 0;
 	}
 
+	stats_create_dir(file);
+
 	char buffer[64];
 
 	/* Create arguments field */
@@ -222,19 +262,19 @@ stats_data *stats_rrd_create(plugin_conf *conf, std::string file)
 
 	/*
 	 * Set start time
-	 * time is decreased by conf->interval because it is not possible to
+	 * time is decreased by interval because it is not possible to
 	 * update the RRD for the next step time.
 	 */
-	snprintf(buffer, 64, "--start=%lu", stats->last - conf->interval);
+	snprintf(buffer, 64, "--start=%lu", start - updater->interval);
 	argv.push_back(buffer);
 
 	/* Set interval */
-	snprintf(buffer, 64, "--step=%d", conf->interval);
+	snprintf(buffer, 64, "--step=%d", updater->interval);
 	argv.push_back(buffer);
 
 	/* Add all fields */
 	for (auto field: fields) {
-		snprintf(buffer, 64, "DS:%s:ABSOLUTE:%u:U:U", field, conf->interval * 2); /* datasource definition, wait 2x the interval for data */
+		snprintf(buffer, 64, "DS:%s:ABSOLUTE:%u:U:U", field, updater->interval * 2); /* datasource definition, wait 2x the interval for data */
 		argv.push_back(buffer);
 	}
 
@@ -256,30 +296,29 @@ stats_data *stats_rrd_create(plugin_conf *conf, std::string file)
 	}
 
 	/* Create RRD database */
+	int ret = 0;
 	if (rrd_create(argv.size(), (char **) c_argv)) {
 		MSG_ERROR(msg_module, "Create RRD DB Error: %s", rrd_get_error());
 		rrd_clear_error();
-		delete stats;
-		return NULL;
+		ret = 1;
 	}
 
-	return stats;
+	delete[] c_argv;
+	return ret;
 }
 
 /**
- * \brief Convert stats counters to string
- *			!! Also resets counters !!
+ * \brief Convert snapshot of stats counters to string
  *
- * \param[in] last	update time
- * \param[in] fields stats fields
+ * \param[in] snapshot stats counters
  * \return counters converted to string
  */
-std::string stats_counters_to_string(uint64_t last, uint64_t fields[GROUPS][PROTOCOLS_PER_GROUP])
+std::string stats_snapshot_to_string(const stats_snapshot &snapshot)
 {
 	std::stringstream ss;
 
 	/* Add update time */
-	ss << last;
+	ss << snapshot.time;
 
 	/* Go through all groups */
 	for (int group = 0; group < GROUPS; ++group) {
@@ -295,10 +334,7 @@ std::string stats_counters_to_string(uint64_t last, uint64_t fields[GROUPS][PROT
 			}
 
 			/* Add field */
-			ss << fields[group][field];
-
-			/* Reset counter */
-			fields[group][field] = 0;
+			ss << snapshot.fields[group][field];
 		}
 	}
 
@@ -308,23 +344,38 @@ std::string stats_counters_to_string(uint64_t last, uint64_t fields[GROUPS][PROT
 /**
  * \brief Update RRD stats file
  *
- * \param[in] stats Stats data
- * \param[in] templ RRD template
+ * All pending snapshots of the file are written by one update.
+ *
+ * \param[in] updater RRD updater
+ * \param[in] file path to RRD file
+ * \param[in] snapshots stats counters (ordered by time)
  */
-void stats_update(stats_data *stats, std::string templ)
+void stats_rrd_update(stats_updater *updater, const std::string &file,
+		const std::vector<stats_snapshot> &snapshots)
 {
+	/* Create the file first */
+	if (updater->ready.find(file) == updater->ready.end()) {
+		if (stats_rrd_create(updater, file, snapshots.front().time)) {
+			return;
+		}
+
+		updater->ready.insert(file);
+	}
+
 	std::vector<std::string> argv;
 
 	/* Set RRD file */
 	argv.push_back("update");
-	argv.push_back(stats->file);
+	argv.push_back(file);
 
 	/* Set template */
 	argv.push_back("--template");
-	argv.push_back(templ);
+	argv.push_back(updater->templ);
 
 	/* Add counters */
-	argv.push_back(stats_counters_to_string(stats->last, stats->fields));
+	for (const stats_snapshot &snapshot: snapshots) {
+		argv.push_back(stats_snapshot_to_string(snapshot));
+	}
 
 	/* Create C style argv */
 	const char **c_argv = new const char*[argv.size()];
@@ -341,6 +392,117 @@ void stats_update(stats_data *stats, std::string templ)
 	delete[] c_argv;
 }
 
+/**
+ * \brief RRD updater's thread function
+ *
+ * Waits for snapshots of counters and writes them to RRD files.
+ *
+ * \param[in] context RRD updater
+ * \return NULL
+ */
+void *stats_updater_thread(void *context)
+{
+	stats_updater *updater = static_cast<stats_updater *>(context);
+	std::map<std::string, std::vector<stats_snapshot> > batch;
+
+	pthread_mutex_lock(&updater->mutex);
+	while (true) {
+		while (updater->pending.empty() && !updater->stop) {
+			pthread_cond_wait(&updater->cond, &updater->mutex);
+		}
+
+		if (updater->pending.empty()) {
+			/* Stopped and nothing left to do */
+			break;
+		}
+
+		/* Take all pending snapshots */
+		batch.swap(updater->pending);
+		pthread_mutex_unlock(&updater->mutex);
+
+		for (auto &file: batch) {
+			stats_rrd_update(updater, file.first, file.second);
+		}
+		batch.clear();
+
+		pthread_mutex_lock(&updater->mutex);
+	}
+	pthread_mutex_unlock(&updater->mutex);
+
+	return NULL;
+}
+
+/**
+ * \brief Start RRD updater
+ *
+ * \param[in] conf plugin configuration
+ * \return RRD updater or NULL
+ */
+stats_updater *stats_updater_start(plugin_conf *conf)
+{
+	stats_updater *updater = new stats_updater;
+	updater->stop = false;
+	updater->interval = conf->interval;
+	updater->templ = conf->templ;
+
+	if (pthread_mutex_init(&updater->mutex, NULL) != 0) {
+		delete updater;
+		return NULL;
+	}
+
+	if (pthread_cond_init(&updater->cond, NULL) != 0) {
+		pthread_mutex_destroy(&updater->mutex);
+		delete updater;
+		return NULL;
+	}
+
+	if (pthread_create(&updater->thread, NULL, stats_updater_thread, updater) != 0) {
+		pthread_cond_destroy(&updater->cond);
+		pthread_mutex_destroy(&updater->mutex);
+		delete updater;
+		return NULL;
+	}
+
+	return updater;
+}
+
+/**
+ * \brief Write all pending snapshots and stop RRD updater
+ *
+ * \param[in] updater RRD updater
+ */
+void stats_updater_stop(stats_updater *updater)
+{
+	pthread_mutex_lock(&updater->mutex);
+	updater->stop = true;
+	pthread_cond_signal(&updater->cond);
+	pthread_mutex_unlock(&updater->mutex);
+
+	pthread_join(updater->thread, NULL);
+	pthread_cond_destroy(&updater->cond);
+	pthread_mutex_destroy(&updater->mutex);
+	delete updater;
+}
+
+/**
+ * \brief Pass counters to RRD updater and reset them
+ *
+ * \param[in] updater RRD updater
+ * \param[in] stats stats data
+ */
+void stats_updater_push(stats_updater *updater, stats_data *stats)
+{
+	stats_snapshot snapshot;
+	snapshot.time = stats->last;
+	memcpy(snapshot.fields, stats->fields, sizeof(snapshot.fields));
+	memset(stats->fields, 0, sizeof(stats->fields));
+
+	pthread_mutex_lock(&updater->mutex);
+	updater->pending[stats->file].push_back(snapshot);
+	pthread_cond_signal(&updater->cond);
+	pthread_mutex_unlock(&updater->mutex);
+}
+
 /**
  * \brief Create path to the rrd file on filesystem
  *
@@ -367,17 +529,13 @@ std::string stats_create_file(std::string path, uint32_t odid)
 		path.replace(o_loc, 2, domain_id);
 	}
 
-	/* Create directory */
-	size_t last_slash = path.find_last_of("/");
-	std::string command = "mkdir -p \"" + path.substr(0, last_slash) + "\"";
-
-	system(command.c_str());
-
 	return path;
 }
 
 /**
- * \brief Find or create RRD stats file for given ODID
+ * \brief Find or create stats counters for given ODID
+ *
+ * The RRD file itself is created by RRD updater.
  *
  * \param[in] conf plugin's configuration
  * \param[in] odid Observation Domain ID
@@ -392,15 +550,39 @@ stats_data *stats_get_rrd_file(plugin_conf *conf, uint32_t odid)
 		return stats;
 	}
 
-	/* Create new RRD file */
+	/* Create new counters */
 	std::string file = stats_create_file(conf->path, odid);
 
-	stats = stats_rrd_create(conf, file);
+	stats = stats_data_create(file);
 	conf->stats[odid] = stats;
 
 	return stats;
 }
 
+/**
+ * \brief Get a field of a data record
+ *
+ * Offsets of common fields are cached in the template (only for templates
+ * without variable-length fields).
+ *
+ * \param[in] rec Data record
+ * \param[in] offset_id Offset identifier of the field in the template
+ * \param[in] field_id Field ID
+ * \param[out] size Size of the field
+ * \return pointer to the field or NULL
+ */
+static inline uint8_t *stats_field_get(ipfix_record *rec, int offset_id,
+		int field_id, int *size)
+{
+	const struct ipfix_offsets *cached = &rec->templ->offsets[offset_id];
+	if (cached->offset >= 0) {
+		*size = cached->bytes;
+		return (uint8_t *) rec->record + cached->offset;
+	}
+
+	return data_record_get_field((uint8_t *) rec->record, rec->templ, 0, field_id, size);
+}
+
 /**
  * \brief Converts IPFIX protocolIdentifier to stats protocol
  *
@@ -410,7 +592,8 @@ stats_data *stats_get_rrd_file(plugin_conf *conf, uint32_t odid)
 enum st_protocol stats_get_proto(ipfix_record *rec)
 {
 	/* Get protocolIdentifier */
-	uint8_t *data = data_record_get_field((uint8_t*) rec->record, rec->templ, 0, PROTOCOL_ID, NULL);
+	int size;
+	uint8_t *data = stats_field_get(rec, OF_PROTOCOL, PROTOCOL_ID, &size);
 	int ipfix_proto = data ? (*((uint8_t *) (data))) : 0;
 
 	/* Decode value */
@@ -427,13 +610,14 @@ enum st_protocol stats_get_proto(ipfix_record *rec)
  * \brief Get field value
  *
  * \param[in] rec Data record
+ * \param[in] offset_id Offset identifier of the field in the template
  * \param[in] field_id	Field ID
  * \return field value (or zero if not found)
  */
-uint64_t stats_field_val(ipfix_record *rec, int field_id)
+uint64_t stats_field_val(ipfix_record *rec, int offset_id, int field_id)
 {
 	int dataSize = 0;
-	uint8_t *data = data_record_get_field((uint8_t*) rec->record, rec->templ, 0, field_id, &dataSize);
+	uint8_t *data = stats_field_get(rec, offset_id, field_id, &dataSize);
 
 	/* Field not found */
 	if (!data) {
@@ -459,8 +643,8 @@ uint64_t stats_field_val(ipfix_record *rec, int field_id)
 void stats_update_counters(stats_data *stats, metadata *mdata)
 {
 	/* Get stats values  */
-	uint64_t packets = stats_field_val(&(mdata->record), PACKETS_ID);
-	uint64_t traffic = stats_field_val(&(mdata->record), TRAFFIC_ID);
+	uint64_t packets = stats_field_val(&(mdata->record), OF_PACKETS, PACKETS_ID);
+	uint64_t traffic = stats_field_val(&(mdata->record), OF_OCTETS, TRAFFIC_ID);
 
 	/* Decode protocol */
 	enum st_protocol proto = stats_get_proto(&(mdata->record));
@@ -477,7 +661,7 @@ void stats_update_counters(stats_data *stats, metadata *mdata)
 }
 
 /**
- * \brief Update RRD files if interval passed
+ * \brief Pass counters to RRD updater if interval passed
  *
  * \param[in] conf plugin config
  * \param[in] force ignore interval, always update files
@@ -493,7 +677,7 @@ void stats_flush_counters(plugin_conf *conf, bool force = false)
 		}
 
 		if (force || ((st.second->last / conf->interval + 1) * conf->interval <= now)) {
-			stats_update(st.second, conf->templ);
+			stats_updater_push(conf->updater, st.second);
 			st.second->last = now;
 		}
 	}
@@ -554,6 +738,13 @@ int intermediate_close(void *config)
 	/* Force update counters */
 	stats_flush_counters(conf, true);
 
+	/* Write pending updates */
+	stats_updater_stop(conf->updater);
+
+	for (auto st: conf->stats) {
+		delete st.second;
+	}
+
 	/* Destroy configuration */
 	delete conf;
 
@@ -3,6 +3,9 @@
 
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
+#include <pthread.h>
 
 /* Default stats interval */
 #define DEFAULT_INTERVAL 300
@@ -49,6 +52,31 @@ struct stats_data {
 	uint64_t fields[GROUPS][PROTOCOLS_PER_GROUP];	/**< Stats fields per group */
 };
 
+/**
+ * Counters of one interval waiting for the RRD updater
+ */
+struct stats_snapshot {
+	uint64_t time;		/**< Update time */
+	uint64_t fields[GROUPS][PROTOCOLS_PER_GROUP];	/**< Stats fields per group */
+};
+
+/**
+ * RRD updater thread
+ *
+ * RRD files are created and updated only by this thread, the intermediate
+ * thread only passes snapshots of counters.
+ */
+struct stats_updater {
+	pthread_t thread;		/**< Updater thread */
+	pthread_mutex_t mutex;	/**< Mutex for pending snapshots and stop flag */
+	pthread_cond_t cond;	/**< New snapshots or stop request */
+	bool stop;				/**< Stop flag */
+	uint32_t interval;		/**< Statistics interval */
+	std::string templ;		/**< RRD template */
+	std::map<std::string, std::vector<stats_snapshot> > pending;	/**< Snapshots per RRD file */
+	std::set<std::string> ready;	/**< Existing RRD files (updater only) */
+};
+
 /**
  * \struct plugin_conf
  *
@@ -60,6 +88,7 @@ struct plugin_conf {
 	void *ip_config;		/**< intermediate process config */
 	std::string templ;		/**< RRD template */
 	std::map<uint32_t, stats_data*> stats;	/**< RRD stats per ODID */
+	stats_updater *updater;	/**< RRD updater */
 };
 
 
@@ -8,6 +8,13 @@ extern "C" {
 #ifdef HAVE_LIBBZ2
 #include <bzlib.h>
 #endif
+#ifdef HAVE_LIBLZ4
+#include <lz4frame.h>
+#include <lz4hc.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 #include <string.h>
 #include <errno.h>
 #include <libxml/parser.h>
@@ -28,6 +35,14 @@ column_writer *column_writer::create(const char *name, xmlDoc *doc, xmlNode *nod
 #ifdef HAVE_LIBBZ2
 	} else if (!strcmp(name, "bzip2")) {
 		result = new bzip_writer;
+#endif
+#ifdef HAVE_LIBLZ4
+	} else if (!strcmp(name, "lz4")) {
+		result = new lz4_writer;
+#endif
+#ifdef HAVE_LIBZSTD
+	} else if (!strcmp(name, "zstd")) {
+		result = new zstd_writer;
 #endif
 	} else {
 		result = NULL;
@@ -39,7 +54,14 @@ column_writer *column_writer::create(const char *name, xmlDoc *doc, xmlNode *nod
 	return result;
 }
 
-bool plain_writer::write(const char *column_file, size_t size, const void *data)
+/**
+ * @brief Append buffer to the end of a file.
+ * @param column_file Path to the file.
+ * @param size Number of bytes to write.
+ * @param data Data to write.
+ * @return true on success.
+ */
+static bool append_file(const char *column_file, size_t size, const void *data)
 {
 	int column_fd;
 	size_t written = 0;
@@ -53,8 +75,15 @@ bool plain_writer::write(const char *column_file, size_t size, const void *data)
 	}
 
 	while (written < size) {
-		//n = write(column_fd, ((char *) data) + written, (size-written < BUFSIZ) ? (size-written) : BUFSIZ);
 		n = ::write(column_fd, ((char *) data) + written, size-written);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			MSG_ERROR(MSG_MODULE, "couldn't write file '%s': %s", column_file, strerror(errno));
+			::close(column_fd);
+			return false;
+		}
 		written += n;
 	}
 	::close(column_fd);
@@ -62,6 +91,11 @@ bool plain_writer::write(const char *column_file, size_t size, const void *data)
 	return true;
 }
 
+bool plain_writer::write(const char *column_file, size_t size, const void *data)
+{
+	return append_file(column_file, size, data);
+}
+
 #ifdef HAVE_LIBZ
 
 void gzip_writer::conf_init(xmlDoc *doc, xmlNode *node)
@@ -216,3 +250,144 @@ bool bzip_writer::write(const char *filename, size_t size, const void *data)
 }
 #endif
 
+
+#ifdef HAVE_LIBLZ4
+
+void lz4_writer::conf_init(xmlDoc *doc, xmlNode *node)
+{
+	xmlNode *cur;
+	unsigned int ulevel;
+
+	if (!doc || !node) {
+		return;
+	}
+
+	cur = node->xmlChildrenNode;
+	while (cur != NULL) {
+		if (cur->type != XML_ELEMENT_NODE) {
+			cur = cur->next;
+			continue;
+		}
+		if (!xmlStrcmp(cur->name, (const xmlChar *) "level")) {
+			if (!xml_get_uint(doc, cur, &ulevel) || ulevel > LZ4HC_CLEVEL_MAX) {
+				MSG_WARNING(MSG_MODULE, "invalid lz4 compression level, using default value");
+				level = 0;
+			} else {
+				level = ulevel;
+			}
+		} else {
+			MSG_ERROR(MSG_MODULE, "invalid lz4 option '%s'", cur->name);
+		}
+		cur = cur->next;
+	}
+}
+
+/*
+ * Every call appends one complete LZ4 frame. Concatenated frames form a valid
+ * LZ4 stream, so the column can be decompressed as a whole.
+ */
+bool lz4_writer::write(const char *filename, size_t size, const void *data)
+{
+	LZ4F_preferences_t prefs;
+	size_t bound;
+	size_t n;
+	char *buffer;
+	bool retval;
+
+	if (size == 0) {
+		return true;
+	}
+
+	memset(&prefs, 0, sizeof(prefs));
+	prefs.compressionLevel = level;
+	prefs.frameInfo.contentSize = size;
+
+	bound = LZ4F_compressFrameBound(size, &prefs);
+	/* malloc: buffer is completely overwritten by the compressor */
+	buffer = (char *) malloc(bound);
+	if (buffer == NULL) {
+		MSG_ERROR(MSG_MODULE, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return false;
+	}
+
+	n = LZ4F_compressFrame(buffer, bound, data, size, &prefs);
+	if (LZ4F_isError(n)) {
+		MSG_ERROR(MSG_MODULE, "failed to compress '%s' using lz4: %s", filename, LZ4F_getErrorName(n));
+		free(buffer);
+		return false;
+	}
+
+	retval = append_file(filename, n, buffer);
+	free(buffer);
+
+	return retval;
+}
+#endif
+
+#ifdef HAVE_LIBZSTD
+
+void zstd_writer::conf_init(xmlDoc *doc, xmlNode *node)
+{
+	xmlNode *cur;
+	unsigned int ulevel;
+
+	if (!doc || !node) {
+		return;
+	}
+
+	cur = node->xmlChildrenNode;
+	while (cur != NULL) {
+		if (cur->type != XML_ELEMENT_NODE) {
+			cur = cur->next;
+			continue;
+		}
+		if (!xmlStrcmp(cur->name, (const xmlChar *) "level")) {
+			if (!xml_get_uint(doc, cur, &ulevel) || ulevel < 1 || (int) ulevel > ZSTD_maxCLevel()) {
+				MSG_WARNING(MSG_MODULE, "invalid zstd compression level, using default value");
+				level = 3;
+			} else {
+				level = ulevel;
+			}
+		} else {
+			MSG_ERROR(MSG_MODULE, "invalid zstd option '%s'", cur->name);
+		}
+		cur = cur->next;
+	}
+}
+
+/*
+ * Every call appends one complete zstd frame. Concatenated frames are
+ * decompressed as a single stream by zstd readers.
+ */
+bool zstd_writer::write(const char *filename, size_t size, const void *data)
+{
+	size_t bound;
+	size_t n;
+	char *buffer;
+	bool retval;
+
+	if (size == 0) {
+		return true;
+	}
+
+	bound = ZSTD_compressBound(size);
+	/* malloc: buffer is completely overwritten by the compressor */
+	buffer = (char *) malloc(bound);
+	if (buffer == NULL) {
+		MSG_ERROR(MSG_MODULE, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+		return false;
+	}
+
+	n = ZSTD_compress(buffer, bound, data, size, level);
+	if (ZSTD_isError(n)) {
+		MSG_ERROR(MSG_MODULE, "failed to compress '%s' using zstd: %s", filename, ZSTD_getErrorName(n));
+		free(buffer);
+		return false;
+	}
+
+	retval = append_file(filename, n, buffer);
+	free(buffer);
+
+	return retval;
+}
+#endif
@@ -51,4 +51,26 @@ private:
 };
 #endif
 
+#ifdef HAVE_LIBLZ4
+class lz4_writer : public column_writer {
+public:
+	lz4_writer() : column_writer("lz4"), level(0) {};
+	bool write(const char *filename, size_t size, const void *data);
+	void conf_init(xmlDoc *doc, xmlNode *node);
+private:
+	int level;
+};
+#endif
+
+#ifdef HAVE_LIBZSTD
+class zstd_writer : public column_writer {
+public:
+	zstd_writer() : column_writer("zstd"), level(3) {};
+	bool write(const char *filename, size_t size, const void *data);
+	void conf_init(xmlDoc *doc, xmlNode *node);
+private:
+	int level;
+};
+#endif
+
 #endif
@@ -62,6 +62,8 @@ bool load_config(struct fastbit_plugin_conf *conf, const char *params)
 	
 	conf->flags = 0;
 	conf->global_compress = NULL;
+	conf->compress_threads = 0;
+	conf->pool = NULL;
 
 	/* parse configuration */
 	doc = xmlParseDoc((xmlChar *) params);
@@ -146,6 +148,11 @@ bool load_config(struct fastbit_plugin_conf *conf, const char *params)
 			}
 		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "compress")) {
 			load_column_settings(conf, doc, cur, add_tmpl_compression, add_element_compression);
+		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "compressThreads")) {
+			if (!xml_get_uint(doc, cur, &conf->compress_threads)) {
+				MSG_ERROR(MSG_MODULE, "invalid compressThreads value");
+				conf->compress_threads = 0;
+			}
 		} else if (!xmlStrcmp(cur->name, (const xmlChar *) "compressOptions")) {
 			cur2 = cur->xmlChildrenNode;
 			while (cur2 != NULL) {
@@ -334,6 +341,12 @@ void free_config(struct fastbit_plugin_conf *conf)
 		return;
 	}
 
+	/* stop compression threads before their writers are destroyed */
+	if (conf->pool) {
+		delete conf->pool;
+		conf->pool = NULL;
+	}
+
 	for (writers_it = conf->writers.begin(); writers_it != conf->writers.end(); writers_it++) {
 		if (writers_it->second) {
 			delete writers_it->second;
@@ -16,6 +16,7 @@ extern "C" {
 
 #include "types.h"
 #include "compression.h"
+#include "thread_pool.h"
 
 #define CONF_REORDER            0x01
 #define CONF_OTF_INDEXES        0x02
@@ -46,6 +47,9 @@ struct fastbit_plugin_conf {
 
 	std::map<std::string, column_writer *> writers;
 
+	unsigned int compress_threads; /** number of threads compressing columns in parallel */
+	thread_pool *pool; /** pool of compression threads, NULL for sequential flush */
+
 	type_cache_t type_cache;
 };
 
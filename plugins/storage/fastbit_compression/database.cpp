@@ -198,7 +198,7 @@ void dbslot::write_stats()
 	delete[] filename;
 }
 
-fb_table::fb_table() : dir(NULL), template_id(0), row(0), max_rows(0), columns(NULL), ncolumns(0), nelements(0), elements(NULL)
+fb_table::fb_table() : dir(NULL), pool(NULL), part_loaded(false), part_rows(0), description("Generated by ipfixcol fasbit plugin"), template_id(0), row(0), max_rows(0), columns(NULL), ncolumns(0), nelements(0), elements(NULL)
 {
 }
 
@@ -211,6 +211,7 @@ void fb_table::set_template(const struct ipfix_template *tmpl, struct fastbit_pl
 
 
 	this->template_id = tmpl->template_id;
+	this->pool = conf ? conf->pool : NULL;
 	if (elements) {
 		delete[] elements;
 	}
@@ -295,6 +296,10 @@ void fb_table::set_dir(const char *base_dir)
 	}
 	this->dir = new char[strlen(base_dir) + 1 + 5 + 1];
 	sprintf(this->dir, "%s/%u", base_dir, template_id);
+
+	/* the -part.txt of the new directory has to be read again */
+	part_loaded = false;
+	part_rows = 0;
 }
 
 fb_table::~fb_table()
@@ -430,21 +435,75 @@ void fb_table::store(uint16_t field, const void *data, size_t length)
 
 }
 
-void fb_table::flush()
+/**
+ * @brief Write one column (and its .sp file) to disk. Runs in a thread of
+ * the compression pool.
+ * @param arg Pointer to struct fb_column_job
+ */
+static void write_column(void *arg)
 {
-	char *part_file_path;
-	FILE *part_file;
-	const char *description = "Generated by ipfixcol fasbit plugin";
-	column_writer *writer;
+	struct fb_column_job *job = (struct fb_column_job *) arg;
+	struct fb_column *column = job->column;
 	plain_writer default_writer;
 
+	if (!job->writer->write(job->column_file, column->data.get_size(), column->data.access(0))) {
+		MSG_ERROR(MSG_MODULE, "failed to write column %s in partition %d", column->name, job->template_id);
+	}
+
+	// write .sp file for blob columns
+	if (job->sp_file) {
+		MSG_DEBUG(MSG_MODULE, "wirting .sp file '%s'", job->sp_file);
+		default_writer.write(job->sp_file, column->spfile.get_size(), column->spfile.access(0));
+	}
+}
+
+void fb_table::load_part_file(const char *part_file_path)
+{
+	FILE *part_file;
 	struct fb_table_header header;
 	std::vector<struct fb_column> columns_orig;
 
+	part_loaded = true;
+	part_rows = 0;
+
+	part_file = fopen(part_file_path, "r");
+	if (part_file == NULL) {
+		MSG_DEBUG(MSG_MODULE, "couldn't open file '%s': %s", part_file_path, strerror(errno));
+		return;
+	}
+
+	header.name = NULL;
+	header.description = NULL;
+	header.nrows = 0;
+	header.ncolumns = 0;
+	parse_part_file(part_file, &header, columns_orig);
+	fclose(part_file);
+
+	part_rows = header.nrows;
+	if (header.description) {
+		description = header.description;
+		free(header.description);
+	}
+	if (header.name) {
+		free(header.name);
+	}
+}
+
+void fb_table::flush()
+{
+	char *part_file_path;
+	FILE *part_file;
+	plain_writer default_writer;
+	std::vector<struct fb_column_job> jobs;
+	struct fb_column_job job;
+	struct timespec start, end;
+
 	if (!dir) {
 		return;
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	part_file_path = get_file_path(PART_FILE_NAME);
 
 	MSG_DEBUG(MSG_MODULE, "creating directory '%s'", dir);
@@ -454,21 +513,9 @@ void fb_table::flush()
 		return;
 	}
 
-	/* first read existing part file */
-	part_file = fopen(part_file_path, "r");
-
-	header.name = NULL;
-	header.description = NULL;
-	header.nrows = 0;
-	header.ncolumns = 0;
-	if (part_file) {
-		parse_part_file(part_file, &header, columns_orig);
-		fclose(part_file);
-		if (header.description) {
-			description = header.description;
-		}
-	} else {
-		MSG_DEBUG(MSG_MODULE, "couldn't open file '%s': %s", part_file_path, strerror(errno));
+	/* read existing part file only once per directory */
+	if (!part_loaded) {
+		load_part_file(part_file_path);
 	}
 
 	/* TODO: check if the original rows match the current ones, otherwise delete the old table */
@@ -481,51 +528,59 @@ void fb_table::flush()
 		return;
 	}
 	fprintf(part_file, "# meta data for data partition %u written by ipfixcol fastbit plugin on %s\n\n", template_id, "date");
-	fprintf(part_file, "BEGIN HEADER\nName = %u\nDescription = %s\nNumber_of_rows = %lu\nNumber_of_columns = %lu\nTimestamp = %u\nEND HEADER\n", template_id, description, header.nrows + row, ncolumns, 0);
+	fprintf(part_file, "BEGIN HEADER\nName = %u\nDescription = %s\nNumber_of_rows = %lu\nNumber_of_columns = %lu\nTimestamp = %u\nEND HEADER\n", template_id, description.c_str(), part_rows + row, ncolumns, 0);
 
+	/* columns are independent, compress them in parallel */
+	jobs.reserve(ncolumns);
 	for (size_t i = 0; i < ncolumns; i++) {
 		if (columns[i].type == ibis::UNKNOWN_TYPE) {
 			continue;
 		}
-		char *column_file = this->get_file_path(columns[i].name);
 
-		writer = columns[i].writer;
-		if (writer == NULL) {
-			writer = &default_writer;
-		}
+		job.column = &columns[i];
+		job.writer = columns[i].writer ? columns[i].writer : &default_writer;
+		job.column_file = this->get_file_path(columns[i].name);
+		job.sp_file = (columns[i].type == ibis::BLOB) ? this->get_file_path(columns[i].name, ".sp") : NULL;
+		job.template_id = template_id;
+		jobs.push_back(job);
+	}
 
-		if (!writer->write(column_file, columns[i].data.get_size(), columns[i].data.access(0))) {
-			MSG_ERROR(MSG_MODULE, "failed to write column %s in partition %d", columns[i].name, template_id);
-		}
-		delete[] column_file;
-
-		// write .sp file for blob columns
-		if (columns[i].type == ibis::BLOB) {
-			char *sp_filename = this->get_file_path(columns[i].name, ".sp");
-			MSG_DEBUG(MSG_MODULE, "wirting .sp file '%d'", sp_filename);
-			default_writer.write(sp_filename, columns[i].spfile.get_size(), columns[i].spfile.access(0));
-			delete[] sp_filename;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (pool) {
+			pool->submit(write_column, &jobs[i]);
+		} else {
+			write_column(&jobs[i]);
 		}
+	}
+	if (pool) {
+		pool->wait();
+	}
 
-		fprintf(part_file, "\nBegin Column\nname = %s\ndescription = compression: %s\ndata_type = %s\nEnd Column\n", columns[i].name, writer->name, fastbit_type_str(columns[i].type));
-		
-		
-		columns[i].length_prev += columns[i].data.get_size();
-		columns[i].row = 0;
-		columns[i].data.empty();
-		columns[i].spfile.empty();
+	for (size_t i = 0; i < jobs.size(); i++) {
+		struct fb_column *column = jobs[i].column;
+
+		fprintf(part_file, "\nBegin Column\nname = %s\ndescription = compression: %s\ndata_type = %s\nEnd Column\n", column->name, jobs[i].writer->name, fastbit_type_str(column->type));
+
+		column->length_prev += column->data.get_size();
+		column->row = 0;
+		column->data.empty();
+		column->spfile.empty();
+
+		delete[] jobs[i].column_file;
+		if (jobs[i].sp_file) {
+			delete[] jobs[i].sp_file;
+		}
 	}
 	fclose(part_file);
 	delete[] part_file_path;
 
-	if (header.name) {
-		free(header.name);
-	}
-	if (header.description) {
-		free(header.description);
-	}
-
+	part_rows += row;
 	row = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	MSG_DEBUG(MSG_MODULE, "partition %u flushed in %.3f s (%lu columns, %lu threads)", template_id,
+			(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+			jobs.size(), pool ? pool->size() : 1);
 }
 
 void fb_table::build_indexes()
@@ -50,6 +50,18 @@ struct information_element {
 				    of an array. */
 };
 
+/**
+ * Column write job. One job is created for each column during flush so that
+ * columns can be compressed in parallel.
+ */
+struct fb_column_job {
+	struct fb_column *column; /** Column to be written */
+	column_writer *writer; /** Writer used for the column */
+	char *column_file; /** Path to the column file */
+	char *sp_file; /** Path to the .sp file, NULL if not needed */
+	uint16_t template_id; /** Template (partition) number */
+};
+
 /**
  * Structure that holds the information contained in the header section of the
  * -part.txt file
@@ -154,7 +166,19 @@ private:
 	 */
 	char *get_file_path(const char *name, const char *suffix);
 
+	/**
+	 * @brief Read header of an existing -part.txt file. The file is parsed
+	 * only once for every directory, the row count is tracked in memory
+	 * afterwards.
+	 * @param part_file_path Path to the -part.txt file.
+	 */
+	void load_part_file(const char *part_file_path);
+
 	char *dir;
+	thread_pool *pool; /** Pool of compression threads, may be NULL */
+	bool part_loaded; /** Whether the -part.txt header was already read */
+	uint64_t part_rows; /** Number of rows already written to the directory */
+	std::string description; /** Partition description */
 	uint16_t template_id;
 	uint64_t row;
 	size_t max_rows;
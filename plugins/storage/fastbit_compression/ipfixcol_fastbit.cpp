@@ -424,6 +424,10 @@ int storage_init(char *params, void **config)
 		return 1;
 	}
 
+	if (core->conf.compress_threads > 1) {
+		core->conf.pool = new thread_pool(core->conf.compress_threads);
+	}
+
 	*config = core;
 
 	MSG_DEBUG(MSG_MODULE, "module started");
@@ -0,0 +1,111 @@
+extern "C" {
+#include <ipfixcol/verbose.h>
+}
+
+#include <string.h>
+
+#include "ipfixcol_fastbit.h"
+#include "thread_pool.h"
+
+thread_pool::thread_pool(unsigned int threads) : running(0), done(false)
+{
+	pthread_t thread;
+	int ret;
+
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&job_cond, NULL);
+	pthread_cond_init(&done_cond, NULL);
+
+	for (unsigned int i = 0; i < threads; i++) {
+		ret = pthread_create(&thread, NULL, &thread_pool::worker, this);
+		if (ret != 0) {
+			MSG_ERROR(MSG_MODULE, "failed to create compression thread: %s", strerror(ret));
+			break;
+		}
+		this->threads.push_back(thread);
+	}
+
+	MSG_DEBUG(MSG_MODULE, "started %lu compression threads", this->threads.size());
+}
+
+thread_pool::~thread_pool()
+{
+	pthread_mutex_lock(&mutex);
+	done = true;
+	pthread_cond_broadcast(&job_cond);
+	pthread_mutex_unlock(&mutex);
+
+	for (size_t i = 0; i < threads.size(); i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&done_cond);
+	pthread_cond_destroy(&job_cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+void thread_pool::submit(void (*func)(void *), void *arg)
+{
+	struct job job;
+
+	/* no workers available, do the job in the calling thread */
+	if (threads.empty()) {
+		func(arg);
+		return;
+	}
+
+	job.func = func;
+	job.arg = arg;
+
+	pthread_mutex_lock(&mutex);
+	jobs.push_back(job);
+	pthread_cond_signal(&job_cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void thread_pool::wait()
+{
+	pthread_mutex_lock(&mutex);
+	while (!jobs.empty() || running > 0) {
+		pthread_cond_wait(&done_cond, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+size_t thread_pool::size()
+{
+	return threads.size();
+}
+
+void *thread_pool::worker(void *arg)
+{
+	thread_pool *pool = (thread_pool *) arg;
+	struct job job;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (pool->jobs.empty() && !pool->done) {
+			pthread_cond_wait(&pool->job_cond, &pool->mutex);
+		}
+		if (pool->jobs.empty()) {
+			/* pool is being destroyed and there is nothing left to do */
+			break;
+		}
+
+		job = pool->jobs.front();
+		pool->jobs.pop_front();
+		pool->running++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		job.func(job.arg);
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->running--;
+		if (pool->jobs.empty() && pool->running == 0) {
+			pthread_cond_broadcast(&pool->done_cond);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
@@ -0,0 +1,62 @@
+/** @file
+ */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+extern "C" {
+#include <pthread.h>
+}
+
+#include <deque>
+#include <vector>
+
+/**
+ * @brief Simple pool of worker threads used to compress columns concurrently.
+ *
+ * Jobs are plain function pointers with an argument. The submitting thread
+ * calls wait() to block until all submitted jobs are finished.
+ * A copy of this pool is used by fbitmerge (tools/fbitmerge), keep them in sync.
+ */
+class thread_pool {
+public:
+	/**
+	 * @brief Start @a threads worker threads.
+	 * @param threads Number of worker threads.
+	 */
+	thread_pool(unsigned int threads);
+	~thread_pool();
+
+	/**
+	 * @brief Queue a job for one of the worker threads.
+	 * @param func Function to be called.
+	 * @param arg Argument passed to @a func.
+	 */
+	void submit(void (*func)(void *), void *arg);
+
+	/**
+	 * @brief Block until all submitted jobs are finished.
+	 */
+	void wait();
+
+	/**
+	 * @brief Get number of worker threads.
+	 */
+	size_t size();
+private:
+	struct job {
+		void (*func)(void *);
+		void *arg;
+	};
+
+	static void *worker(void *arg);
+
+	std::vector<pthread_t> threads;
+	std::deque<struct job> jobs;
+	pthread_mutex_t mutex;
+	pthread_cond_t job_cond; /** signalled when a job is queued */
+	pthread_cond_t done_cond; /** signalled when the pool becomes idle */
+	size_t running; /** number of jobs currently being processed */
+	bool done;
+};
+
+#endif
@@ -37,6 +37,10 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "File.h"
 #include <stdexcept>
 #include <string>
@@ -45,28 +49,64 @@
 #include <cstring>
 #include <cerrno>
 #include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 
 #define DEF_WINDOW_SIZE (300)
 #define DEF_WINDOW_ALIGN (true)
+// Size of the output buffer of compressors
+#define COMP_BUFFER_SIZE (128 * 1024)
 
 static const char *msg_module = "json_storage(file)";
 
+/**
+ * \brief Stream compressor
+ */
+struct compressor {
+#ifdef HAVE_LIBZ
+	z_stream gzip;               /**< gzip stream                */
+#endif
+#ifdef HAVE_LIBZSTD
+	ZSTD_CCtx *zstd;             /**< Zstandard context          */
+#endif
+	std::vector<char> out;       /**< Output buffer              */
+};
+
+/**
+ * \brief Get monotonic time in seconds
+ */
+static double time_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 /**
  * \brief Class constructor
  *
- * Parse output configuration and create an output file
+ * Parse output configuration, create an output file and start the writer
  * \param config[in] XML configuration
  */
 File::File(const pugi::xpath_node &config)
 {
 	unsigned int w_size;
 	bool w_align;
+	uint64_t size_limit = 0;
 	std::string path, prefix;
+	enum Compression compression = COMP_NONE;
+	int level = 0;
 
 	// Storage path
 	path = config.node().child_value("path");
@@ -121,17 +161,68 @@ File::File(const pugi::xpath_node &config)
 		} else {
 			w_align = (strcasecmp(tmp.c_str(), "yes") == 0 || tmp == "1");
 		}
+
+		tmp = ie.child_value("sizeLimit");
+		if (!tmp.empty()) {
+			try {
+				size_limit = std::stoull(tmp) * 1024 * 1024;
+			} catch (std::exception &e) {
+				throw std::invalid_argument("Invalid size limit of files.");
+			}
+		}
+	}
+
+	// Compression
+	std::string comp = config.node().child_value("compression");
+	if (comp.empty() || strcasecmp(comp.c_str(), "none") == 0) {
+		compression = COMP_NONE;
+	} else if (strcasecmp(comp.c_str(), "gzip") == 0) {
+#ifdef HAVE_LIBZ
+		compression = COMP_GZIP;
+		level = Z_DEFAULT_COMPRESSION;
+#else
+		throw std::invalid_argument("gzip compression is not supported "
+			"(plugin built without zlib).");
+#endif
+	} else if (strcasecmp(comp.c_str(), "zstd") == 0) {
+#ifdef HAVE_LIBZSTD
+		compression = COMP_ZSTD;
+		level = 3;
+#else
+		throw std::invalid_argument("zstd compression is not supported "
+			"(plugin built without --enable-zstd).");
+#endif
+	} else {
+		throw std::invalid_argument("Unknown compression '" + comp + "'.");
+	}
+
+	std::string tmp = config.node().child_value("compressionLevel");
+	if (!tmp.empty() && compression != COMP_NONE) {
+		try {
+			level = std::stoi(tmp);
+		} catch (std::exception &e) {
+			throw std::invalid_argument("Invalid compression level.");
+		}
 	}
 
-	// Prepare a configuration of the thread for changing time windows
+	// Prepare a configuration of the writer thread
+	_block = NULL;
+	_block_time = 0;
 	_thread = new thread_ctx_t;
-	_thread->new_file = NULL;
-	_thread->new_file_ready = false;
 	_thread->stop = false;
 
 	_thread->storage_path = path;
 	_thread->file_prefix = prefix;
 	_thread->window_size = w_size;
+	_thread->size_limit = size_limit;
+	_thread->file_idx = 0;
+	_thread->compression = compression;
+	_thread->level = level;
+	_thread->file = NULL;
+	memset(&_thread->file_stats, 0, sizeof(_thread->file_stats));
+	memset(&_thread->total_stats, 0, sizeof(_thread->total_stats));
+	queue_init(_thread->filled, _QUEUE_SIZE);
+	queue_init(_thread->empty, _QUEUE_SIZE);
 	time(&_thread->window_time);
 
 	if (w_align) {
@@ -140,132 +231,471 @@ File::File(const pugi::xpath_node &config)
 			_thread->window_size;
 	}
 
-	// Create directory & first file
-	FILE *new_file = file_create(_thread->storage_path, _thread->file_prefix,
-		_thread->window_time);
-	if (!new_file) {
-		delete _thread;
-		throw std::runtime_error("Failed to create a time window file.");
+	_thread->comp = new compressor;
+	_thread->comp->out.resize(COMP_BUFFER_SIZE);
+#ifdef HAVE_LIBZSTD
+	_thread->comp->zstd = NULL;
+	if (compression == COMP_ZSTD) {
+		_thread->comp->zstd = ZSTD_createCCtx();
+		if (!_thread->comp->zstd) {
+			delete _thread->comp;
+			delete _thread;
+			throw std::runtime_error("Failed to create a zstd context.");
+		}
 	}
+#endif
 
-	_file = new_file;
-
-	if (pthread_mutex_init(&_thread->mutex, NULL) != 0) {
-		fclose(_file);
+	// Create directory & first file
+	if (file_open(_thread) != 0) {
+#ifdef HAVE_LIBZSTD
+		ZSTD_freeCCtx(_thread->comp->zstd);
+#endif
+		delete _thread->comp;
 		delete _thread;
-		throw std::runtime_error("Mutex initialization failed");
+		throw std::runtime_error("Failed to create a time window file.");
 	}
 
-	if (pthread_create(&_thread->thread, NULL, &File::thread_window,
+	if (pthread_create(&_thread->thread, NULL, &File::thread_writer,
 			_thread) != 0) {
-		fclose(_file);
-		pthread_mutex_destroy(&_thread->mutex);
+		file_close(_thread);
+#ifdef HAVE_LIBZSTD
+		ZSTD_freeCCtx(_thread->comp->zstd);
+#endif
+		delete _thread->comp;
 		delete _thread;
-		throw std::runtime_error("Failed to start a thread for changing time "
-			"windows.");
+		throw std::runtime_error("Failed to start a thread for writing "
+			"files.");
 	}
 }
 
 /**
  * \brief Class destructor
  *
- * Close all opened files
+ * Pass remaining records to the writer, wait for it and close all files
  */
 File::~File()
 {
-	if (_file) {
-		fclose(_file);
+	if (!_thread) {
+		return;
+	}
+
+	if (_block && _block->used > 0) {
+		block_push();
+	}
+
+	_thread->stop = true;
+	pthread_join(_thread->thread, NULL);
+
+	const stats_t &stats = _thread->total_stats;
+	MSG_INFO(msg_module, "Written %" PRIu64 " records, %" PRIu64 " bytes "
+		"(%" PRIu64 " bytes stored, %.1f MB/s).", stats.records, stats.bytes_in,
+		stats.bytes_out, (stats.time > 0) ? stats.bytes_in / stats.time / 1e6 : 0.0);
+
+	// Free blocks
+	block_t *block;
+	while ((block = queue_pop(_thread->empty)) != NULL) {
+		free(block->data);
+		delete block;
+	}
+
+	if (_block) {
+		free(_block->data);
+		delete _block;
+	}
+
+#ifdef HAVE_LIBZSTD
+	ZSTD_freeCCtx(_thread->comp->zstd);
+#endif
+	delete _thread->comp;
+	delete _thread;
+}
+
+/**
+ * \brief Prepare a queue
+ * \param[out] queue Queue
+ * \param[in] size Maximal number of blocks in the queue
+ */
+void File::queue_init(queue_t &queue, size_t size)
+{
+	queue.items.resize(size);
+	queue.head = 0;
+	queue.tail = 0;
+}
+
+/**
+ * \brief Insert a block into a queue (only one producer)
+ * \return False if the queue is full
+ */
+bool File::queue_push(queue_t &queue, block_t *block)
+{
+	size_t head = queue.head.load(std::memory_order_relaxed);
+	if (head - queue.tail.load(std::memory_order_acquire) == queue.items.size()) {
+		return false;
+	}
+
+	queue.items[head % queue.items.size()] = block;
+	queue.head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+/**
+ * \brief Remove a block from a queue (only one consumer)
+ * \return The block or NULL if the queue is empty
+ */
+File::block_t *File::queue_pop(queue_t &queue)
+{
+	size_t tail = queue.tail.load(std::memory_order_relaxed);
+	if (tail == queue.head.load(std::memory_order_acquire)) {
+		return NULL;
+	}
+
+	block_t *block = queue.items[tail % queue.items.size()];
+	queue.tail.store(tail + 1, std::memory_order_release);
+	return block;
+}
+
+/**
+ * \brief Pass the current block to the writer
+ *
+ * Waits when the writer is not able to keep up (e.g. slow disk).
+ */
+void File::block_push()
+{
+	while (!queue_push(_thread->filled, _block)) {
+		struct timespec tim;
+		tim.tv_sec = 0;
+		tim.tv_nsec = 1000000L; // 1 ms
+		nanosleep(&tim, NULL);
 	}
 
-	if (_thread) {
-		_thread->stop = true;
-		pthread_join(_thread->thread, NULL);
-		pthread_mutex_destroy(&_thread->mutex);
+	_block = NULL;
+}
+
+/**
+ * \brief Get an empty block (reused if possible)
+ * \param[in] size Minimal size of the block
+ * \return The block or NULL (memory allocation error)
+ */
+File::block_t *File::block_get(size_t size)
+{
+	block_t *block = queue_pop(_thread->empty);
+	if (!block) {
+		block = new block_t;
+		block->data = NULL;
+		block->size = 0;
+	}
 
-		if (_thread->new_file) {
-			fclose(_thread->new_file);
+	block->used = 0;
+	block->records = 0;
+
+	size = std::max(size, _BLOCK_SIZE);
+	if (block->size < size) {
+		char *data = (char *) realloc(block->data, size);
+		if (!data) {
+			MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)",
+				__FILE__, __LINE__);
+			free(block->data);
+			delete block;
+			return NULL;
 		}
 
-		delete _thread;
+		block->data = data;
+		block->size = size;
 	}
+
+	return block;
 }
 
 /**
- * \brief Thread function for changing time windows
- * \param[in,out] context Thread configuration
+ * \brief Open a file for the current time window and prepare the compressor
+ * \param[in,out] ctx Writer
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int File::file_open(thread_ctx_t *ctx)
+{
+	std::string suffix;
+	if (ctx->file_idx > 0) {
+		suffix = "." + std::to_string(ctx->file_idx);
+	}
+
+	switch (ctx->compression) {
+	case COMP_GZIP: suffix += ".gz";  break;
+	case COMP_ZSTD: suffix += ".zst"; break;
+	default: break;
+	}
+
+	ctx->file = file_create(ctx->storage_path, ctx->file_prefix,
+		ctx->window_time, suffix, &ctx->file_name);
+	if (!ctx->file) {
+		return 1;
+	}
+
+	memset(&ctx->file_stats, 0, sizeof(ctx->file_stats));
+
+	int ret = 0;
+	switch (ctx->compression) {
+#ifdef HAVE_LIBZ
+	case COMP_GZIP:
+		memset(&ctx->comp->gzip, 0, sizeof(ctx->comp->gzip));
+		// Window bits + 16 = gzip header
+		ret = deflateInit2(&ctx->comp->gzip, ctx->level, Z_DEFLATED, 15 + 16,
+			8, Z_DEFAULT_STRATEGY);
+		ret = (ret == Z_OK) ? 0 : 1;
+		break;
+#endif
+#ifdef HAVE_LIBZSTD
+	case COMP_ZSTD:
+		ZSTD_CCtx_reset(ctx->comp->zstd, ZSTD_reset_session_only);
+		ret = ZSTD_isError(ZSTD_CCtx_setParameter(ctx->comp->zstd,
+			ZSTD_c_compressionLevel, ctx->level)) ? 1 : 0;
+		break;
+#endif
+	default:
+		break;
+	}
+
+	if (ret != 0) {
+		MSG_ERROR(msg_module, "Failed to initialize compression of '%s'.",
+			ctx->file_name.c_str());
+		fclose(ctx->file);
+		ctx->file = NULL;
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Write (and compress) data to the current file
+ * \param[in,out] ctx Writer
+ * \param[in] data Data (NULL to finish the compressed stream)
+ * \param[in] len Length of the data
+ * \return On success returns 0. Otherwise returns non-zero value.
+ */
+int File::file_write(thread_ctx_t *ctx, const char *data, size_t len)
+{
+	size_t written = 0;
+
+	switch (ctx->compression) {
+	case COMP_NONE:
+		if (data && fwrite(data, len, 1, ctx->file) != 1) {
+			return 1;
+		}
+		written = data ? len : 0;
+		break;
+#ifdef HAVE_LIBZ
+	case COMP_GZIP: {
+		struct compressor *comp = ctx->comp;
+		z_stream *zs = &comp->gzip;
+		size_t out_size = comp->out.size();
+		int flush = data ? Z_NO_FLUSH : Z_FINISH;
+		int ret;
+
+		zs->next_in = (Bytef *) data;
+		zs->avail_in = data ? len : 0;
+		do {
+			zs->next_out = (Bytef *) comp->out.data();
+			zs->avail_out = out_size;
+			ret = deflate(zs, flush);
+			if (ret == Z_STREAM_ERROR) {
+				return 1;
+			}
+
+			size_t have = out_size - zs->avail_out;
+			if (have > 0 && fwrite(comp->out.data(), have, 1, ctx->file) != 1) {
+				return 1;
+			}
+			written += have;
+		} while (zs->avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+		break;
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	case COMP_ZSTD: {
+		struct compressor *comp = ctx->comp;
+		ZSTD_inBuffer in = {data, data ? len : 0, 0};
+		ZSTD_EndDirective mode = data ? ZSTD_e_continue : ZSTD_e_end;
+		size_t out_size = comp->out.size();
+		size_t remaining;
+
+		do {
+			ZSTD_outBuffer out = {comp->out.data(), out_size, 0};
+			remaining = ZSTD_compressStream2(comp->zstd, &out, &in, mode);
+			if (ZSTD_isError(remaining)) {
+				return 1;
+			}
+
+			if (out.pos > 0 && fwrite(comp->out.data(), out.pos, 1, ctx->file) != 1) {
+				return 1;
+			}
+			written += out.pos;
+		} while (data ? (in.pos < in.size) : (remaining != 0));
+		break;
+	}
+#endif
+	default:
+		break;
+	}
+
+	ctx->file_stats.bytes_out += written;
+	return 0;
+}
+
+/**
+ * \brief Finish and close the current file
+ * \param[in,out] ctx Writer
+ */
+void File::file_close(thread_ctx_t *ctx)
+{
+	if (!ctx->file) {
+		return;
+	}
+
+	double start = time_now();
+	if (file_write(ctx, NULL, 0) != 0) {
+		MSG_ERROR(msg_module, "Failed to finish the file '%s'.",
+			ctx->file_name.c_str());
+	}
+
+#ifdef HAVE_LIBZ
+	if (ctx->compression == COMP_GZIP) {
+		deflateEnd(&ctx->comp->gzip);
+	}
+#endif
+
+	fclose(ctx->file);
+	ctx->file = NULL;
+
+	stats_t &stats = ctx->file_stats;
+	stats.time += time_now() - start;
+	MSG_INFO(msg_module, "File '%s' closed: %" PRIu64 " records, %" PRIu64
+		" bytes stored as %" PRIu64 " bytes (ratio %.2f), %.1f MB/s.",
+		ctx->file_name.c_str(), stats.records, stats.bytes_in, stats.bytes_out,
+		(stats.bytes_out > 0) ? (double) stats.bytes_in / stats.bytes_out : 0.0,
+		(stats.time > 0) ? stats.bytes_in / stats.time / 1e6 : 0.0);
+
+	ctx->total_stats.records += stats.records;
+	ctx->total_stats.bytes_in += stats.bytes_in;
+	ctx->total_stats.bytes_out += stats.bytes_out;
+	ctx->total_stats.time += stats.time;
+}
+
+/**
+ * \brief Writer's thread function
+ *
+ * Writes blocks of records and changes files when a time window ends or when
+ * the size limit of a file is reached.
+ * \param[in,out] context Writer configuration
  * \return Nothing
  */
-void *File::thread_window(void *context)
+void *File::thread_writer(void *context)
 {
 	thread_ctx_t *ctx = (thread_ctx_t *) context;
 	MSG_DEBUG(msg_module, "Thread started...");
 
-	while(!ctx->stop) {
-		// Sleep
-		struct timespec tim;
-		tim.tv_sec = 0;
-		tim.tv_nsec = 100000000L; // 0.1 sec
-		nanosleep(&tim, NULL);
+	while (1) {
+		// Must be checked before the queue (all blocks are pushed before)
+		bool stop = ctx->stop.load(std::memory_order_acquire);
+		block_t *block = queue_pop(ctx->filled);
 
 		// Get current time
 		time_t now;
 		time(&now);
 
-		if (difftime(now, ctx->window_time) <= ctx->window_size) {
-			continue;
+		if (difftime(now, ctx->window_time) > ctx->window_size) {
+			// New time window
+			file_close(ctx);
+			while (difftime(now, ctx->window_time) > ctx->window_size) {
+				ctx->window_time += ctx->window_size;
+			}
+
+			ctx->file_idx = 0;
+			if (file_open(ctx) != 0) {
+				MSG_ERROR(msg_module, "Failed to create a time window file.");
+			}
 		}
 
-		// New time window
-		pthread_mutex_lock(&ctx->mutex);
-		if (ctx->new_file) {
-			fclose(ctx->new_file);
-			ctx->new_file = NULL;
+		if (!block) {
+			if (stop) {
+				break;
+			}
+
+			// Sleep
+			struct timespec tim;
+			tim.tv_sec = 0;
+			tim.tv_nsec = 10000000L; // 0.01 sec
+			nanosleep(&tim, NULL);
+			continue;
 		}
 
-		ctx->window_time += ctx->window_size;
-		FILE *file = file_create(ctx->storage_path, ctx->file_prefix,
-			ctx->window_time);
-		if (!file) {
-			MSG_ERROR(msg_module, "Failed to create a time window file.");
+		if (ctx->file) {
+			// Store the records
+			double start = time_now();
+			if (file_write(ctx, block->data, block->used) != 0) {
+				MSG_ERROR(msg_module, "Failed to write to the file '%s' (%s).",
+					ctx->file_name.c_str(), strerror(errno));
+			}
+
+			ctx->file_stats.time += time_now() - start;
+			ctx->file_stats.records += block->records;
+			ctx->file_stats.bytes_in += block->used;
+
+			if (ctx->size_limit > 0 && ctx->file_stats.bytes_out >= ctx->size_limit) {
+				// Size limit reached, continue with the next file of the window
+				file_close(ctx);
+				ctx->file_idx++;
+				if (file_open(ctx) != 0) {
+					MSG_ERROR(msg_module, "Failed to create a file.");
+				}
+			}
 		}
 
-		// Null pointer is also valid...
-		ctx->new_file = file;
-		ctx->new_file_ready = true;
-		pthread_mutex_unlock(&ctx->mutex);
+		// Return the block for reuse
+		if (!queue_push(ctx->empty, block)) {
+			free(block->data);
+			delete block;
+		}
 	}
 
+	file_close(ctx);
 	MSG_DEBUG(msg_module, "Thread terminated.");
 	return NULL;
 }
 
 /**
  * \brief Store a record to a file
+ *
+ * The record is only copied to a block for the writer thread.
  * \param[in] record JSON record
  */
 void File::ProcessDataRecord(const std::string &record)
 {
-	// Should we change a time window
-	if (_thread->new_file_ready) {
-		// Close old time window
-		if (_file) {
-			fclose(_file);
-		}
-
-		// Get new time window
-		pthread_mutex_lock(&_thread->mutex);
-		_file = _thread->new_file;
-		_thread->new_file = NULL;
-		_thread->new_file_ready = false;
-		pthread_mutex_unlock(&_thread->mutex);
+	if (_block && _block->size - _block->used < record.size()) {
+		// The block is full
+		block_push();
 	}
 
-	if (!_file) {
-		return;
+	if (!_block) {
+		_block = block_get(record.size());
+		if (!_block) {
+			return;
+		}
+		time(&_block_time);
 	}
 
-	// Store the record
-	fwrite(record.c_str(), record.size(), 1, _file);
+	memcpy(_block->data + _block->used, record.c_str(), record.size());
+	_block->used += record.size();
+	_block->records++;
+}
+
+/**
+ * \brief Pass records to the writer when they wait in the block for too long
+ */
+void File::Flush()
+{
+	if (_block && _block->used > 0 && time(NULL) != _block_time) {
+		block_push();
+	}
 }
 
 /**
@@ -373,11 +803,15 @@ int File::dir_create(const std::string &path)
  * \brief Create a file for a time window
  *
  * Check/create a directory hierarchy and create a new file for time window.
+ * \param[in] tmplt Template of the directory path
+ * \param[in] prefix File prefix
  * \param[in] tm Time window
+ * \param[in] suffix File suffix (e.g. an extension)
+ * \param[out] name Name of the file (can be NULL)
  * \return On success returns pointer to the file, Otherwise returns NULL.
  */
 FILE *File::file_create(const std::string &tmplt, const std::string &prefix,
-	const time_t &tm)
+	const time_t &tm, const std::string &suffix, std::string *name)
 {
 	char file_fmt[20];
 
@@ -404,7 +838,7 @@ FILE *File::file_create(const std::string &tmplt, const std::string &prefix,
 		return NULL;
 	}
 
-	std::string file_name = directory + prefix + file_fmt;
+	std::string file_name = directory + prefix + file_fmt + suffix;
 	FILE *file = fopen(file_name.c_str(), "w");
 	if (!file) {
 		// Failed to create a flow file
@@ -413,5 +847,9 @@ FILE *File::file_create(const std::string &tmplt, const std::string &prefix,
 		return NULL;
 	}
 
+	if (name) {
+		*name = file_name;
+	}
+
 	return file;
 }
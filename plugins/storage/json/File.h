@@ -43,13 +43,23 @@
 #include "json.h"
 
 #include <string>
+#include <vector>
+#include <atomic>
 #include <ctime>
 #include <cstdio>
+#include <stdint.h>
 
 #include <pthread.h>
 
+/** Internal state of a stream compressor (defined in File.cpp) */
+struct compressor;
+
 /**
  * \brief The class for file output interface
+ *
+ * The storage thread only copies records into blocks that are passed through
+ * a lock-free queue to a writer thread. The writer thread (optionally)
+ * compresses the blocks, writes them to files and rotates the files.
  */
 class File : public Output {
 public:
@@ -59,6 +69,8 @@ public:
 
 	// Store a record to the file
 	void ProcessDataRecord(const std::string &record);
+	// Pass records to the writer thread (if they wait for too long)
+	void Flush();
 
 	// Get a directory path for a time window
 	static int dir_name(const time_t &tm, const std::string &tmplt,
@@ -67,34 +79,95 @@ public:
 	static int dir_create(const std::string &path);
 	// Create a file for a time window
 	static FILE *file_create(const std::string &tmplt, const std::string &prefix,
-				const time_t &tm);
+				const time_t &tm, const std::string &suffix = "",
+				std::string *name = NULL);
 private:
 	/** Minimal window size */
 	const unsigned int _WINDOW_MIN_SIZE = 60; // seconds
+	/** Size of a block of records */
+	const size_t _BLOCK_SIZE = 256 * 1024; // bytes
+	/** Maximal number of blocks waiting for the writer */
+	const size_t _QUEUE_SIZE = 64;
+
+	/** Compression of output files */
+	enum Compression {
+		COMP_NONE,                   /**< Plain text                 */
+		COMP_GZIP,                   /**< gzip (zlib)                */
+		COMP_ZSTD                    /**< Zstandard                  */
+	};
+
+	/** Block of records */
+	typedef struct block_s {
+		char *data;                  /**< Records                    */
+		size_t size;                 /**< Size of the block          */
+		size_t used;                 /**< Used part of the block     */
+		uint64_t records;            /**< Number of records          */
+	} block_t;
+
+	/** Single-producer single-consumer queue of blocks */
+	typedef struct queue_s {
+		std::vector<block_t *> items;   /**< Ring of blocks          */
+		std::atomic<size_t> head;       /**< Next slot to write      */
+		std::atomic<size_t> tail;       /**< Next slot to read       */
+	} queue_t;
+
+	/** Statistics of written data */
+	typedef struct stats_s {
+		uint64_t records;            /**< Records                    */
+		uint64_t bytes_in;           /**< Bytes before compression   */
+		uint64_t bytes_out;          /**< Bytes after compression    */
+		double time;                 /**< Time spent writing (sec.)  */
+	} stats_t;
 
-	/** Configuration of a thread */
+	/** Configuration of the writer thread */
 	typedef struct thread_ctx_s {
 		pthread_t thread;            /**< Thread                     */
-		pthread_mutex_t mutex;       /**< Data mutex                 */
-		bool stop;                   /**< Stop flag for temination   */
+		std::atomic<bool> stop;      /**< Stop flag for temination   */
 
 		unsigned int window_size;    /**< Size of a time window      */
 		time_t window_time;          /**< Current time window        */
 		std::string storage_path;    /**< Storage path (template)    */
 		std::string file_prefix;     /**< File prefix                */
+		uint64_t size_limit;         /**< Max. size of a file (0=off)*/
+		unsigned int file_idx;       /**< Index of a file in window  */
 
-		FILE *new_file;              /**< New file                   */
-		bool new_file_ready;         /**< New file flag              */
+		enum Compression compression;/**< Compression of files       */
+		int level;                   /**< Compression level          */
+		struct compressor *comp;     /**< Compressor                 */
+		FILE *file;                  /**< Current file               */
+		std::string file_name;       /**< Name of the current file   */
+
+		queue_t filled;              /**< Blocks for the writer      */
+		queue_t empty;               /**< Blocks for reuse           */
+
+		stats_t file_stats;          /**< Stats of the current file  */
+		stats_t total_stats;         /**< Stats of all files         */
 	} thread_ctx_t;
 
-	/** File descritor */
-	FILE *_file;
-	/** Thread for changing time windows */
+	/** Block that is being filled */
+	block_t *_block;
+	/** Time of the first record in the block */
+	time_t _block_time;
+	/** Writer thread */
 	thread_ctx_t *_thread;
 
-	// Window changer
-	static void *thread_window(void *context);
+	// Pass the current block to the writer
+	void block_push();
+	// Get an empty block for at least size bytes
+	block_t *block_get(size_t size);
+
+	// Queue operations
+	static void queue_init(queue_t &queue, size_t size);
+	static bool queue_push(queue_t &queue, block_t *block);
+	static block_t *queue_pop(queue_t &queue);
+
+	// Writer's file operations
+	static int file_open(thread_ctx_t *ctx);
+	static int file_write(thread_ctx_t *ctx, const char *data, size_t len);
+	static void file_close(thread_ctx_t *ctx);
+
+	// Writer
+	static void *thread_writer(void *context);
 };
 
 #endif // FILE_H
-
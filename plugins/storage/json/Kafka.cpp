@@ -1,18 +1,95 @@
 #include "Kafka.h"
 
+extern "C" {
+#include <ipfixcol.h>
+}
+
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
-#include <sys/time.h>
-#include <unistd.h>
+#include <algorithm>
+#include <strings.h>
 
 static const char *msg_module = "json kafka";
 
-static void msg_delivered (rd_kafka_t *rk, void *payload, size_t len, 
-        rd_kafka_resp_err_t err, void *opaque, void *msg_opaque)
+/** Maximal length of a flow key (2x IPv6 address + 2x port + protocol) */
+#define FLOW_KEY_MAX_LEN (2 * 16 + 2 * 2 + 1)
+
+/**
+ * \brief Convert a string to a positive number
+ * \param[in] str  String
+ * \param[in] name Name of the configuration option (for error messages)
+ * \return Converted value
+ */
+static unsigned long parse_number(const std::string &str, const char *name)
+{
+    size_t pos = 0;
+    unsigned long value = 0;
+
+    try {
+        value = std::stoul(str, &pos);
+    } catch (std::exception &) {
+        pos = 0;
+    }
+
+    if (pos == 0 || pos != str.length()) {
+        throw std::invalid_argument(std::string("Invalid value of '") + name
+            + "': '" + str + "'");
+    }
+
+    return value;
+}
+
+/**
+ * \brief Calculate a hash value of a flow key (FNV-1a with a final mix)
+ */
+static uint32_t hash_key(const uint8_t *data, size_t len)
 {
-    if (err) {
-        MSG_ERROR(msg_module, "Message delivery failed: %s",
-            rd_kafka_err2str(err));
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 16777619U;
     }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * \brief Get a field of a data record (only with a length up to \p max_len)
+ */
+static uint8_t *get_field(const struct metadata *mdata, uint16_t id,
+    int max_len, int *len)
+{
+    uint8_t *field = data_record_get_field(
+        static_cast<uint8_t *>(mdata->record.record),
+        mdata->record.templ, 0, id, len);
+    if (!field || *len > max_len) {
+        *len = 0;
+        return NULL;
+    }
+
+    return field;
+}
+
+void Kafka::msg_delivered(rd_kafka_t *rk, const rd_kafka_message_t *msg,
+    void *opaque)
+{
+    (void) rk;
+    Kafka *kafka = static_cast<Kafka *>(opaque);
+
+    if (msg->err) {
+        kafka->_stats.failed++;
+    } else {
+        kafka->_stats.delivered++;
+    }
+
+    kafka->chunk_release(static_cast<Chunk *>(msg->_private));
 }
 
 Kafka::Kafka(const pugi::xpath_node &config)
@@ -23,15 +100,36 @@ Kafka::Kafka(const pugi::xpath_node &config)
     std::string ip    = config.node().child_value("ip");
     std::string port  = config.node().child_value("port");
     std::string partitions_str = config.node().child_value("partitions");
+    std::string key   = config.node().child_value("partitionKey");
+    std::string batch = config.node().child_value("batchSize");
+    std::string buffer = config.node().child_value("bufferSize");
+    std::string stats = config.node().child_value("statsInterval");
     _topic = config.node().child_value("topic");
 
+    /* Additional librdkafka properties (e.g. "test.mock.num.brokers") */
+    std::vector<std::pair<std::string, std::string> > properties;
+    bool brokers_set = false;
+    for (pugi::xml_node prop: config.node().children("property")) {
+        std::string name = prop.child_value("name");
+        if (name.empty()) {
+            throw std::invalid_argument("Name of a property not set");
+        }
+
+        if (name == "bootstrap.servers" || name == "metadata.broker.list"
+                || name == "test.mock.num.brokers") {
+            brokers_set = true;
+        }
+
+        properties.push_back(std::make_pair(name, prop.child_value("value")));
+    }
+
     /* Check IP address */
-    if (ip.empty()) {
+    if (ip.empty() && !brokers_set) {
         throw std::invalid_argument("IP address not set");
     }
 
     /* Check port number */
-    if (port.empty()) {
+    if (port.empty() && !brokers_set) {
         throw std::invalid_argument("Port number not set");
     }
 
@@ -44,24 +142,73 @@ Kafka::Kafka(const pugi::xpath_node &config)
     if (partitions_str.empty()) {
         throw std::invalid_argument("Number of partitions not set");
     } else {
-        _partitions = atoi(partitions_str.c_str()); // TODO fixme
+        _partitions = parse_number(partitions_str, "partitions");
+        if (_partitions <= 0) {
+            throw std::invalid_argument("Number of partitions must be positive");
+        }
+    }
+
+    /* Partitioning */
+    if (key.empty() || strcasecmp(key.c_str(), "roundrobin") == 0) {
+        _key = KEY_ROUND_ROBIN;
+    } else if (strcasecmp(key.c_str(), "srcIP") == 0) {
+        _key = KEY_SRC_IP;
+    } else if (strcasecmp(key.c_str(), "dstIP") == 0) {
+        _key = KEY_DST_IP;
+    } else if (strcasecmp(key.c_str(), "hosts") == 0) {
+        _key = KEY_HOSTS;
+    } else if (strcasecmp(key.c_str(), "flow") == 0) {
+        _key = KEY_FLOW;
+    } else {
+        throw std::invalid_argument("Unknown partition key '" + key + "'");
+    }
+
+    if (!batch.empty()) {
+        _batch_size = parse_number(batch, "batchSize");
+        if (_batch_size == 0) {
+            throw std::invalid_argument("Batch size must be positive");
+        }
+    }
+
+    if (!buffer.empty()) {
+        _chunk_size = parse_number(buffer, "bufferSize");
+        if (_chunk_size < 4096) {
+            throw std::invalid_argument("Buffer size must be at least 4096 "
+                "bytes");
+        }
+    }
+
+    if (!stats.empty()) {
+        _stats_interval = parse_number(stats, "statsInterval");
     }
 
     // create kafka configuration
     conf = rd_kafka_conf_new();
+    for (auto &prop: properties) {
+        if (rd_kafka_conf_set(conf, prop.first.c_str(), prop.second.c_str(),
+                errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+            rd_kafka_conf_destroy(conf);
+            throw std::invalid_argument("Invalid property '" + prop.first
+                + "': " + errstr);
+        }
+    }
 
-    // set delivery callback
-    rd_kafka_conf_set_dr_cb(conf, msg_delivered);
+    // set delivery callback (returns buffers to the pool)
+    rd_kafka_conf_set_dr_msg_cb(conf, msg_delivered);
+    rd_kafka_conf_set_opaque(conf, this);
 
     // create new producer
     _rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
     if (!_rk) {
+        rd_kafka_conf_destroy(conf);
         throw std::runtime_error(
             std::string("Failed to create new producer: ") + errstr);
     }
 
     // set brokers
-    if (rd_kafka_brokers_add(_rk, (ip + ":" + port).c_str()) == 0) {
+    if (!ip.empty() && !port.empty()
+            && rd_kafka_brokers_add(_rk, (ip + ":" + port).c_str()) == 0) {
+        rd_kafka_destroy(_rk);
         throw std::runtime_error("No valid brokers specified");
     }
 
@@ -69,60 +216,325 @@ Kafka::Kafka(const pugi::xpath_node &config)
     _rkt = rd_kafka_topic_new(_rk, _topic.c_str(), NULL);
     if (!_rkt) {
         rd_kafka_destroy(_rk);
-        throw std::runtime_error(std::string("Failed to create topic: ") 
-            + rd_kafka_err2str(rd_kafka_errno2err(errno)));
+        throw std::runtime_error(std::string("Failed to create topic: ")
+            + rd_kafka_err2str(rd_kafka_last_error()));
+    }
+
+    _batches.resize(_partitions);
+    for (auto &batch: _batches) {
+        batch.reserve(_batch_size);
     }
 
+    _stats_time = time(NULL);
 }
 
 Kafka::~Kafka()
 {
+    Flush();
+
     MSG_INFO(msg_module, "Waiting for Kafka output to finish sending");
     while (rd_kafka_outq_len(_rk) > 0) {
         rd_kafka_poll(_rk, 100);
     }
 
+    report_stats(true);
+
     // destroy topic
     rd_kafka_topic_destroy(_rkt);
     // destroy the producer
     rd_kafka_destroy(_rk);
 
+    for (Chunk *chunk: _chunks) {
+        free(chunk->data);
+        delete chunk;
+    }
+
     MSG_INFO(msg_module, "Kafka plugin finished");
 }
 
-void Kafka::ProcessDataRecord(const std::string &record)
+/**
+ * \brief Get a buffer with at least \p size free bytes
+ *
+ * A full buffer is sealed and returned to the pool as soon as all its records
+ * are processed by librdkafka.
+ */
+Kafka::Chunk *Kafka::chunk_get(size_t size)
+{
+    if (_chunk && _chunk->size - _chunk->used >= size) {
+        return _chunk;
+    }
+
+    if (_chunk) {
+        // Seal the current buffer
+        Chunk *old = _chunk;
+        _chunk = NULL;
+        if (old->refs == 0) {
+            chunk_recycle(old);
+        }
+    }
+
+    if (size <= _chunk_size && !_pool.empty()) {
+        _chunk = _pool.back();
+        _pool.pop_back();
+        return _chunk;
+    }
+
+    // Allocate a new buffer (larger one for extra long records)
+    Chunk *chunk = new Chunk;
+    chunk->size = std::max(size, _chunk_size);
+    chunk->used = 0;
+    chunk->refs = 0;
+    chunk->data = static_cast<char *>(malloc(chunk->size));
+    if (!chunk->data) {
+        MSG_ERROR(msg_module, "Memory allocation failed (%s:%d)", __FILE__,
+            __LINE__);
+        delete chunk;
+        return NULL;
+    }
+
+    _chunks.push_back(chunk);
+    _chunk = chunk;
+    return _chunk;
+}
+
+/**
+ * \brief Release one record of a buffer
+ */
+void Kafka::chunk_release(Chunk *chunk)
+{
+    if (--chunk->refs > 0) {
+        return;
+    }
+
+    if (chunk == _chunk) {
+        // The buffer is still being filled, just start from the beginning
+        chunk->used = 0;
+        return;
+    }
+
+    chunk_recycle(chunk);
+}
+
+/**
+ * \brief Return an unused sealed buffer to the pool
+ */
+void Kafka::chunk_recycle(Chunk *chunk)
 {
-    while (rd_kafka_produce(_rkt, _current_partition++ % _partitions,
-        RD_KAFKA_MSG_F_COPY, (void *) record.c_str(), record.length(),
-        NULL, 0, NULL) != 0) {
-
-        switch (errno) {
-        case ENOBUFS:
-            MSG_WARNING(msg_module, "maximum number of outstanding messages"
-                " (%u) has been reached: 'queue.buffering.max.messages'",
-                rd_kafka_outq_len(_rk));
-
-            // wait a while for the queue to be processed
-            usleep(200000);
-            rd_kafka_poll(_rk, 0);
-            break;
-        case EMSGSIZE:
-            MSG_ERROR(msg_module, "Message is larged than configured max size:"
-                " 'messages.max.bytes'");
-            return;
-        case ESRCH: 
-            throw std::runtime_error("Requested 'partition' is unknown in the "
-                "Kafka cluster.");
-            break;
-        case ENOENT:
-            throw std::runtime_error("Topic is unknown in the Kafka cluster.");
-            break;
-        default:
-            MSG_ERROR(msg_module, "Unknown error while producing a message to "
-                "Kafka");
-            break;
+    if (chunk->size != _chunk_size) {
+        // Extra long buffers are not pooled
+        _chunks.erase(std::find(_chunks.begin(), _chunks.end(), chunk));
+        free(chunk->data);
+        delete chunk;
+        return;
+    }
+
+    chunk->used = 0;
+    _pool.push_back(chunk);
+}
+
+/**
+ * \brief Select a partition of a record
+ *
+ * Keys "hosts" and "flow" are the same for both directions of a conversation,
+ * because endpoints are always hashed in the same order.
+ */
+int Kafka::select_partition(const struct metadata *mdata)
+{
+    if (_key == KEY_ROUND_ROBIN || !mdata || !mdata->record.templ) {
+        _current_partition = (_current_partition + 1) % _partitions;
+        return _current_partition;
+    }
+
+    uint8_t key[FLOW_KEY_MAX_LEN];
+    size_t key_len = 0;
+    int src_len, dst_len, len;
+
+    // sourceIPv4Address/sourceIPv6Address, destinationIPv4/IPv6Address
+    uint8_t *src = get_field(mdata, 8, 16, &src_len);
+    if (!src) {
+        src = get_field(mdata, 27, 16, &src_len);
+    }
+    uint8_t *dst = get_field(mdata, 12, 16, &dst_len);
+    if (!dst) {
+        dst = get_field(mdata, 28, 16, &dst_len);
+    }
+
+    // sourceTransportPort, destinationTransportPort, protocolIdentifier
+    uint8_t *src_port = NULL, *dst_port = NULL, *proto = NULL;
+    if (_key == KEY_FLOW) {
+        src_port = get_field(mdata, 7, 2, &len);
+        dst_port = get_field(mdata, 11, 2, &len);
+        proto = get_field(mdata, 4, 1, &len);
+    }
+
+    if (_key == KEY_DST_IP) {
+        src = dst;
+        src_len = dst_len;
+    }
+
+    if (_key == KEY_HOSTS || _key == KEY_FLOW) {
+        // Order endpoints
+        int cmp = src_len - dst_len;
+        if (cmp == 0 && src_len > 0) {
+            cmp = memcmp(src, dst, src_len);
+        }
+        if (cmp == 0 && src_port && dst_port) {
+            cmp = memcmp(src_port, dst_port, 2);
         }
+        if (cmp > 0) {
+            std::swap(src, dst);
+            std::swap(src_len, dst_len);
+            std::swap(src_port, dst_port);
+        }
+    }
+
+    if (src) {
+        memcpy(key + key_len, src, src_len);
+        key_len += src_len;
+    }
+    if (src_port) {
+        memcpy(key + key_len, src_port, 2);
+        key_len += 2;
+    }
+    if (_key == KEY_HOSTS || _key == KEY_FLOW) {
+        if (dst) {
+            memcpy(key + key_len, dst, dst_len);
+            key_len += dst_len;
+        }
+        if (dst_port) {
+            memcpy(key + key_len, dst_port, 2);
+            key_len += 2;
+        }
+        if (proto) {
+            key[key_len++] = *proto;
+        }
+    }
+
+    return hash_key(key, key_len) % _partitions;
+}
+
+/**
+ * \brief Produce a batch of records of one partition
+ *
+ * Records are not copied by librdkafka. Records that cannot be enqueued
+ * (e.g. the queue is full) are dropped and counted instead of waiting.
+ */
+void Kafka::produce(int partition)
+{
+    std::vector<rd_kafka_message_t> &batch = _batches[partition];
+    if (batch.empty()) {
+        return;
+    }
+
+    int cnt = rd_kafka_produce_batch(_rkt, partition, 0, batch.data(),
+        batch.size());
+    _stats.batches++;
+    _stats.produced += (cnt > 0) ? cnt : 0;
+
+    if (cnt < 0 || static_cast<size_t>(cnt) != batch.size()) {
+        rd_kafka_resp_err_t last_err = RD_KAFKA_RESP_ERR_NO_ERROR;
+
+        for (rd_kafka_message_t &msg: batch) {
+            if (msg.err == RD_KAFKA_RESP_ERR_NO_ERROR) {
+                continue;
+            }
+
+            if (msg.err == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+                _stats.dropped++;
+            } else {
+                _stats.failed++;
+                last_err = msg.err;
+            }
+
+            chunk_release(static_cast<Chunk *>(msg._private));
+        }
+
+        if (last_err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+            MSG_ERROR(msg_module, "Failed to produce records to partition %d: "
+                "%s", partition, rd_kafka_err2str(last_err));
+        }
+    }
+
+    batch.clear();
+}
+
+/**
+ * \brief Report statistics of the producer
+ * \param[in] force Report now (ignore the interval)
+ */
+void Kafka::report_stats(bool force)
+{
+    time_t now = time(NULL);
+    if (!force && (_stats_interval == 0 || now - _stats_time < _stats_interval)) {
+        return;
+    }
+
+    uint64_t dropped = _stats.dropped - _stats_last.dropped;
+    uint64_t failed = _stats.failed - _stats_last.failed;
+
+    MSG_INFO(msg_module, "Records: %" PRIu64 " produced, %" PRIu64 " delivered, "
+        "%" PRIu64 " failed, %" PRIu64 " dropped; %" PRIu64 " batches; %d in "
+        "queue", _stats.produced, _stats.delivered, _stats.failed,
+        _stats.dropped, _stats.batches, rd_kafka_outq_len(_rk));
+
+    if (dropped > 0) {
+        MSG_WARNING(msg_module, "%" PRIu64 " records dropped since the last "
+            "report, maximum number of outstanding messages has been reached: "
+            "'queue.buffering.max.messages'", dropped);
+    }
+
+    if (failed > 0) {
+        MSG_WARNING(msg_module, "%" PRIu64 " records failed to be delivered "
+            "since the last report", failed);
+    }
+
+    _stats_last = _stats;
+    _stats_time = now;
+}
+
+void Kafka::ProcessDataRecord(const std::string &record)
+{
+    ProcessDataRecord(record, NULL);
+}
+
+void Kafka::ProcessDataRecord(const std::string &record,
+    const struct metadata *mdata)
+{
+    int partition = select_partition(mdata);
+
+    // Serialize the record into a pooled buffer
+    Chunk *chunk = chunk_get(record.length());
+    if (!chunk) {
+        _stats.dropped++;
+        return;
+    }
+
+    char *ptr = chunk->data + chunk->used;
+    memcpy(ptr, record.data(), record.length());
+    chunk->used += record.length();
+    chunk->refs++;
+
+    rd_kafka_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.payload = ptr;
+    msg.len = record.length();
+    msg._private = chunk;
+
+    std::vector<rd_kafka_message_t> &batch = _batches[partition];
+    batch.push_back(msg);
+    if (batch.size() >= _batch_size) {
+        produce(partition);
+        rd_kafka_poll(_rk, 0);
+    }
+}
+
+void Kafka::Flush()
+{
+    for (int i = 0; i < _partitions; ++i) {
+        produce(i);
     }
 
+    // Serve delivery reports (returns buffers to the pool)
     rd_kafka_poll(_rk, 0);
+    report_stats(false);
 }
@@ -4,20 +4,83 @@
 #include "json.h"
 #include <librdkafka/rdkafka.h>
 
+#include <ctime>
+#include <vector>
+
 class Kafka : public Output
 {
 public:
     Kafka(const pugi::xpath_node &config);
 
     ~Kafka();
+    using Output::ProcessDataRecord;
     void ProcessDataRecord(const std::string& record);
+    void ProcessDataRecord(const std::string& record,
+        const struct metadata *mdata);
+    void Flush();
 
 private:
+    friend class KafkaTest; /* tests/kafka_test.cpp */
+
+    /** Flow key used to select a partition */
+    enum PartitionKey {
+        KEY_ROUND_ROBIN,  /**< No key, records are spread over partitions */
+        KEY_SRC_IP,       /**< Source IP address                          */
+        KEY_DST_IP,       /**< Destination IP address                     */
+        KEY_HOSTS,        /**< Pair of IP addresses (both directions)     */
+        KEY_FLOW          /**< Addresses, ports and protocol (both dirs.) */
+    };
+
+    /**
+     * \brief Pooled buffer with serialized records
+     *
+     * Messages are produced without copying, so the buffer is returned to
+     * the pool after all its records are delivered (or dropped).
+     */
+    struct Chunk {
+        char *data;       /**< Serialized records                         */
+        size_t size;      /**< Size of the buffer                         */
+        size_t used;      /**< Used part of the buffer                    */
+        unsigned refs;    /**< Records waiting for delivery               */
+    };
+
+    /** Counters reported as statistics */
+    struct Stats {
+        uint64_t produced;  /**< Records passed to librdkafka             */
+        uint64_t delivered; /**< Records acknowledged by brokers          */
+        uint64_t failed;    /**< Records failed to be delivered           */
+        uint64_t dropped;   /**< Records dropped due to a full queue      */
+        uint64_t batches;   /**< Produced batches                         */
+    };
+
+    static void msg_delivered(rd_kafka_t *rk, const rd_kafka_message_t *msg,
+        void *opaque);
+
+    int select_partition(const struct metadata *mdata);
+    Chunk *chunk_get(size_t size);
+    void chunk_release(Chunk *chunk);
+    void chunk_recycle(Chunk *chunk);
+    void produce(int partition);
+    void report_stats(bool force);
+
     std::string _topic;
     int _partitions = 1;
     int _current_partition = 0;
+    enum PartitionKey _key = KEY_ROUND_ROBIN;
+    size_t _batch_size = 1000;     /* Max. records per batch and partition */
+    size_t _chunk_size = 1 << 20;  /* Size of pooled buffers */
     rd_kafka_t *_rk; /* Producer instance handle */
     rd_kafka_topic_t *_rkt; /* Topic object */
+
+    Chunk *_chunk = NULL;            /* Buffer that is being filled */
+    std::vector<Chunk *> _pool;      /* Free buffers */
+    std::vector<Chunk *> _chunks;    /* All buffers */
+    std::vector<std::vector<rd_kafka_message_t> > _batches; /* Per partition */
+
+    struct Stats _stats = {0, 0, 0, 0, 0};
+    struct Stats _stats_last = {0, 0, 0, 0, 0};
+    time_t _stats_interval = 60;     /* 0 = disabled */
+    time_t _stats_time;
 };
 
 #endif // KAFKA_H
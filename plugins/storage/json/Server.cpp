@@ -40,11 +40,14 @@
 #include "Server.h"
 #include <stdexcept>
 #include <cstring>
+#include <cinttypes>
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 
@@ -52,6 +55,14 @@
 #define DEFAULT_PORT (4800)
 // How many pending connections queue will hold
 #define BACKLOG (10)
+// Default size of the ring buffer
+#define DEFAULT_BUFFER_SIZE (8 * 1024 * 1024)
+// Minimal size of the ring buffer
+#define MIN_BUFFER_SIZE (64 * 1024)
+// Maximal number of events processed by one epoll_wait() call
+#define MAX_EVENTS (64)
+// How long to wait for a slow client in blocking mode (milliseconds)
+#define WAIT_TIMEOUT (100)
 
 // Name of plugin
 static const char *msg_module = "json_storage(server)";
@@ -59,17 +70,21 @@ static const char *msg_module = "json_storage(server)";
 /**
  * \brief Class constructor
  *
- * Parse configuration, create and bind server's socket and create acceptor's
- * thread
+ * Parse configuration, create and bind server's socket, create the ring
+ * buffer and the epoll instance
  */
 Server::Server(const pugi::xpath_node &config)
 {
-	_non_blocking = false;
-	_acceptor = NULL;
+	_slow = SLOW_WAIT;
+	_buffer = NULL;
+	_size = DEFAULT_BUFFER_SIZE;
+	_head = 0;
 
 	// Load and check the configuration
 	std::string port  = config.node().child_value("port");
 	std::string blocking = config.node().child_value("blocking");
+	std::string slow = config.node().child_value("slowClient");
+	std::string size = config.node().child_value("bufferSize");
 
 	// Check the server configuration
 	if (port.empty()) {
@@ -77,13 +92,28 @@ Server::Server(const pugi::xpath_node &config)
 	}
 
 	if (blocking == "yes" || blocking == "true" || blocking == "1") {
-		_non_blocking = false;
+		_slow = SLOW_WAIT;
 	} else if (blocking == "no" || blocking == "false" || blocking == "0") {
-		_non_blocking = true;
+		if (slow.empty() || slow == "skip") {
+			_slow = SLOW_SKIP;
+		} else if (slow == "drop") {
+			_slow = SLOW_DROP;
+		} else {
+			throw std::invalid_argument("Invalid slow client specification.");
+		}
 	} else {
 		throw std::invalid_argument("Invalid blocking mode specification.");
 	}
 
+	if (!size.empty()) {
+		char *end;
+		unsigned long long value = strtoull(size.c_str(), &end, 10);
+		if (*end != '\0' || value < MIN_BUFFER_SIZE) {
+			throw std::invalid_argument("Invalid buffer size specification.");
+		}
+		_size = value;
+	}
+
 	int serv_fd;
 	int ret_val;
 
@@ -103,7 +133,8 @@ Server::Server(const pugi::xpath_node &config)
 	}
 
 	for(iter = servinfo; iter != NULL; iter = iter->ai_next) {
-		serv_fd = socket(iter->ai_family, iter->ai_socktype, iter->ai_protocol);
+		serv_fd = socket(iter->ai_family, iter->ai_socktype | SOCK_NONBLOCK,
+			iter->ai_protocol);
 		if ((serv_fd) == -1) {
 			continue;
 		}
@@ -139,248 +170,400 @@ Server::Server(const pugi::xpath_node &config)
 			std::string(strerror(errno)) + ")");
 	}
 
-	// Create thread
-	_acceptor = new acceptor_t;
-	_acceptor->socket_fd = serv_fd;
-	_acceptor->new_clients_ready = false;
-	_acceptor->stop = false;
+	// Create epoll instance
+	_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epoll_fd == -1) {
+		close(serv_fd);
+		throw std::runtime_error("Server initialization failed (" +
+			std::string(strerror(errno)) + ")");
+	}
 
-	if (pthread_mutex_init(&_acceptor->mutex, NULL) != 0) {
-		delete _acceptor;
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL; // Server socket
+	if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, serv_fd, &ev) == -1) {
+		close(_epoll_fd);
 		close(serv_fd);
-		throw std::runtime_error("Mutex initialization failed");
+		throw std::runtime_error("Server initialization failed (" +
+			std::string(strerror(errno)) + ")");
 	}
 
-	if (pthread_create(&_acceptor->thread, NULL, &Server::thread_accept,
-			_acceptor) != 0) {
-		delete _acceptor;
+	// Create the ring buffer
+	_buffer = (char *) malloc(_size);
+	if (!_buffer) {
+		close(_epoll_fd);
 		close(serv_fd);
-		throw std::runtime_error("Acceptor thread failed");
+		throw std::runtime_error("Memory allocation failed");
 	}
+
+	_socket_fd = serv_fd;
+	MSG_INFO(msg_module, "Waiting for connections...");
 }
 
 /**
  * \brief Class destructor
  *
- * Close all sockets and stop and destroy the acceptor.
+ * Send remaining data, close all sockets and free the ring buffer.
  */
 Server::~Server()
 {
+	Flush();
+
 	// Disconnect connected clients
-	for (auto &client : _clients) {
-		close(client.socket);
+	for (client_t *client : _clients) {
+		close(client->socket);
+		delete client;
 	}
 
-	// Stop and destroy acceptor's thread
-	if (_acceptor) {
-		_acceptor->stop = true;
-		pthread_join(_acceptor->thread, NULL);
-		pthread_mutex_destroy(&_acceptor->mutex);
+	close(_epoll_fd);
+	close(_socket_fd);
+	free(_buffer);
+}
 
-		close(_acceptor->socket_fd);
+/**
+ * \brief Accept all pending connections
+ */
+void Server::accept_clients()
+{
+	while (1) {
+		struct sockaddr_storage client_addr;
+		socklen_t sin_size = sizeof(client_addr);
+		int new_fd;
+
+		new_fd = accept4(_socket_fd, (struct sockaddr *) &client_addr,
+			&sin_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (new_fd == -1) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				MSG_ERROR(msg_module, "accept() - failed (%s)",
+					strerror(errno));
+			}
+			return;
+		}
 
-		for (auto &client : _acceptor->new_clients) {
-			close(client.socket);
+		// Further receptions from the socket will be disallowed
+		shutdown(new_fd, SHUT_RD);
+
+		// New client gets only new records
+		client_t *client = new client_t;
+		client->info = client_addr;
+		client->socket = new_fd;
+		client->offset = _head;
+		client->partial = false;
+		client->writable = true;
+		client->failed = false;
+		client->lost = 0;
+
+		// Edge-triggered, the client is marked as writable by the event
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLOUT | EPOLLET;
+		ev.data.ptr = client;
+		if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, new_fd, &ev) == -1) {
+			MSG_ERROR(msg_module, "epoll_ctl() - failed (%s)", strerror(errno));
+			close(new_fd);
+			delete client;
+			continue;
 		}
 
-		delete _acceptor;
+		MSG_INFO(msg_module, "Client connected: %s",
+			get_client_desc(client_addr).c_str());
+		_clients.push_back(client);
 	}
 }
 
 /**
- * \brief Acceptor's thread function
+ * \brief Process events of the server and clients' sockets
  *
- * Wait for new clients and accept them.
- * \param[in,out] context Acceptor's structure with configured server socket
- * \return Nothing
+ * Accepts new clients and marks clients as writable or failed. Failed clients
+ * are not removed here.
+ * \param[in] timeout Maximal time to wait for an event (milliseconds)
  */
-void *Server::thread_accept(void *context)
+void Server::poll_events(int timeout)
 {
-	acceptor_t *acc = (acceptor_t *) context;
-	int ret_val;
-	struct timeval tv;
-	fd_set rfds;
-
-	MSG_INFO(msg_module, "Waiting for connections...");
-
-	while(1) {
-		struct sockaddr_storage client_addr;
-		socklen_t sin_size = sizeof(client_addr);
-		int new_fd;
+	struct epoll_event events[MAX_EVENTS];
+	int cnt;
 
-		// "select()" configuration
-		FD_ZERO(&rfds);
-		FD_SET(acc->socket_fd, &rfds);
-		tv.tv_sec = 0;
-		tv.tv_usec = 100000;
+	cnt = epoll_wait(_epoll_fd, events, MAX_EVENTS, timeout);
+	if (cnt == -1) {
+		if (errno != EINTR) {
+			MSG_ERROR(msg_module, "epoll_wait() - failed (%s)", strerror(errno));
+		}
+		return;
+	}
 
-		ret_val = select(acc->socket_fd + 1, &rfds, NULL, NULL, &tv);
-		if (ret_val == -1) {
-			MSG_ERROR(msg_module, "select() - failed (%s)", strerror(errno));
-			break;
+	for (int i = 0; i < cnt; ++i) {
+		client_t *client = (client_t *) events[i].data.ptr;
+		if (client == NULL) {
+			accept_clients();
+			continue;
 		}
 
-		if (!FD_ISSET(acc->socket_fd, &rfds)) {
-			// Timeout
-			if (acc->stop) {
-				// End thread
-				break;
+		if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+			if (!client->failed) {
+				MSG_INFO(msg_module, "Client disconnected: %s",
+					get_client_desc(client->info).c_str());
 			}
+			client->failed = true;
 			continue;
 		}
 
-		new_fd = accept(acc->socket_fd, (struct sockaddr *) &client_addr,
-			&sin_size);
-		if (new_fd == -1) {
-			MSG_ERROR(msg_module, "accept() - failed (%s)", strerror(errno));
-			continue;
+		if (events[i].events & EPOLLOUT) {
+			client->writable = true;
 		}
+	}
+}
 
-		MSG_INFO(msg_module, "Client connected: %s",
-			get_client_desc(client_addr).c_str());
+/**
+ * \brief Close and remove failed clients
+ */
+void Server::remove_clients()
+{
+	std::vector<client_t *>::iterator iter = _clients.begin();
+	while (iter != _clients.end()) {
+		client_t *client = *iter;
+		if (!client->failed) {
+			++iter;
+			continue;
+		}
 
-		// Further receptions from the socket will be disallowed
-		shutdown(new_fd, SHUT_RD);
+		if (client->lost > 0) {
+			MSG_INFO(msg_module, "Client %s: %" PRIu64 " records skipped in "
+				"total", get_client_desc(client->info).c_str(), client->lost);
+		}
 
-		// Add new client to the array of new clients
-		pthread_mutex_lock(&acc->mutex);
-		client_t new_client {client_addr, new_fd};
-		acc->new_clients.push_back(new_client);
-		acc->new_clients_ready = true;
-		pthread_mutex_unlock(&acc->mutex);
+		// Closing the socket also removes it from the epoll instance
+		close(client->socket);
+		delete client;
+		iter = _clients.erase(iter); // The iterator has new location...
 	}
-
-	MSG_INFO(msg_module, "Connection acceptor terminated.");
-	return NULL;
 }
 
 /**
- * \brief Send a message to a client
+ * \brief Send stored data to a client
  *
- * Sends the message to the client using prepared socket. When non-blocking mode
- * is enabled and only part of the message was sent, the rest of the message is
- * stored in the client's profile.
- * \param[in] data The message
- * \param[in] len The length of the message
+ * Sends the rest of the previous message (or markers) and all unsent records
+ * from the ring buffer using one system call.
  * \param[in,out] client Client
  * \return Transmission status
  */
-enum Server::Send_status Server::msg_send(const char *data, ssize_t len,
-	client_t &client)
+enum Server::Send_status Server::msg_send(client_t &client)
 {
-	ssize_t now;
-	ssize_t todo = len;
-	const char *ptr = data;
+	struct iovec iov[3];
+	struct msghdr msg;
+	size_t iov_cnt = 0;
+
+	if (!client.msg_rest.empty()) {
+		iov[iov_cnt].iov_base = (void *) client.msg_rest.data();
+		iov[iov_cnt].iov_len = client.msg_rest.size();
+		iov_cnt++;
+	}
 
-	int flags = MSG_NOSIGNAL;
-	if (_non_blocking) {
-		flags |= MSG_DONTWAIT;
+	// Unsent part of the ring buffer (can wrap around)
+	size_t todo = _head - client.offset;
+	size_t start = client.offset % _size;
+	if (todo > 0) {
+		size_t first = std::min(todo, _size - start);
+		iov[iov_cnt].iov_base = _buffer + start;
+		iov[iov_cnt].iov_len = first;
+		iov_cnt++;
+
+		if (first < todo) {
+			iov[iov_cnt].iov_base = _buffer;
+			iov[iov_cnt].iov_len = todo - first;
+			iov_cnt++;
+		}
 	}
 
-	while (todo > 0) {
-		now = send(client.socket, ptr, todo, flags);
+	if (iov_cnt == 0) {
+		return SEND_OK;
+	}
 
-		if (now == -1) {
-			if (_non_blocking && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				// Non-blocking mode
-				break;
-			}
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iov_cnt;
 
-			// Connection failed
-			MSG_INFO(msg_module, "Client disconnected: %s (%s)",
-					get_client_desc(client.info).c_str(), strerror(errno));
-			return SEND_FAILED;
+	ssize_t now = sendmsg(client.socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (now == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			client.writable = false;
+			return SEND_WOULDBLOCK;
 		}
 
-		ptr  += now;
-		todo -= now;
+		// Connection failed
+		MSG_INFO(msg_module, "Client disconnected: %s (%s)",
+				get_client_desc(client.info).c_str(), strerror(errno));
+		client.failed = true;
+		return SEND_FAILED;
 	}
 
-	if (todo <= 0) {
-		return SEND_OK;
+	size_t sent = now;
+	if (!client.msg_rest.empty()) {
+		size_t rest = std::min(sent, client.msg_rest.size());
+		client.msg_rest.erase(0, rest);
+		sent -= rest;
 	}
 
-	// Non-blocking mode - (partly) failed to sent the message
-	if (todo == len) {
-		// No part of the message was sent
+	if (sent > 0) {
+		client.offset += sent;
+		client.partial = (_buffer[(client.offset - 1) % _size] != '\n');
+	}
+
+	if (!client.msg_rest.empty() || client.offset != _head) {
+		// Partly sent, the next attempt shows if the socket buffer is full
 		return SEND_WOULDBLOCK;
 	}
 
-	/*
-	 * Partly sent. Store the rest of the message for the next transmission to
-	 * avoid invalid JSON format. Temporary string should be here, because it is
-	 * possible to "data == rest.c_str()".
-	 */
-	std::string tmp(ptr, todo);
-	client.msg_rest.assign(tmp);
-	return SEND_WOULDBLOCK;
+	return SEND_OK;
 }
 
 /**
- * \brief Send record to all connected clients
+ * \brief Skip all unsent records of a client
  *
- * \param[in] record Record
+ * The rest of a partly sent record is kept to avoid invalid JSON format and
+ * a marker with the number of skipped records is sent to the client instead.
+ * \param[in,out] client Client
  */
-void Server::ProcessDataRecord(const std::string &record)
+void Server::skip_records(client_t &client)
 {
-	const char *data = record.c_str();
-	ssize_t length = record.size();
+	uint64_t pos = client.offset;
+
+	if (client.partial) {
+		// Finish the record
+		while (pos < _head) {
+			char ch = _buffer[pos++ % _size];
+			client.msg_rest += ch;
+			if (ch == '\n') {
+				break;
+			}
+		}
+	}
 
-	// Are there new clients?
-	if (_acceptor->new_clients_ready) {
-		pthread_mutex_lock(&_acceptor->mutex);
+	// Count skipped records
+	uint64_t skipped = 0;
+	while (pos < _head) {
+		size_t start = pos % _size;
+		size_t len = std::min<uint64_t>(_head - pos, _size - start);
+		const char *ptr = _buffer + start;
+		const char *end = ptr + len;
+
+		while ((ptr = (const char *) memchr(ptr, '\n', end - ptr)) != NULL) {
+			skipped++;
+			ptr++;
+		}
+		pos += len;
+	}
 
-		_clients.insert(_clients.end(), _acceptor->new_clients.begin(),
-			_acceptor->new_clients.end());
-		_acceptor->new_clients.clear();
+	client.offset = _head;
+	client.partial = false;
+	client.msg_rest += "{\"@type\": \"ipfix.lost\", \"records\": "
+		+ std::to_string(skipped) + "}\n";
 
-		_acceptor->new_clients_ready = false;
-		pthread_mutex_unlock(&_acceptor->mutex);
+	if (client.lost == 0) {
+		MSG_WARNING(msg_module, "Client %s is too slow, records are skipped",
+			get_client_desc(client.info).c_str());
 	}
+	client.lost += skipped;
+	MSG_DEBUG(msg_module, "Client %s: %" PRIu64 " records skipped (%" PRIu64
+		" in total)", get_client_desc(client.info).c_str(), skipped,
+		client.lost);
+}
 
-	// Send the message to all clients
-	std::vector<client_t>::iterator iter = _clients.begin();
-	while (iter != _clients.end()) {
-		client_t &client = *iter;
-		enum Send_status ret_val;
-
-		// Send the rest part of the last partly sent message
-		if (_non_blocking && !client.msg_rest.empty()) {
-			std::string &rest = client.msg_rest;
-
-			ret_val = msg_send(rest.c_str(), rest.size(), client);
-			switch (ret_val) {
-			case SEND_OK:
-				// The rest of the message successfully sent
-				rest.clear();
-				break;
-			case SEND_WOULDBLOCK:
-				// Skip, next client...
-				++iter;
-				continue;
-			case SEND_FAILED:
-				// Close socket and remove client
-				close(client.socket);
-				iter = _clients.erase(iter); // The iterator has new location...
-				continue;
+/**
+ * \brief Make sure that no client loses data by writing next len bytes
+ *
+ * Clients that would lose unsent data are served first. If it is not enough,
+ * the configured policy is applied (wait, skip records or disconnect).
+ * \param[in] len Number of bytes to write into the ring buffer
+ */
+void Server::make_room(size_t len)
+{
+	if (_head + len <= _size) {
+		return;
+	}
+
+	// Oldest byte that stays in the buffer after the write
+	uint64_t limit = _head + len - _size;
+
+	bool removed = false;
+	for (client_t *client : _clients) {
+		if (client->failed || client->offset >= limit) {
+			continue;
+		}
+
+		if (client->writable) {
+			msg_send(*client);
+		}
+
+		while (!client->failed && client->offset < limit) {
+			if (_slow == SLOW_SKIP) {
+				skip_records(*client);
+			} else if (_slow == SLOW_DROP) {
+				MSG_WARNING(msg_module, "Client %s is too slow, disconnected",
+					get_client_desc(client->info).c_str());
+				client->failed = true;
+			} else {
+				// Blocking mode - wait for the client
+				poll_events(WAIT_TIMEOUT);
+				if (client->writable) {
+					msg_send(*client);
+				}
 			}
 		}
 
-		// Send new message
-		ret_val = msg_send(data, length, client);
-		switch (ret_val) {
-		case SEND_OK:
-		case SEND_WOULDBLOCK:
-			// Next client
-			++iter;
-			break;
-		case SEND_FAILED:
-			// Close socket and remove client's info
-			close(client.socket);
-			iter = _clients.erase(iter); // The iterator has new location...
-			break;
+		removed |= client->failed;
+	}
+
+	if (removed) {
+		remove_clients();
+	}
+}
+
+/**
+ * \brief Store a record for all connected clients
+ *
+ * \param[in] record Record
+ */
+void Server::ProcessDataRecord(const std::string &record)
+{
+	size_t length = record.size();
+
+	if (_clients.empty()) {
+		// Nobody is listening
+		return;
+	}
+
+	if (length > _size) {
+		MSG_WARNING(msg_module, "Record is larger than the buffer (%zu bytes), "
+			"skipped", _size);
+		return;
+	}
+
+	make_room(length);
+
+	// Copy the record into the ring buffer (can wrap around)
+	size_t start = _head % _size;
+	size_t first = std::min(length, _size - start);
+	memcpy(_buffer + start, record.data(), first);
+	memcpy(_buffer, record.data() + first, length - first);
+	_head += length;
+}
+
+/**
+ * \brief Send stored records to all connected clients that are ready
+ */
+void Server::Flush()
+{
+	// Accept new clients and update states of sockets
+	poll_events(0);
+
+	for (client_t *client : _clients) {
+		if (!client->failed && client->writable) {
+			msg_send(*client);
 		}
 	}
+
+	remove_clients();
 }
 
 /**
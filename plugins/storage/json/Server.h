@@ -44,11 +44,15 @@
 #include "json.h"
 #include <string>
 #include <vector>
-#include <pthread.h>
+#include <stdint.h>
 #include <sys/socket.h>
 
 /**
  * \brief The class for server output interface
+ *
+ * Records are stored into a ring buffer shared by all clients. Each client
+ * has its own position in the buffer and the data are sent to clients that
+ * are ready (epoll) with one system call per client after each IPFIX message.
  */
 class Server : public Output
 {
@@ -56,8 +60,10 @@ public:
 	Server(const pugi::xpath_node &config);
 	~Server();
 
-	// Send a record to connected clients
+	// Store a record for connected clients
 	void ProcessDataRecord(const std::string& record);
+	// Send stored records to connected clients
+	void Flush();
 
 private:
 	/** Transmission status */
@@ -67,38 +73,56 @@ private:
 		SEND_FAILED            /**< Failed */
 	};
 
+	/** What to do with a client that is too slow to receive all records */
+	enum Slow_policy {
+		SLOW_WAIT,             /**< Wait for the client (blocking mode) */
+		SLOW_SKIP,             /**< Skip unsent records and send a marker */
+		SLOW_DROP              /**< Disconnect the client */
+	};
+
 	/** Structure for connected client */
 	typedef struct client_s {
 		struct sockaddr_storage info; /**< Info about client (IP, port)     */
 		int socket;                   /**< Client's socket                  */
-		std::string msg_rest;   /**< Rest of a message in non-blocking mode */
+		uint64_t offset;        /**< Next byte to send (ring buffer)        */
+		bool partial;           /**< Last record was partly sent            */
+		bool writable;          /**< Socket is ready for writing            */
+		bool failed;            /**< Connection failed, remove the client   */
+		uint64_t lost;          /**< Total number of skipped records        */
+		std::string msg_rest;   /**< Data to send before the ring buffer    */
 	} client_t;
 
-	/** Configuration of acceptor thread */
-	typedef struct acceptor_s {
-		pthread_t thread;					/**< Thread */
-		pthread_mutex_t mutex;              /**< Mutex for the array */
-		bool stop;                          /**< Stop flag for terminating */
-
-		int socket_fd;                      /**< Server socket */
-		bool new_clients_ready;             /**< New clients flag */
-		std::vector<client_t> new_clients;  /**< Array of new clients */
-	} acceptor_t;
+	/** Connected clients */
+	std::vector<client_t *> _clients;
+	/** Behaviour for slow clients */
+	enum Slow_policy _slow;
+	/** Server socket */
+	int _socket_fd;
+	/** Epoll instance */
+	int _epoll_fd;
 
-	/** Connected client */
-	std::vector<client_t> _clients;
-	/** Socket state */
-	bool _non_blocking;
-	/** Acceptor of new clients */
-	acceptor_t *_acceptor;
+	/** Ring buffer with records */
+	char *_buffer;
+	/** Size of the ring buffer */
+	size_t _size;
+	/** Total number of bytes written into the buffer */
+	uint64_t _head;
 
 	// Brief description of a client
 	static std::string get_client_desc(const struct sockaddr_storage &client);
-	// Send data to the client
-	enum Send_status msg_send(const char *data, ssize_t len, client_t &client);
+	// Send stored data to the client
+	enum Send_status msg_send(client_t &client);
 
-	// Acceptor's thread function
-	static void *thread_accept(void *context);
+	// Process events of the server and clients' sockets
+	void poll_events(int timeout);
+	// Accept new clients
+	void accept_clients();
+	// Close and remove failed clients
+	void remove_clients();
+	// Make sure that no client loses next len bytes of the buffer
+	void make_room(size_t len);
+	// Skip all unsent records of a client
+	void skip_records(client_t &client);
 };
 
 #endif // SERVER_H
@@ -88,10 +88,10 @@ Storage::~Storage()
 /**
  * \brief Send data record
  */
-void Storage::sendData() const
+void Storage::sendData(const struct metadata *mdata) const
 {
 	for (Output *output: outputs) {
-		output->ProcessDataRecord(record);
+		output->ProcessDataRecord(record, mdata);
 	}
 }
 
@@ -102,7 +102,12 @@ void Storage::storeDataSets(const ipfix_message* ipfix_msg, struct json_conf * c
 {
 	/* Iterate through all data records */
 	for (int i = 0; i < ipfix_msg->data_records_count; ++i) {
-		storeDataRecord(&(ipfix_msg->metadata[i]), config);
+		storeDataRecord(ipfix_msg, i, config);
+	}
+
+	/* Let outputs send their batches */
+	for (Output *output: outputs) {
+		output->Flush();
 	}
 }
 
@@ -182,17 +187,94 @@ const char* Storage::rawName(uint32_t en, uint16_t id) const
 	return buf;
 }
 
+/**
+ * \brief Store value of a field
+ */
+void Storage::storeValue(const ipfix_element_t *element, ELEMENT_TYPE element_type,
+	uint8_t *data_record, struct json_conf * config)
+{
+	uint16_t trans_len = 0;
+	const char *trans_str = NULL;
+
+	switch (element_type) {
+	case ET_UNSIGNED_8:
+	case ET_UNSIGNED_16:
+	case ET_UNSIGNED_32:
+	case ET_UNSIGNED_64:{
+		trans_str = translator.toUnsigned(length, &trans_len, data_record, offset,
+			element, config);
+		record.append(trans_str, trans_len);
+	}
+		break;
+	case ET_SIGNED_8:
+	case ET_SIGNED_16:
+	case ET_SIGNED_32:
+	case ET_SIGNED_64:
+		trans_str = translator.toSigned(length, &trans_len, data_record, offset);
+		record.append(trans_str, trans_len);
+		break;
+	case ET_FLOAT_32:
+	case ET_FLOAT_64:
+		trans_str = translator.toFloat(length, &trans_len, data_record, offset);
+		record.append(trans_str, trans_len);
+		break;
+	case ET_IPV4_ADDRESS:
+		record += '"';
+		trans_str = translator.formatIPv4(read32(data_record + offset), &trans_len);
+		record.append(trans_str, trans_len);
+		record += '"';
+		break;
+	case ET_IPV6_ADDRESS:
+		READ_BYTE_ARR(addr6, data_record + offset, IPV6_LEN);
+		record += '"';
+		record += translator.formatIPv6(addr6);
+		record += '"';
+		break;
+	case ET_MAC_ADDRESS:
+		READ_BYTE_ARR(addrMac, data_record + offset, MAC_LEN);
+		record += '"';
+		record += translator.formatMac(addrMac);
+		record += '"';
+		break;
+	case ET_DATE_TIME_SECONDS:
+		record += translator.formatTimestamp(read32(data_record + offset),
+			t_units::SEC, config);
+		break;
+	case ET_DATE_TIME_MILLISECONDS:
+		record += translator.formatTimestamp(read64(data_record + offset),
+			t_units::MILLISEC, config);
+		break;
+	case ET_DATE_TIME_MICROSECONDS:
+		record += translator.formatTimestamp(read64(data_record + offset),
+			t_units::MICROSEC, config);
+		break;
+	case ET_DATE_TIME_NANOSECONDS:
+		record += translator.formatTimestamp(read64(data_record + offset),
+			t_units::NANOSEC, config);
+		break;
+	case ET_STRING:
+		length = realLength(length, data_record, offset);
+		record += translator.escapeString(length, data_record + offset,
+			config);
+		break;
+	case ET_BOOLEAN:
+	case ET_UNASSIGNED: 
+	default:
+		readRawData(length, data_record, offset);
+		break;
+	}
+}
+
 /**
  * \brief Store data record
  */
-void Storage::storeDataRecord(struct metadata *mdata, struct json_conf * config)
+void Storage::storeDataRecord(const struct ipfix_message *msg, int index, struct json_conf * config)
 {
+	struct metadata *mdata = &(msg->metadata[index]);
 	const char *element_name = NULL;
 	ELEMENT_TYPE element_type;
 
 	offset = 0;
-	uint16_t trans_len = 0;
-	const char *trans_str = NULL;
 	record.clear();
 	STR_APPEND(record, "{\"@type\": \"ipfix.entry\", ");
 
@@ -238,78 +320,58 @@ void Storage::storeDataRecord(struct metadata *mdata, struct json_conf * config)
 		record += element_name;
 		STR_APPEND(record, "\": ");
 
-		switch (element_type) {
-		case ET_UNSIGNED_8:
-		case ET_UNSIGNED_16:
-		case ET_UNSIGNED_32:
-		case ET_UNSIGNED_64:{
-			trans_str = translator.toUnsigned(length, &trans_len, data_record, offset,
-				element, config);
-			record.append(trans_str, trans_len);
-		}
-			break;
-		case ET_SIGNED_8:
-		case ET_SIGNED_16:
-		case ET_SIGNED_32:
-		case ET_SIGNED_64:
-			trans_str = translator.toSigned(length, &trans_len, data_record, offset);
-			record.append(trans_str, trans_len);
-			break;
-		case ET_FLOAT_32:
-		case ET_FLOAT_64:
-			trans_str = translator.toFloat(length, &trans_len, data_record, offset);
-			record.append(trans_str, trans_len);
-			break;
-		case ET_IPV4_ADDRESS:
-			record += '"';
-			trans_str = translator.formatIPv4(read32(data_record + offset), &trans_len);
-			record.append(trans_str, trans_len);
-			record += '"';
-			break;
-		case ET_IPV6_ADDRESS:
-			READ_BYTE_ARR(addr6, data_record + offset, IPV6_LEN);
-			record += '"';
-			record += translator.formatIPv6(addr6);
-			record += '"';
-			break;
-		case ET_MAC_ADDRESS:
-			READ_BYTE_ARR(addrMac, data_record + offset, MAC_LEN);
-			record += '"';
-			record += translator.formatMac(addrMac);
-			record += '"';
-			break;
-		case ET_DATE_TIME_SECONDS:
-			record += translator.formatTimestamp(read32(data_record + offset),
-				t_units::SEC, config);
-			break;
-		case ET_DATE_TIME_MILLISECONDS:
-			record += translator.formatTimestamp(read64(data_record + offset),
-				t_units::MILLISEC, config);
-			break;
-		case ET_DATE_TIME_MICROSECONDS:
-			record += translator.formatTimestamp(read64(data_record + offset),
-				t_units::MICROSEC, config);
-			break;
-		case ET_DATE_TIME_NANOSECONDS:
-			record += translator.formatTimestamp(read64(data_record + offset),
-				t_units::NANOSEC, config);
-			break;
-		case ET_STRING:
-			length = realLength(length, data_record, offset);
-			record += translator.escapeString(length, data_record + offset,
-				config);
-			break;
-		case ET_BOOLEAN:
-		case ET_UNASSIGNED: 
-		default:
-			readRawData(length, data_record, offset);
-			break;
-		}
-
+		storeValue(element, element_type, data_record, config);
 		offset += length;
 		added++;
 	}
-	
+
+	/* Store enrichment fields which are not part of the record */
+	if (msg->enrich) {
+		const int columns = enrich_field_count();
+		for (int column = 0; column < columns; ++column) {
+			uint8_t *value = enrich_value_get(msg, column, index);
+			if (value == NULL) {
+				continue;
+			}
+
+			const struct enrich_field *field = enrich_field_get(column);
+			if (template_get_field(templ, field->enterprise, field->id, NULL) != NULL) {
+				continue;
+			}
+
+			id = field->id;
+			length = field->length;
+			enterprise = field->enterprise;
+
+			const ipfix_element_t * element = get_element_by_id(id, enterprise);
+			if (element != NULL) {
+				element_name = element->name;
+				element_type = element->type;
+			} else {
+				if (config->ignoreUnknown) {
+					continue;
+				}
+
+				element_name = rawName(enterprise, id);
+				element_type = ET_UNASSIGNED;
+			}
+
+			if (added > 0) {
+				STR_APPEND(record, ", ");
+			}
+
+			STR_APPEND(record, "\"");
+			record += config->prefix;
+			record += element_name;
+			STR_APPEND(record, "\": ");
+
+			/* Values have fixed length, read them from the start */
+			offset = 0;
+			storeValue(element, element_type, value, config);
+			added++;
+		}
+	}
+
 	/* Store metadata */
 	if (processMetadata) {
 		STR_APPEND(record, ", \"ipfix.metadata\": {");
@@ -318,7 +380,7 @@ void Storage::storeDataRecord(struct metadata *mdata, struct json_conf * config)
 	}
 	
 	STR_APPEND(record, "}\n");
-	sendData();
+	sendData(mdata);
 }
 
 /**
@@ -126,12 +126,23 @@ private:
      */
 	void readRawData(uint16_t &length, uint8_t *data, uint16_t &offset);
     
+    /**
+     * \brief Store value of a field
+     * 
+     * @param element Element description (may be NULL)
+     * @param element_type Element type
+     * @param data_record data record
+     */
+	void storeValue(const ipfix_element_t *element, ELEMENT_TYPE element_type,
+		uint8_t *data_record, struct json_conf * config);
+
     /**
      * \brief Store data record
      * 
-     * @param mdata Data record's metadata
+     * @param msg IPFIX message
+     * @param index Index of the record in message's metadata
      */
-	void storeDataRecord(struct metadata *mdata, struct json_conf * config);
+	void storeDataRecord(const struct ipfix_message *msg, int index, struct json_conf * config);
 
     /**
 	 * \brief Store metadata
@@ -148,8 +159,10 @@ private:
     
 	/**
 	 * \brief Send JSON data to output processors
+	 *
+	 * @param mdata Data record's metadata
      */
-	void sendData() const;
+	void sendData(const struct metadata *mdata) const;
     
 	bool processMetadata{false};	/**< Metadata processing enabled */
 	bool printOnly{false};
@@ -44,6 +44,9 @@ extern "C" {
 
 /* API version constant */
 IPFIXCOL_API_VERSION;
+
+/* Enrichment fields are printed (see Storage::storeDataRecord) */
+IPFIXCOL_STORAGE_ENRICHMENT;
 }
 
 #include <cstring>
@@ -50,6 +50,7 @@ extern "C" {
 
 // Class prototype
 class Storage;
+struct metadata;
 
 /**
  * \brief JSON plugin configuration
@@ -73,6 +74,26 @@ public:
 	virtual ~Output() {}
 
 	virtual void ProcessDataRecord(const std::string& record) = 0;
+
+	/**
+	 * \brief Process a JSON record together with the original IPFIX record
+	 *
+	 * Outputs that need values of the IPFIX record (e.g. a flow key) can
+	 * override this method. By default, only the JSON record is processed.
+	 */
+	virtual void ProcessDataRecord(const std::string& record,
+		const struct metadata *mdata)
+	{
+		(void) mdata;
+		ProcessDataRecord(record);
+	}
+
+	/**
+	 * \brief All records of an IPFIX message were processed
+	 *
+	 * Outputs that collect records into batches should send them now.
+	 */
+	virtual void Flush() {}
 };
 
 #endif // JSON_H
@@ -0,0 +1,300 @@
+/**
+ * \file kafka_test.cpp
+ * \brief Test of the Kafka output of the JSON storage plugin
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+/*
+ * The test runs the Kafka output against the mock cluster of librdkafka
+ * (test.mock.num.brokers), no real broker is needed.
+ */
+
+extern "C" {
+#include <ipfixcol.h>
+}
+
+#include <librdkafka/rdkafka_mock.h>
+
+#include <arpa/inet.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <string>
+
+#include "../../Kafka.h"
+
+/* Topic of all tests */
+#define TOPIC "ipfix"
+
+static int errors = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("Error: %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		errors++; \
+	} \
+} while (0)
+
+/*
+ * Core functions used by the Kafka output. Records of the test are plain
+ * structures, so the field lookup is simulated.
+ */
+extern "C" {
+int verbose = ICMSG_ERROR;
+
+void icmsg_print(ICMSG_LEVEL level, const char *format, ...)
+{
+	(void) level;
+	va_list ap;
+	va_start(ap, format);
+	vprintf(format, ap);
+	va_end(ap);
+}
+
+struct test_flow {
+	uint32_t src;    /* sourceIPv4Address (network order) */
+	uint32_t dst;    /* destinationIPv4Address (network order) */
+	uint16_t sport;  /* sourceTransportPort (network order) */
+	uint16_t dport;  /* destinationTransportPort (network order) */
+	uint8_t proto;   /* protocolIdentifier */
+};
+
+uint8_t *data_record_get_field(uint8_t *record, struct ipfix_template *templ, uint32_t enterprise, uint16_t id, int *data_length)
+{
+	(void) templ;
+	struct test_flow *flow = (struct test_flow *) record;
+
+	if (enterprise != 0) {
+		return NULL;
+	}
+
+	switch (id) {
+	case 8:  *data_length = 4; return (uint8_t *) &flow->src;
+	case 12: *data_length = 4; return (uint8_t *) &flow->dst;
+	case 7:  *data_length = 2; return (uint8_t *) &flow->sport;
+	case 11: *data_length = 2; return (uint8_t *) &flow->dport;
+	case 4:  *data_length = 1; return (uint8_t *) &flow->proto;
+	default: return NULL;
+	}
+}
+}
+
+/* Any template, the simulated lookup doesn't use it */
+static struct ipfix_template test_templ;
+
+/**
+ * \brief Access to internals of the Kafka output
+ */
+class KafkaTest
+{
+public:
+	/**
+	 * \brief Create the output with a mock cluster and the topic
+	 * \param[in] options  Elements of the output's configuration
+	 * \param[in] partitions Number of partitions of the topic (at most 4)
+	 */
+	static Kafka *create(const std::string &options, int partitions)
+	{
+		std::string xml = "<output><type>kafka</type><topic>" TOPIC "</topic>"
+			"<partitions>" + std::to_string(partitions) + "</partitions>"
+			"<statsInterval>0</statsInterval>"
+			"<property><name>test.mock.num.brokers</name><value>1</value></property>"
+			+ options + "</output>";
+
+		pugi::xml_document doc;
+		doc.load_string(xml.c_str());
+		Kafka *kafka = new Kafka(doc.select_node("output"));
+
+		/* The topic may be auto-created (with 4 partitions) by the producer */
+		rd_kafka_mock_cluster_t *mcluster = rd_kafka_handle_mock_cluster(kafka->_rk);
+		rd_kafka_resp_err_t err = mcluster
+			? rd_kafka_mock_topic_create(mcluster, TOPIC, partitions, 1)
+			: RD_KAFKA_RESP_ERR__FAIL;
+		if (err && err != RD_KAFKA_RESP_ERR_TOPIC_ALREADY_EXISTS) {
+			printf("Error: unable to create mock topic (%s)\n", rd_kafka_err2str(err));
+			errors++;
+		}
+
+		return kafka;
+	}
+
+	/**
+	 * \brief Serve delivery reports until all records are delivered
+	 * \return True if nothing is left in the queue
+	 */
+	static bool wait_delivered(Kafka *kafka)
+	{
+		for (int i = 0; i < 100 && rd_kafka_outq_len(kafka->_rk) > 0; ++i) {
+			rd_kafka_poll(kafka->_rk, 100);
+		}
+
+		return rd_kafka_outq_len(kafka->_rk) == 0;
+	}
+
+	/**
+	 * \brief Check that no buffer waits for a delivery report
+	 */
+	static bool chunks_released(Kafka *kafka)
+	{
+		for (Kafka::Chunk *chunk: kafka->_chunks) {
+			if (chunk->refs != 0) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * \brief Both directions of a flow go to the same partition and all
+	 * records are delivered there
+	 */
+	static void partition_key()
+	{
+		printf("Flow key partitioning\n");
+		Kafka *kafka = create("<partitionKey>flow</partitionKey>", 4);
+
+		std::set<int> used;
+		for (uint32_t i = 0; i < 64; ++i) {
+			struct test_flow fwd = {htonl(0x0a000001 + i), htonl(0xc0a80001),
+				htons(1024 + i), htons(443), 6};
+			struct test_flow rev = {fwd.dst, fwd.src, fwd.dport, fwd.sport, 6};
+			struct metadata mfwd, mrev;
+			memset(&mfwd, 0, sizeof(mfwd));
+			memset(&mrev, 0, sizeof(mrev));
+			mfwd.record.record = &fwd;
+			mfwd.record.templ = &test_templ;
+			mrev.record.record = &rev;
+			mrev.record.templ = &test_templ;
+
+			int partition = kafka->select_partition(&mfwd);
+			CHECK(partition >= 0 && partition < 4);
+			CHECK(kafka->select_partition(&mfwd) == partition);
+			CHECK(kafka->select_partition(&mrev) == partition);
+			used.insert(partition);
+
+			kafka->ProcessDataRecord("{\"flow\": " + std::to_string(i) + "}", &mfwd);
+			kafka->ProcessDataRecord("{\"flow\": " + std::to_string(i) + "}", &mrev);
+		}
+
+		/* Flows are spread over partitions */
+		CHECK(used.size() > 1);
+
+		kafka->Flush();
+		CHECK(wait_delivered(kafka));
+		CHECK(kafka->_stats.produced == 128);
+		CHECK(kafka->_stats.delivered == 128);
+		CHECK(kafka->_stats.failed == 0);
+		CHECK(kafka->_stats.dropped == 0);
+
+		delete kafka;
+	}
+
+	/**
+	 * \brief Records that don't fit into the local queue are dropped and
+	 * counted, the collector is not blocked
+	 */
+	static void queue_full()
+	{
+		printf("Full queue\n");
+		Kafka *kafka = create("<batchSize>100</batchSize>"
+			"<property><name>queue.buffering.max.messages</name><value>10</value></property>", 1);
+
+		for (int i = 0; i < 50; ++i) {
+			kafka->ProcessDataRecord("{\"record\": " + std::to_string(i) + "}");
+		}
+
+		/* One batch of 50 records, only 10 fit into the queue */
+		kafka->Flush();
+		CHECK(kafka->_stats.batches == 1);
+		CHECK(kafka->_stats.produced == 10);
+		CHECK(kafka->_stats.dropped == 40);
+
+		CHECK(wait_delivered(kafka));
+		CHECK(kafka->_stats.delivered == 10);
+		CHECK(chunks_released(kafka));
+
+		delete kafka;
+	}
+
+	/**
+	 * \brief Buffers are returned to the pool by delivery reports and reused
+	 */
+	static void chunk_pool()
+	{
+		printf("Buffer pool\n");
+		/* 4 records per buffer, each record is produced immediately */
+		Kafka *kafka = create("<batchSize>1</batchSize><bufferSize>4096</bufferSize>", 1);
+		std::string record(1000, 'x');
+
+		for (int round = 0; round < 3; ++round) {
+			for (int i = 0; i < 8; ++i) {
+				kafka->ProcessDataRecord(record);
+			}
+
+			/* Nothing can be reused before delivery reports are served */
+			CHECK(!chunks_released(kafka));
+
+			CHECK(wait_delivered(kafka));
+			CHECK(chunks_released(kafka));
+
+			/* The sealed buffer is in the pool, the filled one starts over */
+			CHECK(kafka->_chunks.size() == 2);
+			CHECK(kafka->_pool.size() == 1);
+			CHECK(kafka->_chunk && kafka->_chunk->used == 0);
+		}
+
+		CHECK(kafka->_stats.delivered == 24);
+		CHECK(kafka->_stats.dropped == 0);
+
+		delete kafka;
+	}
+};
+
+int main()
+{
+	KafkaTest::partition_key();
+	KafkaTest::queue_full();
+	KafkaTest::chunk_pool();
+
+	if (errors) {
+		printf("%d checks failed\n", errors);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,465 @@
+/**
+ * \file bloom_blocked.c
+ * \brief Cache-line blocked Bloom filter (source file)
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bloom_blocked.h"
+
+/** Block of the filter (must be aligned to a cache line) */
+struct bbf_block {
+	uint32_t words[BBF_BLOCK_WORDS];
+};
+
+/** Internal structure of the filter */
+struct bbf_s {
+	struct bbf_block *blocks;   /**< Array of blocks                        */
+	uint64_t block_cnt;         /**< Number of blocks                       */
+	uint64_t item_cnt;          /**< Number of (probably) unique items      */
+	uint64_t est_items;         /**< Estimated item count                   */
+	double   fp_prob;           /**< False positive probability             */
+};
+
+/** Maximal number of keys processed in one step of a batch insertion */
+#define BBF_BATCH_STEP (32U)
+
+/** Odd multipliers selecting a bit in each word of a block */
+static const uint32_t bbf_salt[BBF_BLOCK_WORDS] = {
+	0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+	0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+	0x9e3779b1U, 0x85ebca6bU, 0xc2b2ae35U, 0x27d4eb2fU,
+	0x165667b1U, 0xd3a2646dU, 0xfd7046c5U, 0xb55a4f09U
+};
+
+/**
+ * \brief Calculate a hash of a key
+ * \param[in] key Key
+ * \return 64bit hash (upper half selects a block, lower half bits)
+ */
+static inline uint64_t
+bbf_hash(const uint8_t *key)
+{
+	uint64_t a, b;
+	memcpy(&a, key, sizeof(a));
+	memcpy(&b, key + sizeof(a), sizeof(b));
+
+	uint64_t h = (a * 0x9e3779b97f4a7c15ULL) ^ (b * 0xc2b2ae3d27d4eb4fULL);
+	h ^= h >> 32;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 29;
+	return h;
+}
+
+/**
+ * \brief Get an index of a block
+ * \param[in] hash      Hash of a key
+ * \param[in] block_cnt Number of blocks (must be less than 2^32)
+ */
+static inline uint64_t
+bbf_block_idx(uint64_t hash, uint64_t block_cnt)
+{
+	return ((hash >> 32) * block_cnt) >> 32;
+}
+
+/**
+ * \brief Calculate a bit mask of a key for each word of a block
+ * \param[in]  hash Hash of a key
+ * \param[out] mask Masks
+ */
+static inline void
+bbf_mask(uint64_t hash, uint32_t mask[BBF_BLOCK_WORDS])
+{
+	const uint32_t key = (uint32_t) hash;
+	for (unsigned int i = 0; i < BBF_BLOCK_WORDS; ++i) {
+		mask[i] = 1U << ((key * bbf_salt[i]) >> 27);
+	}
+}
+
+/**
+ * \brief Test if all bits of a mask are set in a block
+ * \param[in] block Block
+ * \param[in] mask  Masks
+ */
+static inline bool
+bbf_block_check(const struct bbf_block *block,
+	const uint32_t mask[BBF_BLOCK_WORDS])
+{
+	uint32_t missing = 0;
+	for (unsigned int i = 0; i < BBF_BLOCK_WORDS; ++i) {
+		missing |= ~block->words[i] & mask[i];
+	}
+
+	return missing == 0;
+}
+
+/**
+ * \brief Expected false positive probability of a filter
+ *
+ * Number of items in a block follows a Poisson distribution. For a block with
+ * \a j items, each word has a bit set with probability 1 - (31/32)^j.
+ * \param[in] items  Number of items
+ * \param[in] blocks Number of blocks
+ */
+static double
+bbf_fpp(double items, double blocks)
+{
+	const double lambda = items / blocks;
+	const double limit = lambda + 12 * sqrt(lambda) + 32;
+	const double word_miss = 1.0 - 1.0 / 32;
+
+	double p_j = exp(-lambda);  // Probability of j items in a block
+	double result = 0;
+	for (unsigned int j = 1; j <= limit; ++j) {
+		p_j *= lambda / j;
+		result += p_j * pow(1.0 - pow(word_miss, j), BBF_BLOCK_WORDS);
+	}
+
+	return result;
+}
+
+/**
+ * \brief Calculate number of blocks for the required parameters
+ * \param[in] items Estimated number of items
+ * \param[in] prob  Required false positive probability
+ */
+static uint64_t
+bbf_block_cnt(uint64_t items, double prob)
+{
+	if (items == 0) {
+		items = 1;
+	}
+
+	// Start with the size of a classic Bloom filter and enlarge it
+	double bits = -(double) items * log(prob) / (M_LN2 * M_LN2);
+	double blocks = ceil(bits / (BBF_BLOCK_SIZE * 8));
+	if (blocks < 1) {
+		blocks = 1;
+	}
+
+	while (bbf_fpp(items, blocks) > prob) {
+		blocks = ceil(blocks * 1.02);
+	}
+
+	return (uint64_t) blocks;
+}
+
+enum BBF_ECODE
+bbf_create(bbf_t **filter, uint64_t est_items, double fp_prob)
+{
+	if (!filter || fp_prob <= 0 || fp_prob > 1) {
+		return BBF_ERR_ARG;
+	}
+
+	uint64_t block_cnt = bbf_block_cnt(est_items, fp_prob);
+	if (block_cnt >= (1ULL << 32)) {
+		return BBF_ERR_ARG;
+	}
+
+	bbf_t *res = (bbf_t *) calloc(1, sizeof(*res));
+	if (!res) {
+		return BBF_ERR_NOMEM;
+	}
+
+	void *mem;
+	if (posix_memalign(&mem, BBF_BLOCK_SIZE, block_cnt * BBF_BLOCK_SIZE)) {
+		free(res);
+		return BBF_ERR_NOMEM;
+	}
+
+	res->blocks = (struct bbf_block *) mem;
+	res->block_cnt = block_cnt;
+	res->est_items = est_items;
+	res->fp_prob = fp_prob;
+	bbf_clear(res);
+
+	*filter = res;
+	return BBF_OK;
+}
+
+void
+bbf_destroy(bbf_t *filter)
+{
+	if (!filter) {
+		return;
+	}
+
+	free(filter->blocks);
+	free(filter);
+}
+
+void
+bbf_clear(bbf_t *filter)
+{
+	memset(filter->blocks, 0, filter->block_cnt * BBF_BLOCK_SIZE);
+	filter->item_cnt = 0;
+}
+
+void
+bbf_add_batch(bbf_t *filter, const uint8_t (*keys)[BBF_KEY_SIZE], size_t cnt)
+{
+	uint64_t hash[BBF_BATCH_STEP];
+	struct bbf_block *blocks[BBF_BATCH_STEP];
+
+	while (cnt > 0) {
+		const size_t step = (cnt < BBF_BATCH_STEP) ? cnt : BBF_BATCH_STEP;
+
+		// Calculate hashes and prefetch blocks
+		for (size_t i = 0; i < step; ++i) {
+			hash[i] = bbf_hash(keys[i]);
+			blocks[i] = &filter->blocks[bbf_block_idx(hash[i],
+				filter->block_cnt)];
+			__builtin_prefetch(blocks[i], 1);
+		}
+
+		// Set bits
+		for (size_t i = 0; i < step; ++i) {
+			uint32_t mask[BBF_BLOCK_WORDS];
+			bbf_mask(hash[i], mask);
+
+			struct bbf_block *block = blocks[i];
+			if (bbf_block_check(block, mask)) {
+				// Already present (or a false positive)
+				continue;
+			}
+
+			for (unsigned int w = 0; w < BBF_BLOCK_WORDS; ++w) {
+				block->words[w] |= mask[w];
+			}
+			filter->item_cnt++;
+		}
+
+		keys += step;
+		cnt -= step;
+	}
+}
+
+bool
+bbf_query(const bbf_t *filter, const uint8_t *key)
+{
+	uint32_t mask[BBF_BLOCK_WORDS];
+	const uint64_t hash = bbf_hash(key);
+
+	bbf_mask(hash, mask);
+	return bbf_block_check(&filter->blocks[bbf_block_idx(hash,
+		filter->block_cnt)], mask);
+}
+
+uint64_t
+bbf_item_cnt(const bbf_t *filter)
+{
+	return filter->item_cnt;
+}
+
+/**
+ * \brief Write a whole buffer to a file
+ * \param[in] fd   File descriptor
+ * \param[in] data Buffer
+ * \param[in] size Size of the buffer
+ * \return On success returns 0. Otherwise returns a non-zero value.
+ */
+static int
+bbf_write_all(int fd, const void *data, size_t size)
+{
+	const uint8_t *ptr = (const uint8_t *) data;
+
+	while (size > 0) {
+		ssize_t ret = write(fd, ptr, size);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+
+		ptr += ret;
+		size -= (size_t) ret;
+	}
+
+	return 0;
+}
+
+enum BBF_ECODE
+bbf_store(const bbf_t *filter, const char *filename)
+{
+	struct bbf_file_hdr hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BBF_FILE_MAGIC, sizeof(hdr.magic));
+	hdr.version = BBF_FILE_VERSION;
+	hdr.block_size = BBF_BLOCK_SIZE;
+	hdr.block_cnt = filter->block_cnt;
+	hdr.item_cnt = filter->item_cnt;
+	hdr.est_items = filter->est_items;
+	hdr.fp_prob = filter->fp_prob;
+
+	const size_t tmp_len = strlen(filename) + 8;
+	char *tmp_name = (char *) malloc(tmp_len);
+	if (!tmp_name) {
+		return BBF_ERR_NOMEM;
+	}
+	snprintf(tmp_name, tmp_len, "%s.XXXXXX", filename);
+
+	int fd = mkstemp(tmp_name);
+	if (fd < 0) {
+		free(tmp_name);
+		return BBF_ERR_IO;
+	}
+
+	int failed = bbf_write_all(fd, &hdr, sizeof(hdr))
+		|| bbf_write_all(fd, filter->blocks, filter->block_cnt * BBF_BLOCK_SIZE)
+		|| fchmod(fd, 0644);
+	int err = errno;
+	if (close(fd) != 0 && !failed) {
+		failed = 1;
+		err = errno;
+	}
+
+	if (failed) {
+		unlink(tmp_name);
+		free(tmp_name);
+		errno = err;
+		return BBF_ERR_IO;
+	}
+
+	if (rename(tmp_name, filename)) {
+		int err = errno;
+		unlink(tmp_name);
+		free(tmp_name);
+		errno = err;
+		return BBF_ERR_IO;
+	}
+
+	free(tmp_name);
+	return BBF_OK;
+}
+
+/**
+ * \brief Read a whole buffer from a file at a given offset
+ * \param[in]  fd     File descriptor
+ * \param[out] data   Buffer
+ * \param[in]  size   Size of the buffer
+ * \param[in]  offset Offset in the file
+ * \return BBF_OK or an error code
+ */
+static enum BBF_ECODE
+bbf_read_all(int fd, void *data, size_t size, off_t offset)
+{
+	uint8_t *ptr = (uint8_t *) data;
+
+	while (size > 0) {
+		ssize_t ret = pread(fd, ptr, size, offset);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return BBF_ERR_IO;
+		}
+
+		if (ret == 0) {
+			// Unexpected end of file
+			return BBF_ERR_FORMAT;
+		}
+
+		ptr += ret;
+		size -= (size_t) ret;
+		offset += ret;
+	}
+
+	return BBF_OK;
+}
+
+enum BBF_ECODE
+bbf_file_header(int fd, struct bbf_file_hdr *hdr)
+{
+	enum BBF_ECODE ret = bbf_read_all(fd, hdr, sizeof(*hdr), 0);
+	if (ret != BBF_OK) {
+		return ret;
+	}
+
+	if (memcmp(hdr->magic, BBF_FILE_MAGIC, sizeof(hdr->magic)) != 0
+			|| hdr->version != BBF_FILE_VERSION
+			|| hdr->block_size != BBF_BLOCK_SIZE
+			|| hdr->block_cnt == 0 || hdr->block_cnt >= (1ULL << 32)) {
+		return BBF_ERR_FORMAT;
+	}
+
+	return BBF_OK;
+}
+
+enum BBF_ECODE
+bbf_file_probe(int fd, const struct bbf_file_hdr *hdr, const uint8_t *key,
+	bool *present)
+{
+	struct bbf_block block;
+	uint32_t mask[BBF_BLOCK_WORDS];
+	const uint64_t hash = bbf_hash(key);
+	const off_t offset = sizeof(*hdr)
+		+ bbf_block_idx(hash, hdr->block_cnt) * BBF_BLOCK_SIZE;
+
+	enum BBF_ECODE ret = bbf_read_all(fd, &block, sizeof(block), offset);
+	if (ret != BBF_OK) {
+		return ret;
+	}
+
+	bbf_mask(hash, mask);
+	*present = bbf_block_check(&block, mask);
+	return BBF_OK;
+}
+
+const char *
+bbf_strerror(enum BBF_ECODE code)
+{
+	switch (code) {
+	case BBF_OK:
+		return "Success";
+	case BBF_ERR_ARG:
+		return "Invalid parameters of the blocked Bloom filter";
+	case BBF_ERR_NOMEM:
+		return "Memory allocation failed";
+	case BBF_ERR_IO:
+		return strerror(errno);
+	case BBF_ERR_FORMAT:
+		return "Not a blocked Bloom filter index file";
+	}
+
+	return "Unknown error";
+}
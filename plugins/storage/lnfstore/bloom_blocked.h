@@ -0,0 +1,204 @@
+/**
+ * \file bloom_blocked.h
+ * \brief Cache-line blocked Bloom filter (header file)
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef BLOOM_BLOCKED_H
+#define BLOOM_BLOCKED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \defgroup bbf Blocked Bloom filter
+ *
+ * The filter is split into blocks of the size of one cache line (64 bytes).
+ * The first part of a key hash selects a block and the second part sets
+ * exactly one bit in each of sixteen 32bit words of the block. Therefore,
+ * an insertion or a lookup touches only one cache line and calculation of
+ * the bit mask is a fixed-length loop without branches that compilers are able
+ * to vectorize.
+ *
+ * The file representation consists of a header (struct bbf_file_hdr) followed
+ * by an array of blocks. A block of a key can be loaded from the file directly
+ * without reading the whole filter (see bbf_file_probe()).
+ * @{
+ */
+
+/** Size of a key (IPv4 addresses are stored as IPv4-mapped, see libnf) */
+#define BBF_KEY_SIZE    (16U)
+/** Size of one block in bytes (one cache line)                         */
+#define BBF_BLOCK_SIZE  (64U)
+/** Number of 32bit words in a block (= number of bits set per key)     */
+#define BBF_BLOCK_WORDS (BBF_BLOCK_SIZE / sizeof(uint32_t))
+
+/** Identification of a file with the blocked Bloom filter              */
+#define BBF_FILE_MAGIC   "LNFBBF\0\0"
+/** Version of the file format                                          */
+#define BBF_FILE_VERSION (1U)
+
+/** Return codes */
+enum BBF_ECODE {
+	BBF_OK = 0,       /**< Success                                        */
+	BBF_ERR_ARG,      /**< Invalid arguments                              */
+	BBF_ERR_NOMEM,    /**< Memory allocation failed                       */
+	BBF_ERR_IO,       /**< Failed to read or write a file (see errno)     */
+	BBF_ERR_FORMAT    /**< The file is not a blocked Bloom filter index   */
+};
+
+/**
+ * \brief Header of an index file
+ * \note All values are stored in the byte order of the host
+ */
+struct bbf_file_hdr {
+	char     magic[8];    /**< File identification (BBF_FILE_MAGIC)        */
+	uint32_t version;     /**< File format version (BBF_FILE_VERSION)      */
+	uint32_t block_size;  /**< Size of a block (BBF_BLOCK_SIZE)            */
+	uint64_t block_cnt;   /**< Number of blocks                            */
+	uint64_t item_cnt;    /**< Number of (probably) unique inserted items  */
+	uint64_t est_items;   /**< Estimated item count used for sizing        */
+	double   fp_prob;     /**< False positive probability used for sizing  */
+	uint8_t  reserved[16];/**< Reserved (zeroes)                           */
+};
+
+/** Internal type */
+typedef struct bbf_s bbf_t;
+
+/**
+ * \brief Create a new empty filter
+ *
+ * Number of blocks is calculated so that the expected false positive
+ * probability of the filter with \p est_items items is at most \p fp_prob.
+ * \param[out] filter    Pointer to the new filter
+ * \param[in]  est_items Estimated item count
+ * \param[in]  fp_prob   False positive probability (0 < fp_prob <= 1)
+ * \return BBF_OK or an error code
+ */
+enum BBF_ECODE
+bbf_create(bbf_t **filter, uint64_t est_items, double fp_prob);
+
+/**
+ * \brief Destroy a filter
+ * \param[in] filter Filter (can be NULL)
+ */
+void
+bbf_destroy(bbf_t *filter);
+
+/**
+ * \brief Remove all items from a filter
+ * \param[in,out] filter Filter
+ */
+void
+bbf_clear(bbf_t *filter);
+
+/**
+ * \brief Insert multiple keys into a filter
+ *
+ * Hashes of all keys are calculated first and blocks are prefetched before
+ * they are modified, so memory latency of the insertions overlaps.
+ * \param[in,out] filter Filter
+ * \param[in]     keys   Array of keys
+ * \param[in]     cnt    Number of keys
+ */
+void
+bbf_add_batch(bbf_t *filter, const uint8_t (*keys)[BBF_KEY_SIZE], size_t cnt);
+
+/**
+ * \brief Test presence of a key
+ * \param[in] filter Filter
+ * \param[in] key    Key
+ * \return False if the key is definitely not present. Otherwise true.
+ */
+bool
+bbf_query(const bbf_t *filter, const uint8_t *key);
+
+/**
+ * \brief Get number of (probably) unique items in a filter
+ *
+ * An item is counted when its insertion set at least one new bit.
+ * \param[in] filter Filter
+ */
+uint64_t
+bbf_item_cnt(const bbf_t *filter);
+
+/**
+ * \brief Store a filter to a file
+ *
+ * The filter is written into a temporary file in the same directory which
+ * is renamed to \p filename afterwards, so readers never see a partially
+ * written index.
+ * \param[in] filter   Filter
+ * \param[in] filename Output file
+ * \return BBF_OK or an error code (errno is preserved on BBF_ERR_IO)
+ */
+enum BBF_ECODE
+bbf_store(const bbf_t *filter, const char *filename);
+
+/**
+ * \brief Read and check a header of an index file
+ * \param[in]  fd  File descriptor
+ * \param[out] hdr Header
+ * \return BBF_OK or an error code
+ */
+enum BBF_ECODE
+bbf_file_header(int fd, struct bbf_file_hdr *hdr);
+
+/**
+ * \brief Test presence of a key in an index file
+ *
+ * Only the block of the key is read from the file.
+ * \param[in] fd  File descriptor
+ * \param[in] hdr Header of the file (see bbf_file_header())
+ * \param[in] key Key
+ * \param[out] present False if the key is definitely not present.
+ *   Otherwise true.
+ * \return BBF_OK or an error code
+ */
+enum BBF_ECODE
+bbf_file_probe(int fd, const struct bbf_file_hdr *hdr, const uint8_t *key,
+	bool *present);
+
+/**
+ * \brief Get a description of an error code
+ * \param[in] code Error code
+ */
+const char *
+bbf_strerror(enum BBF_ECODE code);
+
+/**@}*/
+
+#endif // BLOOM_BLOCKED_H
@@ -253,6 +253,25 @@ configuration_match_idx(xmlDocPtr doc, xmlNodePtr cur, struct conf_params *cfg)
 		return 0;
 	}
 
+	if (!xmlStrcasecmp(cur->name, (const xmlChar*) "type")) {
+		// Type of the index
+		xmlChar *result = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
+		int ret_code = 0;
+
+		if (result && !xmlStrcasecmp(result, (const xmlChar *) "classic")) {
+			cfg->file_index.type = IDX_MGR_T_CLASSIC;
+		} else if (result && !xmlStrcasecmp(result, (const xmlChar *) "blocked")) {
+			cfg->file_index.type = IDX_MGR_T_BLOCKED;
+		} else {
+			MSG_ERROR(msg_module, "Configuration error - invalid value of "
+				"<type> (expected classic/blocked).");
+			ret_code = 1;
+		}
+
+		xmlFree(result);
+		return ret_code;
+	}
+
 	if (!xmlStrcasecmp(cur->name, (const xmlChar*) "autosize")) {
 		// Enable/disable autosize
 		int result = xml_cmp_bool(doc, cur);
@@ -523,6 +542,7 @@ configuration_set_defaults(struct conf_params *cnf)
 
 	// Index file
 	cnf->file_index.en = false;
+	cnf->file_index.type = IDX_MGR_T_CLASSIC;
 	cnf->file_index.autosize = true;
 	cnf->file_index.est_cnt = BF_DEFAULT_ITEM_CNT_EST;
 	cnf->file_index.fp_prob = BF_DEFAULT_FP_PROB;
@@ -41,6 +41,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "idx_manager.h"
 
 /**
  * \brief Structure for configuration parsed from XML
@@ -72,6 +73,7 @@ struct conf_params {
 		bool  en;          /**< Enable/disable indexing. When disabled, other
                              *  parameters in this structure are undefined. */
 		char *prefix;      /**< File prefix                                  */
+		enum IDX_MGR_TYPE type; /**< Type of the index                       */
 		bool  autosize;    /**< Enable autosize                              */
 
 		uint64_t est_cnt;  /**< Estimated item count in the filter           */
@@ -44,6 +44,7 @@
 #include <time.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include "idx_manager.h"
 
 typedef struct files_mgr_s files_mgr_t;
 
@@ -90,6 +91,7 @@ struct files_mgr_paths {
  * \brief Structure for Bloom filter index parameters
  */
 struct files_mgr_idx_param {
+	enum IDX_MGR_TYPE type; /**< Type of the index */
 	double   prob;       /**< False positive probability */
 	uint64_t item_cnt;   /**< Projected element count (i.e. IP address count) */
 	bool     autosize;   /**< Enable automatic recalculation of parameters
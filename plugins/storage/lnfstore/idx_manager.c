@@ -42,7 +42,10 @@
 #include <bf_index.h>
 #include <ipfixcol.h>
 #include <assert.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include "bloom_blocked.h"
 #include "idx_manager.h"
 
 #include <string.h> // strdup
@@ -71,6 +74,9 @@ extern const char* msg_module;
 #define BF_LOWER_TOLERANCE(val, coeff) \
 	((unsigned long)(val * (1 + coeff * ((coeff > 1.2) ? 1.3 : 0.5) )))
 
+/** Number of addresses collected before insertion into an index */
+#define IDX_MGR_BATCH_SIZE (64U)
+
 /** \brief State of the manager */
 enum IDX_MGR_STATE {
 	IDX_MGR_S_INIT,            /**< Before creating of the first window       */
@@ -85,10 +91,43 @@ enum IDX_MGR_STATE {
 	IDX_MGR_S_ERROR            /**< An index or output file is not ready.     */
 };
 
+/** \brief Bloom filter index of one window */
+struct idx_index {
+	enum IDX_MGR_TYPE type;     /**< Type of the index                        */
+	bfi_index_ptr_t classic;    /**< Classic index (IDX_MGR_T_CLASSIC)        */
+	bbf_t *blocked;             /**< Blocked index (IDX_MGR_T_BLOCKED)        */
+};
+
+/** \brief Index of a finished window waiting for the background writer */
+struct idx_save_job {
+	struct idx_index index;     /**< Index to save (owned by the job)         */
+	char *filename;             /**< Output file                              */
+	struct idx_save_job *next;  /**< Next job in the queue                    */
+};
+
+/** \brief Background writer of finished indexes */
+struct idx_saver {
+	pthread_t thread;           /**< Writer thread                            */
+	bool running;               /**< The thread has been started              */
+	bool stop;                  /**< Request to terminate the thread          */
+
+	pthread_mutex_t mutex;      /**< Mutex protecting the queue               */
+	pthread_cond_t cond;        /**< Signalled when a job is added            */
+	struct idx_save_job *head;  /**< First job in the queue                   */
+	struct idx_save_job *tail;  /**< Last job in the queue                    */
+};
+
 /** \brief Internal structure of the manager */
 struct idx_mgr_s {
-	bfi_index_ptr_t idx_ptr;    /**< Instance of a Bloom filter index         */
+	struct idx_index index; /**< Bloom filter index of current window         */
 	char *idx_filename;     /**< Filename of current index file               */
+	uint64_t last_cnt;      /**< Item count of the last saved window          */
+
+	struct {
+		uint8_t keys[IDX_MGR_BATCH_SIZE][IDX_MGR_KEY_MAX]; /**< Addresses     */
+		uint8_t lens[IDX_MGR_BATCH_SIZE]; /**< Lengths of the addresses       */
+		unsigned int cnt;                 /**< Number of collected addresses  */
+	} batch;                /**< Addresses waiting for insertion              */
 
 	struct {
 		uint64_t est_items; /**< Estimated item count in a Bloom filter       */
@@ -99,11 +138,214 @@ struct idx_mgr_s {
 		bool  en_autosize;        /**< Enable auto-size (on/off)              */
 		enum IDX_MGR_STATE state; /**< State of the manager                   */
 	} cfg_mgr;             /**< Configuration of the manager                  */
+
+	struct idx_saver saver; /**< Background writer                            */
 };
 
+/**
+ * \brief Check if an index exists
+ * \param[in] index Index
+ */
+static inline bool
+idx_index_exists(const struct idx_index *index)
+{
+	return (index->type == IDX_MGR_T_CLASSIC)
+		? index->classic != NULL
+		: index->blocked != NULL;
+}
+
+/**
+ * \brief Destroy an index
+ * \param[in,out] index Index
+ */
+static void
+idx_index_destroy(struct idx_index *index)
+{
+	if (index->classic) {
+		bfi_destroy_index(&(index->classic));
+		index->classic = NULL;
+	}
+
+	bbf_destroy(index->blocked);
+	index->blocked = NULL;
+}
+
+/**
+ * \brief Store an index to a file
+ * \param[in] index    Index
+ * \param[in] filename Output file
+ * \return On success returns 0. Otherwise returns a non-zero value.
+ */
+static int
+idx_index_store(const struct idx_index *index, const char *filename)
+{
+	if (index->type == IDX_MGR_T_CLASSIC) {
+		bfi_ecode_t ret = bfi_store_index(index->classic, (char *) filename);
+		if (ret != BFI_E_OK) {
+			MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+			return 1;
+		}
+	} else {
+		enum BBF_ECODE ret = bbf_store(index->blocked, filename);
+		if (ret != BBF_OK) {
+			MSG_ERROR(msg_module, "Failed to store index '%s' (%s).",
+				filename, bbf_strerror(ret));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Number of unique items in an index
+ * \param[in] index Index
+ */
+static uint64_t
+idx_index_item_cnt(const struct idx_index *index)
+{
+	return (index->type == IDX_MGR_T_CLASSIC)
+		? bfi_stored_item_cnt(index->classic)
+		: bbf_item_cnt(index->blocked);
+}
+
+/**
+ * \brief Main function of the background writer
+ *
+ * Store and destroy queued indexes until the termination is requested and
+ * the queue is empty.
+ * \param[in,out] arg Pointer to the writer (struct idx_saver)
+ */
+static void *
+idx_saver_thread(void *arg)
+{
+	struct idx_saver *saver = (struct idx_saver *) arg;
+
+	pthread_mutex_lock(&saver->mutex);
+	while (true) {
+		while (!saver->head && !saver->stop) {
+			pthread_cond_wait(&saver->cond, &saver->mutex);
+		}
+
+		struct idx_save_job *job = saver->head;
+		if (!job) {
+			// Termination requested and nothing to do
+			break;
+		}
+
+		saver->head = job->next;
+		if (!saver->head) {
+			saver->tail = NULL;
+		}
+		pthread_mutex_unlock(&saver->mutex);
+
+		if (idx_index_store(&job->index, job->filename) == 0) {
+			MSG_DEBUG(msg_module, "Index manager - index '%s' saved.",
+				job->filename);
+		} else {
+			MSG_WARNING(msg_module, "Index manager error (failed to save "
+				"index '%s' - the window wont be indexed).", job->filename);
+		}
+
+		idx_index_destroy(&job->index);
+		free(job->filename);
+		free(job);
+
+		pthread_mutex_lock(&saver->mutex);
+	}
+	pthread_mutex_unlock(&saver->mutex);
+
+	return NULL;
+}
+
+/**
+ * \brief Start the background writer
+ * \note On failure, indexes are saved by the storage thread.
+ * \param[in,out] saver Writer
+ */
+static void
+idx_saver_start(struct idx_saver *saver)
+{
+	pthread_mutex_init(&saver->mutex, NULL);
+	pthread_cond_init(&saver->cond, NULL);
+
+	int ret = pthread_create(&saver->thread, NULL, &idx_saver_thread, saver);
+	if (ret != 0) {
+		MSG_WARNING(msg_module, "Index manager - failed to start background "
+			"index writer (%s), indexes will be saved synchronously.",
+			strerror(ret));
+		return;
+	}
+
+	saver->running = true;
+}
+
+/**
+ * \brief Stop the background writer
+ *
+ * Wait until all queued indexes are stored and terminate the thread.
+ * \param[in,out] saver Writer
+ */
+static void
+idx_saver_stop(struct idx_saver *saver)
+{
+	if (saver->running) {
+		pthread_mutex_lock(&saver->mutex);
+		saver->stop = true;
+		pthread_cond_signal(&saver->cond);
+		pthread_mutex_unlock(&saver->mutex);
+
+		pthread_join(saver->thread, NULL);
+		saver->running = false;
+	}
+
+	pthread_cond_destroy(&saver->cond);
+	pthread_mutex_destroy(&saver->mutex);
+}
+
+/**
+ * \brief Pass an index to the background writer
+ * \param[in,out] saver    Writer
+ * \param[in]     index    Index (the writer takes the ownership)
+ * \param[in]     filename Output file (the writer takes the ownership)
+ * \return On success returns 0. Otherwise (the writer is not running or
+ *   memory allocation failed) returns a non-zero value and the ownership
+ *   is not transferred.
+ */
+static int
+idx_saver_push(struct idx_saver *saver, const struct idx_index *index,
+	char *filename)
+{
+	if (!saver->running) {
+		return 1;
+	}
+
+	struct idx_save_job *job = calloc(1, sizeof(*job));
+	if (!job) {
+		MSG_ERROR(msg_module, "Unable to allocate memory (%s:%d)",
+			__FILE__, __LINE__);
+		return 1;
+	}
+
+	job->index = *index;
+	job->filename = filename;
+
+	pthread_mutex_lock(&saver->mutex);
+	if (saver->tail) {
+		saver->tail->next = job;
+	} else {
+		saver->head = job;
+	}
+	saver->tail = job;
+	pthread_cond_signal(&saver->cond);
+	pthread_mutex_unlock(&saver->mutex);
+
+	return 0;
+}
 
 idx_mgr_t *
-idx_mgr_create(double prob, uint64_t item_cnt, bool autosize)
+idx_mgr_create(enum IDX_MGR_TYPE type, double prob, uint64_t item_cnt,
+	bool autosize)
 {
 	// Check parameters
 	if (prob < FPP_MIN || prob > FPP_MAX) {
@@ -122,11 +364,13 @@ idx_mgr_create(double prob, uint64_t item_cnt, bool autosize)
 	}
 
 	// Save parameters
+	mgr->index.type = type;
 	mgr->cfg_bloom.est_items = item_cnt;
 	mgr->cfg_bloom.fp_prob = prob;
 	mgr->cfg_mgr.en_autosize = autosize;
 	mgr->cfg_mgr.state = IDX_MGR_S_INIT;
 
+	idx_saver_start(&mgr->saver);
 	return mgr;
 }
 
@@ -138,9 +382,8 @@ idx_mgr_destroy(idx_mgr_t *mgr)
 	}
 
 	idx_mgr_save_index(mgr);
-	if (mgr->idx_ptr) {
-		bfi_destroy_index(&(mgr->idx_ptr));
-	}
+	idx_saver_stop(&mgr->saver);
+	idx_index_destroy(&mgr->index);
 
 	free(mgr->idx_filename);
 	free(mgr);
@@ -168,24 +411,68 @@ idx_mgr_unset_curr_file(idx_mgr_t *mgr)
 	mgr->idx_filename = NULL;
 }
 
-int
-idx_mgr_save_index(const idx_mgr_t *mgr)
+/**
+ * \brief Insert collected addresses into the index
+ * \param[in,out] mgr Pointer to an index manager
+ * \return On success returns 0. Otherwise returns a non-zero value.
+ */
+static int
+idx_mgr_batch_flush(idx_mgr_t *mgr)
 {
-	bfi_ecode_t ret;
+	const unsigned int cnt = mgr->batch.cnt;
+	mgr->batch.cnt = 0;
+
+	if (cnt == 0) {
+		return 0;
+	}
+
+	if (mgr->index.type == IDX_MGR_T_BLOCKED) {
+		bbf_add_batch(mgr->index.blocked,
+			(const uint8_t (*)[BBF_KEY_SIZE]) mgr->batch.keys, cnt);
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < cnt; ++i) {
+		bfi_ecode_t ret = bfi_add_addr_index(mgr->index.classic,
+			mgr->batch.keys[i], mgr->batch.lens[i]);
+		if (ret != BFI_E_OK){
+			MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+			return 1;
+		}
+	}
+
+	return 0;
+}
 
+int
+idx_mgr_save_index(idx_mgr_t *mgr)
+{
 	if (mgr->cfg_mgr.state != IDX_MGR_S_WINDOW_FULL &&
 			mgr->cfg_mgr.state != IDX_MGR_S_WINDOW_FIRST_PARTIAL) {
 		// Index file is broken or doesn't exist, don't save.
 		return 0;
 	}
 
-	ret = bfi_store_index(mgr->idx_ptr, mgr->idx_filename);
-	if (ret != BFI_E_OK) {
-		MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+	if (!idx_index_exists(&mgr->index) || !mgr->idx_filename) {
+		// Already saved
+		return 0;
+	}
+
+	if (idx_mgr_batch_flush(mgr) != 0) {
 		return 1;
 	}
 
-	return 0;
+	mgr->last_cnt = idx_index_item_cnt(&mgr->index);
+
+	// Hand over the index to the background writer
+	if (idx_saver_push(&mgr->saver, &mgr->index, mgr->idx_filename) == 0) {
+		mgr->index.classic = NULL;
+		mgr->index.blocked = NULL;
+		mgr->idx_filename = NULL;
+		return 0;
+	}
+
+	return idx_index_store(&mgr->index, mgr->idx_filename);
 }
 
 /**
@@ -199,22 +486,51 @@ idx_mgr_save_index(const idx_mgr_t *mgr)
 static int
 idx_mgr_index_prepare(idx_mgr_t *mgr)
 {
-	bfi_ecode_t ret;
+	// Destroy previous instance
+	idx_index_destroy(&mgr->index);
+
+	if (mgr->index.type == IDX_MGR_T_BLOCKED) {
+		enum BBF_ECODE ret = bbf_create(&mgr->index.blocked,
+			mgr->cfg_bloom.est_items, mgr->cfg_bloom.fp_prob);
+		if (ret != BBF_OK) {
+			MSG_ERROR(msg_module, "Failed to create index (%s).",
+				bbf_strerror(ret));
+			return 1;
+		}
 
-	if (mgr->idx_ptr != NULL) {
-		// Destroy previous instance
-		bfi_destroy_index(&(mgr->idx_ptr));
+		return 0;
 	}
 
 	bfi_index_ptr_t new_index;
-	ret = bfi_init_index(&new_index, mgr->cfg_bloom.est_items,
+	bfi_ecode_t ret = bfi_init_index(&new_index, mgr->cfg_bloom.est_items,
 							mgr->cfg_bloom.fp_prob);
 	if (ret != BFI_E_OK) {
 		MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
 		return 1;
 	}
 
-	mgr->idx_ptr = new_index;
+	mgr->index.classic = new_index;
+	return 0;
+}
+
+/**
+ * \brief Clear the Bloom filter index
+ * \param[in,out] mgr Pointer to an index manager
+ * \return On success returns 0. Otherwise returns a non-zero value.
+ */
+static int
+idx_mgr_index_clear(idx_mgr_t *mgr)
+{
+	if (mgr->index.type == IDX_MGR_T_BLOCKED) {
+		bbf_clear(mgr->index.blocked);
+		return 0;
+	}
+
+	bfi_ecode_t ret = bfi_clear_index(mgr->index.classic);
+	if (ret != BFI_E_OK){
+		MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+		return 1;
+	}
 
 	return 0;
 }
@@ -223,9 +539,10 @@ int
 idx_mgr_window_new(idx_mgr_t *mgr, char *index_filename)
 {
 	bool reinit = false;
-	bfi_ecode_t ret;
+	bool exists = idx_index_exists(&mgr->index);
 
 	idx_mgr_unset_curr_file(mgr);
+	mgr->batch.cnt = 0;
 
 	// Check indexing state
 	if (mgr->cfg_mgr.state == IDX_MGR_S_INIT ||
@@ -238,7 +555,9 @@ idx_mgr_window_new(idx_mgr_t *mgr, char *index_filename)
 		 * Calculate minimal & maximal expected estimate (item count in Bloom
 		 * filter index) based on number of elements in the current window.
 		 */
-		uint64_t act_cnt = bfi_stored_item_cnt(mgr->idx_ptr);
+		uint64_t act_cnt = (exists)
+			? idx_index_item_cnt(&mgr->index)
+			: mgr->last_cnt;
 		double coeff = BF_TOL_COEFF(act_cnt);
 
 		double est_low = BF_LOWER_TOLERANCE(act_cnt, coeff);
@@ -262,8 +581,9 @@ idx_mgr_window_new(idx_mgr_t *mgr, char *index_filename)
 	}
 
 	// Prepare index
-	if (reinit) {
-		// Destroy & create a new index (new parameters)
+	if (reinit || !exists) {
+		// Destroy & create a new index (new parameters or the previous one
+		// has been passed to the background writer)
 		if (idx_mgr_index_prepare(mgr) != 0) {
 			// Something went wrong
 			idx_mgr_invalidate(mgr);
@@ -271,9 +591,7 @@ idx_mgr_window_new(idx_mgr_t *mgr, char *index_filename)
 		}
 	} else {
 		// Only clear the current index (parameters are the same)
-		ret = bfi_clear_index(mgr->idx_ptr);
-		if (ret != BFI_E_OK){
-			MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+		if (idx_mgr_index_clear(mgr) != 0) {
 			idx_mgr_invalidate(mgr);
 			return 1;
 		}
@@ -314,25 +632,36 @@ void
 idx_mgr_invalidate(idx_mgr_t *mgr)
 {
 	mgr->cfg_mgr.state = IDX_MGR_S_ERROR;
+	mgr->batch.cnt = 0;
 }
 
 int
 idx_mgr_add(idx_mgr_t *mgr, const unsigned char *buffer, const size_t len)
 {
-	bfi_ecode_t ret;
-
 	if (mgr->cfg_mgr.state != IDX_MGR_S_WINDOW_FULL &&
 			mgr->cfg_mgr.state != IDX_MGR_S_WINDOW_FIRST_PARTIAL) {
 		return 1;
 	}
 
-	ret = bfi_add_addr_index(mgr->idx_ptr, buffer, len);
-	if (ret != BFI_E_OK){
-		MSG_ERROR(msg_module, "%s", bfi_get_error_msg(ret));
+	if (len > IDX_MGR_KEY_MAX) {
+		MSG_ERROR(msg_module, "Index manager error (unsupported length of "
+			"an address: %zu).", len);
+		return 1;
+	}
+
+	const unsigned int idx = mgr->batch.cnt++;
+	memcpy(mgr->batch.keys[idx], buffer, len);
+	memset(mgr->batch.keys[idx] + len, 0, IDX_MGR_KEY_MAX - len);
+	mgr->batch.lens[idx] = (uint8_t) len;
+
+	if (mgr->batch.cnt < IDX_MGR_BATCH_SIZE) {
+		return 0;
+	}
+
+	if (idx_mgr_batch_flush(mgr) != 0) {
 		idx_mgr_invalidate(mgr);
 		return 1;
 	}
 
 	return 0;
 }
-
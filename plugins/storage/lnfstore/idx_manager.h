@@ -42,6 +42,7 @@
 #define IDX_MANAGER_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /** Minimal false positive probability */
@@ -49,6 +50,16 @@
 /** Maximal false positive probability */
 #define FPP_MAX (1)
 
+/** Maximal length of a key (an IP address) accepted by idx_mgr_add() */
+#define IDX_MGR_KEY_MAX (16U)
+
+/** \brief Type of the Bloom filter index */
+enum IDX_MGR_TYPE {
+	IDX_MGR_T_CLASSIC,  /**< Classic Bloom filter (bfindex library format)  */
+	IDX_MGR_T_BLOCKED   /**< Cache-line blocked Bloom filter (see
+	                      *  bloom_blocked.h)                              */
+};
+
 // Internal type
 typedef struct idx_mgr_s idx_mgr_t;
 
@@ -57,8 +68,10 @@ typedef struct idx_mgr_s idx_mgr_t;
  *
  * \note
  *   Bloom filter index for current window is created in a memory. An output
- *   file for the index is opened and used in the saving phase.
+ *   file for the index is opened and used in the saving phase. Indexes of
+ *   finished windows are written by a background thread.
  *
+ * \param[in] type     Type of the index
  * \param[in] prob     False positive probability
  * \param[in] item_cnt Projected element count (i.e. IP address count)
  * \param[in] autosize Enable automatic recalculation of parameters based on
@@ -69,12 +82,14 @@ typedef struct idx_mgr_s idx_mgr_t;
  *   NULL.
  */
 idx_mgr_t *
-idx_mgr_create(double prob, uint64_t item_cnt, bool autosize);
+idx_mgr_create(enum IDX_MGR_TYPE type, double prob, uint64_t item_cnt,
+	bool autosize);
 
 /**
  * \brief Destroy a manager
  *
  * If an output file exits, content of the index will be stored to the file.
+ * The function waits until all pending indexes are written.
  * \param[in,out] index Pointer to the manager
  */
 void
@@ -105,13 +120,17 @@ idx_mgr_unset_curr_file(idx_mgr_t *mgr);
 /**
  * \brief Store/flush an Bloom filter index to an output file
  *
+ * The index of the current window is passed to a background thread which
+ * writes it to the output file and destroys it. If the thread is not
+ * available, the index is written immediately. A new index is prepared by
+ * idx_mgr_window_new().
  * \param[in] mgr Pointer to a manager
- * \return If save was successful or should not be done because of indexing
- *   state (i.e. "nothing to save" in the error or initial state" 0 is returned.
- *   Otherwise returns a non-zero value.
+ * \return If save was successful (or scheduled) or should not be done because
+ *   of indexing state (i.e. "nothing to save" in the error or initial state"
+ *   0 is returned. Otherwise returns a non-zero value.
  */
 int
-idx_mgr_save_index(const idx_mgr_t *mgr);
+idx_mgr_save_index(idx_mgr_t *mgr);
 
 /**
  * \brief Create a new window
@@ -145,9 +164,12 @@ idx_mgr_invalidate(idx_mgr_t *mgr);
 
 /**
  * \brief Add an IP address to an index
+ *
+ * Addresses are collected into a batch which is inserted at once when it is
+ * full or when the index is saved.
  * \param[in,out] index Pointer to a manager
  * \param[in] buffer Pointer to the address stored in a buffer
- * \param[in] len    Length of the buffer
+ * \param[in] len    Length of the buffer (max. IDX_MGR_KEY_MAX)
  * \return On success returns 0. Otherwise (an index window is not ready)
  *   returns non-zero value.
  */
@@ -0,0 +1,397 @@
+/**
+ * \file idx_query.c
+ * \brief Parallel lookup of IP addresses in blocked Bloom filter indexes
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bloom_blocked.h"
+
+/** Default prefix of index files */
+#define QUERY_DEF_PREFIX "bfi."
+/** Maximal number of threads */
+#define QUERY_MAX_THREADS (256)
+
+/** \brief Searched address */
+struct query_addr {
+	const char *str;              /**< Address as given by the user */
+	uint8_t key[BBF_KEY_SIZE];    /**< Address in the format of lnfstore */
+};
+
+/** \brief Index file and the result of the lookup */
+struct query_file {
+	char *path;                   /**< Path to the file                     */
+	bool *match;                  /**< Result for each address              */
+	bool error;                   /**< Failed to read the file              */
+};
+
+/** \brief Shared state of the lookup */
+static struct {
+	const char *prefix;           /**< Prefix of index files                */
+	bool verbose;                 /**< Report skipped files                 */
+
+	struct query_addr *addrs;     /**< Searched addresses                   */
+	size_t addr_cnt;              /**< Number of addresses                  */
+
+	struct query_file *files;     /**< Index files                          */
+	size_t file_cnt;              /**< Number of files                      */
+	size_t file_alloc;            /**< Number of allocated files            */
+	size_t file_next;             /**< Next file to process (atomic)        */
+} query;
+
+/**
+ * \brief Print usage
+ * \param[in] name Name of the program
+ */
+static void
+usage(const char *name)
+{
+	printf("Usage: %s [-t threads] [-p prefix] [-v] -a address [-a address "
+		"...] path...\n", name);
+	printf("Find index files of the lnfstore plugin (blocked Bloom filter "
+		"index type)\nthat may contain any of the IP addresses.\n\n");
+	printf("  -a address  IPv4 or IPv6 address to search for (repeatable)\n");
+	printf("  -t threads  Number of threads (default: number of CPUs)\n");
+	printf("  -p prefix   Prefix of index files in directories "
+		"(default: \"%s\")\n", QUERY_DEF_PREFIX);
+	printf("  -v          Report files that are not blocked indexes\n");
+	printf("  -h          Show this help\n\n");
+	printf("Directories are searched recursively. Each matching file is "
+		"printed as\n\"<address> <file>\". Exit status is 0 if any match "
+		"was found, 1 if none and\n2 on error.\n");
+}
+
+/**
+ * \brief Convert an address to the key format of lnfstore
+ *
+ * IPv4 addresses are stored in the last 4 bytes (see libnf).
+ * \param[in]  str Address
+ * \param[out] key Key
+ * \return On success returns 0. Otherwise returns a non-zero value.
+ */
+static int
+query_addr_parse(const char *str, uint8_t key[BBF_KEY_SIZE])
+{
+	memset(key, 0, BBF_KEY_SIZE);
+
+	if (inet_pton(AF_INET, str, key + BBF_KEY_SIZE - 4) == 1) {
+		return 0;
+	}
+
+	if (inet_pton(AF_INET6, str, key) == 1) {
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * \brief Add a file to the list of files to probe
+ * \param[in] path Path to the file
+ * \return On success returns 0. Otherwise returns a non-zero value.
+ */
+static int
+query_file_add(const char *path)
+{
+	if (query.file_cnt == query.file_alloc) {
+		size_t new_alloc = (query.file_alloc == 0) ? 64 : 2 * query.file_alloc;
+		struct query_file *new_files = realloc(query.files,
+			new_alloc * sizeof(*new_files));
+		if (!new_files) {
+			return 1;
+		}
+
+		query.files = new_files;
+		query.file_alloc = new_alloc;
+	}
+
+	struct query_file *file = &query.files[query.file_cnt];
+	memset(file, 0, sizeof(*file));
+	file->path = strdup(path);
+	file->match = calloc(query.addr_cnt, sizeof(bool));
+	if (!file->path || !file->match) {
+		free(file->path);
+		free(file->match);
+		return 1;
+	}
+
+	query.file_cnt++;
+	return 0;
+}
+
+/**
+ * \brief Callback of the directory walk
+ */
+static int
+query_walk_cb(const char *path, const struct stat *sb, int type,
+	struct FTW *ftwbuf)
+{
+	(void) sb;
+
+	if (type != FTW_F) {
+		return 0;
+	}
+
+	const char *name = path + ftwbuf->base;
+	if (strncmp(name, query.prefix, strlen(query.prefix)) != 0) {
+		return 0;
+	}
+
+	return query_file_add(path);
+}
+
+/**
+ * \brief Collect index files
+ * \param[in] path File or directory
+ * \return On success returns 0. Otherwise returns a non-zero value.
+ */
+static int
+query_collect(const char *path)
+{
+	struct stat sb;
+	if (stat(path, &sb) != 0) {
+		fprintf(stderr, "Failed to open '%s': %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	if (!S_ISDIR(sb.st_mode)) {
+		// Explicitly given files are always probed
+		return query_file_add(path);
+	}
+
+	if (nftw(path, &query_walk_cb, 32, FTW_PHYS) != 0) {
+		fprintf(stderr, "Failed to walk the directory '%s'\n", path);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Probe one index file
+ * \param[in,out] file File
+ */
+static void
+query_probe(struct query_file *file)
+{
+	struct bbf_file_hdr hdr;
+	enum BBF_ECODE ret;
+
+	int fd = open(file->path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open '%s': %s\n", file->path,
+			strerror(errno));
+		file->error = true;
+		return;
+	}
+
+	ret = bbf_file_header(fd, &hdr);
+	if (ret == BBF_ERR_FORMAT) {
+		// Not an index of this type (classic index, temporary file, ...)
+		if (query.verbose) {
+			fprintf(stderr, "Skipping '%s': %s\n", file->path,
+				bbf_strerror(ret));
+		}
+		close(fd);
+		return;
+	}
+
+	for (size_t i = 0; ret == BBF_OK && i < query.addr_cnt; ++i) {
+		ret = bbf_file_probe(fd, &hdr, query.addrs[i].key, &file->match[i]);
+	}
+
+	if (ret != BBF_OK) {
+		fprintf(stderr, "Failed to read '%s': %s\n", file->path,
+			bbf_strerror(ret));
+		file->error = true;
+	}
+
+	close(fd);
+}
+
+/**
+ * \brief Main function of a worker thread
+ *
+ * Files are taken from the shared list one by one.
+ */
+static void *
+query_worker(void *arg)
+{
+	(void) arg;
+
+	while (true) {
+		size_t idx = __sync_fetch_and_add(&query.file_next, 1);
+		if (idx >= query.file_cnt) {
+			break;
+		}
+
+		query_probe(&query.files[idx]);
+	}
+
+	return NULL;
+}
+
+/** Compare files by the path */
+static int
+query_file_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct query_file *) a)->path,
+		((const struct query_file *) b)->path);
+}
+
+int
+main(int argc, char *argv[])
+{
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+
+	query.prefix = QUERY_DEF_PREFIX;
+	query.addrs = calloc(argc, sizeof(*query.addrs));
+	if (!query.addrs) {
+		fprintf(stderr, "Memory allocation failed\n");
+		return 2;
+	}
+
+	while ((opt = getopt(argc, argv, "a:t:p:vh")) != -1) {
+		switch (opt) {
+		case 'a': {
+			struct query_addr *addr = &query.addrs[query.addr_cnt];
+			if (query_addr_parse(optarg, addr->key) != 0) {
+				fprintf(stderr, "Invalid IP address '%s'\n", optarg);
+				return 2;
+			}
+			addr->str = optarg;
+			query.addr_cnt++;
+			break;
+		}
+		case 't':
+			threads = strtol(optarg, NULL, 10);
+			if (threads < 1 || threads > QUERY_MAX_THREADS) {
+				fprintf(stderr, "Invalid number of threads '%s'\n", optarg);
+				return 2;
+			}
+			break;
+		case 'p':
+			query.prefix = optarg;
+			break;
+		case 'v':
+			query.verbose = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (query.addr_cnt == 0 || optind >= argc) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	// Collect files
+	int status = 1;
+	for (int i = optind; i < argc; ++i) {
+		if (query_collect(argv[i]) != 0) {
+			status = 2;
+		}
+	}
+
+	// Probe files in parallel
+	if (threads < 1) {
+		threads = 1;
+	}
+	if ((size_t) threads > query.file_cnt) {
+		threads = (query.file_cnt > 0) ? (long) query.file_cnt : 1;
+	}
+
+	pthread_t thread_ids[QUERY_MAX_THREADS];
+	long started = 0;
+	for (; started < threads; ++started) {
+		if (pthread_create(&thread_ids[started], NULL, &query_worker, NULL)) {
+			break;
+		}
+	}
+
+	if (started == 0) {
+		// Failed to start any thread, do it ourselves
+		query_worker(NULL);
+	}
+
+	for (long i = 0; i < started; ++i) {
+		pthread_join(thread_ids[i], NULL);
+	}
+
+	// Print results
+	qsort(query.files, query.file_cnt, sizeof(*query.files), &query_file_cmp);
+	for (size_t i = 0; i < query.file_cnt; ++i) {
+		struct query_file *file = &query.files[i];
+		if (file->error) {
+			status = 2;
+		}
+
+		for (size_t a = 0; a < query.addr_cnt; ++a) {
+			if (!file->match[a]) {
+				continue;
+			}
+
+			printf("%s %s\n", query.addrs[a].str, file->path);
+			if (status == 1) {
+				status = 0;
+			}
+		}
+
+		free(file->path);
+		free(file->match);
+	}
+
+	free(query.files);
+	free(query.addrs);
+	return status;
+}
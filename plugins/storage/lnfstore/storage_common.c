@@ -71,6 +71,7 @@ stg_common_files_mgr_create(const struct conf_params *params, const char *dir)
 	memset(&param_idx, 0, sizeof(param_idx));
 
 	if (params->file_index.en) {
+		param_idx.type = params->file_index.type;
 		param_idx.autosize = params->file_index.autosize;
 		param_idx.item_cnt = params->file_index.est_cnt;
 		param_idx.prob = params->file_index.fp_prob;
@@ -0,0 +1,329 @@
+/*
+ * \file block_pipeline.cpp
+ * \brief Parallel compression of nfdump data blocks
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+extern "C" {
+#include <ipfixcol/verbose.h>
+}
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "nfstore.h"
+#include "block_pipeline.h"
+
+#include <lzo/lzoconf.h>
+#include <lzo/lzo1x.h>
+#ifdef HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+/* per thread compression context */
+struct BlockPipeline::WorkMem {
+	lzo_align_t *lzo;
+#ifdef HAVE_LIBZSTD
+	ZSTD_CCtx *zstd;
+#endif
+};
+
+BlockPipeline::WorkMem *BlockPipeline::newWorkMem(){
+	WorkMem *mem = new WorkMem;
+	mem->lzo = new lzo_align_t[LZO1X_1_MEM_COMPRESS / sizeof(lzo_align_t) + 1];
+#ifdef HAVE_LIBZSTD
+	mem->zstd = ZSTD_createCCtx();
+#endif
+	return mem;
+}
+
+void BlockPipeline::deleteWorkMem(WorkMem *mem){
+	if(mem == NULL){
+		return;
+	}
+	delete[] mem->lzo;
+#ifdef HAVE_LIBZSTD
+	ZSTD_freeCCtx(mem->zstd);
+#endif
+	delete mem;
+}
+
+BlockPipeline::BlockPipeline(unsigned int threads): stop_(false){
+	pthread_t thread;
+	int ret;
+
+	pthread_mutex_init(&mutex_, NULL);
+	pthread_cond_init(&jobCond_, NULL);
+	pthread_cond_init(&doneCond_, NULL);
+	inlineMem_ = newWorkMem();
+
+	for(unsigned int i = 0; i < threads; i++){
+		ret = pthread_create(&thread, NULL, &BlockPipeline::worker, this);
+		if(ret != 0){
+			MSG_ERROR(MSG_MODULE,"Failed to create compression thread: %s", strerror(ret));
+			break;
+		}
+		threads_.push_back(thread);
+	}
+	if(threads > 0){
+		MSG_DEBUG(MSG_MODULE,"Started %u compression threads", size());
+	}
+}
+
+BlockPipeline::~BlockPipeline(){
+	pthread_mutex_lock(&mutex_);
+	stop_ = true;
+	pthread_cond_broadcast(&jobCond_);
+	pthread_mutex_unlock(&mutex_);
+
+	for(size_t i = 0; i < threads_.size(); i++){
+		pthread_join(threads_[i], NULL);
+	}
+
+	deleteWorkMem(inlineMem_);
+	pthread_cond_destroy(&doneCond_);
+	pthread_cond_destroy(&jobCond_);
+	pthread_mutex_destroy(&mutex_);
+}
+
+void *BlockPipeline::worker(void *arg){
+	BlockPipeline *pipeline = (BlockPipeline *) arg;
+	WorkMem *mem = newWorkMem();
+	DataBlock *block;
+
+	pthread_mutex_lock(&pipeline->mutex_);
+	while(true){
+		while(pipeline->queue_.empty() && !pipeline->stop_){
+			pthread_cond_wait(&pipeline->jobCond_, &pipeline->mutex_);
+		}
+		if(pipeline->queue_.empty()){
+			/* pipeline is being destroyed and there is nothing left to do */
+			break;
+		}
+
+		block = pipeline->queue_.front();
+		pipeline->queue_.pop_front();
+		pthread_mutex_unlock(&pipeline->mutex_);
+
+		compress(block, mem);
+
+		pthread_mutex_lock(&pipeline->mutex_);
+		block->done = true;
+		pthread_cond_broadcast(&pipeline->doneCond_);
+	}
+	pthread_mutex_unlock(&pipeline->mutex_);
+
+	deleteWorkMem(mem);
+	return NULL;
+}
+
+void BlockPipeline::compress(DataBlock *block, WorkMem *mem){
+	struct timespec start, end;
+	uint32_t outSize = 0;
+
+	block->failed = false;
+	block->header.size = block->rawSize;
+	block->out = block->raw;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	switch(block->compression){
+	case COMPRESSION_NONE:
+		break;
+	case COMPRESSION_LZO: {
+		lzo_uint oSize = 0;
+		if(lzo1x_1_compress((unsigned char *) block->raw, block->rawSize,
+				(unsigned char *) block->compressed, &oSize, mem->lzo) != LZO_E_OK){
+			block->failed = true;
+		}
+		outSize = oSize;
+		break;
+	}
+	case COMPRESSION_LZ4:
+#ifdef HAVE_LIBLZ4
+		{
+		int ret = LZ4_compress_default(block->raw, block->compressed,
+				block->rawSize, block->compressedAlloc);
+		if(ret <= 0){
+			block->failed = true;
+		}
+		outSize = ret;
+		}
+#else
+		block->failed = true;
+#endif
+		break;
+	case COMPRESSION_ZSTD:
+#ifdef HAVE_LIBZSTD
+		{
+		size_t ret = ZSTD_compressCCtx(mem->zstd, block->compressed,
+				block->compressedAlloc, block->raw, block->rawSize,
+				ZSTD_CLEVEL_DEFAULT);
+		if(ZSTD_isError(ret)){
+			block->failed = true;
+		}
+		outSize = ret;
+		}
+#else
+		block->failed = true;
+#endif
+		break;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	block->compressNs = (end.tv_sec - start.tv_sec) * 1000000000ULL
+			+ end.tv_nsec - start.tv_nsec;
+
+	if(block->compression != COMPRESSION_NONE && !block->failed){
+		block->out = block->compressed;
+		block->header.size = outSize;
+	}
+}
+
+void BlockPipeline::submit(DataBlock *block){
+	block->done = false;
+
+	/* no workers available, compress the block in the calling thread */
+	if(threads_.empty() || block->compression == COMPRESSION_NONE){
+		compress(block, inlineMem_);
+		block->done = true;
+		return;
+	}
+
+	pthread_mutex_lock(&mutex_);
+	queue_.push_back(block);
+	pthread_cond_signal(&jobCond_);
+	pthread_mutex_unlock(&mutex_);
+}
+
+bool BlockPipeline::done(DataBlock *block){
+	bool ret;
+
+	pthread_mutex_lock(&mutex_);
+	ret = block->done;
+	pthread_mutex_unlock(&mutex_);
+	return ret;
+}
+
+void BlockPipeline::wait(DataBlock *block){
+	pthread_mutex_lock(&mutex_);
+	while(!block->done){
+		pthread_cond_wait(&doneCond_, &mutex_);
+	}
+	pthread_mutex_unlock(&mutex_);
+}
+
+DataBlock *BlockPipeline::newBlock(uint32_t size){
+	DataBlock *block = new DataBlock;
+	memset(block, 0, sizeof(DataBlock));
+
+	/* worst case of all compression algorithms (LZO has the largest one) */
+	block->compressedAlloc = size + size / 16 + 64 + 3;
+#ifdef HAVE_LIBZSTD
+	if(ZSTD_compressBound(size) > block->compressedAlloc){
+		block->compressedAlloc = ZSTD_compressBound(size);
+	}
+#endif
+	block->rawAlloc = size;
+	block->raw = new char[block->rawAlloc];
+	block->compressed = new char[block->compressedAlloc];
+	block->out = block->raw;
+	block->header.id = DATA_BLOCK_TYPE_2;
+	return block;
+}
+
+void BlockPipeline::deleteBlock(DataBlock *block){
+	if(block == NULL){
+		return;
+	}
+	delete[] block->raw;
+	delete[] block->compressed;
+	delete block;
+}
+
+bool BlockPipeline::available(enum BlockCompression compression){
+	switch(compression){
+	case COMPRESSION_NONE:
+	case COMPRESSION_LZO:
+		return true;
+	case COMPRESSION_LZ4:
+#ifdef HAVE_LIBLZ4
+		return true;
+#else
+		return false;
+#endif
+	case COMPRESSION_ZSTD:
+#ifdef HAVE_LIBZSTD
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+uint32_t BlockPipeline::fileFlag(enum BlockCompression compression){
+	switch(compression){
+	case COMPRESSION_NONE:
+		return 0;
+	case COMPRESSION_LZO:
+		return FLAG_LZO_COMPRESSED;
+	case COMPRESSION_LZ4:
+		return FLAG_LZ4_COMPRESSED;
+	case COMPRESSION_ZSTD:
+		return FLAG_ZSTD_COMPRESSED;
+	}
+	return 0;
+}
+
+const char *BlockPipeline::name(enum BlockCompression compression){
+	switch(compression){
+	case COMPRESSION_NONE:
+		return "none";
+	case COMPRESSION_LZO:
+		return "lzo";
+	case COMPRESSION_LZ4:
+		return "lz4";
+	case COMPRESSION_ZSTD:
+		return "zstd";
+	}
+	return "unknown";
+}
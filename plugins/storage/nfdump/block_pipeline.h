@@ -0,0 +1,108 @@
+/*
+ * \file block_pipeline.h
+ * \brief Parallel compression of nfdump data blocks
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef BLOCKPIPELINE_H_
+#define BLOCKPIPELINE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <deque>
+#include <vector>
+#include "nffile.h"
+
+/* compression of data blocks */
+enum BlockCompression {
+	COMPRESSION_NONE,
+	COMPRESSION_LZO,
+	COMPRESSION_LZ4,
+	COMPRESSION_ZSTD
+};
+
+/* data block on its way from the record buffer to the file */
+struct DataBlock {
+	struct data_block_header_s header; //header, size is set by compression
+	char *raw;				//records
+	uint32_t rawSize;		//number of bytes used in raw
+	uint32_t rawAlloc;		//allocated size of raw
+	char *out;				//data to write (points to raw if not compressed)
+	char *compressed;		//buffer for compressed data
+	uint32_t compressedAlloc;//allocated size of compressed
+	enum BlockCompression compression;
+	bool done;				//block is ready to be written
+	bool failed;			//compression failed, block must be dropped
+	uint64_t compressNs;	//time spent by compression
+};
+
+/*
+ * Pool of worker threads compressing data blocks. Each worker has its own
+ * compression context. Without workers, blocks are compressed by the calling
+ * thread in submit(). Blocks are returned in any order; NfdumpFile keeps
+ * them in a queue and writes them in the order of submission.
+ */
+class BlockPipeline {
+	struct WorkMem;
+
+	std::vector<pthread_t> threads_;
+	std::deque<DataBlock *> queue_;
+	pthread_mutex_t mutex_;
+	pthread_cond_t jobCond_;	//signalled when a block is queued
+	pthread_cond_t doneCond_;	//signalled when a block is compressed
+	bool stop_;
+	WorkMem *inlineMem_;		//compression context for inline compression
+
+	static void *worker(void *arg);
+	static void compress(DataBlock *block, WorkMem *mem);
+	static WorkMem *newWorkMem();
+	static void deleteWorkMem(WorkMem *mem);
+public:
+	BlockPipeline(unsigned int threads);
+	~BlockPipeline();
+	unsigned int size(){return threads_.size();}
+	void submit(DataBlock *block);
+	bool done(DataBlock *block);
+	void wait(DataBlock *block);
+
+	static DataBlock *newBlock(uint32_t size);
+	static void deleteBlock(DataBlock *block);
+	static bool available(enum BlockCompression compression);
+	static uint32_t fileFlag(enum BlockCompression compression);
+	static const char *name(enum BlockCompression compression);
+};
+
+#endif /* BLOCKPIPELINE_H_ */
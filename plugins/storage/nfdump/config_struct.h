@@ -73,8 +73,14 @@ struct nfdumpConfig{
 	/* identification string for nffiles*/
 	std::string ident;
 
-	/* lzo compression of records */
-	bool compression;
+	/* compression of data blocks */
+	enum BlockCompression compression;
+
+	/* number of threads compressing data blocks (0 = storage thread) */
+	unsigned int compressThreads;
+
+	/* compression threads shared by all files */
+	class BlockPipeline *pipeline;
 
 	/* time of last flush (used for time based rotation,
 	 * name is based on start of interval not its end!) */
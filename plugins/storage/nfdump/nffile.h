@@ -98,9 +98,16 @@ typedef struct file_header_s {
 #define FLAG_COMPRESSED 	0x1		// flow records are compressed
 #define FLAG_ANONYMIZED 	0x2		// flow data are anonimized 
 #define FLAG_CATALOG		0x4		// has a file catalog record after stat record
+#define FLAG_LZO_COMPRESSED	FLAG_COMPRESSED	// flow records are LZO compressed
+#define FLAG_BZ2_COMPRESSED	0x8		// flow records are BZ2 compressed
+#define FLAG_LZ4_COMPRESSED	0x10	// flow records are LZ4 compressed
+#define FLAG_ZSTD_COMPRESSED	0x20	// flow records are ZSTD compressed
+#define COMPRESSION_MASK	0x39	// all compression bits
 
 									/*
 										0x1 File is compressed with LZO1X-1 compression
+										0x10 File is compressed with LZ4 (nfdump >= 1.6.16)
+										0x20 File is compressed with ZSTD (nfdump >= 1.6.18)
 									 */
 	uint32_t	NumBlocks;			// number of data blocks in file
 	char		ident[IDENTLEN];	// string identifier for this file
@@ -181,16 +181,32 @@ int processStartupXML(char *params, struct nfdumpConfig* c){
 		}
 
 		tmp=ie.node().child_value("compression");
-		if(tmp == "yes"){
-			c->compression = true;
+		if(tmp == "yes" || tmp == "lzo"){
+			c->compression = COMPRESSION_LZO;
 			if (lzo_init() != LZO_E_OK){
 				MSG_WARNING(MSG_MODULE,"Compression initialization failed (storing without compression)!");
-				c->compression = false;
+				c->compression = COMPRESSION_NONE;
 			}
+		} else if(tmp == "lz4"){
+			c->compression = COMPRESSION_LZ4;
+		} else if(tmp == "zstd"){
+			c->compression = COMPRESSION_ZSTD;
 		} else {
-			c->compression = false;
+			if(tmp != "" && tmp != "no"){
+				MSG_WARNING(MSG_MODULE,"Unknown compression \"%s\" (storing without compression)!", tmp.c_str());
+			}
+			c->compression = COMPRESSION_NONE;
+		}
+
+		if(!BlockPipeline::available(c->compression)){
+			MSG_WARNING(MSG_MODULE,"Support for %s compression is not compiled in (storing without compression)!",
+					BlockPipeline::name(c->compression));
+			c->compression = COMPRESSION_NONE;
 		}
 
+		tmp=ie.node().child_value("compressThreads");
+		c->compressThreads = atoi(tmp.c_str());
+
 		ie = doc.select_single_node("fileWriter/dumpInterval");
 		tmp=ie.node().child_value("timeWindow");
 		c->timeWindow = atoi(tmp.c_str());
@@ -244,6 +260,10 @@ int storage_init (char *params, void **config){
 		MSG_ERROR(MSG_MODULE, "Unable to parse configuration xml!");
 		return 1;
 	}
+
+	/* without compression there is nothing to do in parallel */
+	c->pipeline = new BlockPipeline(
+			(c->compression == COMPRESSION_NONE) ? 0 : c->compressThreads);
 	return 0;
 }
 
@@ -313,6 +333,7 @@ int storage_close (void **config){
 	}
 
 	delete conf->files;
+	delete conf->pipeline;
 	delete conf;
 
 	return 0;
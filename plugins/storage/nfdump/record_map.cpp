@@ -53,19 +53,12 @@ extern "C" {
 #include "nfstore.h"
 #include "nffile.h"
 
-#include <lzo/lzoconf.h>
-#include <lzo/lzo1x.h>
-
-static lzo_align_t __LZO_MMODEL wrkmem[LZO1X_1_MEM_COMPRESS];
-
 void FileHeader::newHeader(FILE *f, struct nfdumpConfig* conf){
 	header_.magic = MAGIC;
 	header_.version = LAYOUT_VERSION_1;
 	header_.flags = 0;
 	header_.NumBlocks = 0;
-	if(conf->compression){
-		header_.flags = header_.flags | FLAG_COMPRESSED;
-	}
+	header_.flags = header_.flags | BlockPipeline::fileFlag(conf->compression);
 	memset(header_.ident,0,IDENTLEN);
 	strncpy(header_.ident,conf->ident.c_str(), IDENTLEN-1);
 	position_ = ftell(f);
@@ -147,52 +140,13 @@ void Stats::increaseSQFail(){
 }
 
 
-void BlockHeader::newBlock(FILE *f){
+void BlockHeader::newBlock(){
 	block_.NumRecords = 0;
 	block_.size = 0;
-	block_.id = 2;
-	position_ = ftell(f);
-	updateBlock(f);
-}
-
-void BlockHeader::updateBlock(FILE *f){
-	//seek block header
-	if((fseek(f, position_, SEEK_SET)) != 0){
-		MSG_ERROR(MSG_MODULE,"Can't update block header");
-	}
-	//write block header
-	if((fwrite(&block_,1,sizeof(struct data_block_header_s),f))
-			!= sizeof(struct data_block_header_s)){
-		MSG_ERROR(MSG_MODULE,"Can't update block header");
-	}
+	block_.id = DATA_BLOCK_TYPE_2;
+	block_.flags = 0;
 }
 
-
-
-void BlockHeader::compress(char *buffer, uint *bufferUsed){ //TODO
-	lzo_uint iSize,oSize;
-	unsigned char __LZO_MMODEL *input;
-	unsigned char __LZO_MMODEL *output;
-
-	char *ibuff;
-
-	ibuff = new char[block_.size];
-	memcpy(ibuff,buffer,block_.size);
-
-	input = (unsigned char __LZO_MMODEL *) ibuff;
-	iSize = block_.size;
-	output = (unsigned char __LZO_MMODEL *) buffer;
-	oSize = 0;
-	if(lzo1x_1_compress(input,iSize,output,&oSize,wrkmem) != LZO_E_OK){
-		MSG_ERROR(MSG_MODULE,"Compression failed");
-	}
-	*bufferUsed = oSize;
-	block_.size = oSize;
-	delete[] ibuff;
-	//TODO ret val
-}
-
-
 int NfdumpFile::newFile(std::string name, struct nfdumpConfig* conf){
 	MSG_DEBUG(MSG_MODULE,"Creating new file: \"%s\"",name.c_str());
 	f_ = fopen(name.c_str(),"w+");
@@ -200,12 +154,12 @@ int NfdumpFile::newFile(std::string name, struct nfdumpConfig* conf){
 		MSG_ERROR(MSG_MODULE,"Can't create file: \"%s\"",name.c_str());
 		return -1;
 	}
+	name_ = name;
 	//create header
 	fileHeader_.newHeader(f_,conf);
 	//create stats
 	stats_.newStats(f_);
-	fileHeader_.increaseBlockCnt();
-	currentBlock_.newBlock(f_);
+	currentBlock_.newBlock();
 
 	extMaps_ = new std::map<uint16_t,RecordMap*>;
 	if(extMaps_ == NULL){
@@ -213,49 +167,114 @@ int NfdumpFile::newFile(std::string name, struct nfdumpConfig* conf){
 		return -1;
 	}
 
+	pipeline_ = conf->pipeline;
+	compression_ = conf->compression;
+	compressStats_ = CompressStats();
+
 	bufferSize_ = conf->bufferSize;
 	bufferUsed_ = 0;
-	buffer_ = new char[BUFFER_SIZE];
-
-	if(buffer_ == NULL){
-		MSG_ERROR(MSG_MODULE,"Can't allocate memory");
-		return -1;
-	}
+	current_ = getBlock();
+	buffer_ = current_->raw;
 	return 0;
 }
 
-void NfdumpFile::updateFile(bool compression){
-	uint check;
+DataBlock *NfdumpFile::getBlock(){
+	DataBlock *block;
 
-	if(f_ == NULL){
-		MSG_ERROR(MSG_MODULE,"Can't update file");
-		bufferUsed_ = 0;
+	if(!freeBlocks_.empty()){
+		block = freeBlocks_.back();
+		freeBlocks_.pop_back();
+		return block;
+	}
+
+	/* free space is checked for one record only, but whole data set is
+	 * buffered, keep the same reserve as the former fixed size buffer */
+	return BlockPipeline::newBlock(bufferSize_ + BUFFER_SIZE);
+}
+
+/* pass the filled block to the compression pipeline and start a new one */
+void NfdumpFile::flushBlock(){
+	if(bufferUsed_ == 0){
 		return;
 	}
-	//update file header
-	fileHeader_.updateHeader(f_);
-	//update stats
-	stats_.updateStats(f_);
-	//update last block header
 
+	current_->header = currentBlock_.header();
+	current_->rawSize = bufferUsed_;
+	current_->compression = compression_;
+	pipeline_->submit(current_);
+	pending_.push_back(current_);
 
-	if(compression){
-		currentBlock_.compress(buffer_, &bufferUsed_);
-		currentBlock_.updateBlock(f_);
-	}else{
-		currentBlock_.updateBlock(f_);
+	current_ = getBlock();
+	buffer_ = current_->raw;
+	bufferUsed_ = 0;
+	currentBlock_.newBlock();
+}
+
+/*
+ * Write compressed blocks in order of submission. Unless all blocks are
+ * requested, stop at the first block still being compressed as long as
+ * the number of pending blocks is reasonable.
+ */
+void NfdumpFile::writeBlocks(bool all){
+	size_t maxPending = 2 * pipeline_->size();
+	DataBlock *block;
+
+	while(!pending_.empty()){
+		block = pending_.front();
+		if(!pipeline_->done(block)){
+			if(!all && pending_.size() <= maxPending){
+				break;
+			}
+			pipeline_->wait(block);
+		}
+
+		pending_.pop_front();
+		writeBlock(block);
+		freeBlocks_.push_back(block);
+	}
+}
+
+void NfdumpFile::writeBlock(DataBlock *block){
+	if(block->failed){
+		MSG_ERROR(MSG_MODULE,"Compression of a block failed (%u records lost)",
+				block->header.NumRecords);
+		return;
 	}
 
-	//flush data from buffer
-	check = fseek(f_, 0, SEEK_END);
-	if(check != 0){
+	if(fseek(f_, 0, SEEK_END) != 0){
 		MSG_ERROR(MSG_MODULE,"Can't update file");
 	}
-	check = fwrite(buffer_,1,bufferUsed_,f_);
-	if(check != bufferUsed_){
+	//write block header and data
+	if(fwrite(&block->header,1,sizeof(struct data_block_header_s),f_)
+			!= sizeof(struct data_block_header_s)
+			|| fwrite(block->out,1,block->header.size,f_) != block->header.size){
 		MSG_ERROR(MSG_MODULE,"Can't update file");
 	}
-	bufferUsed_ = 0;
+	fileHeader_.increaseBlockCnt();
+
+	compressStats_.blocks++;
+	compressStats_.rawBytes += block->rawSize;
+	compressStats_.outBytes += block->header.size;
+	compressStats_.totalNs += block->compressNs;
+	if(block->compressNs > compressStats_.maxNs){
+		compressStats_.maxNs = block->compressNs;
+	}
+}
+
+void NfdumpFile::updateFile(){
+	if(f_ == NULL){
+		MSG_ERROR(MSG_MODULE,"Can't update file");
+		bufferUsed_ = 0;
+		return;
+	}
+
+	flushBlock();
+	writeBlocks(false);
+
+	//update file header
+	fileHeader_.updateHeader(f_);
+	//update stats
+	stats_.updateStats(f_);
 }
 
 unsigned int
@@ -300,9 +319,7 @@ NfdumpFile::bufferPtk(const data_template_couple *dtcouple){
 		/* flush data if there is no space in buffers */
 		if(bufferSize_ <= bufferUsed_ + ext_map_it->second->maxSize()){
 			std::map<uint16_t,RecordMap*>::iterator maps_it;
-			updateFile(fileHeader_.compressed());
-			fileHeader_.increaseBlockCnt();
-			currentBlock_.newBlock(f_);
+			updateFile();
 			//for(maps_it = _ext_maps->begin(); maps_it!=_ext_maps->end();maps_it++){
 			//	maps_it->second->clean_metadata();
 			//}
@@ -343,15 +360,36 @@ void NfdumpFile::closeFile(){
 		return;
 	}
 
-	updateFile(fileHeader_.compressed());
+	flushBlock();
+	writeBlocks(true);
+	fileHeader_.updateHeader(f_);
+	stats_.updateStats(f_);
 	fclose(f_);
+	f_ = NULL;
+
+	if(compression_ != COMPRESSION_NONE && compressStats_.blocks > 0){
+		MSG_INFO(MSG_MODULE,"%s: %lu blocks compressed by %s, %lu -> %lu bytes, "
+				"compression time %.1f us/block (max %.1f us)", name_.c_str(),
+				(unsigned long) compressStats_.blocks,
+				BlockPipeline::name(compression_),
+				(unsigned long) compressStats_.rawBytes,
+				(unsigned long) compressStats_.outBytes,
+				compressStats_.totalNs / 1000.0 / compressStats_.blocks,
+				compressStats_.maxNs / 1000.0);
+	}
+
+	BlockPipeline::deleteBlock(current_);
+	current_ = NULL;
+	for(size_t i = 0; i < freeBlocks_.size(); i++){
+		BlockPipeline::deleteBlock(freeBlocks_[i]);
+	}
+	freeBlocks_.clear();
 
 
 	for(maps_it = extMaps_->begin(); maps_it!=extMaps_->end();maps_it++){
 		delete maps_it->second;
 	}
 	delete extMaps_;
-	delete[] buffer_;
 }
 
 RecordMap::RecordMap() {
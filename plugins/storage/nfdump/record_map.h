@@ -46,6 +46,9 @@
 #include <stdio.h>
 #include <string>
 #include <map>
+#include <deque>
+#include <vector>
+#include "block_pipeline.h"
 
 
 
@@ -80,14 +83,12 @@ public:
 class BlockHeader {
 	enum{HEADER_SIZE=12,MAX_SIZE=500/*MAX_SIZE=4294967295*/};
 	struct data_block_header_s block_;
-	long position_;
 public:
 	uint size(){return HEADER_SIZE;}
 	void increaseRecordsCnt(){block_.NumRecords++;}
 	void addRecordSize(uint32_t size){block_.size+=size;}
-	void newBlock(FILE *f);
-	void compress(char *buffer, uint *bufferUsed);
-	void updateBlock(FILE *f);
+	void newBlock();
+	const struct data_block_header_s &header(){return block_;}
 };
 
 class FileHeader{
@@ -95,7 +96,6 @@ class FileHeader{
 	long position_;
 public:
 	uint size(){return sizeof(struct file_header_s);}
-	bool compressed(){return header_.flags & FLAG_COMPRESSED;}
 	void increaseBlockCnt(){header_.NumBlocks++;};
 	void newHeader(FILE *f, struct nfdumpConfig* conf);
 	void updateHeader(FILE *f);
@@ -134,9 +134,22 @@ public:
 	uint maxSize(){return recordSize_ + mapSize_;}
 };
 
+struct CompressStats{
+
+	CompressStats(): blocks(0), rawBytes(0), outBytes(0), totalNs(0),
+		maxNs(0) {}
+
+	uint64_t blocks;
+	uint64_t rawBytes;
+	uint64_t outBytes;
+	uint64_t totalNs;
+	uint64_t maxNs;
+};
+
 class NfdumpFile{
 	enum {BUFFER_SIZE_ = 512000};
 	FILE * f_;
+	std::string name_;
 	//HEADER
 	class FileHeader fileHeader_;
 	class Stats stats_;
@@ -149,9 +162,25 @@ class NfdumpFile{
 	unsigned int bufferSize_;
 	/* buffer number of bytes used in buffer */
 	unsigned int bufferUsed_;
+
+	/* block compression (shared by all files) */
+	class BlockPipeline *pipeline_;
+	enum BlockCompression compression_;
+	/* block being filled (buffer_ points to its data) */
+	struct DataBlock *current_;
+	/* blocks submitted for compression, in file order */
+	std::deque<struct DataBlock *> pending_;
+	/* blocks ready for reuse */
+	std::vector<struct DataBlock *> freeBlocks_;
+	struct CompressStats compressStats_;
+
+	struct DataBlock *getBlock();
+	void flushBlock();
+	void writeBlocks(bool all);
+	void writeBlock(struct DataBlock *block);
 public:
 	int newFile(std::string name, struct nfdumpConfig* conf);
-	void updateFile(bool compression = false);
+	void updateFile();
 	unsigned int bufferPtk(const struct data_template_couple dtcouple[]);
 	void checkSQNumber(unsigned int SQ, unsigned int recFlows);
 	void closeFile();
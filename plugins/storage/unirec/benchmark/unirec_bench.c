@@ -0,0 +1,271 @@
+/**
+ * \file unirec_bench.c
+ * \brief Throughput benchmark of the UniRec storage plugin
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <ipfixcol.h>
+
+/* accepted program arguments */
+#define ARGUMENTS "p:n:o:vh"
+
+/* default number of records */
+#define DEFAULT_RECORDS 10000000
+
+/* records in one data set */
+#define SET_RECORDS 30
+
+/* variable length value in records */
+#define VAR_VALUE "www.example.com"
+
+typedef int (*init_func)(char *, void **);
+typedef int (*store_func)(void *, const struct ipfix_message *, const struct ipfix_template_mgr *);
+typedef int (*close_func)(void **);
+
+/* template fields: element id, length */
+static const uint16_t fields[][2] = {
+	{8, 4},     /* sourceIPv4Address */
+	{12, 4},    /* destinationIPv4Address */
+	{7, 2},     /* sourceTransportPort */
+	{11, 2},    /* destinationTransportPort */
+	{4, 1},     /* protocolIdentifier */
+	{6, 1},     /* tcpControlBits */
+	{1, 8},     /* octetDeltaCount */
+	{2, 8},     /* packetDeltaCount */
+	{152, 8},   /* flowStartMilliseconds */
+	{153, 8},   /* flowEndMilliseconds */
+	{10, 4},    /* ingressInterface */
+};
+
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+/**
+ * \brief Create template describing generated records
+ *
+ * \param[in] var Add variable length field
+ * \return New template
+ */
+static struct ipfix_template *create_template(int var)
+{
+	struct ipfix_template *tmpl;
+	unsigned int count = FIELD_COUNT + (var ? 2 : 0);
+
+	tmpl = calloc(1, sizeof(struct ipfix_template) + count * sizeof(template_ie));
+	if (!tmpl) {
+		return NULL;
+	}
+
+	tmpl->template_id = 256;
+	tmpl->original_id = 256;
+	tmpl->template_type = TM_TEMPLATE;
+	tmpl->first_transmission = time(NULL);
+	tmpl->field_count = FIELD_COUNT + (var ? 1 : 0);
+
+	for (unsigned int i = 0; i < FIELD_COUNT; i++) {
+		tmpl->fields[i].ie.id = fields[i][0];
+		tmpl->fields[i].ie.length = fields[i][1];
+		tmpl->data_length += fields[i][1];
+	}
+
+	if (var) {
+		/* DNS_NAME, enterprise element 8057/2 */
+		tmpl->fields[FIELD_COUNT].ie.id = 2 | 0x8000;
+		tmpl->fields[FIELD_COUNT].ie.length = VAR_IE_LENGTH;
+		tmpl->fields[FIELD_COUNT + 1].enterprise_number = 8057;
+		tmpl->data_length += 1;
+		tmpl->data_length |= 0x8000;
+	}
+
+	return tmpl;
+}
+
+/**
+ * \brief Fill data set with records
+ *
+ * \param[out] set Data set
+ * \param[in] var Add variable length field
+ * \return Length of the data set
+ */
+static uint16_t fill_set(uint8_t *set, int var)
+{
+	uint8_t *pos = set + sizeof(struct ipfix_set_header);
+	struct ipfix_set_header *header = (struct ipfix_set_header *) set;
+
+	for (int r = 0; r < SET_RECORDS; r++) {
+		for (unsigned int i = 0; i < FIELD_COUNT; i++) {
+			/* some non-zero data, values are not important */
+			for (int b = 0; b < fields[i][1]; b++) {
+				pos[b] = (uint8_t) (r + i + b + 1);
+			}
+			pos += fields[i][1];
+		}
+		if (var) {
+			*pos++ = strlen(VAR_VALUE);
+			memcpy(pos, VAR_VALUE, strlen(VAR_VALUE));
+			pos += strlen(VAR_VALUE);
+		}
+	}
+
+	header->flowset_id = htons(256);
+	header->length = htons(pos - set);
+
+	return pos - set;
+}
+
+void usage(char *name)
+{
+	printf("Usage: %s -p plugin [-n records] [-o file] [-v]\n", name);
+	printf("  -p plugin   path to the UniRec storage plugin\n");
+	printf("  -n records  number of records to process (default %d)\n", DEFAULT_RECORDS);
+	printf("  -o file     output file of the TRAP interface (default /dev/null)\n");
+	printf("  -v          add variable length field to the template\n");
+}
+
+int main(int argc, char **argv)
+{
+	char *plugin = NULL, *output = "/dev/null";
+	unsigned long records = DEFAULT_RECORDS, done;
+	int var = 0, c, ret = 1;
+	void *handle, *config = NULL;
+	init_func storage_init;
+	store_func store_packet;
+	close_func storage_close;
+	struct ipfix_template *tmpl;
+	struct ipfix_message *msg;
+	struct ipfix_header header;
+	uint8_t set[MSG_MAX_LENGTH];
+	char params[1024];
+	struct timespec start, end;
+	double elapsed;
+
+	while ((c = getopt(argc, argv, ARGUMENTS)) != -1) {
+		switch (c) {
+		case 'p':
+			plugin = optarg;
+			break;
+		case 'n':
+			records = strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'v':
+			var = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (plugin == NULL) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	handle = dlopen(plugin, RTLD_NOW);
+	if (!handle) {
+		fprintf(stderr, "Cannot load plugin: %s\n", dlerror());
+		return 1;
+	}
+
+	storage_init = (init_func) dlsym(handle, "storage_init");
+	store_packet = (store_func) dlsym(handle, "store_packet");
+	storage_close = (close_func) dlsym(handle, "storage_close");
+	if (!storage_init || !store_packet || !storage_close) {
+		fprintf(stderr, "Plugin does not implement storage API\n");
+		dlclose(handle);
+		return 1;
+	}
+
+	snprintf(params, sizeof(params),
+		"<fileWriter><fileFormat>unirec</fileFormat><interface>"
+		"<type>f</type><params>%s</params><ifcTimeout>0</ifcTimeout>"
+		"<flushTimeout>10000000</flushTimeout><bufferSwitch>1</bufferSwitch>"
+		"<format>DST_IP,SRC_IP,BYTES,LINK_BIT_FIELD,TIME_FIRST,TIME_LAST,PACKETS,"
+		"DST_PORT,SRC_PORT,DIR_BIT_FIELD,PROTOCOL,TCP_FLAGS%s</format>"
+		"</interface></fileWriter>", output, var ? ",DNS_NAME" : "");
+
+	if (storage_init(params, &config) != 0) {
+		fprintf(stderr, "Plugin initialization failed\n");
+		dlclose(handle);
+		return 1;
+	}
+
+	tmpl = create_template(var);
+	msg = calloc(1, sizeof(struct ipfix_message));
+	if (!tmpl || !msg) {
+		fprintf(stderr, "Memory allocation failed\n");
+		goto cleanup;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.version = htons(IPFIX_VERSION);
+	header.observation_domain_id = htonl(1);
+	header.length = htons(sizeof(header) + fill_set(set, var));
+
+	msg->pkt_header = &header;
+	msg->data_couple[0].data_set = (struct ipfix_data_set *) set;
+	msg->data_couple[0].data_template = tmpl;
+	msg->data_records_count = SET_RECORDS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (done = 0; done < records; done += SET_RECORDS) {
+		store_packet(config, msg, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("records:   %lu\n", done);
+	printf("time:      %.3f s\n", elapsed);
+	printf("records/s: %.0f\n", done / elapsed);
+	ret = 0;
+
+cleanup:
+	storage_close(&config);
+	free(msg);
+	free(tmpl);
+	dlclose(handle);
+
+	return ret;
+}
@@ -254,154 +254,147 @@ static unirecField *match_field(template_ie *element, fht_table_t *ht, uint16_t
 }
 
 /**
- * \brief Get data from data record
- *
- * Uses conf->unirecFields to store values from this record
+ * \brief Destroy translation program
  *
- * \param[in] data_record IPFIX data record
- * \param[in] template corresponding template
- * \param[out] conf structure containing necessary information for converting ipfix to unirec
- * \return length of the data record
+ * @param prog Program to destroy
  */
-static uint16_t process_record(char *data_record, struct ipfix_template *template, unirec_config *conf)
+static void destroy_program(ur_program *prog)
 {
-
-   if (!template) {
-      /* We don't have template for this data set */
-      MSG_WARNING(msg_module, "No template for the data set\n");
-      return 0;
+   if (prog == NULL) {
+      return;
    }
 
-   if (!conf) {
-      /* Configuration not given */
-      MSG_WARNING(msg_module, "No configuration given to process_record\n");
-      return 0;
-   }
+   free(prog->var_offset);
+   free(prog->steps);
+   free(prog->dyn_steps);
+   free(prog->send);
+   free(prog);
+}
 
+/**
+ * \brief Choose conversion of a static UniRec field
+ *
+ * @param field Matched UniRec field
+ * @param length Length of the IPFIX element from template
+ * @param ipfix_id IPFIX element id
+ * @param en_id Enterprise number
+ * @param conf Plugin configuration
+ * @return Conversion from `ur_conversion`, -1 if the value should not be copied
+ */
+static int get_conversion(unirecField *field, uint16_t length, uint16_t ipfix_id, uint32_t en_id, unirec_config *conf)
+{
+   switch (field->type) {
+   case UNIREC_FIELD_IP:
+      if ((en_id == 0 && (ipfix_id == 8 || ipfix_id == 12)) ||
+          (en_id == 39499 && ipfix_id == 40)) {
+         // IPv4 or INVEA_SIP_RTP_IPV4
+         return UR_CONV_IP4;
+      }
+      // IPv6 or INVEA_SIP_RTP_IPV6
+      return UR_CONV_IP;
+   case UNIREC_FIELD_PACKET:
+      // PACKET SIZE IS DIFFERENT FOR DIFFERENT EXPORTER!!!
+      if (length == 4) {
+         return UR_CONV_PACKET32;
+      } else if (length == 8) {
+         return UR_CONV_PACKET64;
+      }
+      return UR_CONV_PACKET_INVALID;
+   case UNIREC_FIELD_TS:
+      return UR_CONV_TS;
+   case UNIREC_FIELD_DBF:
+      return UR_CONV_DBF;
+   case UNIREC_FIELD_LBF:
+      // LINK_BIT_FIELD is copied from record only in ODID JOINFLOWS method
+      return conf->ODID_get_method == ODID_JOINFLOWS_METHOD ? UR_CONV_LBF : -1;
+   default:
+      if (length == VAR_IE_LENGTH) {
+         return UR_CONV_COPY_CHECKED;
+      }
+      // Saturate unirec element if the ipfix element is larger
+      return field->size >= length ? UR_CONV_COPY : UR_CONV_SATURATE;
+   }
+}
 
-   uint16_t offset = 0;
-   uint16_t index, count;
-   uint16_t length, size_length;
+/**
+ * \brief Build translation program for given template
+ *
+ * Matches template fields with UniRec fields only once, the resulting program
+ * lists all copy operations for every interface. Interfaces that can never be
+ * filled by records of this template (missing required field) are left out.
+ *
+ * @param template IPFIX template
+ * @param conf Plugin configuration
+ * @return New program on success, NULL otherwise
+ */
+static ur_program *build_program(struct ipfix_template *template, unirec_config *conf)
+{
+   ur_program *prog;
    unirecField *matchField;
-
+   uint16_t index, count;
    uint16_t ipfix_id;
    uint32_t en_id;
-   uint64_t sec, msec, frac;
+   uint16_t length, segment = 0, offset = 0;
+   uint16_t kept;
+   int *filled;
+   int conversion;
 
+   prog = calloc(1, sizeof(ur_program));
+   if (!prog) {
+      MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+      return NULL;
+   }
 
-    // Fill ODID (link bit field) in all ifc where it is included
-    // Only do this if using ODID MANAGER method
-    if (conf->ODID_get_method == ODID_MANAGER_METHOD) {
-        for (int i = 0; i < conf->ifc_count; i++) {
-            if (conf->LBF_field->included_ar[i]) {
-                *(uint64_t*)(conf->ifc[i].buffer + conf->LBF_field->offset_ar[i]) = 1LLU << (conf->odid - 1);
-            }
-        }
-    }
+   prog->tmpl = template;
+   prog->first_transmission = template->first_transmission;
+   prog->var_offset = calloc(template->field_count, sizeof(uint16_t));
+   prog->steps = calloc((size_t) template->field_count * conf->ifc_count, sizeof(ur_step));
+   prog->dyn_steps = calloc(template->field_count, sizeof(ur_dyn_step));
+   prog->send = calloc(conf->ifc_count, sizeof(uint8_t));
+   filled = calloc(conf->ifc_count, sizeof(int));
+   if (!prog->var_offset || !prog->steps || !prog->dyn_steps || !prog->send || !filled) {
+      MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+      free(filled);
+      destroy_program(prog);
+      return NULL;
+   }
 
-   /* Go over all fields */
    for (count = index = 0; count < template->field_count; count++, index++) {
       matchField = match_field(&template->fields[index], conf->ht_fields, &ipfix_id, &en_id);
-
       length = template->fields[index].ie.length;
-      size_length = 0;
-
-      /* Handle variable length */
-      if (length == VAR_IE_LENGTH) {
-         /* Variable length */
-         length = read8(data_record+offset);
-         size_length = 1;
-
-         if (length == 255) {
-            length = ntohs(read16(data_record+offset+size_length));
-            size_length = 3;
-         }
-      }
 
-      /* Copy the element value on match */
       if (matchField) {
-         // Determine if it is static or dynamic element
-         // If static, copy to all Unirec ifcs whose are using this element
-         // Else if dynamic, copy ptr to this element to `matchField->value` for futher use
          if (matchField->size != -1) {
-            // Static element
+            // Static element, one copy operation for every interface using it
+            conversion = get_conversion(matchField, length, ipfix_id, en_id, conf);
             for (int i = 0; i < conf->ifc_count; i++) {
-               // For every interface
-               if (matchField->included_ar[i]) {
-                  // If element is present in current interface
-                  // Copy special elements in special way
-                  switch (matchField->type) {
-                     case UNIREC_FIELD_IP:
-                        if ((en_id == 0 && (ipfix_id == 8 || ipfix_id == 12)) ||
-                            (en_id == 39499 && ipfix_id == 40)) {
-                           // IPv4 or INVEA_SIP_RTP_IPV4
-                           // Put IPv4 into 128 bits in a special way (see ipaddr.h in Nemea-UniRec for details)
-                           *(uint64_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) = 0;
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i] + 8) = *(uint32_t*)(data_record + offset + size_length);
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i] + 12) = 0xffffffff;
-                        } else {
-                           // IPv6 or INVEA_SIP_RTP_IPV6
-                           memcpy(conf->ifc[i].buffer + matchField->offset_ar[i], data_record + offset + size_length, length);
-                        }
-                        break;
-                     case UNIREC_FIELD_PACKET:
-                        // PACKET SIZE IS DIFFERENT FOR DIFFERENT EXPORTER!!!
-                        if (template->fields[index].ie.length == 4) {
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) =  ntohl(*(uint32_t*)(data_record + offset + size_length));
-                        }
-                        else if (template->fields[index].ie.length == 8) {
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) =  ntohl(*(uint32_t*)(data_record + offset + size_length + 4));
-                        } else {
-                           *(uint32_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) =  0xFFFFFFFF;
-                        }
-                        break;
-                     case UNIREC_FIELD_TS:
-                        // Handle Time variables
-                        msec = be64toh(*(uint64_t*)(data_record + offset + size_length));
-                        sec = msec / 1000;
-                        frac = ((msec % 1000) * 0x4189374BC6A7EFULL) >> 32;
-                        *(uint64_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) =  (sec<<32) | frac;
-                        break;
-                     case UNIREC_FIELD_DBF:
-                        // Handle DIR_BIT_FIELD
-                        *(uint8_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) = ((*(uint16_t*)(data_record + offset + size_length)) >> 8) & 0x1;
-                        break;
-                     case UNIREC_FIELD_LBF:
-                        // Handle LINK_BIT_FIELD, is BIG ENDIAN but we are using only LSB
-                        // Only do this if ODID JOINFLOWS method
-                        if (conf->ODID_get_method == ODID_JOINFLOWS_METHOD) {
-                            *(uint64_t*)(conf->ifc[i].buffer + matchField->offset_ar[i]) = 1LLU << ((*(uint8_t*)(data_record + offset + size_length + 3)) - 1);
-                                }
-                        break;
-                     default:
-                        // Check length of ipfix element and if it is larger than unirec element, then saturate unirec element
-                        if (matchField->size >= length) {
-                           data_copy( (conf->ifc[i].buffer) + matchField->offset_ar[i],	// Offset to Unirec buffer for current ifc
-                                 (data_record + offset + size_length),		// Offset to data in Ipfix message
-                              length);						// Size of element
-                        } else {
-                           // set maximum value to unirec element
-                           memset( (conf->ifc[i].buffer) + matchField->offset_ar[i],
-                              0xFF,
-                              matchField->size);
-                        }
-                  }
-
-                  // if required, add required-filled count
-                  conf->ifc[i].requiredFilled += matchField->required_ar[i];
+               if (!matchField->included_ar[i]) {
+                  continue;
+               }
+               filled[i] += matchField->required_ar[i];
+               if (conversion < 0) {
+                  continue;
                }
+
+               ur_step *step = &prog->steps[prog->step_count++];
+               step->segment = segment;
+               step->src_offset = offset;
+               step->length = length;
+               step->dst_offset = matchField->offset_ar[i];
+               step->ifc = i;
+               step->conversion = conversion;
+               step->size = matchField->size;
             }
          } else {
-            // Dynamic element
-            matchField->valueSize = length;
-            matchField->value     = (void*) (data_record + offset + size_length);
-            matchField->valueFilled = 1;
-            // Fill required count for Unirec where this element is required
+            // Dynamic element, only pointer to the value is stored
+            ur_dyn_step *dyn = &prog->dyn_steps[prog->dyn_count++];
+            dyn->segment = segment;
+            dyn->src_offset = offset;
+            dyn->length = length;
+            dyn->field = matchField;
             for (int i = 0; i < conf->ifc_count; i++) {
-               // For every interface
                if (matchField->included_ar[i]) {
-                  // If element is present in current ifc
-                  conf->ifc[i].requiredFilled += matchField->required_ar[i];
+                  filled[i] += matchField->required_ar[i];
                }
             }
          }
@@ -412,11 +405,238 @@ static uint16_t process_record(char *data_record, struct ipfix_template *templat
          index++;
       }
 
-      /* Skip the length of the value */
-      offset += length + size_length;
+      /* Variable length field closes the segment */
+      if (length == VAR_IE_LENGTH) {
+         prog->var_offset[prog->var_count++] = offset;
+         segment++;
+         offset = 0;
+      } else {
+         offset += length;
+      }
+   }
+   prog->tail_length = offset;
+
+   // Required fields are given by the template, decide about sending now
+   for (int i = 0; i < conf->ifc_count; i++) {
+      prog->send[i] = (conf->ifc[i].requiredCount == filled[i]);
+   }
+   free(filled);
+
+   // Drop operations for interfaces that are never sent
+   kept = 0;
+   for (int i = 0; i < prog->step_count; i++) {
+      if (prog->send[prog->steps[i].ifc]) {
+         prog->steps[kept++] = prog->steps[i];
+      }
+   }
+   prog->step_count = kept;
+
+   // Make sure that there is enough space for segment offsets
+   if (conf->seg_alloc < prog->var_count + 1) {
+      uint32_t *tmp = realloc(conf->seg_base, sizeof(uint32_t) * (prog->var_count + 1));
+      if (!tmp) {
+         MSG_ERROR(msg_module, "Out of memory (%s:%d)", __FILE__, __LINE__);
+         destroy_program(prog);
+         return NULL;
+      }
+      conf->seg_base = tmp;
+      conf->seg_alloc = prog->var_count + 1;
+   }
+
+   MSG_DEBUG(msg_module, "Built translation program for template %u: %u operations, %u dynamic fields, %u variable length fields",
+         template->template_id, prog->step_count, prog->dyn_count, prog->var_count);
+
+   return prog;
+}
+
+/**
+ * \brief Get translation program for given template
+ *
+ * Programs are cached by ODID and template ID. Program is rebuilt when the
+ * template was replaced (withdrawn and defined again).
+ *
+ * @param template IPFIX template
+ * @param odid Observation Domain ID of the message
+ * @param conf Plugin configuration
+ * @return Translation program, NULL on error
+ */
+static ur_program *get_program(struct ipfix_template *template, uint32_t odid, unirec_config *conf)
+{
+   uint64_t key = (((uint64_t) odid) << 32) | template->template_id;
+   ur_program **cached, *prog, *lost = NULL;
+
+   cached = fht_get_data(conf->ht_programs, &key);
+   if (cached && (*cached)->tmpl == template &&
+         (*cached)->first_transmission == template->first_transmission) {
+      return *cached;
+   }
+
+   prog = build_program(template, conf);
+   if (!prog) {
+      return NULL;
+   }
+
+   if (cached) {
+      // Template was replaced
+      destroy_program(*cached);
+      *cached = prog;
+      return prog;
+   }
+
+   if (fht_insert(conf->ht_programs, &key, &prog, NULL, &lost) == FHT_INSERT_LOST) {
+      // Oldest program in the row was replaced
+      destroy_program(lost);
+   }
+
+   return prog;
+}
+
+/**
+ * \brief Read length of variable length field
+ *
+ * @param data Beginning of the field
+ * @param size_length Size of the length prefix is stored here
+ * @return Length of the value
+ */
+static inline uint16_t read_var_length(char *data, uint16_t *size_length)
+{
+   uint16_t length = read8(data);
+
+   if (length == 255) {
+      *size_length = 3;
+      return ntohs(read16(data + 1));
+   }
+
+   *size_length = 1;
+   return length;
+}
+
+/**
+ * \brief Get data from data record
+ *
+ * Runs translation program of the template on the record. Static values are
+ * stored to UniRec buffers of interfaces, dynamic values are referenced by
+ * UniRec fields.
+ *
+ * \param[in] data_record IPFIX data record
+ * \param[in] max_length Number of bytes to the end of the data set
+ * \param[in] prog translation program of the record's template
+ * \param[out] conf structure containing necessary information for converting ipfix to unirec
+ * \return length of the data record, 0 on malformed record
+ */
+static uint16_t process_record(char *data_record, uint32_t max_length, const ur_program *prog, unirec_config *conf)
+{
+   uint32_t *base = conf->seg_base;
+   uint32_t pos, record_length;
+   uint16_t length, size_length;
+   uint64_t sec, msec, frac;
+   char *src, *dst;
+
+   // Find beginning of each segment
+   base[0] = 0;
+   for (int k = 0; k < prog->var_count; k++) {
+      pos = base[k] + prog->var_offset[k];
+      if (pos + 1 > max_length || (read8(data_record + pos) == 255 && pos + 3 > max_length)) {
+         return 0;
+      }
+      length = read_var_length(data_record + pos, &size_length);
+      base[k + 1] = pos + size_length + length;
+   }
+
+   record_length = base[prog->var_count] + prog->tail_length;
+   if (record_length > max_length || record_length == 0) {
+      return 0;
+   }
+
+    // Fill ODID (link bit field) in all ifc where it is included
+    // Only do this if using ODID MANAGER method
+    if (conf->ODID_get_method == ODID_MANAGER_METHOD) {
+        for (int i = 0; i < conf->ifc_count; i++) {
+            if (conf->LBF_field->included_ar[i]) {
+                *(uint64_t*)(conf->ifc[i].buffer + conf->LBF_field->offset_ar[i]) = 1LLU << (conf->odid - 1);
+            }
+        }
+    }
+
+   // Static fields
+   for (int s = 0; s < prog->step_count; s++) {
+      const ur_step *step = &prog->steps[s];
+
+      src = data_record + base[step->segment] + step->src_offset;
+      dst = conf->ifc[step->ifc].buffer + step->dst_offset;
+      length = step->length;
+      if (length == VAR_IE_LENGTH) {
+         length = read_var_length(src, &size_length);
+         src += size_length;
+      }
+
+      switch (step->conversion) {
+      case UR_CONV_COPY:
+         data_copy(dst, src, length);
+         break;
+      case UR_CONV_COPY_CHECKED:
+         if (step->size >= length) {
+            data_copy(dst, src, length);
+         } else {
+            memset(dst, 0xFF, step->size);
+         }
+         break;
+      case UR_CONV_SATURATE:
+         memset(dst, 0xFF, step->size);
+         break;
+      case UR_CONV_IP4:
+         // Put IPv4 into 128 bits in a special way (see ipaddr.h in Nemea-UniRec for details)
+         *(uint64_t*)(dst) = 0;
+         *(uint32_t*)(dst + 8) = *(uint32_t*)(src);
+         *(uint32_t*)(dst + 12) = 0xffffffff;
+         break;
+      case UR_CONV_IP:
+         memcpy(dst, src, length);
+         break;
+      case UR_CONV_PACKET32:
+         *(uint32_t*)(dst) = ntohl(*(uint32_t*)(src));
+         break;
+      case UR_CONV_PACKET64:
+         *(uint32_t*)(dst) = ntohl(*(uint32_t*)(src + 4));
+         break;
+      case UR_CONV_PACKET_INVALID:
+         *(uint32_t*)(dst) = 0xFFFFFFFF;
+         break;
+      case UR_CONV_TS:
+         // Handle Time variables
+         msec = be64toh(*(uint64_t*)(src));
+         sec = msec / 1000;
+         frac = ((msec % 1000) * 0x4189374BC6A7EFULL) >> 32;
+         *(uint64_t*)(dst) = (sec<<32) | frac;
+         break;
+      case UR_CONV_DBF:
+         // Handle DIR_BIT_FIELD
+         *(uint8_t*)(dst) = ((*(uint16_t*)(src)) >> 8) & 0x1;
+         break;
+      case UR_CONV_LBF:
+         // Handle LINK_BIT_FIELD, is BIG ENDIAN but we are using only LSB
+         *(uint64_t*)(dst) = 1LLU << ((*(uint8_t*)(src + 3)) - 1);
+         break;
+      }
+   }
+
+   // Dynamic fields
+   for (int d = 0; d < prog->dyn_count; d++) {
+      const ur_dyn_step *dyn = &prog->dyn_steps[d];
+
+      src = data_record + base[dyn->segment] + dyn->src_offset;
+      length = dyn->length;
+      if (length == VAR_IE_LENGTH) {
+         length = read_var_length(src, &size_length);
+         src += size_length;
+      }
+
+      dyn->field->valueSize = length;
+      dyn->field->value = (void*) src;
+      dyn->field->valueFilled = 1;
    }
 
-   return offset;
+   return record_length;
 }
 
 /**
@@ -464,8 +684,9 @@ static int process_data_sets(const struct ipfix_message *ipfix_msg, unirec_confi
    struct ipfix_data_set *data_set;
    char *data_record;
    struct ipfix_template *template;
-   uint32_t offset;
+   uint32_t offset, set_length;
    uint16_t min_record_length, ret = 0;
+   ur_program *prog;
    int i;
 
    // ********** Store ODID *************
@@ -487,19 +708,25 @@ static int process_data_sets(const struct ipfix_message *ipfix_msg, unirec_confi
          continue;
       }
 
+      prog = get_program(template, ODID, conf);
+      if (prog == NULL) {
+         return -1;
+      }
+
       min_record_length = template->data_length;
       offset = 4;  /* Size of the header */
+      set_length = ntohs(data_set->header.length);
 
       if (min_record_length & 0x8000) {
          /* Record contains fields with variable length */
          min_record_length = min_record_length & 0x7fff; /* size of the fields, variable fields excluded  */
       }
 
-      while ((int) ntohs(data_set->header.length) - (int) offset - (int) min_record_length >= 0) {
+      while ((int) set_length - (int) offset - (int) min_record_length >= 0) {
          data_record = (((char *) data_set) + offset);
 
          // Process data record only once
-         ret = process_record(data_record, template, conf);
+         ret = process_record(data_record, set_length - offset, prog, conf);
 
          // Check that the record was processes successfuly
          if (ret == 0) {
@@ -508,8 +735,8 @@ static int process_data_sets(const struct ipfix_message *ipfix_msg, unirec_confi
 
           //Fill dynamic fields for every UniRec record and send it
          for (i = 0; i < conf->ifc_count; i++) {
-            // Check if we have all required fields
-            if (conf->ifc[i].requiredCount == conf->ifc[i].requiredFilled) {
+            // Check if the template contains all required fields
+            if (prog->send[i]) {
                // Fill dynamic fields if there are ones
                if (conf->ifc[i].dynamic) {
                   process_dynamic(&(conf->ifc[i]));
@@ -531,7 +758,6 @@ static int process_data_sets(const struct ipfix_message *ipfix_msg, unirec_confi
             // Clear static fields
             memset(conf->ifc[i].buffer, 0, conf->ifc[i].bufferStaticSize);
 
-            conf->ifc[i].requiredFilled = 0;
             conf->ifc[i].bufferDynSize = 0;
          }
 
@@ -1122,6 +1348,16 @@ static int parse_format(unirec_config *conf_plugin)
    }
    conf_plugin->ht_fields = ht;
 
+   // ***** Create cache of translation programs *****
+   conf_plugin->ht_programs = fht_init(PROGRAMS_HT_ROWS,
+         PROGRAMS_HT_KEYSIZE,
+         sizeof(ur_program*),
+         PROGRAMS_HT_STASH_SIZE);
+   if (conf_plugin->ht_programs == NULL) {
+      MSG_ERROR(msg_module, "Could not create cache of translation programs!");
+      return 1;
+   }
+
    return 0;
 }
 
@@ -1299,7 +1535,6 @@ int storage_init (char *params, void **config)
       conf->ifc[i].special_field_odid = NULL;
       conf->ifc[i].special_field_link_bit_field = NULL;
       conf->ifc[i].requiredCount = 0;
-      conf->ifc[i].requiredFilled = 0;
       conf->ifc[i].bufferStaticSize = 0;
       conf->ifc[i].bufferDynSize = 0;
       conf->ifc[i].bufferAllocSize = 0;
@@ -1456,6 +1691,19 @@ int storage_close (void **config)
 
    trap_ctx_finalize(&conf->trap_ctx_ptr);
 
+   // Free translation programs
+   if (conf->ht_programs) {
+      fht_iter_t *iter = fht_init_iter(conf->ht_programs);
+      if (iter) {
+         while (fht_get_next_iter(iter) == FHT_ITER_RET_OK) {
+            destroy_program(*(ur_program **) iter->data_ptr);
+         }
+         fht_destroy_iter(iter);
+      }
+      fht_destroy(conf->ht_programs);
+   }
+   free(conf->seg_base);
+
    // Free everything
    int i;
    for (i = 0 ; i < conf->ifc_count; i++) {
@@ -41,7 +41,7 @@
 #ifndef IPFIX2UNIREC_H_
 #define IPFIX2UNIREC_H_
 
-#include "fast_hash_table.h"
+#include <ipfixcol/fast_hash_table.h>
 
 
 
@@ -52,6 +52,9 @@
 #define FIELDS_HT_ROW_FIELDSCOUNT_MULTIPLAYER 8
 #define FIELDS_HT_KEYSIZE 8 // ipfix id + en + padding in bytes (2 + 4 + 2)
 #define FIELDS_HT_STASH_SIZE 4
+#define PROGRAMS_HT_ROWS 256 // x4 columns, number of cached template programs
+#define PROGRAMS_HT_KEYSIZE 8 // odid + template id in bytes (4 + 2 + 2 padding)
+#define PROGRAMS_HT_STASH_SIZE 4
 
 #define UNIREC_DATA_TYPES_COUNT 15 ///< Count of UniRec data types
 #define UNIREC_DEFAULT_LENGTH_OF_DATA_FORMAT 1024 /// Length of string of a template
@@ -71,6 +74,23 @@ enum unirecFieldEnum {
 };
 
 
+/**
+ * \brief Conversions applied when a value is copied from IPFIX record to UniRec
+ */
+enum ur_conversion {
+   UR_CONV_COPY,            /**< Copy with conversion to host byte order */
+   UR_CONV_COPY_CHECKED,    /**< Copy or saturate, decided by runtime length (variable length source) */
+   UR_CONV_SATURATE,        /**< IPFIX value is larger than UniRec field, set maximum value */
+   UR_CONV_IP4,             /**< IPv4 address stored in 128 bit UniRec address */
+   UR_CONV_IP,              /**< IPv6 address copied as is */
+   UR_CONV_PACKET32,        /**< 32 bit packet counter */
+   UR_CONV_PACKET64,        /**< 64 bit packet counter truncated to 32 bits */
+   UR_CONV_PACKET_INVALID,  /**< Packet counter of unsupported size */
+   UR_CONV_TS,              /**< Millisecond timestamp to UniRec time */
+   UR_CONV_DBF,             /**< DIR_BIT_FIELD */
+   UR_CONV_LBF              /**< LINK_BIT_FIELD (joinflows method) */
+};
+
 enum ODID_get_methods {
    ODID_JOINFLOWS_METHOD,
    ODID_MANAGER_METHOD
@@ -107,6 +127,52 @@ typedef struct unirecField {
 } unirecField;
 
 
+/**
+ * \brief One copy operation of a translation program
+ *
+ * Source position is given by a segment and offset in it. Segment N starts
+ * right after the N-th variable length field of the record, segment 0 starts
+ * at the beginning of the record.
+ */
+typedef struct ur_step {
+   uint16_t segment;     /**< Segment of the record containing the value */
+   uint16_t src_offset;  /**< Offset of the value in the segment */
+   uint16_t length;      /**< Length of the IPFIX value or VAR_IE_LENGTH */
+   uint16_t dst_offset;  /**< Offset in UniRec buffer of the interface */
+   uint8_t ifc;          /**< Destination interface */
+   uint8_t conversion;   /**< Conversion, see `ur_conversion` */
+   int8_t size;          /**< Size of UniRec field */
+} ur_step;
+
+/**
+ * \brief Reference to a dynamic UniRec field in the record
+ */
+typedef struct ur_dyn_step {
+   uint16_t segment;     /**< Segment of the record containing the value */
+   uint16_t src_offset;  /**< Offset of the value in the segment */
+   uint16_t length;      /**< Length of the IPFIX value or VAR_IE_LENGTH */
+   unirecField *field;   /**< Dynamic UniRec field */
+} ur_dyn_step;
+
+/**
+ * \brief IPFIX to UniRec translation program
+ *
+ * The program is built once for each template and cached until the template
+ * is replaced (different template structure or time of first transmission).
+ */
+typedef struct ur_program {
+   const struct ipfix_template *tmpl;  /**< Template used to build the program (only compared, never dereferenced) */
+   time_t first_transmission;          /**< First transmission of the template */
+   uint16_t var_count;                 /**< Number of variable length fields */
+   uint16_t *var_offset;               /**< Offset of each variable length field in its segment */
+   uint16_t tail_length;               /**< Length of the last segment */
+   uint16_t step_count;                /**< Number of static copy operations */
+   ur_step *steps;                     /**< Static copy operations */
+   uint16_t dyn_count;                 /**< Number of dynamic fields */
+   ur_dyn_step *dyn_steps;             /**< Dynamic fields */
+   uint8_t *send;                      /**< Per interface flag, set when all required fields are present */
+} ur_program;
+
 /**
  * \struct interface
  *
@@ -128,7 +194,6 @@ typedef struct ifc_config {
    int				dynamicPartOffset;	/**< Offset of current position in dynamic part of record (sum of dynamic field sizes) */
    int				bufferOffset;
    uint8_t				requiredCount;	/**< Count of all required Unirec fields */
-   uint8_t				requiredFilled;	/**< Count of filled required Unirec fields */
    uint16_t 			bufferStaticSize;
    uint8_t 			dynamic;
    uint16_t 			dynCount;
@@ -158,6 +223,9 @@ typedef struct unirec_config {
     uint8_t ODID_get_method;
    uint8_t SF_DATA;
    fht_table_t *ht_fields;
+   fht_table_t *ht_programs;	/**< Translation programs indexed by ODID and template ID */
+   uint32_t *seg_base;		/**< Offsets of record segments, used while processing a record */
+   uint16_t seg_alloc;		/**< Allocated size of `seg_base` */
 } unirec_config;
 
 
@@ -43,6 +43,9 @@
 #include <stdexcept>
 
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sys/prctl.h>
@@ -52,20 +55,50 @@ static const char *msg_module = "Cleaner";
 namespace fbitexpire {
 
 /**
- * \brief Stop cleaner thread
+ * \brief Run cleaner threads
+ * 
+ * \param threads Number of worker threads
+ * \param rate Maximal number of removed bytes per second (0 = unlimited)
+ */
+void Cleaner::run(unsigned threads, uint64_t rate)
+{
+	_done = false;
+	_rate = rate;
+	_next = std::chrono::steady_clock::now();
+	
+	if (threads == 0) {
+		threads = 1;
+	}
+	
+	for (unsigned i = 0; i < threads; ++i) {
+		_workers.push_back(std::thread(&Cleaner::loop, this));
+	}
+	
+	MSG_DEBUG(msg_module, "started %u threads", threads);
+}
+
+/**
+ * \brief Stop cleaner threads (after all queued directories are removed)
  */
 void Cleaner::stop()
 {
-	_done = true;
-	_cv.notify_one();
+	{
+		std::lock_guard<std::mutex> lock(_dirs_lock);
+		_done = true;
+	}
+	_cv.notify_all();
 	
-	if (_th.joinable()) {
-		_th.join();
+	for (auto &th: _workers) {
+		if (th.joinable()) {
+			th.join();
+		}
 	}
+	
+	_workers.clear();
 }
 
 /**
- * \brief Main loop
+ * \brief Main loop of one worker
  */
 void Cleaner::loop()
 {	
@@ -73,94 +106,186 @@ void Cleaner::loop()
 	
 	MSG_DEBUG(msg_module, "started");
 	
-	std::mutex mtx;
-	std::unique_lock<std::mutex> lock{mtx};
+	jobPtr job;
+	bool finished = false;
 	
-	while (!_done) {
-		/* Wait for some event */
-		_cv.wait(lock, [&]{ return count() > 0 || _done; });
-		
-		if (_done) {
-			break;
+	while ((job = getNextJob(finished))) {
+		try {
+			remove(job);
+		} catch (std::exception &e) {
+			MSG_ERROR(msg_module, e.what());
 		}
+		finished = true;
+	}
+	
+	MSG_DEBUG(msg_module, "closing thread");
+}
+
+/**
+ * \brief Wait until removing \p size bytes fits into the rate limit
+ * 
+ * \param size Size of file that is going to be removed
+ */
+void Cleaner::throttle(uint64_t size)
+{
+	std::chrono::steady_clock::time_point now, start;
+	
+	{
+		std::lock_guard<std::mutex> lock(_rate_lock);
 		
-		/* Remove everything in queue */
-		while (count() > 0) {
-			try {
-				remove(getNextDir());
-			} catch (std::exception &e) {
-				MSG_ERROR(msg_module, e.what());
-			}
+		now = std::chrono::steady_clock::now();
+		if (_next < now) {
+			_next = now;
 		}
+		
+		/* Reserve time slot for this file */
+		start = _next;
+		_next += std::chrono::microseconds(size * 1000000 / _rate);
 	}
 	
-	MSG_DEBUG(msg_module, "closing thread");
+	if (start > now) {
+		std::this_thread::sleep_until(start);
+	}
 }
 
 /**
- * \brief Remove directory recursively
+ * \brief Remove files of directory and queue its subdirectories
+ * 
+ * \param job Directory to remove
  */
-void Cleaner::remove(std::string path)
+void Cleaner::remove(jobPtr job)
 {
 	struct stat st;
 	struct dirent *entry;
-	std::string entry_name, entry_path;
+	std::vector<jobPtr> subdirs;
+	bool is_dir, have_stat;
 	
 	/* open directory */
-	DIR *dir = opendir(path.c_str());
+	DIR *dir = opendir(job->path.c_str());
 	
 	if (!dir) {
-		throw std::invalid_argument(std::string("cannot open directory " + path));
+		if (errno != ENOENT) {
+			MSG_ERROR(msg_module, "cannot open directory %s (%s)", job->path.c_str(), strerror(errno));
+		}
+		finish(job);
+		return;
 	}
 	
+	int fd = dirfd(dir);
+	
 	while ((entry = readdir(dir))) {
-		entry_name = entry->d_name;
-		if (entry_name == "." || entry_name == "..") {
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
 			continue;
 		}
 		
-		/* get full entry path */
-		entry_path = path + "/" + entry_name;
-		if (!stat(entry_path.c_str(), &st) && S_ISDIR(st.st_mode)) {
-			/* remove subdirectory */
-			remove(entry_path);
+		/* Filesystem may not provide entry type, stat it in that case */
+		have_stat = false;
+		if (entry->d_type == DT_UNKNOWN) {
+			if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+				continue;
+			}
+			have_stat = true;
+			is_dir = S_ISDIR(st.st_mode);
 		} else {
-			/* remove file */
-			unlink(entry_path.c_str());
+			is_dir = (entry->d_type == DT_DIR);
 		}
+		
+		if (is_dir) {
+			/* subdirectory is removed as separate job */
+			subdirs.push_back(std::make_shared<Job>(job->path + "/" + entry->d_name, job));
+			job->pending++;
+			continue;
+		}
+		
+		if (_rate > 0 && (have_stat || !fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW))) {
+			throttle(st.st_size);
+		}
+		
+		/* remove file */
+		unlinkat(fd, entry->d_name, 0);
 	}
 
-	/* close and remove directory */
 	closedir(dir);
-	rmdir(path.c_str());
+	
+	if (!subdirs.empty()) {
+		/* Subdirectories go to the front so the removal proceeds depth-first */
+		std::lock_guard<std::mutex> lock(_dirs_lock);
+		
+		_jobs.insert(_jobs.begin(), subdirs.begin(), subdirs.end());
+		_count += subdirs.size();
+		_cv.notify_all();
+	}
+	
+	finish(job);
+}
+
+/**
+ * \brief Finish job - remove directory (and its parents) when all their jobs are done
+ * 
+ * \param job Finished job
+ */
+void Cleaner::finish(jobPtr job)
+{
+	while (job && --job->pending == 0) {
+		if (rmdir(job->path.c_str()) && errno != ENOENT) {
+			MSG_ERROR(msg_module, "cannot remove directory %s (%s)", job->path.c_str(), strerror(errno));
+		}
+		job = job->parent;
+	}
 }
 
 /**
  * \brief Remove directory - add it to queue
  */
 void Cleaner::removeDir(std::string path)
+{
+	removeDirs(std::vector<std::string>{path});
+}
+
+/**
+ * \brief Remove batch of directories - add them to queue
+ */
+void Cleaner::removeDirs(const std::vector<std::string> &paths)
 {
 	/* Lock queue - lock guard releases mutex when out of scope */
 	std::lock_guard<std::mutex> lock(_dirs_lock);
 	
-	_dirs.push(path);
-	_count++;
-	_cv.notify_one();
+	for (auto &path: paths) {
+		_jobs.push_back(std::make_shared<Job>(path, nullptr));
+		_count++;
+	}
+	_cv.notify_all();
 }
 
 /**
- * \brief Get directory to remove
+ * \brief Get next directory to remove (blocks until there is one)
+ * 
+ * \param finished True if the calling worker has finished its previous job
+ * \return Job or nullptr when cleaner is stopped and there is nothing left to remove
  */
-std::string Cleaner::getNextDir()
+Cleaner::jobPtr Cleaner::getNextJob(bool finished)
 {
 	/* Lock queue */
-	std::lock_guard<std::mutex> lock(_dirs_lock);
-	std::string path = _dirs.front();
+	std::unique_lock<std::mutex> lock(_dirs_lock);
+	
+	if (finished && --_running == 0 && _done) {
+		/* Wake up workers waiting for subdirectories of this job */
+		_cv.notify_all();
+	}
+	
+	/* Running jobs can add subdirectories, so wait for them before exiting */
+	_cv.wait(lock, [&]{ return count() > 0 || (_done && _running == 0); });
+	if (count() == 0) {
+		return nullptr;
+	}
+	
+	jobPtr job = _jobs.front();
 	
-	_dirs.pop();
+	_jobs.pop_front();
 	_count--;
+	_running++;
 	
-	return path;
+	return job;
 }
 
 } /* end of namespace fbitexpire */
@@ -42,34 +42,64 @@
 
 #include "fbitexpire.h"
 #include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <vector>
 #include <condition_variable>
 
 namespace fbitexpire {
 
 /**
- * \brief Cleaner class - thread for removing old directories
+ * \brief Cleaner class - threads for removing old directories
+ *
+ * Directories are removed by a pool of workers. Each subdirectory is a separate
+ * job so even a single large directory is removed in parallel. Directory itself
+ * is removed by the worker which finishes its last job.
  */
 class Cleaner : public FbitexpireThread {
+    using FbitexpireThread::run;
 public:
     Cleaner() {}
-    ~Cleaner() {}
+    ~Cleaner() { stop(); }
     
+    void run(unsigned threads = 1, uint64_t rate = 0);
     void removeDir(std::string path);
+    void removeDirs(const std::vector<std::string> &paths);
     void stop();
 private:
+    /**
+     * \brief Directory being removed
+     */
+    struct Job {
+        Job(std::string p, std::shared_ptr<Job> par): path{p}, parent{par} {}
+        std::string path;            /**< directory path                       */
+        std::shared_ptr<Job> parent; /**< parent directory (nullptr for top)   */
+        std::atomic<int> pending{1}; /**< unfinished subdirectories + itself   */
+    };
+    using jobPtr = std::shared_ptr<Job>;
+
     void loop();
 
-    void remove(std::string path);
+    void remove(jobPtr job);
+    void finish(jobPtr job);
+    void throttle(uint64_t size);
     int  count() { return _count.load(); }
 
-    std::string getNextDir();
+    jobPtr getNextJob(bool finished);
     
-    std::mutex _dirs_lock;         /**< lock for dirs queue */
-    std::atomic<int> _count{0};    /**< directories counter */
-    std::queue<std::string> _dirs; /**< directories queue   */
+    std::mutex _dirs_lock;         /**< lock for jobs queue */
+    std::atomic<int> _count{0};    /**< jobs counter        */
+    int _running = 0;              /**< jobs being processed */
+    std::deque<jobPtr> _jobs;      /**< jobs queue          */
     std::condition_variable _cv;   /**< condition variable  */
+    
+    std::vector<std::thread> _workers; /**< worker threads */
+    
+    uint64_t _rate = 0;            /**< max. removed bytes per second (0 = unlimited) */
+    std::mutex _rate_lock;         /**< lock for rate limiter */
+    std::chrono::steady_clock::time_point _next; /**< time when next removal can start */
 };
 
 } /* end of namespace fbitexpire */
@@ -127,6 +127,19 @@ void Directory::rescan()
 	setSize(size);
 }
 
+/**
+ * \brief Store directory size into stats file so next scans don't have to count it
+ */
+void Directory::writeStats()
+{
+	std::string statsfile(_name + "/stats.txt");
+	
+	MSG_DEBUG(msg_module, "writing %s", statsfile.c_str());
+	std::ofstream sfile(statsfile, std::ios::out);
+	sfile << _size;
+	sfile.close();
+}
+
 /**
  * \brief Remove the oldest child from vector
  */
@@ -62,6 +62,9 @@ public:
 
     bool isActive()                    { return   _active; }    
     void setActive(bool active = true) { _active = active; }
+    
+    bool isTracked()                     { return    _tracked; }
+    void setTracked(bool tracked = true) { _tracked = tracked; }
      
     dirVec &getChildren() { return _children; }
     
@@ -90,6 +93,7 @@ public:
     
     void rescan();
     void updateAge();
+    void writeStats();
     
     uint64_t countSize()      { return dirSize(_name, false, true, true);   }
     uint64_t countFilesSize() { return dirSize(_name, false, false, false); }
@@ -106,6 +110,7 @@ private:
     int _depth;            /**< depth */
     Directory *_parent;    /**< parent directory */
     bool _active = false;  /**< activity flag - true if data writer writes into this folder */
+    bool _tracked = false; /**< size is kept up to date by watcher (no need to scan it) */
     
     dirVec   _children;    /**< children vector */
     uint64_t _size = 0;    /**< directory size in bytes */
@@ -47,7 +47,9 @@
 #include <stdexcept>
 #include <sys/prctl.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <cstdio>
 #include <iomanip>
 #include <mutex>
 #include <sstream>
@@ -85,6 +87,11 @@ void Scanner::stop()
 	if (_th.joinable()) {
 		_th.join();
 	}
+	
+	/* Store sizes so the next start does not have to scan everything again */
+	if (_rootdir) {
+		saveCache();
+	}
 }
 
 /**
@@ -110,12 +117,17 @@ void Scanner::loop()
 		
 		MSG_DEBUG(msg_module, "Total size: %s, Max: %s, Watermark: %s", 
 			sizeToStr(totalSize()).c_str(), sizeToStr(_max_size).c_str(), sizeToStr(_watermark).c_str());
-		_cv.wait(lock, [&]{ return scanCount() > 0 || addCount() > 0 || _done || totalSize() > _max_size; });
+		_cv.wait(lock, [&]{ return scanCount() > 0 || addCount() > 0 || sizeCount() > 0 || _done || totalSize() > _max_size; });
 		
 		if (_done) {
 			break;
 		}
 		
+		/* Apply size changes reported by watcher */
+		if (sizeCount() > 0) {
+			addSizes();
+		}
+		
 		/* Add dirs from queue */
 		if (addCount() > 0) {
 			addNewDirs();
@@ -125,6 +137,10 @@ void Scanner::loop()
 		if (scanCount() > 0) {
 			rescanDirs();
 		}
+		
+		if (_cache_dirty && time(NULL) - _cache_saved >= CACHE_SAVE_INTERVAL) {
+			saveCache();
+		}
 	}
 	
 	MSG_DEBUG(msg_module, "closing thread");
@@ -177,21 +193,32 @@ Directory *Scanner::getDirToRemove()
 
 /**
  * \brief Remove directories until total size > watermark
+ *
+ * All directories are passed to the cleaner in one batch when the watermark
+ * is reached (or there is nothing more to remove).
  */
 void Scanner::removeDirs()
 {
 	Directory *dir, *parent;
+	std::vector<std::string> batch;
+	uint64_t removed{0};
 	
 	while (totalSize() > _watermark) {
 		dir = getDirToRemove();
 		
 		if (!dir) {
 			MSG_WARNING(msg_module, "cannot remove data (only active directories)");
-			return;
+			break;
 		}
 		
 		MSG_DEBUG(msg_module, "remove %s", dir->getName().c_str());
-		_cleaner->removeDir(dir->getName());
+		
+		/* Subdirectories removed earlier are removed together with their parent */
+		std::string prefix = dir->getName() + "/";
+		batch.erase(std::remove_if(batch.begin(), batch.end(), [&prefix](const std::string &path) {
+			return path.compare(0, prefix.length(), prefix) == 0; }), batch.end());
+		batch.push_back(dir->getName());
+		removed += dir->getSize();
 		
 		/* Remove dir from its parent */
 		parent = dir->getParent();
@@ -211,6 +238,12 @@ void Scanner::removeDirs()
 			_rootdir->sortChildren();
 		}
 	}
+	
+	if (!batch.empty()) {
+		MSG_INFO(msg_module, "removing %lu directories (%s)", batch.size(), sizeToStr(removed).c_str());
+		_cleaner->removeDirs(batch);
+		_cache_dirty = true;
+	}
 }
 
 /**
@@ -235,8 +268,39 @@ void Scanner::rescanDirs()
 			continue;
 		}
 
-		/* rescan directory */
+		/* rescan directory and correct size of its predecessors */
+		int64_t oldSize = dir->getSize();
 		dir->rescan();
+		propagateSize(dir->getParent(), (int64_t) dir->getSize() - oldSize);
+		_cache_dirty = true;
+	}
+}
+
+/**
+ * \brief Apply size changes of directories
+ */
+void Scanner::addSizes()
+{
+	Directory *dir;
+	int64_t delta;
+	
+	while (sizeCount() > 0) {
+		std::tie(dir, delta) = getNextSize();
+		propagateSize(dir, delta);
+	}
+}
+
+/**
+ * \brief Change size of directory and all its predecessors
+ * 
+ * \param dir Directory
+ * \param delta Size difference
+ */
+void Scanner::propagateSize(Directory *dir, int64_t delta)
+{
+	while (dir) {
+		dir->setSize(dir->getSize() + delta);
+		dir = dir->getParent();
 	}
 }
 
@@ -246,12 +310,18 @@ void Scanner::rescanDirs()
 void Scanner::addNewDirs()
 {
 	Directory *dir, *parent;
-	uint64_t newSize;
+	int64_t newSize;
 	
 	while (addCount() > 0) {
 		std::tie(dir, parent) = getNextAdd();
+		
+		/* Size changes reported before the directory was finished must be applied first */
+		addSizes();
+		
 		MSG_DEBUG(msg_module, "Adding %s", dir->getName().c_str());
-		parent->addChild(dir);
+		if (std::find(parent->getChildren().begin(), parent->getChildren().end(), dir) == parent->getChildren().end()) {
+			parent->addChild(dir);
+		}
 		
 		/* 
 		 * If directory is NOT active, it means that it is final tree node (leaf)
@@ -261,13 +331,22 @@ void Scanner::addNewDirs()
 			continue;
 		}
 		
-		/* Set directory age */
-		dir->detectAge();
+		_cache_dirty = true;
 		
-		/* Get directory size */
-		dir->setSize(dir->countSize());
+		if (dir->isTracked()) {
+			/* Size is already known (and propagated) from watcher's events */
+			dir->writeStats();
+			dir->detectAge();
+			continue;
+		}
 		
+		/* Get directory size, the part which is already counted in predecessors is subtracted */
 		newSize = dir->getSize();
+		dir->setSize(dir->countSize());
+		newSize = dir->getSize() - newSize;
+		
+		/* Set directory age (after stats file is written) */
+		dir->detectAge();
 		
 		/* Propagate size to predecessors */
 		while (parent) {
@@ -292,10 +371,10 @@ void Scanner::popNewestChild(Directory *parent)
 	parent->getChildren().pop_back();
 	
 	/* Decrease size of each predecessor */
-	while (parent) {
-		parent->setSize(parent->getSize() - dir->getSize());
-		parent = parent->getParent();
-	}
+	propagateSize(parent, -(int64_t) dir->getSize());
+	
+	/* Directory is not counted anywhere now */
+	dir->setSize(0);
 }
 
 /**
@@ -329,6 +408,37 @@ Scanner::addPair Scanner::getNextAdd()
 	return pair;
 }
 
+/**
+ * \brief Add request to change size of directory
+ * 
+ * \param dir Directory
+ * \param delta Size difference
+ */
+void Scanner::addSize(Directory *dir, int64_t delta)
+{
+	std::lock_guard<std::mutex> lock(_size_lock);
+	
+	_to_size.push(std::make_pair(dir, delta));
+	_size_count++;
+	_cv.notify_one();
+}
+
+/**
+ * \brief Get next size change from queue
+ * 
+ * \return Pair - directory and size difference
+ */
+Scanner::sizePair Scanner::getNextSize()
+{
+	std::lock_guard<std::mutex> lock(_size_lock);
+	
+	sizePair pair = _to_size.front();
+	_to_size.pop();
+	_size_count--;
+	
+	return pair;
+}
+
 /**
  * \brief Add request to rescan directory
  * 
@@ -466,9 +576,17 @@ void Scanner::createDirTree(std::string basedir, int maxdepth, bool force)
 		_force = force;
 
 		MSG_DEBUG(msg_module, "Real max. depth is %d", _max_depth);
+		
+		if (!_force) {
+			loadCache();
+		}
+		
 		MSG_DEBUG(msg_module, "%s with depth %d added to scanner tree", basedir.c_str(), _rootdir->getDepth());
 		/* Add subdirectories (recursively) */
 		createDirTree(_rootdir);
+		
+		/* Cached sizes are not needed anymore */
+		_cache.clear();
 	} else {
 		throw std::invalid_argument(std::string("Cannot acces directory " + basedir));
 	}
@@ -481,6 +599,11 @@ void Scanner::createDirTree(std::string basedir, int maxdepth, bool force)
  */
 void Scanner::createDirTree(Directory* parent)
 {
+	if (parent != _rootdir && cachedSize(parent)) {
+		/* Directory did not change since the size was cached */
+		return;
+	}
+	
 	int depth = parent->getDepth() + 1;
 	if (depth > _max_depth) {
 		parent->setSize(Directory::dirSize(parent->getName(), _force));
@@ -538,6 +661,102 @@ void Scanner::createDirTree(Directory* parent)
 	parent->setSize(size);
 }
 
+/**
+ * \brief Get directory size from cache
+ * 
+ * \param dir Directory (its age must be set)
+ * \return True if the cached size is valid and was used
+ */
+bool Scanner::cachedSize(Directory *dir)
+{
+	auto it = _cache.find(dir->getName());
+	if (it == _cache.end() || it->second.age != dir->getAge()) {
+		return false;
+	}
+	
+	dir->setSize(it->second.size);
+	return true;
+}
+
+/**
+ * \brief Load size cache
+ *
+ * Each line contains size, age and path of the directory which has no children
+ * in the directory tree.
+ */
+void Scanner::loadCache()
+{
+	if (_cache_file.empty()) {
+		return;
+	}
+	
+	std::ifstream file(_cache_file, std::ios::in);
+	if (!file.is_open()) {
+		MSG_DEBUG(msg_module, "size cache %s not found", _cache_file.c_str());
+		return;
+	}
+	
+	CacheEntry entry;
+	std::string path;
+	
+	while (file >> entry.size >> entry.age && std::getline(file >> std::ws, path)) {
+		_cache[path] = entry;
+	}
+	
+	MSG_INFO(msg_module, "loaded %lu sizes from %s", _cache.size(), _cache_file.c_str());
+}
+
+/**
+ * \brief Write sizes of directories without children into cache file
+ */
+void Scanner::saveCache()
+{
+	if (_cache_file.empty()) {
+		return;
+	}
+	
+	/* Write into temporary file so the cache is never incomplete */
+	std::string tmp(_cache_file + ".tmp");
+	std::ofstream file(tmp, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) {
+		MSG_ERROR(msg_module, "cannot write size cache %s", tmp.c_str());
+		return;
+	}
+	
+	saveCache(file, _rootdir);
+	file.close();
+	
+	if (file.fail() || rename(tmp.c_str(), _cache_file.c_str())) {
+		MSG_ERROR(msg_module, "cannot write size cache %s", _cache_file.c_str());
+		unlink(tmp.c_str());
+		return;
+	}
+	
+	_cache_dirty = false;
+	_cache_saved = time(NULL);
+	MSG_DEBUG(msg_module, "size cache %s written", _cache_file.c_str());
+}
+
+/**
+ * \brief Write sizes of directory subtree into cache file
+ * 
+ * \param file Cache file
+ * \param dir Subtree root
+ */
+void Scanner::saveCache(std::ofstream &file, Directory *dir)
+{
+	if (dir->getChildren().empty()) {
+		if (dir != _rootdir && !dir->isActive()) {
+			file << dir->getSize() << " " << dir->getAge() << " " << dir->getName() << "\n";
+		}
+		return;
+	}
+	
+	for (auto child: dir->getChildren()) {
+		saveCache(file, child);
+	}
+}
+
 /**
  * \brief Constructor
  */
@@ -47,11 +47,17 @@
 
 #include <algorithm>
 #include <atomic>
+#include <ctime>
+#include <fstream>
 #include <vector>
 #include <queue>
 #include <mutex>
+#include <unordered_map>
 #include <condition_variable>
 
+/* Minimal interval between two writes of size cache (seconds) */
+#define CACHE_SAVE_INTERVAL 60
+
 namespace fbitexpire {
 
 /**
@@ -59,6 +65,7 @@ namespace fbitexpire {
  */
 class Scanner : public FbitexpireThread {
 	using addPair = std::pair<Directory *, Directory *>;
+	using sizePair = std::pair<Directory *, int64_t>;
 	using FbitexpireThread::run;
 public:
 	Scanner();
@@ -77,8 +84,11 @@ public:
 	void setWatermark(std::string wm) { setWatermark(strtoull(wm.c_str(), nullptr, 10)); }
 	
 	void addDir(Directory *dir, Directory *parent);
+	void addSize(Directory *dir, int64_t delta);
 	void rescan(std::string dir);
 	
+	void setCacheFile(std::string file) { _cache_file = file; }
+	
 	Directory *dirFromPath(std::string path);
 	
 	void stop();
@@ -93,17 +103,25 @@ private:
 	void createDirTree(Directory *parent);
 	int scanCount() { return _scan_count.load(); }
 	int addCount() { return  _add_count.load(); }
+	int sizeCount() { return _size_count.load(); }
 	
 	void addNewDirs();
+	void addSizes();
 	void rescanDirs();
 	void removeDirs();
 	
-	void propagateSize(Directory *parent, uint64_t size);
+	void propagateSize(Directory *dir, int64_t delta);
+	
+	void loadCache();
+	void saveCache();
+	void saveCache(std::ofstream &file, Directory *dir);
+	bool cachedSize(Directory *dir);
 	
 	uint64_t totalSize()   { return _rootdir->getSize();   }
 	
 	std::string getNextScan();
 	addPair     getNextAdd();
+	sizePair    getNextSize();
 	
 	Directory *getOldestDir(Directory *root);
 	Directory *getDirToRemove();
@@ -111,15 +129,28 @@ private:
 	Cleaner   *_cleaner;
 	Directory *_rootdir; /** Root directory */
 	
-	std::thread _th;
 	std::mutex _scan_lock;
 	std::mutex  _add_lock;
+	std::mutex _size_lock;
 	
 	std::atomic<int> _scan_count{0};
 	std::atomic<int>  _add_count{0};
+	std::atomic<int> _size_count{0};
 	
 	std::queue<std::string> _to_scan;
 	std::queue<addPair>     _to_add;
+	std::queue<sizePair>    _to_size;
+	
+	/** Size cache entry - size of directory with given age */
+	struct CacheEntry {
+		int age;
+		uint64_t size;
+	};
+	
+	std::string _cache_file;    /**< path to size cache (empty = disabled) */
+	std::unordered_map<std::string, CacheEntry> _cache; /**< sizes loaded from cache */
+	bool   _cache_dirty{false}; /**< tree changed since last save */
+	time_t _cache_saved{0};     /**< time of last save */
 	
 	int _max_depth;
 	
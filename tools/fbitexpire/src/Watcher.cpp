@@ -40,15 +40,27 @@
 #include "Watcher.h"
 #include "verbose.h"
 
+#include <chrono>
 #include <thread>
 #include <stdexcept>
 #include <iostream>
 
 #include <sys/prctl.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <signal.h>
+#include <string.h>
 
 static const char *msg_module = "Watcher";
 
+/**
+ * \brief SIGINT handler used to interrupt waiting for events
+ */
+static void interrupt(int param)
+{
+	(void) param;
+}
+
 namespace fbitexpire {
 
 /**
@@ -78,14 +90,21 @@ void Watcher::stop()
 	_done = true;
 
 	/*
-	 * Unregister signal handler so the default handler
-	 * will be called when watcher sends SIGINT to it's
-	 * main loop. This will cause inotify to exit read().
+	 * Register empty signal handler (without restarting system calls)
+	 * so SIGINT sent to watcher's main loop causes inotify to exit read()
+	 * and the other threads can be stopped properly.
 	 */
-	signal(SIGINT, SIG_DFL);
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = interrupt;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
 
-	/* Stop waiting on inotify events */
-	pthread_kill(_th.native_handle(), SIGINT);
+	/* Stop waiting on inotify events (again if the signal came before read()) */
+	while (_th.joinable() && !_stopped) {
+		pthread_kill(_th.native_handle(), SIGINT);
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
 	
 	if (_th.joinable()) {
 		_th.join();
@@ -120,16 +139,22 @@ void Watcher::loop()
 				got_event = _inotify.GetEvent(&event);
 				if (got_event && event.IsCreateDir()) {
 					processNewDir(event);
+				} else if (got_event) {
+					processFileEvent(event);
 				}
 
 				count--;
 			}
+			
+			/* Report size changes of all events at once */
+			reportSizes();
 		} catch (InotifyException &e) {
 			MSG_ERROR(msg_module, "%s", e.GetMessage().c_str());
 		}
 	}
 	
 	MSG_DEBUG(msg_module, "closing thread");
+	_stopped = true;
 }
 
 /**
@@ -165,6 +190,8 @@ void Watcher::setup()
 		/* Watch directory subtree */
 		watchRootWatch(rw);
 	}
+	
+	reportSizes();
 }
 
 /**
@@ -176,7 +203,8 @@ void Watcher::setup()
 void Watcher::watch(RootWatch* rw, Directory* dir)
 {
 	MSG_DEBUG(msg_module, "watch %s", dir->getName().c_str());
-	InotifyWatch *watch = new InotifyWatch(dir->getName());
+	bool trackable = isTrackable(rw, dir);
+	InotifyWatch *watch = trackable ? new InotifyWatch(dir->getName(), TRACK_MASK) : new InotifyWatch(dir->getName());
 	_inotify.Add(watch);
 	
 	dir->setActive();
@@ -184,6 +212,10 @@ void Watcher::watch(RootWatch* rw, Directory* dir)
 	if (rw) {
 		rw->watching.push_back(dir);
 	}
+	
+	if (trackable) {
+		track(rw, dir);
+	}
 }
 
 /**
@@ -196,17 +228,22 @@ void Watcher::watchRootWatch(RootWatch* rw)
 	Directory *aux_dir = rw->root;
 	
 	while (aux_dir && aux_dir->getDepth() < _max_depth) {
-		watch(rw, aux_dir);
 		if (aux_dir->getChildren().empty() && aux_dir != rw->root) {
 			/* 
 			 * The newest dir in subtree should removed from dir hierarchy
 			 * It will be added when new dir appears
 			 */
 			_scanner->popNewestChild(aux_dir->getParent());
+			watch(rw, aux_dir);
+			rw->owned = true;
 			return;
 		}
+		watch(rw, aux_dir);
 		aux_dir = aux_dir->getNewestChild();
 	}
+	
+	/* The newest directory is part of the tree */
+	rw->owned = false;
 }
 
 /**
@@ -232,6 +269,10 @@ void Watcher::unWatch(Directory *dir)
  */
 void Watcher::unWatchLast(RootWatch* rw)
 {
+	if (rw->tracked && rw->tracked->dir == rw->watching.back()) {
+		untrack(rw);
+	}
+	
 	unWatch(rw->watching.back());
 	rw->watching.pop_back();
 }
@@ -279,6 +320,13 @@ void Watcher::processNewDir(InotifyEvent& event)
 	std::string new_path = parent_path + "/" + event.GetName();
 	int depth = Directory::dirDepth(new_path);
 	
+	auto tracked = _tracked.find(parent_path);
+	if (tracked != _tracked.end()) {
+		/* New subdirectory of tracked directory */
+		trackTree(tracked->second, new_path);
+		return;
+	}
+	
 	if (depth >= _max_depth) {
 		MSG_DEBUG(msg_module, "%s is too deep", new_path.c_str());
 		return;
@@ -319,6 +367,260 @@ void Watcher::processNewDir(InotifyEvent& event)
 		newdir->setParent(rw->watching.back());
 	}
 	watch(rw, newdir);
+	rw->owned = (newdir != rw->root);
+}
+
+/**
+ * \brief Process file event in tracked directory
+ * 
+ * \param event Inotify event
+ */
+void Watcher::processFileEvent(InotifyEvent& event)
+{
+	auto tracked = _tracked.find(event.GetWatch()->GetPath());
+	if (tracked == _tracked.end() || event.GetName().empty()) {
+		/* Not tracked or event of watched directory itself */
+		return;
+	}
+	
+	TrackedDir *td = tracked->second;
+	std::string path = event.GetWatch()->GetPath() + "/" + event.GetName();
+	struct stat st;
+	
+	if (event.IsType(IN_DELETE) || event.IsType(IN_MOVED_FROM)) {
+		forgetTree(td, path);
+	} else if (event.IsType(IN_ISDIR)) {
+		/* Directory moved into tracked subtree */
+		trackTree(td, path);
+	} else if (!lstat(path.c_str(), &st)) {
+		/* File was written or moved into tracked subtree */
+		setFileSize(td, path, st.st_size);
+	}
+}
+
+/**
+ * \brief Check whether directory should be tracked
+ *
+ * Only the deepest watched directories are tracked, their subdirectories
+ * are not part of the directory tree.
+ * 
+ * \param rw Root of (sub)tree
+ * \param dir Directory
+ * \return True if directory should be tracked
+ */
+bool Watcher::isTrackable(RootWatch *rw, Directory *dir)
+{
+	return rw && dir != rw->root && dir->getDepth() == _max_depth - 1;
+}
+
+/**
+ * \brief Start tracking size of directory
+ * 
+ * \param rw Root of (sub)tree
+ * \param dir Directory (already watched)
+ */
+void Watcher::track(RootWatch *rw, Directory *dir)
+{
+	if (rw->tracked) {
+		untrack(rw);
+	}
+	
+	MSG_DEBUG(msg_module, "track %s", dir->getName().c_str());
+	TrackedDir *td = new TrackedDir(dir);
+	rw->tracked = td;
+	_tracked[dir->getName()] = td;
+	
+	scanTree(td, dir->getName());
+	
+	/* Part of directory size may be already counted by scanner */
+	td->delta -= dir->getSize();
+}
+
+/**
+ * \brief Stop tracking size of directory
+ *
+ * Directory is marked as tracked so scanner uses its size without scanning.
+ * Directory's own watch is removed by unWatch().
+ * 
+ * \param rw Root of (sub)tree
+ */
+void Watcher::untrack(RootWatch *rw)
+{
+	TrackedDir *td = rw->tracked;
+	
+	MSG_DEBUG(msg_module, "untrack %s", td->dir->getName().c_str());
+	for (auto &path: td->watching) {
+		InotifyWatch *watch = _inotify.FindWatch(path);
+		if (watch) {
+			try {
+				_inotify.Remove(watch);
+			} catch (InotifyException &e) {
+				/* Directory was probably removed */
+			}
+			delete watch;
+		}
+		_tracked.erase(path);
+	}
+	_tracked.erase(td->dir->getName());
+	
+	if (td->delta != 0) {
+		_scanner->addSize(td->dir, td->delta);
+	}
+	
+	/* If some subdirectory was not watched, the size is wrong and must be scanned */
+	td->dir->setTracked(!td->lost);
+	
+	delete td;
+	rw->tracked = nullptr;
+}
+
+/**
+ * \brief Watch subdirectory of tracked directory and count its size
+ * 
+ * \param td Tracked directory
+ * \param path Subdirectory path
+ */
+void Watcher::trackTree(TrackedDir *td, std::string path)
+{
+	if (_tracked.find(path) != _tracked.end()) {
+		return;
+	}
+	
+	InotifyWatch *watch = new InotifyWatch(path, TRACK_MASK);
+	try {
+		_inotify.Add(watch);
+	} catch (InotifyException &e) {
+		MSG_WARNING(msg_module, "cannot watch %s (%s), %s will be scanned", path.c_str(), e.GetMessage().c_str(), td->dir->getName().c_str());
+		delete watch;
+		td->lost = true;
+		return;
+	}
+	
+	td->watching.push_back(path);
+	_tracked[path] = td;
+	
+	scanTree(td, path);
+}
+
+/**
+ * \brief Count size of files in tracked (sub)directory
+ *
+ * Directory must be watched before it is scanned, files written meanwhile
+ * are reported by events and counted only once.
+ * 
+ * \param td Tracked directory
+ * \param path Directory path
+ */
+void Watcher::scanTree(TrackedDir *td, std::string path)
+{
+	std::string entry_path, entry_name;
+	struct dirent *entry;
+	struct stat st;
+	
+	DIR *dir = opendir(path.c_str());
+	if (!dir) {
+		MSG_WARNING(msg_module, "cannot open %s (%s)", path.c_str(), strerror(errno));
+		return;
+	}
+	
+	/* Size of "." */
+	if (!lstat(path.c_str(), &st)) {
+		setFileSize(td, path, st.st_size);
+	}
+	
+	while ((entry = readdir(dir))) {
+		entry_name = entry->d_name;
+		entry_path = path + '/' + entry_name;
+		
+		if (entry_name == "." || entry_name == ".." || lstat(entry_path.c_str(), &st)) {
+			continue;
+		} else if (S_ISDIR(st.st_mode)) {
+			trackTree(td, entry_path);
+		} else {
+			setFileSize(td, entry_path, st.st_size);
+		}
+	}
+	closedir(dir);
+}
+
+/**
+ * \brief Forget removed file or directory of tracked directory
+ * 
+ * \param td Tracked directory
+ * \param path Path of removed file or directory
+ */
+void Watcher::forgetTree(TrackedDir *td, std::string path)
+{
+	auto file = td->files.find(path);
+	if (file == td->files.end()) {
+		return;
+	}
+	
+	td->delta -= file->second;
+	td->files.erase(file);
+	
+	auto watched = std::find(td->watching.begin(), td->watching.end(), path);
+	if (watched == td->watching.end()) {
+		/* Regular file */
+		return;
+	}
+	
+	/* Directory - forget its whole subtree */
+	std::string prefix = path + "/";
+	for (auto it = td->files.begin(); it != td->files.end(); ) {
+		if (it->first.compare(0, prefix.length(), prefix) == 0) {
+			td->delta -= it->second;
+			it = td->files.erase(it);
+		} else {
+			++it;
+		}
+	}
+	
+	for (auto it = td->watching.begin(); it != td->watching.end(); ) {
+		if (*it == path || it->compare(0, prefix.length(), prefix) == 0) {
+			InotifyWatch *watch = _inotify.FindWatch(*it);
+			if (watch) {
+				try {
+					_inotify.Remove(watch);
+				} catch (InotifyException &e) {
+					/* Directory is already removed */
+				}
+				delete watch;
+			}
+			_tracked.erase(*it);
+			it = td->watching.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+/**
+ * \brief Set size of file in tracked directory
+ * 
+ * \param td Tracked directory
+ * \param path File path
+ * \param size Current file size
+ */
+void Watcher::setFileSize(TrackedDir *td, std::string path, uint64_t size)
+{
+	uint64_t &known = td->files[path];
+	
+	td->delta += (int64_t) size - (int64_t) known;
+	known = size;
+}
+
+/**
+ * \brief Report size changes of tracked directories to scanner
+ */
+void Watcher::reportSizes()
+{
+	for (auto rw: _roots) {
+		if (rw->tracked && rw->tracked->delta != 0) {
+			_scanner->addSize(rw->tracked->dir, rw->tracked->delta);
+			rw->tracked->delta = 0;
+		}
+	}
 }
 
 /**
@@ -336,8 +638,12 @@ Watcher::Watcher():
 Watcher::~Watcher()
 {
 	for (auto rw: _roots) {
+		if (rw->tracked) {
+			delete rw->tracked;
+		}
+		
 		/* Last watched directory was NOT added to scanner (if it is not root) so we need to delete it here */
-		if (!rw->watching.empty() && rw->watching.back() != rw->root) {
+		if (!rw->watching.empty() && rw->owned) {
 			delete rw->watching.back();
 		}
 		delete rw;
@@ -49,10 +49,30 @@
 #include <iostream>
 #include <thread>
 #include <algorithm>
+#include <atomic>
+#include <unordered_map>
 #include <condition_variable>
 
+/* Events of tracked directories - new subdirectories and file size changes */
+#define TRACK_MASK (IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
 namespace fbitexpire {
 
+/**
+ * \brief Directory at the deepest watched level, tracked with its whole subtree
+ *
+ * Sizes of its files are updated from inotify events so the directory does
+ * not have to be scanned when data writer moves to another one.
+ */
+struct TrackedDir {
+	TrackedDir(Directory *d): dir(d) {}
+	Directory *dir;                                  /* tracked directory */
+	std::vector<std::string> watching;               /* watched subdirectories */
+	std::unordered_map<std::string, uint64_t> files; /* known sizes of files and subdirectories */
+	int64_t delta = 0;                               /* size change not yet reported to scanner */
+	bool lost = false;                               /* some subdirectory could not be watched */
+};
+
 /**
  * \brief Subtree root - used when there are multiple data writers
  */
@@ -61,6 +81,8 @@ struct RootWatch {
 	RootWatch(Directory *r): root(r) {}
 	Directory *root = nullptr;          /* root of watched subtree */
 	std::vector<Directory *> watching;   /* vector of watched directories in this subtree */
+	TrackedDir *tracked = nullptr;       /* tracked directory of this subtree */
+	bool owned = false;                  /* last watched directory is not in scanner's tree */
 };
 
 /**
@@ -78,20 +100,32 @@ private:
 	void loop();
 	void setup();
 	void processNewDir(InotifyEvent& event);
+	void processFileEvent(InotifyEvent& event);
 	void watch(RootWatch *rw, Directory *dir);
 	void watchRootWatch(RootWatch *rw);
 	void unWatch(Directory *dir);
 	void unWatchLast(RootWatch *rw);
 	RootWatch *getRoot(Directory *dir);
 	
+	bool isTrackable(RootWatch *rw, Directory *dir);
+	void track(RootWatch *rw, Directory *dir);
+	void untrack(RootWatch *rw);
+	void trackTree(TrackedDir *td, std::string path);
+	void scanTree(TrackedDir *td, std::string path);
+	void forgetTree(TrackedDir *td, std::string path);
+	void setFileSize(TrackedDir *td, std::string path, uint64_t size);
+	void reportSizes();
+	
 	Inotify  _inotify;          /**< inotify instance */
 	Scanner *_scanner;          /**< scanner's instance */
 	
 	int  _max_depth;            /**< maximal depth */
 	int  _root_name_len;        /**< length of root's name */
 	bool _multiple;             /**< multiple data writers flag */
+	std::atomic<bool> _stopped{false}; /**< main loop finished */
 	
 	std::vector<RootWatch *> _roots;  /**< subRoots */
+	std::unordered_map<std::string, TrackedDir *> _tracked; /**< tracked directories by path */
 
 };
 
@@ -65,10 +65,12 @@
 #include "Watcher.h"
 
 #define DEFAULT_PIPE "./fbitexpire_fifo"
+#define DEFAULT_CACHE "./fbitexpire_cache"
 #define DEFAULT_DEPTH 1
+#define DEFAULT_THREADS 4
 
 /** Acceptable command-line parameters (normal) */
-#define OPTSTRING "rfmhVDkocp:d:s:v:w:"
+#define OPTSTRING "rfmhVDkocp:d:s:v:w:C:t:l:"
 
 /** Acceptable command-line parameters (long) */
 struct option long_opts[] = {
@@ -88,16 +90,19 @@ static PipeListener *list = nullptr;
  */
 void print_help()
 {
-	std::cout << "Usage: " << PACKAGE_NAME << " [-rhVDokmc] [-p pipe] [-d depth] [-w watermark] [-v level] -s size directory\n\n";
+	std::cout << "Usage: " << PACKAGE_NAME << " [-rhVDokmc] [-p pipe] [-d depth] [-w watermark] [-C cache] [-t threads] [-l rate] [-v level] -s size directory\n\n";
 	std::cout << "Options:\n";
 	std::cout << "  -h             Show this help and exit\n";
 	std::cout << "  -V             Show version and exit\n";
 	std::cout << "  -r             Instruct daemon to rescan folder (note: daemon has to be running)\n";
-	std::cout << "  -f             Force rescan directories when daemon starts (ignores stat files)\n";
+	std::cout << "  -f             Force rescan directories when daemon starts (ignores stat files and size cache)\n";
 	std::cout << "  -p <pipe>      Pipe name (default: " << DEFAULT_PIPE << ")\n";
 	std::cout << "  -s <size>      Maximum size of all directories (in MB)\n";
 	std::cout << "  -w <watermark> Lower limit when removing folders (in MB)\n";
 	std::cout << "  -d <depth>     Depth of watched directories (default: 1)\n";
+	std::cout << "  -C <cache>     File with cached directory sizes, empty to disable (default: " << DEFAULT_CACHE << ")\n";
+	std::cout << "  -t <threads>   Number of threads removing old directories (default: " << DEFAULT_THREADS << ")\n";
+	std::cout << "  -l <rate>      Limit of removed data per second (in MB, default: unlimited)\n";
 	std::cout << "  -D             Daemonize\n";
 	std::cout << "  -m             Multiple sources on top level directory. Please check fbitexpire(1) for more information\n";
 	std::cout << "  -k             Stop fbitexpire daemon listening on pipe specified by -p\n";
@@ -168,11 +173,11 @@ int write_to_pipe(bool pipe_exists, std::string pipe, std::string msg)
 
 int main(int argc, char *argv[])
 {
-	int c, depth{DEFAULT_DEPTH};
+	int c, depth{DEFAULT_DEPTH}, threads{DEFAULT_THREADS};
 	bool rescan{false}, daemonize{false}, pipe_exists{false}, pipe_file_exists{false}, pipe_created{false}, multiple{false};
 	bool change{false}, force{false}, wmarkset{false}, size_set{false}, kill_daemon{false}, only_remove{false}, depth_set{false};
-	uint64_t watermark{0}, size{0};
-	std::string pipe{DEFAULT_PIPE};
+	uint64_t watermark{0}, size{0}, rate{0};
+	std::string pipe{DEFAULT_PIPE}, cache{DEFAULT_CACHE};
 	
 	while ((c = getopt_long(argc, argv, OPTSTRING, long_opts, NULL)) != -1) {
 		switch (c) {
@@ -206,6 +211,19 @@ int main(int argc, char *argv[])
 		case 'D':
 			daemonize = true;
 			break;
+		case 'C':
+			cache = std::string(optarg);
+			break;
+		case 't':
+			threads = std::atoi(optarg);
+			if (threads < 1) {
+				MSG_ERROR(msg_module, "invalid number of threads (%s)", optarg);
+				return 1;
+			}
+			break;
+		case 'l':
+			rate = Scanner::strToSize(optarg);
+			break;
 		case 'm':
 			multiple = true;
 			break;
@@ -353,10 +371,11 @@ int main(int argc, char *argv[])
 	std::condition_variable cv;
 	
 	try {
+		scanner.setCacheFile(cache);
 		scanner.createDirTree(basedir, depth, force);
 		watcher.run(&scanner, multiple);
 		scanner.run(&cleaner, size, watermark, multiple);
-		cleaner.run();
+		cleaner.run(threads, rate);
 		listener.run(&watcher, &scanner, &cleaner, &cv);
 		signal(SIGINT, handle);
 	} catch (InotifyException &e) {
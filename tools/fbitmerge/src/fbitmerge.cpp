@@ -37,6 +37,10 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -44,6 +48,7 @@
 #include <stdlib.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <sys/stat.h>
 #include <time.h>
@@ -58,8 +63,9 @@
 
 #include <fastbit/ibis.h>
 #include "fbitmerge.h"
+#include "thread_pool.h"
 
-#define OPTSTRING ":hk:b:p:smd"
+#define OPTSTRING ":hk:b:p:smdt:"
 
 /** Acceptable command-line parameters (long) */
 struct option long_opts[] = {
@@ -68,6 +74,7 @@ struct option long_opts[] = {
 };
 
 static uint8_t separated = 0;
+static unsigned int threads = 0;
 
 /* \brief Prints help
  */
@@ -83,6 +90,7 @@ void usage()
 	std::cout << "-s\t Separate merging - only prefixed folders can be moved and deleted\n";
 	std::cout << "\t It means that their parent folders are merged separately, NOT together\n";
 	std::cout << "-m\t Move only - don't merge folders, only move all prefixed subdirs into basedir\n";
+	std::cout << "-t\t Number of merging threads (default = number of CPUs)\n";
 	std::cout << std::endl;
 }
 
@@ -269,192 +277,490 @@ int merge_dirs(std::string src_dir, std::string dst_dir)
 	return OK;
 }
 
-void scan_dir(std::string dir_name, std::string src_dir, DIRMAP *bigMap)
+time_t get_file_atime(std::string path)
 {
-	ibis::part part(src_dir.c_str(), static_cast<const char*>(0));
+	struct stat file_stat;
+	if (stat(path.c_str(), &file_stat) < 0) {
+		std::cerr << "Could not retrieve file attributes for '" << path << "'" << std::endl;
+		return 0;
+	}
 
-	if (part.nRows() == 0) {
-		return;
+	return file_stat.st_atime;
+}
+
+time_t get_file_mtime(std::string path)
+{
+	struct stat file_stat;
+	if (stat(path.c_str(), &file_stat) < 0) {
+		std::cerr << "Could not retrieve file attributes for '" << path << "'" << std::endl;
+		return 0;
 	}
 
-	for (uint32_t i = 0; i < part.nColumns(); i++) {
-		ibis::column *c = part.getColumn(i);
-		(*bigMap)[dir_name][std::string(c->name())] = c->type();
+	return file_stat.st_mtime;
+}
+
+/* \brief Get time of a monotonic clock in seconds
+ */
+double time_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* \brief Get size of an element of a fixed-size column type
+ *
+ * \param[in] type data type from -part.txt
+ * \return size in bytes, 0 for variable-size (or unknown) types
+ */
+size_t column_size(const std::string &type)
+{
+	if (type == "BYTE" || type == "UBYTE") {
+		return BYTES_1;
+	} else if (type == "SHORT" || type == "USHORT") {
+		return BYTES_2;
+	} else if (type == "INT" || type == "UINT" || type == "FLOAT") {
+		return BYTES_4;
+	} else if (type == "LONG" || type == "ULONG" || type == "DOUBLE" || type == "OID") {
+		return BYTES_8;
 	}
+
+	return 0;
 }
 
-int same_data(innerDirMap *first, innerDirMap *second)
+/* \brief Read number of rows and columns of a part from its -part.txt
+ *
+ * Schema of the part is a canonical list of its columns, so parts with
+ * the same schema can be appended to each other.
+ *
+ * \param[in] path part directory
+ * \param[out] info part information
+ * \return OK on success, NOT_OK else
+ */
+int read_part_info(std::string path, part_info *info)
 {
-	if ((*first).size() != (*second).size()) {
+	std::ifstream file((path + "/-part.txt").c_str());
+	std::string line, name;
+
+	if (!file.is_open()) {
 		return NOT_OK;
 	}
 
-	for (innerDirMap::iterator it = (*first).begin(); it != (*first).end(); it++) {
-		if ((*second).find((*it).first) == (*second).end()) {
-			return NOT_OK;
-		}
-		if ((*it).second != (*second)[(*it).first]) {
-			return NOT_OK;
+	info->path = path;
+	info->rows = 0;
+	info->columns.clear();
+
+	while (std::getline(file, line)) {
+		if (line.compare(0, 15, "Number_of_rows=") == 0) {
+			info->rows = strtoull(line.c_str() + 15, NULL, 10);
+		} else if (line.compare(0, 5, "name=") == 0) {
+			name = line.substr(5);
+		} else if (line.compare(0, 10, "data_type=") == 0 && !name.empty()) {
+			info->columns[name] = line.substr(10);
+			name.clear();
 		}
 	}
 
+	info->schema.clear();
+	for (std::map<std::string, std::string>::iterator it = info->columns.begin(); it != info->columns.end(); ++it) {
+		info->schema += it->first + "=" + it->second + "\n";
+	}
+
 	return OK;
 }
 
-time_t get_file_atime(std::string path)
+/* \brief Scan all parts of a window directory (thread pool job)
+ *
+ * \param[in,out] arg window_scan structure
+ */
+void scan_window(void *arg)
 {
-	struct stat file_stat;
-	if (stat(path.c_str(), &file_stat) < 0) {
-		std::cerr << "Could not retrieve file attributes for '" << path << "'" << std::endl;
-		return 0;
+	window_scan *scan = (window_scan *) arg;
+	DIR *dir = opendir(scan->path.c_str());
+	struct dirent *subdir;
+
+	if (dir == NULL) {
+		std::cerr << "Error while opening '" << scan->path << "': " << strerror(errno) << std::endl;
+		return;
 	}
 
-	return file_stat.st_atime;
+	while ((subdir = readdir(dir)) != NULL) {
+		if ((subdir->d_name[0] == '.') || (subdir->d_type != DT_DIR)) {
+			continue;
+		}
+
+		part_info info;
+		info.name = subdir->d_name;
+		if (read_part_info(scan->path + "/" + subdir->d_name, &info) != OK || info.rows == 0) {
+			continue;
+		}
+
+		scan->parts.push_back(info);
+	}
+
+	closedir(dir);
 }
 
-time_t get_file_mtime(std::string path)
+/* \brief Get size of a file
+ *
+ * \param[in] path file path
+ * \return size or -1 if the file does not exist
+ */
+off_t get_file_size(std::string path)
 {
 	struct stat file_stat;
 	if (stat(path.c_str(), &file_stat) < 0) {
-		std::cerr << "Could not retrieve file attributes for '" << path << "'" << std::endl;
-		return 0;
+		return -1;
 	}
 
-	return file_stat.st_mtime;
+	return file_stat.st_size;
 }
 
-/* \brief Merges 2 folders in format <prefix>YYYYMMDDHHmmSS together
+/* \brief Append content of a file to another file
  *
- * Goes through subfolders of destination folder and saves their names. Then
- * goes through subfolders of source folder and compare folder names
- * with first folder. Same folders are merged together (merge_dirs). If
- * folder doesn't exist in dst_dir, it is moved there.
+ * Data are copied by copy_file_range() (in kernel, possibly by reflinks),
+ * read()/write() is used when it is not supported.
  *
- * \param[in] src_dir source folder name
- * \param[in,out] dst_dir destination folder name
- * \param[in] work_dir parent directory
+ * \param[in] src source file
+ * \param[in] dst destination file (must exist)
  * \return OK on success, NOT_OK else
  */
-int merge_couple(std::string src_dir, std::string dst_dir, std::string work_dir)
+int append_file(std::string src, std::string dst)
 {
-	DIR *sdir = NULL;
-	DIR *ddir = NULL;
+	int in = open(src.c_str(), O_RDONLY);
+	if (in < 0) {
+		std::cerr << "Cannot open '" << src << "': " << strerror(errno) << std::endl;
+		return NOT_OK;
+	}
+
+	int out = open(dst.c_str(), O_WRONLY);
+	if (out < 0 || lseek(out, 0, SEEK_END) < 0) {
+		std::cerr << "Cannot open '" << dst << "': " << strerror(errno) << std::endl;
+		close(in);
+		if (out >= 0) {
+			close(out);
+		}
+		return NOT_OK;
+	}
+
+	ssize_t len = 1;
+#ifdef HAVE_COPY_FILE_RANGE
+	while ((len = copy_file_range(in, NULL, out, NULL, 1 << 30, 0)) > 0) {
+		;
+	}
+
+	if (len < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+		/* Not supported, copy the rest by read()/write() */
+		len = 1;
+	}
+#endif
+
+	if (len > 0) {
+		char buff[COPY_BUFF_LEN];
+		while ((len = read(in, buff, sizeof(buff))) > 0) {
+			char *ptr = buff;
+			while (len > 0) {
+				ssize_t written = write(out, ptr, len);
+				if (written < 0) {
+					break;
+				}
+				ptr += written;
+				len -= written;
+			}
+
+			if (len > 0) {
+				len = -1;
+				break;
+			}
+		}
+	}
 
-	/* Get full paths of folders */
-	std::string src_dir_path = work_dir + "/" + src_dir;
-	std::string dst_dir_path = work_dir + "/" + dst_dir;
+	if (len < 0) {
+		std::cerr << "Cannot append '" << src << "' to '" << dst << "': " << strerror(errno) << std::endl;
+	}
+
+	close(in);
+	close(out);
+	return (len < 0) ? NOT_OK : OK;
+}
 
-	/* Open folders */
-	sdir = opendir(src_dir_path.c_str());
-	if (sdir == NULL) {
-		std::cerr << "Error while opening '" << src_dir_path << "': " << strerror(errno) << std::endl;
+/* \brief Read starting positions of strings (.sp file)
+ *
+ * \param[in] path .sp file path
+ * \param[out] positions starting positions
+ * \return OK on success, NOT_OK else
+ */
+int read_sp_file(std::string path, std::vector<uint64_t> &positions)
+{
+	off_t size = get_file_size(path);
+	if (size < 0 || size % sizeof(uint64_t) != 0) {
 		return NOT_OK;
 	}
 
-	ddir = opendir(dst_dir_path.c_str());
-	if (ddir == NULL) {
-		std::cerr << "Error while opening '" << dst_dir_path << "': " << strerror(errno) << std::endl;
-		closedir(sdir);
+	positions.resize(size / sizeof(uint64_t));
+	std::ifstream file(path.c_str(), std::ifstream::binary);
+	if (!file.read((char *) positions.data(), size)) {
 		return NOT_OK;
 	}
 
-	/* Scan folders in dst_dir folder and save them to DIRMAP */
-	struct dirent *subdir = NULL;
-	DIRMAP src_map, dst_map;
-	while ((subdir = readdir(ddir)) != NULL) {
-		if ((subdir->d_name[0] == '.') || (subdir->d_type != DT_DIR)) {
-			continue;
-		}
+	return OK;
+}
 
-		scan_dir(subdir->d_name, dst_dir_path + "/" + subdir->d_name, &dst_map);
+/* \brief Rewrite number of rows in -part.txt
+ *
+ * Minimal and maximal values of columns are removed as they are not valid
+ * for the appended rows. FastBit computes them again when needed.
+ *
+ * \param[in] path part directory
+ * \param[in] rows new number of rows
+ * \return OK on success, NOT_OK else
+ */
+int update_part_rows(std::string path, uint64_t rows)
+{
+	std::string part_file = path + "/-part.txt";
+	std::string tmp_file = part_file + ".tmp";
+	std::ifstream in(part_file.c_str());
+	std::ofstream out(tmp_file.c_str(), std::ofstream::trunc);
+	std::string line;
+
+	if (!in.is_open() || !out.is_open()) {
+		std::cerr << "Cannot update '" << part_file << "'" << std::endl;
+		return NOT_OK;
 	}
 
-	/* Now do the same with src_dir */
-	while ((subdir = readdir(sdir)) != NULL) {
-		if ((subdir->d_name[0] == '.') || (subdir->d_type != DT_DIR)) {
-			continue;
+	while (std::getline(in, line)) {
+		if (line.compare(0, 15, "Number_of_rows=") == 0) {
+			out << "Number_of_rows=" << rows << "\n";
+		} else if (line.compare(0, 10, "Timestamp=") == 0) {
+			out << "Timestamp=" << time(NULL) << "\n";
+		} else if (line.compare(0, 8, "minimum=") != 0 && line.compare(0, 8, "maximum=") != 0) {
+			out << line << "\n";
 		}
+	}
 
-		scan_dir(subdir->d_name, src_dir_path + "/" + subdir->d_name, &src_map);
+	in.close();
+	out.close();
+	if (out.fail() || rename(tmp_file.c_str(), part_file.c_str()) != 0) {
+		std::cerr << "Cannot update '" << part_file << "'" << std::endl;
+		unlink(tmp_file.c_str());
+		return NOT_OK;
 	}
 
-	/* Iterate through whole dst_map and src_map and find folders with same data (and data types) */
-	for (DIRMAP::iterator dst_i = dst_map.begin(); dst_i != dst_map.end(); ++dst_i) {
-		for (DIRMAP::iterator src_i = src_map.begin(); src_i != src_map.end(); ) {
-			if (same_data(&((*dst_i).second), &((*src_i).second)) == OK) {
-				/* If found, merge it */
-				if (merge_dirs(src_dir_path + "/" + (*src_i).first,
-						dst_dir_path + "/" + (*dst_i).first) != OK) {
-					closedir(sdir);
-					closedir(ddir);
-					return NOT_OK;
-				}
+	return OK;
+}
 
-				/* We don't need this folder anymore */
-				src_i = src_map.erase(src_i);
-			} else {
-				++src_i;
+/* \brief Append rows of a part to a part with the same schema
+ *
+ * Column files are appended directly, starting positions of strings are
+ * shifted. Parts with null masks, categories or inconsistent file sizes
+ * are merged by FastBit (merge_dirs). Appended data are truncated when
+ * anything fails, so the destination part stays consistent.
+ *
+ * \param[in] src source part
+ * \param[in,out] dst destination part
+ * \param[out] fallback set to true if FastBit was used
+ * \return OK on success, NOT_OK else
+ */
+int append_part(const part_info &src, part_info &dst, bool *fallback)
+{
+	std::vector<std::pair<std::string, off_t> > appended;
+	std::map<std::string, std::string>::const_iterator col;
+	int ret = OK;
+
+	/* Check that all columns can be appended directly */
+	for (col = src.columns.begin(); col != src.columns.end(); ++col) {
+		std::string src_col = src.path + "/" + col->first;
+		std::string dst_col = dst.path + "/" + col->first;
+		size_t size = column_size(col->second);
+
+		if (get_file_size(src_col + ".msk") >= 0 || get_file_size(dst_col + ".msk") >= 0) {
+			break;
+		}
+
+		if (size > 0) {
+			if (get_file_size(src_col) != (off_t) (src.rows * size)
+					|| get_file_size(dst_col) != (off_t) (dst.rows * size)) {
+				break;
+			}
+		} else if (col->second == "TEXT") {
+			if (get_file_size(src_col) < 0 || get_file_size(dst_col) < 0
+					|| (get_file_size(src_col + ".sp") < 0) != (get_file_size(dst_col + ".sp") < 0)) {
+				break;
 			}
+		} else {
+			break;
 		}
 	}
 
-	/* If there is some folder that wasn't merged, just move it to dst_dir */
-	/* But we must find unused folder name for it (we dont wan't to rewrite some other folder */
-	for (DIRMAP::iterator src_i = src_map.begin(); src_i != src_map.end(); ++src_i) {
-		struct stat st;
-		char suffix = 'a';
+	if (col != src.columns.end()) {
+		*fallback = true;
+		if (merge_dirs(src.path, dst.path) != OK) {
+			return NOT_OK;
+		}
+
+		return read_part_info(dst.path, &dst);
+	}
 
-		/* Add suffix to the name */
-		while (stat((dst_dir_path + "/" + (*src_i).first).c_str(), &st) == 0) {
-			if (suffix == 'z') {
-				suffix = 'A';
-			} else if (suffix == 'Z') {
-				/* \TODO do it better */
-				std::cerr << "Not enough suffixes for folder '" << (*src_i).first << "'" << std::endl;
+	/* Append column files */
+	for (col = src.columns.begin(); col != src.columns.end() && ret == OK; ++col) {
+		std::string src_col = src.path + "/" + col->first;
+		std::string dst_col = dst.path + "/" + col->first;
+		off_t dst_size = get_file_size(dst_col);
+
+		/* Shift starting positions of strings */
+		if (col->second == "TEXT" && get_file_size(src_col + ".sp") >= 0) {
+			std::vector<uint64_t> src_sp, dst_sp;
+			if (read_sp_file(src_col + ".sp", src_sp) != OK || read_sp_file(dst_col + ".sp", dst_sp) != OK
+					|| src_sp.size() != src.rows + 1 || dst_sp.size() != dst.rows + 1
+					|| dst_sp.back() != (uint64_t) dst_size) {
+				std::cerr << "Inconsistent starting positions of column '" << col->first << "' in '"
+						<< src.path << "' or '" << dst.path << "'" << std::endl;
+				ret = NOT_OK;
 				break;
-			} else {
-				suffix++;
 			}
+
+			appended.push_back(std::make_pair(dst_col + ".sp", get_file_size(dst_col + ".sp")));
+			std::ofstream sp((dst_col + ".sp").c_str(), std::ofstream::binary | std::ofstream::app);
+			for (size_t i = 1; i < src_sp.size(); ++i) {
+				src_sp[i] += dst_size;
+			}
+			sp.write((const char *) (src_sp.data() + 1), (src_sp.size() - 1) * sizeof(uint64_t));
+			sp.close();
+			if (sp.fail()) {
+				ret = NOT_OK;
+				break;
+			}
+		}
+
+		appended.push_back(std::make_pair(dst_col, dst_size));
+		ret = append_file(src_col, dst_col);
+
+		/* Existing index is not valid anymore */
+		unlink((dst_col + ".idx").c_str());
+	}
+
+	if (ret == OK) {
+		ret = update_part_rows(dst.path, dst.rows + src.rows);
+	}
+
+	if (ret != OK) {
+		/* Drop appended data */
+		for (size_t i = 0; i < appended.size(); ++i) {
+			if (truncate(appended[i].first.c_str(), appended[i].second) != 0) {
+				std::cerr << "Cannot truncate '" << appended[i].first << "'" << std::endl;
+			}
+		}
+		return NOT_OK;
+	}
+
+	dst.rows += src.rows;
+	return OK;
+}
+
+/* \brief Merge all parts of a group into its target (thread pool job)
+ *
+ * Each source part is removed right after it is appended, so running
+ * the merge again after a failure never appends the same rows twice.
+ *
+ * \param[in,out] arg merge_group structure
+ */
+void merge_group_parts(void *arg)
+{
+	merge_group *group = (merge_group *) arg;
+
+	for (size_t i = 0; i < group->sources.size(); ++i) {
+		bool fallback = false;
+
+		if (append_part(group->sources[i], group->target, &fallback) != OK) {
+			std::cerr << "Cannot merge '" << group->sources[i].path << "' into '"
+					<< group->target.path << "'" << std::endl;
+			group->status = NOT_OK;
+			return;
 		}
 
-		if (rename((src_dir_path + "/" + (*src_i).first).c_str(),
-				(dst_dir_path + "/" + (*src_i).first).c_str()) != 0) {
-			std::cerr << "Cannot rename folder '" << (src_dir_path + "/" + (*src_i).first) << "'" << std::endl;
+		if (fallback) {
+			group->fallbacks++;
 		}
+
+		remove_folder_tree(group->sources[i].path);
+	}
+
+	group->status = OK;
+}
+
+/* \brief Find unused name for a part in a directory
+ *
+ * \param[in] dir directory
+ * \param[in] name original name of the part
+ * \return unused name or empty string
+ */
+std::string unused_part_name(std::string dir, std::string name)
+{
+	static const char suffixes[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	struct stat st;
+	std::string new_name = name;
+
+	for (const char *suffix = suffixes; stat((dir + "/" + new_name).c_str(), &st) == 0; ++suffix) {
+		if (*suffix == '\0') {
+			std::cerr << "Not enough suffixes for folder '" << name << "'" << std::endl;
+			return std::string();
+		}
+
+		new_name = name + *suffix;
 	}
 
-	/* Now merge template directories with same data (and data types) in dst_dir */
-	for (DIRMAP::iterator dst_i = dst_map.begin(); dst_i != dst_map.end(); ) {
-		for (DIRMAP::iterator it = dst_i; it != dst_map.end(); ) {
-			if (it == dst_i) {
-				++it;
+	return new_name;
+}
+
+/* \brief Plan merging of windows with the same key
+ *
+ * Parts of all windows are grouped by schema. The first part of each group
+ * (preferably from the destination window) is the target, other parts will
+ * be appended to it. Targets from other windows are moved to the
+ * destination window.
+ *
+ * \param[in] work_dir parent directory
+ * \param[in] scans scanned windows, the first one is the destination
+ * \param[out] groups groups with at least one part to merge
+ * \return OK on success, NOT_OK else
+ */
+int plan_groups(std::string work_dir, std::vector<window_scan *> &scans, std::vector<merge_group> &groups)
+{
+	std::string dst_path = work_dir + "/" + scans[0]->name;
+	std::map<std::string, merge_group> by_schema;
+
+	for (size_t w = 0; w < scans.size(); ++w) {
+		for (size_t p = 0; p < scans[w]->parts.size(); ++p) {
+			part_info &part = scans[w]->parts[p];
+			merge_group &group = by_schema[part.schema];
+
+			if (!group.target.path.empty()) {
+				group.sources.push_back(part);
 				continue;
 			}
 
-			if (same_data(&((*dst_i).second), &((*it).second)) == OK) {
-				if (merge_dirs(dst_dir_path + "/" + (*it).first,
-						dst_dir_path + "/" + (*dst_i).first) != OK) {
-					closedir(sdir);
-					closedir(ddir);
-					return NOT_OK;
-				}
+			group.target = part;
+			if (w == 0) {
+				continue;
+			}
 
-				remove_folder_tree((dst_dir_path + "/" + (*it).first).c_str());
-				it = dst_map.erase(it);
+			/* Move the target to the destination window */
+			std::string name = unused_part_name(dst_path, part.name);
+			if (name.empty() || rename(part.path.c_str(), (dst_path + "/" + name).c_str()) != 0) {
+				std::cerr << "Cannot move folder '" << part.path << "' to '" << dst_path << "'" << std::endl;
+				return NOT_OK;
 			}
 
-			++it;
+			group.target.name = name;
+			group.target.path = dst_path + "/" + name;
 		}
-
-		++dst_i;
 	}
 
-	/* Finally merge flowsStats.txt files */
-	merge_flows_stats(src_dir_path + "/" + "flowsStats.txt",
-			dst_dir_path + "/" + "flowsStats.txt");
-
-	closedir(sdir);
-	closedir(ddir);
+	for (std::map<std::string, merge_group>::iterator it = by_schema.begin(); it != by_schema.end(); ++it) {
+		if (!it->second.sources.empty()) {
+			groups.push_back(it->second);
+		}
+	}
 
 	return OK;
 }
@@ -462,7 +768,11 @@ int merge_couple(std::string src_dir, std::string dst_dir, std::string work_dir)
 /* \brief Goes through folder containing prefixed subfolders and merges them together by key
  *
  * Goes through work_dir subfolders and looks at key values.
- * Folders with same key values are merged together.
+ * Folders with same key values are merged together:
+ *  1) parts (template directories) of all folders are scanned in parallel,
+ *  2) parts are grouped by key and schema (names and types of columns),
+ *  3) groups are merged in parallel, each into the first folder of the key,
+ *  4) other folders of the key are removed.
  *
  * \param[in] work_dir folder with prefixed subfolders
  * \param[in] key key value
@@ -471,6 +781,9 @@ int merge_couple(std::string src_dir, std::string dst_dir, std::string work_dir)
  */
 int merge_all(std::string work_dir, uint16_t key, std::string prefix)
 {
+	double start = time_now(), phase = start;
+	double time_scan = 0, time_plan = 0, time_merge = 0;
+
 	DIR *dir = NULL;
 	dir = opendir(work_dir.c_str());
 	if (dir == NULL) {
@@ -502,6 +815,8 @@ int merge_all(std::string work_dir, uint16_t key, std::string prefix)
 	/* Go through subdirs */
 	std::map<uint32_t, std::string> dir_map;
 	std::map<uint32_t, time_t> dir_map_max_mtime;
+	std::map<uint32_t, std::vector<window_scan *> > key_scans;
+	std::vector<window_scan *> scans;
 	struct dirent *subdir = NULL;
 	char key_str[size + 1];
 	std::string full_subdir_path;
@@ -521,28 +836,103 @@ int merge_all(std::string work_dir, uint16_t key, std::string prefix)
 		time_t dir_mtime = get_file_mtime(full_subdir_path);
 
 		/* If it is the first occurrence of the key, store it in the map.
-		 * Otherwise, merge the two folders. */
+		 * Otherwise, it will be merged into the first folder. */
 		if (dir_map.find(key_int) == dir_map.end()) {
 			dir_map[key_int] = subdir->d_name;
 			dir_map_max_mtime[key_int] = dir_mtime;
-		} else {
+		} else if (dir_mtime > dir_map_max_mtime[key_int]) {
 			/* Check whether mtime is larger than the one stored in map. If so,
 			 * update it. */
-			if (dir_mtime > dir_map_max_mtime[key_int]) {
-				dir_map_max_mtime[key_int] = dir_mtime;
-			}
+			dir_map_max_mtime[key_int] = dir_mtime;
+		}
 
-			/* Merge data */
-			if (merge_couple(subdir->d_name, dir_map[key_int], work_dir) != OK) {
-				closedir(dir);
-				return NOT_OK;
+		window_scan *scan = new window_scan;
+		scan->name = subdir->d_name;
+		scan->path = full_subdir_path;
+		key_scans[key_int].push_back(scan);
+		scans.push_back(scan);
+	}
+
+	closedir(dir);
+
+	/* The first folder of each key (the one in dir_map) is the destination */
+	thread_pool pool(threads);
+	int ret = OK;
+	size_t part_cnt = 0, merged_cnt = 0, fallback_cnt = 0;
+	std::vector<merge_group> groups;
+
+	/* Scan parts of folders that will be merged */
+	for (std::map<uint32_t, std::vector<window_scan *> >::iterator it = key_scans.begin(); it != key_scans.end(); ++it) {
+		if (it->second.size() < 2) {
+			continue;
+		}
+
+		for (size_t i = 0; i < it->second.size(); ++i) {
+			pool.submit(scan_window, it->second[i]);
+		}
+	}
+
+	pool.wait();
+	time_scan = time_now() - phase;
+	phase = time_now();
+
+	/* Group compatible parts */
+	for (std::map<uint32_t, std::vector<window_scan *> >::iterator it = key_scans.begin(); it != key_scans.end(); ++it) {
+		if (it->second.size() < 2) {
+			continue;
+		}
+
+		for (size_t i = 0; i < it->second.size(); ++i) {
+			part_cnt += it->second[i]->parts.size();
+		}
+
+		if (plan_groups(work_dir, it->second, groups) != OK) {
+			ret = NOT_OK;
+			break;
+		}
+	}
+
+	time_plan = time_now() - phase;
+	phase = time_now();
+
+	/* Merge independent groups in parallel */
+	if (ret == OK) {
+		for (size_t i = 0; i < groups.size(); ++i) {
+			pool.submit(merge_group_parts, &groups[i]);
+		}
+
+		pool.wait();
+
+		for (size_t i = 0; i < groups.size(); ++i) {
+			if (groups[i].status != OK) {
+				ret = NOT_OK;
 			}
+			merged_cnt += groups[i].sources.size();
+			fallback_cnt += groups[i].fallbacks;
+		}
+	}
+
+	time_merge = time_now() - phase;
+	phase = time_now();
 
-			/* Remove merged src folder */
-			remove_folder_tree(full_subdir_path);
+	/* Merge flowsStats.txt files and remove merged src folders */
+	for (std::map<uint32_t, std::vector<window_scan *> >::iterator it = key_scans.begin(); it != key_scans.end(); ++it) {
+		std::vector<window_scan *> &windows = it->second;
+		for (size_t i = 1; ret == OK && i < windows.size(); ++i) {
+			merge_flows_stats(windows[i]->path + "/" + "flowsStats.txt",
+					windows[0]->path + "/" + "flowsStats.txt");
+			remove_folder_tree(windows[i]->path);
 		}
 	}
 
+	for (size_t i = 0; i < scans.size(); ++i) {
+		delete scans[i];
+	}
+
+	if (ret != OK) {
+		return NOT_OK;
+	}
+
 	/* Rename folders, if necessary - reset name values after key to 0. Also
 	 * update folder mtime. */
 	for (std::map<uint32_t, std::string>::iterator i = dir_map.begin(); i != dir_map.end(); i++) {
@@ -586,7 +976,11 @@ int merge_all(std::string work_dir, uint16_t key, std::string prefix)
 		}
 	}
 
-	closedir(dir);
+	std::cout << "Merged " << merged_cnt << " of " << part_cnt << " parts in " << groups.size()
+			<< " groups (" << fallback_cnt << " by FastBit) using " << pool.size() << " threads" << std::endl;
+	std::cout << "Time: scan " << time_scan << " s, plan " << time_plan << " s, merge " << time_merge
+			<< " s, finish " << time_now() - phase << " s, total " << time_now() - start << " s" << std::endl;
+
 	return OK;
 }
 
@@ -689,6 +1083,7 @@ int main(int argc, char *argv[])
 	}
 
 	ibis::gVerbose = -10;
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
 
 	/* Process arguments */
 	int option;
@@ -734,6 +1129,9 @@ int main(int argc, char *argv[])
 		case 'm':
 			moveOnly = 1;
 			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 10);
+			break;
 		case '?':
 			std::cerr << "Unknown argument: " << (char) optopt << std::endl;
 			usage();
@@ -40,9 +40,6 @@
 #ifndef FBITMERGE_H_
 #define FBITMERGE_H_
 
-typedef std::map<std::string, int> innerDirMap;
-typedef std::map<std::string, innerDirMap> DIRMAP;
-
 enum {
 	MAX_SEC = 59,
 	MAX_MIN = 59,
@@ -70,6 +67,10 @@ enum {
 	ASCII_ZERO = 48
 };
 
+enum {
+	COPY_BUFF_LEN = 1 << 16
+};
+
 enum key {
 	YEAR = 0,
 	MONTH = 1,
@@ -89,11 +90,45 @@ enum size {
 	BYTES_8 = 8
 };
 
+/**
+ * \brief Part (template directory) of a window
+ */
+struct part_info {
+	std::string name;                                /**< Directory name */
+	std::string path;                                /**< Directory path */
+	uint64_t rows;                                   /**< Number of rows */
+	std::map<std::string, std::string> columns;      /**< Column name -> data type */
+	std::string schema;                              /**< Canonical list of columns */
+};
+
+/**
+ * \brief Parts of a window directory
+ */
+struct window_scan {
+	std::string name;                                /**< Directory name */
+	std::string path;                                /**< Directory path */
+	std::vector<part_info> parts;                    /**< Non-empty parts */
+};
+
+/**
+ * \brief Parts with the same schema merged into one target
+ */
+struct merge_group {
+	part_info target;                                /**< Part in destination window */
+	std::vector<part_info> sources;                  /**< Parts appended to target */
+	size_t fallbacks = 0;                            /**< Parts merged by FastBit */
+	int status = NOT_OK;                             /**< Result of merging */
+};
+
 void usage();
 
 int merge_all(std::string workDir, uint16_t key, std::string prefix);
 
-int merge_couple(std::string src_dir, std::string dst_dir, std::string work_dir);
+int read_part_info(std::string path, part_info *info);
+
+int append_part(const part_info &src, part_info &dst, bool *fallback);
+
+int plan_groups(std::string work_dir, std::vector<window_scan *> &scans, std::vector<merge_group> &groups);
 
 int merge_dirs(std::string src_dir, std::string dst_dir);
 
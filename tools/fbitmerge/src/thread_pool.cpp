@@ -0,0 +1,144 @@
+/**
+ * \file thread_pool.cpp
+ * \brief Pool of worker threads for merging FastBit data
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <string.h>
+
+#include <iostream>
+
+#include "thread_pool.h"
+
+thread_pool::thread_pool(unsigned int threads) : running(0), done(false)
+{
+	pthread_t thread;
+	int ret;
+
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&job_cond, NULL);
+	pthread_cond_init(&done_cond, NULL);
+
+	for (unsigned int i = 0; i < threads; i++) {
+		ret = pthread_create(&thread, NULL, &thread_pool::worker, this);
+		if (ret != 0) {
+			std::cerr << "Failed to create worker thread: " << strerror(ret) << std::endl;
+			break;
+		}
+		this->threads.push_back(thread);
+	}
+}
+
+thread_pool::~thread_pool()
+{
+	pthread_mutex_lock(&mutex);
+	done = true;
+	pthread_cond_broadcast(&job_cond);
+	pthread_mutex_unlock(&mutex);
+
+	for (size_t i = 0; i < threads.size(); i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&done_cond);
+	pthread_cond_destroy(&job_cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+void thread_pool::submit(void (*func)(void *), void *arg)
+{
+	struct job job;
+
+	/* No workers available, do the job in the calling thread */
+	if (threads.empty()) {
+		func(arg);
+		return;
+	}
+
+	job.func = func;
+	job.arg = arg;
+
+	pthread_mutex_lock(&mutex);
+	jobs.push_back(job);
+	pthread_cond_signal(&job_cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void thread_pool::wait()
+{
+	pthread_mutex_lock(&mutex);
+	while (!jobs.empty() || running > 0) {
+		pthread_cond_wait(&done_cond, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+size_t thread_pool::size()
+{
+	return threads.size();
+}
+
+void *thread_pool::worker(void *arg)
+{
+	thread_pool *pool = (thread_pool *) arg;
+	struct job job;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (pool->jobs.empty() && !pool->done) {
+			pthread_cond_wait(&pool->job_cond, &pool->mutex);
+		}
+		if (pool->jobs.empty()) {
+			/* Pool is being destroyed and there is nothing left to do */
+			break;
+		}
+
+		job = pool->jobs.front();
+		pool->jobs.pop_front();
+		pool->running++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		job.func(job.arg);
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->running--;
+		if (pool->jobs.empty() && pool->running == 0) {
+			pthread_cond_broadcast(&pool->done_cond);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
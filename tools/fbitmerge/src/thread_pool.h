@@ -0,0 +1,101 @@
+/**
+ * \file thread_pool.h
+ * \brief Pool of worker threads for merging FastBit data
+ *
+ * Copyright (C) 2026 CESNET, z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is, and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+/**
+ * \brief Simple pool of worker threads
+ *
+ * Jobs are plain function pointers with an argument. The submitting thread
+ * calls wait() to block until all submitted jobs are finished.
+ *
+ * The same pool is used by the fastbit_compression storage plugin. fbitmerge
+ * is a separate package that does not depend on ipfixcol, so the code is
+ * copied; keep both copies in sync.
+ */
+class thread_pool {
+public:
+	/**
+	 * \brief Start worker threads
+	 *
+	 * \param[in] threads Number of worker threads (0 = run jobs in the caller)
+	 */
+	thread_pool(unsigned int threads);
+	~thread_pool();
+
+	/**
+	 * \brief Queue a job for one of the worker threads
+	 *
+	 * \param[in] func Function to be called
+	 * \param[in] arg Argument passed to func
+	 */
+	void submit(void (*func)(void *), void *arg);
+
+	/**
+	 * \brief Block until all submitted jobs are finished
+	 */
+	void wait();
+
+	/**
+	 * \brief Get number of worker threads
+	 */
+	size_t size();
+private:
+	struct job {
+		void (*func)(void *);
+		void *arg;
+	};
+
+	static void *worker(void *arg);
+
+	std::vector<pthread_t> threads;
+	std::deque<struct job> jobs;
+	pthread_mutex_t mutex;
+	pthread_cond_t job_cond;  /**< signalled when a job is queued */
+	pthread_cond_t done_cond; /**< signalled when the pool becomes idle */
+	size_t running;           /**< number of jobs being processed */
+	bool done;
+};
+
+#endif /* THREAD_POOL_H_ */